@@ -5,7 +5,7 @@
 SET(Boost_ADDITIONAL_VERSIONS "1.53" "1.53.0")
 SET(BOOST_ROOT ${whery_SOURCE_DIR}/../libraries/boost_1_53_0)
 SET(Boost_USE_STATIC_LIBS ON)
-FIND_PACKAGE(Boost 1.53.0 REQUIRED COMPONENTS date_time filesystem system thread unit_test_framework)
+FIND_PACKAGE(Boost 1.53.0 REQUIRED COMPONENTS chrono date_time filesystem system thread unit_test_framework)
 IF(Boost_FOUND)
 	INCLUDE_DIRECTORIES(${Boost_INCLUDE_DIRS})
 	LINK_DIRECTORIES(${Boost_LIBRARY_DIRS})
@@ -0,0 +1,513 @@
+/**
+ * bench-db: BTreeBenchmarks.cpp
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#include "BTreeBenchmarks.h"
+
+#include <algorithm>
+
+#include <boost/assign/list_of.hpp>
+#include <boost/atomic.hpp>
+using namespace boost::assign;
+
+#include "whery/db/base/DoubleFieldManipulator.h"
+#include "whery/db/base/FreshTuple.h"
+#include "whery/db/base/IntFieldManipulator.h"
+#include "whery/db/base/RangeKey.h"
+#include "whery/db/base/ValueKey.h"
+#include "whery/db/btrees/BTree.h"
+#include "whery/db/pages/InMemorySortedPage.h"
+using namespace whery;
+
+#include "KeyDistribution.h"
+
+//#################### LOCAL CLASSES ####################
+
+namespace {
+
+/**
+An instance of this class provides in-memory pages to a B+-tree with leaf tuples of the form
+<key,tuple ID,value> and branch tuples of the form <key,tuple ID,child node ID>. Keys need not
+be unique, since the tuple IDs are used to disambiguate any duplicates.
+*/
+class BenchmarkPageController : public BTreePageController
+{
+	//#################### PRIVATE VARIABLES ####################
+private:
+	/** The number of tuples that should fit on a B+-tree page. */
+	const unsigned int m_tuplesPerPage;
+
+	//#################### CONSTRUCTORS ####################
+public:
+	explicit BenchmarkPageController(unsigned int tuplesPerPage)
+	:	m_tuplesPerPage(tuplesPerPage)
+	{}
+
+	//#################### PUBLIC INHERITED METHODS ####################
+public:
+	virtual TupleManipulator btree_branch_tuple_manipulator() const
+	{
+		return TupleManipulator(list_of<const FieldManipulator*>
+			(&IntFieldManipulator::instance())
+			(&IntFieldManipulator::instance())
+			(&IntFieldManipulator::instance())
+		);
+	}
+
+	virtual TupleManipulator btree_leaf_tuple_manipulator() const
+	{
+		return TupleManipulator(list_of<const FieldManipulator*>
+			(&IntFieldManipulator::instance())
+			(&IntFieldManipulator::instance())
+			(&DoubleFieldManipulator::instance())
+		);
+	}
+
+	virtual SortedPage_Ptr make_btree_branch_page() const
+	{
+		TupleManipulator tupleManipulator = btree_branch_tuple_manipulator();
+		return SortedPage_Ptr(new InMemorySortedPage(InMemorySortedPage::buffer_size_for(m_tuplesPerPage, tupleManipulator), tupleManipulator));
+	}
+
+	virtual SortedPage_Ptr make_btree_leaf_page() const
+	{
+		TupleManipulator tupleManipulator = btree_leaf_tuple_manipulator();
+		return SortedPage_Ptr(new InMemorySortedPage(InMemorySortedPage::buffer_size_for(m_tuplesPerPage, tupleManipulator), tupleManipulator));
+	}
+};
+
+/**
+An instance of a class deriving from this one represents a benchmark of a B+-tree operation.
+*/
+class BTreeBenchmark : public Benchmark
+{
+	//#################### PROTECTED VARIABLES ####################
+protected:
+	/** The distribution from which the keys used by the operations are drawn. */
+	const KeyDistribution m_distribution;
+
+	/** The keys used by the operations. */
+	std::vector<int> m_keys;
+
+	/** The page controller for the B+-tree. */
+	const BTreePageController_CPtr m_pageController;
+
+	/** The seed to use when generating keys. */
+	const unsigned int m_seed;
+
+	/** A running checksum of the operations' results (this stops the compiler from optimising the operations away). */
+	unsigned int m_sink;
+
+	/** The B+-tree. */
+	boost::shared_ptr<BTree> m_tree;
+
+	/** The number of tuples with which to populate the B+-tree. */
+	const unsigned int m_tupleCount;
+
+	//#################### CONSTRUCTORS ####################
+protected:
+	BTreeBenchmark(const std::string& name, unsigned int opCount, KeyDistribution distribution, unsigned int tupleCount, unsigned int tuplesPerPage, unsigned int seed, unsigned int sampleSize = 1)
+	:	Benchmark(name, opCount, sampleSize),
+		m_distribution(distribution),
+		m_pageController(new BenchmarkPageController(tuplesPerPage)),
+		m_seed(seed),
+		m_sink(0),
+		m_tupleCount(tupleCount)
+	{
+		add_param("distribution", to_string(distribution));
+		add_param("tuples", tupleCount);
+		add_param("tuples_per_page", tuplesPerPage);
+	}
+
+	//#################### PROTECTED METHODS ####################
+protected:
+	/**
+	Makes a fresh B+-tree containing the tuples <k * stride,k,k * 0.5> for each k in [0,m_tupleCount).
+	The tuples are inserted in random order, so that the pages end up partially full, as they would
+	in a B+-tree that had been built up over time.
+
+	\param stride	The spacing between adjacent keys in the B+-tree.
+	*/
+	void make_populated_tree(int stride)
+	{
+		m_tree.reset(new BTree(m_pageController));
+		FreshTuple tuple(m_tree->leaf_tuple_manipulator());
+		std::vector<int> ids = generate_permutation(m_tupleCount, m_seed + 2);
+		for(unsigned int i = 0; i < m_tupleCount; ++i)
+		{
+			tuple.field(0).set_int(ids[i] * stride);
+			tuple.field(1).set_int(ids[i]);
+			tuple.field(2).set_double(ids[i] * 0.5);
+			m_tree->insert_tuple(tuple);
+		}
+	}
+};
+
+/**
+An instance of this class benchmarks range scans over a B+-tree that read the tuples a leaf at a time using a batch cursor
+(each scan finds the start of the range and then reads a fixed number of tuples, so that the results are directly comparable
+with those for btree_scan).
+*/
+class BTreeBatchScanBenchmark : public BTreeBenchmark
+{
+	//#################### PRIVATE VARIABLES ####################
+private:
+	/** The key at which to start each scan. */
+	ValueKey m_key;
+
+	/** The number of tuples to visit in each scan. */
+	const unsigned int m_scanLength;
+
+	/** A buffer into which to decode the tuple IDs of each batch. */
+	std::vector<int> m_tupleIDs;
+
+	//#################### CONSTRUCTORS ####################
+public:
+	BTreeBatchScanBenchmark(KeyDistribution distribution, unsigned int scanLength, unsigned int tupleCount, unsigned int tuplesPerPage, unsigned int seed)
+	:	BTreeBenchmark("btree_batch_scan", std::max(1u, tupleCount / scanLength), distribution, tupleCount, tuplesPerPage, seed),
+		m_key(m_pageController->btree_leaf_tuple_manipulator(), list_of(0)),
+		m_scanLength(scanLength)
+	{
+		add_param("scan_length", scanLength);
+	}
+
+	//#################### PROTECTED METHODS ####################
+protected:
+	virtual void run_op(unsigned int i)
+	{
+		m_key.field(0).set_int(m_keys[i]);
+		BTree::BatchCursor cursor(m_tree->lower_bound(m_key), m_tree->end());
+		for(unsigned int remaining = m_scanLength; remaining > 0 && cursor.next();)
+		{
+			cursor.read_ints(1, m_tupleIDs);
+			const unsigned int n = std::min(remaining, cursor.size());
+			for(unsigned int j = 0; j < n; ++j) m_sink += m_tupleIDs[j];
+			remaining -= n;
+		}
+	}
+
+	virtual void set_up()
+	{
+		make_populated_tree(1);
+		m_keys = generate_keys(m_distribution, op_count(), m_tupleCount, m_seed);
+	}
+};
+
+/**
+An instance of this class benchmarks erasing tuples from a B+-tree (in an order determined by the key distribution).
+*/
+class BTreeEraseBenchmark : public BTreeBenchmark
+{
+	//#################### PRIVATE VARIABLES ####################
+private:
+	/** The key used to find the tuples to erase. */
+	ValueKey m_key;
+
+	//#################### CONSTRUCTORS ####################
+public:
+	BTreeEraseBenchmark(KeyDistribution distribution, unsigned int tupleCount, unsigned int tuplesPerPage, unsigned int seed)
+	:	BTreeBenchmark("btree_erase", tupleCount, distribution, tupleCount, tuplesPerPage, seed),
+		m_key(m_pageController->btree_leaf_tuple_manipulator(), list_of(0))
+	{}
+
+	//#################### PROTECTED METHODS ####################
+protected:
+	virtual void run_op(unsigned int i)
+	{
+		m_key.field(0).set_int(m_keys[i]);
+		m_tree->erase_tuple(m_key);
+	}
+
+	virtual void set_up()
+	{
+		make_populated_tree(1);
+
+		// Erase every tuple exactly once, either in key order or in a random order.
+		if(m_distribution == KD_SEQUENTIAL) m_keys = generate_keys(KD_SEQUENTIAL, m_tupleCount, m_tupleCount, m_seed);
+		else m_keys = generate_permutation(m_tupleCount, m_seed);
+	}
+};
+
+/**
+An instance of this class benchmarks finding tuples in a B+-tree (all of the keys searched for are present).
+*/
+class BTreeFindBenchmark : public BTreeBenchmark
+{
+	//#################### PRIVATE VARIABLES ####################
+private:
+	/** The key to search for. */
+	ValueKey m_key;
+
+	//#################### CONSTRUCTORS ####################
+public:
+	BTreeFindBenchmark(KeyDistribution distribution, unsigned int tupleCount, unsigned int tuplesPerPage, unsigned int seed)
+	:	BTreeBenchmark("btree_find", tupleCount, distribution, tupleCount, tuplesPerPage, seed),
+		m_key(m_pageController->btree_leaf_tuple_manipulator(), list_of(0))
+	{}
+
+	//#################### PROTECTED METHODS ####################
+protected:
+	virtual void run_op(unsigned int i)
+	{
+		m_key.field(0).set_int(m_keys[i]);
+		BTree::ConstIterator it = m_tree->find(m_key);
+		if(it != m_tree->end()) m_sink += it->field(1).get_int();
+	}
+
+	virtual void set_up()
+	{
+		make_populated_tree(1);
+		m_keys = generate_keys(m_distribution, op_count(), m_tupleCount, m_seed);
+	}
+};
+
+/**
+An instance of this class benchmarks finding tuples in a B+-tree in batches (all of the keys searched for are present).
+Each operation is the lookup of a single key, so that the results are directly comparable with those for btree_find:
+the whole of each batch is looked up by the first operation in it, and the operations are timed a batch at a time.
+*/
+class BTreeFindBatchBenchmark : public BTreeBenchmark
+{
+	//#################### PRIVATE VARIABLES ####################
+private:
+	/** The number of keys to look up in each batch. */
+	const unsigned int m_batchSize;
+
+	/** The batches of keys to search for. */
+	std::vector<std::vector<ValueKey> > m_batches;
+
+	//#################### CONSTRUCTORS ####################
+public:
+	BTreeFindBatchBenchmark(KeyDistribution distribution, unsigned int batchSize, unsigned int tupleCount, unsigned int tuplesPerPage, unsigned int seed)
+	:	BTreeBenchmark("btree_find_batch", tupleCount, distribution, tupleCount, tuplesPerPage, seed, batchSize),
+		m_batchSize(batchSize)
+	{
+		add_param("batch_size", batchSize);
+	}
+
+	//#################### PROTECTED METHODS ####################
+protected:
+	virtual void run_op(unsigned int i)
+	{
+		if(i % m_batchSize != 0) return;
+
+		std::vector<BTree::ConstIterator> results = m_tree->find_batch(m_batches[i / m_batchSize]);
+		BTree::ConstIterator iend = m_tree->end();
+		for(std::vector<BTree::ConstIterator>::const_iterator it = results.begin(), jend = results.end(); it != jend; ++it)
+		{
+			if(*it != iend) m_sink += (*it)->field(1).get_int();
+		}
+	}
+
+	virtual void set_up()
+	{
+		make_populated_tree(1);
+		m_keys = generate_keys(m_distribution, op_count(), m_tupleCount, m_seed);
+
+		// Build the batches of keys in advance, so that their construction is not timed.
+		ValueKey key(m_pageController->btree_leaf_tuple_manipulator(), list_of(0));
+		m_batches.clear();
+		for(unsigned int i = 0, size = op_count(); i < size; ++i)
+		{
+			if(i % m_batchSize == 0) m_batches.push_back(std::vector<ValueKey>());
+			key.field(0).set_int(m_keys[i]);
+			m_batches.back().push_back(key);
+		}
+	}
+};
+
+/**
+An instance of this class benchmarks inserting tuples into an initially empty B+-tree.
+*/
+class BTreeInsertBenchmark : public BTreeBenchmark
+{
+	//#################### PRIVATE VARIABLES ####################
+private:
+	/** The tuple to insert. */
+	FreshTuple m_tuple;
+
+	//#################### CONSTRUCTORS ####################
+public:
+	BTreeInsertBenchmark(KeyDistribution distribution, unsigned int tupleCount, unsigned int tuplesPerPage, unsigned int seed)
+	:	BTreeBenchmark("btree_insert", tupleCount, distribution, tupleCount, tuplesPerPage, seed),
+		m_tuple(m_pageController->btree_leaf_tuple_manipulator())
+	{}
+
+	//#################### PROTECTED METHODS ####################
+protected:
+	virtual void run_op(unsigned int i)
+	{
+		m_tuple.field(0).set_int(m_keys[i]);
+		m_tuple.field(1).set_int(i);
+		m_tuple.field(2).set_double(i * 0.5);
+		m_tree->insert_tuple(m_tuple);
+	}
+
+	virtual void set_up()
+	{
+		m_tree.reset(new BTree(m_pageController));
+		m_keys = generate_keys(m_distribution, op_count(), m_tupleCount, m_seed);
+	}
+};
+
+/**
+An instance of this class benchmarks finding lower bounds in a B+-tree (only half of the keys searched for are present).
+*/
+class BTreeLowerBoundBenchmark : public BTreeBenchmark
+{
+	//#################### PRIVATE VARIABLES ####################
+private:
+	/** The key to search for. */
+	ValueKey m_key;
+
+	//#################### CONSTRUCTORS ####################
+public:
+	BTreeLowerBoundBenchmark(KeyDistribution distribution, unsigned int tupleCount, unsigned int tuplesPerPage, unsigned int seed)
+	:	BTreeBenchmark("btree_lower_bound", tupleCount, distribution, tupleCount, tuplesPerPage, seed),
+		m_key(m_pageController->btree_leaf_tuple_manipulator(), list_of(0))
+	{}
+
+	//#################### PROTECTED METHODS ####################
+protected:
+	virtual void run_op(unsigned int i)
+	{
+		m_key.field(0).set_int(m_keys[i]);
+		BTree::ConstIterator it = m_tree->lower_bound(m_key);
+		if(it != m_tree->end()) m_sink += it->field(1).get_int();
+	}
+
+	virtual void set_up()
+	{
+		// Populate the B+-tree with even keys, and search for a mixture of even and odd ones.
+		make_populated_tree(2);
+		m_keys = generate_keys(m_distribution, op_count(), 2 * m_tupleCount, m_seed);
+	}
+};
+
+/**
+An instance of this class benchmarks full-table aggregations over a B+-tree using parallel scans.
+*/
+class BTreeParallelScanBenchmark : public BTreeBenchmark
+{
+	//#################### NESTED TYPES ####################
+private:
+	/**
+	\brief An instance of this struct sums a field of the tuples in each run of a scan, and adds the
+	result to a shared total (so that the threads only synchronise once per run, not once per tuple).
+	*/
+	struct RunSummer
+	{
+		boost::atomic<unsigned int> *total;
+
+		void operator()(const BTree::ConstIterator& begin, const BTree::ConstIterator& end) const
+		{
+			unsigned int sum = 0;
+			for(BTree::ConstIterator it = begin; it != end; ++it) sum += it->field(1).get_int();
+			*total += sum;
+		}
+	};
+
+	//#################### PRIVATE VARIABLES ####################
+private:
+	/** A range key covering the whole B+-tree. */
+	RangeKey m_key;
+
+	/** The number of threads to use for each scan. */
+	const unsigned int m_threadCount;
+
+	//#################### CONSTRUCTORS ####################
+public:
+	BTreeParallelScanBenchmark(unsigned int threadCount, unsigned int tupleCount, unsigned int tuplesPerPage, unsigned int seed)
+	:	BTreeBenchmark("btree_parallel_scan", 10, KD_SEQUENTIAL, tupleCount, tuplesPerPage, seed),
+		m_key(m_pageController->btree_leaf_tuple_manipulator().field_manipulators(), list_of(0)),
+		m_threadCount(threadCount)
+	{
+		add_param("threads", threadCount);
+		m_key.clear_low_endpoint();
+		m_key.clear_high_endpoint();
+	}
+
+	//#################### PROTECTED METHODS ####################
+protected:
+	virtual void run_op(unsigned int /*i*/)
+	{
+		boost::atomic<unsigned int> total(0);
+		RunSummer summer = { &total };
+		m_tree->parallel_scan(m_key, m_threadCount, summer);
+		m_sink += total;
+	}
+
+	virtual void set_up()
+	{
+		make_populated_tree(1);
+	}
+};
+
+/**
+An instance of this class benchmarks range scans over a B+-tree (each of which
+finds the start of the range and then iterates over a fixed number of tuples).
+*/
+class BTreeScanBenchmark : public BTreeBenchmark
+{
+	//#################### PRIVATE VARIABLES ####################
+private:
+	/** The key at which to start each scan. */
+	ValueKey m_key;
+
+	/** The number of tuples to visit in each scan. */
+	const unsigned int m_scanLength;
+
+	//#################### CONSTRUCTORS ####################
+public:
+	BTreeScanBenchmark(KeyDistribution distribution, unsigned int scanLength, unsigned int tupleCount, unsigned int tuplesPerPage, unsigned int seed)
+	:	BTreeBenchmark("btree_scan", std::max(1u, tupleCount / scanLength), distribution, tupleCount, tuplesPerPage, seed),
+		m_key(m_pageController->btree_leaf_tuple_manipulator(), list_of(0)),
+		m_scanLength(scanLength)
+	{
+		add_param("scan_length", scanLength);
+	}
+
+	//#################### PROTECTED METHODS ####################
+protected:
+	virtual void run_op(unsigned int i)
+	{
+		m_key.field(0).set_int(m_keys[i]);
+		BTree::ConstIterator it = m_tree->lower_bound(m_key), iend = m_tree->end();
+		for(unsigned int j = 0; j < m_scanLength && it != iend; ++j, ++it)
+		{
+			m_sink += it->field(1).get_int();
+		}
+	}
+
+	virtual void set_up()
+	{
+		make_populated_tree(1);
+		m_keys = generate_keys(m_distribution, op_count(), m_tupleCount, m_seed);
+	}
+};
+
+}
+
+//#################### GLOBAL FUNCTIONS ####################
+
+void add_btree_benchmarks(std::vector<Benchmark_Ptr>& benchmarks, unsigned int tupleCount, unsigned int tuplesPerPage, unsigned int seed)
+{
+	benchmarks.push_back(Benchmark_Ptr(new BTreeInsertBenchmark(KD_SEQUENTIAL, tupleCount, tuplesPerPage, seed)));
+	benchmarks.push_back(Benchmark_Ptr(new BTreeInsertBenchmark(KD_RANDOM, tupleCount, tuplesPerPage, seed)));
+	benchmarks.push_back(Benchmark_Ptr(new BTreeInsertBenchmark(KD_ZIPFIAN, tupleCount, tuplesPerPage, seed)));
+	benchmarks.push_back(Benchmark_Ptr(new BTreeFindBenchmark(KD_RANDOM, tupleCount, tuplesPerPage, seed)));
+	benchmarks.push_back(Benchmark_Ptr(new BTreeFindBenchmark(KD_ZIPFIAN, tupleCount, tuplesPerPage, seed)));
+	benchmarks.push_back(Benchmark_Ptr(new BTreeFindBatchBenchmark(KD_RANDOM, 64, tupleCount, tuplesPerPage, seed)));
+	benchmarks.push_back(Benchmark_Ptr(new BTreeFindBatchBenchmark(KD_RANDOM, 1024, tupleCount, tuplesPerPage, seed)));
+	benchmarks.push_back(Benchmark_Ptr(new BTreeFindBatchBenchmark(KD_ZIPFIAN, 64, tupleCount, tuplesPerPage, seed)));
+	benchmarks.push_back(Benchmark_Ptr(new BTreeLowerBoundBenchmark(KD_RANDOM, tupleCount, tuplesPerPage, seed)));
+	benchmarks.push_back(Benchmark_Ptr(new BTreeScanBenchmark(KD_RANDOM, 10, tupleCount, tuplesPerPage, seed)));
+	benchmarks.push_back(Benchmark_Ptr(new BTreeScanBenchmark(KD_RANDOM, 1000, tupleCount, tuplesPerPage, seed)));
+	benchmarks.push_back(Benchmark_Ptr(new BTreeBatchScanBenchmark(KD_RANDOM, 10, tupleCount, tuplesPerPage, seed)));
+	benchmarks.push_back(Benchmark_Ptr(new BTreeBatchScanBenchmark(KD_RANDOM, 1000, tupleCount, tuplesPerPage, seed)));
+	benchmarks.push_back(Benchmark_Ptr(new BTreeParallelScanBenchmark(1, tupleCount, tuplesPerPage, seed)));
+	benchmarks.push_back(Benchmark_Ptr(new BTreeParallelScanBenchmark(4, tupleCount, tuplesPerPage, seed)));
+	benchmarks.push_back(Benchmark_Ptr(new BTreeEraseBenchmark(KD_SEQUENTIAL, tupleCount, tuplesPerPage, seed)));
+	benchmarks.push_back(Benchmark_Ptr(new BTreeEraseBenchmark(KD_RANDOM, tupleCount, tuplesPerPage, seed)));
+}
@@ -0,0 +1,23 @@
+/**
+ * bench-db: BTreeBenchmarks.h
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#ifndef H_BENCHDB_BTREEBENCHMARKS
+#define H_BENCHDB_BTREEBENCHMARKS
+
+#include "Benchmark.h"
+
+//#################### GLOBAL FUNCTIONS ####################
+
+/**
+Adds benchmarks for the main B+-tree operations (insertion, search, range scans and erasure) to a list.
+
+\param benchmarks		The list of benchmarks.
+\param tupleCount		The number of tuples with which to populate each B+-tree.
+\param tuplesPerPage	The number of tuples that should fit on each B+-tree page.
+\param seed				The seed to use when generating keys.
+*/
+void add_btree_benchmarks(std::vector<Benchmark_Ptr>& benchmarks, unsigned int tupleCount, unsigned int tuplesPerPage, unsigned int seed);
+
+#endif
@@ -0,0 +1,122 @@
+/**
+ * bench-db: Benchmark.cpp
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#include "Benchmark.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <boost/chrono/chrono.hpp>
+#include <boost/lexical_cast.hpp>
+
+//#################### LOCAL FUNCTIONS ####################
+
+namespace {
+
+/**
+Returns the specified percentile of a sorted array of values (using the nearest-rank method).
+
+\param values	The sorted array of values (must be non-empty).
+\param p		The percentile (in the range [0,100]).
+\return			The specified percentile of the values.
+*/
+double percentile(const std::vector<double>& values, double p)
+{
+	size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * values.size()));
+	return values[std::max<size_t>(rank, 1) - 1];
+}
+
+}
+
+//#################### CONSTRUCTORS ####################
+
+Benchmark::Benchmark(const std::string& name, unsigned int opCount, unsigned int sampleSize)
+:	m_name(name), m_opCount(opCount), m_sampleSize(std::max(1u, sampleSize))
+{}
+
+//#################### DESTRUCTOR ####################
+
+Benchmark::~Benchmark() {}
+
+//#################### PUBLIC METHODS ####################
+
+const std::string& Benchmark::name() const
+{
+	return m_name;
+}
+
+void Benchmark::run(std::ostream& os)
+{
+	typedef boost::chrono::high_resolution_clock Clock;
+	using boost::chrono::duration_cast;
+	using boost::chrono::nanoseconds;
+
+	set_up();
+
+	// Perform the operations, timing them in samples of (up to) m_sampleSize operations each. The latency
+	// recorded for each operation in a sample is the mean latency of the operations in that sample.
+	std::vector<double> latencies;
+	latencies.reserve(m_opCount / m_sampleSize + 1);
+	double totalNanoseconds = 0.0;
+	for(unsigned int i = 0; i < m_opCount; i += m_sampleSize)
+	{
+		const unsigned int end = std::min(i + m_sampleSize, m_opCount);
+		for(unsigned int j = i; j < end; ++j) prepare_op(j);
+
+		Clock::time_point start = Clock::now();
+		for(unsigned int j = i; j < end; ++j) run_op(j);
+		double sampleNanoseconds = static_cast<double>(duration_cast<nanoseconds>(Clock::now() - start).count());
+
+		totalNanoseconds += sampleNanoseconds;
+		latencies.push_back(sampleNanoseconds / (end - i));
+	}
+
+	// Write the results.
+	os << "{\"benchmark\":\"" << m_name << "\",\"params\":{";
+	for(size_t i = 0, size = m_params.size(); i < size; ++i)
+	{
+		if(i != 0) os << ',';
+		os << '"' << m_params[i].first << "\":" << m_params[i].second;
+	}
+	os << "},\"ops\":" << m_opCount;
+
+	if(!latencies.empty())
+	{
+		std::sort(latencies.begin(), latencies.end());
+		const double seconds = totalNanoseconds / 1e9;
+		os << ",\"seconds\":" << seconds
+		   << ",\"ops_per_sec\":" << (seconds > 0.0 ? m_opCount / seconds : 0.0)
+		   << ",\"latency_ns\":{"
+		   << "\"mean\":" << totalNanoseconds / m_opCount
+		   << ",\"p50\":" << percentile(latencies, 50.0)
+		   << ",\"p90\":" << percentile(latencies, 90.0)
+		   << ",\"p99\":" << percentile(latencies, 99.0)
+		   << ",\"p99.9\":" << percentile(latencies, 99.9)
+		   << ",\"max\":" << latencies.back()
+		   << '}';
+	}
+
+	os << "}\n";
+	os.flush();
+}
+
+//#################### PROTECTED METHODS ####################
+
+void Benchmark::add_param(const std::string& name, const std::string& value)
+{
+	m_params.push_back(std::make_pair(name, '"' + value + '"'));
+}
+
+void Benchmark::add_param(const std::string& name, unsigned int value)
+{
+	m_params.push_back(std::make_pair(name, boost::lexical_cast<std::string>(value)));
+}
+
+unsigned int Benchmark::op_count() const
+{
+	return m_opCount;
+}
+
+void Benchmark::prepare_op(unsigned int /*i*/) {}
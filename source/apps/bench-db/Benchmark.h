@@ -0,0 +1,130 @@
+/**
+ * bench-db: Benchmark.h
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#ifndef H_BENCHDB_BENCHMARK
+#define H_BENCHDB_BENCHMARK
+
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+
+/**
+\brief An instance of a class deriving from this one represents a parameterised microbenchmark.
+
+A benchmark consists of a number of operations (e.g. B+-tree insertions), which are timed in
+samples of one or more operations each. Derived classes set up the state for the benchmark
+in set_up(), and then perform the individual operations in run_op(). Any work that needs
+to be done before an operation but should not be timed (e.g. refilling a page) can be done
+in prepare_op(). Operations that are too fast to time individually should be timed in larger
+samples, since the overhead of reading the clock is included in each sample.
+*/
+class Benchmark
+{
+	//#################### PRIVATE VARIABLES ####################
+private:
+	/** The name of the benchmark. */
+	std::string m_name;
+
+	/** The number of operations to perform. */
+	unsigned int m_opCount;
+
+	/** The parameters of the benchmark (as name/value pairs), for reporting purposes. */
+	std::vector<std::pair<std::string,std::string> > m_params;
+
+	/** The number of operations to time in each sample. */
+	unsigned int m_sampleSize;
+
+	//#################### CONSTRUCTORS ####################
+protected:
+	/**
+	Constructs a benchmark.
+
+	\param name			The name of the benchmark.
+	\param opCount		The number of operations to perform.
+	\param sampleSize	The number of operations to time in each sample.
+	*/
+	Benchmark(const std::string& name, unsigned int opCount, unsigned int sampleSize = 1);
+
+	//#################### DESTRUCTOR ####################
+public:
+	/**
+	Destroys the benchmark.
+	*/
+	virtual ~Benchmark();
+
+	//#################### PROTECTED ABSTRACT METHODS ####################
+protected:
+	/**
+	Performs the specified operation.
+
+	\param i	The index of the operation (in the range [0,op_count())).
+	*/
+	virtual void run_op(unsigned int i) = 0;
+
+	/**
+	Sets up the state for the benchmark (this is not timed).
+	*/
+	virtual void set_up() = 0;
+
+	//#################### PUBLIC METHODS ####################
+public:
+	/**
+	Returns the name of the benchmark.
+
+	\return	The name of the benchmark.
+	*/
+	const std::string& name() const;
+
+	/**
+	Runs the benchmark and writes the results to the specified stream as a single line of JSON. The results
+	contain the benchmark's name and parameters, the number of operations performed, the total time taken
+	(in seconds), the throughput (in operations per second) and the mean and various percentiles of the
+	per-operation latency (in nanoseconds).
+
+	\param os	The stream.
+	*/
+	void run(std::ostream& os);
+
+	//#################### PROTECTED METHODS ####################
+protected:
+	/**
+	Adds a parameter to the benchmark for reporting purposes.
+
+	\param name		The name of the parameter.
+	\param value	The value of the parameter.
+	*/
+	void add_param(const std::string& name, const std::string& value);
+
+	/**
+	Adds a parameter to the benchmark for reporting purposes.
+
+	\param name		The name of the parameter.
+	\param value	The value of the parameter.
+	*/
+	void add_param(const std::string& name, unsigned int value);
+
+	/**
+	Returns the number of operations to perform.
+
+	\return	The number of operations to perform.
+	*/
+	unsigned int op_count() const;
+
+	/**
+	Prepares for the specified operation (this is not timed). By default, this does nothing.
+
+	\param i	The index of the operation (in the range [0,op_count())).
+	*/
+	virtual void prepare_op(unsigned int i);
+};
+
+//#################### TYPEDEFS ####################
+
+typedef boost::shared_ptr<Benchmark> Benchmark_Ptr;
+
+#endif
@@ -0,0 +1,135 @@
+/**
+ * bench-db: ComparatorBenchmarks.cpp
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#include "ComparatorBenchmarks.h"
+
+#include <boost/assign/list_of.hpp>
+using namespace boost::assign;
+
+#include "whery/db/base/DoubleFieldManipulator.h"
+#include "whery/db/base/FreshTuple.h"
+#include "whery/db/base/IntFieldManipulator.h"
+#include "whery/db/base/PrefixTupleComparator.h"
+#include "whery/db/base/TupleComparator.h"
+using namespace whery;
+
+#include "KeyDistribution.h"
+
+//#################### LOCAL CONSTANTS ####################
+
+namespace {
+
+/** The number of comparisons to time in each sample (a single comparison is too quick to time accurately). */
+const unsigned int COMPARISONS_PER_SAMPLE = 64;
+
+/** The number of distinct tuples to compare (small enough for them all to stay in cache). */
+const unsigned int TUPLE_COUNT = 1024;
+
+}
+
+//#################### LOCAL CLASSES ####################
+
+namespace {
+
+/**
+An instance of an instantiation of this class template benchmarks a tuple comparator by using it to
+compare pairs of tuples of the form <a,b,c>, where a is an int, b is a double and c is an int. The
+values of a and b are drawn from small ranges so that many of the comparisons need to look beyond
+the first field. The left-hand tuples can optionally be truncated to a prefix of their fields.
+*/
+template <typename Comparator>
+class ComparatorBenchmark : public Benchmark
+{
+	//#################### PRIVATE VARIABLES ####################
+private:
+	/** The comparator to benchmark. */
+	Comparator m_comparator;
+
+	/** The left-hand tuples to compare. */
+	std::vector<FreshTuple> m_lhs;
+
+	/** The number of fields in each left-hand tuple. */
+	const unsigned int m_lhsArity;
+
+	/** The right-hand tuples to compare. */
+	std::vector<FreshTuple> m_rhs;
+
+	/** The seed to use when generating the tuples. */
+	const unsigned int m_seed;
+
+	/** A running checksum of the comparison results (this stops the compiler from optimising the comparisons away). */
+	int m_sink;
+
+	//#################### CONSTRUCTORS ####################
+public:
+	ComparatorBenchmark(const std::string& name, const Comparator& comparator, const std::string& directions, unsigned int lhsArity, unsigned int opCount, unsigned int seed)
+	:	Benchmark(name, opCount, COMPARISONS_PER_SAMPLE), m_comparator(comparator), m_lhsArity(lhsArity), m_seed(seed), m_sink(0)
+	{
+		add_param("directions", directions);
+		add_param("lhs_arity", lhsArity);
+	}
+
+	//#################### PROTECTED METHODS ####################
+protected:
+	virtual void run_op(unsigned int i)
+	{
+		m_sink += m_comparator.compare(m_lhs[i % TUPLE_COUNT], m_rhs[(i * 7) % TUPLE_COUNT]);
+	}
+
+	virtual void set_up()
+	{
+		std::vector<const FieldManipulator*> fieldManipulators = list_of<const FieldManipulator*>
+			(&IntFieldManipulator::instance())
+			(&DoubleFieldManipulator::instance())
+			(&IntFieldManipulator::instance());
+		std::vector<const FieldManipulator*> lhsFieldManipulators(fieldManipulators.begin(), fieldManipulators.begin() + m_lhsArity);
+
+		std::vector<int> a = generate_keys(KD_RANDOM, 2 * TUPLE_COUNT, 4, m_seed);
+		std::vector<int> b = generate_keys(KD_RANDOM, 2 * TUPLE_COUNT, 4, m_seed + 1);
+		std::vector<int> c = generate_keys(KD_RANDOM, 2 * TUPLE_COUNT, TUPLE_COUNT, m_seed + 2);
+		for(unsigned int i = 0; i < TUPLE_COUNT; ++i)
+		{
+			FreshTuple lhs(lhsFieldManipulators), rhs(fieldManipulators);
+			set_fields(lhs, a[i], b[i], c[i]);
+			set_fields(rhs, a[TUPLE_COUNT + i], b[TUPLE_COUNT + i], c[TUPLE_COUNT + i]);
+			m_lhs.push_back(lhs);
+			m_rhs.push_back(rhs);
+		}
+	}
+
+	//#################### PRIVATE STATIC METHODS ####################
+private:
+	/**
+	Sets the fields of a tuple of the form <a,b,c> (or a prefix thereof).
+
+	\param tuple	The tuple.
+	\param a		The value of its first field.
+	\param b		Twice the value of its second field.
+	\param c		The value of its third field.
+	*/
+	static void set_fields(FreshTuple& tuple, int a, int b, int c)
+	{
+		if(tuple.arity() > 0) tuple.field(0).set_int(a);
+		if(tuple.arity() > 1) tuple.field(1).set_double(b * 0.5);
+		if(tuple.arity() > 2) tuple.field(2).set_int(c);
+	}
+};
+
+}
+
+//#################### GLOBAL FUNCTIONS ####################
+
+void add_comparator_benchmarks(std::vector<Benchmark_Ptr>& benchmarks, unsigned int opCount, unsigned int seed)
+{
+	std::vector<std::pair<unsigned int,SortDirection> > mixedFieldIndices = list_of
+		(std::make_pair(1u, DESC))
+		(std::make_pair(0u, ASC))
+		(std::make_pair(2u, DESC));
+
+	benchmarks.push_back(Benchmark_Ptr(new ComparatorBenchmark<TupleComparator>("tuple_comparator", TupleComparator::make_default(3), "asc", 3, opCount, seed)));
+	benchmarks.push_back(Benchmark_Ptr(new ComparatorBenchmark<TupleComparator>("tuple_comparator", TupleComparator(mixedFieldIndices), "mixed", 3, opCount, seed)));
+	benchmarks.push_back(Benchmark_Ptr(new ComparatorBenchmark<PrefixTupleComparator>("prefix_tuple_comparator", PrefixTupleComparator(), "asc", 3, opCount, seed)));
+	benchmarks.push_back(Benchmark_Ptr(new ComparatorBenchmark<PrefixTupleComparator>("prefix_tuple_comparator", PrefixTupleComparator(), "asc", 2, opCount, seed)));
+}
@@ -0,0 +1,22 @@
+/**
+ * bench-db: ComparatorBenchmarks.h
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#ifndef H_BENCHDB_COMPARATORBENCHMARKS
+#define H_BENCHDB_COMPARATORBENCHMARKS
+
+#include "Benchmark.h"
+
+//#################### GLOBAL FUNCTIONS ####################
+
+/**
+Adds benchmarks for the throughput of the tuple comparators to a list.
+
+\param benchmarks	The list of benchmarks.
+\param opCount		The number of comparisons to perform in each benchmark.
+\param seed			The seed to use when generating the tuples to compare.
+*/
+void add_comparator_benchmarks(std::vector<Benchmark_Ptr>& benchmarks, unsigned int opCount, unsigned int seed);
+
+#endif
@@ -0,0 +1,147 @@
+/**
+ * bench-db: IDAllocatorBenchmarks.cpp
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#include "IDAllocatorBenchmarks.h"
+
+#include <set>
+#include <stdexcept>
+
+#include "whery/util/IDAllocator.h"
+using namespace whery;
+
+#include "KeyDistribution.h"
+
+//#################### LOCAL CONSTANTS ####################
+
+namespace {
+
+/** The number of allocations and deallocations to time in each sample (a single one is too quick to time accurately). */
+const unsigned int OPS_PER_SAMPLE = 64;
+
+}
+
+//#################### LOCAL CLASSES ####################
+
+namespace {
+
+/**
+An instance of this class allocates IDs in the same way as IDAllocator, but keeps both the
+free and used IDs in sets (as IDAllocator originally did). It is retained as a baseline.
+*/
+class SetIDAllocator
+{
+	//#################### PRIVATE VARIABLES ####################
+private:
+	/** A free list of IDs that have been deallocated - these can be reallocated by allocate(). */
+	std::set<int> m_free;
+
+	/** The set of IDs that are currently in use. */
+	std::set<int> m_used;
+
+	//#################### PUBLIC METHODS ####################
+public:
+	int allocate()
+	{
+		int n;
+
+		if(!m_free.empty())
+		{
+			n = *m_free.begin();
+			m_free.erase(m_free.begin());
+		}
+		else
+		{
+			n = static_cast<int>(m_used.size());
+		}
+
+		m_used.insert(n);
+		return n;
+	}
+
+	void deallocate(int n)
+	{
+		std::set<int>::iterator it = m_used.find(n);
+		if(it == m_used.end())
+		{
+			throw std::invalid_argument("The specified ID is not currently in use.");
+		}
+
+		if(n == *m_used.rbegin())
+		{
+			m_used.erase(it);
+			m_free.erase(m_free.upper_bound(m_used.empty() ? -1 : *m_used.rbegin()), m_free.end());
+		}
+		else
+		{
+			m_used.erase(it);
+			m_free.insert(n);
+		}
+	}
+};
+
+/**
+An instance of an instantiation of this class template benchmarks an ID allocator under a workload like that
+of the node IDs of a B+-tree that is mostly growing: three quarters of the operations allocate an ID (like a
+split), and the rest deallocate an ID chosen at random from those in use (like a merge).
+*/
+template <typename Allocator>
+class IDAllocatorBenchmark : public Benchmark
+{
+	//#################### PRIVATE VARIABLES ####################
+private:
+	/** The ID allocator. */
+	Allocator m_allocator;
+
+	/** The random values used to decide which operation to perform at each step (and which ID to deallocate). */
+	std::vector<int> m_choices;
+
+	/** The IDs currently in use. */
+	std::vector<int> m_live;
+
+	/** The seed to use when generating the random values. */
+	const unsigned int m_seed;
+
+	//#################### CONSTRUCTORS ####################
+public:
+	IDAllocatorBenchmark(const std::string& name, unsigned int opCount, unsigned int seed)
+	:	Benchmark(name, opCount, OPS_PER_SAMPLE), m_seed(seed)
+	{
+		add_param("workload", "split_heavy");
+	}
+
+	//#################### PROTECTED METHODS ####################
+protected:
+	virtual void run_op(unsigned int i)
+	{
+		const int choice = m_choices[i];
+		if(choice % 4 != 0 || m_live.empty())
+		{
+			m_live.push_back(m_allocator.allocate());
+		}
+		else
+		{
+			size_t j = (choice / 4) % m_live.size();
+			m_allocator.deallocate(m_live[j]);
+			m_live[j] = m_live.back();
+			m_live.pop_back();
+		}
+	}
+
+	virtual void set_up()
+	{
+		m_choices = generate_keys(KD_RANDOM, op_count(), 1 << 30, m_seed);
+		m_live.reserve(op_count());
+	}
+};
+
+}
+
+//#################### GLOBAL FUNCTIONS ####################
+
+void add_id_allocator_benchmarks(std::vector<Benchmark_Ptr>& benchmarks, unsigned int opCount, unsigned int seed)
+{
+	benchmarks.push_back(Benchmark_Ptr(new IDAllocatorBenchmark<IDAllocator>("id_allocator", opCount, seed)));
+	benchmarks.push_back(Benchmark_Ptr(new IDAllocatorBenchmark<SetIDAllocator>("set_id_allocator", opCount, seed)));
+}
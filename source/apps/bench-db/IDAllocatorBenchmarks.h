@@ -0,0 +1,22 @@
+/**
+ * bench-db: IDAllocatorBenchmarks.h
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#ifndef H_BENCHDB_IDALLOCATORBENCHMARKS
+#define H_BENCHDB_IDALLOCATORBENCHMARKS
+
+#include "Benchmark.h"
+
+//#################### GLOBAL FUNCTIONS ####################
+
+/**
+Adds benchmarks for the ID allocator (and for the set-based allocator that it replaced, for comparison) to a list.
+
+\param benchmarks	The list of benchmarks.
+\param opCount		The number of allocations and deallocations to perform in each benchmark.
+\param seed			The seed to use when choosing between allocations and deallocations.
+*/
+void add_id_allocator_benchmarks(std::vector<Benchmark_Ptr>& benchmarks, unsigned int opCount, unsigned int seed);
+
+#endif
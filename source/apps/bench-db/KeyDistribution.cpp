@@ -0,0 +1,165 @@
+/**
+ * bench-db: KeyDistribution.cpp
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#include "KeyDistribution.h"
+
+#include <cassert>
+#include <cmath>
+
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_01.hpp>
+#include <boost/random/uniform_int_distribution.hpp>
+
+//#################### LOCAL CLASSES ####################
+
+namespace {
+
+/**
+An instance of this class generates ranks in the range [0,n) that follow a Zipfian distribution, using
+the method described in "Quickly Generating Billion-Record Synthetic Databases" (Gray et al., 1994).
+Rank 0 is the most popular, rank 1 the next most popular, and so on.
+*/
+class ZipfianGenerator
+{
+	//#################### PRIVATE VARIABLES ####################
+private:
+	/** The exponent used by the generation method (alpha in the paper). */
+	double m_alpha;
+
+	/** The scaling constant used by the generation method (eta in the paper). */
+	double m_eta;
+
+	/** The number of ranks. */
+	unsigned int m_n;
+
+	/** The skew of the distribution (larger values produce a more skewed distribution). */
+	double m_theta;
+
+	/** The normalisation constant zeta(n,theta). */
+	double m_zetaN;
+
+	//#################### CONSTRUCTORS ####################
+public:
+	/**
+	Constructs a Zipfian generator.
+
+	\param n		The number of ranks (must be at least 2).
+	\param theta	The skew of the distribution (must be in the range (0,1)).
+	*/
+	ZipfianGenerator(unsigned int n, double theta)
+	:	m_n(n), m_theta(theta)
+	{
+		assert(n >= 2 && theta > 0.0 && theta < 1.0);
+		m_zetaN = zeta(n, theta);
+		m_alpha = 1.0 / (1.0 - theta);
+		m_eta = (1.0 - std::pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta(2, theta) / m_zetaN);
+	}
+
+	//#################### PUBLIC OPERATORS ####################
+public:
+	/**
+	Generates the next rank.
+
+	\param rng	The random number generator to use.
+	\return		The rank.
+	*/
+	template <typename RNG>
+	unsigned int operator()(RNG& rng) const
+	{
+		double u = boost::random::uniform_01<double>()(rng);
+		double uz = u * m_zetaN;
+		if(uz < 1.0) return 0;
+		if(uz < 1.0 + std::pow(0.5, m_theta)) return 1;
+		unsigned int rank = static_cast<unsigned int>(m_n * std::pow(m_eta * u - m_eta + 1.0, m_alpha));
+		return rank < m_n ? rank : m_n - 1;
+	}
+
+	//#################### PRIVATE STATIC METHODS ####################
+private:
+	/**
+	Calculates the generalized harmonic number zeta(n,theta) = sum_{i=1}^{n} 1/i^theta.
+
+	\param n		The number of terms.
+	\param theta	The exponent.
+	\return			zeta(n,theta).
+	*/
+	static double zeta(unsigned int n, double theta)
+	{
+		double result = 0.0;
+		for(unsigned int i = 1; i <= n; ++i) result += 1.0 / std::pow(static_cast<double>(i), theta);
+		return result;
+	}
+};
+
+}
+
+//#################### GLOBAL FUNCTIONS ####################
+
+std::vector<int> generate_keys(KeyDistribution distribution, unsigned int count, unsigned int range, unsigned int seed)
+{
+	assert(range != 0);
+
+	std::vector<int> keys;
+	keys.reserve(count);
+
+	boost::random::mt19937 rng(seed);
+	switch(distribution)
+	{
+		case KD_RANDOM:
+		{
+			boost::random::uniform_int_distribution<unsigned int> dist(0, range - 1);
+			for(unsigned int i = 0; i < count; ++i) keys.push_back(dist(rng));
+			break;
+		}
+		case KD_SEQUENTIAL:
+		{
+			for(unsigned int i = 0; i < count; ++i) keys.push_back(i % range);
+			break;
+		}
+		case KD_ZIPFIAN:
+		{
+			if(range < 2)
+			{
+				keys.resize(count, 0);
+				break;
+			}
+
+			// Map the ranks through a random permutation of the key range so that the hot keys are spread out.
+			ZipfianGenerator gen(range, 0.99);
+			std::vector<int> permutation = generate_permutation(range, seed + 1);
+			for(unsigned int i = 0; i < count; ++i) keys.push_back(permutation[gen(rng)]);
+			break;
+		}
+	}
+
+	return keys;
+}
+
+std::vector<int> generate_permutation(unsigned int range, unsigned int seed)
+{
+	std::vector<int> keys(range);
+	for(unsigned int i = 0; i < range; ++i) keys[i] = i;
+
+	// Perform a Fisher-Yates shuffle on the keys.
+	boost::random::mt19937 rng(seed);
+	for(unsigned int i = range; i > 1; --i)
+	{
+		boost::random::uniform_int_distribution<unsigned int> dist(0, i - 1);
+		std::swap(keys[i - 1], keys[dist(rng)]);
+	}
+
+	return keys;
+}
+
+std::string to_string(KeyDistribution distribution)
+{
+	switch(distribution)
+	{
+		case KD_RANDOM:		return "random";
+		case KD_SEQUENTIAL:	return "sequential";
+		case KD_ZIPFIAN:	return "zipfian";
+		default:			return "unknown";
+	}
+}
@@ -0,0 +1,61 @@
+/**
+ * bench-db: KeyDistribution.h
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#ifndef H_BENCHDB_KEYDISTRIBUTION
+#define H_BENCHDB_KEYDISTRIBUTION
+
+#include <string>
+#include <vector>
+
+/**
+\brief The values of this enum represent possible distributions from which benchmark keys can be drawn.
+*/
+enum KeyDistribution
+{
+	/** The keys are drawn uniformly at random. */
+	KD_RANDOM,
+
+	/** The keys are 0, 1, 2, ... (wrapping around at the end of the key range). */
+	KD_SEQUENTIAL,
+
+	/**
+	The keys are drawn from a Zipfian distribution (with a skew of 0.99, as in YCSB), so
+	that a small number of hot keys account for most of the draws. The hot keys are
+	scattered across the key range rather than being clustered at its low end.
+	*/
+	KD_ZIPFIAN
+};
+
+//#################### GLOBAL FUNCTIONS ####################
+
+/**
+Generates a sequence of keys in the range [0,range) that are drawn from the specified distribution.
+
+\param distribution	The distribution from which to draw the keys.
+\param count		The number of keys to generate.
+\param range		The size of the key range (must be non-zero).
+\param seed			The seed for the random number generator (the same seed will always yield the same keys).
+\return				The keys.
+*/
+std::vector<int> generate_keys(KeyDistribution distribution, unsigned int count, unsigned int range, unsigned int seed);
+
+/**
+Generates a random permutation of the keys in the range [0,range).
+
+\param range	The size of the key range.
+\param seed		The seed for the random number generator.
+\return			The permuted keys.
+*/
+std::vector<int> generate_permutation(unsigned int range, unsigned int seed);
+
+/**
+Returns the name of the specified key distribution (for reporting purposes).
+
+\param distribution	The key distribution.
+\return				The name of the key distribution.
+*/
+std::string to_string(KeyDistribution distribution);
+
+#endif
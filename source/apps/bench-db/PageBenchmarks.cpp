@@ -0,0 +1,208 @@
+/**
+ * bench-db: PageBenchmarks.cpp
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#include "PageBenchmarks.h"
+
+#include <boost/assign/list_of.hpp>
+using namespace boost::assign;
+
+#include "whery/db/base/DoubleFieldManipulator.h"
+#include "whery/db/base/FreshTuple.h"
+#include "whery/db/base/IntFieldManipulator.h"
+#include "whery/db/base/ValueKey.h"
+#include "whery/db/pages/InMemorySortedPage.h"
+using namespace whery;
+
+#include "KeyDistribution.h"
+
+//#################### LOCAL CLASSES ####################
+
+namespace {
+
+/**
+An instance of a class deriving from this one represents a benchmark of an operation on an
+in-memory sorted page containing tuples of the form <key,tuple ID,value>.
+*/
+class PageBenchmark : public Benchmark
+{
+	//#################### PROTECTED VARIABLES ####################
+protected:
+	/** The keys used by the operations. */
+	std::vector<int> m_keys;
+
+	/** The page. */
+	InMemorySortedPage m_page;
+
+	/** The seed to use when generating keys. */
+	const unsigned int m_seed;
+
+	/** A running checksum of the operations' results (this stops the compiler from optimising the operations away). */
+	unsigned int m_sink;
+
+	/** A tuple that can be used to add tuples to the page. */
+	FreshTuple m_tuple;
+
+	//#################### CONSTRUCTORS ####################
+protected:
+	PageBenchmark(const std::string& name, unsigned int opCount, unsigned int tuplesPerPage, unsigned int seed)
+	:	Benchmark(name, opCount),
+		m_page(InMemorySortedPage::buffer_size_for(tuplesPerPage, tuple_manipulator()), tuple_manipulator()),
+		m_seed(seed),
+		m_sink(0),
+		m_tuple(tuple_manipulator())
+	{
+		add_param("tuples_per_page", tuplesPerPage);
+	}
+
+	//#################### PROTECTED METHODS ####################
+protected:
+	/**
+	Adds the tuple <key,key,key * 0.5> to the page.
+
+	\param key	The key of the tuple to add.
+	*/
+	void add_tuple(int key)
+	{
+		m_tuple.field(0).set_int(key);
+		m_tuple.field(1).set_int(key);
+		m_tuple.field(2).set_double(key * 0.5);
+		m_page.add_tuple(m_tuple);
+	}
+
+	/**
+	Fills the page with the tuples <k,k,k * 0.5> for each k in [0,max_tuple_count()).
+	*/
+	void fill_page()
+	{
+		m_page.clear();
+		for(unsigned int k = 0, size = m_page.max_tuple_count(); k < size; ++k) add_tuple(k);
+	}
+
+	//#################### PROTECTED STATIC METHODS ####################
+protected:
+	/**
+	Returns the tuple manipulator for the tuples on the page.
+
+	\return	The tuple manipulator.
+	*/
+	static TupleManipulator tuple_manipulator()
+	{
+		return TupleManipulator(list_of<const FieldManipulator*>
+			(&IntFieldManipulator::instance())
+			(&IntFieldManipulator::instance())
+			(&DoubleFieldManipulator::instance())
+		);
+	}
+};
+
+/**
+An instance of this class benchmarks adding tuples with random keys to a page (the page is cleared whenever it becomes full).
+*/
+class PageAddBenchmark : public PageBenchmark
+{
+	//#################### CONSTRUCTORS ####################
+public:
+	PageAddBenchmark(unsigned int opCount, unsigned int tuplesPerPage, unsigned int seed)
+	:	PageBenchmark("page_add", opCount, tuplesPerPage, seed)
+	{}
+
+	//#################### PROTECTED METHODS ####################
+protected:
+	virtual void prepare_op(unsigned int /*i*/)
+	{
+		if(m_page.empty_tuple_count() == 0) m_page.clear();
+	}
+
+	virtual void run_op(unsigned int i)
+	{
+		add_tuple(m_keys[i]);
+	}
+
+	virtual void set_up()
+	{
+		m_keys = generate_keys(KD_RANDOM, op_count(), 4 * m_page.max_tuple_count(), m_seed);
+	}
+};
+
+/**
+An instance of this class benchmarks finding and erasing tuples from a page (the page is refilled whenever it becomes empty).
+*/
+class PageEraseBenchmark : public PageBenchmark
+{
+	//#################### PRIVATE VARIABLES ####################
+private:
+	/** The key used to find the tuples to erase. */
+	ValueKey m_key;
+
+	//#################### CONSTRUCTORS ####################
+public:
+	PageEraseBenchmark(unsigned int opCount, unsigned int tuplesPerPage, unsigned int seed)
+	:	PageBenchmark("page_erase", opCount, tuplesPerPage, seed),
+		m_key(tuple_manipulator(), list_of(0))
+	{}
+
+	//#################### PROTECTED METHODS ####################
+protected:
+	virtual void prepare_op(unsigned int /*i*/)
+	{
+		if(m_page.tuple_count() == 0) fill_page();
+	}
+
+	virtual void run_op(unsigned int i)
+	{
+		m_key.field(0).set_int(m_keys[i % m_keys.size()]);
+		m_page.erase_tuple(m_page.find(m_key));
+	}
+
+	virtual void set_up()
+	{
+		// Erase the tuples in a random order, so that each refill of the page sees every key erased exactly once.
+		m_keys = generate_permutation(m_page.max_tuple_count(), m_seed);
+	}
+};
+
+/**
+An instance of this class benchmarks finding tuples with random keys on a full page (all of the keys searched for are present).
+*/
+class PageFindBenchmark : public PageBenchmark
+{
+	//#################### PRIVATE VARIABLES ####################
+private:
+	/** The key to search for. */
+	ValueKey m_key;
+
+	//#################### CONSTRUCTORS ####################
+public:
+	PageFindBenchmark(unsigned int opCount, unsigned int tuplesPerPage, unsigned int seed)
+	:	PageBenchmark("page_find", opCount, tuplesPerPage, seed),
+		m_key(tuple_manipulator(), list_of(0))
+	{}
+
+	//#################### PROTECTED METHODS ####################
+protected:
+	virtual void run_op(unsigned int i)
+	{
+		m_key.field(0).set_int(m_keys[i]);
+		SortedPage::TupleSetCIter it = m_page.find(m_key);
+		if(it != m_page.end()) m_sink += it->field(1).get_int();
+	}
+
+	virtual void set_up()
+	{
+		fill_page();
+		m_keys = generate_keys(KD_RANDOM, op_count(), m_page.max_tuple_count(), m_seed);
+	}
+};
+
+}
+
+//#################### GLOBAL FUNCTIONS ####################
+
+void add_page_benchmarks(std::vector<Benchmark_Ptr>& benchmarks, unsigned int opCount, unsigned int tuplesPerPage, unsigned int seed)
+{
+	benchmarks.push_back(Benchmark_Ptr(new PageAddBenchmark(opCount, tuplesPerPage, seed)));
+	benchmarks.push_back(Benchmark_Ptr(new PageFindBenchmark(opCount, tuplesPerPage, seed)));
+	benchmarks.push_back(Benchmark_Ptr(new PageEraseBenchmark(opCount, tuplesPerPage, seed)));
+}
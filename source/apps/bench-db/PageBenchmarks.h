@@ -0,0 +1,23 @@
+/**
+ * bench-db: PageBenchmarks.h
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#ifndef H_BENCHDB_PAGEBENCHMARKS
+#define H_BENCHDB_PAGEBENCHMARKS
+
+#include "Benchmark.h"
+
+//#################### GLOBAL FUNCTIONS ####################
+
+/**
+Adds benchmarks for the main in-memory sorted page operations (adding, finding and erasing tuples) to a list.
+
+\param benchmarks		The list of benchmarks.
+\param opCount			The number of operations to perform in each benchmark.
+\param tuplesPerPage	The number of tuples that should fit on each page.
+\param seed				The seed to use when generating keys.
+*/
+void add_page_benchmarks(std::vector<Benchmark_Ptr>& benchmarks, unsigned int opCount, unsigned int tuplesPerPage, unsigned int seed);
+
+#endif
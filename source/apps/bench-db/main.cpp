@@ -0,0 +1,96 @@
+/**
+ * bench-db: main.cpp
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <boost/lexical_cast.hpp>
+
+#include "BTreeBenchmarks.h"
+#include "ComparatorBenchmarks.h"
+#include "IDAllocatorBenchmarks.h"
+#include "PageBenchmarks.h"
+
+//#################### LOCAL FUNCTIONS ####################
+
+namespace {
+
+/**
+Prints a usage message for the program.
+
+\param os	The stream to which to print it.
+*/
+void print_usage(std::ostream& os)
+{
+	os << "Usage: bench-db [options]\n"
+	   << "  --filter <text>       Only run the benchmarks whose names contain the specified text\n"
+	   << "  --list                List the benchmarks rather than running them\n"
+	   << "  --ops <n>             The number of operations for each page, comparator and ID allocator benchmark (default: 1000000)\n"
+	   << "  --seed <n>            The seed to use when generating keys (default: 12345)\n"
+	   << "  --tuples <n>          The number of tuples with which to populate each B+-tree (default: 100000)\n"
+	   << "  --tuples-per-page <n> The number of tuples that should fit on each page (default: 128)\n"
+	   << "\n"
+	   << "The results are written to stdout as one JSON object per line.\n";
+}
+
+}
+
+int main(int argc, char *argv[])
+try
+{
+	std::string filter;
+	bool listOnly = false;
+	unsigned int opCount = 1000000;
+	unsigned int seed = 12345;
+	unsigned int tupleCount = 100000;
+	unsigned int tuplesPerPage = 128;
+
+	for(int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+		if(arg == "--list") listOnly = true;
+		else if(i + 1 < argc && arg == "--filter") filter = argv[++i];
+		else if(i + 1 < argc && arg == "--ops") opCount = boost::lexical_cast<unsigned int>(argv[++i]);
+		else if(i + 1 < argc && arg == "--seed") seed = boost::lexical_cast<unsigned int>(argv[++i]);
+		else if(i + 1 < argc && arg == "--tuples") tupleCount = boost::lexical_cast<unsigned int>(argv[++i]);
+		else if(i + 1 < argc && arg == "--tuples-per-page") tuplesPerPage = boost::lexical_cast<unsigned int>(argv[++i]);
+		else
+		{
+			print_usage(std::cerr);
+			return arg == "--help" ? 0 : 1;
+		}
+	}
+
+	if(tupleCount == 0 || tuplesPerPage < 4)
+	{
+		std::cerr << "Error: Each B+-tree must contain at least one tuple, and each page must be able to hold at least four tuples\n";
+		return 1;
+	}
+
+	std::vector<Benchmark_Ptr> benchmarks;
+	add_btree_benchmarks(benchmarks, tupleCount, tuplesPerPage, seed);
+	add_page_benchmarks(benchmarks, opCount, tuplesPerPage, seed);
+	add_comparator_benchmarks(benchmarks, opCount, seed);
+	add_id_allocator_benchmarks(benchmarks, opCount, seed);
+
+	for(size_t i = 0, size = benchmarks.size(); i < size; ++i)
+	{
+		if(benchmarks[i]->name().find(filter) == std::string::npos) continue;
+
+		if(listOnly) std::cout << benchmarks[i]->name() << '\n';
+		else benchmarks[i]->run(std::cout);
+
+		// Release each benchmark's state as soon as we are done with it.
+		benchmarks[i].reset();
+	}
+
+	return 0;
+}
+catch(std::exception& e)
+{
+	std::cerr << "Error: " << e.what() << '\n';
+	return 1;
+}
@@ -8,6 +8,8 @@
 
 #include <string>
 
+#include "SortDirection.h"
+
 namespace whery {
 
 //#################### FORWARD DECLARATIONS ####################
@@ -86,6 +88,13 @@ public:
 	*/
 	std::string get_string() const;
 
+	/**
+	Gets the size (in bytes) of the normalized encoding of this field (see write_normalized()).
+
+	\return	The size (in bytes) of the normalized encoding.
+	*/
+	unsigned int normalized_size() const;
+
 	/**
 	Sets this field to the specified value, performing type conversion where necessary.
 	If the type conversion fails, an exception will be thrown.
@@ -113,6 +122,15 @@ public:
 	*/
 	void set_int(int value) const;
 
+	/**
+	Writes an order-preserving encoding of this field to dest (see FieldManipulator::write_normalized()).
+	Note that the encodings of two fields can only be compared if the fields have the same type.
+
+	\param dest			The location to which to write the encoding (which must have room for normalized_size() bytes).
+	\param direction	The sort direction that the encoding should respect.
+	*/
+	void write_normalized(char *dest, SortDirection direction = ASC) const;
+
 	//#################### PRIVATE METHODS ####################
 private:
 	/**
@@ -9,8 +9,11 @@
 #include <functional>
 #include <string>
 
+#include <boost/cstdint.hpp>
 #include <boost/uuid/uuid.hpp>
 
+#include "SortDirection.h"
+
 namespace whery {
 
 /**
@@ -57,6 +60,13 @@ public:
 	*/
 	virtual int compare_to(const char *location, const FieldManipulator& otherManipulator, const char *otherLocation) const = 0;
 
+	/**
+	Returns the size (in bytes) of the normalized encoding of a field of the manipulated type (see write_normalized()).
+
+	\return	The size (in bytes) of the normalized encoding.
+	*/
+	virtual unsigned int normalized_size() const = 0;
+
 	/**
 	Sets the field at location (as manipulated by this manipulator) to the value of the field at otherLocation
 	(as manipulated by otherManipulator), after first converting it to the right type. If the type conversion
@@ -76,6 +86,18 @@ public:
 	*/
 	virtual unsigned int size() const = 0;
 
+	/**
+	Writes a normalized encoding of the field at location to dest. Normalized encodings are order-preserving:
+	comparing the encodings of two fields of the manipulated type using memcmp gives the same result as
+	comparing the fields themselves (or the opposite result, for a descending sort direction). As a result,
+	the concatenated encodings of several fields can be compared in a single memcmp.
+
+	\param location		The memory location of the field on which this manipulator should operate.
+	\param dest			The location to which to write the encoding (which must have room for normalized_size() bytes).
+	\param direction	The sort direction that the encoding should respect.
+	*/
+	virtual void write_normalized(const char *location, char *dest, SortDirection direction) const = 0;
+
 	//#################### PUBLIC METHODS ####################
 
 	/**
@@ -167,6 +189,17 @@ protected:
 		else if(comp(rhs, lhs)) return 1;
 		else return 0;
 	}
+
+	/**
+	Writes the low-order size bytes of value to dest in big-endian order (so that memcmp orders them
+	in the same way as the corresponding unsigned values), complementing them for a descending sort.
+
+	\param value		The value.
+	\param size			The number of bytes to write.
+	\param dest			The location to which to write the bytes.
+	\param direction	The sort direction that the bytes should respect.
+	*/
+	static void write_big_endian(boost::uint64_t value, unsigned int size, char *dest, SortDirection direction);
 };
 
 }
@@ -8,19 +8,41 @@
 
 #include <vector>
 
+#include <boost/config.hpp>
+
+#include "whery/util/AlignmentTracker.h"
 #include "BackedTuple.h"
 
+/**
+The size (in bytes) of the largest tuple that a FreshTuple stores inline rather than on the heap.
+This can be overridden at compile time (e.g. for schemas with unusually wide keys).
+*/
+#ifndef WHERY_FRESHTUPLE_INLINE_SIZE
+#define WHERY_FRESHTUPLE_INLINE_SIZE 64
+#endif
+
 namespace whery {
 
 /**
 \brief An instance of this class represents a freshly-created tuple that is backed by its own buffer.
+
+Tuples that are no bigger than WHERY_FRESHTUPLE_INLINE_SIZE bytes (which includes most keys) are stored
+inline, so that constructing and copying them does not require any heap allocation. Larger tuples fall
+back to a buffer on the heap.
 */
 class FreshTuple : public BackedTuple
 {
 	//#################### PRIVATE VARIABLES ####################
 private:
-	/** The buffer backing the tuple. */
-	std::vector<char> m_buffer;
+	/** The buffer backing the tuple, if it is too big to be stored inline (empty otherwise). */
+	std::vector<char> m_heapBuffer;
+
+	/** The buffer backing the tuple, if it is small enough to be stored inline. */
+	union
+	{
+		char m_inlineBuffer[WHERY_FRESHTUPLE_INLINE_SIZE];
+		AlignmentTracker::MaxAlignmentHelper m_inlineBufferAlignment;
+	};
 
 	//#################### CONSTRUCTORS ####################
 public:
@@ -56,17 +78,40 @@ public:
 	*/
 	FreshTuple& operator=(const FreshTuple& rhs);
 
+#ifndef BOOST_NO_CXX11_RVALUE_REFERENCES
+	//#################### MOVE CONSTRUCTOR & ASSIGNMENT OPERATOR ####################
+public:
+	/**
+	Constructs a fresh tuple by taking over the contents of rhs. If rhs is stored on the heap, its buffer
+	is taken over without copying, and rhs is left without a buffer: it may then only be assigned to,
+	copied (which gives a zeroed tuple) or destroyed.
+
+	\param rhs	The tuple to move.
+	*/
+	FreshTuple(FreshTuple&& rhs);
+
+	/**
+	Overwrites the contents of this tuple by taking over the contents of rhs. If rhs is stored on the heap,
+	its buffer is taken over without copying, and rhs is left without a buffer (as for the move constructor).
+
+	\param rhs	The tuple from which to move-assign.
+	\return		The current tuple.
+	*/
+	FreshTuple& operator=(FreshTuple&& rhs);
+#endif
+
 	//#################### PRIVATE METHODS ####################
 private:
 	/**
-	Sets the buffer backing the tuple to the specified buffer.
+	Sets the buffer backing the tuple to a copy of the buffer backing the specified tuple (or to a fresh,
+	zeroed buffer if that tuple has been moved from, and so has no buffer).
 
-	\param buffer	The buffer to copy.
+	\param rhs	The tuple whose buffer is to be copied.
 	*/
-	void set_buffer(const std::vector<char>& buffer);
+	void set_buffer(const FreshTuple& rhs);
 
 	/**
-	Sets the buffer backing the tuple to a fresh buffer of the specified size.
+	Sets the buffer backing the tuple to a fresh, zeroed buffer of the specified size.
 
 	\param size	The size of the fresh buffer.
 	*/
@@ -38,10 +38,12 @@ public:
 	virtual double get_double(const char *location) const;
 	virtual int get_int(const char *location) const;
 	virtual std::string get_string(const char *location) const;
+	virtual unsigned int normalized_size() const;
 	virtual void set_double(char *location, double value) const;
 	virtual void set_from(char *location, const FieldManipulator& sourceManipulator, const char *sourceLocation) const;
 	virtual void set_int(char *location, int value) const;
 	virtual unsigned int size() const;
+	virtual void write_normalized(const char *location, char *dest, SortDirection direction) const;
 };
 
 }
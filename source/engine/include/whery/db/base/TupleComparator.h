@@ -7,6 +7,7 @@
 #define H_WHERY_TUPLECOMPARATOR
 
 #include <functional>
+#include <string>
 #include <utility>
 #include <vector>
 
@@ -79,6 +80,18 @@ public:
 	\throw std::invalid_argument	If the arities of the tuples being compared do not match.
 	*/
 	int compare(const Tuple& lhs, const Tuple& rhs) const;
+
+	/**
+	Makes a normalized key for a tuple from the fields specified when constructing the comparator.
+	Comparing the normalized keys of two tuples (e.g. using std::string's comparison operators, which
+	compare the bytes in the manner of memcmp) gives the same result as comparing the tuples themselves,
+	provided that the types of the tuples' corresponding fields match. This allows a sort to compute each
+	tuple's key once up-front and then just compare bytes.
+
+	\param tuple	The tuple.
+	\return			The normalized key for the tuple.
+	*/
+	std::string normalized_key(const Tuple& tuple) const;
 };
 
 }
@@ -24,19 +24,35 @@ with a particular signature at some location in memory.
 Tuple manipulators do not hold any state relating to the target tuples
 on which they operate - the relevant member functions accept pointers
 to the memory on which to work.
+
+The signature itself (the field manipulators, the field offsets and so on)
+is stored in an immutable schema that is interned when the manipulator is
+constructed, so that all manipulators for the same signature share a single
+schema that lives for the rest of the program. Each thread caches the schemas
+that it has already looked up (see Interner), so constructing a manipulator for
+a familiar signature (e.g. for a search key) does not take a lock or allocate. A tuple manipulator is thus
+just a pointer to its schema, and can be copied (e.g. into every tuple that
+refers to a page) without any allocation.
 */
 class TupleManipulator
 {
-	//#################### PRIVATE VARIABLES ####################
-private:
-	/** The manipulators for the fields in a target tuple. */
-	std::vector<const FieldManipulator*> m_fieldManipulators;
+	//#################### TYPEDEFS ####################
+public:
+	/**
+	The type of a function that compares (using prefix comparison) the first arity fields
+	of two target tuples whose layout is known at compile time (see TypedTupleManipulator).
+	*/
+	typedef int (*LayoutComparator)(const char *lhs, const char *rhs, unsigned int arity);
 
-	/** The memory offsets of the fields (in bytes) from the start of a target tuple. */
-	std::vector<unsigned int> m_fieldOffsets;
+	//#################### NESTED TYPES ####################
+private:
+	struct Schema;
+	struct SchemaKey;
 
-	/** The overall size (in bytes) of a target tuple. */
-	unsigned int m_size;
+	//#################### PRIVATE VARIABLES ####################
+private:
+	/** The (interned) schema describing a target tuple. */
+	const Schema *m_schema;
 
 	//#################### CONSTRUCTORS ####################
 public:
@@ -70,6 +86,35 @@ public:
 		const std::vector<unsigned int>& fieldIndices
 	);
 
+protected:
+	/**
+	Constructs a tuple manipulator for target tuples whose layout is known at compile time.
+
+	\param fieldManipulators		A non-empty array of manipulators for the fields in a target tuple.
+	\param layoutComparator		A function that directly compares target tuples in memory.
+	\throw std::invalid_argument	If fieldManipulators is empty.
+	*/
+	TupleManipulator(const std::vector<const FieldManipulator*>& fieldManipulators, LayoutComparator layoutComparator);
+
+	//#################### PUBLIC OPERATORS ####################
+public:
+	/**
+	Checks whether or not this tuple manipulator is the same as another one, i.e. whether or not they share
+	their schema (which, since schemas are interned, is the case if and only if they have the same signature).
+
+	\param rhs	The other tuple manipulator.
+	\return		true, if the tuple manipulators are the same, or false otherwise.
+	*/
+	bool operator==(const TupleManipulator& rhs) const;
+
+	/**
+	Checks whether or not this tuple manipulator differs from another one.
+
+	\param rhs	The other tuple manipulator.
+	\return		true, if the tuple manipulators differ, or false otherwise.
+	*/
+	bool operator!=(const TupleManipulator& rhs) const;
+
 	//#################### PUBLIC METHODS ####################
 public:
 	/**
@@ -91,6 +136,15 @@ public:
 	*/
 	Field field(char *tupleLocation, unsigned int i, bool readOnly = false) const;
 
+	/**
+	Gets the memory offset (in bytes) of the i'th field from the start of a target tuple. This allows a caller that
+	already knows the type of a field to read it directly, without going through its field manipulator.
+
+	\param i	The index of the field.
+	\return		The offset of the i'th field.
+	*/
+	unsigned int field_offset(unsigned int i) const;
+
 	/**
 	Gets the manipulators for the fields in a target tuple.
 
@@ -98,6 +152,34 @@ public:
 	*/
 	const std::vector<const FieldManipulator*>& field_manipulators() const;
 
+	/**
+	Gets a function that directly compares target tuples in memory, if their layout is known at compile time.
+	Such a function compares the tuples' fields without any virtual dispatch, but note that it can only be
+	used when both tuples have the layout of a target tuple (as opposed to e.g. the layout of a key).
+
+	\return	The comparison function, if available, or NULL otherwise.
+	*/
+	LayoutComparator layout_comparator() const;
+
+	/**
+	Sets whether or not sorted pages of target tuples should store normalized key prefixes to speed up their searches
+	(see SlottedSortedPage). Doing so allows most of the comparisons during a search to be done by comparing a few
+	bytes stored alongside each tuple's slot, at the cost of some extra space per tuple.
+
+	\param usesKeyPrefixes	Whether or not sorted pages of target tuples should store normalized key prefixes.
+	*/
+	void set_uses_key_prefixes(bool usesKeyPrefixes);
+
+	/**
+	Sets whether or not sorted pages of target tuples should store them with some of their trailing key fields omitted
+	(see SlottedSortedPage). This is intended for the branch tuples of a B+-tree, whose last field is a child node ID
+	and whose other fields are a separator key: storing only as many leading key fields as are needed to separate two
+	children lets each branch page hold more entries when the keys are wide.
+
+	\param usesSuffixTruncation	Whether or not sorted pages of target tuples should store them with trailing key fields omitted.
+	*/
+	void set_uses_suffix_truncation(bool usesSuffixTruncation);
+
 	/**
 	Gets the overall size of a target tuple.
 
@@ -105,15 +187,52 @@ public:
 	*/
 	unsigned int size() const;
 
-	//#################### PRIVATE METHODS ####################
+	/**
+	Makes a manipulator for target tuples that have had some of their trailing key fields omitted (see
+	set_uses_suffix_truncation), i.e. for tuples that consist of the first keyArity fields of a target
+	tuple, followed by its last field.
+
+	\param keyArity	The number of key fields to keep (at least one, and at most arity() - 1).
+	\return			The manipulator (this manipulator itself, if keyArity is arity() - 1).
+	*/
+	TupleManipulator truncated(unsigned int keyArity) const;
+
+	/**
+	Gets whether or not sorted pages of target tuples should store normalized key prefixes to speed up their searches.
+
+	\return	true, if sorted pages of target tuples should store normalized key prefixes, or false otherwise.
+	*/
+	bool uses_key_prefixes() const;
+
+	/**
+	Gets whether or not sorted pages of target tuples should store them with trailing key fields omitted.
+
+	\return	true, if sorted pages of target tuples should store them with trailing key fields omitted, or false otherwise.
+	*/
+	bool uses_suffix_truncation() const;
+
+	//#################### PRIVATE STATIC METHODS ####################
 private:
 	/**
-	Initialises the tuple manipulator.
+	Gets the interned schema for target tuples with the specified properties, creating it if necessary.
+	If the calling thread has seen the schema before, this does not allocate any memory.
 
-	\param fieldManipulators		A non-empty array of manipulators for the fields in a target tuple.
-	\throw std::invalid_argument	If fieldManipulators is empty.
+	\param fieldManipulators		A non-empty array of manipulators for the fields in an underlying tuple.
+	\param fieldIndices				A non-empty array specifying the indices of the fields in the underlying tuple that form
+									a target tuple, or NULL if a target tuple contains all of the fields of the underlying tuple.
+	\param layoutComparator		A function that directly compares target tuples in memory, or NULL if their layout is not known at compile time.
+	\param usesKeyPrefixes			Whether or not sorted pages of target tuples should store normalized key prefixes.
+	\param usesSuffixTruncation	Whether or not sorted pages of target tuples should store them with trailing key fields omitted.
+	\return						The schema.
+	\throw std::invalid_argument	If fieldManipulators or fieldIndices is empty.
 	*/
-	void initialise(const std::vector<const FieldManipulator*>& fieldManipulators);
+	static const Schema *intern_schema(
+		const std::vector<const FieldManipulator*>& fieldManipulators,
+		const std::vector<unsigned int> *fieldIndices,
+		LayoutComparator layoutComparator,
+		bool usesKeyPrefixes,
+		bool usesSuffixTruncation
+	);
 };
 
 }
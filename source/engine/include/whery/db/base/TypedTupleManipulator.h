@@ -0,0 +1,201 @@
+/**
+ * whery: TypedTupleManipulator.h
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#ifndef H_WHERY_TYPEDTUPLEMANIPULATOR
+#define H_WHERY_TYPEDTUPLEMANIPULATOR
+
+#include <cassert>
+
+#include <boost/uuid/uuid.hpp>
+
+#include "whery/util/AlignmentTracker.h"
+#include "DoubleFieldManipulator.h"
+#include "IntFieldManipulator.h"
+#include "TupleManipulator.h"
+#include "UuidFieldManipulator.h"
+
+namespace whery {
+
+//#################### HELPER CLASSES ####################
+
+/**
+\brief This struct is used to mark the unused trailing fields of a TypedTupleManipulator.
+*/
+struct NoField {};
+
+/**
+\brief An instantiation of this template provides the compile-time properties of a type of field
+that can be stored in a tuple laid out by a TypedTupleManipulator.
+
+The alignment and size of each field type must match those of the corresponding field manipulator,
+so that the tuple layout calculated at compile time is identical to the one calculated at runtime.
+*/
+template <typename T> struct TypedField;
+
+/**
+\brief An instantiation of this template provides the compile-time properties shared by all field types
+that are stored directly in memory and compared using operator<.
+*/
+template <typename T, unsigned int Alignment>
+struct BasicTypedField
+{
+	enum
+	{
+		/** The size (in bytes) of the alignment boundary required for the field. */
+		ALIGNMENT = Alignment,
+
+		/** The size (in bytes) of the field. */
+		SIZE = sizeof(T)
+	};
+
+	/**
+	Compares the field at lhs with the field at rhs.
+
+	\param lhs	The location of the left-hand field.
+	\param rhs	The location of the right-hand field.
+	\return		-1, if the left-hand field is ordered before the right-hand one;
+				1, if the left-hand field is ordered after the right-hand one;
+				0, otherwise.
+	*/
+	static int compare(const char *lhs, const char *rhs)
+	{
+		const T& l = *reinterpret_cast<const T*>(lhs);
+		const T& r = *reinterpret_cast<const T*>(rhs);
+		if(l < r) return -1;
+		else if(r < l) return 1;
+		else return 0;
+	}
+};
+
+template <> struct TypedField<double> : BasicTypedField<double,sizeof(double)>
+{
+	static const FieldManipulator *manipulator() { return &DoubleFieldManipulator::instance(); }
+};
+
+template <> struct TypedField<int> : BasicTypedField<int,sizeof(int)>
+{
+	static const FieldManipulator *manipulator() { return &IntFieldManipulator::instance(); }
+};
+
+template <> struct TypedField<boost::uuids::uuid> : BasicTypedField<boost::uuids::uuid,sizeof(boost::uuids::uuid)>
+{
+	static const FieldManipulator *manipulator() { return &UuidFieldManipulator::instance(); }
+};
+
+template <> struct TypedField<NoField>
+{
+	enum
+	{
+		ALIGNMENT = 1,
+		SIZE = 0
+	};
+
+	static int compare(const char * /*lhs*/, const char * /*rhs*/) { return 0; }
+	static const FieldManipulator *manipulator() { return NULL; }
+};
+
+/**
+\brief An instantiation of this template calculates (at compile time) the first offset at or after
+the specified one that lies on a boundary for the specified alignment.
+*/
+template <unsigned int Offset, unsigned int Alignment>
+struct AlignedOffset
+{
+	enum { VALUE = (Offset + Alignment - 1) / Alignment * Alignment };
+};
+
+/**
+\brief An instance of an instantiation of this class template is a tuple manipulator for tuples
+whose field types are known at compile time, e.g. TypedTupleManipulator<int,double,int>.
+
+The offsets of the fields are calculated at compile time (and match the ones calculated by an
+ordinary tuple manipulator for the same field types), which allows tuples to be compared directly
+in memory by compare(), without going through either Tuple or FieldManipulator. The manipulator
+can be used anywhere an ordinary tuple manipulator can (e.g. for the pages of a B+-tree): sorted
+pages use its layout comparator to speed up their searches, whilst everything else continues to
+access the tuples' fields via the field manipulators as usual.
+
+Up to four fields are supported: the unused trailing fields should be left as NoField.
+*/
+template <typename T0, typename T1 = NoField, typename T2 = NoField, typename T3 = NoField>
+class TypedTupleManipulator : public TupleManipulator
+{
+	//#################### ENUMERATIONS ####################
+public:
+	enum
+	{
+		/** The arity (number of fields) of a target tuple. */
+		ARITY = 1 + (TypedField<T1>::SIZE != 0) + (TypedField<T2>::SIZE != 0) + (TypedField<T3>::SIZE != 0),
+
+		/** The memory offsets of the fields (in bytes) from the start of a target tuple. */
+		OFFSET0 = 0,
+		OFFSET1 = AlignedOffset<OFFSET0 + TypedField<T0>::SIZE, TypedField<T1>::ALIGNMENT>::VALUE,
+		OFFSET2 = AlignedOffset<OFFSET1 + TypedField<T1>::SIZE, TypedField<T2>::ALIGNMENT>::VALUE,
+		OFFSET3 = AlignedOffset<OFFSET2 + TypedField<T2>::SIZE, TypedField<T3>::ALIGNMENT>::VALUE,
+
+		/** The overall size (in bytes) of a target tuple. */
+		SIZE = AlignedOffset<OFFSET3 + TypedField<T3>::SIZE, sizeof(AlignmentTracker::MaxAlignmentHelper)>::VALUE
+	};
+
+	//#################### CONSTRUCTORS ####################
+public:
+	/**
+	Constructs a typed tuple manipulator.
+	*/
+	TypedTupleManipulator()
+	:	TupleManipulator(make_field_manipulators(), &TypedTupleManipulator::compare)
+	{
+		assert(arity() == ARITY && size() == SIZE);
+	}
+
+	//#################### PUBLIC STATIC METHODS ####################
+public:
+	/**
+	Compares the first arity fields of the target tuples at lhs and rhs, using prefix comparison.
+
+	\param lhs		The location of the left-hand tuple.
+	\param rhs		The location of the right-hand tuple.
+	\param arity	The number of fields to compare (in the range [1,ARITY]).
+	\return			-1, if the left-hand tuple is ordered before the right-hand one;
+					1, if the left-hand tuple is ordered after the right-hand one;
+					0, otherwise.
+	*/
+	static int compare(const char *lhs, const char *rhs, unsigned int arity)
+	{
+		int result = TypedField<T0>::compare(lhs + OFFSET0, rhs + OFFSET0);
+		if(result != 0 || arity == 1) return result;
+
+		result = TypedField<T1>::compare(lhs + OFFSET1, rhs + OFFSET1);
+		if(result != 0 || arity == 2) return result;
+
+		result = TypedField<T2>::compare(lhs + OFFSET2, rhs + OFFSET2);
+		if(result != 0 || arity == 3) return result;
+
+		return TypedField<T3>::compare(lhs + OFFSET3, rhs + OFFSET3);
+	}
+
+	//#################### PRIVATE STATIC METHODS ####################
+private:
+	/**
+	Makes the array of field manipulators corresponding to the field types.
+
+	\return	The array of field manipulators.
+	*/
+	static std::vector<const FieldManipulator*> make_field_manipulators()
+	{
+		const FieldManipulator *fieldManipulators[] =
+		{
+			TypedField<T0>::manipulator(),
+			TypedField<T1>::manipulator(),
+			TypedField<T2>::manipulator(),
+			TypedField<T3>::manipulator()
+		};
+		return std::vector<const FieldManipulator*>(fieldManipulators, fieldManipulators + ARITY);
+	}
+};
+
+}
+
+#endif
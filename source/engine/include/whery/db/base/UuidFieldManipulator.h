@@ -37,9 +37,11 @@ public:
 	virtual int compare_to(const char *location, const FieldManipulator& otherManipulator, const char *otherLocation) const;
 	virtual std::string get_string(const char *location) const;
 	virtual boost::uuids::uuid get_uuid(const char *location) const;
+	virtual unsigned int normalized_size() const;
 	virtual void set_from(char *location, const FieldManipulator& sourceManipulator, const char *sourceLocation) const;
 	virtual void set_uuid(char *location, const boost::uuids::uuid& value) const;
 	virtual unsigned int size() const;
+	virtual void write_normalized(const char *location, char *dest, SortDirection direction) const;
 };
 
 }
@@ -17,8 +17,12 @@ class ValueKey : public FreshTuple
 {
 	//#################### PRIVATE VARIABLES ####################
 private:
-	/** A non-empty array specifying the indices of the fields to be used for the key. */
-	std::vector<unsigned int> m_fieldIndices;
+	/**
+	A non-empty array specifying the indices of the fields to be used for the key. These arrays are interned
+	(like tuple schemas), so that keys can be copied without allocating a fresh array each time, and once a
+	thread has constructed a key with the same indices, constructing another does not take a lock.
+	*/
+	const std::vector<unsigned int> *m_fieldIndices;
 
 	//#################### CONSTRUCTORS ####################
 public:
@@ -48,6 +52,16 @@ public:
 	\return	The indices of the fields to be used for the key.
 	*/
 	const std::vector<unsigned int>& field_indices() const;
+
+	//#################### PRIVATE STATIC METHODS ####################
+private:
+	/**
+	Gets the interned copy of the specified array of field indices, creating it if necessary.
+
+	\param fieldIndices	The array of field indices.
+	\return				The interned copy of the array.
+	*/
+	static const std::vector<unsigned int> *intern_field_indices(const std::vector<unsigned int>& fieldIndices);
 };
 
 }
@@ -6,12 +6,19 @@
 #ifndef H_WHERY_BTREE
 #define H_WHERY_BTREE
 
+#include <boost/atomic.hpp>
+#include <boost/function.hpp>
 #include <boost/optional/optional.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/shared_mutex.hpp>
 
 #include "whery/db/base/FreshTuple.h"
+#include "whery/db/base/ValueKey.h"
 #include "whery/db/pages/SortedPage.h"
 #include "whery/util/IDAllocator.h"
+#include "whery/util/SegmentedArray.h"
 #include "BTreePageController.h"
+#include "BTreeStats.h"
 
 namespace whery {
 
@@ -20,24 +27,83 @@ namespace whery {
 
 Note that this implementation is designed to work with tuples that
 incorporate a unique key, and as such does not support duplicates.
-This turns out to be a minor restriction in practice.
+An index whose keys may be duplicated (e.g. a secondary index) can
+instead be built on top of a B+-tree using PostingListBTree, which
+packs the payloads of the entries that share a key into posting
+lists, so that no synthetic unique ID needs to be added to the key.
+
+A B+-tree can optionally be constructed in concurrent mode, in which
+lower_bound(ValueKey), upper_bound(ValueKey), find, lookup, insert_tuple
+and erase_tuple can safely be called from multiple threads at once.
+Readers take no node latches: they use optimistic lock coupling,
+checking the version of each node before moving on from it and
+restarting if a concurrent writer has changed anything they read.
+(They are not entirely lock-free, however: each node's page is
+loaded with boost::atomic_load, which Boost implements for shared
+pointers by briefly taking one of a small pool of spinlocks.)
+Writers latch only the leaf they modify, unless they need to change
+the structure of the tree (e.g. by splitting or merging nodes), in
+which case they exclude other writers for the duration of the change
+and any overlapping readers restart. The iterators returned by the
+search functions are only snapshots: they must not be dereferenced
+or advanced whilst the tree may be being modified (use lookup() to
+read a tuple safely). Concurrent mode requires pages that can be read
+whilst they are being modified (e.g. in-memory or memory-mapped pages,
+but not buffered ones, since buffer pools are not thread-safe, nor the
+columnar and packed ones, whose reads write to a row cache).
+
+A B+-tree can also optionally be constructed in counted mode, in which
+each branch node keeps track of the number of leaf tuples in its subtree.
+The counts are kept up to date by every insertion, erasure, split, merge
+and redistribution, and make it possible to find the rank of a key, the
+tuple at a given rank and the number of tuples in a range (see rank,
+select and count) in logarithmic time, rather than by walking the leaves.
+In concurrent mode, counted mode makes every insertion and erasure a
+structure modification (since the counts of all of the ancestors of the
+leaf must change), and the order statistics are then computed whilst
+holding a shared lock on the structure.
+
+If the branch tuple manipulator specifies that branch pages should use
+suffix truncation (see TupleManipulator::set_uses_suffix_truncation),
+each index entry holds only the shortest separator that divides a child
+from its left neighbour, so that branch pages can hold more entries.
+
+Leaf pages with value-dependent capacities are supported (see insert_tuple).
+
+If the B+-tree's page controller persists the structure of its B+-tree
+(see BTreePageController::persists_btree_structure), the B+-tree saves
+its node table via the controller when it is destroyed, and a B+-tree
+constructed later with a controller that holds a saved structure (e.g.
+in a later session) reopens it in place: its nodes are restored from the
+node table, and their pages are reopened without copying any tuples.
+
+If WHERY_BTREE_STATS is defined (e.g. by configuring the build with
+WITH_BTREE_STATS), a B+-tree records the latencies of its operations
+and counts its structural events (splits, merges, etc.), which can be
+retrieved using stats(). Otherwise, nothing is recorded, and none of
+the instrumentation is compiled in. Since the macro changes the layout
+of BTree itself, it must be defined (or not) in the same way for every
+translation unit that includes this header, which is why it is set for
+the whole build rather than per target.
 */
 class BTree
 {
 	//#################### NESTED TYPES ####################
 private:
 	/**
-	\brief An instance of this struct represents a node in a B+-tree.
+	\brief An instance of this struct holds the metadata for a node in a B+-tree that is not needed to descend through it.
+
+	The nodes are stored as a structure of arrays: the fields that a descent reads at every level (the raw pointer to
+	the node's page and the ID of its first child) are kept apart from the rest, in a separate table of routes (see
+	NodeRoute), so that the descents do not drag the rest of each node (its owning page pointer, its links to its
+	parent and siblings, etc.), which is only needed for structure modifications and sibling traversals, through the cache.
 	*/
 	struct Node
 	{
 		/**
-		The ID of the node's first child, if it has one. The IDs of any
-		other children are stored in the tuples on the data page.
+		The page used to store the tuple data for the node. In concurrent mode, this is
+		only accessed via boost::atomic_load/boost::atomic_store.
 		*/
-		int firstChildID;
-
-		/** The page used to store the tuple data for the node. */
 		SortedPage_Ptr page;
 
 		/** The ID of the node's parent in the B+-tree (if any). */
@@ -46,23 +112,62 @@ private:
 		/** The ID of the node's left sibling in the B+-tree (if any). */
 		int siblingLeftID;
 
-		/** The ID of the node's right sibling in the B+-tree (if any). */
-		int siblingRightID;
+		/**
+		The ID of the node's right sibling in the B+-tree (if any). This is atomic because optimistic readers
+		read it whilst writers may be changing it (the readers validate what they read afterwards).
+		*/
+		boost::atomic<int> siblingRightID;
+
+		/**
+		The number of leaf tuples in the subtree rooted at the node. This is only maintained for branch
+		nodes, and only in counted mode (the tuple count of a leaf is simply that of its page).
+		*/
+		unsigned int tupleCount;
+
+		/**
+		The version latch for the node, which is used in concurrent mode. It is odd
+		whilst a writer is modifying the node's leaf page in place, and is incremented
+		again (to the next even number) when the writer has finished.
+		*/
+		boost::atomic<unsigned int> version;
 
 		/**
 		Constructs a node.
 		*/
 		Node()
-		:	firstChildID(-1), parentID(-1), siblingLeftID(-1), siblingRightID(-1)
+		:	parentID(-1), siblingLeftID(-1), siblingRightID(-1), tupleCount(0), version(0)
 		{}
+	};
 
+	/**
+	\brief An instance of this struct holds the fields of a node in a B+-tree that are needed to descend through it.
+
+	Each route is only 16 bytes (on a 64-bit platform), so four of them share a cache line, and a descent reads
+	a single one per level, without any reference counting.
+	*/
+	struct NodeRoute
+	{
 		/**
-		Constructs a node.
+		A raw pointer to the page used to store the tuple data for the node (see Node::page). This is used by
+		searches, which avoids the cost of copying a shared pointer (and the reference count traffic) at every
+		level. It is only valid for as long as the node holds the page, i.e. until the node is deleted.
+		*/
+		boost::atomic<SortedPage*> rawPage;
 
-		\param page	The page to be used to store the tuple data for the node.
+		/**
+		The ID of the node's first child, if it has one. The IDs of any
+		other children are stored in the tuples on the data page. This is
+		atomic because optimistic readers read it whilst writers may be
+		changing it (the readers validate what they read afterwards, so
+		they load it with relaxed ordering).
+		*/
+		boost::atomic<int> firstChildID;
+
+		/**
+		Constructs a route.
 		*/
-		explicit Node(const SortedPage_Ptr& page_)
-		:	firstChildID(-1), page(page_), parentID(-1), siblingLeftID(-1), siblingRightID(-1)
+		NodeRoute()
+		:	rawPage(NULL), firstChildID(-1)
 		{}
 
 		/**
@@ -72,7 +177,7 @@ private:
 		*/
 		bool has_children() const
 		{
-			return firstChildID != -1;
+			return firstChildID.load(boost::memory_order_relaxed) != -1;
 		}
 	};
 
@@ -120,17 +225,66 @@ private:
 		{}
 	};
 
+	/**
+	\brief An instance of this class marks a B+-tree as undergoing a structure modification for as long as it exists.
+
+	In concurrent mode, a structure modification excludes all other writers, and keeps the structure version of
+	the tree odd so that any readers that overlap with it will restart. In serial mode, it has no effect.
+	*/
+	class StructureModification
+	{
+		//#################### PRIVATE VARIABLES ####################
+	private:
+		/** The lock on the B+-tree's structure mutex (held only in concurrent mode). */
+		boost::unique_lock<boost::shared_mutex> m_lock;
+
+		/** The B+-tree being modified. */
+		BTree& m_tree;
+
+		//#################### CONSTRUCTORS ####################
+	public:
+		/**
+		Starts a structure modification of the specified B+-tree.
+
+		\param tree	The B+-tree.
+		*/
+		explicit StructureModification(BTree& tree);
+
+		//#################### DESTRUCTOR ####################
+	public:
+		/**
+		Finishes the structure modification.
+		*/
+		~StructureModification();
+
+		//#################### COPY CONSTRUCTOR & ASSIGNMENT OPERATOR ####################
+	private:
+		/** Private and unimplemented - structure modifications cannot be copied. */
+		StructureModification(const StructureModification&);
+		StructureModification& operator=(const StructureModification&);
+	};
+
 public:
 	/**
 	\brief An instance of this class can be used to traverse the leaf tuples in a B+-tree.
 
-	The leaf tuples themselves cannot be modified through this interface.
+	The leaf tuples themselves cannot be modified through this interface. As with a page iterator,
+	dereferencing an iterator yields a view of the tuple by value, whereas the tuple pointed to by
+	operator-> is owned by the iterator.
 	*/
-	class ConstIterator : public std::iterator<std::bidirectional_iterator_tag, BackedTuple>
+	class ConstIterator
 	{
 		//#################### FRIENDS ####################
 		friend class BTree;
 
+		//#################### TYPEDEFS ####################
+	public:
+		typedef std::bidirectional_iterator_tag iterator_category;
+		typedef std::ptrdiff_t difference_type;
+		typedef const BackedTuple *pointer;
+		typedef BackedTuple reference;
+		typedef BackedTuple value_type;
+
 		//#################### PRIVATE VARIABLES ####################
 	private:
 		/** The B+-tree for which this is an iterator. */
@@ -165,7 +319,7 @@ public:
 
 		//#################### PUBLIC OPERATORS ####################
 	public:
-		const BackedTuple& operator*() const
+		BackedTuple operator*() const
 		{
 			return *m_it;
 		}
@@ -190,14 +344,15 @@ public:
 			// Provided we're not at the end of the current page (which can only
 			// happen if the page is an empty root page, in which case the whole
 			// B+-tree must also be empty), increment the iterator.
-			if(m_it != m_tree->page_end(m_nodeID))
+			const SortedPage::TupleSetCIter pageEnd = m_tree->page_end(m_nodeID);
+			if(m_it != pageEnd)
 			{
 				++m_it;
 			}
 
 			// If we're at the end of the current page and there's a right sibling,
 			// move the iterator to the start of the right sibling's page.
-			if(m_it == m_tree->page_end(m_nodeID) && m_tree->m_nodes[m_nodeID].siblingRightID != -1)
+			if(m_it == pageEnd && m_tree->m_nodes[m_nodeID].siblingRightID != -1)
 			{
 				m_nodeID = m_tree->m_nodes[m_nodeID].siblingRightID;
 				m_it = m_tree->page_begin(m_nodeID);
@@ -227,14 +382,158 @@ public:
 		}
 	};
 
+	/**
+	\brief An instance of this class can be used to traverse the leaf tuples in a range of a B+-tree a leaf at a time.
+
+	Each call to next() moves the cursor on to the next batch of tuples, which consists of all of the tuples in the
+	range that are on a single leaf. The tuples in a batch are presented as an array of their locations in memory,
+	which share the B+-tree's leaf tuple manipulator, and (for int and double fields) can also be decoded into a
+	column of values at once (which leaves whose pages store each field separately can do without touching the
+	other fields). This lets a consumer process a whole leaf's worth of tuples in a tight loop, without
+	the virtual calls and tuple views that iterating over them one at a time would involve.
+
+	As with the B+-tree's iterators, a cursor must not be used whilst the B+-tree may be being modified, and the
+	locations in a batch are only valid for as long as the tuples remain on their page (in particular, they must
+	not be retained for pages whose buffers may be evicted, e.g. the pages of a BufferedBTreePageController).
+	*/
+	class BatchCursor
+	{
+		//#################### PRIVATE VARIABLES ####################
+	private:
+		/** The position of the first tuple of the current batch within its leaf node. */
+		unsigned int m_batchBegin;
+
+		/** The position one beyond the last tuple of the current batch within its leaf node. */
+		unsigned int m_batchEnd;
+
+		/** The page of the leaf node containing the current batch (or NULL, if there is no current batch). */
+		const SortedPage *m_batchPage;
+
+		/** The ID of the leaf node containing the end of the range. */
+		int m_endNodeID;
+
+		/** The position of the end of the range within its leaf node. */
+		unsigned int m_endPosition;
+
+		/** The locations of the tuples in the current batch (found on demand, since decoding a column does not need them). */
+		mutable std::vector<const char*> m_locations;
+
+		/** The ID of the leaf node from which the next batch will be taken (or -1, if there are no more batches). */
+		int m_nodeID;
+
+		/** The position of the first tuple of the next batch within its leaf node. */
+		unsigned int m_position;
+
+		/** The B+-tree for which this is a cursor. */
+		const BTree *m_tree;
+
+		//#################### CONSTRUCTORS ####################
+	public:
+		/**
+		Constructs a cursor over the range of leaf tuples [begin,end). The cursor initially has an empty
+		batch: next() must be called to move it on to the first batch.
+
+		\param begin	An iterator pointing to the first tuple in the range.
+		\param end		An iterator pointing one beyond the last tuple in the range.
+		*/
+		BatchCursor(const ConstIterator& begin, const ConstIterator& end);
+
+		//#################### PUBLIC METHODS ####################
+	public:
+		/**
+		Gets the location in memory of the i'th tuple in the current batch.
+
+		\param i	The index of the tuple in the batch (in the range [0,size())).
+		\return		The location of the tuple.
+		*/
+		const char *location(unsigned int i) const
+		{
+			return locations()[i];
+		}
+
+		/**
+		Gets the locations in memory of the tuples in the current batch.
+
+		\return	An array of size() locations (or NULL, if the batch is empty).
+		*/
+		const char * const *locations() const
+		{
+			if(m_locations.empty() && m_batchEnd > m_batchBegin) fetch_locations();
+			return m_locations.empty() ? NULL : &m_locations[0];
+		}
+
+		/**
+		Moves the cursor on to the next (non-empty) batch of tuples, if any.
+
+		\return	true, if the cursor has moved on to another batch, or false if there are no more tuples in the range.
+		*/
+		bool next();
+
+		/**
+		Decodes the values of the specified double field of the tuples in the current batch.
+
+		\param fieldIndex	The index of the field (which must be of a type that can be read as a double).
+		\param values		Used to return the values (in the same order as the tuples).
+		*/
+		void read_doubles(unsigned int fieldIndex, std::vector<double>& values) const;
+
+		/**
+		Decodes the values of the specified int field of the tuples in the current batch.
+
+		\param fieldIndex	The index of the field (which must be of a type that can be read as an int).
+		\param values		Used to return the values (in the same order as the tuples).
+		*/
+		void read_ints(unsigned int fieldIndex, std::vector<int>& values) const;
+
+		/**
+		Gets the number of tuples in the current batch.
+
+		\return	The number of tuples in the current batch.
+		*/
+		unsigned int size() const
+		{
+			return m_batchEnd - m_batchBegin;
+		}
+
+		/**
+		Gets the manipulator used to interact with the tuples in each batch.
+
+		\return	The B+-tree's leaf tuple manipulator.
+		*/
+		const TupleManipulator& tuple_manipulator() const
+		{
+			return m_tree->m_leafTupleManipulator;
+		}
+
+		//#################### PRIVATE METHODS ####################
+	private:
+		/**
+		Finds the locations of the tuples in the current batch.
+		*/
+		void fetch_locations() const;
+	};
+
 	//#################### TYPEDEFS ####################
 public:
 	typedef std::pair<ConstIterator,ConstIterator> EqualRangeResult;
+	typedef boost::function<void(const ConstIterator&,const ConstIterator&)> ScanCallback;
 
 	//#################### PRIVATE VARIABLES ####################
 private:
-	/** The field indices to use when making branch keys. */
-	std::vector<unsigned int> m_branchKeyFieldIndices;
+	/**
+	A branch key with the right fields (all but the last field of a branch tuple), which is copied to make
+	each new branch key. Since copying a key requires no allocation, this keeps descents allocation-free.
+	*/
+	ValueKey m_branchKeyPrototype;
+
+	/** The tuple manipulator for the branch (index) tuples. */
+	TupleManipulator m_branchTupleManipulator;
+
+	/** Whether or not the B+-tree is in concurrent mode. */
+	bool m_concurrent;
+
+	/** Whether or not the B+-tree is in counted mode. */
+	bool m_counted;
 
 	/** The ID of the first leaf node (used to optimise begin()). */
 	int m_firstLeafID;
@@ -242,29 +541,88 @@ private:
 	/** The ID of the last leaf node (used to optimise end()). */
 	int m_lastLeafID;
 
+	/** The tuple manipulator for the leaf (data) tuples. */
+	TupleManipulator m_leafTupleManipulator;
+
 	/** An ID allocator used to allocate IDs for the nodes. */
 	IDAllocator m_nodeIDAllocator;
 
-	/** The nodes in the B+-tree. */
-	std::vector<Node> m_nodes;
+	/**
+	The nodes in the B+-tree (apart from their routes, see m_routes). These are never moved once
+	created, so that concurrent readers can safely access them whilst a writer is adding new nodes.
+	*/
+	SegmentedArray<Node> m_nodes;
 
 	/** The page controller used to construct/destroy pages for the B+-tree. */
 	BTreePageController_CPtr m_pageController;
 
+	/**
+	The pages of nodes that have been deleted in concurrent mode. These are kept alive until no
+	reader is still using them, so that they are always released by a writer (page controllers
+	are not generally thread-safe).
+	*/
+	std::vector<SortedPage_Ptr> m_retiredPages;
+
 	/** The ID of the root node. */
-	int m_rootID;
+	boost::atomic<int> m_rootID;
+
+	/** The routes of the nodes in the B+-tree, indexed by node ID (see NodeRoute). Like the nodes, these are never moved once created. */
+	SegmentedArray<NodeRoute> m_routes;
+
+	/**
+	The mutex used in concurrent mode to exclude other writers during a structure modification
+	(and, in counted mode, to exclude writers whilst the order statistics are being computed).
+	*/
+	mutable boost::shared_mutex m_structureMutex;
+
+	/**
+	The structure version of the B+-tree, which is used in concurrent mode. It is odd
+	whilst a structure modification is in progress.
+	*/
+	boost::atomic<unsigned int> m_structureVersion;
+
+#ifdef WHERY_BTREE_STATS
+	/** The recorder used to record the B+-tree's statistics (it is updated even by const operations). */
+	mutable BTreeStatsRecorder m_statsRecorder;
+#endif
+
+	/**
+	If the separators are truncated, branch keys holding the first k branch key fields (for each k from 1 up to
+	the number of branch key fields), indexed by k - 1, which are copied to make each new (truncated) separator.
+	*/
+	std::vector<ValueKey> m_truncatedBranchKeyPrototypes;
+
+	/**
+	If the separators are truncated, the tuple manipulators for branch tuples with k key fields (for each k from 1
+	up to the number of branch key fields), indexed by k - 1. This is empty if the separators are not truncated.
+	*/
+	std::vector<TupleManipulator> m_truncatedBranchTupleManipulators;
 
 	/** The number of tuples currently stored in the leaf nodes. */
-	unsigned int m_tupleCount;
+	boost::atomic<unsigned int> m_tupleCount;
 
 	//#################### CONSTRUCTORS ####################
 public:
 	/**
 	Constructs a B+-tree whose pages are to be constructed/destroyed using the specified controller.
 
-	\param pageController	The page controller to be used to construct/destroy pages for the B+-tree.
+	If the page controller holds the saved structure of a B+-tree (see BTreePageController::load_btree_structure),
+	the B+-tree is reopened from it; otherwise, the B+-tree starts out empty.
+
+	\param pageController			The page controller to be used to construct/destroy pages for the B+-tree.
+	\param concurrent				Whether or not the B+-tree should be constructed in concurrent mode.
+	\param counted					Whether or not the B+-tree should be constructed in counted mode.
+	\throw std::invalid_argument	If the separators are to be truncated, but the branch key fields do not have
+									the same types as the leading leaf fields.
 	*/
-	explicit BTree(const BTreePageController_CPtr& pageController);
+	explicit BTree(const BTreePageController_CPtr& pageController, bool concurrent = false, bool counted = false);
+
+	//#################### DESTRUCTOR ####################
+public:
+	/**
+	Destroys the B+-tree. If its page controller persists the structure of the B+-tree, the structure is saved first.
+	*/
+	~BTree();
 
 	//#################### COPY CONSTRUCTOR & ASSIGNMENT OPERATOR ####################
 private:
@@ -282,15 +640,37 @@ public:
 	ConstIterator begin() const;
 
 	/**
-	TODO: Loads a large number of tuples into an empty B+-tree to avoid the cost of repeated insertions.
+	Loads a large number of tuples into an empty B+-tree to avoid the cost of repeated insertions.
+	The tuples are taken in order from the specified pages, which must be sorted with respect to
+	each other (i.e. the last tuple on each page must not be ordered after the first tuple on the
+	next non-empty page). The B+-tree is built bottom-up: the leaves are packed to the specified
+	fill factor (subject to the minimum tuple invariant), after which each level of branch nodes
+	is built in a single pass over the level beneath it. The leaves are sized by the capacity that
+	the page controller reports, which for pages whose capacity depends on their values should be
+	the capacity they have whatever their values.
+
+	\param pages					The pages containing the tuples to load.
+	\param fillFactor				The fraction of each node's capacity to fill (in the range (0,1]).
+	\throw std::invalid_argument	If the fill factor is out of range or the pages are not sorted.
+	\throw std::logic_error			If the B+-tree is not empty.
 	*/
-	void bulk_load(const std::vector<SortedPage_Ptr>& pages);
+	void bulk_load(const std::vector<SortedPage_Ptr>& pages, double fillFactor = 1.0);
 
 	/**
 	TODO: Clears the B+-tree. (This is deferred because of its interaction with entity management.)
 	*/
 	void clear();
 
+	/**
+	Counts the leaf (data) tuples in the B+-tree that lie within the range specified by key, i.e. those
+	in [lower_bound(key), upper_bound(key)), in logarithmic time. The B+-tree must be in counted mode.
+
+	\param key				The range.
+	\return					The number of leaf tuples in the range.
+	\throw std::logic_error	If the B+-tree is not in counted mode.
+	*/
+	unsigned int count(const RangeKey& key) const;
+
 	/**
 	Returns an iterator pointing to the end of the set of leaf (data) tuples in the B+-tree.
 
@@ -319,21 +699,27 @@ public:
 
 	/**
 	Erases the first leaf (data) tuple that matches the specified key from the B+-tree.
-	Other leaf tuples that match the specified key remain in the tree.
+	Other leaf tuples that match the specified key remain in the tree. If the separators
+	are truncated, this may leave a node below its minimum (see erase_tuple_from_branch).
 
 	\param key	The key denoting the tuple to erase.
 	*/
 	void erase_tuple(const ValueKey& key);
 
 	/**
-	TODO: Erases any tuples that match the specified key from the B+-tree.
+	Erases any leaf (data) tuples that lie within the range specified by key from the B+-tree.
+	Rather than erasing the tuples one at a time, this walks down the tree once, deleting any
+	subtrees that lie entirely within the range wholesale, and only erasing individual tuples
+	from the leaves at the ends of the range. Only the nodes on the paths to those leaves can
+	be left with too few tuples, so only they need to be rebalanced afterwards.
 
 	\param key	The key denoting the tuples to erase.
 	*/
 	void erase_tuples(const RangeKey& key);
 
 	/**
-	TODO: Erases any tuples that match the specified key from the B+-tree.
+	Erases any leaf (data) tuples that compare equal to the specified key (using prefix comparison)
+	from the B+-tree. This is equivalent to erasing the closed range [key,key].
 
 	\param key	The key denoting the tuples to erase.
 	*/
@@ -349,13 +735,43 @@ public:
 	*/
 	ConstIterator find(const ValueKey& key) const;
 
+	/**
+	Finds each of the specified keys in the B+-tree, as if by calling find on each of them in turn.
+	This is generally faster than doing so, since the keys are searched for together (see lower_bound_batch).
+
+	\param keys	The search keys.
+	\return		A vector containing, for each key (in the same order as the keys), an iterator pointing
+					to the first leaf (data) tuple in the B+-tree that compares equal to it (if any), or end()
+					otherwise.
+	*/
+	std::vector<ConstIterator> find_batch(const std::vector<ValueKey>& keys) const;
+
 	/**
 	Inserts a leaf (data) tuple into the B+-tree.
 
+	If the capacity of the leaf pages depends on their values, an insertion may split a leaf that still has empty
+	slots. If neither half of a split leaf has room for the tuple (see split_leaf_and_insert), the insertion is
+	retried from the root, splitting the relevant half in turn; this terminates because a leaf page can hold at
+	least two tuples whatever their values.
+
 	\param tuple	The tuple to insert.
 	*/
 	void insert_tuple(const Tuple& tuple);
 
+	/**
+	Returns whether or not the B+-tree is in concurrent mode.
+
+	\return	true, if the B+-tree is in concurrent mode, or false otherwise.
+	*/
+	bool is_concurrent() const;
+
+	/**
+	Returns whether or not the B+-tree is in counted mode.
+
+	\return	true, if the B+-tree is in counted mode, or false otherwise.
+	*/
+	bool is_counted() const;
+
 	/**
 	Returns a tuple manipulator that can be used to interact with the B+-tree's leaf (data) tuples.
 
@@ -363,6 +779,17 @@ public:
 	*/
 	TupleManipulator leaf_tuple_manipulator() const;
 
+	/**
+	Looks up the first leaf (data) tuple in the B+-tree that compares equal to key (if any),
+	and returns a copy of it. Unlike find, this is safe to use whilst the B+-tree is being
+	modified concurrently, since the tuple is copied before the search is validated.
+
+	\param key	The search key.
+	\return		A copy of the first leaf (data) tuple in the B+-tree that compares equal
+				to key (if any), or boost::none otherwise.
+	*/
+	boost::optional<FreshTuple> lookup(const ValueKey& key) const;
+
 	/**
 	Returns an iterator pointing to the leaf (data) tuple at the lower end
 	of the range specified by key.
@@ -384,6 +811,49 @@ public:
 	*/
 	ConstIterator lower_bound(const ValueKey& key) const;
 
+	/**
+	Finds the lower bound of each of the specified keys in the B+-tree, as if by calling lower_bound
+	on each of them in turn. Rather than descending the tree separately for each key, this sorts the
+	keys (by their normalized encodings) and then descends the tree for all of them at once, a level
+	at a time, so that keys whose paths share a prefix visit the shared nodes consecutively, whilst
+	they are still in the cache, and duplicate keys share a single descent. Whilst a node is being
+	searched for one key, the page of a node a few keys further on is prefetched, so that the cache
+	misses for several descents overlap. (In concurrent mode, the keys are simply looked up one at
+	a time.)
+
+	\param keys	The search keys.
+	\return		A vector containing, for each key (in the same order as the keys), an iterator pointing
+					to the first leaf (data) tuple in the B+-tree that is not ordered before it, or end() if
+					all tuples are ordered before it.
+	*/
+	std::vector<ConstIterator> lower_bound_batch(const std::vector<ValueKey>& keys) const;
+
+	/**
+	Scans the leaf (data) tuples in the specified range using several threads. The range is cut into runs
+	of consecutive leaves at the boundaries between the subtrees of the highest branch level at which it
+	spans enough nodes to give each thread several runs (so that a thread that finishes early can steal
+	runs from the others), and the runs are then processed on a WorkStealingRunner. Since the subtrees at
+	any one level are of similar sizes, the runs contain similar numbers of tuples, and no leaf has to be
+	read to find where they start.
+
+	The callback is called once for each run, with a pair of iterators [begin,end) delimiting the tuples
+	in it, and may be called from several threads at once (e.g. to aggregate the tuples, it should keep a
+	separate total for each run, and combine them afterwards). Like any other iterators, the ones passed
+	to the callback must not be used whilst the B+-tree may be being modified. Since the leaves are read
+	from several threads at once, a scan with more than one thread requires leaf pages that can be read
+	concurrently (see SortedPage::supports_concurrent_reads), which rules out buffered pages and pages
+	that reconstruct their tuples on demand (e.g. columnar and packed pages). A scan with one thread
+	simply calls the callback once for the whole range on the calling thread, and no threads are
+	started for an empty range.
+
+	\param key						The range.
+	\param threadCount				The number of threads to use (including the calling thread).
+	\param callback					The callback to call for each run.
+	\throw std::invalid_argument	If threadCount is zero.
+	\throw std::logic_error			If threadCount is greater than one and the leaf pages cannot be read concurrently.
+	*/
+	void parallel_scan(const RangeKey& key, unsigned int threadCount, const ScanCallback& callback) const;
+
 	/**
 	Prints the B+-tree to an output stream (for debugging purposes).
 
@@ -391,12 +861,67 @@ public:
 	*/
 	void print(std::ostream& os) const;
 
+	/**
+	Calculates the rank of the specified key, i.e. the number of leaf (data) tuples in the B+-tree that are
+	ordered before it (using prefix comparison), in logarithmic time. This is the position of lower_bound(key)
+	in the sequence of leaf tuples. The B+-tree must be in counted mode.
+
+	\param key				The key.
+	\return					The number of leaf tuples that are ordered before key.
+	\throw std::logic_error	If the B+-tree is not in counted mode.
+	*/
+	unsigned int rank(const ValueKey& key) const;
+
+	/**
+	Discards the statistics recorded for the B+-tree so far (this does nothing unless
+	WHERY_BTREE_STATS is defined).
+	*/
+	void reset_stats();
+
+	/**
+	Finds the leaf (data) tuple with the specified rank, i.e. the one at the specified (zero-based) position
+	in the sequence of leaf tuples, in logarithmic time. For example, select(tuple_count() * 99 / 100) finds
+	the 99th percentile tuple. The B+-tree must be in counted mode.
+
+	\param k					The rank of the tuple.
+	\return					An iterator pointing to the tuple with rank k, or end() if k >= tuple_count().
+	\throw std::logic_error	If the B+-tree is not in counted mode.
+	*/
+	ConstIterator select(unsigned int k) const;
+
+	/**
+	Takes a snapshot of the statistics recorded for the B+-tree so far. Unless WHERY_BTREE_STATS
+	is defined, nothing is recorded and the snapshot is always empty. Note that only the latencies
+	of the operations themselves are recorded: in particular, equal_range is timed as a range lookup
+	(the iteration over the range, whether via iterators or a BatchCursor, is up to the caller and is
+	not timed), whereas parallel_scan is timed as a whole. Batched lookups are not timed as a whole.
+
+	\return	The snapshot.
+	*/
+	BTreeStats stats() const;
+
 	/**
 	Gets the number of tuples currently stored in the B+-tree's leaf nodes.
 
 	\return	The number of tuples currently stored in the B+-tree's leaf nodes.
 	*/
-	unsigned int tuple_count();
+	unsigned int tuple_count() const;
+
+	/**
+	Replaces the leaf (data) tuple pointed to by the specified iterator with the specified tuple, e.g. to change
+	a field that is not part of the key. If the replacement is ordered between the tuple's neighbours on its leaf
+	(and, if it would become the first or last tuple on the leaf, does not move towards the neighbouring leaf),
+	it is simply swapped into the same leaf, without any further searching and without any splits or merges.
+	Otherwise, the old tuple is erased and the replacement inserted as usual. Either way, the iterator (and any
+	other iterators into the B+-tree) must not be used afterwards. Since the iterators returned in concurrent mode
+	are only snapshots, which may no longer point to the tuple by the time it is updated, this is not supported
+	in concurrent mode.
+
+	\param it					An iterator pointing to the tuple to replace (which must not be end()).
+	\param tuple				The replacement tuple.
+	\throw std::logic_error	If the B+-tree is in concurrent mode.
+	*/
+	void update_tuple(const ConstIterator& it, const Tuple& tuple);
 
 	/**
 	Returns an iterator pointing one beyond the leaf (data) tuple at the higher end
@@ -460,6 +985,14 @@ private:
 	*/
 	void add_root_node(const Split& split);
 
+	/**
+	Makes a branch key containing the key fields of the specified branch tuple (which may be a truncated separator).
+
+	\param branchTuple	The branch tuple.
+	\return				The branch key.
+	*/
+	ValueKey branch_key_of(const Tuple& branchTuple) const;
+
 	/**
 	Returns a tuple manipulator that can be used to interact with the B+-tree's branch (index) tuples.
 
@@ -467,6 +1000,79 @@ private:
 	*/
 	TupleManipulator branch_tuple_manipulator() const;
 
+	/**
+	Builds a level of branch nodes above the specified level of nodes as part of a bulk load.
+	The nodes on the level beneath are divided as evenly as possible between the branch nodes.
+
+	\param childIDs			The IDs of the nodes on the level beneath (in left-to-right order).
+	\param targetChildCount	The number of children we would ideally like each branch node to have.
+	\param minChildCount	The minimum number of children each branch node must have (if there is more than one).
+	\return					The IDs of the branch nodes (in left-to-right order).
+	*/
+	std::vector<int> bulk_load_branch_level(const std::vector<int>& childIDs, unsigned int targetChildCount, unsigned int minChildCount);
+
+	/**
+	Calculates the number of nodes to use to hold the specified number of items (tuples or children)
+	during a bulk load. The result is chosen so that dividing the items as evenly as possible between
+	the nodes gives each node close to the target number of items but never fewer than the minimum
+	(except when only a single node is needed).
+
+	\param itemCount	The number of items to be held.
+	\param target		The number of items we would ideally like each node to hold.
+	\param minimum		The minimum number of items each node must hold (if there is more than one node).
+	\return				The number of nodes to use.
+	*/
+	static unsigned int bulk_load_node_count(unsigned int itemCount, unsigned int target, unsigned int minimum);
+
+	/**
+	Checks whether or not the tuples of the specified right-hand node, with their number changed by the specified
+	offset, will fit in the spare capacity of the specified left-hand node. For example, an offset of 1 allows for
+	the index entry that is pulled down when two branch nodes are merged, and an offset of -1 allows for a tuple
+	that is erased before two leaf nodes are merged.
+
+	\param leftNodeID	The ID of the left-hand node.
+	\param rightNodeID	The ID of the right-hand node.
+	\param offset		The offset to apply to the number of tuples in the right-hand node.
+	\return				true, if the tuples will fit in the left-hand node, or false otherwise.
+	*/
+	bool can_merge(int leftNodeID, int rightNodeID, int offset) const;
+
+	/**
+	Checks whether or not a tuple can be inserted into the specified full leaf node by redistributing a tuple across to the
+	specified sibling, i.e. whether the sibling has room for either the tuple itself or a tuple from the node, and the node
+	has room for the tuple once one of its own tuples has gone.
+
+	\param nodeID		The ID of the full leaf node.
+	\param siblingID	The ID of the sibling.
+	\param tuple		The tuple to insert.
+	\return				true, if the tuple can be inserted by redistribution, or false otherwise.
+	*/
+	bool can_redistribute_leaf_and_insert(int nodeID, int siblingID, const Tuple& tuple) const;
+
+	/**
+	Checks whether or not the specified number of index entries in the specified branch node can be replaced by new
+	ones (e.g. after a redistribution changes the first tuples of some of its children). This is always the case
+	unless the separators are truncated, in which case a new entry may be longer than the one it replaces, so we
+	require the node to have room for that many full-length entries. (The capacity of a truncating branch page is
+	measured in full-length entries, so bulk loads also size branch nodes by them.) If this check fails, the
+	redistribution is not attempted: an insertion splits the node instead, and an erasure may leave it underfull.
+
+	\param parentNodeID	The ID of the branch node.
+	\param n			The number of index entries to replace.
+	\return				true, if the index entries can be replaced, or false otherwise.
+	*/
+	bool can_replace_index_entries(int parentNodeID, unsigned int n) const;
+
+	/**
+	Checks whether or not the leaf tuple pointed to by the specified iterator can be replaced by the specified
+	tuple without moving it to a different position in its leaf or to a different leaf (see update_tuple).
+
+	\param it		An iterator pointing to the tuple to replace.
+	\param tuple	The replacement tuple.
+	\return			true, if the tuple can be replaced within its leaf, or false otherwise.
+	*/
+	bool can_update_in_place(const ConstIterator& it, const Tuple& tuple) const;
+
 	/**
 	Extracts the child node ID from a branch tuple of the form <key1,...,keyN,child node ID>.
 
@@ -475,6 +1081,14 @@ private:
 	*/
 	int child_node_id(const BackedTuple& branchTuple) const;
 
+	/**
+	Returns the IDs of the children of the specified branch node (in left-to-right order).
+
+	\param nodeID	The ID of the branch node.
+	\return			The IDs of its children.
+	*/
+	std::vector<int> child_node_ids(int nodeID) const;
+
 	/**
 	Connects a fresh node into the B+-tree as the right sibling of the specified node
 	and with the same parent. Note that this function makes no attempt to update the
@@ -494,6 +1108,15 @@ private:
 	*/
 	void delete_node(int nodeID);
 
+	/**
+	Deletes the subtree rooted at the specified node from the B+-tree, disconnecting each node in it
+	from its siblings, emptying its page and updating the tuple count as it goes. Note that the caller is
+	responsible for removing any index entry for the root of the subtree from its parent.
+
+	\param nodeID	The ID of the node at the root of the subtree to delete.
+	*/
+	void delete_subtree(int nodeID);
+
 	/**
 	Disconnects the specified node from its siblings in the B+-tree. Note that this
 	function makes no attempt to update the parent of the node, and should therefore
@@ -516,6 +1139,11 @@ private:
 	the specified branch node. Other tuples that match the specified key remain in
 	the subtree.
 
+	If the separators are truncated, a child left below its minimum may be neither redistributed nor merged (see
+	can_replace_index_entries), in which case it is left underfull. This only happens if the node has no room for a
+	full-length index entry and the child cannot be merged with either of its siblings (i.e. it and either sibling
+	would not fit on a single page). A later erasure from the child tries again, and later insertions refill it.
+
 	\param key		The key denoting the tuple to erase.
 	\param nodeID	The ID of the branch node at the root of the subtree from which to erase it.
 	\return			The result of any merge that occurs, or boost::none otherwise.
@@ -526,6 +1154,9 @@ private:
 	Erases the first tuple that matches the specified key from the specified leaf node.
 	Other tuples that match the specified key remain in the node.
 
+	If the separators are truncated, the leaf may be left below its minimum for the reasons given for
+	erase_tuple_from_branch, but it always keeps at least one tuple, since an empty leaf can always be merged.
+
 	\param key		The key denoting the tuple to erase.
 	\param nodeID	The ID of the leaf node from which to erase it.
 	\return			The result of any merge that occurs, or boost::none otherwise.
@@ -542,6 +1173,39 @@ private:
 	*/
 	boost::optional<Merge> erase_tuple_from_subtree(const ValueKey& key, int nodeID);
 
+	/**
+	Erases any tuples that lie within the specified range from the subtree rooted at the specified
+	branch node. Children whose subtrees lie entirely within the range are deleted wholesale, and
+	children that straddle an end of the range are recursed into; any of the node's children that
+	are left with too few tuples are then rebalanced. The node itself may be left with too few
+	tuples (to be dealt with by its parent), and if it is left with no children at all, it is
+	cleared so that its parent can delete it like an empty leaf.
+
+	\param key		The key denoting the range of tuples to erase.
+	\param nodeID	The ID of the branch node at the root of the subtree from which to erase them.
+	\return			true, if the subtree is left empty, or false otherwise.
+	*/
+	bool erase_tuples_from_branch(const RangeKey& key, int nodeID);
+
+	/**
+	Erases any tuples that lie within the specified range from the specified leaf node.
+	The node may be left with too few tuples (to be dealt with by its parent).
+
+	\param key		The key denoting the range of tuples to erase.
+	\param nodeID	The ID of the leaf node from which to erase them.
+	\return			true, if the leaf is left empty, or false otherwise.
+	*/
+	bool erase_tuples_from_leaf(const RangeKey& key, int nodeID);
+
+	/**
+	Erases any tuples that lie within the specified range from the subtree rooted at the specified node.
+
+	\param key		The key denoting the range of tuples to erase.
+	\param nodeID	The ID of the node at the root of the subtree from which to erase them.
+	\return			true, if the subtree is left empty, or false otherwise.
+	*/
+	bool erase_tuples_from_subtree(const RangeKey& key, int nodeID);
+
 	/**
 	Finds the index entry for the specified node in its parent node. The node must
 	have a parent and must not be the parent's first child.
@@ -555,7 +1219,10 @@ private:
 	Checks whether or not the specified node satisfies its minimum tuple invariant, possibly
 	after changing its tuple count by the specified offset. For example, specifying an offset
 	of -1 allows us to check whether the node will still satisfy its minimum tuple invariant
-	after a tuple has been erased.
+	after a tuple has been erased. The minimum is half the capacity of the node's page, but
+	it is not a strict invariant: a node made by a biased split (see split_leaf_and_insert)
+	starts out far below it, and is only brought back up to it (by redistribution or merging)
+	once a tuple is erased from it.
 
 	\param nodeID	The node for which we want to check the minimum tuple invariant.
 	\param offset	An optional offset to apply to the node's tuple count when performing the check.
@@ -574,6 +1241,15 @@ private:
 	*/
 	bool has_less_than_max_tuples(int nodeID) const;
 
+	/**
+	Checks whether or not the specified leaf node has room for the specified tuple (see SortedPage::has_room_for).
+
+	\param nodeID	The ID of the leaf node to check.
+	\param tuple	The tuple.
+	\return			true, if the node has room for the tuple, or false otherwise.
+	*/
+	bool has_room_for(int nodeID, const Tuple& tuple) const;
+
 	/**
 	Inserts a tuple into the subtree rooted at the specified branch node. This may cause
 	the node to be split, in which case a split result will be returned.
@@ -604,6 +1280,18 @@ private:
 	*/
 	boost::optional<Split> insert_tuple_into_subtree(const Tuple& tuple, int nodeID);
 
+	/**
+	Checks whether or not inserting the specified tuple into the specified node would append it to the end
+	of the node's level of the B+-tree, i.e. whether the node is the rightmost one on its level and the tuple
+	would go after all of its existing tuples. This is what happens when inserting tuples with increasing
+	keys (e.g. IDs), and is used to bias splits so as to leave full nodes behind.
+
+	\param nodeID	The ID of the node.
+	\param tuple	The tuple (a leaf tuple for a leaf node, or a branch tuple for a branch node).
+	\return			true, if inserting the tuple into the node would append it to the node's level, or false otherwise.
+	*/
+	bool is_append(int nodeID, const Tuple& tuple) const;
+
 	/**
 	Checks whether or not the specified sibling of the specified node is "useful" for a
 	redistribution or a merge, in the sense that it both exists and has the same parent.
@@ -615,6 +1303,27 @@ private:
 	*/
 	bool is_useful_sibling(int nodeID, int siblingID) const;
 
+	/**
+	Returns the ID of the leaf node that would be reached by walking down the B+-tree
+	from the root, using the specified key to choose a child at each branch node. This
+	is only safe when no structure modification can be in progress (e.g. in concurrent
+	mode, when holding a shared lock on the structure mutex).
+
+	\param key				The key to use to choose a child at each branch node.
+	\param useUpperBound	Whether to choose the child to the left of the key's upper bound (true)
+							or lower bound (false) at each branch node.
+	\return					The ID of the leaf node reached.
+	*/
+	int leaf_for(const ValueKey& key, bool useUpperBound) const;
+
+	/**
+	Returns the ID of the leftmost leaf in the subtree rooted at the specified node.
+
+	\param nodeID	The ID of the node at the root of the subtree.
+	\return			The ID of the leftmost leaf in the subtree.
+	*/
+	int leftmost_leaf_of(int nodeID) const;
+
 	/**
 	Returns the ID of the child to the left of the pointed-to index entry in the
 	specified branch node. (If the iterator points to the end of the index entries,
@@ -638,9 +1347,21 @@ private:
 	*/
 	ValueKey make_branch_key(const Tuple& sourceTuple) const;
 
+	/**
+	Makes a branch key containing only the first few branch key fields, copied from the specified
+	source tuple (if the separators are not truncated, the key must contain all of the fields).
+
+	\param sourceTuple	The tuple from which to copy the branch key's fields.
+	\param keyArity		The number of fields to copy.
+	\return				The branch key.
+	*/
+	ValueKey make_branch_key(const Tuple& sourceTuple, unsigned int keyArity) const;
+
 	/**
 	Makes a branch tuple by copying the appropriate number of fields from a source tuple
-	(which can be either a leaf or a branch tuple) and filling in the child node ID.
+	(which can be either a leaf tuple or a branch key) and filling in the child node ID.
+	If the separators are truncated, the branch tuple has as many key fields as the
+	source tuple, up to the number of branch key fields.
 
 	\param sourceTuple	The tuple from which to copy all but one of the branch tuple's fields.
 	\param childNodeID	The ID of the child node that will be stored in the last field of the
@@ -649,6 +1370,36 @@ private:
 	*/
 	FreshTuple make_branch_tuple(const Tuple& sourceTuple, int childNodeID) const;
 
+	/**
+	Makes the key for the index entry of the specified node, i.e. a separator between the first leaf tuple
+	in the node's subtree and the last leaf tuple to its left (see make_separator). The node must not be the
+	leftmost node on its level, and the leftmost leaf in its subtree must contain at least one tuple.
+
+	\param nodeID	The ID of the node.
+	\return			The key.
+	*/
+	ValueKey make_index_key(int nodeID) const;
+
+	/**
+	Makes a separator between two adjacent leaf tuples, i.e. a branch key that can be used to divide the
+	tuples up to and including the left-hand one from those starting with the right-hand one. If the
+	separators are truncated, this is the shortest prefix of the right-hand tuple that is not a prefix
+	of the left-hand one (or all of its branch key fields, if there is none); otherwise, it is simply the
+	branch key of the right-hand tuple.
+
+	\param lastLeftTuple	The left-hand tuple.
+	\param firstRightTuple	The right-hand tuple.
+	\return					The separator.
+	*/
+	ValueKey make_separator(const Tuple& lastLeftTuple, const Tuple& firstRightTuple) const;
+
+	/**
+	Makes a description of the structure of the B+-tree that its page controller can persist (see BTreePageController::BTreeStructure).
+
+	\return	The structure of the B+-tree.
+	*/
+	BTreePageController::BTreeStructure make_structure() const;
+
 	/**
 	Merges two branch nodes together (by merging the right-hand node into the left-hand node).
 
@@ -658,6 +1409,15 @@ private:
 	*/
 	Merge merge_branches(int leftNodeID, int rightNodeID);
 
+	/**
+	Merges two leaf nodes together (by merging the right-hand node into the left-hand node).
+
+	\param leftNodeID	The left-hand operand of the merge.
+	\param rightNodeID	The right-hand operand of the merge.
+	\return				The result of the merge.
+	*/
+	Merge merge_leaves(int leftNodeID, int rightNodeID);
+
 	/**
 	Merges two leaf nodes together, erasing a tuple from one of them in the process.
 
@@ -669,6 +1429,23 @@ private:
 	*/
 	Merge merge_leaves_and_erase(int nodeID, const SortedPage::TupleSetCIter& it, int leftNodeID, int rightNodeID);
 
+	/**
+	Finds the lower or upper bound of the specified key using optimistic lock coupling, which makes it safe
+	to call whilst the B+-tree is being modified concurrently. No node latches are taken: instead, the version
+	of each node (and the structure version of the tree) is checked before the search moves on from the node,
+	and the search restarts from the root if a concurrent writer has modified anything it has read. (Loading
+	each node's page does briefly take one of the spinlocks that Boost uses to implement boost::atomic_load on
+	shared pointers, but these are only ever held for the duration of a reference count update.)
+
+	\param key		The search key.
+	\param upper	Whether to find the upper bound (true) or the lower bound (false) of the key.
+	\param match	If non-NULL, the pointed-to tuple is set to a copy of the leaf tuple at the bound
+					(or to boost::none if the bound is at the end of the tree). The copy is made before
+					the search is validated, so it is consistent with the returned iterator.
+	\return			An iterator pointing to the bound.
+	*/
+	ConstIterator optimistic_bound(const ValueKey& key, bool upper, boost::optional<FreshTuple> *match) const;
+
 	/**
 	Returns the page of the specified node.
 
@@ -728,6 +1505,73 @@ private:
 	*/
 	void pull_down_index_entry(int sourceNodeID, int targetNodeID, int childNodeID);
 
+	/**
+	Calculates the pair of iterators returned by equal_range for the specified range key, without timing the
+	calculation as a range lookup (so that other operations that need the range, e.g. parallel_scan, are not
+	also counted as range lookups).
+
+	\param key	The range key.
+	\return		The pair [lower_bound(key), upper_bound(key)] if the key is valid, or else the pair
+				[lower_bound(key), lower_bound(key)].
+	*/
+	EqualRangeResult range_bounds(const RangeKey& key) const;
+
+	/**
+	Calculates the number of leaf tuples that are ordered before the lower or upper bound of the specified key,
+	using the subtree tuple counts maintained in counted mode.
+
+	\param key		The key.
+	\param upper	Whether to use the upper bound (true) or the lower bound (false) of the key.
+	\return		The number of leaf tuples that are ordered before the bound.
+	*/
+	unsigned int rank_of_bound(const ValueKey& key, bool upper) const;
+
+	/**
+	Returns a raw pointer to the page of the specified node, without copying the shared pointer that owns it.
+	This is cheaper than page(), and is used by searches and by other code that does not delete any nodes
+	whilst it is using the page. In concurrent mode, it may only be used whilst structure modifications are
+	excluded (or by readers that will validate their results afterwards, and not dereference the pointer
+	again if validation fails).
+
+	\param nodeID	The node whose page we want to get.
+	\return			A raw pointer to the page of the specified node.
+	*/
+	SortedPage *raw_page(int nodeID) const;
+
+	/**
+	Restores the minimum tuple invariant for any children of the specified branch node that have
+	too few tuples (e.g. after a range erase), by merging each of them with, or redistributing
+	tuples from, an adjacent child. Unlike when erasing a single tuple, a child may be arbitrarily
+	far below its minimum, and may itself have a single child with too few tuples, so any branch
+	nodes that result are rebalanced in turn. If the node has only a single child, nothing can
+	be done at this level, and the child must be rebalanced once the node itself has been.
+
+	\param nodeID	The ID of the branch node whose children should be rebalanced.
+	*/
+	void rebalance_children(int nodeID);
+
+	/**
+	Restores the minimum tuple invariant for two adjacent nodes with the same parent, at least
+	one of which has too few tuples, either by merging them (if their tuples will fit in a single
+	node) or by moving enough tuples across from one to the other. Note that this function
+	appropriately updates the parent of the two nodes. If the separators are truncated, or the
+	capacity of the leaf pages depends on their values, it may not be possible to do either (see
+	can_replace_index_entries and SortedPage::has_room_for_tuples_from), in which case nothing is done.
+
+	\param leftNodeID	The ID of the left-hand node.
+	\param rightNodeID	The ID of the right-hand node.
+	\return				true, if anything was changed, or false otherwise.
+	*/
+	bool rebalance_siblings(int leftNodeID, int rightNodeID);
+
+	/**
+	Recalculates the numbers of leaf tuples in the subtrees rooted at the specified node and its descendants (used in counted mode).
+
+	\param nodeID	The ID of the node at the root of the subtree.
+	\return			The number of leaf tuples in the subtree.
+	*/
+	unsigned int recount_subtree(int nodeID);
+
 	/**
 	Moves the last tuple across from the left sibling of the specified branch node so as to restore
 	the specified node's minimum tuple invariant. The left sibling must have the same parent as the
@@ -795,7 +1639,42 @@ private:
 	void redistribute_leaf_right_and_insert(int nodeID, const Tuple& tuple);
 
 	/**
-	Splits a full branch node into two half-full branch nodes and inserts the specified tuple.
+	Releases any retired pages that are no longer being used by concurrent readers.
+	This must only be called during a structure modification.
+	*/
+	void release_retired_pages();
+
+	/**
+	Restores the nodes of an empty B+-tree from a saved structure, reopening their pages via the page controller.
+
+	\param structure	The saved structure (which must contain at least one node).
+	*/
+	void restore_structure(const BTreePageController::BTreeStructure& structure);
+
+	/**
+	Cuts the non-empty range [lower,upper) of leaf tuples into runs for a parallel scan, at the boundaries
+	between the subtrees of the highest level at which the range spans at least the specified number of
+	nodes (or at the boundaries between the leaves, if it does not span that many nodes at any level).
+
+	\param lower	An iterator pointing to the first tuple in the range.
+	\param upper	An iterator pointing one beyond the last tuple in the range.
+	\param runCount	The number of runs desired.
+	\return			The boundaries between the runs, starting with lower and ending with upper (no two are equal).
+	*/
+	std::vector<ConstIterator> scan_boundaries(const ConstIterator& lower, const ConstIterator& upper, unsigned int runCount) const;
+
+	/**
+	Sets the page of the specified node (keeping its raw page pointer in sync with it).
+
+	\param nodeID	The ID of the node.
+	\param page		The page (or NULL, to release the node's page).
+	*/
+	void set_page(int nodeID, const SortedPage_Ptr& page);
+
+	/**
+	Splits a full branch node into two half-full branch nodes and inserts the specified tuple. As for
+	leaves, the split is biased to the right if the tuple is being appended to the end of the level,
+	in which case the fresh node starts with only a few index entries (i.e. below its minimum).
 
 	\param nodeID					The ID of the branch node to split.
 	\param tuple					The tuple to insert.
@@ -804,7 +1683,12 @@ private:
 	Split split_branch_and_insert(int nodeID, const FreshTuple& tuple);
 
 	/**
-	Splits a full leaf node into two half-full leaf nodes and inserts the specified tuple.
+	Splits a full leaf node into two half-full leaf nodes and inserts the specified tuple. If the tuple is
+	being appended to the end of the B+-tree (see is_append), the split is instead biased to the right, so
+	that the original node is left almost full and the fresh node (which will receive subsequent appends)
+	starts almost empty (i.e. below its minimum, see has_at_least_min_tuples). If the capacity of the leaf
+	pages depends on their values, the node the tuple belongs in may still not have room for it, in which
+	case it is left out (and the tree's tuple count is left unchanged), so that the caller can retry.
 
 	\param nodeID					The ID of the leaf node to split.
 	\param tuple					The tuple to insert.
@@ -812,6 +1696,15 @@ private:
 	*/
 	Split split_leaf_and_insert(int nodeID, const Tuple& tuple);
 
+	/**
+	Returns the number of leaf tuples in the subtree rooted at the specified node. This is
+	only accurate for branch nodes in counted mode.
+
+	\param nodeID	The ID of the node at the root of the subtree.
+	\return		The number of leaf tuples in the subtree.
+	*/
+	unsigned int subtree_tuple_count(int nodeID) const;
+
 	/**
 	Transfers tuples from the specified leaf node to one of its siblings (which must have
 	the same parent and enough space for the extra tuples). Note that this function makes
@@ -846,6 +1739,49 @@ private:
 	*/
 	void transfer_leaf_tuples_right(int sourceNodeID, unsigned int n);
 
+	/**
+	In serial mode, attempts to insert a tuple by appending it directly to the rightmost leaf,
+	without searching for the leaf from the root. This fails if the tuple does not come after
+	all of the tuples in the B+-tree, or if the rightmost leaf is full, in which case the caller
+	should fall back to a full insert.
+
+	\param tuple	The tuple to insert.
+	\return			true, if the tuple was appended, or false otherwise.
+	*/
+	bool try_append_tuple(const Tuple& tuple);
+
+	/**
+	In concurrent mode, attempts to erase the first tuple that matches the specified key
+	by latching and modifying only the leaf that contains it. This fails if the erasure
+	would require a structure modification (or if the tuple is not in the expected leaf),
+	in which case the caller should fall back to a full erase.
+
+	\param key	The key denoting the tuple to erase.
+	\return		true, if the tuple was erased, or false otherwise.
+	*/
+	bool try_erase_tuple_from_leaf(const ValueKey& key);
+
+	/**
+	In concurrent mode, attempts to insert a tuple by latching and modifying only the
+	leaf into which it should be inserted. This fails if the leaf is full, in which case
+	the caller should fall back to a full insert (which may split or redistribute nodes).
+
+	\param tuple	The tuple to insert.
+	\return			true, if the tuple was inserted, or false otherwise.
+	*/
+	bool try_insert_tuple_into_leaf(const Tuple& tuple);
+
+	/**
+	Attempts to replace a leaf tuple within its leaf (see update_tuple). If the tuple cannot be replaced within
+	its leaf, its fields are instead copied into the specified key, so that the caller can erase it by a full erase.
+
+	\param it		An iterator pointing to the tuple to replace.
+	\param tuple	The replacement tuple.
+	\param key		A key with room for all of the fields of a leaf tuple.
+	\return			true, if the tuple was replaced, or false otherwise.
+	*/
+	bool try_update_tuple_in_leaf(const ConstIterator& it, const Tuple& tuple, ValueKey& key);
+
 	/**
 	Updates the parent pointers in the children of the old parent node to
 	point to the new parent node.
@@ -854,6 +1790,15 @@ private:
 	\param newParentID	The ID of the new parent node.
 	*/
 	void update_parent_pointers(int oldParentID, int newParentID);
+
+	/**
+	In counted mode, recalculates the tuple count of the specified branch node from the counts of its children
+	(which must themselves be up to date). This is used after the node has gained or lost children, e.g. in a
+	split, merge or redistribution. Outside counted mode, it has no effect.
+
+	\param nodeID	The ID of the branch node.
+	*/
+	void update_tuple_count(int nodeID);
 };
 
 //#################### GLOBAL FUNCTIONS ####################
@@ -6,6 +6,11 @@
 #ifndef H_WHERY_BTREEPAGECONTROLLER
 #define H_WHERY_BTREEPAGECONTROLLER
 
+#include <stdexcept>
+#include <vector>
+
+#include <boost/optional.hpp>
+
 #include "whery/db/pages/SortedPage.h"
 
 namespace whery {
@@ -15,9 +20,72 @@ namespace whery {
 
 This interface exists because the B+-tree itself should not need to care about how pages are constructed and destroyed
 (which generally involves specifying details of how the pages are persisted, and interaction with the cache).
+
+A controller whose pages outlive the B+-tree (e.g. because they are stored in a file) can also persist the structure
+of the B+-tree, i.e. its node table (see BTreeStructure), so that the B+-tree can later be reopened in place, rather
+than having to be rebuilt from its leaves. A B+-tree saves its structure via its controller when it is destroyed, and
+asks its controller for a saved structure when it is constructed. By default, controllers do not persist anything.
 */
 class BTreePageController
 {
+	//#################### NESTED TYPES ####################
+public:
+	/**
+	\brief An instance of this struct describes the structure of a B+-tree, in a form that can be persisted alongside its pages.
+	*/
+	struct BTreeStructure
+	{
+		/**
+		\brief An instance of this struct describes a node of the B+-tree.
+		*/
+		struct NodeRecord
+		{
+			/** The ID of the node's first child (if any), or -1 if the node is a leaf. */
+			int firstChildID;
+
+			/** The ID assigned to the node's page by the page controller (see btree_page_id), or -1 if there is no node with this ID. */
+			int pageID;
+
+			/** The ID of the node's parent (if any), or -1 otherwise. */
+			int parentID;
+
+			/** The ID of the node's left sibling (if any), or -1 otherwise. */
+			int siblingLeftID;
+
+			/** The ID of the node's right sibling (if any), or -1 otherwise. */
+			int siblingRightID;
+
+			/** The number of leaf tuples in the subtree rooted at the node (only maintained for the branch nodes of a counted B+-tree). */
+			unsigned int tupleCount;
+
+			NodeRecord()
+			:	firstChildID(-1), pageID(-1), parentID(-1), siblingLeftID(-1), siblingRightID(-1), tupleCount(0)
+			{}
+		};
+
+		/** Whether or not the B+-tree was in counted mode (i.e. whether or not the tuple counts of its branch nodes are valid). */
+		bool counted;
+
+		/** The ID of the first leaf node. */
+		int firstLeafID;
+
+		/** The ID of the last leaf node. */
+		int lastLeafID;
+
+		/** The nodes of the B+-tree, indexed by node ID (this is empty if the B+-tree was empty). */
+		std::vector<NodeRecord> nodes;
+
+		/** The ID of the root node. */
+		int rootID;
+
+		/** The number of tuples in the leaf nodes. */
+		unsigned int tupleCount;
+
+		BTreeStructure()
+		:	counted(false), firstLeafID(-1), lastLeafID(-1), rootID(-1), tupleCount(0)
+		{}
+	};
+
 	//#################### DESTRUCTOR ####################
 public:
 	/**
@@ -54,6 +122,89 @@ public:
 	\return	The leaf page.
 	*/
 	virtual SortedPage_Ptr make_btree_leaf_page() const = 0;
+
+	//#################### PUBLIC METHODS ####################
+public:
+	/**
+	Gets the ID that the controller has assigned to one of the B+-tree's pages, so that the page can be identified in
+	a saved structure (see reopen_btree_page). This need only be supported by controllers that persist the structure.
+
+	\param page				The page (which must have been made by this controller).
+	\return					The ID of the page.
+	\throw std::logic_error	If the controller does not persist the structure of the B+-tree.
+	*/
+	virtual int btree_page_id(const SortedPage& /*page*/) const
+	{
+		throw std::logic_error("This page controller does not persist the structure of its B+-tree.");
+	}
+
+	/**
+	Loads the structure of a B+-tree that was saved via this controller (e.g. in a previous session), if there is one.
+	The structure can only be loaded once: the B+-tree that loads it takes ownership of its pages, so if the B+-tree is
+	then modified, the structure is no longer valid until the B+-tree saves it again.
+
+	\return	The saved structure, if any, or boost::none otherwise.
+	*/
+	virtual boost::optional<BTreeStructure> load_btree_structure() const
+	{
+		return boost::none;
+	}
+
+	/**
+	Gets the maximum number of tuples that each of the B+-tree's branch (index) pages can hold.
+	By default, this makes a throwaway branch page and asks it, so controllers that can work
+	out the capacity of their pages directly should override it.
+
+	\return	The maximum number of tuples that each branch page can hold.
+	*/
+	virtual unsigned int max_btree_branch_tuple_count() const
+	{
+		return make_btree_branch_page()->max_tuple_count();
+	}
+
+	/**
+	Gets the maximum number of tuples that each of the B+-tree's leaf (data) pages can hold.
+	By default, this makes a throwaway leaf page and asks it, so controllers that can work
+	out the capacity of their pages directly should override it.
+
+	\return	The maximum number of tuples that each leaf page can hold.
+	*/
+	virtual unsigned int max_btree_leaf_tuple_count() const
+	{
+		return make_btree_leaf_page()->max_tuple_count();
+	}
+
+	/**
+	Gets whether or not the controller persists the structure of its B+-tree (see save_btree_structure).
+
+	\return	true, if the controller persists the structure of its B+-tree, or false otherwise.
+	*/
+	virtual bool persists_btree_structure() const
+	{
+		return false;
+	}
+
+	/**
+	Reopens one of the pages of a B+-tree whose structure was saved via this controller (see load_btree_structure).
+
+	\param pageID			The ID of the page (see btree_page_id).
+	\param leaf				Whether the page is a leaf (data) page, as opposed to a branch (index) page.
+	\return					The page.
+	\throw std::logic_error	If the controller does not persist the structure of the B+-tree.
+	*/
+	virtual SortedPage_Ptr reopen_btree_page(int /*pageID*/, bool /*leaf*/) const
+	{
+		throw std::logic_error("This page controller does not persist the structure of its B+-tree.");
+	}
+
+	/**
+	Saves the structure of the B+-tree, so that it can be reopened by a later B+-tree that uses this controller.
+	By default, this does nothing.
+
+	\param structure	The structure of the B+-tree.
+	*/
+	virtual void save_btree_structure(const BTreeStructure& /*structure*/) const
+	{}
 };
 
 typedef boost::shared_ptr<const BTreePageController> BTreePageController_CPtr;
@@ -0,0 +1,288 @@
+/**
+ * whery: BTreeStats.h
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#ifndef H_WHERY_BTREESTATS
+#define H_WHERY_BTREESTATS
+
+#include <ostream>
+#include <vector>
+
+#include <boost/atomic.hpp>
+#include <boost/chrono/chrono.hpp>
+#include <boost/cstdint.hpp>
+
+#include "whery/util/LatencyHistogram.h"
+
+namespace whery {
+
+/**
+\brief An instance of this class represents a snapshot of the statistics recorded for a B+-tree, namely
+a latency histogram (in nanoseconds) for each kind of operation and a count of each kind of structural
+event (splits, merges, etc.).
+*/
+class BTreeStats
+{
+	//#################### ENUMERATIONS ####################
+public:
+	/**
+	\brief The values of this enum represent the kinds of operation whose latencies are recorded.
+	*/
+	enum Operation
+	{
+		/** An erasure (erase_tuple or erase_tuples). */
+		OP_ERASE,
+
+		/** A point lookup (find or lookup). */
+		OP_FIND,
+
+		/** An insertion (insert_tuple). */
+		OP_INSERT,
+
+		/** A whole parallel scan (parallel_scan), including the work done by its callbacks. */
+		OP_PARALLEL_SCAN,
+
+		/** The lookup of the bounds of a range (equal_range), which does not include iterating over the range. */
+		OP_RANGE_LOOKUP,
+
+		/** The number of kinds of operation. */
+		OPERATION_COUNT
+	};
+
+	/**
+	\brief The values of this enum represent the kinds of structural event that are counted.
+	*/
+	enum Event
+	{
+		/** A new root node was added above a split (increasing the height of the tree). */
+		EVENT_ADD_ROOT_NODE,
+
+		/** Two branch nodes were merged. */
+		EVENT_MERGE_BRANCHES,
+
+		/** Two leaf nodes were merged. */
+		EVENT_MERGE_LEAVES,
+
+		/** An optimistic search restarted because of a concurrent modification (concurrent mode only). */
+		EVENT_OPTIMISTIC_RESTART,
+
+		/** An index entry was moved between two sibling branch nodes. */
+		EVENT_REDISTRIBUTE_BRANCH,
+
+		/** Tuples were moved between two sibling leaf nodes. */
+		EVENT_REDISTRIBUTE_LEAF,
+
+		/** A branch node was split. */
+		EVENT_SPLIT_BRANCH,
+
+		/** A leaf node was split. */
+		EVENT_SPLIT_LEAF,
+
+		/** The number of kinds of event. */
+		EVENT_COUNT
+	};
+
+	//#################### PRIVATE VARIABLES ####################
+private:
+	/** The number of times each kind of event has occurred. */
+	std::vector<boost::uint64_t> m_eventCounts;
+
+	/** The latency histogram for each kind of operation. */
+	std::vector<LatencyHistogram> m_latencies;
+
+	//#################### CONSTRUCTORS ####################
+public:
+	/**
+	Constructs an empty set of statistics.
+	*/
+	BTreeStats();
+
+	/**
+	Constructs a set of statistics.
+
+	\param eventCounts				The number of times each kind of event has occurred.
+	\param latencies				The latency histogram for each kind of operation.
+	\throw std::invalid_argument	If either vector has the wrong size.
+	*/
+	BTreeStats(const std::vector<boost::uint64_t>& eventCounts, const std::vector<LatencyHistogram>& latencies);
+
+	//#################### PUBLIC STATIC METHODS ####################
+public:
+	/**
+	Gets the name of the specified kind of event (e.g. for output).
+
+	\param event	The kind of event.
+	\return			Its name.
+	*/
+	static const char *event_name(Event event);
+
+	/**
+	Gets the name of the specified kind of operation (e.g. for output).
+
+	\param op	The kind of operation.
+	\return		Its name.
+	*/
+	static const char *operation_name(Operation op);
+
+	//#################### PUBLIC METHODS ####################
+public:
+	/**
+	Gets the number of times the specified kind of event has occurred.
+
+	\param event	The kind of event.
+	\return			The number of times it has occurred.
+	*/
+	boost::uint64_t event_count(Event event) const;
+
+	/**
+	Gets the latency histogram (in nanoseconds) for the specified kind of operation.
+
+	\param op	The kind of operation.
+	\return		Its latency histogram.
+	*/
+	const LatencyHistogram& latencies(Operation op) const;
+
+	/**
+	Gets the number of operations of the specified kind that have been performed.
+
+	\param op	The kind of operation.
+	\return		The number of operations of that kind.
+	*/
+	boost::uint64_t operation_count(Operation op) const;
+};
+
+/**
+\brief An instance of this class records statistics for a B+-tree. It can safely be used from multiple
+threads at once (e.g. by a B+-tree in concurrent mode), since all of its counters are atomic.
+*/
+class BTreeStatsRecorder
+{
+	//#################### NESTED CLASSES ####################
+public:
+	/**
+	\brief An instance of this class times an operation from its construction to its destruction,
+	and records the latency with a stats recorder when it is destroyed.
+	*/
+	class OperationTimer
+	{
+		//#################### TYPEDEFS ####################
+	private:
+		typedef boost::chrono::high_resolution_clock Clock;
+
+		//#################### PRIVATE VARIABLES ####################
+	private:
+		/** The kind of operation being timed. */
+		BTreeStats::Operation m_op;
+
+		/** The stats recorder with which to record the latency. */
+		BTreeStatsRecorder& m_recorder;
+
+		/** The time at which the operation started. */
+		Clock::time_point m_start;
+
+		//#################### CONSTRUCTORS ####################
+	public:
+		/**
+		Starts timing an operation.
+
+		\param recorder	The stats recorder with which to record the latency.
+		\param op		The kind of operation being timed.
+		*/
+		OperationTimer(BTreeStatsRecorder& recorder, BTreeStats::Operation op);
+
+		//#################### DESTRUCTOR ####################
+	public:
+		/**
+		Stops timing the operation and records its latency.
+		*/
+		~OperationTimer();
+
+		//#################### COPY CONSTRUCTOR & ASSIGNMENT OPERATOR ####################
+	private:
+		/** Private and unimplemented - operation timers cannot be copied. */
+		OperationTimer(const OperationTimer&);
+		OperationTimer& operator=(const OperationTimer&);
+	};
+
+	//#################### TYPEDEFS ####################
+private:
+	typedef boost::atomic<boost::uint64_t> Counter;
+
+	//#################### PRIVATE VARIABLES ####################
+private:
+	/** The number of latencies recorded in each bucket of the histogram for each kind of operation. */
+	Counter m_bucketCounts[BTreeStats::OPERATION_COUNT][LatencyHistogram::BUCKET_COUNT];
+
+	/** The number of times each kind of event has occurred. */
+	Counter m_eventCounts[BTreeStats::EVENT_COUNT];
+
+	/** The largest latency recorded for each kind of operation. */
+	Counter m_maxLatencies[BTreeStats::OPERATION_COUNT];
+
+	/** The smallest latency recorded for each kind of operation. */
+	Counter m_minLatencies[BTreeStats::OPERATION_COUNT];
+
+	/** The sum of the latencies recorded for each kind of operation. */
+	Counter m_sumLatencies[BTreeStats::OPERATION_COUNT];
+
+	//#################### CONSTRUCTORS ####################
+public:
+	/**
+	Constructs a stats recorder that has not yet recorded anything.
+	*/
+	BTreeStatsRecorder();
+
+	//#################### COPY CONSTRUCTOR & ASSIGNMENT OPERATOR ####################
+private:
+	/** Private and unimplemented - stats recorders cannot be copied. */
+	BTreeStatsRecorder(const BTreeStatsRecorder&);
+	BTreeStatsRecorder& operator=(const BTreeStatsRecorder&);
+
+	//#################### PUBLIC METHODS ####################
+public:
+	/**
+	Counts an occurrence of the specified kind of event.
+
+	\param event	The kind of event.
+	*/
+	void count_event(BTreeStats::Event event);
+
+	/**
+	Records the latency of an operation of the specified kind.
+
+	\param op			The kind of operation.
+	\param latency		Its latency (in nanoseconds).
+	*/
+	void record_latency(BTreeStats::Operation op, boost::uint64_t latency);
+
+	/**
+	Discards everything that has been recorded so far.
+	*/
+	void reset();
+
+	/**
+	Takes a snapshot of the statistics recorded so far. Note that if statistics are being recorded
+	concurrently, the snapshot is not atomic (e.g. an operation may have been counted in its histogram
+	but not yet in its sum), but each individual counter in it will be valid.
+
+	\return	The snapshot.
+	*/
+	BTreeStats snapshot() const;
+};
+
+//#################### GLOBAL FUNCTIONS ####################
+
+/**
+Outputs a summary of a set of B+-tree statistics to a stream: the count, mean and selected percentiles
+of the latencies for each kind of operation, followed by the count of each kind of structural event.
+
+\param os		The stream.
+\param stats	The statistics.
+\return			The stream.
+*/
+std::ostream& operator<<(std::ostream& os, const BTreeStats& stats);
+
+}
+
+#endif
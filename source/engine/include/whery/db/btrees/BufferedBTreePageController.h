@@ -0,0 +1,57 @@
+/**
+ * whery: BufferedBTreePageController.h
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#ifndef H_WHERY_BUFFEREDBTREEPAGECONTROLLER
+#define H_WHERY_BUFFEREDBTREEPAGECONTROLLER
+
+#include "whery/db/buffers/BufferPool.h"
+#include "BTreePageController.h"
+
+namespace whery {
+
+/**
+\brief An instance of this class controls the construction and destruction of B+-tree pages
+that are cached in a buffer pool.
+
+This allows a B+-tree to run with a fixed memory footprint (determined by the pool's memory
+budget), with pages that do not fit in memory being held in the pool's backing store.
+*/
+class BufferedBTreePageController : public BTreePageController
+{
+	//#################### PRIVATE VARIABLES ####################
+private:
+	/** A tuple manipulator that can be used to interact with the B+-tree's branch (index) tuples. */
+	TupleManipulator m_branchTupleManipulator;
+
+	/** A tuple manipulator that can be used to interact with the B+-tree's leaf (data) tuples. */
+	TupleManipulator m_leafTupleManipulator;
+
+	/** The buffer pool in which the pages are cached. */
+	BufferPool_Ptr m_pool;
+
+	//#################### CONSTRUCTORS ####################
+public:
+	/**
+	Constructs a page controller that caches its pages in the specified buffer pool.
+
+	\param pool						The buffer pool.
+	\param branchTupleManipulator	A tuple manipulator that can be used to interact with the B+-tree's branch (index) tuples.
+	\param leafTupleManipulator		A tuple manipulator that can be used to interact with the B+-tree's leaf (data) tuples.
+	*/
+	BufferedBTreePageController(const BufferPool_Ptr& pool, const TupleManipulator& branchTupleManipulator, const TupleManipulator& leafTupleManipulator);
+
+	//#################### PUBLIC INHERITED METHODS ####################
+public:
+	virtual TupleManipulator btree_branch_tuple_manipulator() const;
+	virtual TupleManipulator btree_leaf_tuple_manipulator() const;
+	virtual SortedPage_Ptr make_btree_branch_page() const;
+	virtual SortedPage_Ptr make_btree_leaf_page() const;
+	virtual unsigned int max_btree_branch_tuple_count() const;
+	virtual unsigned int max_btree_leaf_tuple_count() const;
+};
+
+}
+
+#endif
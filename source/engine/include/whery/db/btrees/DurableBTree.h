@@ -0,0 +1,228 @@
+/**
+ * whery: DurableBTree.h
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#ifndef H_WHERY_DURABLEBTREE
+#define H_WHERY_DURABLEBTREE
+
+#include <string>
+#include <vector>
+
+#include <boost/thread/mutex.hpp>
+
+#include "whery/db/wal/WriteAheadLog.h"
+#include "BTree.h"
+
+namespace whery {
+
+/**
+\brief An instance of this class makes the insertions into and erasures from a B+-tree durable, by
+recording them in a write-ahead log and periodically checkpointing the tree.
+
+Each insertion or erasure is first logged (as a logical record containing the tuple inserted or the
+key erased), then applied to the tree, and the log is committed before the insertion or erasure
+returns. Since the record is appended before the tree is touched, a write that cannot be logged
+(e.g. because the log has been poisoned) is never applied. (A write that is logged but then cannot
+be applied, e.g. because memory runs out, is still recovered from the log.) The commit is made after
+the write has been applied, however, so that commits from concurrent writers can be grouped into a
+single sync of the log. Note that this means a write is visible to readers of the tree before it is
+durable, and that if the commit fails, the write is not undone: it remains in the tree, but may not
+survive a crash. (It cannot simply be undone, since a concurrent writer may already have made a change
+that depends on it.) A failed commit poisons the log (see WriteAheadLog), so every subsequent write
+throws, and the durable B+-tree must then be reconstructed from its files, which recovers exactly the
+writes that were made durable. The log can also be told to sync only once every few commits (see
+WriteAheadLog), so that throughput holds up under many small writes.
+
+A checkpoint copies all of the tuples in the tree into memory (with writes held up only for the copy),
+and then, whilst writes carry on, writes the copy to a checkpoint file (atomically, by writing a temporary
+file and renaming it) and discards the records in the log that it makes redundant, keeping any that were
+logged after the copy was made (see WriteAheadLog::discard_through). Checkpoints are taken automatically
+once a specified number of records have been logged since the last one, which bounds both the size of
+the log and the time taken to recover. An automatic checkpoint is taken by the writer whose record makes
+it due, once that writer has committed its write (or by a later writer, if another checkpoint is still
+being written at the time).
+
+On construction, the tree (which must be empty) is recovered from the latest checkpoint (by bulk
+loading it) and any records logged since then are replayed into it. Note that the durable state is
+thus the checkpoint and the log, not the tree's pages: even if the tree uses persistent (e.g.
+memory-mapped) pages, they are not relied upon after a crash, since they are modified in place and
+can be left in an inconsistent state (e.g. in the middle of a split).
+
+Reads should be made directly on the underlying tree, which is available via tree(). Writes must
+always go through this class, which serialises them with respect to each other (in the order in
+which they are logged), but syncs the log and writes checkpoints outside the lock, so that concurrent
+commits are grouped and writes are not held up by checkpoints.
+*/
+class DurableBTree
+{
+	//#################### ENUMERATIONS ####################
+private:
+	/**
+	\brief The values of this enum represent the types of record in the log.
+	*/
+	enum RecordType
+	{
+		/** An erasure, whose payload is the arity of the key, followed by its field indices and its tuple data. */
+		RT_ERASE = 1,
+
+		/** An insertion, whose payload is the tuple data of the leaf tuple inserted. */
+		RT_INSERT
+	};
+
+	//#################### PRIVATE VARIABLES ####################
+private:
+	/** The name of the checkpoint file. */
+	std::string m_checkpointFilename;
+
+	/** The number of records to log between automatic checkpoints (0 if checkpoints should only be taken manually). */
+	unsigned int m_checkpointInterval;
+
+	/** The LSN of the last log record reflected in the latest checkpoint. */
+	WriteAheadLog::LSN m_checkpointLSN;
+
+	/** The mutex used to ensure that only one checkpoint is written at a time. */
+	boost::mutex m_checkpointMutex;
+
+	/** A buffer used to construct the payloads of log records. */
+	std::vector<char> m_payload;
+
+	/** The write-ahead log. */
+	WriteAheadLog m_log;
+
+	/** The mutex used to serialise writes. */
+	boost::mutex m_mutex;
+
+	/** The number of records logged since the latest checkpoint. */
+	unsigned int m_recordsSinceCheckpoint;
+
+	/** A leaf tuple used to convert tuples being inserted into the leaf format before they are logged. */
+	FreshTuple m_scratchTuple;
+
+	/** The underlying B+-tree. */
+	BTree_Ptr m_tree;
+
+	//#################### CONSTRUCTORS ####################
+public:
+	/**
+	Constructs a durable B+-tree whose log and checkpoint are stored in files with the specified base
+	name (with extensions .wal and .ckpt respectively). If these files already exist, the state they
+	record is recovered into the (empty) tree provided.
+
+	\param tree						The underlying B+-tree (which must be empty).
+	\param basename					The base name of the log and checkpoint files.
+	\param checkpointInterval		The number of records to log between automatic checkpoints (0 for none).
+	\param syncInterval				The number of commits to group together before syncing the log (see WriteAheadLog).
+	\throw std::invalid_argument	If the tree is not empty, or syncInterval is zero.
+	\throw std::runtime_error		If the log or checkpoint cannot be read, or is corrupt.
+	*/
+	DurableBTree(const BTree_Ptr& tree, const std::string& basename, unsigned int checkpointInterval = 10000, unsigned int syncInterval = 1);
+
+	//#################### COPY CONSTRUCTOR & ASSIGNMENT OPERATOR ####################
+private:
+	/** Private and unimplemented - durable B+-trees cannot be copied. */
+	DurableBTree(const DurableBTree&);
+	DurableBTree& operator=(const DurableBTree&);
+
+	//#################### PUBLIC METHODS ####################
+public:
+	/**
+	Takes a checkpoint of the B+-tree, and discards the log records that it makes redundant.
+	If another checkpoint is being written at the time, this waits for it to finish first.
+
+	\throw std::runtime_error	If the checkpoint cannot be written.
+	*/
+	void checkpoint();
+
+	/**
+	Logs the erasure of the leaf (data) tuple with the specified key, and erases it from the B+-tree.
+
+	\param key					The key of the tuple to erase.
+	\throw std::runtime_error	If the erasure cannot be logged (in which case it has not been applied to the
+								tree), or cannot be committed (in which case it has still been applied to the
+								tree, but is not durable), or if an automatic checkpoint cannot be written (in
+								which case the erasure is still durable).
+	*/
+	void erase_tuple(const ValueKey& key);
+
+	/**
+	Logs the insertion of a tuple, and inserts it into the B+-tree.
+
+	\param tuple					The tuple to insert.
+	\throw std::runtime_error	If the insertion cannot be logged (in which case it has not been applied to the
+								tree), or cannot be committed (in which case it has still been applied to the
+								tree, but is not durable), or if an automatic checkpoint cannot be written (in
+								which case the insertion is still durable).
+	*/
+	void insert_tuple(const Tuple& tuple);
+
+	/**
+	Gets the write-ahead log (e.g. to check how far it has been synced).
+
+	\return	The write-ahead log.
+	*/
+	const WriteAheadLog& log() const;
+
+	/**
+	Syncs the log, so that all of the writes made so far are durable (even if the log
+	has been told to sync only once every few commits).
+
+	\throw std::runtime_error	If the log cannot be synced.
+	*/
+	void sync();
+
+	/**
+	Gets the underlying B+-tree, which can be used for reads.
+
+	\return	The underlying B+-tree.
+	*/
+	const BTree& tree() const;
+
+	//#################### PRIVATE METHODS ####################
+private:
+	/**
+	Loads the latest checkpoint (if any) into the B+-tree.
+
+	\throw std::runtime_error	If the checkpoint cannot be read, or is corrupt.
+	*/
+	void load_checkpoint();
+
+	/**
+	Records that a log record has been appended, and determines whether or not an automatic checkpoint is due.
+	This must be called with the write mutex held.
+
+	\return	true, if an automatic checkpoint is due, or false otherwise.
+	*/
+	bool note_record_logged();
+
+	/**
+	Applies a log record to the B+-tree during recovery.
+
+	\param record				The log record.
+	\throw std::runtime_error	If the record is malformed.
+	*/
+	void replay(WriteAheadLog::Record& record);
+
+	/**
+	Takes an automatic checkpoint of the B+-tree, unless another checkpoint is being written at the time
+	(in which case the next write will try again). This must be called without the write mutex held.
+
+	\throw std::runtime_error	If the checkpoint cannot be written.
+	*/
+	void take_automatic_checkpoint();
+
+	/**
+	Writes a checkpoint of the B+-tree and discards the log records that it makes redundant. This must be called
+	with the checkpoint mutex held, but without the write mutex held, since it only holds that whilst it copies
+	the tuples in the tree.
+
+	\throw std::runtime_error	If the checkpoint cannot be written.
+	*/
+	void write_checkpoint();
+};
+
+typedef boost::shared_ptr<DurableBTree> DurableBTree_Ptr;
+
+}
+
+#endif
@@ -0,0 +1,161 @@
+/**
+ * whery: MappedBTreePageController.h
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#ifndef H_WHERY_MAPPEDBTREEPAGECONTROLLER
+#define H_WHERY_MAPPEDBTREEPAGECONTROLLER
+
+#include <string>
+
+#include "whery/db/pages/MappedSortedPage.h"
+#include "BTreePageController.h"
+
+namespace whery {
+
+/**
+\brief An instance of this class controls the construction and destruction of memory-mapped
+B+-tree pages that are all stored in a single data file.
+
+The data file is divided into fixed-size page slots, each of which consists of a small header
+(recording whether the slot is free or what it contains) followed by the buffer for a MappedSortedPage.
+The file grows geometrically as necessary to accommodate new pages, and the slots of pages that are
+destroyed are reused. The file is mapped into memory in large chunks: when the file grows, the part
+that has been added is mapped as a further chunk, so the existing chunks (and hence the pages in them)
+never move, and the number of chunks only grows logarithmically with the size of the file.
+
+The first slot of the file holds the file header. When a B+-tree that uses the controller is destroyed,
+it saves its structure (its root ID and node table, see BTreePageController::BTreeStructure) via the
+controller: the node table is written to a chain of further slots, and the header records where to find
+it, together with a checksum of both. A B+-tree constructed later with a controller for the same file
+(e.g. in the next session) then reopens the saved B+-tree in place, which only takes time linear in the
+number of nodes, and does not copy any tuples or need any extra space in the file. Since the B+-tree will
+modify its pages, the header is invalidated as soon as the structure has been loaded, and only becomes
+valid again when the B+-tree is next destroyed.
+
+If the process stops without the B+-tree being destroyed, the header will not be valid the next time the
+file is opened, so the B+-tree must instead be rebuilt from its leaves. To make this possible, a page that
+is destroyed while it is empty (as happens when a B+-tree deletes a node) has its slot freed, but a page
+that is destroyed while it still contains tuples is left in the file. When the file is opened without a
+valid header, the surviving leaf pages can be retrieved via recover_leaf_pages() and bulk loaded into a
+fresh B+-tree. (Surviving branch pages are simply discarded, since the branch structure can be rebuilt
+from the leaves.) Note that such a rebuild takes time linear in the number of tuples, and that the file
+must hold two copies of the leaves whilst it is in progress.
+*/
+class MappedBTreePageController : public BTreePageController
+{
+	//#################### ENUMERATIONS ####################
+private:
+	/**
+	\brief The values of this enum represent the possible states of a page slot in the data file.
+	*/
+	enum PageKind
+	{
+		/** The slot is free. */
+		PK_FREE,
+
+		/** The slot contains a branch page. */
+		PK_BRANCH,
+
+		/** The slot contains a leaf page. */
+		PK_LEAF,
+
+		/** The slot contains the file header. */
+		PK_HEADER,
+
+		/** The slot contains part of the saved node table of a B+-tree. */
+		PK_TABLE
+	};
+
+	//#################### NESTED CLASSES ####################
+private:
+	struct PageFile;
+	typedef boost::shared_ptr<PageFile> PageFile_Ptr;
+
+	class PageDeleter;
+
+	//#################### PRIVATE VARIABLES ####################
+private:
+	/** A tuple manipulator that can be used to interact with the B+-tree's branch (index) tuples. */
+	TupleManipulator m_branchTupleManipulator;
+
+	/** The data file that contains the pages (shared with the deleters of the pages themselves). */
+	PageFile_Ptr m_file;
+
+	/** A tuple manipulator that can be used to interact with the B+-tree's leaf (data) tuples. */
+	TupleManipulator m_leafTupleManipulator;
+
+	//#################### CONSTRUCTORS ####################
+public:
+	/**
+	Constructs a page controller that stores its pages in the specified data file. If the file
+	does not exist, it is created. If it does, and it has a valid header, the B+-tree saved in it
+	is retained so that it can be reopened; otherwise, any leaf pages left in it by a previous
+	session are retained so that they can be recovered.
+
+	\param filename					The name of the data file.
+	\param pageSize					The size (in bytes) of each page slot in the file (including its header).
+									This must be a multiple of 16 and large enough for the file header.
+	\param branchTupleManipulator	A tuple manipulator that can be used to interact with the B+-tree's branch (index) tuples.
+	\param leafTupleManipulator		A tuple manipulator that can be used to interact with the B+-tree's leaf (data) tuples.
+	\throw std::invalid_argument	If pageSize is invalid, or if an existing data file does not start with a file header
+									or has a size that is not a multiple of it.
+	*/
+	MappedBTreePageController(const std::string& filename, unsigned int pageSize,
+							  const TupleManipulator& branchTupleManipulator, const TupleManipulator& leafTupleManipulator);
+
+	//#################### PUBLIC INHERITED METHODS ####################
+public:
+	virtual TupleManipulator btree_branch_tuple_manipulator() const;
+	virtual TupleManipulator btree_leaf_tuple_manipulator() const;
+	virtual int btree_page_id(const SortedPage& page) const;
+	virtual boost::optional<BTreeStructure> load_btree_structure() const;
+	virtual SortedPage_Ptr make_btree_branch_page() const;
+	virtual SortedPage_Ptr make_btree_leaf_page() const;
+	virtual unsigned int max_btree_branch_tuple_count() const;
+	virtual unsigned int max_btree_leaf_tuple_count() const;
+	virtual bool persists_btree_structure() const;
+	virtual SortedPage_Ptr reopen_btree_page(int pageID, bool leaf) const;
+	virtual void save_btree_structure(const BTreeStructure& structure) const;
+
+	//#################### PUBLIC METHODS ####################
+public:
+	/**
+	Recovers any non-empty leaf pages that were left in the data file by a previous session that did not save its B+-tree.
+	The pages are returned in ascending order of their first tuples, ready to be passed to
+	BTree::bulk_load(). Their slots are freed once the pages returned are destroyed, so the
+	caller should copy their tuples elsewhere (e.g. by bulk loading them) before then, and
+	should destroy them as soon as possible afterwards. Each page can only be recovered once.
+	See the class description for the cost of rebuilding a B+-tree in this way.
+
+	\return	The recovered leaf pages.
+	*/
+	std::vector<SortedPage_Ptr> recover_leaf_pages();
+
+	/**
+	Gets the number of page slots in the data file that are currently in use (not counting the file header).
+
+	\return	The number of page slots in the data file that are currently in use.
+	*/
+	unsigned int used_page_count() const;
+
+	//#################### PRIVATE METHODS ####################
+private:
+	/**
+	Makes a page, either in a fresh page slot or in an existing slot that was written by a previous session.
+
+	\param tupleManipulator	The manipulator to be used to interact with tuples on the page.
+	\param kind				The kind of page to make (branch or leaf).
+	\param pageID			The ID of an existing page slot to reopen, or -1 to allocate a fresh one.
+	\param alwaysFree		Whether or not the page's slot should be freed when it is destroyed even if the page
+							is not empty (as for recovered pages, whose tuples are copied elsewhere).
+	\return					The page.
+	*/
+	SortedPage_Ptr make_page(const TupleManipulator& tupleManipulator, PageKind kind, int pageID, bool alwaysFree) const;
+};
+
+typedef boost::shared_ptr<MappedBTreePageController> MappedBTreePageController_Ptr;
+
+}
+
+#endif
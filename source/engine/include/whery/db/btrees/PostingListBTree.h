@@ -0,0 +1,369 @@
+/**
+ * whery: PostingListBTree.h
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#ifndef H_WHERY_POSTINGLISTBTREE
+#define H_WHERY_POSTINGLISTBTREE
+
+#include <utility>
+#include <vector>
+
+#include <boost/optional.hpp>
+
+#include "whery/db/base/FreshTuple.h"
+#include "BTree.h"
+
+namespace whery {
+
+/**
+\brief An instance of this class represents an index that supports duplicate keys, by packing the
+payloads of all of the entries that share a key into compressed posting lists stored in an underlying B+-tree.
+
+Logically, the index contains entries of the form <key fields...,payload>, where the payload is an
+int (e.g. a tuple ID). Each payload can appear at most once for a given key, but any number of entries
+can share the same key, as in a secondary index on a column with few distinct values. The entries are
+visited in order of key and then payload.
+
+Physically, the underlying B+-tree's leaf tuples are posting lists of the form <key fields...,first payload,
+data 1,...,data n,payload count>. The payloads in a posting list are in ascending order: the first of them
+is stored as is, and each of the others is stored as its difference from the one before it (less one),
+encoded as a variable-length integer (seven bits per byte, with the top bit of each byte set if another
+byte follows) in the bytes of the n int data fields. Since the payloads for a key are often dense (e.g.
+the IDs of the tuples that share a value), most of the differences take a single byte, so a posting list
+holds up to 4n + 1 payloads, and the key is only stored once for all of them. A key whose payloads do not
+fit in a single posting list has several, whose payloads are disjoint ranges that are ordered by their
+first payloads. The underlying B+-tree's branch tuples must therefore be of the form <key fields...,first
+payload,child node ID>, so that they distinguish the posting lists of a key without needing to store any
+of the other payloads.
+
+Since a write decodes and re-encodes a whole posting list (replacing it in place in its leaf where possible,
+see BTree::update_tuple), the index must not be read whilst it is being written, and writes must not be made
+concurrently (so the underlying B+-tree must not be in concurrent mode). The number of entries is counted the first time it is needed (e.g. when the index is reopened
+around a B+-tree that already contains posting lists), and maintained from then on.
+*/
+class PostingListBTree
+{
+	//#################### NESTED TYPES ####################
+public:
+	/**
+	\brief An instance of this class can be used to traverse the entries in a posting list B+-tree.
+	*/
+	class ConstIterator
+	{
+		//#################### FRIENDS ####################
+		friend class PostingListBTree;
+
+		//#################### PRIVATE VARIABLES ####################
+	private:
+		/** The index for which this is an iterator. */
+		const PostingListBTree *m_index;
+
+		/** An iterator to the posting list containing the currently-pointed-to entry. */
+		BTree::ConstIterator m_it;
+
+		/** The offset (in bytes) of the encoded difference that follows the currently-pointed-to entry's payload. */
+		unsigned int m_offset;
+
+		/** The payload of the currently-pointed-to entry (if any). */
+		int m_payload;
+
+		/** The position of the currently-pointed-to entry's payload in its posting list. */
+		unsigned int m_position;
+
+		//#################### CONSTRUCTORS ####################
+	public:
+		/**
+		Constructs an invalid iterator (it can be assigned something valid later).
+		*/
+		ConstIterator()
+		:	m_index(NULL), m_offset(0), m_payload(0), m_position(0)
+		{}
+
+	private:
+		/**
+		Constructs an iterator.
+
+		\param index	The index for which this is an iterator.
+		\param it		An iterator to the posting list containing the initially-pointed-to entry.
+		\param position	The position of the initially-pointed-to entry's payload in its posting list.
+		*/
+		ConstIterator(const PostingListBTree *index, const BTree::ConstIterator& it, unsigned int position)
+		:	m_index(index), m_it(it), m_offset(0), m_payload(0), m_position(0)
+		{
+			if(m_it == m_index->m_tree->end()) return;
+
+			// Decode the payloads from the start of the posting list up to the initially-pointed-to one.
+			m_payload = m_index->first_payload(*m_it);
+			while(m_position < position)
+			{
+				m_payload = m_index->next_payload(*m_it, m_payload, m_offset);
+				++m_position;
+			}
+		}
+
+		//#################### PUBLIC OPERATORS ####################
+	public:
+		/**
+		Gets the currently-pointed-to entry, as a tuple of the form <key fields...,payload>.
+
+		\return	The entry.
+		*/
+		FreshTuple operator*() const
+		{
+			return m_index->make_entry(*m_it, m_payload);
+		}
+
+		bool operator==(const ConstIterator& rhs) const
+		{
+			return m_it == rhs.m_it && m_position == rhs.m_position;
+		}
+
+		bool operator!=(const ConstIterator& rhs) const
+		{
+			return !(*this == rhs);
+		}
+
+		ConstIterator& operator++()
+		{
+			if(++m_position == m_index->payload_count(*m_it))
+			{
+				*this = ConstIterator(m_index, ++m_it, 0);
+			}
+			else m_payload = m_index->next_payload(*m_it, m_payload, m_offset);
+			return *this;
+		}
+
+		//#################### PUBLIC METHODS ####################
+	public:
+		/**
+		Gets the payload of the currently-pointed-to entry.
+
+		\return	The payload.
+		*/
+		int payload() const
+		{
+			return m_payload;
+		}
+	};
+
+	//#################### TYPEDEFS ####################
+public:
+	typedef std::pair<ConstIterator,ConstIterator> EqualRangeResult;
+
+	//#################### PRIVATE VARIABLES ####################
+private:
+	/** The number of bytes available in each posting list for the encoded differences between its payloads. */
+	unsigned int m_byteCapacity;
+
+	/** The index of the field in each posting list that holds its payload count. */
+	unsigned int m_countField;
+
+	/** A prototype for the keys used to find posting lists in the B+-tree, of the form <key fields...,first payload>. */
+	ValueKey m_entryKeyPrototype;
+
+	/** The manipulator for entries, which have the form <key fields...,payload>. */
+	TupleManipulator m_entryTupleManipulator;
+
+	/** The number of fields in each key. */
+	unsigned int m_keyArity;
+
+	/** The underlying B+-tree. */
+	BTree_Ptr m_tree;
+
+	/** The number of entries in the index, once it has been counted. */
+	mutable boost::optional<unsigned int> m_tupleCount;
+
+	//#################### CONSTRUCTORS ####################
+public:
+	/**
+	Constructs a posting list B+-tree around the specified B+-tree, which may already contain posting lists.
+
+	\param tree						The underlying B+-tree.
+	\param keyArity					The number of fields in each key.
+	\throw std::invalid_argument	If the B+-tree is in concurrent mode, or its leaf tuples do not consist of
+									keyArity key fields, followed by at least one int payload field and an int
+									payload count.
+	*/
+	PostingListBTree(const BTree_Ptr& tree, unsigned int keyArity);
+
+	//#################### PUBLIC METHODS ####################
+public:
+	/**
+	Returns an iterator pointing to the first entry in the index.
+
+	\return	As stated.
+	*/
+	ConstIterator begin() const;
+
+	/**
+	Returns an iterator pointing to the end of the index.
+
+	\return	As stated.
+	*/
+	ConstIterator end() const;
+
+	/**
+	Finds the range of entries that match the specified key, which consists of some or all
+	of the key fields, optionally followed by a payload (if all of the key fields are specified).
+
+	\param key	The key.
+	\return		A pair of iterators [lower_bound(key),upper_bound(key)) delimiting the entries that match it.
+	*/
+	EqualRangeResult equal_range(const ValueKey& key) const;
+
+	/**
+	Erases the entry with the specified key and payload from the index (if it is present).
+
+	\param key						A key of the form <key fields...,payload>.
+	\throw std::invalid_argument	If the key does not specify both all of the key fields and a payload.
+	*/
+	void erase_tuple(const ValueKey& key);
+
+	/**
+	Inserts an entry into the index (if it is not already present).
+
+	\param tuple	The entry, as a tuple whose first fields are the key fields and whose next field is the payload.
+	*/
+	void insert_tuple(const Tuple& tuple);
+
+	/**
+	Returns an iterator pointing to the first entry that does not compare less than the specified key
+	(see equal_range for the allowed forms of key).
+
+	\param key	The key.
+	\return		As stated.
+	*/
+	ConstIterator lower_bound(const ValueKey& key) const;
+
+	/**
+	Gets the underlying B+-tree (e.g. to find out how many posting lists it contains).
+
+	\return	The underlying B+-tree.
+	*/
+	const BTree& tree() const;
+
+	/**
+	Gets the number of entries in the index. The first call counts the entries in the posting lists
+	that the underlying B+-tree already contains (if any); later calls take constant time.
+
+	\return	The number of entries in the index.
+	*/
+	unsigned int tuple_count() const;
+
+	/**
+	Returns an iterator pointing to the first entry that compares greater than the specified key
+	(see equal_range for the allowed forms of key).
+
+	\param key	The key.
+	\return		As stated.
+	*/
+	ConstIterator upper_bound(const ValueKey& key) const;
+
+	//#################### PRIVATE METHODS ####################
+private:
+	/**
+	Returns an iterator pointing to the lower or upper bound of the specified key in the index.
+
+	\param key		The key.
+	\param upper	Whether to find the upper bound (true) or lower bound (false).
+	\return			As stated.
+	*/
+	ConstIterator bound(const ValueKey& key, bool upper) const;
+
+	/**
+	Decodes all of the payloads in a posting list.
+
+	\param postingList	The posting list.
+	\param payloads		Used to return the payloads (in ascending order).
+	*/
+	void decode_payloads(const Tuple& postingList, std::vector<int>& payloads) const;
+
+	/**
+	Encodes a range of payloads into a posting list (whose key fields are left unchanged), if they fit.
+
+	\param payloads		The payloads (in ascending order).
+	\param begin		The index of the first payload in the range.
+	\param end			The index one beyond that of the last payload in the range (which must not be empty).
+	\param postingList	The posting list.
+	\return				true, if the payloads fit in the posting list, or false (leaving it unchanged) otherwise.
+	*/
+	bool encode_payloads(const std::vector<int>& payloads, size_t begin, size_t end, FreshTuple& postingList) const;
+
+	/**
+	Finds the posting list that would contain an entry with the specified key and payload, i.e. the last
+	posting list for the key whose first payload is no greater than the specified one.
+
+	\param entryKey	A key of the form <key fields...,payload>.
+	\return			An iterator pointing to the posting list, or to the end of the B+-tree if there is none.
+	*/
+	BTree::ConstIterator find_posting_list(const ValueKey& entryKey) const;
+
+	/**
+	Gets the first (i.e. smallest) payload in a posting list.
+
+	\param postingList	The posting list.
+	\return				The payload.
+	*/
+	int first_payload(const Tuple& postingList) const;
+
+	/**
+	Makes an entry of the form <key fields...,payload> from the key fields of a posting list and the specified payload.
+
+	\param postingList	The posting list.
+	\param payload		The payload.
+	\return				The entry.
+	*/
+	FreshTuple make_entry(const Tuple& postingList, int payload) const;
+
+	/**
+	Makes a key of the form <key fields...,payload> from the first fields of the specified
+	tuple, which may either be an entry or a posting list (whose first payload is used).
+
+	\param source	The tuple.
+	\return			The key.
+	*/
+	ValueKey make_entry_key(const Tuple& source) const;
+
+	/**
+	Decodes the payload that follows the specified one in a posting list.
+
+	\param postingList	The posting list.
+	\param payload		The preceding payload.
+	\param offset		The offset (in bytes) of the encoded difference between the payloads, which is advanced past it.
+	\return				The following payload.
+	*/
+	int next_payload(const Tuple& postingList, int payload, unsigned int& offset) const;
+
+	/**
+	Gets the number of payloads in a posting list.
+
+	\param postingList	The posting list.
+	\return				The number of payloads in it.
+	*/
+	unsigned int payload_count(const Tuple& postingList) const;
+
+	/**
+	Checks whether or not the specified tuples have the same key fields.
+
+	\param lhs	The first tuple (an entry, posting list or entry key).
+	\param rhs	The second tuple (an entry, posting list or entry key).
+	\return		true, if the tuples have the same key fields, or false otherwise.
+	*/
+	bool same_key(const Tuple& lhs, const Tuple& rhs) const;
+
+	/**
+	Chooses where to split the payloads of a posting list that has become too big into two posting lists,
+	so that the encoded differences are divided as evenly as possible and both of the lists fit.
+
+	\param payloads	The payloads (in ascending order, at least two of them).
+	\return			The index of the first payload of the upper posting list.
+	*/
+	size_t split_point(const std::vector<int>& payloads) const;
+};
+
+typedef boost::shared_ptr<PostingListBTree> PostingListBTree_Ptr;
+
+}
+
+#endif
@@ -0,0 +1,338 @@
+/**
+ * whery: BufferPool.h
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#ifndef H_WHERY_BUFFERPOOL
+#define H_WHERY_BUFFERPOOL
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#include "whery/db/pages/SlottedSortedPage.h"
+#include "EvictionPolicy.h"
+#include "PageStore.h"
+
+namespace whery {
+
+/**
+\brief An instance of this class represents a bounded pool of in-memory frames that cache
+the pages of a backing store.
+
+The pool holds a fixed number of frames, determined by its memory budget. A page must be pinned
+(using a Pin) while it is being accessed: if it is not already resident, it is loaded into a free
+frame, or failing that into a frame whose page is evicted (and written back to the store if it has
+been modified). The choice of which page to evict is delegated to a pluggable eviction policy, which
+the pool keeps informed of which pages can currently be evicted.
+
+Pinned pages are never evicted. In addition, the pages in the two most recently accessed frames are
+never evicted, so that a caller working with two pages at once (e.g. when transferring tuples between
+two sibling pages in a B+-tree) does not cause them to be repeatedly evicted and reloaded.
+
+Each frame also has a row cache, into which the tuples of the page it holds can be copied (see Pin::row),
+so that they can still be read once the page has been unpinned. The row cache can be as large as the page
+itself, so the memory budget is charged for both: each frame takes up twice the page size. The copied rows
+belong to the frame rather than to the page, so they are given up when the page is evicted (the memory is
+reused for the rows of the next page to be loaded into the frame), as well as when the page is modified.
+*/
+class BufferPool
+{
+	//#################### NESTED CLASSES ####################
+private:
+	class FramePage;
+	typedef boost::shared_ptr<FramePage> FramePage_Ptr;
+
+	/**
+	\brief An instance of this struct represents a frame in the pool.
+	*/
+	struct Frame
+	{
+		/** The memory buffer for the frame. */
+		std::vector<char> buffer;
+
+		/** Whether or not the page in the frame has been modified since it was loaded. */
+		bool dirty;
+
+		/** Whether or not the eviction policy has been told that the page in the frame can be evicted. */
+		bool evictable;
+
+		/** The page in the frame (if any). */
+		FramePage *page;
+
+		/** The ID of the page in the frame (if any), or -1 otherwise. */
+		int pageID;
+
+		/**
+		The page objects that have been used to view the frame's buffer, one for each of the tuple manipulators
+		with which pages have been loaded into the frame. These are reused, rather than being reallocated each
+		time a page is loaded.
+		*/
+		std::vector<FramePage_Ptr> pages;
+
+		/** The number of pins currently held on the page in the frame. */
+		unsigned int pinCount;
+
+		/** The current generation of the row cache: a row holds a valid copy of its tuple if and only if its stamp matches this. */
+		unsigned int rowGeneration;
+
+		/** The row cache for the frame (allocated when it is first used), which holds copies of the tuples on the page in the frame. */
+		std::vector<char> rows;
+
+		/** The generation of the row cache in which each row was last copied (0 if it never has been). */
+		std::vector<unsigned int> rowStamps;
+
+		explicit Frame(unsigned int size)
+		:	buffer(size), dirty(false), evictable(false), page(NULL), pageID(-1), pinCount(0), rowGeneration(1)
+		{}
+
+		/**
+		Moves the row cache on to a new generation, so that none of the copies currently in it is used again.
+		*/
+		void invalidate_rows()
+		{
+			// If the generation counter wraps round, the stamps of the rows must be reset, but this only happens very rarely.
+			if(++rowGeneration == 0)
+			{
+				std::fill(rowStamps.begin(), rowStamps.end(), 0);
+				rowGeneration = 1;
+			}
+		}
+	};
+
+public:
+	/**
+	\brief An instance of this class pins a page in a buffer pool for as long as it exists.
+	*/
+	class Pin
+	{
+		//#################### PRIVATE VARIABLES ####################
+	private:
+		/** Whether or not the page has been modified via this pin. */
+		bool m_dirty;
+
+		/** The index of the frame containing the pinned page. */
+		unsigned int m_frame;
+
+		/** The pinned page. */
+		SlottedSortedPage *m_page;
+
+		/** The buffer pool containing the page. */
+		BufferPool *m_pool;
+
+		//#################### CONSTRUCTORS ####################
+	public:
+		/**
+		Pins the specified page, loading it into the pool if necessary.
+
+		\param pool					The buffer pool.
+		\param pageID				The ID of the page.
+		\param tupleManipulator		The manipulator to be used to interact with tuples on the page.
+		\param fresh				Whether or not the page is a fresh one that has not yet been loaded
+									(in which case it is made empty rather than read from the store).
+		\param frameHint			If non-null, the index of the frame in which the page was last found (or -1).
+									That frame is checked before the pool's page table is searched, and the
+									index of the frame that now contains the page is written back to it.
+		\throw std::runtime_error	If all of the pool's frames are in use and none can be evicted.
+		*/
+		Pin(BufferPool& pool, int pageID, const TupleManipulator& tupleManipulator, bool fresh = false, int *frameHint = NULL);
+
+		//#################### DESTRUCTOR ####################
+	public:
+		/**
+		Unpins the page.
+		*/
+		~Pin();
+
+		//#################### COPY CONSTRUCTOR & ASSIGNMENT OPERATOR ####################
+	private:
+		Pin(const Pin&);
+		Pin& operator=(const Pin&);
+
+		//#################### PUBLIC OPERATORS ####################
+	public:
+		SlottedSortedPage& operator*() const;
+		SlottedSortedPage *operator->() const;
+
+		//#################### PUBLIC METHODS ####################
+	public:
+		/**
+		Records the fact that the page has been modified, so that it must be written back to the store before
+		it is evicted, and so that any copies of its tuples in the frame's row cache are no longer used.
+		*/
+		void mark_dirty();
+
+		/**
+		Gets a copy of the tuple at the specified position on the page, copying it into the frame's row cache
+		if it is not already there. The copy remains valid after the pin has been released, until the page is
+		next modified or evicted. The page must not use suffix truncation (its tuples must all be the same size).
+
+		\param i	The position of the tuple on the page.
+		\return		The location of the copy, which must not be written to.
+		*/
+		char *row(unsigned int i) const;
+	};
+
+	//#################### FRIENDS ####################
+	friend class Pin;
+
+	//#################### PRIVATE VARIABLES ####################
+private:
+	/** The frames in the pool. */
+	std::vector<Frame> m_frames;
+
+	/** The indices of the frames that do not currently contain a page. */
+	std::vector<unsigned int> m_freeFrames;
+
+	/** A map from the IDs of the resident pages to the indices of the frames that contain them. */
+	std::map<int,unsigned int> m_pageTable;
+
+	/** The policy used to decide which pages to evict. */
+	EvictionPolicy_Ptr m_policy;
+
+	/** The indices of the two most recently accessed frames (most recent first), or -1 if there are none. */
+	int m_recentFrames[2];
+
+	/** The backing store for the pages. */
+	PageStore_Ptr m_store;
+
+	//#################### CONSTRUCTORS ####################
+public:
+	/**
+	Constructs a buffer pool.
+
+	\param store					The backing store for the pages.
+	\param policy					The policy used to decide which pages to evict.
+	\param memoryBudget				The maximum amount of memory (in bytes) to use for the pool's frames
+									(each of which takes up twice the page size, see above).
+	\throw std::invalid_argument	If the memory budget is not large enough for at least three frames.
+	*/
+	BufferPool(const PageStore_Ptr& store, const EvictionPolicy_Ptr& policy, unsigned int memoryBudget);
+
+	//#################### COPY CONSTRUCTOR & ASSIGNMENT OPERATOR ####################
+private:
+	BufferPool(const BufferPool&);
+	BufferPool& operator=(const BufferPool&);
+
+	//#################### PUBLIC METHODS ####################
+public:
+	/**
+	Allocates a fresh page in the backing store. The page must be pinned as fresh before it is used.
+
+	\return	The ID of the page.
+	*/
+	int allocate_page();
+
+	/**
+	Gets the copy of a tuple in the row cache of the frame that contains the specified page, if it is the specified
+	frame and it currently holds such a copy. This does not pin the page (or count as an access to it), so it is a
+	cheap way to re-read a tuple that has been read before (see Pin::row).
+
+	\param pageID	The ID of the page.
+	\param frame	The index of the frame in which the page was last found, or -1 if there is none.
+	\param i		The position of the tuple on the page.
+	\return			The location of the copy, or NULL if there is no valid copy in the frame.
+	*/
+	char *cached_row(int pageID, int frame, unsigned int i) const;
+
+	/**
+	Discards the specified page, removing it from the pool (without writing it back) and deallocating it in the backing store.
+
+	\param pageID				The ID of the page.
+	\throw std::logic_error		If the page is currently pinned.
+	*/
+	void discard_page(int pageID);
+
+	/**
+	Writes all modified resident pages back to the backing store.
+	*/
+	void flush();
+
+	/**
+	Gets the number of frames in the pool.
+
+	\return	The number of frames in the pool.
+	*/
+	unsigned int frame_count() const;
+
+	/**
+	Gets the size (in bytes) of the pages in the pool.
+
+	\return	The size (in bytes) of the pages in the pool.
+	*/
+	unsigned int page_size() const;
+
+	/**
+	Gets the number of pages that are currently resident in the pool.
+
+	\return	The number of pages that are currently resident in the pool.
+	*/
+	unsigned int resident_page_count() const;
+
+	//#################### PRIVATE METHODS ####################
+private:
+	/**
+	Acquires a frame into which to load a page, evicting a page if necessary.
+
+	\return						The index of the frame.
+	\throw std::runtime_error	If all the frames are in use and none can be evicted.
+	*/
+	unsigned int acquire_frame();
+
+	/**
+	Evicts the page in the specified frame, writing it back to the store if it has been modified.
+
+	\param frame	The index of the frame.
+	*/
+	void evict_page(unsigned int frame);
+
+	/**
+	Loads the specified page into the specified (empty) frame, reusing one of the frame's page objects if possible.
+
+	\param frame				The index of the frame.
+	\param pageID				The ID of the page.
+	\param tupleManipulator		The manipulator to be used to interact with tuples on the page.
+	\param fresh				Whether or not the page is a fresh one that has not yet been loaded.
+	*/
+	void load_page(unsigned int frame, int pageID, const TupleManipulator& tupleManipulator, bool fresh);
+
+	/**
+	Records an access to the page in the specified frame.
+
+	\param frame	The index of the frame.
+	*/
+	void note_access(unsigned int frame);
+
+	/**
+	Pins the specified page, loading it into the pool if necessary.
+
+	\param pageID				The ID of the page.
+	\param tupleManipulator		The manipulator to be used to interact with tuples on the page.
+	\param fresh				Whether or not the page is a fresh one that has not yet been loaded.
+	\param frameHint			The index of the frame in which the page was last found, or -1 if there is none.
+	\return						The index of the frame containing the page.
+	\throw std::runtime_error	If all of the pool's frames are in use and none can be evicted.
+	*/
+	unsigned int pin_page(int pageID, const TupleManipulator& tupleManipulator, bool fresh, int frameHint);
+
+	/**
+	Unpins the page in the specified frame.
+
+	\param frame	The index of the frame.
+	\param dirty	Whether or not the page was modified while it was pinned.
+	*/
+	void unpin_page(unsigned int frame, bool dirty);
+
+	/**
+	Checks whether or not the page in the specified frame can currently be evicted, and tells the eviction policy if that has changed.
+
+	\param frame	The index of the frame (if it is -1, nothing is done).
+	*/
+	void update_evictability(int frame);
+};
+
+typedef boost::shared_ptr<BufferPool> BufferPool_Ptr;
+
+}
+
+#endif
@@ -0,0 +1,65 @@
+/**
+ * whery: ClockEvictionPolicy.h
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#ifndef H_WHERY_CLOCKEVICTIONPOLICY
+#define H_WHERY_CLOCKEVICTIONPOLICY
+
+#include <vector>
+
+#include "EvictionPolicy.h"
+
+namespace whery {
+
+/**
+\brief An instance of this class implements a CLOCK (second chance) eviction policy.
+
+Each frame has a reference bit that is set whenever its page is accessed. To choose a victim,
+a clock hand sweeps round the frames, clearing reference bits as it goes, until it finds an
+evictable frame whose bit is already clear. This approximates LRU without needing to reorder
+anything on each access. The policy counts the evictable frames, so that it can tell at once when
+there is no victim to be found; otherwise, each frame the hand passes over either has its reference
+bit cleared (which pays for the access that set it) or is one of the few whose pages are held by the
+pool, so choosing a victim takes amortised constant time.
+*/
+class ClockEvictionPolicy : public EvictionPolicy
+{
+	//#################### PRIVATE VARIABLES ####################
+private:
+	/** Flags indicating which frames currently contain evictable pages. */
+	std::vector<bool> m_evictable;
+
+	/** The number of frames that currently contain evictable pages. */
+	unsigned int m_evictableCount;
+
+	/** The index of the frame at which the next sweep will start. */
+	unsigned int m_hand;
+
+	/** Flags indicating which frames currently contain pages. */
+	std::vector<bool> m_occupied;
+
+	/** The reference bits for the frames. */
+	std::vector<bool> m_referenced;
+
+	//#################### CONSTRUCTORS ####################
+public:
+	/**
+	Constructs a CLOCK eviction policy.
+	*/
+	ClockEvictionPolicy();
+
+	//#################### PUBLIC INHERITED METHODS ####################
+public:
+	virtual int choose_victim();
+	virtual void page_accessed(unsigned int frame);
+	virtual void page_discarded(unsigned int frame);
+	virtual void page_evicted(unsigned int frame);
+	virtual void page_loaded(unsigned int frame, int pageID);
+	virtual void reset(unsigned int frameCount);
+	virtual void set_evictable(unsigned int frame, bool evictable);
+};
+
+}
+
+#endif
@@ -0,0 +1,94 @@
+/**
+ * whery: EvictionPolicy.h
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#ifndef H_WHERY_EVICTIONPOLICY
+#define H_WHERY_EVICTIONPOLICY
+
+#include <boost/shared_ptr.hpp>
+
+namespace whery {
+
+/**
+\brief An instance of a class deriving from this one decides which page a buffer pool
+should evict from memory when it needs to make room for another one.
+
+The buffer pool informs its policy whenever a page is loaded into one of its frames,
+accessed, evicted or discarded, and consults it when it needs to choose a victim.
+Frames are identified by their (zero-based) indices within the pool.
+
+The pool also tells its policy whenever the page in a frame becomes evictable or stops being
+evictable (pages that are pinned or very recently accessed are not), so that the policy can
+keep track of the candidates itself and need not examine every frame to choose a victim.
+A page that has just been loaded is not evictable until the pool says otherwise.
+*/
+class EvictionPolicy
+{
+	//#################### DESTRUCTOR ####################
+public:
+	/**
+	Destroys the eviction policy.
+	*/
+	virtual ~EvictionPolicy() {}
+
+	//#################### PUBLIC ABSTRACT METHODS ####################
+public:
+	/**
+	Chooses a frame whose page should be evicted, from among those whose pages are evictable.
+
+	\return	The index of the chosen frame, or -1 if no frame can be chosen.
+	*/
+	virtual int choose_victim() = 0;
+
+	/**
+	Informs the policy that the page in the specified frame has been accessed.
+
+	\param frame	The index of the frame.
+	*/
+	virtual void page_accessed(unsigned int frame) = 0;
+
+	/**
+	Informs the policy that the page in the specified frame has been discarded
+	(i.e. it no longer exists, so there is no need to remember anything about it).
+
+	\param frame	The index of the frame.
+	*/
+	virtual void page_discarded(unsigned int frame) = 0;
+
+	/**
+	Informs the policy that the page in the specified frame has been evicted.
+
+	\param frame	The index of the frame.
+	*/
+	virtual void page_evicted(unsigned int frame) = 0;
+
+	/**
+	Informs the policy that a page has been loaded into the specified frame.
+
+	\param frame	The index of the frame.
+	\param pageID	The ID of the page.
+	*/
+	virtual void page_loaded(unsigned int frame, int pageID) = 0;
+
+	/**
+	Resets the policy for use with a buffer pool that has the specified number of frames.
+
+	\param frameCount	The number of frames in the buffer pool.
+	*/
+	virtual void reset(unsigned int frameCount) = 0;
+
+	/**
+	Informs the policy that the page in the specified frame has become evictable, or has stopped being evictable.
+
+	\param frame		The index of the frame.
+	\param evictable	Whether or not the page in the frame is now evictable.
+	*/
+	virtual void set_evictable(unsigned int frame, bool evictable) = 0;
+};
+
+typedef boost::shared_ptr<EvictionPolicy> EvictionPolicy_Ptr;
+
+}
+
+#endif
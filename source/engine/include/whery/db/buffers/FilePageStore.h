@@ -0,0 +1,58 @@
+/**
+ * whery: FilePageStore.h
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#ifndef H_WHERY_FILEPAGESTORE
+#define H_WHERY_FILEPAGESTORE
+
+#include <fstream>
+#include <string>
+
+#include "whery/util/IDAllocator.h"
+#include "PageStore.h"
+
+namespace whery {
+
+/**
+\brief An instance of this class represents a page store that keeps its pages in a file.
+
+The file is used purely as spill space for a buffer pool: it is truncated when the store
+is constructed, and its contents are not intended to be reused by later sessions.
+*/
+class FilePageStore : public PageStore
+{
+	//#################### PRIVATE VARIABLES ####################
+private:
+	/** The stream used to access the file. */
+	mutable std::fstream m_fs;
+
+	/** The allocator used to allocate page IDs. */
+	IDAllocator m_pageIDAllocator;
+
+	/** The size (in bytes) of the pages in the store. */
+	unsigned int m_pageSize;
+
+	//#################### CONSTRUCTORS ####################
+public:
+	/**
+	Constructs a page store that keeps its pages in the specified file.
+
+	\param filename				The name of the file (which will be created or truncated).
+	\param pageSize				The size (in bytes) of the pages in the store.
+	\throw std::runtime_error	If the file cannot be opened.
+	*/
+	FilePageStore(const std::string& filename, unsigned int pageSize);
+
+	//#################### PUBLIC INHERITED METHODS ####################
+public:
+	virtual int allocate_page();
+	virtual void deallocate_page(int pageID);
+	virtual unsigned int page_size() const;
+	virtual void read_page(int pageID, char *buffer) const;
+	virtual void write_page(int pageID, const char *buffer);
+};
+
+}
+
+#endif
@@ -0,0 +1,54 @@
+/**
+ * whery: InMemoryPageStore.h
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#ifndef H_WHERY_INMEMORYPAGESTORE
+#define H_WHERY_INMEMORYPAGESTORE
+
+#include <vector>
+
+#include "whery/util/IDAllocator.h"
+#include "PageStore.h"
+
+namespace whery {
+
+/**
+\brief An instance of this class represents a page store that keeps its pages in memory.
+
+This is mostly useful for testing, since it does not reduce the memory footprint of the pages.
+*/
+class InMemoryPageStore : public PageStore
+{
+	//#################### PRIVATE VARIABLES ####################
+private:
+	/** The allocator used to allocate page IDs. */
+	IDAllocator m_pageIDAllocator;
+
+	/** The contents of the pages (indexed by page ID). */
+	std::vector<std::vector<char> > m_pages;
+
+	/** The size (in bytes) of the pages in the store. */
+	unsigned int m_pageSize;
+
+	//#################### CONSTRUCTORS ####################
+public:
+	/**
+	Constructs an in-memory page store.
+
+	\param pageSize	The size (in bytes) of the pages in the store.
+	*/
+	explicit InMemoryPageStore(unsigned int pageSize);
+
+	//#################### PUBLIC INHERITED METHODS ####################
+public:
+	virtual int allocate_page();
+	virtual void deallocate_page(int pageID);
+	virtual unsigned int page_size() const;
+	virtual void read_page(int pageID, char *buffer) const;
+	virtual void write_page(int pageID, const char *buffer);
+};
+
+}
+
+#endif
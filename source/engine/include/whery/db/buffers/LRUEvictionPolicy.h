@@ -0,0 +1,56 @@
+/**
+ * whery: LRUEvictionPolicy.h
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#ifndef H_WHERY_LRUEVICTIONPOLICY
+#define H_WHERY_LRUEVICTIONPOLICY
+
+#include <list>
+#include <vector>
+
+#include "EvictionPolicy.h"
+
+namespace whery {
+
+/**
+\brief An instance of this class implements a least recently used (LRU) eviction policy.
+
+Only the frames whose pages are evictable are kept in the LRU list, so the victim is always at its head.
+A frame joins the back of the list when its page becomes evictable, which is when the pool has finished
+with it (i.e. the page has been unpinned and is no longer among the most recently accessed ones), so the
+list stays in order of last use.
+*/
+class LRUEvictionPolicy : public EvictionPolicy
+{
+	//#################### PRIVATE VARIABLES ####################
+private:
+	/** The frames that currently contain evictable pages, in order of last access (least recently used first). */
+	std::list<unsigned int> m_frames;
+
+	/** The position of each frame in the list of frames (or m_frames.end() if the frame contains no evictable page). */
+	std::vector<std::list<unsigned int>::iterator> m_positions;
+
+	//#################### PUBLIC INHERITED METHODS ####################
+public:
+	virtual int choose_victim();
+	virtual void page_accessed(unsigned int frame);
+	virtual void page_discarded(unsigned int frame);
+	virtual void page_evicted(unsigned int frame);
+	virtual void page_loaded(unsigned int frame, int pageID);
+	virtual void reset(unsigned int frameCount);
+	virtual void set_evictable(unsigned int frame, bool evictable);
+
+	//#################### PRIVATE METHODS ####################
+private:
+	/**
+	Removes the specified frame from the list of frames (if it is in it).
+
+	\param frame	The index of the frame.
+	*/
+	void remove_frame(unsigned int frame);
+};
+
+}
+
+#endif
@@ -0,0 +1,74 @@
+/**
+ * whery: PageStore.h
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#ifndef H_WHERY_PAGESTORE
+#define H_WHERY_PAGESTORE
+
+#include <boost/shared_ptr.hpp>
+
+namespace whery {
+
+/**
+\brief An instance of a class deriving from this one represents a backing store for fixed-size pages.
+
+A buffer pool reads pages from its backing store when they are needed, and writes them
+back to it when they are evicted from memory after being modified.
+*/
+class PageStore
+{
+	//#################### DESTRUCTOR ####################
+public:
+	/**
+	Destroys the page store.
+	*/
+	virtual ~PageStore() {}
+
+	//#################### PUBLIC ABSTRACT METHODS ####################
+public:
+	/**
+	Allocates a page in the store.
+
+	\return	The ID of the page.
+	*/
+	virtual int allocate_page() = 0;
+
+	/**
+	Deallocates the specified page. Its ID may subsequently be reused by allocate_page().
+
+	\param pageID					The ID of the page.
+	\throw std::invalid_argument	If the specified page is not currently allocated.
+	*/
+	virtual void deallocate_page(int pageID) = 0;
+
+	/**
+	Gets the size (in bytes) of the pages in the store.
+
+	\return	The size (in bytes) of the pages in the store.
+	*/
+	virtual unsigned int page_size() const = 0;
+
+	/**
+	Reads the specified page into a buffer. If the page has never been written,
+	the buffer is filled with zeros.
+
+	\param pageID	The ID of the page.
+	\param buffer	A buffer of at least page_size() bytes.
+	*/
+	virtual void read_page(int pageID, char *buffer) const = 0;
+
+	/**
+	Writes the contents of a buffer to the specified page.
+
+	\param pageID	The ID of the page.
+	\param buffer	A buffer of at least page_size() bytes.
+	*/
+	virtual void write_page(int pageID, const char *buffer) = 0;
+};
+
+typedef boost::shared_ptr<PageStore> PageStore_Ptr;
+
+}
+
+#endif
@@ -0,0 +1,108 @@
+/**
+ * whery: TwoQueueEvictionPolicy.h
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#ifndef H_WHERY_TWOQUEUEEVICTIONPOLICY
+#define H_WHERY_TWOQUEUEEVICTIONPOLICY
+
+#include <list>
+#include <vector>
+
+#include "EvictionPolicy.h"
+
+namespace whery {
+
+/**
+\brief An instance of this class implements a 2Q eviction policy (Johnson and Shasha, 1994).
+
+Pages that are loaded for the first time go into a FIFO queue (A1in), and further accesses to them
+while they are there are ignored. When such a page is evicted, its ID is remembered in a bounded
+"ghost" queue (A1out). If the page is then loaded again while its ID is still remembered, it is
+deemed to be genuinely hot and goes into an LRU queue (Am) instead. Victims are taken from A1in
+while it is larger than its target size, and from Am otherwise. This prevents a one-off scan over
+many pages from flushing the hot pages out of the pool, which is a weakness of plain LRU.
+
+The frames stay in their queues whilst their pages are held by the pool (so that A1in remains in order
+of loading), and the search for a victim simply skips over them. Since the pool only ever holds a few
+pages at once (those that are pinned, and the two most recently accessed ones), this takes constant time.
+*/
+class TwoQueueEvictionPolicy : public EvictionPolicy
+{
+	//#################### ENUMERATIONS ####################
+private:
+	/**
+	\brief The values of this enum identify the queue (if any) that contains a frame.
+	*/
+	enum Queue
+	{
+		/** The frame is in the A1in (FIFO) queue. */
+		Q_A1IN,
+
+		/** The frame is in the Am (LRU) queue. */
+		Q_AM,
+
+		/** The frame is not in either queue (i.e. it contains no page). */
+		Q_NONE
+	};
+
+	//#################### PRIVATE VARIABLES ####################
+private:
+	/** The frames in the A1in queue (oldest first). */
+	std::list<unsigned int> m_a1in;
+
+	/** The IDs of the pages that were recently evicted from the A1in queue (oldest first). */
+	std::list<int> m_a1out;
+
+	/** The frames in the Am queue (least recently used first). */
+	std::list<unsigned int> m_am;
+
+	/** Flags indicating which frames currently contain evictable pages. */
+	std::vector<bool> m_evictable;
+
+	/** The maximum number of page IDs to remember in the A1out queue. */
+	unsigned int m_maxA1OutSize;
+
+	/** The IDs of the pages in the frames. */
+	std::vector<int> m_pageIDs;
+
+	/** The position of each frame in the queue that contains it (if any). */
+	std::vector<std::list<unsigned int>::iterator> m_positions;
+
+	/** The queue (if any) that contains each frame. */
+	std::vector<Queue> m_queues;
+
+	/** The target size for the A1in queue. */
+	unsigned int m_targetA1InSize;
+
+	//#################### PUBLIC INHERITED METHODS ####################
+public:
+	virtual int choose_victim();
+	virtual void page_accessed(unsigned int frame);
+	virtual void page_discarded(unsigned int frame);
+	virtual void page_evicted(unsigned int frame);
+	virtual void page_loaded(unsigned int frame, int pageID);
+	virtual void reset(unsigned int frameCount);
+	virtual void set_evictable(unsigned int frame, bool evictable);
+
+	//#################### PRIVATE METHODS ####################
+private:
+	/**
+	Finds the first evictable frame in the specified queue.
+
+	\param queue	The queue.
+	\return			The index of the first evictable frame in the queue, or -1 if there is none.
+	*/
+	int first_evictable(const std::list<unsigned int>& queue) const;
+
+	/**
+	Removes the specified frame from the queue that contains it.
+
+	\param frame	The index of the frame.
+	*/
+	void remove_frame(unsigned int frame);
+};
+
+}
+
+#endif
@@ -0,0 +1,131 @@
+/**
+ * whery: BufferedSortedPage.h
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#ifndef H_WHERY_BUFFEREDSORTEDPAGE
+#define H_WHERY_BUFFEREDSORTEDPAGE
+
+#include "whery/db/buffers/BufferPool.h"
+
+namespace whery {
+
+/**
+\brief An instance of this class represents a sorted page of tuples that is cached in a buffer pool.
+
+The page itself is just a lightweight handle: each operation on it pins the underlying page in
+the buffer pool for the duration of the operation, loading it from the pool's backing store if
+it is not already resident. As a result, a B+-tree can hold a handle for each of its nodes
+without all of their pages needing to be in memory at the same time.
+
+Since the underlying page is unpinned at the end of each operation, and can then be evicted at any
+time, the tuples on it cannot be read in place. Instead, tuple_location() copies the requested tuple
+into the row cache of the frame containing the page (see BufferPool::Pin::row), which is counted against
+the pool's memory budget, and returns its location there. A copied row must not be written to, and is
+only retained until the page is next modified or evicted. Re-reading a tuple whose copy is still in the
+row cache does not need to pin the page.
+
+The handle also remembers the frame in which it last found the page (so that pinning a resident page
+does not usually need to search the pool's page table), and keeps its own copy of the page's tuple count
+(which is safe, since the page is only ever modified through the handle).
+*/
+class BufferedSortedPage : public SortedPage
+{
+	//#################### PRIVATE VARIABLES ####################
+private:
+	/** The index of the frame in which the page was last found in the buffer pool (or -1 if there is none). */
+	mutable int m_frameHint;
+
+	/** The maximum number of tuples that can be stored on the page. */
+	unsigned int m_maxTupleCount;
+
+	/** The ID of the page in the buffer pool. */
+	int m_pageID;
+
+	/** The buffer pool in which the page is cached. */
+	BufferPool_Ptr m_pool;
+
+	/** The number of tuples currently on the page. */
+	unsigned int m_tupleCount;
+
+	/** The manipulator used to interact with the tuples on the page. */
+	TupleManipulator m_tupleManipulator;
+
+	//#################### CONSTRUCTORS ####################
+public:
+	/**
+	Constructs a fresh (empty) page in the specified buffer pool.
+
+	\param pool					The buffer pool.
+	\param tupleManipulator		The manipulator to be used to interact with tuples on the page.
+	\throw std::invalid_argument	If the manipulator specifies that the page should use suffix truncation
+									(the row cache relies on all the tuples on the page having the same size).
+	*/
+	BufferedSortedPage(const BufferPool_Ptr& pool, const TupleManipulator& tupleManipulator);
+
+	//#################### DESTRUCTOR ####################
+public:
+	/**
+	Destroys the page, discarding it from the buffer pool.
+	*/
+	~BufferedSortedPage();
+
+	//#################### COPY CONSTRUCTOR & ASSIGNMENT OPERATOR ####################
+private:
+	BufferedSortedPage(const BufferedSortedPage&);
+	BufferedSortedPage& operator=(const BufferedSortedPage&);
+
+	//#################### PUBLIC INHERITED METHODS ####################
+public:
+	virtual void add_tuple(const Tuple& tuple);
+	virtual TupleSetCIter begin() const;
+	virtual unsigned int buffer_size() const;
+	virtual void clear();
+	virtual unsigned int empty_tuple_count() const;
+	virtual TupleSetCIter end() const;
+	virtual EqualRangeResult equal_range(const RangeKey& key) const;
+	virtual EqualRangeResult equal_range(const ValueKey& key) const;
+	virtual void erase_tuple(const BackedTuple& key);
+	virtual void erase_tuple(const TupleSetCIter& it);
+	virtual void erase_tuple(const TupleSetCRIter& rit);
+	virtual void erase_tuples(const TupleSetCIter& begin, const TupleSetCIter& end);
+	virtual const std::vector<const FieldManipulator*>& field_manipulators() const;
+	virtual TupleSetCIter find(const ValueKey& key) const;
+	virtual TupleSetCIter lower_bound(const RangeKey& key) const;
+	virtual TupleSetCIter lower_bound(const ValueKey& key) const;
+	virtual unsigned int max_tuple_count() const;
+	virtual double percentage_full() const;
+	virtual TupleSetCRIter rbegin() const;
+	virtual void read_doubles(unsigned int fieldIndex, unsigned int begin, unsigned int end, double *values) const;
+	virtual void read_ints(unsigned int fieldIndex, unsigned int begin, unsigned int end, int *values) const;
+	virtual TupleSetCRIter rend() const;
+	virtual bool supports_concurrent_reads() const;
+	virtual unsigned int tuple_count() const;
+	virtual char *tuple_location(unsigned int i) const;
+	virtual void tuple_locations(unsigned int begin, unsigned int end, const char **locations) const;
+	virtual const TupleManipulator& tuple_manipulator() const;
+	virtual TupleSetCIter upper_bound(const RangeKey& key) const;
+	virtual TupleSetCIter upper_bound(const ValueKey& key) const;
+
+	//#################### PRIVATE METHODS ####################
+private:
+	/**
+	Records the fact that the underlying page has been modified via the specified pin. This marks the page
+	as dirty (which also invalidates any copies of its tuples in the row cache) and updates the cached tuple count.
+
+	\param pin	The pin via which the page was modified.
+	*/
+	void page_modified(BufferPool::Pin& pin);
+
+	/**
+	Converts an iterator over the underlying page into an equivalent iterator over this page.
+
+	\param it	An iterator over the underlying page.
+	\return		The equivalent iterator over this page.
+	*/
+	TupleSetCIter wrap(const TupleSetCIter& it) const;
+};
+
+}
+
+#endif
@@ -0,0 +1,237 @@
+/**
+ * whery: ColumnarSortedPage.h
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#ifndef H_WHERY_COLUMNARSORTEDPAGE
+#define H_WHERY_COLUMNARSORTEDPAGE
+
+#include "SortedPage.h"
+
+namespace whery {
+
+/**
+\brief An instance of this class represents a sorted page of tuples that resides in memory and stores
+each field of its tuples in a separate column (a layout known as PAX, for Partition Attributes Across).
+
+The page's buffer is divided into a minipage for each field, followed by a tuple count. The i'th entry
+of each minipage holds the corresponding field of the i'th tuple in the page's sorted order, so each
+field's values are stored contiguously (and without any of the padding that a row would need) in sorted
+order. Scanning a single field (see read_ints, filter_ints, etc.) thus only reads that field's minipage.
+The price is that adding or erasing a tuple has to shift the later entries of every minipage, rather
+than just the slots of a slotted page, which makes the layout best suited to pages that are scanned far
+more often than they are modified.
+
+Since the page's tuples are not stored as rows, tuple_location() reconstructs the requested tuple in a
+row cache owned by the page, so that tuple views (e.g. those of the page's iterators) work as normal.
+A reconstructed row is retained until the page is next modified, and must not be written to. Because
+reading a tuple can thus write to the row cache, the page must not be read concurrently (so it cannot
+be used by a B+-tree that allows optimistic concurrent readers).
+*/
+class ColumnarSortedPage : public SortedPage
+{
+	//#################### PRIVATE VARIABLES ####################
+private:
+	/** The memory buffer used by the page to hold its minipages and tuple count. */
+	std::vector<char> m_buffer;
+
+	/** The offsets (in bytes) of the fields' minipages from the start of the buffer, followed by that of the tuple count. */
+	std::vector<unsigned int> m_columnOffsets;
+
+	/** The maximum number of tuples that can be stored on the page. */
+	unsigned int m_maxTupleCount;
+
+	/** The row cache, in which the tuples on the page are reconstructed on demand (see tuple_location). */
+	mutable std::vector<char> m_rowCache;
+
+	/** Flags indicating which of the rows in the row cache currently hold the corresponding tuple. */
+	mutable std::vector<unsigned char> m_rowCached;
+
+	/** The manipulator used to interact with the tuples in the row cache. */
+	TupleManipulator m_tupleManipulator;
+
+	//#################### CONSTRUCTORS ####################
+public:
+	/**
+	Constructs a page to contain tuples that can be manipulated by the specified manipulator.
+
+	\param bufferSize				The size (in bytes) to use for the page's memory buffer.
+	\param tupleManipulator			The manipulator to be used to interact with tuples on the page.
+	\throw std::invalid_argument	If bufferSize is too small to hold the page's tuple count, or if the
+									manipulator specifies that the page should use suffix truncation.
+	*/
+	ColumnarSortedPage(unsigned int bufferSize, const TupleManipulator& tupleManipulator);
+
+	//#################### COPY CONSTRUCTOR & ASSIGNMENT OPERATOR ####################
+private:
+	// Deliberately unimplemented.
+	ColumnarSortedPage(const ColumnarSortedPage&);
+	ColumnarSortedPage& operator=(const ColumnarSortedPage&);
+
+	//#################### PUBLIC STATIC METHODS ####################
+public:
+	/**
+	Calculates the buffer size (in bytes) needed for a page to be able to hold the specified number of tuples.
+
+	\param maxTupleCount	The number of tuples the page should be able to hold.
+	\param tupleManipulator	The manipulator to be used to interact with tuples on the page.
+	\return					The buffer size needed.
+	*/
+	static unsigned int buffer_size_for(unsigned int maxTupleCount, const TupleManipulator& tupleManipulator);
+
+	//#################### PUBLIC INHERITED METHODS ####################
+public:
+	virtual void add_tuple(const Tuple& tuple);
+	virtual TupleSetCIter begin() const;
+	virtual unsigned int buffer_size() const;
+	virtual void clear();
+	virtual unsigned int empty_tuple_count() const;
+	virtual TupleSetCIter end() const;
+	virtual EqualRangeResult equal_range(const RangeKey& key) const;
+	virtual EqualRangeResult equal_range(const ValueKey& key) const;
+	virtual void erase_tuple(const BackedTuple& key);
+	virtual void erase_tuple(const TupleSetCIter& it);
+	virtual void erase_tuple(const TupleSetCRIter& rit);
+	virtual void erase_tuples(const TupleSetCIter& begin, const TupleSetCIter& end);
+	virtual const std::vector<const FieldManipulator*>& field_manipulators() const;
+	virtual TupleSetCIter find(const ValueKey& key) const;
+	virtual TupleSetCIter lower_bound(const RangeKey& key) const;
+	virtual TupleSetCIter lower_bound(const ValueKey& key) const;
+	virtual unsigned int max_tuple_count() const;
+	virtual double percentage_full() const;
+	virtual TupleSetCRIter rbegin() const;
+	virtual void read_doubles(unsigned int fieldIndex, unsigned int begin, unsigned int end, double *values) const;
+	virtual void read_ints(unsigned int fieldIndex, unsigned int begin, unsigned int end, int *values) const;
+	virtual TupleSetCRIter rend() const;
+	virtual bool supports_concurrent_reads() const;
+	virtual unsigned int tuple_count() const;
+	virtual char *tuple_location(unsigned int i) const;
+	virtual const TupleManipulator& tuple_manipulator() const;
+	virtual TupleSetCIter upper_bound(const RangeKey& key) const;
+	virtual TupleSetCIter upper_bound(const ValueKey& key) const;
+
+	//#################### PUBLIC METHODS ####################
+public:
+	/**
+	Gets the minipage that holds the values of the specified field. The value for the tuple at position i
+	on the page is at offset i * field_manipulators()[fieldIndex]->size() from the start of the minipage,
+	and is suitably aligned for its type.
+
+	\param fieldIndex	The index of the field.
+	\return				A pointer to the start of the field's minipage.
+	*/
+	const char *column(unsigned int fieldIndex) const;
+
+	/**
+	Finds the positions of the tuples on the page whose values for the specified field lie in the range [low,high].
+
+	\param fieldIndex	The index of the field (which must be of a type that can be read as a double).
+	\param low			The lower bound of the range.
+	\param high			The upper bound of the range.
+	\param positions	Used to return the positions of the matching tuples (in ascending order).
+	*/
+	void filter_doubles(unsigned int fieldIndex, double low, double high, std::vector<unsigned int>& positions) const;
+
+	/**
+	Finds the positions of the tuples on the page whose values for the specified field lie in the range [low,high].
+
+	\param fieldIndex	The index of the field (which must be of a type that can be read as an int).
+	\param low			The lower bound of the range.
+	\param high			The upper bound of the range.
+	\param positions	Used to return the positions of the matching tuples (in ascending order).
+	*/
+	void filter_ints(unsigned int fieldIndex, int low, int high, std::vector<unsigned int>& positions) const;
+
+	//#################### PRIVATE METHODS ####################
+private:
+	/**
+	Gets the location in the buffer of the specified field of the tuple at the specified position on the page.
+
+	\param fieldIndex	The index of the field.
+	\param i			The position of the tuple on the page.
+	\return				The location of the field.
+	*/
+	char *column_location(unsigned int fieldIndex, unsigned int i) const;
+
+	/**
+	Compares the tuple at the specified position on the page with the specified key, using prefix comparison.
+
+	\param i		The position of the tuple on the page.
+	\param key		The key.
+	\return			-1, if the tuple is ordered before the key;
+					1, if the tuple is ordered after the key;
+					0, otherwise.
+	*/
+	int compare_tuple(unsigned int i, const Tuple& key) const;
+
+	/**
+	Erases the tuples at the specified range of positions on the page.
+
+	\param begin	The position of the first tuple to erase.
+	\param end		The position one beyond that of the last tuple to erase (in the range [begin,tuple_count()]).
+	*/
+	void erase_tuples_at(unsigned int begin, unsigned int end);
+
+	/**
+	Marks the rows in the row cache for a range of positions as no longer holding the corresponding tuples
+	(because those tuples have moved or changed).
+
+	\param begin	The first position.
+	\param end		The position one beyond the last position.
+	*/
+	void invalidate_rows(unsigned int begin, unsigned int end);
+
+	/**
+	Narrows down the range of positions on the page that can contain the bounds of the specified key, by
+	finding the tuples whose leading field is equivalent to the key's. If the leading field is an int or
+	a double, its minipage is a sorted array of native values, so this can be done using a vectorised
+	search (see SimdSearch.h) rather than by comparing the tuples with the key through their manipulators.
+
+	\param key		The search key.
+	\param low		Used to return the position of the first tuple whose leading field is equivalent to the key's.
+	\param high	Used to return the position one beyond the last such tuple.
+	\return		true, if the range was narrowed down, or false if the leading field is of another type.
+	*/
+	bool leading_field_range(const Tuple& key, unsigned int& low, unsigned int& high) const;
+
+	/**
+	Finds the position of the first tuple on the page that is not ordered before the specified key.
+
+	\param key	The search key.
+	\return		The position of the first tuple that is not ordered before key, or tuple_count() if there is none.
+	*/
+	unsigned int lower_bound_index(const Tuple& key) const;
+
+	/**
+	Gets a pointer to the page's tuple count (stored in the buffer after the minipages).
+
+	\return	A pointer to the page's tuple count.
+	*/
+	unsigned int *tuple_count_location() const;
+
+	/**
+	Finds the position of the first tuple on the page that is ordered after the specified key.
+
+	\param key	The search key.
+	\return		The position of the first tuple that is ordered after key, or tuple_count() if there is none.
+	*/
+	unsigned int upper_bound_index(const Tuple& key) const;
+
+	//#################### PRIVATE STATIC METHODS ####################
+private:
+	/**
+	Lays out the minipages of a page that can hold the specified number of tuples.
+
+	\param maxTupleCount	The number of tuples the page should be able to hold.
+	\param tupleManipulator	The manipulator to be used to interact with tuples on the page.
+	\param columnOffsets	If non-NULL, used to return the offsets of the fields' minipages and of the tuple count.
+	\return					The buffer size needed for the page.
+	*/
+	static unsigned int lay_out(unsigned int maxTupleCount, const TupleManipulator& tupleManipulator, std::vector<unsigned int> *columnOffsets);
+};
+
+typedef boost::shared_ptr<ColumnarSortedPage> ColumnarSortedPage_Ptr;
+
+}
+
+#endif
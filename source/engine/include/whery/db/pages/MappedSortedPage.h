@@ -0,0 +1,66 @@
+/**
+ * whery: MappedSortedPage.h
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#ifndef H_WHERY_MAPPEDSORTEDPAGE
+#define H_WHERY_MAPPEDSORTEDPAGE
+
+#include "SlottedSortedPage.h"
+
+//#################### FORWARD DECLARATIONS ####################
+namespace boost { namespace interprocess { class mapped_region; } }
+
+namespace whery {
+
+/**
+\brief An instance of this class represents a sorted page of tuples whose buffer resides
+in a memory-mapped region of a file.
+
+Since the page's contents (including its slot array and tuple count) live entirely within
+the mapped region, a page that was written during one session can be reopened in a later
+one simply by mapping the same region of the file again. The region may be shared with
+other pages (e.g. a large chunk of a file of pages can be mapped at once), in which case
+each page uses only its own part of it.
+*/
+class MappedSortedPage : public SlottedSortedPage
+{
+	//#################### PRIVATE VARIABLES ####################
+private:
+	/** The offset (in bytes) of the page's buffer from the start of the mapped region. */
+	unsigned int m_bufferOffset;
+
+	/** The mapped region of the file that contains the page's buffer. */
+	boost::shared_ptr<boost::interprocess::mapped_region> m_region;
+
+	//#################### CONSTRUCTORS ####################
+public:
+	/**
+	Constructs a page whose buffer resides in the specified mapped region of a file.
+
+	\param region					The mapped region.
+	\param bufferOffset				The offset (in bytes) of the page's buffer from the start of the region.
+									This must preserve the region's alignment for the tuples on the page.
+	\param bufferSize				The size (in bytes) of the page's buffer.
+	\param tupleManipulator			The manipulator to be used to interact with tuples on the page.
+	\param fresh					Whether or not the buffer is fresh (in which case the page is made
+									empty), as opposed to containing a page written previously.
+	\throw std::invalid_argument	If the buffer does not lie within the region, if it is too small to hold
+									the page's tuple count, or if it is not fresh and does not contain a valid page.
+	*/
+	MappedSortedPage(const boost::shared_ptr<boost::interprocess::mapped_region>& region, unsigned int bufferOffset, unsigned int bufferSize,
+					 const TupleManipulator& tupleManipulator, bool fresh);
+
+	//#################### PUBLIC METHODS ####################
+public:
+	/**
+	Writes any modified parts of the page back to the underlying file (without flushing the rest of the region).
+	*/
+	void flush() const;
+};
+
+typedef boost::shared_ptr<MappedSortedPage> MappedSortedPage_Ptr;
+
+}
+
+#endif
@@ -0,0 +1,328 @@
+/**
+ * whery: PackedSortedPage.h
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#ifndef H_WHERY_PACKEDSORTEDPAGE
+#define H_WHERY_PACKEDSORTEDPAGE
+
+#include "SortedPage.h"
+
+namespace whery {
+
+/**
+\brief An instance of this class represents a sorted page of tuples that resides in memory, stores each
+field of its tuples in a separate column, and compresses its int columns.
+
+Like a ColumnarSortedPage, the page divides a fixed-size buffer into a column for each field, whose i'th
+entry holds the corresponding field of the i'th tuple in the page's sorted order. An int column, however,
+stores each value as its offset from a base, using only as many bits as the column's range of values needs
+(a scheme known as frame-of-reference encoding, see BitPacking.h). A column of IDs or counters that span a
+small range thus takes a few bits per value rather than four bytes, and since the leading field is sorted,
+its values on a page are generally close together even if they are large. (Storing the differences between
+consecutive values instead would make them smaller still, but would mean that a value could only be found
+by summing all the differences before it, which would rule out binary searching the page.) Columns of other
+types are stored uncompressed.
+
+The page's capacity therefore depends on the values it holds: the columns are laid out for as many tuples as
+fit in the buffer at their current bases and bit widths (see max_tuple_count), and a tuple can be added as
+long as the page would still have room for it once its columns had been re-encoded to accommodate its values
+(see has_room_for). Adding a tuple whose values fit the current encoding just shifts the later values in each
+column up and writes the new ones in place; only a tuple whose values lie outside the range of a column makes
+the page re-encode its columns (choosing each base so that the range has room to grow in both directions, so
+that a run of increasing or decreasing values does not re-encode the page every time). Erasing tuples never
+re-encodes the columns, so they only shrink again when the page is next re-encoded or cleared. Scans should
+use read_ints (which unpacks a column in bulk, using AVX2 where available) rather than reading the tuples one
+at a time.
+
+Since a B+-tree only takes account of value-dependent capacities for its leaves, the page should only be used
+for leaves, and the controller that provides them should report max_tuple_count_for (the number of tuples that
+fit whatever their values) as their capacity, since bulk loads rely on it.
+
+As with a ColumnarSortedPage, tuple_location() reconstructs the requested tuple in a row cache owned by the
+page (which is only allocated when a tuple is first read in this way). A reconstructed row is retained until
+the page is next modified, and must not be written to. The page must not be read concurrently.
+*/
+class PackedSortedPage : public SortedPage
+{
+	//#################### NESTED TYPES ####################
+private:
+	/**
+	\brief An instance of this struct describes how the values of one of the page's fields are stored.
+	*/
+	struct Column
+	{
+		/** For a packed column, the value relative to which the column's values are stored (no greater than the smallest of them). */
+		int base;
+
+		/** For a packed column, the number of bits used to store each value. */
+		unsigned int bitWidth;
+
+		/** The offset (in bytes) of the column from the start of the page's buffer. */
+		unsigned int offset;
+
+		/** Whether or not the column is packed (i.e. whether it holds an int field). */
+		bool packed;
+	};
+
+	//#################### PRIVATE VARIABLES ####################
+private:
+	/** The memory buffer used by the page to hold its columns. */
+	std::vector<char> m_buffer;
+
+	/** The columns holding the values of the page's fields. */
+	std::vector<Column> m_columns;
+
+	/** The maximum number of tuples that can be stored on the page at the columns' current bases and bit widths. */
+	unsigned int m_maxTupleCount;
+
+	/** The row cache, in which the tuples on the page are reconstructed on demand (see tuple_location). */
+	mutable std::vector<char> m_rowCache;
+
+	/** Flags indicating which of the rows in the row cache currently hold the corresponding tuple. */
+	mutable std::vector<unsigned char> m_rowCached;
+
+	/** The number of tuples currently on the page. */
+	unsigned int m_tupleCount;
+
+	/** The manipulator used to interact with the tuples in the row cache. */
+	TupleManipulator m_tupleManipulator;
+
+	//#################### CONSTRUCTORS ####################
+public:
+	/**
+	Constructs a page to contain tuples that can be manipulated by the specified manipulator.
+
+	\param bufferSize				The size (in bytes) to use for the page's memory buffer.
+	\param tupleManipulator			The manipulator to be used to interact with tuples on the page.
+	\throw std::invalid_argument	If bufferSize is too small to hold two tuples whatever their values, or if
+									the manipulator specifies that the page should use suffix truncation.
+	*/
+	PackedSortedPage(unsigned int bufferSize, const TupleManipulator& tupleManipulator);
+
+	//#################### COPY CONSTRUCTOR & ASSIGNMENT OPERATOR ####################
+private:
+	// Deliberately unimplemented.
+	PackedSortedPage(const PackedSortedPage&);
+	PackedSortedPage& operator=(const PackedSortedPage&);
+
+	//#################### PUBLIC STATIC METHODS ####################
+public:
+	/**
+	Calculates the buffer size (in bytes) needed for a page to be able to hold the specified number of tuples,
+	whatever their values.
+
+	\param maxTupleCount	The number of tuples the page should be able to hold.
+	\param tupleManipulator	The manipulator to be used to interact with tuples on the page.
+	\return					The buffer size needed.
+	*/
+	static unsigned int buffer_size_for(unsigned int maxTupleCount, const TupleManipulator& tupleManipulator);
+
+	/**
+	Calculates the number of tuples that a page with the specified buffer size can hold, whatever their values
+	(i.e. with every int column packed at 32 bits per value). The page may be able to hold many more tuples than
+	this if their values span smaller ranges.
+
+	\param bufferSize		The size (in bytes) of the page's buffer.
+	\param tupleManipulator	The manipulator to be used to interact with tuples on the page.
+	\return					The number of tuples that the page can hold, whatever their values.
+	*/
+	static unsigned int max_tuple_count_for(unsigned int bufferSize, const TupleManipulator& tupleManipulator);
+
+	//#################### PUBLIC INHERITED METHODS ####################
+public:
+	virtual void add_tuple(const Tuple& tuple);
+	virtual TupleSetCIter begin() const;
+	virtual unsigned int buffer_size() const;
+	virtual void clear();
+	virtual unsigned int empty_tuple_count() const;
+	virtual TupleSetCIter end() const;
+	virtual EqualRangeResult equal_range(const RangeKey& key) const;
+	virtual EqualRangeResult equal_range(const ValueKey& key) const;
+	virtual void erase_tuple(const BackedTuple& key);
+	virtual void erase_tuple(const TupleSetCIter& it);
+	virtual void erase_tuple(const TupleSetCRIter& rit);
+	virtual void erase_tuples(const TupleSetCIter& begin, const TupleSetCIter& end);
+	virtual const std::vector<const FieldManipulator*>& field_manipulators() const;
+	virtual TupleSetCIter find(const ValueKey& key) const;
+	virtual bool has_room_for(const Tuple& tuple, unsigned int erasedCount = 0) const;
+	virtual bool has_room_for_tuples_from(const SortedPage& source, unsigned int count) const;
+	virtual TupleSetCIter lower_bound(const RangeKey& key) const;
+	virtual TupleSetCIter lower_bound(const ValueKey& key) const;
+
+	/**
+	Gets the maximum number of tuples that can be stored on the page at the current bases and bit widths of its
+	int columns. Note that this is only a guide to whether a particular tuple can be added (see has_room_for).
+
+	\return	The maximum number of tuples that can be stored on the page at its current encoding.
+	*/
+	virtual unsigned int max_tuple_count() const;
+
+	virtual double percentage_full() const;
+	virtual TupleSetCRIter rbegin() const;
+	virtual void read_doubles(unsigned int fieldIndex, unsigned int begin, unsigned int end, double *values) const;
+	virtual void read_ints(unsigned int fieldIndex, unsigned int begin, unsigned int end, int *values) const;
+	virtual TupleSetCRIter rend() const;
+	virtual bool supports_concurrent_reads() const;
+	virtual unsigned int tuple_count() const;
+	virtual char *tuple_location(unsigned int i) const;
+	virtual const TupleManipulator& tuple_manipulator() const;
+	virtual TupleSetCIter upper_bound(const RangeKey& key) const;
+	virtual TupleSetCIter upper_bound(const ValueKey& key) const;
+
+	//#################### PUBLIC METHODS ####################
+public:
+	/**
+	Gets the number of bits currently used to store each value of the specified field.
+
+	\param fieldIndex	The index of the field.
+	\return				The packed bit width of the field's column (in the range [0,32]), if the field is an int,
+						or the number of bits in the field's usual representation, otherwise.
+	*/
+	unsigned int bit_width(unsigned int fieldIndex) const;
+
+	//#################### PRIVATE STATIC METHODS ####################
+private:
+	/**
+	Lays out the columns of a page with the specified buffer size for as many tuples as will fit at the columns'
+	bit widths.
+
+	\param bufferSize		The size (in bytes) of the page's buffer.
+	\param tupleManipulator	The manipulator to be used to interact with tuples on the page.
+	\param columns			The columns, whose offsets are set to match the layout.
+	\return					The number of tuples for which the columns have been laid out.
+	*/
+	static unsigned int capacity_for(unsigned int bufferSize, const TupleManipulator& tupleManipulator, std::vector<Column>& columns);
+
+	/**
+	Lays out the columns of a page that can hold the specified number of tuples at the columns' bit widths.
+
+	\param maxTupleCount	The number of tuples the page should be able to hold.
+	\param tupleManipulator	The manipulator to be used to interact with tuples on the page.
+	\param columns			The columns, whose offsets are set to match the layout.
+	\return					The buffer size needed for the page.
+	*/
+	static unsigned int lay_out(unsigned int maxTupleCount, const TupleManipulator& tupleManipulator, std::vector<Column>& columns);
+
+	/**
+	Makes the columns for a page that has the specified type of tuple and stores every int at 32 bits.
+
+	\param tupleManipulator	The manipulator to be used to interact with tuples on the page.
+	\return					The columns.
+	*/
+	static std::vector<Column> make_full_width_columns(const TupleManipulator& tupleManipulator);
+
+	//#################### PRIVATE METHODS ####################
+private:
+	/**
+	Gets the data of the specified column.
+
+	\param column	The column.
+	\return			A pointer to the start of the column in the page's buffer.
+	*/
+	char *column_data(const Column& column) const;
+
+	/**
+	Compares the tuple at the specified position on the page with the specified key, using prefix comparison.
+
+	\param i		The position of the tuple on the page.
+	\param key		The key.
+	\return			-1, if the tuple is ordered before the key;
+					1, if the tuple is ordered after the key;
+					0, otherwise.
+	*/
+	int compare_tuple(unsigned int i, const Tuple& key) const;
+
+	/**
+	Erases the tuples at the specified range of positions on the page, shifting the later values in each column down.
+
+	\param begin	The position of the first tuple to erase.
+	\param end		The position one beyond that of the last tuple to erase (in the range [begin,tuple_count()]).
+	*/
+	void erase_tuples_at(unsigned int begin, unsigned int end);
+
+	/**
+	Determines whether or not the values of the specified tuple fit the current bases and bit widths of the page's int columns.
+
+	\param tuple	The tuple.
+	\return			true, if the tuple's values fit the page's current encoding, or false otherwise.
+	*/
+	bool fits_encoding(const Tuple& tuple) const;
+
+	/**
+	Marks the rows in the row cache for a range of positions as no longer holding the corresponding tuples
+	(because those tuples have moved or changed).
+
+	\param begin	The first position.
+	\param end		The position one beyond the last position.
+	*/
+	void invalidate_rows(unsigned int begin, unsigned int end);
+
+	/**
+	Narrows down the range of positions on the page that can contain the bounds of the specified key, by
+	finding the tuples whose leading field is equivalent to the key's. If the leading field is packed, this
+	can be done by searching its column directly, rather than by comparing the tuples with the key through
+	their manipulators. In particular, no search is needed if the key's leading field is outside the range
+	of the column.
+
+	\param key		The search key.
+	\param low		Used to return the position of the first tuple whose leading field is equivalent to the key's.
+	\param high	Used to return the position one beyond the last such tuple.
+	\return		true, if the range was narrowed down, or false if the leading field is not packed.
+	*/
+	bool leading_field_range(const Tuple& key, unsigned int& low, unsigned int& high) const;
+
+	/**
+	Finds the position of the first tuple on the page that is not ordered before the specified key.
+
+	\param key	The search key.
+	\return		The position of the first tuple that is not ordered before key, or tuple_count() if there is none.
+	*/
+	unsigned int lower_bound_index(const Tuple& key) const;
+
+	/**
+	Works out the bases and bit widths that the page's int columns would need in order to hold the values of
+	the tuples on the page, together with those of an extra tuple and/or all of the tuples on another page.
+	The bit width of each column is the smallest that will do, and its base is chosen so as to leave as much
+	room as possible both below the smallest value and above the largest one.
+
+	\param tuple		An extra tuple whose values the columns should hold (may be NULL).
+	\param source		Another page whose tuples' values the columns should hold (may be NULL).
+	\param columns		Used to return the columns (laid out for as many tuples as will fit in the page's buffer).
+	\return				The number of tuples that the page could hold with the columns encoded in this way.
+	*/
+	unsigned int plan_encoding(const Tuple *tuple, const SortedPage *source, std::vector<Column>& columns) const;
+
+	/**
+	Gets the location of the specified field of the tuple at the specified position on the page, for a field
+	whose column is not packed.
+
+	\param fieldIndex	The index of the field.
+	\param i			The position of the tuple on the page.
+	\return				The location of the field.
+	*/
+	char *raw_location(unsigned int fieldIndex, unsigned int i) const;
+
+	/**
+	Re-encodes the page's columns with the specified bases and bit widths, which must be able to hold all of
+	the values on the page, and which determine the page's new capacity.
+
+	\param columns		The columns (as laid out by plan_encoding).
+	\param maxTupleCount	The number of tuples for which the columns have been laid out.
+	*/
+	void re_encode(const std::vector<Column>& columns, unsigned int maxTupleCount);
+
+	/**
+	Finds the position of the first tuple on the page that is ordered after the specified key.
+
+	\param key	The search key.
+	\return		The position of the first tuple that is ordered after key, or tuple_count() if there is none.
+	*/
+	unsigned int upper_bound_index(const Tuple& key) const;
+};
+
+typedef boost::shared_ptr<PackedSortedPage> PackedSortedPage_Ptr;
+
+}
+
+#endif
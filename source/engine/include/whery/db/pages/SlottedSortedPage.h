@@ -0,0 +1,408 @@
+/**
+ * whery: SlottedSortedPage.h
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#ifndef H_WHERY_SLOTTEDSORTEDPAGE
+#define H_WHERY_SLOTTEDSORTEDPAGE
+
+#include "SortedPage.h"
+
+namespace whery {
+
+/**
+\brief An instance of a class deriving from this one represents a sorted page of tuples that is stored
+in a slotted buffer. Derived classes are responsible for providing the buffer itself (e.g. in memory
+or in a memory-mapped file).
+
+The page's buffer is divided into three parts: an array of fixed-size tuple cells, an array of slots
+and a tuple count. Each slot contains the offset (in bytes) of a tuple cell from the start of the buffer.
+The slots form a permutation of all the cells on the page: the first tuple_count() of them refer to the
+tuples currently on the page, sorted lexicographically in ascending order, and the remainder refer to
+the cells that are currently free. Searching the page is thus a binary search over the slot array, and
+adding or erasing a tuple shifts some of the slots but never moves any tuple data.
+
+If the page's tuple manipulator specifies that it should use key prefixes, the slot array is followed
+by an array of normalized key prefixes (one for each slot), each containing the first few bytes of the
+normalized encoding of the corresponding tuple. Most of the comparisons during a search can then be
+resolved by comparing the prefixes, without needing to access the tuples themselves.
+
+If instead the page's tuple manipulator specifies that it should use suffix truncation (as for the branch
+pages of a B+-tree, whose tuples consist of a separator key followed by a child node ID), each tuple may be
+stored with some of its trailing key fields omitted, i.e. as its first k fields (for some k >= 1) followed
+by its last field, and the cells are then of variable size (they are packed together, rather than padded to
+a maximum-alignment boundary, so that dropping even a single int field saves space). The buffer starts with
+a small header (the tuple count, the offset of the first cell and the total size of the cells), followed by
+the slot array, which grows upwards, whilst the cells are allocated downwards from the end of the buffer.
+Each slot holds both the offset of its cell and the number of key fields it contains. Erasing a tuple only
+removes its slot: the space taken by erased cells is reclaimed by compacting the remaining cells when a
+tuple would not otherwise fit (which moves the data, but not the positions, of the other tuples). The
+capacity of the page is measured in tuples of full length, i.e. max_tuple_count() is the number of tuples
+on the page plus the number of full-length tuples that could still be added to it. When the page is
+searched, a tuple is compared with the key on the key fields that they share, except that a truncated tuple
+whose key fields form a proper prefix of the key is ordered before it (a B+-tree only truncates a separator
+if nothing to its left starts with the same fields).
+*/
+class SlottedSortedPage : public SortedPage
+{
+	//#################### ENUMERATIONS ####################
+private:
+	enum
+	{
+		/** The maximum number of (4-byte) words in a normalized key prefix. */
+		MAX_KEY_PREFIX_WORDS = 2,
+
+		/** The number of low-order bits of a slot that hold the offset of its cell on a page that uses suffix truncation. */
+		SLOT_OFFSET_BITS = 24
+	};
+
+	/**
+	The positions of the (4-byte) words in the header of a page that uses suffix truncation.
+	*/
+	enum HeaderWord
+	{
+		/** The number of tuples on the page. */
+		HW_TUPLE_COUNT,
+
+		/** The offset (in bytes) of the lowest cell in the buffer (i.e. the start of the cell area). */
+		HW_CELLS_BEGIN,
+
+		/** The total size (in bytes) of the cells of the tuples currently on the page. */
+		HW_CELL_BYTES,
+
+		/** The number of words in the header. */
+		HW_COUNT
+	};
+
+	//#################### NESTED CLASSES ####################
+private:
+	/**
+	\brief An instance of this struct holds the normalized key prefix of a search key.
+	*/
+	struct KeyPrefix
+	{
+		/** Whether or not the prefix contains the whole of the search key (in which case equivalent prefixes imply equivalent tuples). */
+		bool complete;
+
+		/** The number of words in the prefix that can be compared (0 if the page does not use key prefixes). */
+		unsigned int wordCount;
+
+		/** The words of the prefix, each containing four bytes of the normalized encoding in big-endian order. */
+		unsigned int words[MAX_KEY_PREFIX_WORDS];
+
+		/**
+		Compares a stored key prefix with this one.
+
+		\param prefix	The stored key prefix.
+		\return			-1, if the stored prefix is ordered before this one;
+						1, if the stored prefix is ordered after this one;
+						0, if they are equivalent (in which case the full tuple must be compared).
+		*/
+		int compare(const unsigned int *prefix) const;
+	};
+
+	//#################### PRIVATE VARIABLES ####################
+private:
+	/** The buffer used by the page to hold the tuple data (owned by the derived class). */
+	char *m_buffer;
+
+	/** The size (in bytes) of the buffer. */
+	unsigned int m_bufferSize;
+
+	/** A scratch array used to order the slots of a page that uses suffix truncation when compacting its cells (see compact_cells). */
+	std::vector<unsigned int> m_compactionOrder;
+
+	/** The number of (4-byte) words in the normalized key prefix stored for each slot (0 if the page does not use key prefixes). */
+	unsigned int m_keyPrefixWordCount;
+
+	/**
+	The maximum number of tuples that can be stored on the page (or, if the page uses suffix
+	truncation, the maximum number of full-length tuples that can be stored on it).
+	*/
+	unsigned int m_maxTupleCount;
+
+	/**
+	If the page uses suffix truncation, the sizes (in bytes) of the cells of the tuples in the buffer,
+	indexed by the number of key fields they contain minus one (see truncated_cell_size).
+	*/
+	std::vector<unsigned int> m_truncatedCellSizes;
+
+	/**
+	If the page uses suffix truncation, the manipulators used to interact with the tuples in the buffer, indexed
+	by the number of key fields they contain minus one (the last of these is simply the page's tuple manipulator).
+	*/
+	std::vector<TupleManipulator> m_truncatedTupleManipulators;
+
+	/** The manipulator used to interact with the tuples in the buffer. */
+	TupleManipulator m_tupleManipulator;
+
+	//#################### CONSTRUCTORS ####################
+protected:
+	/**
+	Constructs a page to contain tuples that can be manipulated by the specified manipulator.
+	The buffer for the page must be set separately by calling initialise().
+
+	\param tupleManipulator	The manipulator to be used to interact with tuples on the page.
+	*/
+	explicit SlottedSortedPage(const TupleManipulator& tupleManipulator);
+
+	//#################### PUBLIC STATIC METHODS ####################
+public:
+	/**
+	Calculates the buffer size (in bytes) needed for a page to be able to hold the specified number of tuples.
+
+	\param maxTupleCount	The number of tuples the page should be able to hold.
+	\param tupleManipulator	The manipulator to be used to interact with tuples on the page.
+	\return					The buffer size needed.
+	*/
+	static unsigned int buffer_size_for(unsigned int maxTupleCount, const TupleManipulator& tupleManipulator);
+
+	/**
+	Calculates the number of tuples that a page with a buffer of the specified size will be able to hold.
+
+	\param bufferSize		The buffer size (in bytes), which must be large enough to hold the page's tuple count.
+	\param tupleManipulator	The manipulator to be used to interact with tuples on the page.
+	\return					The maximum number of tuples the page will be able to hold.
+	*/
+	static unsigned int max_tuple_count_for(unsigned int bufferSize, const TupleManipulator& tupleManipulator);
+
+	//#################### PUBLIC INHERITED METHODS ####################
+public:
+	virtual void add_tuple(const Tuple& tuple);
+	virtual TupleSetCIter begin() const;
+	virtual unsigned int buffer_size() const;
+	virtual void clear();
+	virtual unsigned int empty_tuple_count() const;
+	virtual TupleSetCIter end() const;
+	virtual EqualRangeResult equal_range(const RangeKey& key) const;
+	virtual EqualRangeResult equal_range(const ValueKey& key) const;
+	virtual void erase_tuple(const BackedTuple& key);
+	virtual void erase_tuple(const TupleSetCIter& it);
+	virtual void erase_tuple(const TupleSetCRIter& rit);
+	virtual void erase_tuples(const TupleSetCIter& begin, const TupleSetCIter& end);
+	virtual const std::vector<const FieldManipulator*>& field_manipulators() const;
+	virtual TupleSetCIter find(const ValueKey& key) const;
+	virtual TupleSetCIter lower_bound(const RangeKey& key) const;
+	virtual TupleSetCIter lower_bound(const ValueKey& key) const;
+	virtual unsigned int max_tuple_count() const;
+	virtual double percentage_full() const;
+	virtual void prefetch() const;
+	virtual TupleSetCRIter rbegin() const;
+	virtual TupleSetCRIter rend() const;
+	virtual unsigned int tuple_count() const;
+	virtual char *tuple_location(unsigned int i) const;
+	virtual void tuple_locations(unsigned int begin, unsigned int end, const char **locations) const;
+	virtual const TupleManipulator& tuple_manipulator() const;
+	virtual const TupleManipulator& tuple_manipulator_at(unsigned int i) const;
+	virtual TupleSetCIter upper_bound(const RangeKey& key) const;
+	virtual TupleSetCIter upper_bound(const ValueKey& key) const;
+
+	//#################### PROTECTED METHODS ####################
+protected:
+	/**
+	Sets the buffer to be used by the page. If the buffer is fresh, it is formatted so that the page
+	contains no tuples; otherwise, it is assumed to already contain a page in the slotted format.
+
+	\param buffer					The buffer (which must remain valid for the lifetime of the page).
+	\param bufferSize				The size (in bytes) of the buffer.
+	\param fresh					Whether or not the buffer is fresh (and should thus be formatted).
+	\throw std::invalid_argument	If the buffer is too small to hold the page's tuple count, or if
+									it is not fresh and does not contain a valid page, or if the page
+									uses suffix truncation and either its tuples have fewer than two
+									fields, it also uses key prefixes, or the buffer is 16MB or more.
+	*/
+	void initialise(char *buffer, unsigned int bufferSize, bool fresh);
+
+	//#################### PRIVATE METHODS ####################
+private:
+	/**
+	Gets the location of the cell of the tuple at the specified position on a page that uses suffix truncation,
+	together with the number of key fields it contains. Since an optimistic reader may read a slot whilst it is
+	being changed, whatever is read is clamped so that the cell is always within the cell area of the buffer.
+
+	\param i			The position of the tuple on the page.
+	\param keyArity		Used to return the number of key fields in the cell.
+	\return				The location of the cell.
+	*/
+	char *cell_location(unsigned int i, unsigned int& keyArity) const;
+
+	/**
+	Gets the offset (in bytes) of the end of the cell area of a page that uses suffix truncation.
+
+	\return	The offset of the end of the cell area.
+	*/
+	unsigned int cells_end() const;
+
+	/**
+	Moves the cells of the tuples on a page that uses suffix truncation up against the end of the
+	buffer, so that the space taken by the cells of erased tuples can be reused.
+	*/
+	void compact_cells();
+
+	/**
+	Compares the tuple at the specified position on a page that uses suffix truncation with the specified key.
+	If the key is a search key, they are compared on the key fields that they share, except that a truncated
+	tuple whose key fields form a proper prefix of the key is ordered before it. If the key is itself a tuple
+	that could be stored on the page (e.g. one being added), the order is a total one: the tuples are compared
+	on the key fields that they share, then a tuple with fewer key fields is ordered before one with more, and
+	finally tuples with the same key fields are ordered by their last fields.
+
+	\param i			The position of the tuple on the page.
+	\param key			The key.
+	\param keyIsTuple	Whether the key is a tuple that could be stored on the page (true) or a search key (false).
+	\return				-1, if the tuple is ordered before the key;
+						1, if the tuple is ordered after the key;
+						0, otherwise.
+	*/
+	int compare_cell(unsigned int i, const Tuple& key, bool keyIsTuple) const;
+
+	/**
+	Compares the tuple at the specified position on the page with the specified key, using prefix comparison.
+
+	\param i		The position of the tuple on the page.
+	\param key		The key.
+	\return			-1, if the tuple is ordered before the key;
+					1, if the tuple is ordered after the key;
+					0, otherwise.
+	*/
+	int compare_tuple(unsigned int i, const Tuple& key) const;
+
+	/**
+	Erases the tuples at the specified range of positions on the page.
+
+	\param begin	The position of the first tuple to erase.
+	\param end		The position one beyond that of the last tuple to erase (in the range [begin,tuple_count()]).
+	*/
+	void erase_tuples_at(unsigned int begin, unsigned int end);
+
+	/**
+	Calculates the number of bytes in the buffer of a page that uses suffix truncation that are not being used
+	by its header, its slots or the cells of the tuples on it (including any taken by the cells of erased tuples).
+
+	\return	The number of free bytes.
+	*/
+	unsigned int free_bytes() const;
+
+	/**
+	Gets a pointer to the header of a page that uses suffix truncation (stored at the start of the buffer).
+
+	\return	A pointer to the header.
+	*/
+	unsigned int *header() const;
+
+	/**
+	Gets a pointer to the page's array of normalized key prefixes (stored in the buffer after the slot array).
+
+	\return	A pointer to the page's array of normalized key prefixes.
+	*/
+	unsigned int *key_prefixes() const;
+
+	/**
+	Finds the position of the first tuple on the page that is not ordered before the specified key.
+
+	\param key	The search key.
+	\return		The position of the first tuple that is not ordered before key, or tuple_count() if there is none.
+	*/
+	unsigned int lower_bound_index(const Tuple& key) const;
+
+	/**
+	Finds the position of the first tuple on the page that is not ordered before a search key.
+
+	\param comp			A comparator that compares the tuple at a given location with the search key
+						(returning -1, 0 or 1, in the manner of compare_tuple()).
+	\param keyPrefix	The normalized key prefix of the search key.
+	\return				The position of the first tuple that is not ordered before the key, or tuple_count() if there is none.
+	*/
+	template <typename Comp>
+	unsigned int lower_bound_index_with(const Comp& comp, const KeyPrefix& keyPrefix) const;
+
+	/**
+	Makes the normalized key prefix of a tuple or search key, as it would be stored on the page.
+
+	\param key	The tuple or search key.
+	\return		The normalized key prefix.
+	*/
+	KeyPrefix make_key_prefix(const Tuple& key) const;
+
+	/**
+	Gets a pointer to the page's slot array (stored in the buffer after the tuple cells or, if the page uses
+	suffix truncation, after the header).
+
+	\return	A pointer to the page's slot array.
+	*/
+	unsigned int *slots() const;
+
+	/**
+	Finds the position of the first tuple on a page that uses suffix truncation that is not ordered before
+	(or, optionally, that is ordered after) the specified key (see compare_cell).
+
+	\param key			The key.
+	\param keyIsTuple	Whether the key is a tuple that could be stored on the page (true) or a search key (false).
+	\param upper		Whether to find the first tuple that is ordered after the key (true), rather than the first
+						that is not ordered before it (false).
+	\return				The position of the tuple, or tuple_count() if there is none.
+	*/
+	unsigned int truncated_bound_index(const Tuple& key, bool keyIsTuple, bool upper) const;
+
+	/**
+	Gets a pointer to the page's tuple count (stored in the buffer after the slot array and any key prefixes or,
+	if the page uses suffix truncation, at the start of its header).
+
+	\return	A pointer to the page's tuple count.
+	*/
+	unsigned int *tuple_count_location() const;
+
+	/**
+	Finds the position of the first tuple on the page that is ordered after the specified key.
+
+	\param key	The search key.
+	\return		The position of the first tuple that is ordered after key, or tuple_count() if there is none.
+	*/
+	unsigned int upper_bound_index(const Tuple& key) const;
+
+	/**
+	Finds the position of the first tuple on the page that is ordered after a search key.
+
+	\param comp			A comparator that compares the tuple at a given location with the search key
+						(returning -1, 0 or 1, in the manner of compare_tuple()).
+	\param keyPrefix	The normalized key prefix of the search key.
+	\return				The position of the first tuple that is ordered after the key, or tuple_count() if there is none.
+	*/
+	template <typename Comp>
+	unsigned int upper_bound_index_with(const Comp& comp, const KeyPrefix& keyPrefix) const;
+
+	//#################### PRIVATE STATIC METHODS ####################
+private:
+	/**
+	Calculates the number of (4-byte) words in the normalized key prefix that a page stores for each slot.
+
+	\param tupleManipulator	The manipulator to be used to interact with tuples on the page.
+	\return					The number of words in each prefix (0 if the page does not use key prefixes).
+	*/
+	static unsigned int key_prefix_word_count(const TupleManipulator& tupleManipulator);
+
+	/**
+	Calculates the size (in bytes) of the cell that a page that uses suffix truncation stores for a tuple. Unlike
+	a tuple's own size, this is not padded to a maximum-alignment boundary, but only to the strictest alignment
+	of the fields of the page's (full-length) tuples, so that the cells can be packed together without leaving
+	any of their fields misaligned, and dropping even a single small key field makes a tuple's cell smaller.
+
+	\param truncatedManipulator	The manipulator for the tuple (see TupleManipulator::truncated).
+	\param tupleManipulator		The manipulator to be used to interact with tuples on the page.
+	\return						The size of the tuple's cell.
+	*/
+	static unsigned int truncated_cell_size(const TupleManipulator& truncatedManipulator, const TupleManipulator& tupleManipulator);
+
+	/**
+	Calculates the offset (in bytes) of the end of the cell area for a page that uses suffix truncation,
+	i.e. the size of its buffer rounded down to a maximum-alignment boundary.
+
+	\param bufferSize	The size (in bytes) of the buffer.
+	\return				The offset of the end of the cell area.
+	*/
+	static unsigned int truncated_cells_end(unsigned int bufferSize);
+};
+
+}
+
+#endif
@@ -6,9 +6,11 @@
 #ifndef H_WHERY_SORTEDPAGE
 #define H_WHERY_SORTEDPAGE
 
-#include <set>
+#include <cstddef>
+#include <iterator>
 #include <vector>
 
+#include <boost/optional.hpp>
 #include <boost/shared_ptr.hpp>
 
 #include "whery/db/base/BackedTuple.h"
@@ -26,14 +28,326 @@ class ValueKey;
 
 Pages of tuples are of a fixed size, and as such can hold a maximum number of tuples.
 When they are full, additional pages must be allocated.
+
+The tuples on a page are addressed by their (zero-based) position in the page's sorted
+order, and the page's iterators are defined in terms of these positions. As a result,
+adding a tuple to or erasing a tuple from a page invalidates any iterators that point
+to the same position or a later one.
 */
 class SortedPage
 {
+	//#################### NESTED CLASSES ####################
+private:
+	/**
+	\brief An instance of this class is a read-only view of a tuple on a page, which can be
+	re-pointed at other tuples on the same page without needing to be reconstructed.
+	*/
+	class PageTuple : public BackedTuple
+	{
+		//#################### CONSTRUCTORS ####################
+	public:
+		/**
+		Constructs a read-only view of the tuple at the specified location.
+
+		\param location		The location of the tuple in memory.
+		\param manipulator	The manipulator used to interact with the memory containing the tuple.
+		*/
+		PageTuple(char *location, const TupleManipulator& manipulator)
+		:	BackedTuple(location, manipulator)
+		{
+			make_read_only();
+		}
+
+		//#################### PUBLIC METHODS ####################
+	public:
+		/**
+		Re-points the view at the tuple at the specified location.
+
+		\param location		The location of the tuple in memory.
+		\param manipulator	The manipulator used to interact with the memory containing the tuple.
+		*/
+		void set_location(char *location, const TupleManipulator& manipulator)
+		{
+			m_location = location;
+			m_manipulator = manipulator;
+		}
+	};
+
+	/**
+	\brief An instance of this class provides the functionality that is common to both forward
+	and reverse iterators over the tuples on a page.
+	*/
+	class IteratorBase
+	{
+		//#################### PROTECTED VARIABLES ####################
+	protected:
+		/** The position used to identify the currently-pointed-to tuple (its exact meaning depends on the derived iterator). */
+		unsigned int m_index;
+
+		/** The page for which this is an iterator. */
+		const SortedPage *m_page;
+
+		/** A view of the currently-pointed-to tuple (made on demand, and re-pointed as the iterator moves). */
+		mutable boost::optional<PageTuple> m_tuple;
+
+		//#################### CONSTRUCTORS ####################
+	protected:
+		IteratorBase()
+		:	m_index(0), m_page(NULL)
+		{}
+
+		IteratorBase(const SortedPage *page, unsigned int index)
+		:	m_index(index), m_page(page)
+		{}
+
+		//#################### COPY CONSTRUCTOR & ASSIGNMENT OPERATOR ####################
+	protected:
+		IteratorBase(const IteratorBase& rhs)
+		:	m_index(rhs.m_index), m_page(rhs.m_page)
+		{
+			// Note that the tuple view is deliberately not copied: it will be made on demand if needed.
+		}
+
+		IteratorBase& operator=(const IteratorBase& rhs)
+		{
+			// The tuple view can be retained if the iterators refer to the same page, since it can simply be re-pointed.
+			if(m_page != rhs.m_page) m_tuple.reset();
+			m_index = rhs.m_index;
+			m_page = rhs.m_page;
+			return *this;
+		}
+
+		//#################### PROTECTED METHODS ####################
+	protected:
+		/**
+		Gets a view of the tuple at the specified position on the page that is owned by the iterator.
+
+		\param i	The position of the tuple on the page.
+		\return		A view of the tuple (which remains valid until the iterator is moved or destroyed).
+		*/
+		const BackedTuple& tuple_at(unsigned int i) const
+		{
+			char *location = m_page->tuple_location(i);
+			if(m_tuple) m_tuple->set_location(location, m_page->tuple_manipulator_at(i));
+			else m_tuple = PageTuple(location, m_page->tuple_manipulator_at(i));
+			return *m_tuple;
+		}
+
+		/**
+		Makes a free-standing read-only view of the tuple at the specified position on the page.
+
+		\param i	The position of the tuple on the page.
+		\return		A view of the tuple (which remains valid for as long as the tuple stays at that position).
+		*/
+		BackedTuple tuple_view(unsigned int i) const
+		{
+			return PageTuple(m_page->tuple_location(i), m_page->tuple_manipulator_at(i));
+		}
+	};
+
+public:
+	class ConstReverseIterator;
+
+	/**
+	\brief An instance of this class can be used to traverse the tuples on a page in ascending order.
+
+	The tuples themselves cannot be modified through this interface. Dereferencing an iterator yields a
+	read-only view of the tuple by value, which remains valid for as long as the tuple stays at the same
+	position on the page (like the iterator itself), so binding it to a const reference is safe. However,
+	the tuple pointed to by operator-> is a view owned by the iterator, so that pointer must not be retained
+	once the iterator has been moved or destroyed.
+	*/
+	class ConstIterator : private IteratorBase
+	{
+		//#################### FRIENDS ####################
+		friend class ConstReverseIterator;
+
+		//#################### TYPEDEFS ####################
+	public:
+		typedef std::bidirectional_iterator_tag iterator_category;
+		typedef std::ptrdiff_t difference_type;
+		typedef const BackedTuple *pointer;
+		typedef BackedTuple reference;
+		typedef BackedTuple value_type;
+
+		//#################### CONSTRUCTORS ####################
+	public:
+		/**
+		Constructs an invalid page iterator (it can be assigned something valid later).
+		*/
+		ConstIterator()
+		{}
+
+		/**
+		Constructs a page iterator.
+
+		\param page		The page for which this is an iterator.
+		\param index	The position of the initially-pointed-to tuple on the page.
+		*/
+		ConstIterator(const SortedPage *page, unsigned int index)
+		:	IteratorBase(page, index)
+		{}
+
+		//#################### PUBLIC OPERATORS ####################
+	public:
+		BackedTuple operator*() const
+		{
+			return tuple_view(m_index);
+		}
+
+		const BackedTuple *operator->() const
+		{
+			return &tuple_at(m_index);
+		}
+
+		bool operator==(const ConstIterator& rhs) const
+		{
+			return m_page == rhs.m_page && m_index == rhs.m_index;
+		}
+
+		bool operator!=(const ConstIterator& rhs) const
+		{
+			return !(*this == rhs);
+		}
+
+		ConstIterator& operator++()
+		{
+			++m_index;
+			return *this;
+		}
+
+		ConstIterator operator++(int)
+		{
+			ConstIterator result = *this;
+			++m_index;
+			return result;
+		}
+
+		ConstIterator& operator--()
+		{
+			--m_index;
+			return *this;
+		}
+
+		ConstIterator operator--(int)
+		{
+			ConstIterator result = *this;
+			--m_index;
+			return result;
+		}
+
+		//#################### PUBLIC METHODS ####################
+	public:
+		/**
+		Gets the position of the currently-pointed-to tuple on the page.
+
+		\return	The position of the currently-pointed-to tuple on the page.
+		*/
+		unsigned int index() const
+		{
+			return m_index;
+		}
+	};
+
+	/**
+	\brief An instance of this class can be used to traverse the tuples on a page in descending order.
+
+	As with std::reverse_iterator, a reverse iterator refers to the tuple immediately before the
+	position of its base iterator. Dereferencing it yields a view of the tuple by value, as for ConstIterator.
+	*/
+	class ConstReverseIterator : private IteratorBase
+	{
+		//#################### TYPEDEFS ####################
+	public:
+		typedef std::bidirectional_iterator_tag iterator_category;
+		typedef std::ptrdiff_t difference_type;
+		typedef const BackedTuple *pointer;
+		typedef BackedTuple reference;
+		typedef BackedTuple value_type;
+
+		//#################### CONSTRUCTORS ####################
+	public:
+		/**
+		Constructs an invalid page reverse iterator (it can be assigned something valid later).
+		*/
+		ConstReverseIterator()
+		{}
+
+		/**
+		Constructs a page reverse iterator that refers to the tuple immediately before the one
+		pointed to by the specified forward iterator.
+
+		\param it	The forward iterator.
+		*/
+		explicit ConstReverseIterator(const ConstIterator& it)
+		:	IteratorBase(it.m_page, it.m_index)
+		{}
+
+		//#################### PUBLIC OPERATORS ####################
+	public:
+		BackedTuple operator*() const
+		{
+			return tuple_view(m_index - 1);
+		}
+
+		const BackedTuple *operator->() const
+		{
+			return &tuple_at(m_index - 1);
+		}
+
+		bool operator==(const ConstReverseIterator& rhs) const
+		{
+			return m_page == rhs.m_page && m_index == rhs.m_index;
+		}
+
+		bool operator!=(const ConstReverseIterator& rhs) const
+		{
+			return !(*this == rhs);
+		}
+
+		ConstReverseIterator& operator++()
+		{
+			--m_index;
+			return *this;
+		}
+
+		ConstReverseIterator operator++(int)
+		{
+			ConstReverseIterator result = *this;
+			--m_index;
+			return result;
+		}
+
+		ConstReverseIterator& operator--()
+		{
+			++m_index;
+			return *this;
+		}
+
+		ConstReverseIterator operator--(int)
+		{
+			ConstReverseIterator result = *this;
+			++m_index;
+			return result;
+		}
+
+		//#################### PUBLIC METHODS ####################
+	public:
+		/**
+		Gets a forward iterator pointing to the tuple after the one referred to by this reverse iterator.
+
+		\return	The underlying forward iterator.
+		*/
+		ConstIterator base() const
+		{
+			return ConstIterator(m_page, m_index);
+		}
+	};
+
 	//#################### TYPEDEFS ####################
 public:
-	typedef std::multiset<BackedTuple,PrefixTupleComparator> TupleSet;
-	typedef TupleSet::const_iterator TupleSetCIter;
-	typedef TupleSet::const_reverse_iterator TupleSetCRIter;
+	typedef ConstIterator TupleSetCIter;
+	typedef ConstReverseIterator TupleSetCRIter;
 	typedef std::pair<TupleSetCIter,TupleSetCIter> EqualRangeResult;
 
 	//#################### DESTRUCTOR ####################
@@ -130,6 +444,15 @@ public:
 	*/
 	virtual void erase_tuple(const TupleSetCRIter& rit) = 0;
 
+	/**
+	Erases the tuples in the specified range from the page. Since the tuples in the range are
+	contiguous, this shifts the later tuples down over them just once, rather than once per tuple.
+
+	\param begin	An iterator pointing to the first tuple to erase.
+	\param end		An iterator pointing one beyond the last tuple to erase.
+	*/
+	virtual void erase_tuples(const TupleSetCIter& begin, const TupleSetCIter& end) = 0;
+
 	/**
 	Gets the manipulators for the fields of the tuples on the page.
 
@@ -203,6 +526,22 @@ public:
 	*/
 	virtual unsigned int tuple_count() const = 0;
 
+	/**
+	Gets the location in memory of the tuple at the specified position in the page's sorted order.
+	No bounds-checking is done for performance reasons.
+
+	\param i	The position of the tuple (in the range [0,tuple_count())).
+	\return		The location in memory of the tuple.
+	*/
+	virtual char *tuple_location(unsigned int i) const = 0;
+
+	/**
+	Gets the manipulator used to interact with the tuples on the page.
+
+	\return	The manipulator used to interact with the tuples on the page.
+	*/
+	virtual const TupleManipulator& tuple_manipulator() const = 0;
+
 	/**
 	Returns an iterator pointing one beyond the tuple at the higher end of the
 	range specified by key.
@@ -222,6 +561,111 @@ public:
 				after key, or end() if no tuples are ordered after key.
 	*/
 	virtual TupleSetCIter upper_bound(const ValueKey& key) const = 0;
+
+	//#################### PUBLIC METHODS ####################
+public:
+	/**
+	Determines whether or not the specified tuple could be added to the page, possibly after erasing some of the
+	tuples already on it. By default, this simply checks whether there would be an empty slot for it, but a page
+	whose capacity depends on the values it holds must override it to take account of the tuple's values.
+
+	A B+-tree only moves a tuple into a leaf (by an insertion, redistribution or merge) if this returns true. As a
+	result, an erasure may leave a leaf of such pages below its minimum, but only if it has no room for a tuple from
+	either sibling and cannot be merged with either of them, and it always keeps at least one tuple.
+
+	\param tuple		The tuple.
+	\param erasedCount	The number of tuples that will first be erased from the page.
+	\return				true, if the tuple could be added to the page, or false otherwise.
+	*/
+	virtual bool has_room_for(const Tuple& /*tuple*/, unsigned int erasedCount = 0) const
+	{
+		return empty_tuple_count() + erasedCount > 0;
+	}
+
+	/**
+	Determines whether or not the specified number of tuples from another page could be added to the page.
+	By default, this simply checks whether there are enough empty slots for them, but a page whose capacity
+	depends on the values it holds must override it to take account of the tuples' values (for which it may
+	conservatively assume that any of the source page's tuples could be among those added).
+
+	\param source	The page from which the tuples would be taken.
+	\param count	The number of tuples.
+	\return			true, if the tuples could be added to the page, or false otherwise.
+	*/
+	virtual bool has_room_for_tuples_from(const SortedPage& /*source*/, unsigned int count) const
+	{
+		return empty_tuple_count() >= count;
+	}
+
+	/**
+	Hints that the page is about to be searched, so that an implementation can start bringing
+	the parts of it that a search will read first into the cache. This lets the caller overlap
+	the cache misses for one page with useful work on another (e.g. when searching a B+-tree
+	for a batch of keys). By default, this does nothing.
+	*/
+	virtual void prefetch() const {}
+
+	/**
+	Decodes the values of the specified field of the tuples at a range of positions in the page's sorted order.
+	By default, this finds the tuples' locations a chunk at a time using tuple_locations, but an implementation
+	that stores the field's values contiguously should override it to read them directly. No bounds-checking
+	is done.
+
+	\param fieldIndex	The index of the field (which must be of a type that can be read as a double).
+	\param begin		The position of the first tuple.
+	\param end			The position one beyond the last tuple.
+	\param values		An array with room for end - begin values, into which to write them.
+	*/
+	virtual void read_doubles(unsigned int fieldIndex, unsigned int begin, unsigned int end, double *values) const;
+
+	/**
+	Decodes the values of the specified field of the tuples at a range of positions in the page's sorted order
+	(see read_doubles).
+
+	\param fieldIndex	The index of the field (which must be of a type that can be read as an int).
+	\param begin		The position of the first tuple.
+	\param end			The position one beyond the last tuple.
+	\param values		An array with room for end - begin values, into which to write them.
+	*/
+	virtual void read_ints(unsigned int fieldIndex, unsigned int begin, unsigned int end, int *values) const;
+
+	/**
+	Determines whether or not the page can safely be read from several threads at once (whilst it is not being
+	modified). This is true by default, but a page whose reads modify shared state (e.g. a cache) must override
+	it to return false.
+
+	\return	true, if the page can be read concurrently, or false otherwise.
+	*/
+	virtual bool supports_concurrent_reads() const { return true; }
+
+	/**
+	Gets the locations in memory of the tuples at a range of positions in the page's sorted order, so
+	that a caller can process a whole batch of tuples without making a virtual call for each of them.
+	By default, this calls tuple_location for each tuple in turn, but an implementation that can find
+	the locations more directly should override it. No bounds-checking is done.
+
+	\param begin		The position of the first tuple.
+	\param end			The position one beyond the last tuple.
+	\param locations	An array with room for end - begin locations, into which to write them.
+	*/
+	virtual void tuple_locations(unsigned int begin, unsigned int end, const char **locations) const
+	{
+		for(unsigned int i = begin; i < end; ++i) *locations++ = tuple_location(i);
+	}
+
+	/**
+	Gets the manipulator used to interact with the tuple at the specified position in the page's sorted order.
+	By default, this is simply tuple_manipulator(), but a page that stores some of its tuples with trailing
+	fields omitted (see TupleManipulator::set_uses_suffix_truncation) must override it to return a manipulator
+	for the fields that are actually stored. No bounds-checking is done.
+
+	\param i	The position of the tuple (in the range [0,tuple_count())).
+	\return		The manipulator used to interact with the tuple.
+	*/
+	virtual const TupleManipulator& tuple_manipulator_at(unsigned int /*i*/) const
+	{
+		return tuple_manipulator();
+	}
 };
 
 typedef boost::shared_ptr<SortedPage> SortedPage_Ptr;
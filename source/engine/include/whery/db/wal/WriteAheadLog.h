@@ -0,0 +1,259 @@
+/**
+ * whery: WriteAheadLog.h
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#ifndef H_WHERY_WRITEAHEADLOG
+#define H_WHERY_WRITEAHEADLOG
+
+#include <string>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include "whery/util/BinaryFile.h"
+
+namespace whery {
+
+/**
+\brief An instance of this class represents an append-only log of records, each of which consists
+of a type and an arbitrary payload, and is identified by a log sequence number (LSN).
+
+Appending a record just adds it to an in-memory buffer; it is written to the log file (and, if
+necessary, synced to disk) when it is committed. Commits are grouped: if several threads commit
+at once, a single thread writes out all of their records and syncs the file for all of them, and
+the others simply wait for it to finish. In addition, the log can be told to sync only once every
+few commits, which trades the durability of the most recent commits (in the event of a machine
+crash, rather than a process crash) for throughput.
+
+The log file starts with a header recording the LSN of the last record discarded by reset(), which
+is followed by the records themselves. Each record is stored with its LSN, its size and a checksum,
+so that a torn record at the end of the file (e.g. after a crash in mid-write) can be detected and
+discarded when the log is reopened.
+
+If writing to or syncing the log file fails, the log is poisoned, and every subsequent append, commit,
+sync or reset throws. The sync is not retried, because after a failed sync the kernel may already have
+dropped the unwritten pages, so a retry could appear to succeed even though the records were never
+written. In particular, the records up to durable_lsn() are still durable, but the state of everything
+after them in the file is unknown, so the log must be reopened (which discards any torn records at the
+end of the file) before it can be used again. Once everything in the log has been made durable elsewhere
+(e.g. by a checkpoint), its records can be discarded by calling reset(), which truncates the file
+but preserves the sequence of LSNs. If only the records up to a given LSN have been made durable elsewhere
+(e.g. by a checkpoint taken whilst further records were being appended), they can instead be discarded by
+calling discard_through(), which replaces the file with a fresh one containing just the later records.
+*/
+class WriteAheadLog
+{
+	//#################### TYPEDEFS ####################
+public:
+	typedef boost::uint64_t LSN;
+
+	//#################### NESTED CLASSES ####################
+public:
+	/**
+	\brief An instance of this struct represents a record read back from the log.
+	*/
+	struct Record
+	{
+		/** The log sequence number of the record. */
+		LSN lsn;
+
+		/** The payload of the record. */
+		std::vector<char> payload;
+
+		/** The type of the record (whose meaning is up to the client). */
+		unsigned char type;
+	};
+
+	//#################### PRIVATE VARIABLES ####################
+private:
+	/** The records that have been appended but not yet handed to a thread to write to the file. */
+	std::vector<char> m_buffer;
+
+	/** The number of commits since the log was last synced. */
+	unsigned int m_commitsSinceSync;
+
+	/** Whether or not a write to (or sync of) the log file has failed, in which case the log can no longer be used. */
+	bool m_failed;
+
+	/** The LSN up to which (inclusive) the records in the log are known to have been synced to disk. */
+	LSN m_durableLSN;
+
+	/** The log file. */
+	BinaryFile m_file;
+
+	/** Whether or not a thread is currently writing to (or syncing) the log file. */
+	bool m_fileBusy;
+
+	/** A condition variable used to wait for the log file to stop being busy. */
+	mutable boost::condition_variable m_fileIdle;
+
+	/** The name of the log file. */
+	std::string m_filename;
+
+	/** The LSN of the most recently appended record (or one less than the LSN of the first record, if there are none). */
+	LSN m_lastLSN;
+
+	/** The mutex protecting the state of the log. */
+	mutable boost::mutex m_mutex;
+
+	/** The number of times the log file has been synced to disk. */
+	boost::uint64_t m_syncCount;
+
+	/** The number of commits that are grouped together before the log file is synced. */
+	unsigned int m_syncInterval;
+
+	/** A spare buffer, which is swapped with m_buffer when its records are written to the file (so as to reuse its capacity). */
+	std::vector<char> m_writeBuffer;
+
+	/** The LSN up to which (inclusive) the records in the log have been written to the file (but not necessarily synced). */
+	LSN m_writtenLSN;
+
+	//#################### CONSTRUCTORS ####################
+public:
+	/**
+	Opens the log stored in the specified file, creating it if it does not already exist. If the file
+	ends with a torn or corrupt record, that record (and anything after it) is discarded.
+
+	\param filename					The name of the log file.
+	\param syncInterval				The number of commits to group together before syncing the log file. If this
+									is 1, every commit is durable by the time commit() returns; if it is n > 1,
+									up to n - 1 of the most recent commits may be lost in a machine crash.
+	\throw std::invalid_argument	If syncInterval is zero.
+	\throw std::runtime_error		If the file cannot be opened, or is not a valid log file.
+	*/
+	explicit WriteAheadLog(const std::string& filename, unsigned int syncInterval = 1);
+
+	//#################### DESTRUCTOR ####################
+public:
+	/**
+	Writes out and syncs any committed records that are not yet durable, and closes the log file.
+	*/
+	~WriteAheadLog();
+
+	//#################### COPY CONSTRUCTOR & ASSIGNMENT OPERATOR ####################
+private:
+	/** Private and unimplemented - logs cannot be copied. */
+	WriteAheadLog(const WriteAheadLog&);
+	WriteAheadLog& operator=(const WriteAheadLog&);
+
+	//#################### PUBLIC METHODS ####################
+public:
+	/**
+	Appends a record to the log. The record is not written to the file until it (or a later record) is committed.
+
+	\param type					The type of the record.
+	\param payload				A pointer to the payload of the record.
+	\param size					The size (in bytes) of the payload.
+	\return						The LSN of the record.
+	\throw std::runtime_error	If the log has been poisoned by an earlier failure to write to it.
+	*/
+	LSN append(unsigned char type, const char *payload, size_t size);
+
+	/**
+	Commits all of the records up to (and including) the specified one, writing them to the log file and
+	syncing it (if this is the last of a group of commits) before returning.
+
+	\param lsn					The LSN of the last record to commit.
+	\throw std::runtime_error	If the log file cannot be written or synced (in which case the log is poisoned),
+								or if the log has already been poisoned.
+	*/
+	void commit(LSN lsn);
+
+	/**
+	Discards the records in the log up to (and including) the specified one, keeping any later ones. The records
+	that are kept are written to a fresh log file, which then atomically replaces the existing one, so a crash at
+	any point leaves a log file that contains them. Unlike reset(), this can be called at the same time as append()
+	and commit(): records can still be appended whilst the fresh file is written, and are written to it once it has
+	replaced the existing one. This should only be called once the discarded records have been made durable elsewhere.
+
+	\param lsn						The LSN of the last record to discard.
+	\throw std::invalid_argument	If the record is not yet durable.
+	\throw std::runtime_error		If the fresh log file cannot be written (in which case the existing one is left
+									in place), or cannot be switched over to once it has replaced the existing one
+									(in which case the log is poisoned), or if the log has already been poisoned.
+	*/
+	void discard_through(LSN lsn);
+
+	/**
+	Gets the LSN up to which (inclusive) the records in the log are known to be durable.
+
+	\return	The LSN up to which the records in the log are known to be durable.
+	*/
+	LSN durable_lsn() const;
+
+	/**
+	Gets the LSN of the most recently appended record.
+
+	\return	The LSN of the most recently appended record, or one less than the LSN
+			that the next record will be given if there are none.
+	*/
+	LSN last_lsn() const;
+
+	/**
+	Reads all of the valid records in the log file (in LSN order). This is intended to be used for
+	recovery, before anything else has been appended to the log.
+
+	\return						The records.
+	\throw std::runtime_error	If the log file cannot be read.
+	*/
+	std::vector<Record> read_records() const;
+
+	/**
+	Discards all of the records in the log (including any that have been appended but not yet committed),
+	truncating the log file. The next record to be appended will be given the next LSN in sequence. This
+	should only be called once everything in the log has been made durable elsewhere, and must not be
+	called at the same time as append().
+
+	\throw std::runtime_error	If the log file cannot be truncated (in which case the log is poisoned),
+								or if the log has already been poisoned.
+	*/
+	void reset();
+
+	/**
+	Writes out and syncs all of the records that have been appended to the log so far.
+
+	\throw std::runtime_error	If the log file cannot be written or synced (in which case the log is poisoned),
+								or if the log has already been poisoned.
+	*/
+	void sync();
+
+	/**
+	Gets the number of times the log file has been synced to disk.
+
+	\return	The number of times the log file has been synced to disk.
+	*/
+	boost::uint64_t sync_count() const;
+
+	//#################### PRIVATE METHODS ####################
+private:
+	/**
+	Checks that the log has not been poisoned by an earlier failure to write to it.
+	This must be called with the log's mutex held.
+
+	\throw std::runtime_error	If the log has been poisoned.
+	*/
+	void check_not_failed() const;
+
+	/**
+	Writes the records up to (at least) the specified one to the log file, and syncs it if requested.
+	If another thread is already writing to the file, this waits for it to finish first, and returns
+	straight away if that thread has already done everything required.
+
+	\param lock					A lock on the log's mutex (which is released whilst writing to the file).
+	\param lsn					The LSN of the last record to write.
+	\param syncFile				Whether or not to sync the file once the records have been written.
+	\throw std::runtime_error	If the log file cannot be written or synced (in which case the log is poisoned),
+								or if the log has already been poisoned.
+	*/
+	void write_through(boost::unique_lock<boost::mutex>& lock, LSN lsn, bool syncFile);
+};
+
+typedef boost::shared_ptr<WriteAheadLog> WriteAheadLog_Ptr;
+
+}
+
+#endif
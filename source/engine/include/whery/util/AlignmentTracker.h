@@ -16,6 +16,20 @@ This is important in order to ensure that all such objects are suitably-aligned.
 */
 class AlignmentTracker
 {
+	//#################### NESTED CLASSES ####################
+public:
+	/**
+	\brief The size of this union is used as the maximum alignment (in bytes) required for any data type.
+
+	Note: This is an egregious hack - I feel slightly unclean.
+	*/
+	union MaxAlignmentHelper
+	{
+		long double ld;
+		long long ll;
+		void *vp;
+	};
+
 	//#################### PRIVATE VARIABLES ####################
 private:
 	/** The number of bytes we have advanced from a maximum-alignment boundary. */
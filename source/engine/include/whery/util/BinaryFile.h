@@ -0,0 +1,111 @@
+/**
+ * whery: BinaryFile.h
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#ifndef H_WHERY_BINARYFILE
+#define H_WHERY_BINARYFILE
+
+#include <cstddef>
+#include <string>
+
+#include <boost/cstdint.hpp>
+
+namespace whery {
+
+/**
+\brief An instance of this class provides unbuffered, writable access to a binary file, including
+the ability to sync it to disk (which the standard streams lack).
+*/
+class BinaryFile
+{
+	//#################### PRIVATE VARIABLES ####################
+private:
+	/** The descriptor of the file. */
+	int m_fd;
+
+	/** The name of the file. */
+	std::string m_filename;
+
+	//#################### CONSTRUCTORS ####################
+public:
+	/**
+	Opens the specified file for reading and writing, creating it if it does not exist. The
+	file position starts at the beginning of the file.
+
+	\param filename				The name of the file.
+	\param truncate				Whether or not to truncate the file if it already exists.
+	\throw std::runtime_error	If the file cannot be opened.
+	*/
+	explicit BinaryFile(const std::string& filename, bool truncate = false);
+
+	//#################### DESTRUCTOR ####################
+public:
+	/**
+	Closes the file (without syncing it).
+	*/
+	~BinaryFile();
+
+	//#################### COPY CONSTRUCTOR & ASSIGNMENT OPERATOR ####################
+private:
+	/** Private and unimplemented - files cannot be copied. */
+	BinaryFile(const BinaryFile&);
+	BinaryFile& operator=(const BinaryFile&);
+
+	//#################### PUBLIC STATIC METHODS ####################
+public:
+	/**
+	Syncs the directory containing the specified file to disk, so that a file that has just been
+	created or renamed there will still be found after a crash. (This does nothing on platforms on
+	which directory entries are made durable with the files themselves.)
+
+	\param filename				The name of the file.
+	\throw std::runtime_error	If the directory cannot be synced.
+	*/
+	static void sync_directory_of(const std::string& filename);
+
+	//#################### PUBLIC METHODS ####################
+public:
+	/**
+	Moves the file position to the specified offset from the start of the file.
+
+	\param offset				The offset (in bytes).
+	\throw std::runtime_error	If the file position cannot be moved.
+	*/
+	void seek(boost::uint64_t offset);
+
+	/**
+	Swaps this file with another one (e.g. to switch over to a file that has just replaced the one open).
+
+	\param rhs	The other file.
+	*/
+	void swap(BinaryFile& rhs);
+
+	/**
+	Syncs the contents of the file to disk.
+
+	\throw std::runtime_error	If the file cannot be synced.
+	*/
+	void sync();
+
+	/**
+	Truncates (or extends) the file to the specified size. The file position is left unchanged.
+
+	\param size					The new size of the file (in bytes).
+	\throw std::runtime_error	If the file cannot be resized.
+	*/
+	void truncate(boost::uint64_t size);
+
+	/**
+	Writes the specified data to the file at the current file position, advancing the position past it.
+
+	\param data					A pointer to the data.
+	\param size					The size of the data (in bytes).
+	\throw std::runtime_error	If the data cannot be written.
+	*/
+	void write(const char *data, size_t size);
+};
+
+}
+
+#endif
@@ -0,0 +1,99 @@
+/**
+ * whery: BitPacking.h
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#ifndef H_WHERY_BITPACKING
+#define H_WHERY_BITPACKING
+
+#include "SimdSearch.h"
+
+namespace whery {
+
+//#################### GLOBAL FUNCTIONS ####################
+
+/**
+Moves a range of the ints in an array of ints that was packed by pack_ints to another position in the array,
+without unpacking them (so that the base relative to which they were packed does not matter). As for memmove,
+the source and destination ranges may overlap.
+
+\param packed	The packed array.
+\param begin	The index of the first int to move.
+\param end		The index one beyond that of the last int to move.
+\param dest		The index to which to move the first int.
+\param bitWidth	The number of bits used to store each int.
+*/
+void move_packed_ints(char *packed, unsigned int begin, unsigned int end, unsigned int dest, unsigned int bitWidth);
+
+/**
+Calculates the number of bits needed to pack ints relative to a base (a scheme known as frame-of-reference
+encoding), given the difference between the largest and smallest of them.
+
+\param range	The difference between the largest int and the base (as an unsigned value, so that it cannot overflow).
+\return			The number of bits needed to store each int's offset from the base (in the range [0,32]).
+*/
+unsigned int packed_bit_width(unsigned int range);
+
+/**
+Calculates the number of bytes needed to pack the specified number of ints at the specified bit width.
+This includes a few bytes of padding at the end, so that the ints can be unpacked using whole-word loads.
+
+\param count	The number of ints.
+\param bitWidth	The number of bits used to store each int.
+\return			The number of bytes needed.
+*/
+unsigned int packed_size(unsigned int count, unsigned int bitWidth);
+
+/**
+Packs an array of ints by storing each one's offset from a base in a fixed number of bits.
+The i'th offset is stored in bits [i * bitWidth, (i+1) * bitWidth) of the packed array.
+
+\param values	The ints, each of which must be in the range [base, base + 2^bitWidth).
+\param count	The number of ints.
+\param base		The base relative to which to store the ints (usually the smallest of them).
+\param bitWidth	The number of bits to use to store each int.
+\param packed	An array of packed_size(count, bitWidth) bytes, into which to pack the ints.
+*/
+void pack_ints(const int *values, unsigned int count, int base, unsigned int bitWidth, char *packed);
+
+/**
+Packs a single int into an array of ints that was packed by pack_ints, replacing the int previously stored at that index.
+
+\param packed	The packed array.
+\param i		The index at which to store the int.
+\param base		The base relative to which the ints were packed.
+\param bitWidth	The number of bits used to store each int.
+\param value	The int, which must be in the range [base, base + 2^bitWidth).
+*/
+void pack_int(char *packed, unsigned int i, int base, unsigned int bitWidth, int value);
+
+/**
+Unpacks a single int from an array of ints that was packed by pack_ints.
+
+\param packed	The packed array.
+\param i		The index of the int to unpack.
+\param base		The base relative to which the ints were packed.
+\param bitWidth	The number of bits used to store each int.
+\return			The int.
+*/
+int unpack_int(const char *packed, unsigned int i, int base, unsigned int bitWidth);
+
+/**
+Unpacks a range of ints from an array of ints that was packed by pack_ints. Blocks of eight ints are
+unpacked at a time using AVX2 (if available and the bit width is at most 25, so that each int can be
+extracted from a single 32-bit load); the remaining ints are unpacked one at a time.
+
+\param packed	The packed array.
+\param begin	The index of the first int to unpack.
+\param end		The index one beyond that of the last int to unpack.
+\param base		The base relative to which the ints were packed.
+\param bitWidth	The number of bits used to store each int.
+\param values	An array with room for end - begin ints, into which to unpack them.
+\param level	The instruction set to use (this is clamped to best_simd_level()).
+*/
+void unpack_ints(const char *packed, unsigned int begin, unsigned int end, int base, unsigned int bitWidth, int *values,
+				 SimdLevel level = best_simd_level());
+
+}
+
+#endif
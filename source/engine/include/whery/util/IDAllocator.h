@@ -6,7 +6,7 @@
 #ifndef H_WHERY_IDALLOCATOR
 #define H_WHERY_IDALLOCATOR
 
-#include <set>
+#include <vector>
 
 namespace whery {
 
@@ -14,16 +14,25 @@ namespace whery {
 \brief An instance of this class is used to manage the allocation of unique integer IDs.
 
 This is useful in a variety of contexts, e.g. allocating IDs to pages in a cache.
+
+The IDs in use are recorded in a dense bitmap, and the IDs that have been deallocated are kept
+in a min-heap, so that the smallest one is always reused first (this keeps the IDs compact).
+The bitmap ends at the largest ID in use, so deallocating that ID also frees up any unused IDs
+immediately below it: these are not reused from the heap, but are allocated afresh later.
 */
 class IDAllocator
 {
 	//#################### PRIVATE VARIABLES ####################
 private:
-	/** A free list of IDs that have been deallocated - these can be reallocated by allocate(). */
-	std::set<int> m_free;
+	/**
+	A min-heap of IDs that have been deallocated - these can be reallocated by allocate(). The heap may also
+	contain stale entries for IDs that have since been reallocated or trimmed from the end of the bitmap (and
+	may contain duplicates as a result), but these are cheap to recognise and are discarded when they surface.
+	*/
+	std::vector<int> m_free;
 
-	/** The set of IDs that are currently in use. */
-	std::set<int> m_used;
+	/** A bitmap specifying which of the IDs in [0,m_used.size()) are currently in use (the last one always is). */
+	std::vector<bool> m_used;
 
 	//#################### PUBLIC METHODS ####################
 public:
@@ -43,18 +52,17 @@ public:
 	void deallocate(int n);
 
 	/**
-	Resets the ID allocator (equivalent to deallocating all allocated IDs).
+	Reserves enough space for IDs in the range [0,n) to be allocated without any further memory allocation
+	(e.g. before a bulk load that is known to need a certain number of IDs).
+
+	\param n	The number of IDs for which to reserve space.
 	*/
-	void reset();
+	void reserve(unsigned int n);
 
-	//#################### PRIVATE METHODS ####################
-private:
 	/**
-	Gets the maximum ID currently in use.
-
-	\return	The maximum ID currently in use, if any, or -1 otherwise.
+	Resets the ID allocator (equivalent to deallocating all allocated IDs).
 	*/
-	int max_used() const;
+	void reset();
 };
 
 }
@@ -0,0 +1,111 @@
+/**
+ * whery: Interner.h
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#ifndef H_WHERY_INTERNER
+#define H_WHERY_INTERNER
+
+#include <algorithm>
+#include <set>
+#include <vector>
+
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
+
+namespace whery {
+
+/**
+\brief An instance of an instantiation of this class template holds a single shared copy of each of a set of values,
+so that equal values can be represented by the same pointer for the rest of the program.
+
+The shared copies are held in a global set that is protected by a mutex. However, each thread also keeps its own
+cache of pointers to the copies that it has already looked up, so that once a thread has seen a value, interning
+it again (e.g. whenever a key with a familiar schema is constructed) does not take the mutex. The copies are never
+removed, and since the elements of a std::set never move, the pointers remain valid for as long as the interner exists.
+
+Values are compared using operator<, which only needs to compare the properties that define a value: any properties
+derived from them can be filled in by the caller before calling intern() when lookup() fails to find the value. Since
+lookup() also accepts a non-owning view of a value, a caller can check whether a value has already been interned without
+first having to build (and allocate) a copy of it.
+*/
+template <typename T>
+class Interner
+{
+	//#################### NESTED TYPES ####################
+private:
+	/**
+	\brief An instance of this struct orders pointers to values relative to the values (or lookup keys) they are compared with.
+	*/
+	struct IndirectLess
+	{
+		template <typename K>
+		bool operator()(const T *lhs, const K& rhs) const
+		{
+			return *lhs < rhs;
+		}
+	};
+
+	typedef std::vector<const T*> Cache;
+
+	//#################### PRIVATE VARIABLES ####################
+private:
+	/** The per-thread caches of pointers to the shared copies of the values (each sorted by the values to which they point). */
+	boost::thread_specific_ptr<Cache> m_caches;
+
+	/** The mutex protecting the shared copies of the values. */
+	boost::mutex m_mutex;
+
+	/** The shared copies of the values. */
+	std::set<T> m_values;
+
+	//#################### PUBLIC METHODS ####################
+public:
+	/**
+	Gets the shared copy of the specified value, creating it if necessary.
+
+	\param value	The value.
+	\return			The shared copy of the value.
+	*/
+	const T *intern(const T& value)
+	{
+		const T *interned = lookup(value);
+		if(interned) return interned;
+
+		{
+			boost::lock_guard<boost::mutex> lock(m_mutex);
+			interned = &*m_values.insert(value).first;
+		}
+
+		Cache *cache = m_caches.get();
+		cache->insert(std::lower_bound(cache->begin(), cache->end(), value, IndirectLess()), interned);
+		return interned;
+	}
+
+	/**
+	Looks up the shared copy of the value equivalent to the specified key in the calling thread's cache, without taking
+	the mutex. The key can be either a value or a lightweight view of one (e.g. one that refers to the caller's data rather
+	than owning a copy of it), provided that it can be compared with a value in both directions using operator<.
+
+	\param key	The key.
+	\return		The shared copy of the value, if the calling thread has interned it before, or NULL otherwise.
+	*/
+	template <typename K>
+	const T *lookup(const K& key)
+	{
+		Cache *cache = m_caches.get();
+		if(!cache)
+		{
+			cache = new Cache;
+			m_caches.reset(cache);
+		}
+
+		typename Cache::const_iterator it = std::lower_bound(cache->begin(), cache->end(), key, IndirectLess());
+		return it != cache->end() && !(key < **it) ? *it : NULL;
+	}
+};
+
+}
+
+#endif
@@ -0,0 +1,160 @@
+/**
+ * whery: LatencyHistogram.h
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#ifndef H_WHERY_LATENCYHISTOGRAM
+#define H_WHERY_LATENCYHISTOGRAM
+
+#include <cstddef>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+
+namespace whery {
+
+/**
+\brief An instance of this class represents a histogram of latencies (e.g. in nanoseconds).
+
+The buckets are log-linear, in the manner of an HDR histogram: values below SUB_BUCKET_COUNT
+each have a bucket of their own, and each power-of-two range [2^e,2^(e+1)) above that is
+divided into SUB_BUCKET_COUNT equally-sized buckets. Any recorded value can thus be recovered
+to within a relative error of 1/SUB_BUCKET_COUNT, using a fixed number of buckets that cover
+the whole range of a 64-bit integer.
+*/
+class LatencyHistogram
+{
+	//#################### ENUMERATIONS ####################
+public:
+	enum
+	{
+		/** The base-2 logarithm of the number of buckets into which each power-of-two range is divided. */
+		SUB_BUCKET_BITS = 4,
+
+		/** The number of buckets into which each power-of-two range is divided. */
+		SUB_BUCKET_COUNT = 1 << SUB_BUCKET_BITS,
+
+		/** The total number of buckets in a histogram. */
+		BUCKET_COUNT = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKET_COUNT
+	};
+
+	//#################### PRIVATE VARIABLES ####################
+private:
+	/** The number of values recorded in each bucket. */
+	std::vector<boost::uint64_t> m_bucketCounts;
+
+	/** The total number of values recorded. */
+	boost::uint64_t m_count;
+
+	/** The largest value recorded (or 0 if there are none). */
+	boost::uint64_t m_max;
+
+	/** The smallest value recorded (or 0 if there are none). */
+	boost::uint64_t m_min;
+
+	/** The sum of the values recorded. */
+	boost::uint64_t m_sum;
+
+	//#################### CONSTRUCTORS ####################
+public:
+	/**
+	Constructs an empty histogram.
+	*/
+	LatencyHistogram();
+
+	/**
+	Constructs a histogram from the raw bucket counts and summary values of one that has
+	already been recorded (e.g. by a set of atomic counters).
+
+	\param bucketCounts				The number of values recorded in each bucket.
+	\param min						The smallest value recorded (ignored if there are none).
+	\param max						The largest value recorded (ignored if there are none).
+	\param sum						The sum of the values recorded.
+	\throw std::invalid_argument	If bucketCounts does not contain exactly BUCKET_COUNT counts.
+	*/
+	LatencyHistogram(const std::vector<boost::uint64_t>& bucketCounts, boost::uint64_t min, boost::uint64_t max, boost::uint64_t sum);
+
+	//#################### PUBLIC STATIC METHODS ####################
+public:
+	/**
+	Gets the index of the bucket into which the specified value falls.
+
+	\param value	The value.
+	\return			The index of the bucket (in the range [0,BUCKET_COUNT)).
+	*/
+	static size_t bucket_for(boost::uint64_t value);
+
+	/**
+	Gets the largest value that falls into the specified bucket.
+
+	\param bucket	The index of the bucket.
+	\return			The largest value that falls into the bucket.
+	*/
+	static boost::uint64_t bucket_highest(size_t bucket);
+
+	/**
+	Gets the smallest value that falls into the specified bucket.
+
+	\param bucket	The index of the bucket.
+	\return			The smallest value that falls into the bucket.
+	*/
+	static boost::uint64_t bucket_lowest(size_t bucket);
+
+	//#################### PUBLIC METHODS ####################
+public:
+	/**
+	Gets the total number of values recorded.
+
+	\return	The total number of values recorded.
+	*/
+	boost::uint64_t count() const;
+
+	/**
+	Gets the largest value recorded.
+
+	\return	The largest value recorded, or 0 if there are none.
+	*/
+	boost::uint64_t max() const;
+
+	/**
+	Gets the mean of the values recorded.
+
+	\return	The mean of the values recorded, or 0 if there are none.
+	*/
+	double mean() const;
+
+	/**
+	Adds all of the values recorded in another histogram to this one.
+
+	\param rhs	The other histogram.
+	*/
+	void merge(const LatencyHistogram& rhs);
+
+	/**
+	Gets the smallest value recorded.
+
+	\return	The smallest value recorded, or 0 if there are none.
+	*/
+	boost::uint64_t min() const;
+
+	/**
+	Gets (an upper estimate of) the specified percentile of the values recorded, i.e. the
+	largest value in the bucket containing the value at that rank (capped at max()).
+
+	\param p						The percentile (in the range [0,100]).
+	\return							The percentile, or 0 if there are no values.
+	\throw std::invalid_argument	If p is not in the range [0,100].
+	*/
+	boost::uint64_t percentile(double p) const;
+
+	/**
+	Records a value in the histogram.
+
+	\param value	The value.
+	*/
+	void record(boost::uint64_t value);
+};
+
+}
+
+#endif
@@ -0,0 +1,156 @@
+/**
+ * whery: SegmentedArray.h
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#ifndef H_WHERY_SEGMENTEDARRAY
+#define H_WHERY_SEGMENTEDARRAY
+
+#include <cassert>
+#include <cstddef>
+
+namespace whery {
+
+/**
+\brief An instance of an instantiation of this class template represents a growable array whose elements never move.
+
+The elements are stored in a fixed number of segments, each twice the size of the one before it, which are
+allocated on demand as the array grows. Unlike std::vector, growing the array never reallocates the existing
+elements, so references to them remain valid for as long as the array exists, and elements that have already
+been published to other threads can safely be accessed whilst the array is growing.
+*/
+template <typename T>
+class SegmentedArray
+{
+	//#################### ENUMERATIONS ####################
+private:
+	enum
+	{
+		/** The base-2 logarithm of the size of the first segment. */
+		FIRST_SEGMENT_BITS = 6,
+
+		/** The size of the first segment. */
+		FIRST_SEGMENT_SIZE = 1 << FIRST_SEGMENT_BITS,
+
+		/** The maximum number of segments (enough for just under 2^32 elements). */
+		MAX_SEGMENTS = 32 - FIRST_SEGMENT_BITS
+	};
+
+	//#################### PRIVATE VARIABLES ####################
+private:
+	/** The segments of the array (any segments that have not yet been allocated are NULL). */
+	T *m_segments[MAX_SEGMENTS];
+
+	/** The number of elements in the array. */
+	size_t m_size;
+
+	//#################### CONSTRUCTORS ####################
+public:
+	/**
+	Constructs an empty segmented array.
+	*/
+	SegmentedArray()
+	:	m_size(0)
+	{
+		for(int i = 0; i < MAX_SEGMENTS; ++i) m_segments[i] = NULL;
+	}
+
+	//#################### DESTRUCTOR ####################
+public:
+	/**
+	Destroys the segmented array.
+	*/
+	~SegmentedArray()
+	{
+		for(int i = 0; i < MAX_SEGMENTS; ++i) delete[] m_segments[i];
+	}
+
+	//#################### COPY CONSTRUCTOR & ASSIGNMENT OPERATOR ####################
+private:
+	/** Private and unimplemented - segmented arrays are not intended to be copied. */
+	SegmentedArray(const SegmentedArray&);
+	SegmentedArray& operator=(const SegmentedArray&);
+
+	//#################### PUBLIC OPERATORS ####################
+public:
+	/**
+	Returns the element with the specified index.
+
+	\param i	The index of the element (must be less than size()).
+	\return		The element.
+	*/
+	T& operator[](size_t i)
+	{
+		assert(i < m_size);
+		size_t j = i + FIRST_SEGMENT_SIZE;
+		unsigned int bit = highest_bit(j);
+		return m_segments[bit - FIRST_SEGMENT_BITS][j - (static_cast<size_t>(1) << bit)];
+	}
+
+	/**
+	Returns the element with the specified index.
+
+	\param i	The index of the element (must be less than size()).
+	\return		The element.
+	*/
+	const T& operator[](size_t i) const
+	{
+		return const_cast<SegmentedArray&>(*this)[i];
+	}
+
+	//#################### PUBLIC METHODS ####################
+public:
+	/**
+	Grows the array to the specified size. Any new elements are default-constructed.
+
+	\param size	The new size of the array (must be at least the current size).
+	*/
+	void resize(size_t size)
+	{
+		assert(size >= m_size);
+		if(size == 0) return;
+
+		const unsigned int lastSegment = highest_bit(size - 1 + FIRST_SEGMENT_SIZE) - FIRST_SEGMENT_BITS;
+		assert(lastSegment < MAX_SEGMENTS);
+		for(unsigned int k = 0; k <= lastSegment; ++k)
+		{
+			if(m_segments[k] == NULL) m_segments[k] = new T[FIRST_SEGMENT_SIZE << k];
+		}
+
+		m_size = size;
+	}
+
+	/**
+	Returns the number of elements in the array.
+
+	\return	The number of elements in the array.
+	*/
+	size_t size() const
+	{
+		return m_size;
+	}
+
+	//#################### PRIVATE STATIC METHODS ####################
+private:
+	/**
+	Returns the index of the highest set bit in a (non-zero) integer.
+
+	\param n	The integer.
+	\return		The index of the highest set bit in n.
+	*/
+	static unsigned int highest_bit(size_t n)
+	{
+		assert(n != 0);
+#if defined(__GNUC__)
+		return static_cast<unsigned int>(sizeof(unsigned long) * 8 - 1 - __builtin_clzl(n));
+#else
+		unsigned int bit = 0;
+		while(n >>= 1) ++bit;
+		return bit;
+#endif
+	}
+};
+
+}
+
+#endif
@@ -0,0 +1,89 @@
+/**
+ * whery: SimdSearch.h
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#ifndef H_WHERY_SIMDSEARCH
+#define H_WHERY_SIMDSEARCH
+
+namespace whery {
+
+//#################### ENUMERATIONS ####################
+
+/**
+\brief The values of this enumeration denote the instruction sets that can be used to search sorted arrays.
+*/
+enum SimdLevel
+{
+	/** Plain scalar code (a binary search). */
+	SIMD_NONE,
+
+	/** SSE2, which is available on every x86-64 processor. */
+	SIMD_SSE2,
+
+	/** AVX2, which is only used if the processor (and operating system) are found to support it at runtime. */
+	SIMD_AVX2
+};
+
+//#################### GLOBAL FUNCTIONS ####################
+
+/**
+Gets the best instruction set that can be used to search sorted arrays on this machine.
+
+\return	The best instruction set that can be used (as detected on first use).
+*/
+SimdLevel best_simd_level();
+
+/**
+Finds the position of the first value in a sorted array that is not less than the specified key
+(i.e. the same position as std::lower_bound). The array is narrowed down using a binary search,
+and the last few dozen values are then compared with the key a vector at a time, which avoids
+the unpredictable branches at the bottom of a binary search.
+
+\param values	The array, which must be sorted in ascending order.
+\param count	The number of values in the array.
+\param key		The key.
+\param level	The instruction set to use (this is clamped to best_simd_level()).
+\return			The position of the first value that is not less than the key, or count if there is none.
+*/
+unsigned int simd_lower_bound(const double *values, unsigned int count, double key, SimdLevel level = best_simd_level());
+
+/**
+Finds the position of the first value in a sorted array that is not less than the specified key
+(see the double version).
+
+\param values	The array, which must be sorted in ascending order.
+\param count	The number of values in the array.
+\param key		The key.
+\param level	The instruction set to use (this is clamped to best_simd_level()).
+\return			The position of the first value that is not less than the key, or count if there is none.
+*/
+unsigned int simd_lower_bound(const int *values, unsigned int count, int key, SimdLevel level = best_simd_level());
+
+/**
+Finds the position of the first value in a sorted array that is greater than the specified key
+(i.e. the same position as std::upper_bound).
+
+\param values	The array, which must be sorted in ascending order.
+\param count	The number of values in the array.
+\param key		The key.
+\param level	The instruction set to use (this is clamped to best_simd_level()).
+\return			The position of the first value that is greater than the key, or count if there is none.
+*/
+unsigned int simd_upper_bound(const double *values, unsigned int count, double key, SimdLevel level = best_simd_level());
+
+/**
+Finds the position of the first value in a sorted array that is greater than the specified key
+(i.e. the same position as std::upper_bound).
+
+\param values	The array, which must be sorted in ascending order.
+\param count	The number of values in the array.
+\param key		The key.
+\param level	The instruction set to use (this is clamped to best_simd_level()).
+\return			The position of the first value that is greater than the key, or count if there is none.
+*/
+unsigned int simd_upper_bound(const int *values, unsigned int count, int key, SimdLevel level = best_simd_level());
+
+}
+
+#endif
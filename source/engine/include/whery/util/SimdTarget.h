@@ -0,0 +1,30 @@
+/**
+ * whery: SimdTarget.h
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#ifndef H_WHERY_SIMDTARGET
+#define H_WHERY_SIMDTARGET
+
+/*
+This header is for the implementation files of the vectorised utilities (see SimdSearch.h and BitPacking.h).
+It defines WHERY_SIMD_X86_64 (and includes the intrinsics) if compiling for x86-64, and WHERY_TARGET_AVX2,
+which marks a function to be compiled for AVX2 regardless of the compiler flags. Such a function must only be
+called if best_simd_level() says that AVX2 is supported.
+*/
+
+#if defined(__x86_64__) || defined(_M_X64)
+	#define WHERY_SIMD_X86_64
+	#include <immintrin.h>
+	#if defined(_MSC_VER)
+		#include <intrin.h>
+	#endif
+#endif
+
+#if defined(__GNUC__)
+	#define WHERY_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+	#define WHERY_TARGET_AVX2
+#endif
+
+#endif
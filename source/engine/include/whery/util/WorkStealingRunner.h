@@ -0,0 +1,72 @@
+/**
+ * whery: WorkStealingRunner.h
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#ifndef H_WHERY_WORKSTEALINGRUNNER
+#define H_WHERY_WORKSTEALINGRUNNER
+
+#include <vector>
+
+#include <boost/function.hpp>
+
+namespace whery {
+
+/**
+\brief An instance of this class runs batches of independent tasks on a fixed number of threads.
+
+The tasks in a batch are initially divided between the threads in contiguous blocks (so that
+neighbouring tasks, which often touch neighbouring data, tend to be run by the same thread). Each
+thread works through its own block from the front, and when it runs out of tasks, it steals tasks
+from the backs of the other threads' blocks, so that the threads all stay busy until the batch is
+finished even if some of the tasks take much longer than others.
+
+The threads only exist for the duration of each batch (there is no persistent pool of workers): the
+calling thread acts as one of them, and the others are started at the beginning of the batch and
+joined at the end of it.
+*/
+class WorkStealingRunner
+{
+	//#################### TYPEDEFS ####################
+public:
+	typedef boost::function<void()> Task;
+
+	//#################### PRIVATE VARIABLES ####################
+private:
+	/** The number of threads on which to run each batch of tasks. */
+	unsigned int m_threadCount;
+
+	//#################### CONSTRUCTORS ####################
+public:
+	/**
+	Constructs a work-stealing runner.
+
+	\param threadCount				The number of threads on which to run each batch of tasks (including the calling thread).
+	\throw std::invalid_argument	If threadCount is zero.
+	*/
+	explicit WorkStealingRunner(unsigned int threadCount);
+
+	//#################### PUBLIC METHODS ####################
+public:
+	/**
+	Runs a batch of tasks, and waits for all of them to finish. If any of the tasks throws an exception,
+	none of the tasks that have not yet started are run, and the first exception thrown is rethrown once
+	the others have finished. Similarly, if one of the threads cannot be started, the threads that have
+	already been started are stopped (once their current tasks have finished) and joined before the
+	exception is rethrown.
+
+	\param tasks	The tasks.
+	*/
+	void run(const std::vector<Task>& tasks) const;
+
+	/**
+	Gets the number of threads on which each batch of tasks is run.
+
+	\return	The number of threads on which each batch of tasks is run.
+	*/
+	unsigned int thread_count() const;
+};
+
+}
+
+#endif
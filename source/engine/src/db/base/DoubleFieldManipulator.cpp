@@ -5,6 +5,8 @@
 
 #include "whery/db/base/DoubleFieldManipulator.h"
 
+#include <cstring>
+
 #include <boost/lexical_cast.hpp>
 
 namespace whery {
@@ -50,6 +52,11 @@ std::string DoubleFieldManipulator::get_string(const char *location) const
 	return boost::lexical_cast<std::string>(get_double(location));
 }
 
+unsigned int DoubleFieldManipulator::normalized_size() const
+{
+	return sizeof(double);
+}
+
 void DoubleFieldManipulator::set_double(char *location, double value) const
 {
 	*reinterpret_cast<double*>(location) = value;
@@ -73,4 +80,21 @@ unsigned int DoubleFieldManipulator::size() const
 	return sizeof(double);
 }
 
+void DoubleFieldManipulator::write_normalized(const char *location, char *dest, SortDirection direction) const
+{
+	// Map -0.0 to 0.0, since the two compare equal.
+	double value = get_double(location);
+	if(value == 0.0) value = 0.0;
+
+	// Map the IEEE 754 bit patterns onto unsigned values in the same order: non-negative values just need their
+	// sign bit setting, whereas negative values need all of their bits flipping (so that larger magnitudes
+	// come first). Note that NaNs (which cannot be ordered using std::less anyway) are not supported.
+	boost::uint64_t bits;
+	memcpy(&bits, &value, sizeof(double));
+	const boost::uint64_t SIGN_BIT = static_cast<boost::uint64_t>(1) << 63;
+	bits = (bits & SIGN_BIT) != 0 ? ~bits : bits | SIGN_BIT;
+
+	write_big_endian(bits, sizeof(double), dest, direction);
+}
+
 }
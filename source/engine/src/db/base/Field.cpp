@@ -39,6 +39,11 @@ std::string Field::get_string() const
 	return m_manipulator.get_string(m_location);
 }
 
+unsigned int Field::normalized_size() const
+{
+	return m_manipulator.normalized_size();
+}
+
 void Field::set_double(double value) const
 {
 	ensure_writable();
@@ -57,6 +62,11 @@ void Field::set_int(int value) const
 	m_manipulator.set_int(m_location, value);
 }
 
+void Field::write_normalized(char *dest, SortDirection direction) const
+{
+	m_manipulator.write_normalized(m_location, dest, direction);
+}
+
 //#################### PRIVATE METHODS ####################
 
 void Field::ensure_writable() const
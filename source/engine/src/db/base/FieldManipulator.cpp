@@ -58,4 +58,16 @@ void FieldManipulator::set_uuid(char *location, const boost::uuids::uuid& value)
 	throw std::bad_cast(/*"Cannot set field value from type 'uuid'."*/);
 }
 
+//#################### PROTECTED METHODS ####################
+
+void FieldManipulator::write_big_endian(boost::uint64_t value, unsigned int size, char *dest, SortDirection direction)
+{
+	if(direction == DESC) value = ~value;
+	for(int i = static_cast<int>(size) - 1; i >= 0; --i)
+	{
+		dest[i] = static_cast<char>(value & 0xff);
+		value >>= 8;
+	}
+}
+
 }
@@ -5,6 +5,12 @@
 
 #include "whery/db/base/FreshTuple.h"
 
+#include <cstring>
+
+#ifndef BOOST_NO_CXX11_RVALUE_REFERENCES
+#include <utility>
+#endif
+
 namespace whery {
 
 //#################### CONSTRUCTORS ####################
@@ -26,28 +32,86 @@ FreshTuple::FreshTuple(const TupleManipulator& manipulator)
 FreshTuple::FreshTuple(const FreshTuple& rhs)
 :	BackedTuple(rhs.m_manipulator)
 {
-	set_buffer(rhs.m_buffer);
+	set_buffer(rhs);
 }
 
 FreshTuple& FreshTuple::operator=(const FreshTuple& rhs)
 {
+	if(this != &rhs)
+	{
+		m_manipulator = rhs.m_manipulator;
+		set_buffer(rhs);
+	}
+	return *this;
+}
+
+#ifndef BOOST_NO_CXX11_RVALUE_REFERENCES
+//#################### MOVE CONSTRUCTOR & ASSIGNMENT OPERATOR ####################
+
+FreshTuple::FreshTuple(FreshTuple&& rhs)
+:	BackedTuple(rhs.m_manipulator)
+{
+	*this = std::move(rhs);
+}
+
+FreshTuple& FreshTuple::operator=(FreshTuple&& rhs)
+{
+	if(this == &rhs) return *this;
+
 	m_manipulator = rhs.m_manipulator;
-	set_buffer(rhs.m_buffer);
+	if(rhs.m_heapBuffer.empty())
+	{
+		// The tuple is stored inline, so there is nothing to be gained by moving it.
+		set_buffer(rhs);
+	}
+	else
+	{
+		// Take over the heap buffer (the location of its contents is unchanged by swapping the vectors).
+		m_heapBuffer.swap(rhs.m_heapBuffer);
+		m_location = &m_heapBuffer[0];
+		std::vector<char>().swap(rhs.m_heapBuffer);
+		rhs.m_location = NULL;
+	}
 	return *this;
 }
+#endif
 
 //#################### PRIVATE METHODS ####################
 
-void FreshTuple::set_buffer(const std::vector<char>& buffer)
+void FreshTuple::set_buffer(const FreshTuple& rhs)
 {
-	m_buffer = buffer;
-	m_location = &m_buffer[0];
+	const unsigned int size = rhs.m_manipulator.size();
+	if(size <= WHERY_FRESHTUPLE_INLINE_SIZE)
+	{
+		std::vector<char>().swap(m_heapBuffer);
+		memcpy(m_inlineBuffer, rhs.m_location, size);
+		m_location = m_inlineBuffer;
+	}
+	else if(rhs.m_heapBuffer.empty())
+	{
+		// The tuple has been moved from, so it has no buffer to copy.
+		set_fresh_buffer(size);
+	}
+	else
+	{
+		m_heapBuffer = rhs.m_heapBuffer;
+		m_location = &m_heapBuffer[0];
+	}
 }
 
 void FreshTuple::set_fresh_buffer(unsigned int size)
 {
-	m_buffer = std::vector<char>(size);
-	m_location = &m_buffer[0];
+	if(size <= WHERY_FRESHTUPLE_INLINE_SIZE)
+	{
+		std::vector<char>().swap(m_heapBuffer);
+		memset(m_inlineBuffer, 0, size);
+		m_location = m_inlineBuffer;
+	}
+	else
+	{
+		m_heapBuffer.assign(size, 0);
+		m_location = &m_heapBuffer[0];
+	}
 }
 
 }
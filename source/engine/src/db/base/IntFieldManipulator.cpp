@@ -50,6 +50,11 @@ std::string IntFieldManipulator::get_string(const char *location) const
 	return boost::lexical_cast<std::string>(get_int(location));
 }
 
+unsigned int IntFieldManipulator::normalized_size() const
+{
+	return sizeof(int);
+}
+
 void IntFieldManipulator::set_double(char *location, double value) const
 {
 	set_int(location, static_cast<int>(value));
@@ -73,4 +78,10 @@ unsigned int IntFieldManipulator::size() const
 	return sizeof(int);
 }
 
+void IntFieldManipulator::write_normalized(const char *location, char *dest, SortDirection direction) const
+{
+	// Flipping the sign bit maps the signed values onto unsigned ones in the same order.
+	write_big_endian(static_cast<boost::uint32_t>(get_int(location)) ^ 0x80000000u, sizeof(int), dest, direction);
+}
+
 }
@@ -69,4 +69,17 @@ int TupleComparator::compare(const Tuple& lhs, const Tuple& rhs) const
 	return 0;
 }
 
+std::string TupleComparator::normalized_key(const Tuple& tuple) const
+{
+	std::string key;
+	for(size_t i = 0, size = m_fieldIndices.size(); i < size; ++i)
+	{
+		Field field = tuple.field(m_fieldIndices[i].first);
+		size_t offset = key.size();
+		key.resize(offset + field.normalized_size());
+		field.write_normalized(&key[offset], m_fieldIndices[i].second);
+	}
+	return key;
+}
+
 }
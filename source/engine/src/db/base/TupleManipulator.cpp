@@ -6,88 +6,287 @@
 #include "whery/db/base/TupleManipulator.h"
 
 #include <cassert>
+#include <functional>
 #include <stdexcept>
 
 #include "whery/db/base/FieldManipulator.h"
 #include "whery/util/AlignmentTracker.h"
+#include "whery/util/Interner.h"
 
 namespace whery {
 
-//#################### CONSTRUCTORS ####################
+//#################### NESTED TYPES ####################
 
-TupleManipulator::TupleManipulator(const std::vector<const FieldManipulator*>& fieldManipulators)
+/**
+\brief An instance of this struct is a non-owning view of the properties that define a schema, which can be used
+to look up an interned schema without first having to build (and allocate) one.
+*/
+struct TupleManipulator::SchemaKey
 {
-	initialise(fieldManipulators);
-}
+	/** The manipulators for the fields in an underlying tuple. */
+	const std::vector<const FieldManipulator*> *fieldManipulators;
 
-TupleManipulator::TupleManipulator(const boost::assign_detail::generic_list<const FieldManipulator*>& fieldManipulators)
+	/** The indices of the fields in the underlying tuple that form a target tuple, or NULL if it contains all of them. */
+	const std::vector<unsigned int> *fieldIndices;
+
+	/** A function that directly compares target tuples in memory, or NULL if their layout is not known at compile time. */
+	LayoutComparator layoutComparator;
+
+	/** Whether or not sorted pages of target tuples should store normalized key prefixes to speed up their searches. */
+	bool usesKeyPrefixes;
+
+	/** Whether or not sorted pages of target tuples should store them with trailing key fields omitted. */
+	bool usesSuffixTruncation;
+
+	/**
+	Gets the number of fields in a target tuple.
+
+	\return	The number of fields in a target tuple.
+	*/
+	size_t arity() const
+	{
+		return fieldIndices ? fieldIndices->size() : fieldManipulators->size();
+	}
+
+	/**
+	Gets the manipulator for the i'th field in a target tuple.
+
+	\param i	The index of the field.
+	\return		The manipulator for the field.
+	*/
+	const FieldManipulator *field_manipulator(size_t i) const
+	{
+		if(!fieldIndices) return (*fieldManipulators)[i];
+		assert((*fieldIndices)[i] < fieldManipulators->size());
+		return (*fieldManipulators)[(*fieldIndices)[i]];
+	}
+
+	/**
+	Compares the schema described by this key with the one described by another key.
+
+	\param rhs	The other key.
+	\return		A negative value, zero or a positive value, if this key is ordered respectively before, with or after rhs.
+	*/
+	int compare(const SchemaKey& rhs) const
+	{
+		std::less<const FieldManipulator*> fieldLess;
+		for(size_t i = 0, lhsArity = arity(), rhsArity = rhs.arity(); i < lhsArity || i < rhsArity; ++i)
+		{
+			if(i == lhsArity) return -1;
+			if(i == rhsArity) return 1;
+
+			const FieldManipulator *lhsField = field_manipulator(i), *rhsField = rhs.field_manipulator(i);
+			if(fieldLess(lhsField, rhsField)) return -1;
+			if(fieldLess(rhsField, lhsField)) return 1;
+		}
+
+		std::less<LayoutComparator> comparatorLess;
+		if(comparatorLess(layoutComparator, rhs.layoutComparator)) return -1;
+		if(comparatorLess(rhs.layoutComparator, layoutComparator)) return 1;
+		if(usesKeyPrefixes != rhs.usesKeyPrefixes) return static_cast<int>(usesKeyPrefixes) - static_cast<int>(rhs.usesKeyPrefixes);
+		return static_cast<int>(usesSuffixTruncation) - static_cast<int>(rhs.usesSuffixTruncation);
+	}
+
+	bool operator<(const Schema& rhs) const;
+};
+
+/**
+\brief An instance of this struct describes the signature of the target tuples of one or more tuple manipulators.
+*/
+struct TupleManipulator::Schema
+{
+	/** The manipulators for the fields in a target tuple. */
+	std::vector<const FieldManipulator*> fieldManipulators;
+
+	/** The memory offsets of the fields (in bytes) from the start of a target tuple. */
+	std::vector<unsigned int> fieldOffsets;
+
+	/** A function that directly compares target tuples in memory, or NULL if their layout is not known at compile time. */
+	LayoutComparator layoutComparator;
+
+	/** The overall size (in bytes) of a target tuple. */
+	unsigned int size;
+
+	/** Whether or not sorted pages of target tuples should store normalized key prefixes to speed up their searches. */
+	bool usesKeyPrefixes;
+
+	/** Whether or not sorted pages of target tuples should store them with trailing key fields omitted. */
+	bool usesSuffixTruncation;
+
+	/**
+	Gets a key describing the properties that define this schema (the field offsets and size are derived from the field manipulators).
+
+	\return	The key.
+	*/
+	SchemaKey key() const
+	{
+		SchemaKey result = { &fieldManipulators, NULL, layoutComparator, usesKeyPrefixes, usesSuffixTruncation };
+		return result;
+	}
+
+	bool operator<(const Schema& rhs) const		{ return key().compare(rhs.key()) < 0; }
+	bool operator<(const SchemaKey& rhs) const	{ return key().compare(rhs) < 0; }
+};
+
+bool TupleManipulator::SchemaKey::operator<(const Schema& rhs) const
 {
-	initialise(fieldManipulators);
+	return compare(rhs.key()) < 0;
 }
 
+//#################### CONSTRUCTORS ####################
+
+TupleManipulator::TupleManipulator(const std::vector<const FieldManipulator*>& fieldManipulators)
+:	m_schema(intern_schema(fieldManipulators, NULL, NULL, false, false))
+{}
+
+TupleManipulator::TupleManipulator(const boost::assign_detail::generic_list<const FieldManipulator*>& fieldManipulators)
+:	m_schema(intern_schema(fieldManipulators, NULL, NULL, false, false))
+{}
+
 TupleManipulator::TupleManipulator(
 	const std::vector<const FieldManipulator*>& fieldManipulators,
 	const std::vector<unsigned int>& fieldIndices)
+:	m_schema(intern_schema(fieldManipulators, &fieldIndices, NULL, false, false))
+{}
+
+TupleManipulator::TupleManipulator(const std::vector<const FieldManipulator*>& fieldManipulators, LayoutComparator layoutComparator)
+:	m_schema(intern_schema(fieldManipulators, NULL, layoutComparator, false, false))
+{}
+
+//#################### PUBLIC OPERATORS ####################
+
+bool TupleManipulator::operator==(const TupleManipulator& rhs) const
 {
-	std::vector<const FieldManipulator*> projectedFieldManipulators;
-	size_t fieldCount = fieldIndices.size();
-	projectedFieldManipulators.reserve(fieldCount);
-	for(size_t i = 0; i < fieldCount; ++i)
-	{
-		assert(fieldIndices[i] < fieldManipulators.size());
-		projectedFieldManipulators.push_back(fieldManipulators[fieldIndices[i]]);
-	}
+	return m_schema == rhs.m_schema;
+}
 
-	initialise(projectedFieldManipulators);
+bool TupleManipulator::operator!=(const TupleManipulator& rhs) const
+{
+	return m_schema != rhs.m_schema;
 }
 
 //#################### PUBLIC METHODS ####################
 
 unsigned int TupleManipulator::arity() const
 {
-	return m_fieldManipulators.size();
+	return static_cast<unsigned int>(m_schema->fieldManipulators.size());
 }
 
 Field TupleManipulator::field(char *tupleLocation, unsigned int i, bool readOnly) const
 {
-	assert(i < m_fieldManipulators.size());
-	return Field(tupleLocation + m_fieldOffsets[i], *m_fieldManipulators[i], readOnly);
+	assert(i < m_schema->fieldManipulators.size());
+	return Field(tupleLocation + m_schema->fieldOffsets[i], *m_schema->fieldManipulators[i], readOnly);
+}
+
+unsigned int TupleManipulator::field_offset(unsigned int i) const
+{
+	assert(i < m_schema->fieldOffsets.size());
+	return m_schema->fieldOffsets[i];
 }
 
 const std::vector<const FieldManipulator*>& TupleManipulator::field_manipulators() const
 {
-	return m_fieldManipulators;
+	return m_schema->fieldManipulators;
+}
+
+TupleManipulator::LayoutComparator TupleManipulator::layout_comparator() const
+{
+	return m_schema->layoutComparator;
+}
+
+void TupleManipulator::set_uses_key_prefixes(bool usesKeyPrefixes)
+{
+	if(usesKeyPrefixes != m_schema->usesKeyPrefixes)
+	{
+		m_schema = intern_schema(m_schema->fieldManipulators, NULL, m_schema->layoutComparator, usesKeyPrefixes, m_schema->usesSuffixTruncation);
+	}
+}
+
+void TupleManipulator::set_uses_suffix_truncation(bool usesSuffixTruncation)
+{
+	if(usesSuffixTruncation != m_schema->usesSuffixTruncation)
+	{
+		m_schema = intern_schema(m_schema->fieldManipulators, NULL, m_schema->layoutComparator, m_schema->usesKeyPrefixes, usesSuffixTruncation);
+	}
 }
 
 unsigned int TupleManipulator::size() const
 {
-	return m_size;
+	return m_schema->size;
 }
 
-//#################### PRIVATE METHODS ####################
+TupleManipulator TupleManipulator::truncated(unsigned int keyArity) const
+{
+	assert(1 <= keyArity && keyArity < arity());
+	if(keyArity == arity() - 1) return *this;
+
+	std::vector<unsigned int> fieldIndices;
+	fieldIndices.reserve(keyArity + 1);
+	for(unsigned int i = 0; i < keyArity; ++i)
+	{
+		fieldIndices.push_back(i);
+	}
+	fieldIndices.push_back(arity() - 1);
+	return TupleManipulator(m_schema->fieldManipulators, fieldIndices);
+}
 
-void TupleManipulator::initialise(const std::vector<const FieldManipulator*>& fieldManipulators)
+bool TupleManipulator::uses_key_prefixes() const
 {
-	if(fieldManipulators.empty())
+	return m_schema->usesKeyPrefixes;
+}
+
+bool TupleManipulator::uses_suffix_truncation() const
+{
+	return m_schema->usesSuffixTruncation;
+}
+
+//#################### PRIVATE STATIC METHODS ####################
+
+const TupleManipulator::Schema *TupleManipulator::intern_schema(
+	const std::vector<const FieldManipulator*>& fieldManipulators,
+	const std::vector<unsigned int> *fieldIndices,
+	LayoutComparator layoutComparator,
+	bool usesKeyPrefixes,
+	bool usesSuffixTruncation)
+{
+	if(fieldManipulators.empty() || (fieldIndices && fieldIndices->empty()))
 	{
 		throw std::invalid_argument("Tuples must contain at least one field.");
 	}
 
-	m_fieldManipulators = fieldManipulators;
+	static Interner<Schema> s_schemas;
+
+	// If this thread has seen the schema before, it can be found without taking the interner's mutex or allocating.
+	SchemaKey key = { &fieldManipulators, fieldIndices, layoutComparator, usesKeyPrefixes, usesSuffixTruncation };
+	const Schema *interned = s_schemas.lookup(key);
+	if(interned) return interned;
+
+	Schema schema;
+	size_t fieldCount = key.arity();
+	schema.fieldManipulators.reserve(fieldCount);
+	for(size_t i = 0; i < fieldCount; ++i)
+	{
+		schema.fieldManipulators.push_back(key.field_manipulator(i));
+	}
+	schema.layoutComparator = layoutComparator;
+	schema.usesKeyPrefixes = usesKeyPrefixes;
+	schema.usesSuffixTruncation = usesSuffixTruncation;
 
 	// Calculate the memory offsets of the fields (in bytes) from the start of a target tuple.
 	AlignmentTracker alignmentTracker;
-	m_fieldOffsets.reserve(m_fieldManipulators.size());
-	for(size_t i = 0, size = m_fieldManipulators.size(); i < size; ++i)
+	schema.fieldOffsets.reserve(fieldCount);
+	for(size_t i = 0; i < fieldCount; ++i)
 	{
-		alignmentTracker.advance_to_boundary(m_fieldManipulators[i]->alignment_requirement());
-		m_fieldOffsets.push_back(alignmentTracker.offset());
-		alignmentTracker.advance(m_fieldManipulators[i]->size());
+		alignmentTracker.advance_to_boundary(schema.fieldManipulators[i]->alignment_requirement());
+		schema.fieldOffsets.push_back(alignmentTracker.offset());
+		alignmentTracker.advance(schema.fieldManipulators[i]->size());
 	}
 
 	// Advance to the next maximum-alignment boundary and store the size of the tuple.
 	alignmentTracker.advance_to_boundary(alignmentTracker.max_alignment());
-	m_size = alignmentTracker.offset();
+	schema.size = alignmentTracker.offset();
+
+	return s_schemas.intern(schema);
 }
 
 }
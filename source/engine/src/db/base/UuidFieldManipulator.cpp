@@ -46,6 +46,11 @@ boost::uuids::uuid UuidFieldManipulator::get_uuid(const char *location) const
 	return *reinterpret_cast<const uuid*>(location);
 }
 
+unsigned int UuidFieldManipulator::normalized_size() const
+{
+	return uuid::static_size();
+}
+
 void UuidFieldManipulator::set_from(
 	char *location,
 	const FieldManipulator& sourceManipulator,
@@ -64,4 +69,14 @@ unsigned int UuidFieldManipulator::size() const
 	return uuid::static_size();
 }
 
+void UuidFieldManipulator::write_normalized(const char *location, char *dest, SortDirection direction) const
+{
+	// UUIDs are ordered by comparing their bytes lexicographically, so they are already normalized.
+	uuid value = get_uuid(location);
+	for(uuid::size_type i = 0, size = uuid::static_size(); i < size; ++i)
+	{
+		dest[i] = static_cast<char>(direction == ASC ? value.data[i] : ~value.data[i]);
+	}
+}
+
 }
@@ -5,6 +5,8 @@
 
 #include "whery/db/base/ValueKey.h"
 
+#include "whery/util/Interner.h"
+
 namespace whery {
 
 //#################### CONSTRUCTORS ####################
@@ -13,19 +15,27 @@ ValueKey::ValueKey(
 	const std::vector<const FieldManipulator*>& fieldManipulators,
 	const std::vector<unsigned int>& fieldIndices)
 :	FreshTuple(TupleManipulator(fieldManipulators, fieldIndices)),
-	m_fieldIndices(fieldIndices)
+	m_fieldIndices(intern_field_indices(fieldIndices))
 {}
 
 ValueKey::ValueKey(const TupleManipulator& tupleManipulator, const std::vector<unsigned int>& fieldIndices)
 :	FreshTuple(TupleManipulator(tupleManipulator.field_manipulators(), fieldIndices)),
-	m_fieldIndices(fieldIndices)
+	m_fieldIndices(intern_field_indices(fieldIndices))
 {}
 
 //#################### PUBLIC METHODS ####################
 
 const std::vector<unsigned int>& ValueKey::field_indices() const
 {
-	return m_fieldIndices;
+	return *m_fieldIndices;
+}
+
+//#################### PRIVATE STATIC METHODS ####################
+
+const std::vector<unsigned int> *ValueKey::intern_field_indices(const std::vector<unsigned int>& fieldIndices)
+{
+	static Interner<std::vector<unsigned int> > s_fieldIndices;
+	return s_fieldIndices.intern(fieldIndices);
 }
 
 }
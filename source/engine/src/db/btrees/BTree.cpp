@@ -5,32 +5,364 @@
 
 #include "whery/db/btrees/BTree.h"
 
+#include <algorithm>
 #include <cassert>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+
+#include <boost/bind.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/thread/thread.hpp>
 
 #include "whery/db/base/RangeKey.h"
 #include "whery/util/TextUtil.h"
+#include "whery/util/WorkStealingRunner.h"
+
+//#################### MACROS ####################
+
+// These macros record statistics for the B+-tree if (and only if) WHERY_BTREE_STATS is defined,
+// and otherwise compile to nothing, so that the instrumentation then has no cost at all.
+#ifdef WHERY_BTREE_STATS
+	#define WHERY_BTREE_COUNT_EVENT(event) m_statsRecorder.count_event(BTreeStats::event)
+	#define WHERY_BTREE_TIME_OPERATION(op) BTreeStatsRecorder::OperationTimer operationTimer(m_statsRecorder, BTreeStats::op)
+#else
+	#define WHERY_BTREE_COUNT_EVENT(event) ((void)0)
+	#define WHERY_BTREE_TIME_OPERATION(op) ((void)0)
+#endif
 
 namespace whery {
 
-//#################### CONSTRUCTORS ####################
+//#################### LOCAL CONSTANTS ####################
+
+namespace {
+
+/** The reciprocal of the fraction of its tuples that a node moves to the fresh node when it is split by an append. */
+const unsigned int APPEND_SPLIT_DIVISOR = 10;
+
+/** The number of keys ahead of the current one whose node's page should be prefetched during a batched search. */
+const size_t BATCH_PREFETCH_DISTANCE = 8;
+
+/** The number of runs into which a parallel scan tries to cut its range for each thread (so that there are runs to steal). */
+const unsigned int SCAN_RUNS_PER_THREAD = 4;
 
-BTree::BTree(const BTreePageController_CPtr& pageController)
-:	m_pageController(pageController), m_tupleCount(0)
+}
+
+//#################### LOCAL CLASSES ####################
+
+namespace {
+
+/**
+\brief An instance of this class orders the branch tuples of a B+-tree, some of which may have had trailing key fields omitted
+(see TupleManipulator::set_uses_suffix_truncation).
+
+Branch tuples are compared on the key fields that they share, then a tuple with fewer key fields is ordered before one with
+more, and finally tuples with the same key fields are ordered by child node ID. This is the order in which SlottedSortedPage
+stores them (for branch tuples of the same length, it is simply the order given by PrefixTupleComparator).
+*/
+struct BranchTupleComparator
 {
-	// Create the root node.
-	m_rootID = m_firstLeafID = m_lastLeafID = add_leaf_node();
+	bool operator()(const Tuple& lhs, const Tuple& rhs) const
+	{
+		return compare(lhs, rhs) == -1;
+	}
 
-	// Pre-calculate the field indices to use when constructing branch keys.
-	TupleManipulator branchTupleManipulator = branch_tuple_manipulator();
-	unsigned int branchKeyArity = branchTupleManipulator.arity() - 1;
-	m_branchKeyFieldIndices.reserve(branchKeyArity);
+	int compare(const Tuple& lhs, const Tuple& rhs) const
+	{
+		const unsigned int lhsKeyArity = lhs.arity() - 1, rhsKeyArity = rhs.arity() - 1;
+		for(unsigned int i = 0, size = std::min(lhsKeyArity, rhsKeyArity); i < size; ++i)
+		{
+			int result = lhs.field(i).compare_to(rhs.field(i));
+			if(result != 0) return result;
+		}
+
+		if(lhsKeyArity != rhsKeyArity) return lhsKeyArity < rhsKeyArity ? -1 : 1;
+		return lhs.field(lhsKeyArity).compare_to(rhs.field(rhsKeyArity));
+	}
+};
+
+/**
+\brief An instance of this class holds a version latch (e.g. that of a B+-tree node) for as long as it exists.
+
+A version latch is held whenever its version is odd. Acquiring the latch waits until the version is even and
+then increments it; releasing the latch increments it again, so that any optimistic reader that read the old
+version can tell that something has changed.
+*/
+class VersionLatch
+{
+	//#################### PRIVATE VARIABLES ####################
+private:
+	/** The version. */
+	boost::atomic<unsigned int>& m_version;
+
+	//#################### CONSTRUCTORS ####################
+public:
+	/**
+	Acquires the specified version latch.
+
+	\param version	The version.
+	*/
+	explicit VersionLatch(boost::atomic<unsigned int>& version)
+	:	m_version(version)
+	{
+		unsigned int v = m_version.load();
+		for(;;)
+		{
+			if(v % 2 == 1)
+			{
+				boost::this_thread::yield();
+				v = m_version.load();
+			}
+			else if(m_version.compare_exchange_weak(v, v + 1)) break;
+		}
+	}
+
+	//#################### DESTRUCTOR ####################
+public:
+	/**
+	Releases the version latch.
+	*/
+	~VersionLatch()
+	{
+		++m_version;
+	}
+
+	//#################### COPY CONSTRUCTOR & ASSIGNMENT OPERATOR ####################
+private:
+	/** Private and unimplemented - version latches cannot be copied. */
+	VersionLatch(const VersionLatch&);
+	VersionLatch& operator=(const VersionLatch&);
+};
+
+}
+
+//#################### LOCAL FUNCTIONS ####################
+
+namespace {
+
+/**
+Checks whether every tuple that is ordered after the specified separator must lie beyond the high end of the specified range.
+This is conservative: if the separator and the high endpoint compare equal, we cannot tell, so we return false.
+
+\param lowerSeparator	The separator (if any), i.e. a key that is no greater than any of the tuples we are interested in.
+\param key				The range.
+\return					true, if every tuple that is ordered after the separator must lie beyond the range, or false otherwise.
+*/
+bool follows_range(const ValueKey *lowerSeparator, const RangeKey& key)
+{
+	return lowerSeparator && key.has_high_endpoint() && PrefixTupleComparator().compare(*lowerSeparator, key.high_value()) == 1;
+}
+
+/**
+Makes a key that can hold the first few key fields of a branch tuple (by default, all but its last field, the child node ID).
+
+\param branchTupleManipulator	The tuple manipulator for the branch tuples.
+\param branchKeyArity			The number of key fields the key should hold (0 means all of them).
+\return							The key.
+*/
+ValueKey make_branch_key_prototype(const TupleManipulator& branchTupleManipulator, unsigned int branchKeyArity = 0)
+{
+	std::vector<unsigned int> fieldIndices;
+	if(branchKeyArity == 0) branchKeyArity = branchTupleManipulator.arity() - 1;
+	fieldIndices.reserve(branchKeyArity);
 	for(unsigned int i = 0; i < branchKeyArity; ++i)
 	{
-		m_branchKeyFieldIndices.push_back(i);
+		fieldIndices.push_back(i);
+	}
+	return ValueKey(branchTupleManipulator, fieldIndices);
+}
+
+/**
+Checks whether every tuple that is ordered before the specified separator must lie before the low end of the specified range.
+This is conservative: if the separator and the low endpoint compare equal, we cannot tell, so we return false.
+
+\param upperSeparator	The separator (if any), i.e. a key that is greater than any of the tuples we are interested in.
+\param key				The range.
+\return					true, if every tuple that is ordered before the separator must lie before the range, or false otherwise.
+*/
+bool precedes_range(const ValueKey *upperSeparator, const RangeKey& key)
+{
+	return upperSeparator && key.has_low_endpoint() && PrefixTupleComparator().compare(*upperSeparator, key.low_value()) == -1;
+}
+
+/**
+Waits until the specified version is not latched, and then returns it.
+
+\param version	The version.
+\return			The version, once it is not latched (i.e. is even).
+*/
+unsigned int stable_version(const boost::atomic<unsigned int>& version)
+{
+	unsigned int v = version.load();
+	while(v % 2 == 1)
+	{
+		boost::this_thread::yield();
+		v = version.load();
+	}
+	return v;
+}
+
+/**
+Checks whether the versions of a B+-tree node and of the structure of the tree are unchanged since they were
+read by an optimistic reader. Any data the reader has read since then is consistent if and only if they are.
+
+\param nodeVersion					The version of the node.
+\param expectedNodeVersion			The version of the node when it was read.
+\param structureVersion				The structure version of the tree.
+\param expectedStructureVersion		The structure version of the tree when it was read.
+\return								true, if both versions are unchanged, or false otherwise.
+*/
+bool versions_unchanged(const boost::atomic<unsigned int>& nodeVersion, unsigned int expectedNodeVersion,
+						const boost::atomic<unsigned int>& structureVersion, unsigned int expectedStructureVersion)
+{
+	// Prevent the reader's earlier (non-atomic) reads of the node from being reordered after the checks.
+	boost::atomic_thread_fence(boost::memory_order_acquire);
+	return nodeVersion == expectedNodeVersion && structureVersion == expectedStructureVersion;
+}
+
+/**
+Checks whether every tuple that lies between the specified separators must lie within the specified range.
+This is conservative: if either separator compares equal to the corresponding endpoint, we return false.
+
+\param lowerSeparator	The lower separator (if any), i.e. a key that is no greater than any of the tuples we are interested in.
+\param upperSeparator	The upper separator (if any), i.e. a key that is greater than any of the tuples we are interested in.
+\param key				The range.
+\return					true, if every tuple between the separators must lie within the range, or false otherwise.
+*/
+bool within_range(const ValueKey *lowerSeparator, const ValueKey *upperSeparator, const RangeKey& key)
+{
+	PrefixTupleComparator comp;
+	return (!key.has_low_endpoint() || (lowerSeparator && comp.compare(*lowerSeparator, key.low_value()) == 1)) &&
+		   (!key.has_high_endpoint() || (upperSeparator && comp.compare(*upperSeparator, key.high_value()) == -1));
+}
+
+}
+
+//#################### CONSTRUCTORS ####################
+
+BTree::BTree(const BTreePageController_CPtr& pageController, bool concurrent, bool counted)
+:	m_branchKeyPrototype(make_branch_key_prototype(pageController->btree_branch_tuple_manipulator())),
+	m_branchTupleManipulator(pageController->btree_branch_tuple_manipulator()),
+	m_concurrent(concurrent),
+	m_counted(counted),
+	m_leafTupleManipulator(pageController->btree_leaf_tuple_manipulator()),
+	m_pageController(pageController),
+	m_structureVersion(0),
+	m_tupleCount(0)
+{
+	if(m_branchTupleManipulator.uses_suffix_truncation())
+	{
+		// A truncated separator is only known to be greater than the leaf tuples to its left if the branch key fields
+		// compare in exactly the same way as the corresponding leaf fields, i.e. if they have the same types.
+		const std::vector<const FieldManipulator*>& branchFields = m_branchTupleManipulator.field_manipulators();
+		const std::vector<const FieldManipulator*>& leafFields = m_leafTupleManipulator.field_manipulators();
+		const unsigned int branchKeyArity = m_branchTupleManipulator.arity() - 1;
+		if(branchKeyArity > leafFields.size() || !std::equal(branchFields.begin(), branchFields.begin() + branchKeyArity, leafFields.begin()))
+		{
+			throw std::invalid_argument("A B+-tree can only truncate its separators if its branch key fields have the same types as the leading fields of its leaf tuples.");
+		}
+
+		for(unsigned int keyArity = 1; keyArity <= branchKeyArity; ++keyArity)
+		{
+			m_truncatedBranchKeyPrototypes.push_back(make_branch_key_prototype(m_branchTupleManipulator, keyArity));
+			m_truncatedBranchTupleManipulators.push_back(m_branchTupleManipulator.truncated(keyArity));
+		}
+	}
+
+	// Reopen the B+-tree whose structure was saved via the page controller (if any), or else create an empty root node.
+	boost::optional<BTreePageController::BTreeStructure> structure = m_pageController->load_btree_structure();
+	if(structure && !structure->nodes.empty()) restore_structure(*structure);
+	else m_rootID = m_firstLeafID = m_lastLeafID = add_leaf_node();
+}
+
+//#################### DESTRUCTOR ####################
+
+BTree::~BTree()
+{
+	if(m_pageController->persists_btree_structure())
+	{
+		// If the structure cannot be saved, the controller will simply not have a structure to reopen,
+		// and the B+-tree will need to be rebuilt in some other way, so there is no need to propagate this.
+		try
+		{
+			m_pageController->save_btree_structure(make_structure());
+		}
+		catch(std::exception&) {}
+	}
+}
+
+//#################### NESTED CLASSES ####################
+
+BTree::BatchCursor::BatchCursor(const ConstIterator& begin, const ConstIterator& end)
+:	m_batchBegin(0),
+	m_batchEnd(0),
+	m_batchPage(NULL),
+	m_endNodeID(end.m_nodeID),
+	m_endPosition(end.m_it.index()),
+	m_nodeID(begin == end ? -1 : begin.m_nodeID),
+	m_position(begin.m_it.index()),
+	m_tree(begin.m_tree)
+{}
+
+bool BTree::BatchCursor::next()
+{
+	m_batchBegin = m_batchEnd = 0;
+	m_batchPage = NULL;
+	m_locations.clear();
+
+	// Take the tuples in the range from each leaf in turn until one of them yields a non-empty batch.
+	while(m_nodeID != -1 && m_batchPage == NULL)
+	{
+		const SortedPage *nodePage = m_tree->raw_page(m_nodeID);
+		const unsigned int end = m_nodeID == m_endNodeID ? m_endPosition : nodePage->tuple_count();
+		if(end > m_position)
+		{
+			m_batchBegin = m_position;
+			m_batchEnd = end;
+			m_batchPage = nodePage;
+		}
+
+		m_nodeID = m_nodeID == m_endNodeID ? -1 : m_tree->m_nodes[m_nodeID].siblingRightID.load();
+		m_position = 0;
+	}
+
+	return m_batchPage != NULL;
+}
+
+void BTree::BatchCursor::read_doubles(unsigned int fieldIndex, std::vector<double>& values) const
+{
+	values.resize(size());
+	if(!values.empty()) m_batchPage->read_doubles(fieldIndex, m_batchBegin, m_batchEnd, &values[0]);
+}
+
+void BTree::BatchCursor::read_ints(unsigned int fieldIndex, std::vector<int>& values) const
+{
+	values.resize(size());
+	if(!values.empty()) m_batchPage->read_ints(fieldIndex, m_batchBegin, m_batchEnd, &values[0]);
+}
+
+void BTree::BatchCursor::fetch_locations() const
+{
+	m_locations.resize(size());
+	m_batchPage->tuple_locations(m_batchBegin, m_batchEnd, &m_locations[0]);
+}
+
+BTree::StructureModification::StructureModification(BTree& tree)
+:	m_lock(tree.m_structureMutex, boost::defer_lock), m_tree(tree)
+{
+	if(m_tree.m_concurrent)
+	{
+		m_lock.lock();
+		++m_tree.m_structureVersion;
+		m_tree.release_retired_pages();
 	}
 }
 
+BTree::StructureModification::~StructureModification()
+{
+	if(m_lock.owns_lock()) ++m_tree.m_structureVersion;
+}
+
 //#################### PUBLIC METHODS ####################
 
 BTree::ConstIterator BTree::begin() const
@@ -38,6 +370,131 @@ BTree::ConstIterator BTree::begin() const
 	return ConstIterator(this, m_firstLeafID, page_begin(m_firstLeafID));
 }
 
+void BTree::bulk_load(const std::vector<SortedPage_Ptr>& pages, double fillFactor)
+{
+	if(m_tupleCount != 0)
+	{
+		throw std::logic_error("It is only possible to bulk load tuples into an empty B+-tree.");
+	}
+
+	if(!(fillFactor > 0.0 && fillFactor <= 1.0))
+	{
+		throw std::invalid_argument("The fill factor for a bulk load must be in the range (0,1].");
+	}
+
+	// Count the tuples to be loaded, checking that the pages are sorted with respect to each other
+	// as we go. (The tuples on each individual page are sorted by construction.)
+	unsigned int tupleCount = 0;
+	SortedPage_Ptr lastNonEmptyPage;
+	PrefixTupleComparator comp;
+	for(std::vector<SortedPage_Ptr>::const_iterator it = pages.begin(), iend = pages.end(); it != iend; ++it)
+	{
+		if((*it)->tuple_count() == 0) continue;
+
+		if(lastNonEmptyPage && comp.compare(*lastNonEmptyPage->rbegin(), *(*it)->begin()) == 1)
+		{
+			throw std::invalid_argument("The pages to be bulk loaded must be sorted with respect to each other.");
+		}
+
+		tupleCount += (*it)->tuple_count();
+		lastNonEmptyPage = *it;
+	}
+
+	// If there is nothing to load, leave the B+-tree as it is.
+	if(tupleCount == 0) return;
+
+	StructureModification modification(*this);
+
+	// An empty B+-tree consists of a single, empty root leaf, which is replaced by the new tree once that has been
+	// built (so that if building it fails, the B+-tree is left as it was).
+	const int oldRootID = m_rootID;
+	assert(!m_routes[oldRootID].has_children() && page(oldRootID)->tuple_count() == 0);
+
+	// Decide how many leaves to use. Each leaf should be filled to the specified fill factor where
+	// possible, but must contain at least the minimum number of tuples (unless it is the only leaf).
+	const unsigned int leafMax = m_pageController->max_btree_leaf_tuple_count();
+	const unsigned int leafMin = leafMax / 2;
+	unsigned int leafTarget = std::max(leafMin, static_cast<unsigned int>(leafMax * fillFactor));
+	leafTarget = std::max(1u, std::min(leafMax, leafTarget));
+	const unsigned int leafCount = bulk_load_node_count(tupleCount, leafTarget, leafMin);
+
+	// Every branch node will have at least two children, so the tree will need fewer than twice as many nodes as leaves.
+	m_nodeIDAllocator.reserve(2 * leafCount);
+
+	// Build the leaves by copying the tuples across in order, dividing them as evenly
+	// as possible between the leaves and linking each leaf to its left sibling.
+	std::vector<int> level;
+	level.reserve(leafCount);
+	size_t pageIndex = 0;
+	SortedPage::TupleSetCIter it = pages[pageIndex]->begin();
+	for(unsigned int i = 0; i < leafCount; ++i)
+	{
+		int id = add_leaf_node();
+		SortedPage_Ptr leafPage = page(id);
+		unsigned int n = tupleCount / leafCount + (i < tupleCount % leafCount ? 1 : 0);
+		for(unsigned int j = 0; j < n; ++j, ++it)
+		{
+			while(it == pages[pageIndex]->end())
+			{
+				it = pages[++pageIndex]->begin();
+			}
+			leafPage->add_tuple(*it);
+		}
+
+		if(!level.empty())
+		{
+			m_nodes[level.back()].siblingRightID = id;
+			m_nodes[id].siblingLeftID = level.back();
+		}
+		level.push_back(id);
+	}
+
+	const int firstLeafID = level.front();
+	const int lastLeafID = level.back();
+
+	// Build the branch levels, one at a time, until we reach a level with only a single node (the root).
+	if(level.size() > 1)
+	{
+		const unsigned int branchMax = m_pageController->max_btree_branch_tuple_count();
+		const unsigned int branchMin = branchMax / 2;
+		unsigned int branchTarget = std::max(branchMin, static_cast<unsigned int>(branchMax * fillFactor));
+		branchTarget = std::max(1u, std::min(branchMax, branchTarget));
+
+		// Note that a branch node with n index entries has n + 1 children, and that every branch node
+		// must have at least two children.
+		while(level.size() > 1)
+		{
+			level = bulk_load_branch_level(level, branchTarget + 1, std::max(2u, branchMin + 1));
+		}
+	}
+
+	// Replace the old root with the new tree, and only then discard it.
+	m_rootID = level.front();
+	m_firstLeafID = firstLeafID;
+	m_lastLeafID = lastLeafID;
+	m_tupleCount = tupleCount;
+	delete_node(oldRootID);
+}
+
+unsigned int BTree::count(const RangeKey& key) const
+{
+	if(!m_counted)
+	{
+		throw std::logic_error("It is only possible to count the tuples in a range in a counted B+-tree.");
+	}
+
+	if(!key.is_valid()) return 0;
+
+	boost::shared_lock<boost::shared_mutex> lock(m_structureMutex, boost::defer_lock);
+	if(m_concurrent) lock.lock();
+
+	// An open low endpoint excludes the tuples equal to it, and so starts at their upper bound;
+	// conversely, an open high endpoint excludes the tuples equal to it, and so ends at their lower bound.
+	unsigned int low = key.has_low_endpoint() ? rank_of_bound(key.low_value(), key.low_kind() == OPEN) : 0;
+	unsigned int high = key.has_high_endpoint() ? rank_of_bound(key.high_value(), key.high_kind() == CLOSED) : m_tupleCount.load();
+	return high > low ? high - low : 0;
+}
+
 BTree::ConstIterator BTree::end() const
 {
 	return ConstIterator(this, m_lastLeafID, page_end(m_lastLeafID));
@@ -45,31 +502,87 @@ BTree::ConstIterator BTree::end() const
 
 BTree::EqualRangeResult BTree::equal_range(const RangeKey& key) const
 {
-	if(key.is_valid())
-	{
-		return std::make_pair(lower_bound(key), upper_bound(key));
-	}
-	else
-	{
-		ConstIterator it = lower_bound(key);
-		return std::make_pair(it, it);
-	}
+	WHERY_BTREE_TIME_OPERATION(OP_RANGE_LOOKUP);
+
+	return range_bounds(key);
 }
 
 BTree::EqualRangeResult BTree::equal_range(const ValueKey& key) const
 {
+	WHERY_BTREE_TIME_OPERATION(OP_RANGE_LOOKUP);
+
 	return std::make_pair(lower_bound(key), upper_bound(key));
 }
 
 void BTree::erase_tuple(const ValueKey& key)
 {
+	WHERY_BTREE_TIME_OPERATION(OP_ERASE);
+
+	// In concurrent mode, most erasures only need to modify a single leaf, so try that first
+	// (unless we are in counted mode, in which case the counts of its ancestors must change too).
+	if(m_concurrent && !m_counted && try_erase_tuple_from_leaf(key)) return;
+
+	StructureModification modification(*this);
 	boost::optional<Merge> result = erase_tuple_from_subtree(key, m_rootID);
 	assert(!result);
-	--m_tupleCount;
+}
+
+void BTree::erase_tuples(const RangeKey& key)
+{
+	WHERY_BTREE_TIME_OPERATION(OP_ERASE);
+
+	if(!key.is_valid()) return;
+
+	StructureModification modification(*this);
+	const bool rootIsLeaf = !m_routes[m_rootID].has_children();
+	if(erase_tuples_from_subtree(key, m_rootID))
+	{
+		// If the whole tree has been erased, replace the root with a fresh, empty leaf (unless it is already one).
+		if(!rootIsLeaf)
+		{
+			delete_subtree(m_rootID);
+			m_rootID = m_firstLeafID = m_lastLeafID = add_leaf_node();
+		}
+	}
+	else
+	{
+		// Decrease the height of the tree for as long as the root has only a single child. (Any children of the
+		// new root that have too few tuples will already have been rebalanced, unless the new root itself has
+		// only a single child.)
+		while(m_routes[m_rootID].has_children() && page(m_rootID)->tuple_count() == 0)
+		{
+			int oldRootID = m_rootID;
+			m_rootID = m_routes[m_rootID].firstChildID.load();
+			m_nodes[m_rootID].parentID = -1;
+			delete_node(oldRootID);
+		}
+	}
+}
+
+void BTree::erase_tuples(const ValueKey& key)
+{
+	RangeKey rangeKey(leaf_tuple_manipulator().field_manipulators(), key.field_indices());
+	for(unsigned int i = 0, arity = key.arity(); i < arity; ++i)
+	{
+		rangeKey.low_value().field(i).set_from(key.field(i));
+		rangeKey.high_value().field(i).set_from(key.field(i));
+	}
+	rangeKey.low_kind() = rangeKey.high_kind() = CLOSED;
+	erase_tuples(rangeKey);
 }
 
 BTree::ConstIterator BTree::find(const ValueKey& key) const
 {
+	WHERY_BTREE_TIME_OPERATION(OP_FIND);
+
+	if(m_concurrent)
+	{
+		// The tuple at the lower bound cannot be safely dereferenced here, so compare the key against a copy of it instead.
+		boost::optional<FreshTuple> match;
+		ConstIterator it = optimistic_bound(key, false, &match);
+		return match && PrefixTupleComparator().compare(*match, key) == 0 ? it : end();
+	}
+
 	ConstIterator it = lower_bound(key), iend = end();
 	if(it != iend && PrefixTupleComparator().compare(*it, key) != 0)
 	{
@@ -78,16 +591,79 @@ BTree::ConstIterator BTree::find(const ValueKey& key) const
 	return it;
 }
 
+std::vector<BTree::ConstIterator> BTree::find_batch(const std::vector<ValueKey>& keys) const
+{
+	std::vector<ConstIterator> results;
+	if(m_concurrent)
+	{
+		// The tuples at the lower bounds cannot be safely dereferenced here, so just find each key in turn.
+		results.reserve(keys.size());
+		for(std::vector<ValueKey>::const_iterator it = keys.begin(), iend = keys.end(); it != iend; ++it)
+		{
+			results.push_back(find(*it));
+		}
+		return results;
+	}
+
+	results = lower_bound_batch(keys);
+	ConstIterator iend = end();
+	PrefixTupleComparator comp;
+	for(size_t i = 0, size = keys.size(); i < size; ++i)
+	{
+		if(results[i] != iend && comp.compare(*results[i], keys[i]) != 0)
+		{
+			results[i] = iend;
+		}
+	}
+	return results;
+}
+
 void BTree::insert_tuple(const Tuple& tuple)
 {
-	boost::optional<Split> result = insert_tuple_into_subtree(tuple, m_rootID);
-	assert(!result);
-	++m_tupleCount;
+	WHERY_BTREE_TIME_OPERATION(OP_INSERT);
+
+	// In concurrent mode, most insertions only need to modify a single leaf, so try that first
+	// (unless we are in counted mode, in which case the counts of its ancestors must change too).
+	if(m_concurrent && !m_counted && try_insert_tuple_into_leaf(tuple)) return;
+
+	// In serial mode, a tuple that comes after all of the existing ones (e.g. one with an increasing ID)
+	// can be appended straight to the rightmost leaf, without searching for it, if the leaf has room.
+	if(!m_concurrent && try_append_tuple(tuple)) return;
+
+	// Note that if the leaves' capacity depends on the values they hold, a leaf that is split to make room for the tuple
+	// may still not have room for it in the half it belongs in, in which case the insertion is retried (see the class
+	// documentation). The halves get smaller each time, so the insertion eventually succeeds.
+	StructureModification modification(*this);
+	for(const unsigned int tupleCount = m_tupleCount; m_tupleCount == tupleCount;)
+	{
+		boost::optional<Split> result = insert_tuple_into_subtree(tuple, m_rootID);
+		assert(!result);
+	}
+}
+
+bool BTree::is_concurrent() const
+{
+	return m_concurrent;
+}
+
+bool BTree::is_counted() const
+{
+	return m_counted;
 }
 
 TupleManipulator BTree::leaf_tuple_manipulator() const
 {
-	return m_pageController->btree_leaf_tuple_manipulator();
+	return m_leafTupleManipulator;
+}
+
+boost::optional<FreshTuple> BTree::lookup(const ValueKey& key) const
+{
+	WHERY_BTREE_TIME_OPERATION(OP_FIND);
+
+	boost::optional<FreshTuple> match;
+	optimistic_bound(key, false, &match);
+	if(match && PrefixTupleComparator().compare(*match, key) != 0) match = boost::none;
+	return match;
 }
 
 BTree::ConstIterator BTree::lower_bound(const RangeKey& key) const
@@ -108,15 +684,17 @@ BTree::ConstIterator BTree::lower_bound(const RangeKey& key) const
 
 BTree::ConstIterator BTree::lower_bound(const ValueKey& key) const
 {
+	if(m_concurrent) return optimistic_bound(key, false, NULL);
+
 	int id = m_rootID;
-	SortedPage::TupleSetCIter it = page(id)->lower_bound(key);
+	SortedPage::TupleSetCIter it = raw_page(id)->lower_bound(key);
 
 	// Walk down the B+-tree to find the lower bound. At the start of each iteration,
 	// the iterator it points to the lower bound of the key in the current node.
-	while(m_nodes[id].has_children())
+	while(m_routes[id].has_children())
 	{
 		id = left_child_of(it, id);
-		it = page(id)->lower_bound(key);
+		it = raw_page(id)->lower_bound(key);
 	}
 
 	// If the iterator points to the end of the leaf page, move it to the start
@@ -130,16 +708,220 @@ BTree::ConstIterator BTree::lower_bound(const ValueKey& key) const
 	return ConstIterator(this, id, it);
 }
 
+std::vector<BTree::ConstIterator> BTree::lower_bound_batch(const std::vector<ValueKey>& keys) const
+{
+	const size_t size = keys.size();
+	std::vector<ConstIterator> results(size);
+
+	if(m_concurrent)
+	{
+		// Optimistic descents cannot share nodes safely, so just look up each key in turn.
+		for(size_t i = 0; i < size; ++i)
+		{
+			results[i] = lower_bound(keys[i]);
+		}
+		return results;
+	}
+
+	if(size == 0) return results;
+
+	// Sort the positions of the keys by key, so that keys whose descents follow the same path are adjacent.
+	// To make the sort cheap, each key is first converted to the types of the leaf tuples' fields (as when
+	// comparing it with a leaf tuple) and normalized, so that the keys can then be compared with memcmp.
+	FreshTuple scratch(leaf_tuple_manipulator());
+	std::vector<std::pair<std::string,size_t> > normalizedKeys(size);
+	for(size_t i = 0; i < size; ++i)
+	{
+		std::string& normalizedKey = normalizedKeys[i].first;
+		for(unsigned int j = 0, arity = std::min(keys[i].arity(), scratch.arity()); j < arity; ++j)
+		{
+			Field field = scratch.field(j);
+			field.set_from(keys[i].field(j));
+			size_t offset = normalizedKey.size();
+			normalizedKey.resize(offset + field.normalized_size());
+			field.write_normalized(&normalizedKey[offset]);
+		}
+		normalizedKeys[i].second = i;
+	}
+	std::sort(normalizedKeys.begin(), normalizedKeys.end());
+
+	std::vector<size_t> order(size);
+	for(size_t j = 0; j < size; ++j) order[j] = normalizedKeys[j].second;
+
+	// Walk down the B+-tree for all of the keys at once, a level at a time. At the start of each iteration,
+	// nodeIDs[j] contains the ID of the current node for the j'th key (in sorted order), and at the end of
+	// it, its[j] points to the lower bound of that key in the node. (Since the B+-tree is balanced, all of
+	// the current nodes are at the same level, and so either they are all branches or they are all leaves.)
+	std::vector<int> nodeIDs(size, m_rootID);
+	std::vector<SortedPage::TupleSetCIter> its(size);
+	for(;;)
+	{
+		for(size_t j = 0; j < size; ++j)
+		{
+			// Start fetching the page of a node a few keys further on, so that its cache misses overlap with
+			// the searches for the keys in between (unless it is the same node as for the key before it).
+			const size_t k = j + BATCH_PREFETCH_DISTANCE;
+			if(k < size && nodeIDs[k] != nodeIDs[k - 1]) raw_page(nodeIDs[k])->prefetch();
+
+			// If this key is equivalent to the previous one, it shares its lower bound, so there is no need to search the node again.
+			const int id = nodeIDs[j];
+			if(j > 0 && normalizedKeys[j].first == normalizedKeys[j - 1].first) its[j] = its[j - 1];
+			else its[j] = raw_page(id)->lower_bound(keys[order[j]]);
+		}
+
+		if(!m_routes[nodeIDs[0]].has_children()) break;
+
+		for(size_t j = 0; j < size; ++j)
+		{
+			nodeIDs[j] = left_child_of(its[j], nodeIDs[j]);
+		}
+	}
+
+	for(size_t j = 0; j < size; ++j)
+	{
+		// If the iterator points to the end of the leaf page, move it to the start
+		// of the leaf page's right sibling (if any), as in lower_bound.
+		int id = nodeIDs[j];
+		SortedPage::TupleSetCIter it = its[j];
+		if(it == page_end(id) && m_nodes[id].siblingRightID != -1)
+		{
+			id = m_nodes[id].siblingRightID;
+			it = page_begin(id);
+		}
+
+		results[order[j]] = ConstIterator(this, id, it);
+	}
+
+	return results;
+}
+
+void BTree::parallel_scan(const RangeKey& key, unsigned int threadCount, const ScanCallback& callback) const
+{
+	WHERY_BTREE_TIME_OPERATION(OP_PARALLEL_SCAN);
+
+	if(threadCount == 0) throw std::invalid_argument("A parallel scan must use at least one thread.");
+
+	EqualRangeResult range = range_bounds(key);
+	if(range.first == range.second) return;
+
+	// A scan on a single thread is just a scan of the whole range, so there is no need to cut it into runs or start any threads.
+	if(threadCount == 1)
+	{
+		callback(range.first, range.second);
+		return;
+	}
+
+	if(!page(range.first.m_nodeID)->supports_concurrent_reads())
+	{
+		throw std::logic_error("A parallel scan needs leaf pages that can be read from several threads at once.");
+	}
+
+	std::vector<ConstIterator> boundaries = scan_boundaries(range.first, range.second, threadCount * SCAN_RUNS_PER_THREAD);
+	std::vector<WorkStealingRunner::Task> tasks;
+	tasks.reserve(boundaries.size() - 1);
+	for(size_t i = 0, size = boundaries.size(); i + 1 < size; ++i)
+	{
+		tasks.push_back(boost::bind(callback, boundaries[i], boundaries[i + 1]));
+	}
+	WorkStealingRunner(threadCount).run(tasks);
+}
+
 void BTree::print(std::ostream& os) const
 {
 	print_subtree(os, m_rootID, 0);
 }
 
-unsigned int BTree::tuple_count()
+unsigned int BTree::rank(const ValueKey& key) const
+{
+	if(!m_counted)
+	{
+		throw std::logic_error("It is only possible to find the rank of a key in a counted B+-tree.");
+	}
+
+	boost::shared_lock<boost::shared_mutex> lock(m_structureMutex, boost::defer_lock);
+	if(m_concurrent) lock.lock();
+
+	return rank_of_bound(key, false);
+}
+
+void BTree::reset_stats()
+{
+#ifdef WHERY_BTREE_STATS
+	m_statsRecorder.reset();
+#endif
+}
+
+BTree::ConstIterator BTree::select(unsigned int k) const
+{
+	if(!m_counted)
+	{
+		throw std::logic_error("It is only possible to find the tuple with a given rank in a counted B+-tree.");
+	}
+
+	boost::shared_lock<boost::shared_mutex> lock(m_structureMutex, boost::defer_lock);
+	if(m_concurrent) lock.lock();
+
+	if(k >= m_tupleCount) return end();
+
+	// Walk down the B+-tree, at each branch node skipping over the children whose subtrees contain
+	// fewer tuples than the rank we are looking for, and reducing the rank accordingly.
+	int id = m_rootID;
+	while(m_routes[id].has_children())
+	{
+		int childID = m_routes[id].firstChildID;
+		for(SortedPage::TupleSetCIter it = page_begin(id), iend = page_end(id); it != iend; ++it)
+		{
+			const unsigned int childCount = subtree_tuple_count(childID);
+			if(k < childCount) break;
+			k -= childCount;
+			childID = child_node_id(*it);
+		}
+		id = childID;
+	}
+
+	const SortedPage *leafPage = raw_page(id);
+	assert(k < leafPage->tuple_count());
+	return ConstIterator(this, id, SortedPage::TupleSetCIter(leafPage, k));
+}
+
+BTreeStats BTree::stats() const
+{
+#ifdef WHERY_BTREE_STATS
+	return m_statsRecorder.snapshot();
+#else
+	return BTreeStats();
+#endif
+}
+
+unsigned int BTree::tuple_count() const
 {
 	return m_tupleCount;
 }
 
+void BTree::update_tuple(const ConstIterator& it, const Tuple& tuple)
+{
+	// In concurrent mode, an iterator is only a snapshot of a position, which another writer may since have
+	// moved a different tuple into (or removed from the leaf altogether), so it cannot identify the old tuple.
+	if(m_concurrent)
+	{
+		throw std::logic_error("It is only possible to update a tuple through an iterator in a non-concurrent B+-tree.");
+	}
+
+	assert(it != end());
+
+	// Make a key from all of the fields of the old tuple, so that if it cannot be replaced within its leaf,
+	// it is the one that gets erased.
+	std::vector<unsigned int> fieldIndices(m_leafTupleManipulator.arity());
+	for(unsigned int i = 0, arity = m_leafTupleManipulator.arity(); i < arity; ++i) fieldIndices[i] = i;
+	ValueKey key(m_leafTupleManipulator, fieldIndices);
+
+	if(!try_update_tuple_in_leaf(it, tuple, key))
+	{
+		erase_tuple(key);
+		insert_tuple(tuple);
+	}
+}
+
 BTree::ConstIterator BTree::upper_bound(const RangeKey& key) const
 {
 	if(key.has_high_endpoint())
@@ -163,15 +945,17 @@ BTree::ConstIterator BTree::upper_bound(const RangeKey& key) const
 
 BTree::ConstIterator BTree::upper_bound(const ValueKey& key) const
 {
+	if(m_concurrent) return optimistic_bound(key, true, NULL);
+
 	int id = m_rootID;
-	SortedPage::TupleSetCIter it = page(id)->upper_bound(key);
+	SortedPage::TupleSetCIter it = raw_page(id)->upper_bound(key);
 
 	// Walk down the B+-tree to find the upper bound. At the start of each iteration,
 	// the iterator it points to the upper bound of the key in the current node.
-	while(m_nodes[id].has_children())
+	while(m_routes[id].has_children())
 	{
 		id = left_child_of(it, id);
-		it = page(id)->upper_bound(key);
+		it = raw_page(id)->upper_bound(key);
 	}
 
 	// If the iterator points to the end of the leaf page, move it to the start
@@ -190,7 +974,7 @@ BTree::ConstIterator BTree::upper_bound(const ValueKey& key) const
 int BTree::add_branch_node()
 {
 	int id = add_node();
-	m_nodes[id].page = m_pageController->make_btree_branch_page();
+	set_page(id, m_pageController->make_btree_branch_page());
 	return id;
 }
 
@@ -198,13 +982,13 @@ void BTree::add_index_entry(int nodeID)
 {
 	const int parentNodeID = m_nodes[nodeID].parentID;
 	assert(parentNodeID != -1);
-	page(parentNodeID)->add_tuple(make_branch_tuple(*page_begin(nodeID), nodeID));
+	page(parentNodeID)->add_tuple(make_branch_tuple(make_index_key(nodeID), nodeID));
 }
 
 int BTree::add_leaf_node()
 {
 	int id = add_node();
-	m_nodes[id].page = m_pageController->make_btree_leaf_page();
+	set_page(id, m_pageController->make_btree_leaf_page());
 	return id;
 }
 
@@ -215,40 +999,153 @@ int BTree::add_node()
 	if(static_cast<unsigned int>(id) >= m_nodes.size())
 	{
 		m_nodes.resize(id + 1);
+		m_routes.resize(id + 1);
 	}
 
 	Node& n = m_nodes[id];
 	n.parentID = n.siblingLeftID = n.siblingRightID = -1;
+	n.tupleCount = 0;
 
 	return id;
 }
 
 void BTree::add_root_node(const Split& split)
 {
+	WHERY_BTREE_COUNT_EVENT(EVENT_ADD_ROOT_NODE);
+
 	m_rootID = add_branch_node();
 	m_nodes[split.leftNodeID].parentID = m_rootID;
 	m_nodes[split.rightNodeID].parentID = m_rootID;
-	m_nodes[m_rootID].firstChildID = split.leftNodeID;
+	m_routes[m_rootID].firstChildID = split.leftNodeID;
 	page(m_rootID)->add_tuple(make_branch_tuple(split.splitter, split.rightNodeID));
+	update_tuple_count(m_rootID);
+}
+
+ValueKey BTree::branch_key_of(const Tuple& branchTuple) const
+{
+	return make_branch_key(branchTuple, branchTuple.arity() - 1);
 }
 
 TupleManipulator BTree::branch_tuple_manipulator() const
 {
-	return m_pageController->btree_branch_tuple_manipulator();
+	return m_branchTupleManipulator;
+}
+
+std::vector<int> BTree::bulk_load_branch_level(const std::vector<int>& childIDs, unsigned int targetChildCount, unsigned int minChildCount)
+{
+	const unsigned int childCount = static_cast<unsigned int>(childIDs.size());
+	const unsigned int branchCount = bulk_load_node_count(childCount, targetChildCount, minChildCount);
+
+	std::vector<int> branchIDs;
+	branchIDs.reserve(branchCount);
+	std::vector<int>::const_iterator ct = childIDs.begin();
+	for(unsigned int i = 0; i < branchCount; ++i)
+	{
+		int id = add_branch_node();
+		SortedPage_Ptr branchPage = page(id);
+		unsigned int n = childCount / branchCount + (i < childCount % branchCount ? 1 : 0);
+
+		// The first child is referenced directly by the node; each subsequent child gets an index
+		// entry keyed by (a separator derived from) the first leaf tuple in its subtree.
+		m_routes[id].firstChildID = *ct;
+		for(unsigned int j = 0; j < n; ++j, ++ct)
+		{
+			if(j > 0) branchPage->add_tuple(make_branch_tuple(make_index_key(*ct), *ct));
+			m_nodes[*ct].parentID = id;
+		}
+		update_tuple_count(id);
+
+		if(!branchIDs.empty())
+		{
+			m_nodes[branchIDs.back()].siblingRightID = id;
+			m_nodes[id].siblingLeftID = branchIDs.back();
+		}
+		branchIDs.push_back(id);
+	}
+
+	return branchIDs;
+}
+
+unsigned int BTree::bulk_load_node_count(unsigned int itemCount, unsigned int target, unsigned int minimum)
+{
+	// Use enough nodes to avoid exceeding the target, unless doing so would cause
+	// the nodes to fall below the minimum (in which case use as many as we can).
+	unsigned int nodeCount = (itemCount + target - 1) / target;
+	if(minimum > 0) nodeCount = std::min(nodeCount, std::max(1u, itemCount / minimum));
+	return nodeCount;
+}
+
+bool BTree::can_merge(int leftNodeID, int rightNodeID, int offset) const
+{
+	const SortedPage *rightPage = raw_page(rightNodeID);
+	const int count = static_cast<int>(rightPage->tuple_count()) + offset;
+	return count <= 0 || raw_page(leftNodeID)->has_room_for_tuples_from(*rightPage, count);
+}
+
+bool BTree::can_redistribute_leaf_and_insert(int nodeID, int siblingID, const Tuple& tuple) const
+{
+	const SortedPage *nodePage = raw_page(nodeID), *siblingPage = raw_page(siblingID);
+	return siblingPage->has_room_for(tuple) && siblingPage->has_room_for_tuples_from(*nodePage, 1) && nodePage->has_room_for(tuple, 1);
+}
+
+bool BTree::can_replace_index_entries(int parentNodeID, unsigned int n) const
+{
+	return m_truncatedBranchTupleManipulators.empty() || raw_page(parentNodeID)->empty_tuple_count() >= n;
+}
+
+bool BTree::can_update_in_place(const ConstIterator& it, const Tuple& tuple) const
+{
+	const int nodeID = it.m_nodeID;
+	const SortedPage *nodePage = raw_page(nodeID);
+	PrefixTupleComparator comp;
+
+	// The replacement must not be ordered before the tuple before it on the leaf. If the tuple is the first
+	// on the leaf, the replacement must instead not be ordered before the tuple itself (unless the leaf is
+	// the leftmost one), since it might otherwise be ordered before the index entry for the leaf.
+	if(it.m_it != nodePage->begin())
+	{
+		SortedPage::TupleSetCIter prev = it.m_it;
+		--prev;
+		if(comp.compare(*prev, tuple) == 1) return false;
+	}
+	else if(m_nodes[nodeID].siblingLeftID != -1 && comp.compare(tuple, *it.m_it) == -1) return false;
+
+	// Similarly, the replacement must not be ordered after the tuple after it on the leaf, or after the tuple
+	// itself if that is the last on the leaf (unless the leaf is the rightmost one).
+	SortedPage::TupleSetCIter next = it.m_it;
+	if(++next != nodePage->end())
+	{
+		if(comp.compare(tuple, *next) == 1) return false;
+	}
+	else if(m_nodes[nodeID].siblingRightID != -1 && comp.compare(tuple, *it.m_it) == 1) return false;
+
+	// Finally, the leaf must have room for the replacement once the old tuple has gone (which is always
+	// the case unless its capacity depends on the values it holds).
+	return nodePage->has_room_for(tuple, 1);
 }
 
 int BTree::child_node_id(const BackedTuple& branchTuple) const
 {
 	int id = branchTuple.field(branchTuple.arity() - 1).get_int();
-	assert(0 <= id && static_cast<unsigned int>(id) < m_nodes.size() && page(id).get() != NULL);
+	assert(0 <= id && static_cast<unsigned int>(id) < m_nodes.size() && raw_page(id) != NULL);
 	return id;
 }
 
+std::vector<int> BTree::child_node_ids(int nodeID) const
+{
+	std::vector<int> childIDs(1, m_routes[nodeID].firstChildID);
+	for(SortedPage::TupleSetCIter it = page_begin(nodeID), iend = page_end(nodeID); it != iend; ++it)
+	{
+		childIDs.push_back(child_node_id(*it));
+	}
+	return childIDs;
+}
+
 void BTree::connect_node_as_right_sibling_of(int freshID, int existingID)
 {
 	m_nodes[freshID].parentID = m_nodes[existingID].parentID;
 	m_nodes[freshID].siblingLeftID = existingID;
-	m_nodes[freshID].siblingRightID = m_nodes[existingID].siblingRightID;
+	m_nodes[freshID].siblingRightID = m_nodes[existingID].siblingRightID.load();
 	m_nodes[existingID].siblingRightID = freshID;
 	if(m_nodes[freshID].siblingRightID != -1) m_nodes[m_nodes[freshID].siblingRightID].siblingLeftID = freshID;
 	if(m_lastLeafID == existingID) m_lastLeafID = freshID;
@@ -259,8 +1156,38 @@ void BTree::delete_node(int nodeID)
 	m_nodeIDAllocator.deallocate(nodeID);
 
 	Node& n = m_nodes[nodeID];
-	n.page.reset();
-	n.firstChildID = n.parentID = n.siblingLeftID = n.siblingRightID = -1;
+	if(m_concurrent)
+	{
+		// Concurrent readers may still be using the node's page, so retire it rather than releasing it here.
+		m_retiredPages.push_back(n.page);
+	}
+	set_page(nodeID, SortedPage_Ptr());
+	m_routes[nodeID].firstChildID = n.parentID = n.siblingLeftID = n.siblingRightID = -1;
+}
+
+void BTree::delete_subtree(int nodeID)
+{
+	if(m_routes[nodeID].has_children())
+	{
+		std::vector<int> childIDs = child_node_ids(nodeID);
+		for(std::vector<int>::const_iterator it = childIDs.begin(), iend = childIDs.end(); it != iend; ++it)
+		{
+			delete_subtree(*it);
+		}
+	}
+	else
+	{
+		m_tupleCount -= page(nodeID)->tuple_count();
+		if(m_firstLeafID == nodeID) m_firstLeafID = m_nodes[nodeID].siblingRightID;
+		if(m_lastLeafID == nodeID) m_lastLeafID = m_nodes[nodeID].siblingLeftID;
+	}
+
+	// Empty the node's page before deleting the node, since a page controller may only free the page if it is empty
+	// (e.g. a memory-mapped controller keeps non-empty pages in its file so that their tuples can be recovered).
+	page(nodeID)->clear();
+
+	disconnect_node_from_siblings(nodeID);
+	delete_node(nodeID);
 }
 
 void BTree::disconnect_node_from_siblings(int nodeID)
@@ -281,8 +1208,13 @@ boost::optional<BTree::Merge> BTree::erase_tuple_from_branch(const ValueKey& key
 	// Find the child of this node below which tuples that match the specified key can be found,
 	// and erase the tuple from the subtree below it.
 	int childNodeID = left_child_of(page(nodeID)->lower_bound(key), nodeID);
+	const unsigned int tupleCount = m_tupleCount;
 	boost::optional<Merge> result = erase_tuple_from_subtree(key, childNodeID);
 
+	// If a tuple was actually erased, this node's subtree now contains one fewer tuple. (Any merge or
+	// redistribution below only moves tuples between this node's children, so does not affect this.)
+	if(m_counted && m_tupleCount != tupleCount) --m_nodes[nodeID].tupleCount;
+
 	if(!result)
 	{
 		// The erasure succeeded without any merge occurring on the level directly below this one.
@@ -294,6 +1226,10 @@ boost::optional<BTree::Merge> BTree::erase_tuple_from_branch(const ValueKey& key
 		// for the node in this level has been violated and restore it if it has.
 
 		// Get the ID of the relevant node at this level (the parent of the node resulting from the lower-level merge).
+		// Note that this is not necessarily the node we descended through: if the tuple erased was the first tuple
+		// in its leaf, the leaf may have been reached by hopping to the right sibling of the leaf we descended to,
+		// and may therefore have a different parent. Any redistribution or merge must be done on the relevant node
+		// (whose invariant is the one that may have been violated), not on nodeID.
 		int relevantNodeID = m_nodes[result->nodeID].parentID;
 
 		if(relevantNodeID == m_rootID)
@@ -303,7 +1239,7 @@ boost::optional<BTree::Merge> BTree::erase_tuple_from_branch(const ValueKey& key
 			if(page(relevantNodeID)->tuple_count() == 0)
 			{
 				int oldRootID = m_rootID;
-				m_rootID = m_nodes[m_rootID].firstChildID;
+				m_rootID = m_routes[m_rootID].firstChildID.load();
 				m_nodes[m_rootID].parentID = -1;
 				delete_node(oldRootID);
 			}
@@ -325,35 +1261,48 @@ boost::optional<BTree::Merge> BTree::erase_tuple_from_branch(const ValueKey& key
 			// (noting that we can't redistribute tuples between or merge nodes that do not have the same parent).
 			// The node must have at least one useful sibling, since otherwise the B+-tree would be invalid (we know
 			// that this node is the child of a branch node, and all branch nodes have at least two children).
-			bool hasUsefulLeftSibling = is_useful_sibling(relevantNodeID, m_nodes[relevantNodeID].siblingLeftID);
-			bool hasUsefulRightSibling = is_useful_sibling(relevantNodeID, m_nodes[relevantNodeID].siblingRightID);
+			const int leftNodeID = m_nodes[relevantNodeID].siblingLeftID;
+			const int rightNodeID = m_nodes[relevantNodeID].siblingRightID;
+			bool hasUsefulLeftSibling = is_useful_sibling(relevantNodeID, leftNodeID);
+			bool hasUsefulRightSibling = is_useful_sibling(relevantNodeID, rightNodeID);
 			assert(hasUsefulLeftSibling || hasUsefulRightSibling);
 
-			if(hasUsefulLeftSibling && has_at_least_min_tuples(m_nodes[relevantNodeID].siblingLeftID, -1))
+			// Moving a tuple across via the parent replaces one of the parent's index entries with another,
+			// which may not fit if the separators are truncated (see can_replace_index_entries).
+			const bool canRotate = can_replace_index_entries(m_nodes[relevantNodeID].parentID, 1);
+
+			if(hasUsefulLeftSibling && has_at_least_min_tuples(leftNodeID, -1) && canRotate)
 			{
 				// The node has a useful left sibling with a tuple to spare, so move the sibling's
 				// rightmost tuple across to restore the minimum tuple invariant.
 				redistribute_from_left_branch(relevantNodeID);
 				return boost::none;
 			}
-			else if(hasUsefulRightSibling && has_at_least_min_tuples(m_nodes[relevantNodeID].siblingRightID, -1))
+			else if(hasUsefulRightSibling && has_at_least_min_tuples(rightNodeID, -1) && canRotate)
 			{
 				// The node has a useful right sibling with a tuple to spare, so move the sibling's
 				// leftmost tuple across to restore the minimum tuple invariant.
 				redistribute_from_right_branch(relevantNodeID);
 				return boost::none;
 			}
-			else if(hasUsefulLeftSibling)
+			else if(hasUsefulLeftSibling && can_merge(leftNodeID, relevantNodeID, 1))
 			{
 				// The node has no useful siblings with a tuple to spare, but it does have a useful
 				// left sibling, so merge the two together to restore the minimum tuple invariant.
-				return merge_branches(m_nodes[relevantNodeID].siblingLeftID, nodeID);
+				return merge_branches(leftNodeID, relevantNodeID);
 			}
-			else
+			else if(hasUsefulRightSibling && can_merge(relevantNodeID, rightNodeID, 1))
 			{
 				// The node has no useful siblings with a tuple to spare, but it does have a useful
 				// right sibling, so merge the two together to restore the minimum tuple invariant.
-				return merge_branches(nodeID, m_nodes[relevantNodeID].siblingRightID);
+				return merge_branches(relevantNodeID, rightNodeID);
+			}
+			else
+			{
+				// This can only happen if the separators are truncated: the siblings' entries are too large
+				// to merge with, and the parent has no room to rotate one across, so leave the node underfull
+				// (within the bound described in the class documentation).
+				return boost::none;
 			}
 		}
 	}
@@ -361,6 +1310,7 @@ boost::optional<BTree::Merge> BTree::erase_tuple_from_branch(const ValueKey& key
 
 boost::optional<BTree::Merge> BTree::erase_tuple_from_leaf(const ValueKey& key, int nodeID)
 {
+	const int originalNodeID = nodeID;
 	SortedPage_Ptr nodePage = page(nodeID);
 	SortedPage::TupleSetCIter it = nodePage->lower_bound(key);
 
@@ -388,11 +1338,26 @@ boost::optional<BTree::Merge> BTree::erase_tuple_from_leaf(const ValueKey& key,
 		return boost::none;
 	}
 
+	// The tuple is definitely going to be erased, so update the tuple count.
+	--m_tupleCount;
+
+	// In counted mode, the ancestors of the original leaf will each have their counts decremented as the erasure
+	// returns up the tree. If the tuple is actually being erased from the right sibling, it is the sibling's
+	// ancestors that lose a tuple, so move the decrement across to them below their lowest common ancestor.
+	if(m_counted && nodeID != originalNodeID)
+	{
+		for(int l = m_nodes[originalNodeID].parentID, r = m_nodes[nodeID].parentID; l != r; l = m_nodes[l].parentID, r = m_nodes[r].parentID)
+		{
+			++m_nodes[l].tupleCount;
+			--m_nodes[r].tupleCount;
+		}
+	}
+
 	if(nodeID == m_rootID || has_at_least_min_tuples(nodeID, -1))
 	{
 		// Either this node is the root (in which case it has no minimum tuple requirement),
-		// or it would still be at least half full after a deletion, so simply erase the
-		// first tuple that matches the key.
+		// or it would still satisfy its minimum tuple invariant after a deletion, so simply
+		// erase the first tuple that matches the key.
 		nodePage->erase_tuple(it);
 		return boost::none;
 	}
@@ -402,44 +1367,66 @@ boost::optional<BTree::Merge> BTree::erase_tuple_from_leaf(const ValueKey& key,
 		// (noting that we can't redistribute tuples between or merge nodes that do not have the same parent).
 		// The node must have at least one useful sibling, since otherwise the B+-tree would be invalid (we know
 		// that this node is the child of a branch node, and all branch nodes have at least two children).
-		bool hasUsefulLeftSibling = is_useful_sibling(nodeID, m_nodes[nodeID].siblingLeftID);
-		bool hasUsefulRightSibling = is_useful_sibling(nodeID, m_nodes[nodeID].siblingRightID);
+		const int leftNodeID = m_nodes[nodeID].siblingLeftID;
+		const int rightNodeID = m_nodes[nodeID].siblingRightID;
+		bool hasUsefulLeftSibling = is_useful_sibling(nodeID, leftNodeID);
+		bool hasUsefulRightSibling = is_useful_sibling(nodeID, rightNodeID);
 		assert(hasUsefulLeftSibling || hasUsefulRightSibling);
 
-		if(hasUsefulLeftSibling && has_at_least_min_tuples(m_nodes[nodeID].siblingLeftID, -1))
+		// Redistributing replaces the index entries of the nodes whose first tuples change (see can_replace_index_entries).
+		const int parentNodeID = m_nodes[nodeID].parentID;
+		const unsigned int rightReplacementCount = nodeID == m_routes[parentNodeID].firstChildID ? 1 : 2;
+
+		if(hasUsefulLeftSibling && has_at_least_min_tuples(leftNodeID, -1) && can_replace_index_entries(parentNodeID, 1) &&
+		   nodePage->has_room_for_tuples_from(*raw_page(leftNodeID), 1))
 		{
-			// The node would be less than half full after a deletion, but its left sibling
-			// has a tuple to spare, so we can avoid the need for a merge.
+			// The node would be below its minimum after a deletion (it may already be, if it was
+			// made by a biased split), but its left sibling has a tuple to spare, so we can avoid
+			// the need for a merge.
 			redistribute_from_left_leaf_and_erase(nodeID, it);
 			return boost::none;
 		}
-		else if(hasUsefulRightSibling && has_at_least_min_tuples(m_nodes[nodeID].siblingRightID, -1))
+		else if(hasUsefulRightSibling && has_at_least_min_tuples(rightNodeID, -1) && can_replace_index_entries(parentNodeID, rightReplacementCount) &&
+				nodePage->has_room_for_tuples_from(*raw_page(rightNodeID), 1))
 		{
-			// The node would be less than half full after a deletion, but its right sibling
+			// The node would be below its minimum after a deletion, but its right sibling
 			// has a tuple to spare, so we can avoid the need for a merge.
 			redistribute_from_right_leaf_and_erase(nodeID, it);
 			return boost::none;
 		}
-		else if(hasUsefulLeftSibling)
+		else if(hasUsefulLeftSibling && can_merge(leftNodeID, nodeID, -1))
 		{
-			// The node would be less than half full after a deletion, and no redistribution from
+			// The node would be below its minimum after a deletion, and no redistribution from
 			// a sibling is possible; it does however have a useful left sibling, so first erase
-			// the tuple and then merge the two nodes.
-			return merge_leaves_and_erase(nodeID, it, m_nodes[nodeID].siblingLeftID, nodeID);
+			// the tuple and then merge the two nodes (which fit in one node, since the sibling
+			// is at its minimum).
+			return merge_leaves_and_erase(nodeID, it, leftNodeID, nodeID);
 		}
-		else
+		else if(hasUsefulRightSibling && can_merge(nodeID, rightNodeID, -1))
 		{
-			// The node would be less than half full after a deletion, and no redistribution from
+			// The node would be below its minimum after a deletion, and no redistribution from
 			// a sibling is possible; it does however have a useful right sibling, so first erase
-			// the tuple and then merge the two nodes.
-			return merge_leaves_and_erase(nodeID, it, nodeID, m_nodes[nodeID].siblingRightID);
+			// the tuple and then merge the two nodes (which fit in one node, since the sibling
+			// is at its minimum).
+			return merge_leaves_and_erase(nodeID, it, nodeID, rightNodeID);
+		}
+		else
+		{
+			// This can only happen if the separators are truncated, and a sibling has a tuple to spare but the parent
+			// has no room for the new index entries, or if the leaves' capacity depends on the values they hold, and
+			// this node has no room for a tuple from a sibling. Simply erase the tuple and leave the node underfull
+			// (within the bound described in the class documentation). The node cannot become empty, since it could
+			// then always be merged with either sibling.
+			assert(nodePage->tuple_count() > 1);
+			nodePage->erase_tuple(it);
+			return boost::none;
 		}
 	}
 }
 
 boost::optional<BTree::Merge> BTree::erase_tuple_from_subtree(const ValueKey& key, int nodeID)
 {
-	if(m_nodes[nodeID].has_children())
+	if(m_routes[nodeID].has_children())
 	{
 		return erase_tuple_from_branch(key, nodeID);
 	}
@@ -449,15 +1436,109 @@ boost::optional<BTree::Merge> BTree::erase_tuple_from_subtree(const ValueKey& ke
 	}
 }
 
+bool BTree::erase_tuples_from_branch(const RangeKey& key, int nodeID)
+{
+	// Make a note of the children of this node, and of the separators between them (the separator
+	// before each child other than the first is the key of that child's index entry).
+	std::vector<int> childIDs = child_node_ids(nodeID);
+	std::vector<ValueKey> separators;
+	separators.reserve(childIDs.size() - 1);
+	for(SortedPage::TupleSetCIter it = page_begin(nodeID), iend = page_end(nodeID); it != iend; ++it)
+	{
+		separators.push_back(branch_key_of(*it));
+	}
+
+	// Erase the relevant tuples from each child in turn, keeping track of the children that survive
+	// (and the index entries they will need). Children that lie entirely outside the range are left
+	// alone, children that lie entirely within it are deleted wholesale, and the remainder (normally
+	// at most two, one at each end of the range) are recursed into.
+	std::vector<int> survivorIDs;
+	std::vector<FreshTuple> survivorEntries;
+	for(size_t i = 0, size = childIDs.size(); i < size; ++i)
+	{
+		const ValueKey *lowerSeparator = i > 0 ? &separators[i - 1] : NULL;
+		const ValueKey *upperSeparator = i + 1 < size ? &separators[i] : NULL;
+
+		bool survives = true;
+		if(precedes_range(upperSeparator, key) || follows_range(lowerSeparator, key))
+		{
+			// The child lies entirely outside the range, so leave it alone.
+		}
+		else if(within_range(lowerSeparator, upperSeparator, key) || erase_tuples_from_subtree(key, childIDs[i]))
+		{
+			// The child lies entirely within the range (or has been emptied), so delete it.
+			delete_subtree(childIDs[i]);
+			survives = false;
+		}
+
+		if(survives)
+		{
+			// The first surviving child becomes the first child of this node; the others keep their original
+			// index entries, which remain valid because the separators still bound the surviving tuples.
+			if(!survivorIDs.empty()) survivorEntries.push_back(make_branch_tuple(separators[i - 1], childIDs[i]));
+			survivorIDs.push_back(childIDs[i]);
+		}
+	}
+
+	// Rebuild this node's page from the surviving children.
+	SortedPage_Ptr nodePage = page(nodeID);
+	nodePage->clear();
+	if(survivorIDs.empty())
+	{
+		m_routes[nodeID].firstChildID = -1;
+		return true;
+	}
+
+	m_routes[nodeID].firstChildID = survivorIDs.front();
+	for(std::vector<FreshTuple>::const_iterator it = survivorEntries.begin(), iend = survivorEntries.end(); it != iend; ++it)
+	{
+		nodePage->add_tuple(*it);
+	}
+
+	// Restore the minimum tuple invariant for any children that were left with too few tuples.
+	rebalance_children(nodeID);
+	update_tuple_count(nodeID);
+	return false;
+}
+
+bool BTree::erase_tuples_from_leaf(const RangeKey& key, int nodeID)
+{
+	SortedPage_Ptr nodePage = page(nodeID);
+	SortedPage::TupleSetCIter it = nodePage->lower_bound(key), iend = nodePage->upper_bound(key);
+	unsigned int n = static_cast<unsigned int>(std::distance(it, iend));
+	nodePage->erase_tuples(it, iend);
+
+	m_tupleCount -= n;
+	return nodePage->tuple_count() == 0;
+}
+
+bool BTree::erase_tuples_from_subtree(const RangeKey& key, int nodeID)
+{
+	if(m_routes[nodeID].has_children())
+	{
+		return erase_tuples_from_branch(key, nodeID);
+	}
+	else
+	{
+		return erase_tuples_from_leaf(key, nodeID);
+	}
+}
+
 SortedPage::TupleSetCIter BTree::find_index_entry(int nodeID) const
 {
 	const int parentNodeID = m_nodes[nodeID].parentID;
 	assert(parentNodeID != -1);
-	assert(m_nodes[parentNodeID].firstChildID != nodeID);
+	assert(m_routes[parentNodeID].firstChildID != nodeID);
 	SortedPage_Ptr parentPage = page(parentNodeID);
 
 	SortedPage::TupleSetCIter it;
-	if(page(nodeID)->tuple_count() > 0)
+	if(!m_truncatedBranchTupleManipulators.empty())
+	{
+		// If the separators are truncated, an entry's key is no longer derived from the node's own first
+		// tuple alone, so simply look for the index entry that refers to the node.
+		for(it = parentPage->begin(); child_node_id(*it) != nodeID; ++it);
+	}
+	else if(page(nodeID)->tuple_count() > 0)
 	{
 		// Normally, the node itself will contain at least one tuple,
 		// in which case we can use that to search for the entry in
@@ -477,8 +1558,18 @@ SortedPage::TupleSetCIter BTree::find_index_entry(int nodeID) const
 		// method that the node is not its parent's first child.
 		const int leftNodeID = m_nodes[nodeID].siblingLeftID;
 		assert(is_useful_sibling(nodeID, leftNodeID));
-		ValueKey key = make_branch_key(*page_begin(leftNodeID));
-		it = parentPage->upper_bound(key);
+		if(page(leftNodeID)->tuple_count() > 0)
+		{
+			ValueKey key = make_branch_key(*page_begin(leftNodeID));
+			it = parentPage->upper_bound(key);
+		}
+		else
+		{
+			// During a range erase, both the node and its left sibling may be branch nodes
+			// with only a single child (and hence no tuples), in which case we fall back to
+			// looking for the index entry that refers to the node.
+			for(it = parentPage->begin(); child_node_id(*it) != nodeID; ++it);
+		}
 	}
 
 	return it;
@@ -486,12 +1577,18 @@ SortedPage::TupleSetCIter BTree::find_index_entry(int nodeID) const
 
 bool BTree::has_at_least_min_tuples(int nodeID, int offset) const
 {
-	return page(nodeID)->tuple_count() + offset >= page(nodeID)->max_tuple_count() / 2;
+	const SortedPage *nodePage = raw_page(nodeID);
+	return nodePage->tuple_count() + offset >= nodePage->max_tuple_count() / 2;
 }
 
 bool BTree::has_less_than_max_tuples(int nodeID) const
 {
-	return page(nodeID)->empty_tuple_count() > 0;
+	return raw_page(nodeID)->empty_tuple_count() > 0;
+}
+
+bool BTree::has_room_for(int nodeID, const Tuple& tuple) const
+{
+	return raw_page(nodeID)->has_room_for(tuple);
 }
 
 boost::optional<BTree::Split> BTree::insert_tuple_into_branch(const Tuple& tuple, int nodeID)
@@ -499,8 +1596,14 @@ boost::optional<BTree::Split> BTree::insert_tuple_into_branch(const Tuple& tuple
 	// Find the child of this node below which the specified tuple should be inserted,
 	// and insert the tuple into the subtree below it.
 	int childNodeID = left_child_of(page(nodeID)->upper_bound(make_branch_key(tuple)), nodeID);
+	const unsigned int tupleCount = m_tupleCount;
 	boost::optional<Split> result = insert_tuple_into_subtree(tuple, childNodeID);
 
+	// If the tuple was actually inserted (which may not be the case if a leaf was split to make room for it, see
+	// split_leaf_and_insert), this node's subtree now contains one more tuple. A split of a node in this node's
+	// subtree only moves tuples around within it, so does not affect this.
+	if(m_counted && m_tupleCount != tupleCount) ++m_nodes[nodeID].tupleCount;
+
 	if(!result)
 	{
 		// The insertion succeeded without needing to split the direct child of this node.
@@ -535,24 +1638,30 @@ boost::optional<BTree::Split> BTree::insert_tuple_into_leaf(const Tuple& tuple,
 	const int leftNodeID = m_nodes[nodeID].siblingLeftID;
 	const int rightNodeID = m_nodes[nodeID].siblingRightID;
 
-	if(has_less_than_max_tuples(nodeID))
+	if(has_room_for(nodeID, tuple))
 	{
 		// This node has spare capacity, so simply insert the tuple into it.
 		page(nodeID)->add_tuple(tuple);
+		++m_tupleCount;
 		return boost::none;
 	}
-	else if(is_useful_sibling(nodeID, leftNodeID) && has_less_than_max_tuples(leftNodeID))
+	else if(is_useful_sibling(nodeID, leftNodeID) && can_redistribute_leaf_and_insert(nodeID, leftNodeID, tuple) && !is_append(nodeID, tuple) &&
+			can_replace_index_entries(m_nodes[nodeID].parentID, 1))
 	{
 		// This node is full, but its left sibling has the same parent and spare capacity,
-		// so we can avoid the need for a split.
+		// so we can avoid the need for a split. (We don't do this for appends, since more
+		// of them are likely to follow, and redistribution would only delay the split.)
 		redistribute_leaf_left_and_insert(nodeID, tuple);
+		++m_tupleCount;
 		return boost::none;
 	}
-	else if(is_useful_sibling(nodeID, rightNodeID) && has_less_than_max_tuples(rightNodeID))
+	else if(is_useful_sibling(nodeID, rightNodeID) && can_redistribute_leaf_and_insert(nodeID, rightNodeID, tuple) &&
+			can_replace_index_entries(m_nodes[nodeID].parentID, 1))
 	{
 		// This node is full, but its right sibling has the same parent and spare capacity,
 		// so we can avoid the need for a split.
 		redistribute_leaf_right_and_insert(nodeID, tuple);
+		++m_tupleCount;
 		return boost::none;
 	}
 	else
@@ -574,26 +1683,54 @@ boost::optional<BTree::Split> BTree::insert_tuple_into_leaf(const Tuple& tuple,
 
 boost::optional<BTree::Split> BTree::insert_tuple_into_subtree(const Tuple& tuple, int nodeID)
 {
-	if(m_nodes[nodeID].has_children())
+	if(m_routes[nodeID].has_children())
 	{
 		return insert_tuple_into_branch(tuple, nodeID);
 	}
 	else
 	{
-		return insert_tuple_into_leaf(tuple, nodeID);
+		return insert_tuple_into_leaf(tuple, nodeID);
+	}
+}
+
+bool BTree::is_append(int nodeID, const Tuple& tuple) const
+{
+	const SortedPage *nodePage = raw_page(nodeID);
+	if(m_nodes[nodeID].siblingRightID != -1 || nodePage->tuple_count() == 0) return false;
+	return m_routes[nodeID].has_children() ? BranchTupleComparator().compare(tuple, *nodePage->rbegin()) != -1
+										  : PrefixTupleComparator().compare(tuple, *nodePage->rbegin()) != -1;
+}
+
+bool BTree::is_useful_sibling(int nodeID, int siblingID) const
+{
+	return siblingID != -1 && m_nodes[siblingID].parentID == m_nodes[nodeID].parentID;
+}
+
+int BTree::leaf_for(const ValueKey& key, bool useUpperBound) const
+{
+	int id = m_rootID;
+	while(m_routes[id].has_children())
+	{
+		const SortedPage *nodePage = raw_page(id);
+		id = left_child_of(useUpperBound ? nodePage->upper_bound(key) : nodePage->lower_bound(key), id);
 	}
+	return id;
 }
 
-bool BTree::is_useful_sibling(int nodeID, int siblingID) const
+int BTree::leftmost_leaf_of(int nodeID) const
 {
-	return siblingID != -1 && m_nodes[siblingID].parentID == m_nodes[nodeID].parentID;
+	while(m_routes[nodeID].has_children())
+	{
+		nodeID = m_routes[nodeID].firstChildID;
+	}
+	return nodeID;
 }
 
 int BTree::left_child_of(const SortedPage::TupleSetCIter& it, int branchNodeID) const
 {
 	if(it == page_begin(branchNodeID))
 	{
-		return m_nodes[branchNodeID].firstChildID;
+		return m_routes[branchNodeID].firstChildID;
 	}
 	else
 	{
@@ -605,10 +1742,21 @@ int BTree::left_child_of(const SortedPage::TupleSetCIter& it, int branchNodeID)
 
 ValueKey BTree::make_branch_key(const Tuple& sourceTuple) const
 {
-	TupleManipulator branchTupleManipulator = branch_tuple_manipulator();
-	ValueKey result(branchTupleManipulator.field_manipulators(), m_branchKeyFieldIndices);
-	unsigned int branchKeyArity = m_branchKeyFieldIndices.size();
-	for(unsigned int i = 0; i < branchKeyArity; ++i)
+	ValueKey result(m_branchKeyPrototype);
+	for(unsigned int i = 0, branchKeyArity = result.arity(); i < branchKeyArity; ++i)
+	{
+		result.field(i).set_from(sourceTuple.field(i));
+	}
+	return result;
+}
+
+ValueKey BTree::make_branch_key(const Tuple& sourceTuple, unsigned int keyArity) const
+{
+	if(keyArity == m_branchKeyPrototype.arity()) return make_branch_key(sourceTuple);
+
+	assert(1 <= keyArity && keyArity <= m_truncatedBranchKeyPrototypes.size());
+	ValueKey result(m_truncatedBranchKeyPrototypes[keyArity - 1]);
+	for(unsigned int i = 0; i < keyArity; ++i)
 	{
 		result.field(i).set_from(sourceTuple.field(i));
 	}
@@ -619,8 +1767,11 @@ FreshTuple BTree::make_branch_tuple(const Tuple& sourceTuple, int childNodeID) c
 {
 	// A branch tuple has fields of the same type as some of the initial fields of a leaf tuple, plus a
 	// child node ID (of type int). For example, a B+-tree with leaf tuples of type <int,double,double>
-	// might have branch tuples of type <int,int>.
-	FreshTuple result(branch_tuple_manipulator());
+	// might have branch tuples of type <int,int>. If the separators are truncated, a branch tuple may
+	// have fewer key fields (e.g. if the source tuple is a truncated separator).
+	const unsigned int maxKeyArity = m_branchKeyPrototype.arity();
+	FreshTuple result(m_truncatedBranchTupleManipulators.empty() ? branch_tuple_manipulator() :
+					  m_truncatedBranchTupleManipulators[std::min(sourceTuple.arity(), maxKeyArity) - 1]);
 
 	// Copy fields across from the source tuple to fill up all but one of the fields of the branch tuple.
 	// Note that not every field of the source tuple has to be used, but that the source tuple must have
@@ -637,27 +1788,114 @@ FreshTuple BTree::make_branch_tuple(const Tuple& sourceTuple, int childNodeID) c
 	return result;
 }
 
+ValueKey BTree::make_index_key(int nodeID) const
+{
+	// The key must separate the first leaf tuple in the node's subtree from the last one to its left (if any).
+	const int leafID = leftmost_leaf_of(nodeID);
+	const int leftLeafID = m_nodes[leafID].siblingLeftID;
+	if(leftLeafID != -1 && raw_page(leftLeafID)->tuple_count() > 0) return make_separator(*page_rbegin(leftLeafID), *page_begin(leafID));
+	else return make_branch_key(*page_begin(leafID));
+}
+
+ValueKey BTree::make_separator(const Tuple& lastLeftTuple, const Tuple& firstRightTuple) const
+{
+	if(m_truncatedBranchTupleManipulators.empty()) return make_branch_key(firstRightTuple);
+
+	// Keep the leading fields of the right-hand tuple up to and including the first one that differs from the
+	// corresponding field of the left-hand tuple, or all of the branch key fields if they are all the same.
+	// Every tuple to the left of the separator is then ordered strictly before it, whilst every tuple to
+	// its right starts with it or is ordered after it.
+	const unsigned int maxKeyArity = m_branchKeyPrototype.arity();
+	unsigned int keyArity = 1;
+	while(keyArity < maxKeyArity && lastLeftTuple.field(keyArity - 1).compare_to(firstRightTuple.field(keyArity - 1)) == 0)
+	{
+		++keyArity;
+	}
+	return make_branch_key(firstRightTuple, keyArity);
+}
+
+BTreePageController::BTreeStructure BTree::make_structure() const
+{
+	BTreePageController::BTreeStructure structure;
+
+	// An empty B+-tree has nothing worth saving (and the page of its root leaf is not kept by the controller).
+	if(m_tupleCount == 0) return structure;
+
+	structure.counted = m_counted;
+	structure.firstLeafID = m_firstLeafID;
+	structure.lastLeafID = m_lastLeafID;
+	structure.rootID = m_rootID;
+	structure.tupleCount = m_tupleCount;
+
+	const int nodeCount = static_cast<int>(m_nodes.size());
+	structure.nodes.resize(nodeCount);
+	for(int id = 0; id < nodeCount; ++id)
+	{
+		const SortedPage *nodePage = raw_page(id);
+		if(!nodePage) continue;
+
+		BTreePageController::BTreeStructure::NodeRecord& record = structure.nodes[id];
+		const Node& n = m_nodes[id];
+		record.firstChildID = m_routes[id].firstChildID;
+		record.pageID = m_pageController->btree_page_id(*nodePage);
+		record.parentID = n.parentID;
+		record.siblingLeftID = n.siblingLeftID;
+		record.siblingRightID = n.siblingRightID;
+		record.tupleCount = n.tupleCount;
+	}
+
+	return structure;
+}
+
 BTree::Merge BTree::merge_branches(int leftNodeID, int rightNodeID)
 {
+	WHERY_BTREE_COUNT_EVENT(EVENT_MERGE_BRANCHES);
+
+	// Check that the left-hand node has space for the pulled-down index entry and all of the right-hand node's tuples.
+	assert(can_merge(leftNodeID, rightNodeID, 1));
+
 	// Pull down the index entry for the right-hand node from the parent page into the left-hand node.
-	pull_down_index_entry(rightNodeID, leftNodeID, m_nodes[rightNodeID].firstChildID);
+	pull_down_index_entry(rightNodeID, leftNodeID, m_routes[rightNodeID].firstChildID);
 
 	// Update the parent pointers for the children of the right-hand node to make them point to the left-hand node.
 	update_parent_pointers(rightNodeID, leftNodeID);
 
 	// Transfer all tuples from the right-hand node to the left-hand node.
-	assert(page(leftNodeID)->tuple_count() + page(rightNodeID)->tuple_count() <= page(leftNodeID)->max_tuple_count());
 	transfer_leaf_tuples_left(rightNodeID, page(rightNodeID)->tuple_count());
 
 	// Disconnect the right-hand node from the B+-tree and delete it.
 	disconnect_node_from_siblings(rightNodeID);
 	delete_node(rightNodeID);
 
+	update_tuple_count(leftNodeID);
+	return Merge(leftNodeID);
+}
+
+BTree::Merge BTree::merge_leaves(int leftNodeID, int rightNodeID)
+{
+	WHERY_BTREE_COUNT_EVENT(EVENT_MERGE_LEAVES);
+
+	// Erase the index entry for the right-hand node from the parent page.
+	erase_index_entry(rightNodeID);
+
+	// Transfer all tuples from the right-hand node to the left-hand node.
+	assert(can_merge(leftNodeID, rightNodeID, 0));
+	transfer_leaf_tuples_left(rightNodeID, page(rightNodeID)->tuple_count());
+
+	// Disconnect the right-hand node from the B+-tree and delete it.
+	disconnect_node_from_siblings(rightNodeID);
+	delete_node(rightNodeID);
+
+	// Update the last leaf ID if necessary.
+	if(m_lastLeafID == rightNodeID) m_lastLeafID = leftNodeID;
+
 	return Merge(leftNodeID);
 }
 
 BTree::Merge BTree::merge_leaves_and_erase(int nodeID, const SortedPage::TupleSetCIter& it, int leftNodeID, int rightNodeID)
 {
+	WHERY_BTREE_COUNT_EVENT(EVENT_MERGE_LEAVES);
+
 	// Erase the index entry for the right-hand node from the parent page.
 	erase_index_entry(rightNodeID);
 
@@ -665,7 +1903,7 @@ BTree::Merge BTree::merge_leaves_and_erase(int nodeID, const SortedPage::TupleSe
 	page(nodeID)->erase_tuple(it);
 
 	// Transfer all tuples from the right-hand node to the left-hand node.
-	assert(page(leftNodeID)->tuple_count() + page(rightNodeID)->tuple_count() <= page(leftNodeID)->max_tuple_count());
+	assert(can_merge(leftNodeID, rightNodeID, 0));
 	transfer_leaf_tuples_left(rightNodeID, page(rightNodeID)->tuple_count());
 
 	// Disconnect the right-hand node from the B+-tree and delete it.
@@ -678,36 +1916,114 @@ BTree::Merge BTree::merge_leaves_and_erase(int nodeID, const SortedPage::TupleSe
 	return Merge(leftNodeID);
 }
 
+BTree::ConstIterator BTree::optimistic_bound(const ValueKey& key, bool upper, boost::optional<FreshTuple> *match) const
+{
+	for(bool restarting = false;; restarting = true)
+	{
+		if(restarting) WHERY_BTREE_COUNT_EVENT(EVENT_OPTIMISTIC_RESTART);
+
+		// Start (or restart) the search from the root, waiting until no structure modification is in progress.
+		const unsigned int structureVersion = stable_version(m_structureVersion);
+		int id = m_rootID.load(boost::memory_order_acquire);
+		unsigned int version = stable_version(m_nodes[id].version);
+		SortedPage_Ptr nodePage = boost::atomic_load(&m_nodes[id].page);
+		if(!nodePage) continue;
+
+		// Walk down the B+-tree to find the bound. Before moving on from each node, we check that neither the node
+		// nor the structure of the tree has changed since we started reading it, since otherwise the ID of the child
+		// we read may be garbage. We then read the child's version and check again, so that the child cannot have
+		// been modified (or deleted) between our reading its ID and our reading its version.
+		SortedPage::TupleSetCIter it = upper ? nodePage->upper_bound(key) : nodePage->lower_bound(key);
+		bool valid = true;
+		while(valid && m_routes[id].has_children())
+		{
+			int childID = m_routes[id].firstChildID.load(boost::memory_order_relaxed);
+			if(it != nodePage->begin())
+			{
+				SortedPage::TupleSetCIter jt = it;
+				--jt;
+				childID = jt->field(jt->arity() - 1).get_int();
+			}
+
+			if(!versions_unchanged(m_nodes[id].version, version, m_structureVersion, structureVersion)) break;
+			const unsigned int childVersion = stable_version(m_nodes[childID].version);
+			if(!versions_unchanged(m_nodes[id].version, version, m_structureVersion, structureVersion)) break;
+
+			id = childID;
+			version = childVersion;
+			nodePage = boost::atomic_load(&m_nodes[id].page);
+			valid = nodePage.get() != NULL;
+			if(valid) it = upper ? nodePage->upper_bound(key) : nodePage->lower_bound(key);
+		}
+		if(!valid || m_routes[id].has_children()) continue;
+
+		// If the iterator points to the end of the leaf page, move it to the start
+		// of the leaf page's right sibling (if any), using the same protocol. Note
+		// that a writer may have erased tuples from the page since we searched it,
+		// so the iterator may now be beyond the end of the page rather than at it.
+		const int siblingRightID = m_nodes[id].siblingRightID.load(boost::memory_order_relaxed);
+		if(it.index() >= nodePage->tuple_count() && siblingRightID != -1)
+		{
+			if(!versions_unchanged(m_nodes[id].version, version, m_structureVersion, structureVersion)) continue;
+			const unsigned int siblingVersion = stable_version(m_nodes[siblingRightID].version);
+			if(!versions_unchanged(m_nodes[id].version, version, m_structureVersion, structureVersion)) continue;
+
+			id = siblingRightID;
+			version = siblingVersion;
+			nodePage = boost::atomic_load(&m_nodes[id].page);
+			if(!nodePage) continue;
+			it = nodePage->begin();
+		}
+
+		// If requested, copy the tuple at the bound before the final check, so that the copy is known to be consistent.
+		if(match)
+		{
+			*match = boost::none;
+			if(it.index() < nodePage->tuple_count())
+			{
+				FreshTuple tuple(nodePage->tuple_manipulator());
+				tuple.copy_from(*it);
+				*match = tuple;
+			}
+		}
+
+		if(versions_unchanged(m_nodes[id].version, version, m_structureVersion, structureVersion))
+		{
+			return ConstIterator(this, id, it);
+		}
+	}
+}
+
 SortedPage_Ptr BTree::page(int nodeID) const
 {
-	return m_nodes[nodeID].page;
+	return m_concurrent ? boost::atomic_load(&m_nodes[nodeID].page) : m_nodes[nodeID].page;
 }
 
 SortedPage::TupleSetCIter BTree::page_begin(int nodeID) const
 {
-	SortedPage_Ptr p = page(nodeID);
-	assert(p.get() != NULL);
+	const SortedPage *p = raw_page(nodeID);
+	assert(p != NULL);
 	return p->begin();
 }
 
 SortedPage::TupleSetCIter BTree::page_end(int nodeID) const
 {
-	SortedPage_Ptr p = page(nodeID);
-	assert(p.get() != NULL);
+	const SortedPage *p = raw_page(nodeID);
+	assert(p != NULL);
 	return p->end();
 }
 
 SortedPage::TupleSetCRIter BTree::page_rbegin(int nodeID) const
 {
-	SortedPage_Ptr p = page(nodeID);
-	assert(p.get() != NULL);
+	const SortedPage *p = raw_page(nodeID);
+	assert(p != NULL);
 	return p->rbegin();
 }
 
 SortedPage::TupleSetCRIter BTree::page_rend(int nodeID) const
 {
-	SortedPage_Ptr p = page(nodeID);
-	assert(p.get() != NULL);
+	const SortedPage *p = raw_page(nodeID);
+	assert(p != NULL);
 	return p->rend();
 }
 
@@ -721,6 +2037,8 @@ void BTree::print_subtree(std::ostream& os, int nodeID, unsigned int depth) cons
 	write_tabbed_text(os, depth, "Parent: " + lexical_cast<std::string>(n.parentID));
 	write_tabbed_text(os, depth, "Left Sibling: " + lexical_cast<std::string>(n.siblingLeftID));
 	write_tabbed_text(os, depth, "Right Sibling: " + lexical_cast<std::string>(n.siblingRightID));
+	const NodeRoute& r = m_routes[nodeID];
+	if(m_counted && r.has_children()) write_tabbed_text(os, depth, "Tuple Count: " + lexical_cast<std::string>(n.tupleCount));
 
 	// Print the tuples held by the node.
 	for(SortedPage::TupleSetCIter it = page_begin(nodeID), iend = page_end(nodeID); it != iend; ++it)
@@ -737,9 +2055,9 @@ void BTree::print_subtree(std::ostream& os, int nodeID, unsigned int depth) cons
 	}
 
 	// Recursively print the children of the node (if any).
-	if(n.has_children())
+	if(r.has_children())
 	{
-		print_subtree(os, n.firstChildID, depth + 1);
+		print_subtree(os, r.firstChildID, depth + 1);
 		for(SortedPage::TupleSetCIter it = page_begin(nodeID), iend = page_end(nodeID); it != iend; ++it)
 		{
 			print_subtree(os, child_node_id(*it), depth + 1);
@@ -750,35 +2068,193 @@ void BTree::print_subtree(std::ostream& os, int nodeID, unsigned int depth) cons
 void BTree::pull_down_index_entry(int sourceNodeID, int targetNodeID, int childNodeID)
 {
 	SortedPage::TupleSetCIter it = find_index_entry(sourceNodeID);
-	page(targetNodeID)->add_tuple(make_branch_tuple(*it, childNodeID));
+	page(targetNodeID)->add_tuple(make_branch_tuple(branch_key_of(*it), childNodeID));
 	page(m_nodes[sourceNodeID].parentID)->erase_tuple(it);
 }
 
+BTree::EqualRangeResult BTree::range_bounds(const RangeKey& key) const
+{
+	if(key.is_valid())
+	{
+		return std::make_pair(lower_bound(key), upper_bound(key));
+	}
+	else
+	{
+		ConstIterator it = lower_bound(key);
+		return std::make_pair(it, it);
+	}
+}
+
+unsigned int BTree::rank_of_bound(const ValueKey& key, bool upper) const
+{
+	unsigned int result = 0;
+
+	// Walk down the B+-tree as in lower_bound/upper_bound, at each branch node adding the
+	// counts of all of the children to the left of the one we are about to descend into.
+	int id = m_rootID;
+	SortedPage::TupleSetCIter it = upper ? raw_page(id)->upper_bound(key) : raw_page(id)->lower_bound(key);
+	while(m_routes[id].has_children())
+	{
+		int childID = m_routes[id].firstChildID;
+		for(SortedPage::TupleSetCIter jt = page_begin(id); jt != it; ++jt)
+		{
+			result += subtree_tuple_count(childID);
+			childID = child_node_id(*jt);
+		}
+
+		id = childID;
+		it = upper ? raw_page(id)->upper_bound(key) : raw_page(id)->lower_bound(key);
+	}
+
+	// Add the position of the bound within the leaf. (If the bound is at the end of the leaf,
+	// it is really at the start of the leaf's right sibling, which has the same rank.)
+	return result + it.index();
+}
+
+SortedPage *BTree::raw_page(int nodeID) const
+{
+	return m_routes[nodeID].rawPage.load(boost::memory_order_acquire);
+}
+
+void BTree::rebalance_children(int nodeID)
+{
+	// Repeatedly look for a child with too few tuples and rebalance it with an adjacent child, until there are none left
+	// (or, if the separators are truncated, none that can be rebalanced). Note that we start again from scratch after each
+	// rebalancing, since merges change the set of children.
+	for(bool changed = true; changed;)
+	{
+		changed = false;
+		std::vector<int> childIDs = child_node_ids(nodeID);
+		if(childIDs.size() < 2) return;
+
+		for(size_t i = 0, size = childIDs.size(); i < size && !changed; ++i)
+		{
+			if(has_at_least_min_tuples(childIDs[i])) continue;
+
+			// Prefer to rebalance with the left sibling, since the child is then not the first child of the pair.
+			if(i > 0) changed = rebalance_siblings(childIDs[i - 1], childIDs[i]);
+			else changed = rebalance_siblings(childIDs[i], childIDs[i + 1]);
+		}
+	}
+}
+
+bool BTree::rebalance_siblings(int leftNodeID, int rightNodeID)
+{
+	assert(is_useful_sibling(leftNodeID, rightNodeID));
+	SortedPage_Ptr leftPage = page(leftNodeID), rightPage = page(rightNodeID);
+	const unsigned int leftCount = leftPage->tuple_count(), rightCount = rightPage->tuple_count();
+	const int parentNodeID = m_nodes[leftNodeID].parentID;
+
+	if(m_routes[leftNodeID].has_children())
+	{
+		// Note that merging two branch nodes pulls down the index entry that separates them.
+		if(can_merge(leftNodeID, rightNodeID, 1))
+		{
+			Merge merge = merge_branches(leftNodeID, rightNodeID);
+			rebalance_children(merge.nodeID);
+		}
+		else
+		{
+			// Move index entries across one at a time until both nodes satisfy their minimum tuple invariant. (Unless the
+			// separators are truncated, the donor always has an entry to spare and the parent always has room to rotate.)
+			bool changed = false;
+			while(!has_at_least_min_tuples(leftNodeID) && has_at_least_min_tuples(rightNodeID, -1) && can_replace_index_entries(parentNodeID, 1))
+			{
+				redistribute_from_right_branch(leftNodeID);
+				changed = true;
+			}
+			while(!has_at_least_min_tuples(rightNodeID) && has_at_least_min_tuples(leftNodeID, -1) && can_replace_index_entries(parentNodeID, 1))
+			{
+				redistribute_from_left_branch(rightNodeID);
+				changed = true;
+			}
+			if(!changed) return false;
+
+			rebalance_children(leftNodeID);
+			rebalance_children(rightNodeID);
+		}
+	}
+	else
+	{
+		// Work out how many tuples would have to move across to restore the minimum tuple invariant for
+		// whichever node has too few tuples (if the pages have the same capacity, there are enough between
+		// them for both to have their minimum, but that need not be the case if it depends on their values).
+		const bool toLeft = !has_at_least_min_tuples(leftNodeID);
+		const SortedPage_Ptr& targetPage = toLeft ? leftPage : rightPage;
+		const SortedPage_Ptr& sourcePage = toLeft ? rightPage : leftPage;
+		const unsigned int n = targetPage->max_tuple_count() / 2 - (toLeft ? leftCount : rightCount);
+
+		if(can_merge(leftNodeID, rightNodeID, 0))
+		{
+			merge_leaves(leftNodeID, rightNodeID);
+		}
+		else if(!can_replace_index_entries(parentNodeID, 1) || n >= sourcePage->tuple_count() || !targetPage->has_room_for_tuples_from(*sourcePage, n))
+		{
+			// The parent has no room for the right-hand node's new index entry, or the tuples cannot be moved across,
+			// so leave the nodes as they are.
+			return false;
+		}
+		else
+		{
+			// Move the tuples across. The index entry for the right-hand node is updated to reflect its new first tuple.
+			WHERY_BTREE_COUNT_EVENT(EVENT_REDISTRIBUTE_LEAF);
+			erase_index_entry(rightNodeID);
+			if(toLeft) transfer_leaf_tuples_left(rightNodeID, n);
+			else transfer_leaf_tuples_right(leftNodeID, n);
+			add_index_entry(rightNodeID);
+		}
+	}
+
+	return true;
+}
+
+unsigned int BTree::recount_subtree(int nodeID)
+{
+	if(!m_routes[nodeID].has_children()) return raw_page(nodeID)->tuple_count();
+
+	unsigned int tupleCount = 0;
+	std::vector<int> childIDs = child_node_ids(nodeID);
+	for(std::vector<int>::const_iterator it = childIDs.begin(), iend = childIDs.end(); it != iend; ++it)
+	{
+		tupleCount += recount_subtree(*it);
+	}
+
+	m_nodes[nodeID].tupleCount = tupleCount;
+	return tupleCount;
+}
+
 void BTree::redistribute_from_left_branch(int nodeID)
 {
+	WHERY_BTREE_COUNT_EVENT(EVENT_REDISTRIBUTE_BRANCH);
+
 	const int leftNodeID = m_nodes[nodeID].siblingLeftID;
 
-	assert(m_nodes[nodeID].has_children());
+	assert(m_routes[nodeID].has_children());
 	assert(is_useful_sibling(nodeID, leftNodeID));
 
 	// Pull the index entry for the node down from its parent page.
-	pull_down_index_entry(nodeID, nodeID, m_nodes[nodeID].firstChildID);
+	pull_down_index_entry(nodeID, nodeID, m_routes[nodeID].firstChildID);
 
 	// Make a note of the last child of the left sibling.
 	SortedPage_Ptr leftPage = page(leftNodeID);
 	int childID = child_node_id(*leftPage->rbegin());
 
 	// Push the last index entry of the left sibling up to the parent node.
-	page(m_nodes[nodeID].parentID)->add_tuple(make_branch_tuple(*leftPage->rbegin(), nodeID));
+	page(m_nodes[nodeID].parentID)->add_tuple(make_branch_tuple(branch_key_of(*leftPage->rbegin()), nodeID));
 	leftPage->erase_tuple(leftPage->rbegin());
 
 	// Update the first child of the node to be the former last child of its left sibling.
-	m_nodes[nodeID].firstChildID = childID;
+	m_routes[nodeID].firstChildID = childID;
 	m_nodes[childID].parentID = nodeID;
+
+	update_tuple_count(leftNodeID);
+	update_tuple_count(nodeID);
 }
 
 void BTree::redistribute_from_left_leaf_and_erase(int nodeID, const SortedPage::TupleSetCIter& it)
 {
+	WHERY_BTREE_COUNT_EVENT(EVENT_REDISTRIBUTE_LEAF);
+
 	// Erase the index entry for this node from the parent page (an updated index
 	// entry will be re-added below).
 	erase_index_entry(nodeID);
@@ -795,13 +2271,15 @@ void BTree::redistribute_from_left_leaf_and_erase(int nodeID, const SortedPage::
 
 void BTree::redistribute_from_right_branch(int nodeID)
 {
+	WHERY_BTREE_COUNT_EVENT(EVENT_REDISTRIBUTE_BRANCH);
+
 	const int rightNodeID = m_nodes[nodeID].siblingRightID;
 
-	assert(m_nodes[nodeID].has_children());
+	assert(m_routes[nodeID].has_children());
 	assert(is_useful_sibling(nodeID, rightNodeID));
 
 	// Pull the index entry for the node's right sibling down from the parent into this node.
-	pull_down_index_entry(rightNodeID, nodeID, m_nodes[rightNodeID].firstChildID);
+	pull_down_index_entry(rightNodeID, nodeID, m_routes[rightNodeID].firstChildID);
 
 	// Update the parent pointer of the new last child of this node (the former
 	// first child of this node's right sibling) to point to this node.
@@ -812,15 +2290,20 @@ void BTree::redistribute_from_right_branch(int nodeID)
 	int childID = child_node_id(*rightPage->begin());
 
 	// Push the first index entry of the right sibling up to the parent node.
-	page(m_nodes[nodeID].parentID)->add_tuple(make_branch_tuple(*rightPage->begin(), rightNodeID));
+	page(m_nodes[nodeID].parentID)->add_tuple(make_branch_tuple(branch_key_of(*rightPage->begin()), rightNodeID));
 	rightPage->erase_tuple(rightPage->begin());
 
 	// Update the first child of the right sibling to be the stored child value.
-	m_nodes[rightNodeID].firstChildID = childID;
+	m_routes[rightNodeID].firstChildID = childID;
+
+	update_tuple_count(nodeID);
+	update_tuple_count(rightNodeID);
 }
 
 void BTree::redistribute_from_right_leaf_and_erase(int nodeID, const SortedPage::TupleSetCIter& it)
 {
+	WHERY_BTREE_COUNT_EVENT(EVENT_REDISTRIBUTE_LEAF);
+
 	const int parentNodeID = m_nodes[nodeID].parentID;
 	const int rightNodeID = m_nodes[nodeID].siblingRightID;
 
@@ -831,7 +2314,7 @@ void BTree::redistribute_from_right_leaf_and_erase(int nodeID, const SortedPage:
 	// If this node is not its parent's first child, similarly erase its index entry.
 	// This is needed for the special case in which we're erasing the last tuple from
 	// this node, since the index entry in the parent will then need to change.
-	if(nodeID != m_nodes[parentNodeID].firstChildID)
+	if(nodeID != m_routes[parentNodeID].firstChildID)
 	{
 		erase_index_entry(nodeID);
 	}
@@ -846,7 +2329,7 @@ void BTree::redistribute_from_right_leaf_and_erase(int nodeID, const SortedPage:
 	add_index_entry(rightNodeID);
 
 	// If this node is not its parent's first child, similarly re-add an index entry for it.
-	if(nodeID != m_nodes[parentNodeID].firstChildID)
+	if(nodeID != m_routes[parentNodeID].firstChildID)
 	{
 		add_index_entry(nodeID);
 	}
@@ -854,16 +2337,30 @@ void BTree::redistribute_from_right_leaf_and_erase(int nodeID, const SortedPage:
 
 void BTree::redistribute_leaf_left_and_insert(int nodeID, const Tuple& tuple)
 {
+	WHERY_BTREE_COUNT_EVENT(EVENT_REDISTRIBUTE_LEAF);
+
 	// Erase the index entry for this node from the parent page (an updated index
 	// entry will be re-added below).
 	erase_index_entry(nodeID);
 
-	// Noting that the tuple being inserted must be at least as large as the
-	// first tuple on this page, or we wouldn't be trying to insert it here,
-	// we can redistribute the first tuple across to the left sibling to make
-	// space, and then insert the tuple into this page.
-	transfer_leaf_tuples_left(nodeID, 1);
-	page(nodeID)->add_tuple(tuple);
+	if(PrefixTupleComparator().compare(tuple, *page_begin(nodeID)) == -1)
+	{
+		// If the tuple being inserted is less than the first tuple on this page, it can be
+		// inserted into the left sibling (which has space). Note that this is a valid thing
+		// to do because the tuple must also be no less than the last tuple on the left page,
+		// since its branch key is no less than the index entry for this page (or we wouldn't
+		// be trying to insert it here in the first place). This can happen when the branch
+		// key is a proper prefix of the leaf key, and a run of equal branch keys spans the
+		// two pages.
+		page(m_nodes[nodeID].siblingLeftID)->add_tuple(tuple);
+	}
+	else
+	{
+		// Otherwise, we can redistribute the first tuple across to the left sibling
+		// to make space, and then insert the tuple into this page.
+		transfer_leaf_tuples_left(nodeID, 1);
+		page(nodeID)->add_tuple(tuple);
+	}
 
 	// Re-add an index entry for this node to the parent page.
 	add_index_entry(nodeID);
@@ -871,6 +2368,8 @@ void BTree::redistribute_leaf_left_and_insert(int nodeID, const Tuple& tuple)
 
 void BTree::redistribute_leaf_right_and_insert(int nodeID, const Tuple& tuple)
 {
+	WHERY_BTREE_COUNT_EVENT(EVENT_REDISTRIBUTE_LEAF);
+
 	const int rightNodeID = m_nodes[nodeID].siblingRightID;
 
 	// Erase the index entry for the right sibling from the parent page (an updated
@@ -899,87 +2398,230 @@ void BTree::redistribute_leaf_right_and_insert(int nodeID, const Tuple& tuple)
 	add_index_entry(rightNodeID);
 }
 
+void BTree::release_retired_pages()
+{
+	// A retired page is no longer reachable from the tree, so if we hold the only reference
+	// to it, no reader can still be using it (or start using it in future).
+	for(size_t i = 0; i < m_retiredPages.size();)
+	{
+		if(m_retiredPages[i].unique())
+		{
+			m_retiredPages[i] = m_retiredPages.back();
+			m_retiredPages.pop_back();
+		}
+		else ++i;
+	}
+}
+
+void BTree::restore_structure(const BTreePageController::BTreeStructure& structure)
+{
+	// Allocate the IDs of all of the nodes, and then deallocate the ones that are not in use, so that
+	// the node ID allocator ends up in the same state as if the nodes had just been added.
+	const int nodeCount = static_cast<int>(structure.nodes.size());
+	m_nodeIDAllocator.reserve(nodeCount);
+	for(int id = 0; id < nodeCount; ++id) m_nodeIDAllocator.allocate();
+	m_nodes.resize(nodeCount);
+	m_routes.resize(nodeCount);
+
+	for(int id = nodeCount - 1; id >= 0; --id)
+	{
+		const BTreePageController::BTreeStructure::NodeRecord& record = structure.nodes[id];
+		if(record.pageID == -1)
+		{
+			m_nodeIDAllocator.deallocate(id);
+			continue;
+		}
+
+		Node& n = m_nodes[id];
+		n.parentID = record.parentID;
+		n.siblingLeftID = record.siblingLeftID;
+		n.siblingRightID = record.siblingRightID;
+		n.tupleCount = record.tupleCount;
+		m_routes[id].firstChildID = record.firstChildID;
+		set_page(id, m_pageController->reopen_btree_page(record.pageID, record.firstChildID == -1));
+	}
+
+	m_firstLeafID = structure.firstLeafID;
+	m_lastLeafID = structure.lastLeafID;
+	m_rootID = structure.rootID;
+	m_tupleCount = structure.tupleCount;
+
+	// If the B+-tree was not counted when it was saved, but is counted now, its subtree counts must be worked out afresh.
+	if(m_counted && !structure.counted) recount_subtree(m_rootID);
+}
+
+std::vector<BTree::ConstIterator> BTree::scan_boundaries(const ConstIterator& lower, const ConstIterator& upper, unsigned int runCount) const
+{
+	// Find the ancestors of the leaves containing the ends of the range at each level, from the root down
+	// (the tree is balanced, so both leaves have the same number of ancestors).
+	std::vector<int> lowerPath, upperPath;
+	for(int id = lower.m_nodeID; id != -1; id = m_nodes[id].parentID) lowerPath.push_back(id);
+	for(int id = upper.m_nodeID; id != -1; id = m_nodes[id].parentID) upperPath.push_back(id);
+	std::reverse(lowerPath.begin(), lowerPath.end());
+	std::reverse(upperPath.begin(), upperPath.end());
+
+	// Find the nodes spanned by the range at the highest level at which there are at least runCount of them (or
+	// at the leaf level). Since each level spans fewer than runCount nodes until then, this only walks a bounded
+	// number of nodes, however big the range.
+	std::vector<int> nodeIDs;
+	for(size_t depth = 0, height = lowerPath.size(); depth < height; ++depth)
+	{
+		nodeIDs.clear();
+		for(int id = lowerPath[depth]; ; id = m_nodes[id].siblingRightID)
+		{
+			nodeIDs.push_back(id);
+			if(id == upperPath[depth]) break;
+		}
+		if(nodeIDs.size() >= runCount) break;
+	}
+
+	// Each run after the first starts at the beginning of the leftmost leaf of one of the nodes.
+	std::vector<ConstIterator> result(1, lower);
+	for(size_t i = 1, size = nodeIDs.size(); i < size; ++i)
+	{
+		const int leafID = leftmost_leaf_of(nodeIDs[i]);
+		ConstIterator it(this, leafID, page_begin(leafID));
+		if(it != result.back() && it != upper) result.push_back(it);
+	}
+	result.push_back(upper);
+	return result;
+}
+
+void BTree::set_page(int nodeID, const SortedPage_Ptr& page)
+{
+	boost::atomic_store(&m_nodes[nodeID].page, page);
+	m_routes[nodeID].rawPage.store(page.get(), boost::memory_order_release);
+}
+
 BTree::Split BTree::split_branch_and_insert(int nodeID, const FreshTuple& tuple)
 {
+	WHERY_BTREE_COUNT_EVENT(EVENT_SPLIT_BRANCH);
+
 	// Check that the branch is full.
 	assert(!has_less_than_max_tuples(nodeID));
 
+	// Note whether the tuple is being appended to the end of the level (this must be checked before the node gets a right sibling).
+	const bool append = is_append(nodeID, tuple);
+
 	// Create a fresh branch node and connect it to the rest of the tree.
 	int freshID = add_branch_node();
 	connect_node_as_right_sibling_of(freshID, nodeID);
 
 	// Make a tuple set containing fresh copies of all the tuples in the original page.
-	typedef std::multiset<FreshTuple,PrefixTupleComparator> FreshTupleSet;
+	typedef std::multiset<FreshTuple,BranchTupleComparator> FreshTupleSet;
 	FreshTupleSet tuples;
-	TupleManipulator branchTupleManipulator = branch_tuple_manipulator();
 	SortedPage_Ptr nodePage = page(nodeID);
 	for(SortedPage::TupleSetCIter it = nodePage->begin(), iend = nodePage->end(); it != iend; ++it)
 	{
-		FreshTuple temp(branchTupleManipulator);
-		temp.copy_from(*it);
-		tuples.insert(temp);
+		tuples.insert(make_branch_tuple(branch_key_of(*it), child_node_id(*it)));
 	}
 
 	// Add the tuple to be inserted to the set.
 	tuples.insert(tuple);
 
-	// Clear the original page and copy the first half of the tuple set across to it.
+	// Clear the original page and copy the first half of the tuple set across to it. If the tuple is being appended, bias
+	// the split to the right as for leaves (see split_leaf_and_insert), whilst still leaving at least one tuple for the fresh page.
 	nodePage->clear();
+	const unsigned int size = static_cast<unsigned int>(tuples.size());
+	unsigned int leftCount = append ? size - 1 - std::max(1u, (size - 1) / APPEND_SPLIT_DIVISOR) : size / 2;
 	FreshTupleSet::const_iterator it = tuples.begin(), iend = tuples.end();
-	for(unsigned int i = 0, size = tuples.size(); i < size / 2; ++it, ++i)
+	if(!m_truncatedBranchTupleManipulators.empty())
+	{
+		// If the separators are truncated, the tuples vary in size, so divide them by size rather than by number,
+		// with the same bias for appends (whilst still leaving at least one tuple for each page).
+		std::vector<unsigned int> sizes;
+		sizes.reserve(size);
+		unsigned int totalSize = 0;
+		for(FreshTupleSet::const_iterator jt = tuples.begin(); jt != iend; ++jt)
+		{
+			sizes.push_back(m_truncatedBranchTupleManipulators[jt->arity() - 2].size());
+			totalSize += sizes.back();
+		}
+
+		const unsigned int leftSize = append ? totalSize - totalSize / APPEND_SPLIT_DIVISOR : totalSize / 2;
+		leftCount = 0;
+		for(unsigned int accumulatedSize = 0; leftCount < size && (accumulatedSize += sizes[leftCount]) <= leftSize; ++leftCount);
+		leftCount = std::max(1u, std::min(leftCount, size - 2));
+	}
+
+	for(unsigned int i = 0; i < leftCount; ++it, ++i)
 	{
 		nodePage->add_tuple(*it);
 	}
 
-	// Record the median as the splitter.
-	FreshTuple splitter(branchTupleManipulator);
-	splitter.copy_from(*it);
+	// Record the key of the median as the splitter (its child becomes the first child of the fresh node).
+	const int medianChildID = child_node_id(*it);
+	FreshTuple splitter = branch_key_of(*it);
 	++it;
 
-	// Copy the second half of the tuple set across to the fresh page.
+	// Copy the rest of the tuple set across to the fresh page.
 	SortedPage_Ptr freshPage = page(freshID);
 	for(; it != iend; ++it)
 	{
 		freshPage->add_tuple(*it);
 	}
 
-	// Set the first child of the fresh node to be the child pointed to by the splitter.
-	m_nodes[freshID].firstChildID = child_node_id(splitter);
+	// Set the first child of the fresh node to be the child pointed to by the median.
+	m_routes[freshID].firstChildID = medianChildID;
 
 	// Update the parent pointers of all the children of the fresh page.
 	update_parent_pointers(freshID, freshID);
 
+	update_tuple_count(nodeID);
+	update_tuple_count(freshID);
+
 	return Split(nodeID, freshID, splitter);
 }
 
 BTree::Split BTree::split_leaf_and_insert(int nodeID, const Tuple& tuple)
 {
-	// Check that the leaf is full.
-	assert(!has_less_than_max_tuples(nodeID));
+	WHERY_BTREE_COUNT_EVENT(EVENT_SPLIT_LEAF);
+
+	// Check that the leaf is full (or at least has no room for the tuple).
+	assert(!has_room_for(nodeID, tuple));
+
+	// Note whether the tuple is being appended to the end of the B+-tree (this must be checked before the node gets a right sibling).
+	const bool append = is_append(nodeID, tuple);
 
 	// Create a fresh leaf node and connect it to the rest of the tree.
 	int freshID = add_leaf_node();
 	connect_node_as_right_sibling_of(freshID, nodeID);
 
-	// Transfer half of the tuples across to the fresh node.
-	transfer_leaf_tuples_right(nodeID, page(nodeID)->tuple_count() / 2);
-
-	// Compare the tuple to be inserted against the first tuple on the fresh page.
-	// If it's strictly before that tuple in the ordering, insert it into this page;
-	// if not, insert it into the fresh page.
-	if(PrefixTupleComparator().compare(tuple, *page_begin(freshID)) == -1)
+	if(append)
 	{
-		page(nodeID)->add_tuple(tuple);
+		// The tuple is being appended, and more appends are likely to follow, so leave this node almost full
+		// and put the tuple into the fresh node, which the subsequent appends will fill. Note that the fresh
+		// node may end up with fewer than the usual minimum number of tuples, which erasures can cope with.
+		transfer_leaf_tuples_right(nodeID, page(nodeID)->tuple_count() / APPEND_SPLIT_DIVISOR);
+		if(has_room_for(freshID, tuple))
+		{
+			page(freshID)->add_tuple(tuple);
+			++m_tupleCount;
+		}
 	}
 	else
 	{
-		page(freshID)->add_tuple(tuple);
+		// Transfer half of the tuples across to the fresh node.
+		transfer_leaf_tuples_right(nodeID, page(nodeID)->tuple_count() / 2);
+
+		// Compare the tuple to be inserted against the first tuple on the fresh page.
+		// If it's strictly before that tuple in the ordering, insert it into this page;
+		// if not, insert it into the fresh page.
+		const int targetID = PrefixTupleComparator().compare(tuple, *page_begin(freshID)) == -1 ? nodeID : freshID;
+		if(has_room_for(targetID, tuple))
+		{
+			page(targetID)->add_tuple(tuple);
+			++m_tupleCount;
+		}
 	}
 
-	// Construct and return the split result.
-	Split split(nodeID, freshID, FreshTuple(leaf_tuple_manipulator()));
-	split.splitter.copy_from(*page_begin(freshID));
-	return split;
+	// Construct and return the split result, using a key that separates the last tuple on this page from the first on the fresh one.
+	return Split(nodeID, freshID, make_separator(*page_rbegin(nodeID), *page_begin(freshID)));
+}
+
+unsigned int BTree::subtree_tuple_count(int nodeID) const
+{
+	return m_routes[nodeID].has_children() ? m_nodes[nodeID].tupleCount : raw_page(nodeID)->tuple_count();
 }
 
 void BTree::transfer_leaf_tuples(int sourceNodeID, int targetNodeID, const std::vector<BackedTuple>& tuples)
@@ -988,7 +2630,7 @@ void BTree::transfer_leaf_tuples(int sourceNodeID, int targetNodeID, const std::
 
 	// Check that the target node has the same parent and space to hold the tuples.
 	assert(m_nodes[targetNodeID].parentID == m_nodes[sourceNodeID].parentID);
-	assert(targetPage->empty_tuple_count() >= tuples.size());
+	assert(targetPage->has_room_for_tuples_from(*page(sourceNodeID), static_cast<unsigned int>(tuples.size())));
 
 	// Transfer the tuples to the target node.
 	SortedPage_Ptr sourcePage = page(sourceNodeID);
@@ -1035,15 +2677,110 @@ void BTree::transfer_leaf_tuples_right(int sourceNodeID, unsigned int n)
 	transfer_leaf_tuples(sourceNodeID, m_nodes[sourceNodeID].siblingRightID, tuples);
 }
 
+bool BTree::try_append_tuple(const Tuple& tuple)
+{
+	if(!is_append(m_lastLeafID, tuple) || !has_room_for(m_lastLeafID, tuple)) return false;
+
+	page(m_lastLeafID)->add_tuple(tuple);
+	++m_tupleCount;
+
+	// In counted mode, the counts of the leaf's ancestors must also be updated.
+	if(m_counted)
+	{
+		for(int nodeID = m_nodes[m_lastLeafID].parentID; nodeID != -1; nodeID = m_nodes[nodeID].parentID)
+		{
+			++m_nodes[nodeID].tupleCount;
+		}
+	}
+
+	return true;
+}
+
+bool BTree::try_erase_tuple_from_leaf(const ValueKey& key)
+{
+	// Prevent any structure modifications until we're done, and find the leaf that should contain the tuple.
+	boost::shared_lock<boost::shared_mutex> lock(m_structureMutex);
+	const int nodeID = leaf_for(key, false);
+
+	// Latch the leaf to exclude other writers and make any concurrent readers of it restart.
+	VersionLatch latch(m_nodes[nodeID].version);
+
+	// If the tuple can be erased from the leaf without breaking its minimum tuple invariant (or the leaf
+	// is the root, which has no such invariant), simply erase it. Note that if all of the tuples in the
+	// leaf are less than the key, the tuple may be in the right sibling, so we leave it to a full erase.
+	SortedPage_Ptr nodePage = page(nodeID);
+	SortedPage::TupleSetCIter it = nodePage->lower_bound(key);
+	if(it != nodePage->end() && PrefixTupleComparator().compare(*it, key) == 0 &&
+	   (nodeID == m_rootID || has_at_least_min_tuples(nodeID, -1)))
+	{
+		nodePage->erase_tuple(it);
+		--m_tupleCount;
+		return true;
+	}
+
+	return false;
+}
+
+bool BTree::try_insert_tuple_into_leaf(const Tuple& tuple)
+{
+	// Prevent any structure modifications until we're done, and find the leaf into which the tuple should be inserted.
+	boost::shared_lock<boost::shared_mutex> lock(m_structureMutex);
+	const int nodeID = leaf_for(make_branch_key(tuple), true);
+
+	// Latch the leaf to exclude other writers and make any concurrent readers of it restart.
+	VersionLatch latch(m_nodes[nodeID].version);
+
+	// If the leaf has spare capacity, simply insert the tuple into it.
+	if(has_room_for(nodeID, tuple))
+	{
+		page(nodeID)->add_tuple(tuple);
+		++m_tupleCount;
+		return true;
+	}
+
+	return false;
+}
+
+bool BTree::try_update_tuple_in_leaf(const ConstIterator& it, const Tuple& tuple, ValueKey& key)
+{
+	if(can_update_in_place(it, tuple))
+	{
+		// The leaf has room for the replacement once the old tuple has gone, so this cannot split the leaf,
+		// and the leaf's tuple count (and hence those of its ancestors in counted mode) does not change.
+		SortedPage_Ptr nodePage = page(it.m_nodeID);
+		nodePage->erase_tuple(it.m_it);
+		nodePage->add_tuple(tuple);
+		return true;
+	}
+
+	for(unsigned int i = 0, arity = key.arity(); i < arity; ++i)
+	{
+		key.field(i).set_from(it->field(i));
+	}
+	return false;
+}
+
 void BTree::update_parent_pointers(int oldParentID, int newParentID)
 {
-	m_nodes[m_nodes[oldParentID].firstChildID].parentID = newParentID;
+	m_nodes[m_routes[oldParentID].firstChildID].parentID = newParentID;
 	for(SortedPage::TupleSetCIter it = page_begin(oldParentID), iend = page_end(oldParentID); it != iend; ++it)
 	{
 		m_nodes[child_node_id(*it)].parentID = newParentID;
 	}
 }
 
+void BTree::update_tuple_count(int nodeID)
+{
+	if(!m_counted) return;
+
+	unsigned int tupleCount = subtree_tuple_count(m_routes[nodeID].firstChildID);
+	for(SortedPage::TupleSetCIter it = page_begin(nodeID), iend = page_end(nodeID); it != iend; ++it)
+	{
+		tupleCount += subtree_tuple_count(child_node_id(*it));
+	}
+	m_nodes[nodeID].tupleCount = tupleCount;
+}
+
 //#################### GLOBAL FUNCTIONS ####################
 
 std::ostream& operator<<(std::ostream& os, const BTree& rhs)
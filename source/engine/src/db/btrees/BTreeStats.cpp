@@ -0,0 +1,183 @@
+/**
+ * whery: BTreeStats.cpp
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#include "whery/db/btrees/BTreeStats.h"
+
+#include <stdexcept>
+
+#include <boost/integer_traits.hpp>
+
+namespace whery {
+
+//#################### CONSTRUCTORS ####################
+
+BTreeStats::BTreeStats()
+:	m_eventCounts(EVENT_COUNT, 0), m_latencies(OPERATION_COUNT)
+{}
+
+BTreeStats::BTreeStats(const std::vector<boost::uint64_t>& eventCounts, const std::vector<LatencyHistogram>& latencies)
+:	m_eventCounts(eventCounts), m_latencies(latencies)
+{
+	if(eventCounts.size() != EVENT_COUNT || latencies.size() != OPERATION_COUNT)
+	{
+		throw std::invalid_argument("B+-tree statistics must have exactly one count for each kind of event and one histogram for each kind of operation.");
+	}
+}
+
+//#################### PUBLIC STATIC METHODS ####################
+
+const char *BTreeStats::event_name(Event event)
+{
+	switch(event)
+	{
+		case EVENT_ADD_ROOT_NODE:		return "add_root_node";
+		case EVENT_MERGE_BRANCHES:		return "merge_branches";
+		case EVENT_MERGE_LEAVES:		return "merge_leaves";
+		case EVENT_OPTIMISTIC_RESTART:	return "optimistic_restart";
+		case EVENT_REDISTRIBUTE_BRANCH:	return "redistribute_branch";
+		case EVENT_REDISTRIBUTE_LEAF:	return "redistribute_leaf";
+		case EVENT_SPLIT_BRANCH:		return "split_branch";
+		case EVENT_SPLIT_LEAF:			return "split_leaf";
+		default:						throw std::invalid_argument("Unknown B+-tree event");
+	}
+}
+
+const char *BTreeStats::operation_name(Operation op)
+{
+	switch(op)
+	{
+		case OP_ERASE:			return "erase";
+		case OP_FIND:			return "find";
+		case OP_INSERT:			return "insert";
+		case OP_PARALLEL_SCAN:	return "parallel_scan";
+		case OP_RANGE_LOOKUP:	return "range_lookup";
+		default:				throw std::invalid_argument("Unknown B+-tree operation");
+	}
+}
+
+//#################### PUBLIC METHODS ####################
+
+boost::uint64_t BTreeStats::event_count(Event event) const
+{
+	return m_eventCounts[event];
+}
+
+const LatencyHistogram& BTreeStats::latencies(Operation op) const
+{
+	return m_latencies[op];
+}
+
+boost::uint64_t BTreeStats::operation_count(Operation op) const
+{
+	return m_latencies[op].count();
+}
+
+//#################### NESTED CLASSES ####################
+
+BTreeStatsRecorder::OperationTimer::OperationTimer(BTreeStatsRecorder& recorder, BTreeStats::Operation op)
+:	m_op(op), m_recorder(recorder), m_start(Clock::now())
+{}
+
+BTreeStatsRecorder::OperationTimer::~OperationTimer()
+{
+	using boost::chrono::duration_cast;
+	using boost::chrono::nanoseconds;
+	m_recorder.record_latency(m_op, duration_cast<nanoseconds>(Clock::now() - m_start).count());
+}
+
+//#################### CONSTRUCTORS ####################
+
+BTreeStatsRecorder::BTreeStatsRecorder()
+{
+	reset();
+}
+
+//#################### PUBLIC METHODS ####################
+
+void BTreeStatsRecorder::count_event(BTreeStats::Event event)
+{
+	m_eventCounts[event].fetch_add(1, boost::memory_order_relaxed);
+}
+
+void BTreeStatsRecorder::record_latency(BTreeStats::Operation op, boost::uint64_t latency)
+{
+	m_bucketCounts[op][LatencyHistogram::bucket_for(latency)].fetch_add(1, boost::memory_order_relaxed);
+	m_sumLatencies[op].fetch_add(latency, boost::memory_order_relaxed);
+
+	boost::uint64_t maxLatency = m_maxLatencies[op].load(boost::memory_order_relaxed);
+	while(latency > maxLatency && !m_maxLatencies[op].compare_exchange_weak(maxLatency, latency, boost::memory_order_relaxed));
+
+	boost::uint64_t minLatency = m_minLatencies[op].load(boost::memory_order_relaxed);
+	while(latency < minLatency && !m_minLatencies[op].compare_exchange_weak(minLatency, latency, boost::memory_order_relaxed));
+}
+
+void BTreeStatsRecorder::reset()
+{
+	for(int op = 0; op < BTreeStats::OPERATION_COUNT; ++op)
+	{
+		for(size_t i = 0; i < LatencyHistogram::BUCKET_COUNT; ++i) m_bucketCounts[op][i].store(0);
+		m_maxLatencies[op].store(0);
+		m_minLatencies[op].store(boost::integer_traits<boost::uint64_t>::const_max);
+		m_sumLatencies[op].store(0);
+	}
+
+	for(int event = 0; event < BTreeStats::EVENT_COUNT; ++event) m_eventCounts[event].store(0);
+}
+
+BTreeStats BTreeStatsRecorder::snapshot() const
+{
+	std::vector<boost::uint64_t> eventCounts(BTreeStats::EVENT_COUNT);
+	for(int event = 0; event < BTreeStats::EVENT_COUNT; ++event)
+	{
+		eventCounts[event] = m_eventCounts[event].load(boost::memory_order_relaxed);
+	}
+
+	std::vector<LatencyHistogram> latencies;
+	latencies.reserve(BTreeStats::OPERATION_COUNT);
+	std::vector<boost::uint64_t> bucketCounts(LatencyHistogram::BUCKET_COUNT);
+	for(int op = 0; op < BTreeStats::OPERATION_COUNT; ++op)
+	{
+		for(size_t i = 0; i < LatencyHistogram::BUCKET_COUNT; ++i)
+		{
+			bucketCounts[i] = m_bucketCounts[op][i].load(boost::memory_order_relaxed);
+		}
+
+		latencies.push_back(LatencyHistogram(
+			bucketCounts,
+			m_minLatencies[op].load(boost::memory_order_relaxed),
+			m_maxLatencies[op].load(boost::memory_order_relaxed),
+			m_sumLatencies[op].load(boost::memory_order_relaxed)
+		));
+	}
+
+	return BTreeStats(eventCounts, latencies);
+}
+
+//#################### GLOBAL FUNCTIONS ####################
+
+std::ostream& operator<<(std::ostream& os, const BTreeStats& stats)
+{
+	for(int i = 0; i < BTreeStats::OPERATION_COUNT; ++i)
+	{
+		BTreeStats::Operation op = static_cast<BTreeStats::Operation>(i);
+		const LatencyHistogram& latencies = stats.latencies(op);
+		os << BTreeStats::operation_name(op) << ": count=" << latencies.count()
+		   << " mean=" << latencies.mean() << "ns"
+		   << " p50=" << latencies.percentile(50) << "ns"
+		   << " p99=" << latencies.percentile(99) << "ns"
+		   << " p99.9=" << latencies.percentile(99.9) << "ns"
+		   << " max=" << latencies.max() << "ns\n";
+	}
+
+	for(int i = 0; i < BTreeStats::EVENT_COUNT; ++i)
+	{
+		BTreeStats::Event event = static_cast<BTreeStats::Event>(i);
+		os << BTreeStats::event_name(event) << ": " << stats.event_count(event) << '\n';
+	}
+
+	return os;
+}
+
+}
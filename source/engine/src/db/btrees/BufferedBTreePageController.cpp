@@ -0,0 +1,51 @@
+/**
+ * whery: BufferedBTreePageController.cpp
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#include "whery/db/btrees/BufferedBTreePageController.h"
+
+#include "whery/db/pages/BufferedSortedPage.h"
+
+namespace whery {
+
+//#################### CONSTRUCTORS ####################
+
+BufferedBTreePageController::BufferedBTreePageController(const BufferPool_Ptr& pool, const TupleManipulator& branchTupleManipulator,
+														 const TupleManipulator& leafTupleManipulator)
+:	m_branchTupleManipulator(branchTupleManipulator), m_leafTupleManipulator(leafTupleManipulator), m_pool(pool)
+{}
+
+//#################### PUBLIC METHODS ####################
+
+TupleManipulator BufferedBTreePageController::btree_branch_tuple_manipulator() const
+{
+	return m_branchTupleManipulator;
+}
+
+TupleManipulator BufferedBTreePageController::btree_leaf_tuple_manipulator() const
+{
+	return m_leafTupleManipulator;
+}
+
+SortedPage_Ptr BufferedBTreePageController::make_btree_branch_page() const
+{
+	return SortedPage_Ptr(new BufferedSortedPage(m_pool, m_branchTupleManipulator));
+}
+
+SortedPage_Ptr BufferedBTreePageController::make_btree_leaf_page() const
+{
+	return SortedPage_Ptr(new BufferedSortedPage(m_pool, m_leafTupleManipulator));
+}
+
+unsigned int BufferedBTreePageController::max_btree_branch_tuple_count() const
+{
+	return SlottedSortedPage::max_tuple_count_for(m_pool->page_size(), m_branchTupleManipulator);
+}
+
+unsigned int BufferedBTreePageController::max_btree_leaf_tuple_count() const
+{
+	return SlottedSortedPage::max_tuple_count_for(m_pool->page_size(), m_leafTupleManipulator);
+}
+
+}
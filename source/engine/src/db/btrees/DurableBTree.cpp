@@ -0,0 +1,323 @@
+/**
+ * whery: DurableBTree.cpp
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#include "whery/db/btrees/DurableBTree.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+#include <boost/crc.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <boost/thread/locks.hpp>
+
+#include "whery/db/pages/InMemorySortedPage.h"
+#include "whery/util/BinaryFile.h"
+
+namespace whery {
+
+//#################### LOCAL CONSTANTS ####################
+
+namespace {
+
+/** The magic number at the start of every checkpoint file. */
+const char CHECKPOINT_MAGIC[] = "WHRYCKP1";
+
+/** The size (in bytes) of the magic number. */
+const size_t CHECKPOINT_MAGIC_SIZE = 8;
+
+/** The size (in bytes) of the checkpoint header, which consists of the magic number, the LSN, the tuple size and the tuple count. */
+const size_t CHECKPOINT_HEADER_SIZE = CHECKPOINT_MAGIC_SIZE + sizeof(WriteAheadLog::LSN) + sizeof(boost::uint32_t) + sizeof(boost::uint64_t);
+
+/** The size (in bytes) of the chunks in which a checkpoint is written. */
+const size_t CHECKPOINT_CHUNK_SIZE = 64 * 1024;
+
+/** The maximum number of tuples to put on each of the pages used to bulk load a checkpoint. */
+const unsigned int CHECKPOINT_TUPLES_PER_PAGE = 1024;
+
+}
+
+//#################### CONSTRUCTORS ####################
+
+DurableBTree::DurableBTree(const BTree_Ptr& tree, const std::string& basename, unsigned int checkpointInterval, unsigned int syncInterval)
+:	m_checkpointFilename(basename + ".ckpt"),
+	m_checkpointInterval(checkpointInterval),
+	m_checkpointLSN(0),
+	m_log(basename + ".wal", syncInterval),
+	m_recordsSinceCheckpoint(0),
+	m_scratchTuple(tree->leaf_tuple_manipulator()),
+	m_tree(tree)
+{
+	if(m_tree->tuple_count() != 0)
+	{
+		throw std::invalid_argument("A durable B+-tree must be constructed around an empty B+-tree.");
+	}
+
+	// Recover the tree from the latest checkpoint, and then replay any records logged since it was taken.
+	// (Records up to and including the checkpoint LSN may still be in the log if we crashed during a
+	// checkpoint, after the checkpoint file was written but before the log records were discarded.)
+	load_checkpoint();
+
+	std::vector<WriteAheadLog::Record> records = m_log.read_records();
+	for(std::vector<WriteAheadLog::Record>::iterator it = records.begin(), iend = records.end(); it != iend; ++it)
+	{
+		if(it->lsn <= m_checkpointLSN) continue;
+		replay(*it);
+		++m_recordsSinceCheckpoint;
+	}
+}
+
+//#################### PUBLIC METHODS ####################
+
+void DurableBTree::checkpoint()
+{
+	boost::lock_guard<boost::mutex> lock(m_checkpointMutex);
+	write_checkpoint();
+}
+
+void DurableBTree::erase_tuple(const ValueKey& key)
+{
+	WriteAheadLog::LSN lsn;
+	bool checkpointDue;
+	{
+		boost::lock_guard<boost::mutex> lock(m_mutex);
+
+		const std::vector<unsigned int>& fieldIndices = key.field_indices();
+		const boost::uint32_t arity = static_cast<boost::uint32_t>(fieldIndices.size());
+		m_payload.resize(sizeof(boost::uint32_t) * (arity + 1) + key.size());
+		char *p = &m_payload[0];
+		memcpy(p, &arity, sizeof(arity));
+		p += sizeof(arity);
+		for(boost::uint32_t i = 0; i < arity; ++i, p += sizeof(boost::uint32_t))
+		{
+			boost::uint32_t fieldIndex = fieldIndices[i];
+			memcpy(p, &fieldIndex, sizeof(fieldIndex));
+		}
+		memcpy(p, key.location(), key.size());
+
+		// Log the erasure before applying it, so that it is never applied unless it has been logged.
+		lsn = m_log.append(RT_ERASE, &m_payload[0], m_payload.size());
+		m_tree->erase_tuple(key);
+		checkpointDue = note_record_logged();
+	}
+
+	// Commit (and take any checkpoint that is due) outside the lock, so that commits from concurrent
+	// writers can be grouped together, and writes are not held up whilst the checkpoint is written.
+	m_log.commit(lsn);
+	if(checkpointDue) take_automatic_checkpoint();
+}
+
+void DurableBTree::insert_tuple(const Tuple& tuple)
+{
+	WriteAheadLog::LSN lsn;
+	bool checkpointDue;
+	{
+		boost::lock_guard<boost::mutex> lock(m_mutex);
+
+		// Log the insertion before applying it, so that it is never applied unless it has been logged.
+		m_scratchTuple.copy_from(tuple);
+		lsn = m_log.append(RT_INSERT, m_scratchTuple.location(), m_scratchTuple.size());
+		m_tree->insert_tuple(tuple);
+		checkpointDue = note_record_logged();
+	}
+
+	// Commit (and take any checkpoint that is due) outside the lock, so that commits from concurrent
+	// writers can be grouped together, and writes are not held up whilst the checkpoint is written.
+	m_log.commit(lsn);
+	if(checkpointDue) take_automatic_checkpoint();
+}
+
+const WriteAheadLog& DurableBTree::log() const
+{
+	return m_log;
+}
+
+void DurableBTree::sync()
+{
+	m_log.sync();
+}
+
+const BTree& DurableBTree::tree() const
+{
+	return *m_tree;
+}
+
+//#################### PRIVATE METHODS ####################
+
+void DurableBTree::load_checkpoint()
+{
+	if(!boost::filesystem::exists(m_checkpointFilename)) return;
+
+	std::ifstream fs(m_checkpointFilename.c_str(), std::ios::binary);
+	if(!fs)
+	{
+		throw std::runtime_error("Could not open the checkpoint file " + m_checkpointFilename + ".");
+	}
+	std::vector<char> contents((std::istreambuf_iterator<char>(fs)), std::istreambuf_iterator<char>());
+
+	// Check that the checkpoint is intact. (Since checkpoints are written atomically, any damage is not the result of a crash.)
+	const std::string corrupt = "The checkpoint file " + m_checkpointFilename + " is corrupt.";
+	if(contents.size() < CHECKPOINT_HEADER_SIZE + sizeof(boost::uint32_t) || memcmp(&contents[0], CHECKPOINT_MAGIC, CHECKPOINT_MAGIC_SIZE) != 0)
+	{
+		throw std::runtime_error(corrupt);
+	}
+
+	boost::uint32_t checksum;
+	const size_t checksumOffset = contents.size() - sizeof(checksum);
+	memcpy(&checksum, &contents[checksumOffset], sizeof(checksum));
+	boost::crc_32_type crc;
+	crc.process_bytes(&contents[0], checksumOffset);
+	if(crc.checksum() != checksum) throw std::runtime_error(corrupt);
+
+	WriteAheadLog::LSN lsn;
+	boost::uint32_t tupleSize;
+	boost::uint64_t tupleCount;
+	const char *header = &contents[CHECKPOINT_MAGIC_SIZE];
+	memcpy(&lsn, header, sizeof(lsn));
+	memcpy(&tupleSize, header + sizeof(lsn), sizeof(tupleSize));
+	memcpy(&tupleCount, header + sizeof(lsn) + sizeof(tupleSize), sizeof(tupleCount));
+
+	const TupleManipulator tupleManipulator = m_tree->leaf_tuple_manipulator();
+	if(tupleSize != tupleManipulator.size() || checksumOffset - CHECKPOINT_HEADER_SIZE != tupleCount * tupleSize)
+	{
+		throw std::runtime_error(corrupt);
+	}
+
+	// Copy the tuples onto a set of in-memory pages, and bulk load them into the tree. (Each tuple is first
+	// copied into a suitably-aligned buffer, since the tuples in the checkpoint may not be aligned.)
+	std::vector<SortedPage_Ptr> pages;
+	FreshTuple tuple(tupleManipulator);
+	const unsigned int bufferSize = InMemorySortedPage::buffer_size_for(CHECKPOINT_TUPLES_PER_PAGE, tupleManipulator);
+	for(boost::uint64_t i = 0; i < tupleCount; ++i)
+	{
+		if(i % CHECKPOINT_TUPLES_PER_PAGE == 0)
+		{
+			pages.push_back(SortedPage_Ptr(new InMemorySortedPage(bufferSize, tupleManipulator)));
+		}
+
+		memcpy(const_cast<char*>(tuple.location()), &contents[CHECKPOINT_HEADER_SIZE + i * tupleSize], tupleSize);
+		pages.back()->add_tuple(tuple);
+	}
+
+	m_tree->bulk_load(pages);
+	m_checkpointLSN = lsn;
+}
+
+bool DurableBTree::note_record_logged()
+{
+	return m_checkpointInterval != 0 && ++m_recordsSinceCheckpoint >= m_checkpointInterval;
+}
+
+void DurableBTree::replay(WriteAheadLog::Record& record)
+{
+	const TupleManipulator tupleManipulator = m_tree->leaf_tuple_manipulator();
+	const std::string malformed = "A record in the write-ahead log is malformed.";
+
+	switch(record.type)
+	{
+		case RT_ERASE:
+		{
+			boost::uint32_t arity;
+			if(record.payload.size() < sizeof(arity)) throw std::runtime_error(malformed);
+			memcpy(&arity, &record.payload[0], sizeof(arity));
+
+			const size_t indicesSize = sizeof(boost::uint32_t) * arity;
+			if(record.payload.size() < sizeof(arity) + indicesSize) throw std::runtime_error(malformed);
+
+			std::vector<unsigned int> fieldIndices(arity);
+			for(boost::uint32_t i = 0; i < arity; ++i)
+			{
+				boost::uint32_t fieldIndex;
+				memcpy(&fieldIndex, &record.payload[sizeof(arity) + i * sizeof(boost::uint32_t)], sizeof(fieldIndex));
+				if(fieldIndex >= tupleManipulator.arity()) throw std::runtime_error(malformed);
+				fieldIndices[i] = fieldIndex;
+			}
+
+			ValueKey key(tupleManipulator, fieldIndices);
+			if(record.payload.size() != sizeof(arity) + indicesSize + key.size()) throw std::runtime_error(malformed);
+			memcpy(const_cast<char*>(key.location()), &record.payload[sizeof(arity) + indicesSize], key.size());
+			m_tree->erase_tuple(key);
+			break;
+		}
+		case RT_INSERT:
+		{
+			if(record.payload.size() != tupleManipulator.size()) throw std::runtime_error(malformed);
+
+			// Note that the payload starts at the beginning of its own heap-allocated buffer, so it is suitably aligned.
+			m_tree->insert_tuple(BackedTuple(&record.payload[0], tupleManipulator));
+			break;
+		}
+		default:
+		{
+			throw std::runtime_error(malformed);
+		}
+	}
+}
+
+void DurableBTree::take_automatic_checkpoint()
+{
+	boost::unique_lock<boost::mutex> lock(m_checkpointMutex, boost::try_to_lock);
+	if(lock.owns_lock()) write_checkpoint();
+}
+
+void DurableBTree::write_checkpoint()
+{
+	// Copy the tuples in the tree (together with the header of the checkpoint) into memory with the write mutex
+	// held, noting the LSN of the last record that they reflect. Writes are only held up whilst the copy is made.
+	WriteAheadLog::LSN lsn;
+	std::vector<char> contents(CHECKPOINT_HEADER_SIZE);
+	{
+		boost::lock_guard<boost::mutex> lock(m_mutex);
+		lsn = m_log.last_lsn();
+
+		const boost::uint32_t tupleSize = static_cast<boost::uint32_t>(m_scratchTuple.size());
+		const boost::uint64_t tupleCount = m_tree->tuple_count();
+		contents.reserve(CHECKPOINT_HEADER_SIZE + tupleCount * tupleSize + sizeof(boost::uint32_t));
+		memcpy(&contents[0], CHECKPOINT_MAGIC, CHECKPOINT_MAGIC_SIZE);
+		memcpy(&contents[CHECKPOINT_MAGIC_SIZE], &lsn, sizeof(lsn));
+		memcpy(&contents[CHECKPOINT_MAGIC_SIZE + sizeof(lsn)], &tupleSize, sizeof(tupleSize));
+		memcpy(&contents[CHECKPOINT_MAGIC_SIZE + sizeof(lsn) + sizeof(tupleSize)], &tupleCount, sizeof(tupleCount));
+
+		for(BTree::ConstIterator it = m_tree->begin(), iend = m_tree->end(); it != iend; ++it)
+		{
+			m_scratchTuple.copy_from(*it);
+			contents.insert(contents.end(), m_scratchTuple.location(), m_scratchTuple.location() + tupleSize);
+		}
+
+		m_recordsSinceCheckpoint = 0;
+	}
+
+	// Make sure that the log is durable up to the checkpoint before writing the checkpoint itself, so that
+	// if we crash before the log records have been discarded, the LSNs of any records logged after the
+	// checkpoint will still be higher than that of the checkpoint.
+	m_log.sync();
+
+	boost::crc_32_type crc;
+	crc.process_bytes(&contents[0], contents.size());
+	const boost::uint32_t checksum = crc.checksum();
+	contents.insert(contents.end(), reinterpret_cast<const char*>(&checksum), reinterpret_cast<const char*>(&checksum) + sizeof(checksum));
+
+	const std::string tempFilename = m_checkpointFilename + ".tmp";
+	{
+		BinaryFile file(tempFilename, true);
+		for(size_t offset = 0; offset < contents.size(); offset += CHECKPOINT_CHUNK_SIZE)
+		{
+			file.write(&contents[offset], std::min(CHECKPOINT_CHUNK_SIZE, contents.size() - offset));
+		}
+		file.sync();
+	}
+
+	// Atomically replace the previous checkpoint with the new one, and then discard the log records it makes redundant
+	// (keeping any that were logged after the tuples were copied).
+	boost::filesystem::rename(tempFilename, m_checkpointFilename);
+	BinaryFile::sync_directory_of(m_checkpointFilename);
+	m_log.discard_through(lsn);
+
+	m_checkpointLSN = lsn;
+}
+
+}
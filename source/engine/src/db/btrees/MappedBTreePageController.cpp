@@ -0,0 +1,712 @@
+/**
+ * whery: MappedBTreePageController.cpp
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#include "whery/db/btrees/MappedBTreePageController.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <stdexcept>
+
+#include <boost/crc.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include "whery/util/IDAllocator.h"
+
+namespace bip = boost::interprocess;
+
+namespace whery {
+
+//#################### LOCAL CONSTANTS ####################
+
+namespace {
+
+/** The magic number that marks a file header as describing a saved B+-tree. */
+const unsigned int FILE_HEADER_MAGIC = 0x57485259;
+
+/** The ID of the page slot that holds the file header. */
+const int HEADER_PAGE_ID = 0;
+
+/** The number of words used to save each node in the node table of a saved B+-tree. */
+const unsigned int NODE_RECORD_WORDS = 6;
+
+/** The size (in bytes) of the header at the start of each page slot (chosen to preserve tuple alignment). */
+const unsigned int PAGE_HEADER_SIZE = 16;
+
+/**
+The words of the file header, which is stored in the buffer of the header slot.
+*/
+enum FileHeaderWord
+{
+	FHW_MAGIC,
+	FHW_PAGE_SIZE,
+	FHW_FIRST_TABLE_PAGE,
+	FHW_NODE_COUNT,
+	FHW_ROOT_ID,
+	FHW_FIRST_LEAF_ID,
+	FHW_LAST_LEAF_ID,
+	FHW_TUPLE_COUNT,
+	FHW_COUNTED,
+	FHW_CHECKSUM,
+	FHW_COUNT
+};
+
+/**
+The words of the header at the start of each page slot.
+*/
+enum SlotHeaderWord
+{
+	/** The kind of page stored in the slot. */
+	SHW_KIND,
+
+	/** For a slot containing part of a saved node table, the ID of the slot containing the next part (or -1). */
+	SHW_NEXT_TABLE_PAGE
+};
+
+}
+
+//#################### LOCAL FUNCTIONS ####################
+
+namespace {
+
+/**
+Determines whether the first tuple on one (non-empty) page is ordered before the first tuple on another.
+
+\param lhs	The left-hand page.
+\param rhs	The right-hand page.
+\return		true, if the first tuple on lhs is ordered before the first tuple on rhs, or false otherwise.
+*/
+bool first_tuple_less(const SortedPage_Ptr& lhs, const SortedPage_Ptr& rhs)
+{
+	return PrefixTupleComparator()(*lhs->begin(), *rhs->begin());
+}
+
+}
+
+//#################### NESTED CLASSES ####################
+
+/**
+\brief An instance of this struct represents the data file in which a controller's pages are stored.
+*/
+struct MappedBTreePageController::PageFile
+{
+	/**
+	\brief An instance of this struct represents a contiguous range of page slots that are mapped into memory together.
+	*/
+	struct Chunk
+	{
+		/** The ID of the first page slot in the chunk. */
+		unsigned int firstPageID;
+
+		/** The mapped region containing the chunk's page slots. */
+		boost::shared_ptr<bip::mapped_region> region;
+	};
+
+	/** The chunks into which the data file is mapped, in order of their first page slots. */
+	std::vector<Chunk> chunks;
+
+	/** The name of the data file. */
+	std::string filename;
+
+	/** The mapping used to map the data file's page slots into memory. */
+	bip::file_mapping mapping;
+
+	/** The number of page slots that the data file can currently hold. */
+	unsigned int pageCount;
+
+	/** The allocator used to allocate page slots in the data file. */
+	IDAllocator pageIDAllocator;
+
+	/** The IDs of the page slots that contain the pages that are currently alive. */
+	std::map<const SortedPage*,int> pageIDs;
+
+	/** The size (in bytes) of each page slot in the data file. */
+	unsigned int pageSize;
+
+	/** The IDs of the slots that contain non-empty leaf pages that were left in the file by a previous session. */
+	std::vector<int> recoverableLeafIDs;
+
+	/** Whether or not the file header currently describes a saved B+-tree (whose pages must then be retained even if they are empty). */
+	bool structureSaved;
+
+	/** The number of page slots that are currently in use (including the header slot). */
+	unsigned int usedPageCount;
+
+	PageFile(const std::string& filename_, unsigned int pageSize_)
+	:	filename(filename_), pageCount(0), pageSize(pageSize_), structureSaved(false), usedPageCount(0)
+	{
+		// Create the data file if it does not already exist (a file mapping can only be made for an existing file).
+		if(!boost::filesystem::exists(filename))
+		{
+			std::ofstream fs(filename.c_str(), std::ios::binary);
+			if(!fs) throw std::invalid_argument("Could not create the data file " + filename + ".");
+		}
+
+		boost::uintmax_t fileSize = boost::filesystem::file_size(filename);
+		if(fileSize % pageSize != 0)
+		{
+			throw std::invalid_argument("The size of the data file " + filename + " is not a multiple of the page size.");
+		}
+		pageCount = static_cast<unsigned int>(fileSize / pageSize);
+
+		bip::file_mapping temp(filename.c_str(), bip::read_write);
+		mapping.swap(temp);
+
+		if(pageCount > 0) map_chunk(0, pageCount);
+	}
+
+	/**
+	Allocates a page slot, growing the data file if necessary.
+
+	\return	The ID of the allocated page slot.
+	*/
+	int allocate_page()
+	{
+		int pageID = pageIDAllocator.allocate();
+		++usedPageCount;
+
+		if(static_cast<unsigned int>(pageID) >= pageCount)
+		{
+			// Grow the file geometrically to avoid the need to resize it on every allocation,
+			// and map the part that has been added as a new chunk.
+			unsigned int oldPageCount = pageCount;
+			pageCount = std::max(static_cast<unsigned int>(pageID) + 1, pageCount * 2);
+			boost::filesystem::resize_file(filename, static_cast<boost::uintmax_t>(pageCount) * pageSize);
+			map_chunk(oldPageCount, pageCount - oldPageCount);
+		}
+
+		return pageID;
+	}
+
+	/**
+	Finds the chunk containing the specified page slot.
+
+	\param pageID	The ID of the page slot.
+	\return			The chunk containing the page slot.
+	*/
+	const Chunk& chunk_for(int pageID) const
+	{
+		std::vector<Chunk>::const_iterator it = chunks.end();
+		do --it; while(it->firstPageID > static_cast<unsigned int>(pageID));
+		return *it;
+	}
+
+	/**
+	Calculates the checksum of a saved B+-tree structure.
+
+	\param header	The file header describing the structure.
+	\param table		The structure's node table.
+	\return			The checksum.
+	*/
+	static unsigned int checksum(const unsigned int *header, const std::vector<unsigned int>& table)
+	{
+		boost::crc_32_type crc;
+		crc.process_bytes(header, FHW_CHECKSUM * sizeof(unsigned int));
+		if(!table.empty()) crc.process_bytes(&table[0], table.size() * sizeof(unsigned int));
+		return crc.checksum();
+	}
+
+	/**
+	Deallocates a page slot, marking it as free in the data file.
+
+	\param pageID	The ID of the page slot.
+	*/
+	void deallocate_page(int pageID)
+	{
+		set_page_kind(pageID, PK_FREE);
+		pageIDAllocator.deallocate(pageID);
+		--usedPageCount;
+	}
+
+	/**
+	Gets the file header.
+
+	\return	A pointer to the words of the file header.
+	*/
+	unsigned int *file_header() const
+	{
+		return slot_header(HEADER_PAGE_ID) + PAGE_HEADER_SIZE / sizeof(unsigned int);
+	}
+
+	/**
+	Synchronously flushes all of the data file's chunks to disk.
+	*/
+	void flush() const
+	{
+		for(std::vector<Chunk>::const_iterator it = chunks.begin(), iend = chunks.end(); it != iend; ++it)
+		{
+			it->region->flush(0, 0, false);
+		}
+	}
+
+	/**
+	Synchronously flushes the specified page slot to disk.
+
+	\param pageID	The ID of the page slot.
+	*/
+	void flush_page(int pageID) const
+	{
+		const Chunk& chunk = chunk_for(pageID);
+		chunk.region->flush((pageID - chunk.firstPageID) * pageSize, pageSize, false);
+	}
+
+	/**
+	Marks the file header as no longer describing a saved B+-tree, and flushes it to disk.
+	*/
+	void invalidate_header()
+	{
+		file_header()[FHW_MAGIC] = 0;
+		flush_page(HEADER_PAGE_ID);
+	}
+
+	/**
+	Maps a range of page slots into memory as a new chunk.
+
+	\param firstPageID	The ID of the first page slot in the range.
+	\param count			The number of page slots in the range.
+	*/
+	void map_chunk(unsigned int firstPageID, unsigned int count)
+	{
+		Chunk chunk;
+		chunk.firstPageID = firstPageID;
+		bip::offset_t offset = static_cast<bip::offset_t>(firstPageID) * pageSize;
+		chunk.region.reset(new bip::mapped_region(mapping, bip::read_write, offset, static_cast<std::size_t>(count) * pageSize));
+		chunks.push_back(chunk);
+	}
+
+	/**
+	Gets the kind of page stored in the specified page slot.
+
+	\param pageID	The ID of the page slot.
+	\return			The kind of page stored in the page slot.
+	*/
+	PageKind page_kind(int pageID) const
+	{
+		return static_cast<PageKind>(slot_header(pageID)[SHW_KIND]);
+	}
+
+	/**
+	Reads the saved B+-tree structure (if any) described by the file header.
+
+	\param structure		Used to return the structure.
+	\param tablePageIDs	Used to return the IDs of the page slots containing the structure's node table.
+	\return				true, if the file header describes a valid saved structure, or false otherwise.
+	*/
+	bool read_structure(BTreeStructure& structure, std::vector<int>& tablePageIDs) const
+	{
+		const unsigned int *header = file_header();
+		if(header[FHW_MAGIC] != FILE_HEADER_MAGIC || header[FHW_PAGE_SIZE] != pageSize) return false;
+
+		// Check that the node table could fit in the file before reading it, in case the node count is corrupt.
+		const unsigned int tableCapacity = pageSize - PAGE_HEADER_SIZE;
+		const unsigned int nodeCount = header[FHW_NODE_COUNT];
+		const boost::uintmax_t tableSize = static_cast<boost::uintmax_t>(nodeCount) * NODE_RECORD_WORDS * sizeof(unsigned int);
+		if(tableSize > static_cast<boost::uintmax_t>(pageCount) * tableCapacity) return false;
+
+		// Read the node table from its chain of page slots.
+		std::vector<unsigned int> table(nodeCount * NODE_RECORD_WORDS);
+		char *dest = table.empty() ? NULL : reinterpret_cast<char*>(&table[0]);
+		unsigned int remaining = static_cast<unsigned int>(tableSize);
+		int tablePageID = static_cast<int>(header[FHW_FIRST_TABLE_PAGE]);
+		tablePageIDs.clear();
+		while(remaining > 0)
+		{
+			if(tablePageID <= HEADER_PAGE_ID || static_cast<unsigned int>(tablePageID) >= pageCount ||
+			   page_kind(tablePageID) != PK_TABLE || tablePageIDs.size() == pageCount)
+			{
+				return false;
+			}
+			tablePageIDs.push_back(tablePageID);
+
+			const unsigned int *slot = slot_header(tablePageID);
+			unsigned int size = std::min(remaining, tableCapacity);
+			memcpy(dest, reinterpret_cast<const char*>(slot) + PAGE_HEADER_SIZE, size);
+			dest += size;
+			remaining -= size;
+			tablePageID = static_cast<int>(slot[SHW_NEXT_TABLE_PAGE]);
+		}
+
+		if(checksum(header, table) != header[FHW_CHECKSUM]) return false;
+
+		structure.counted = header[FHW_COUNTED] != 0;
+		structure.firstLeafID = static_cast<int>(header[FHW_FIRST_LEAF_ID]);
+		structure.lastLeafID = static_cast<int>(header[FHW_LAST_LEAF_ID]);
+		structure.rootID = static_cast<int>(header[FHW_ROOT_ID]);
+		structure.tupleCount = header[FHW_TUPLE_COUNT];
+		structure.nodes.resize(nodeCount);
+		for(unsigned int i = 0; i < nodeCount; ++i)
+		{
+			const unsigned int *words = &table[i * NODE_RECORD_WORDS];
+			BTreeStructure::NodeRecord& record = structure.nodes[i];
+			record.firstChildID = static_cast<int>(words[0]);
+			record.pageID = static_cast<int>(words[1]);
+			record.parentID = static_cast<int>(words[2]);
+			record.siblingLeftID = static_cast<int>(words[3]);
+			record.siblingRightID = static_cast<int>(words[4]);
+			record.tupleCount = words[5];
+
+			if(record.pageID != -1 && (record.pageID <= HEADER_PAGE_ID || static_cast<unsigned int>(record.pageID) >= pageCount))
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	/**
+	Sets the kind of page stored in the specified page slot.
+
+	\param pageID	The ID of the page slot.
+	\param kind		The kind of page stored in the page slot.
+	*/
+	void set_page_kind(int pageID, PageKind kind)
+	{
+		slot_header(pageID)[SHW_KIND] = kind;
+	}
+
+	/**
+	Gets the header of the specified page slot.
+
+	\param pageID	The ID of the page slot.
+	\return			A pointer to the words of the page slot's header.
+	*/
+	unsigned int *slot_header(int pageID) const
+	{
+		const Chunk& chunk = chunk_for(pageID);
+		char *address = static_cast<char*>(chunk.region->get_address()) + static_cast<std::size_t>(pageID - chunk.firstPageID) * pageSize;
+		return reinterpret_cast<unsigned int*>(address);
+	}
+
+	/**
+	Takes the saved B+-tree structure (if any) described by the file header, invalidating
+	the header and freeing the page slots that contain the structure's node table.
+
+	\param structure	Used to return the structure (may be NULL if it is not needed).
+	\return			true, if the file header described a valid saved structure, or false otherwise.
+	*/
+	bool take_structure(BTreeStructure *structure)
+	{
+		BTreeStructure temp;
+		std::vector<int> tablePageIDs;
+		if(!read_structure(temp, tablePageIDs)) return false;
+
+		invalidate_header();
+		structureSaved = false;
+		for(std::vector<int>::const_iterator it = tablePageIDs.begin(), iend = tablePageIDs.end(); it != iend; ++it)
+		{
+			deallocate_page(*it);
+		}
+
+		if(structure) *structure = temp;
+		return true;
+	}
+
+	/**
+	Saves a B+-tree structure, writing its node table to a chain of fresh page slots and
+	then making the file header describe it.
+
+	\param structure	The structure.
+	*/
+	void write_structure(const BTreeStructure& structure)
+	{
+		std::vector<unsigned int> table;
+		table.reserve(structure.nodes.size() * NODE_RECORD_WORDS);
+		for(std::vector<BTreeStructure::NodeRecord>::const_iterator it = structure.nodes.begin(), iend = structure.nodes.end(); it != iend; ++it)
+		{
+			table.push_back(static_cast<unsigned int>(it->firstChildID));
+			table.push_back(static_cast<unsigned int>(it->pageID));
+			table.push_back(static_cast<unsigned int>(it->parentID));
+			table.push_back(static_cast<unsigned int>(it->siblingLeftID));
+			table.push_back(static_cast<unsigned int>(it->siblingRightID));
+			table.push_back(it->tupleCount);
+		}
+
+		// Write the node table. Note that growing the file while doing so does not move any existing
+		// chunks, so the header of the previous slot in the chain remains valid.
+		const unsigned int tableCapacity = pageSize - PAGE_HEADER_SIZE;
+		const char *src = table.empty() ? NULL : reinterpret_cast<const char*>(&table[0]);
+		unsigned int remaining = static_cast<unsigned int>(table.size() * sizeof(unsigned int));
+		int firstTablePageID = -1;
+		unsigned int *previousSlot = NULL;
+		while(remaining > 0)
+		{
+			int tablePageID = allocate_page();
+			unsigned int *slot = slot_header(tablePageID);
+			slot[SHW_KIND] = PK_TABLE;
+			slot[SHW_NEXT_TABLE_PAGE] = static_cast<unsigned int>(-1);
+			if(previousSlot) previousSlot[SHW_NEXT_TABLE_PAGE] = static_cast<unsigned int>(tablePageID);
+			else firstTablePageID = tablePageID;
+
+			unsigned int size = std::min(remaining, tableCapacity);
+			memcpy(reinterpret_cast<char*>(slot) + PAGE_HEADER_SIZE, src, size);
+			src += size;
+			remaining -= size;
+			previousSlot = slot;
+		}
+
+		// Make sure that the pages and the node table reach the disk before the header that refers to them.
+		flush();
+
+		unsigned int *header = file_header();
+		header[FHW_MAGIC] = FILE_HEADER_MAGIC;
+		header[FHW_PAGE_SIZE] = pageSize;
+		header[FHW_FIRST_TABLE_PAGE] = static_cast<unsigned int>(firstTablePageID);
+		header[FHW_NODE_COUNT] = static_cast<unsigned int>(structure.nodes.size());
+		header[FHW_ROOT_ID] = static_cast<unsigned int>(structure.rootID);
+		header[FHW_FIRST_LEAF_ID] = static_cast<unsigned int>(structure.firstLeafID);
+		header[FHW_LAST_LEAF_ID] = static_cast<unsigned int>(structure.lastLeafID);
+		header[FHW_TUPLE_COUNT] = structure.tupleCount;
+		header[FHW_COUNTED] = structure.counted ? 1 : 0;
+		header[FHW_CHECKSUM] = checksum(header, table);
+		flush_page(HEADER_PAGE_ID);
+		structureSaved = true;
+	}
+};
+
+/**
+\brief An instance of this class is used to destroy the pages handed out by a controller,
+freeing their page slots as appropriate.
+*/
+class MappedBTreePageController::PageDeleter
+{
+	//#################### PRIVATE VARIABLES ####################
+private:
+	/** Whether or not the page's slot should be freed even if the page is not empty. */
+	bool m_alwaysFree;
+
+	/** The data file that contains the page. */
+	PageFile_Ptr m_file;
+
+	/** The ID of the page's slot in the data file. */
+	int m_pageID;
+
+	//#################### CONSTRUCTORS ####################
+public:
+	PageDeleter(const PageFile_Ptr& file, int pageID, bool alwaysFree)
+	:	m_alwaysFree(alwaysFree), m_file(file), m_pageID(pageID)
+	{}
+
+	//#################### PUBLIC OPERATORS ####################
+public:
+	void operator()(SortedPage *page) const
+	{
+		m_file->pageIDs.erase(page);
+		if(m_alwaysFree || (page->tuple_count() == 0 && !m_file->structureSaved))
+		{
+			m_file->deallocate_page(m_pageID);
+		}
+		delete page;
+	}
+};
+
+//#################### CONSTRUCTORS ####################
+
+MappedBTreePageController::MappedBTreePageController(const std::string& filename, unsigned int pageSize,
+													 const TupleManipulator& branchTupleManipulator,
+													 const TupleManipulator& leafTupleManipulator)
+:	m_branchTupleManipulator(branchTupleManipulator), m_leafTupleManipulator(leafTupleManipulator)
+{
+	if(pageSize < PAGE_HEADER_SIZE + FHW_COUNT * sizeof(unsigned int) || pageSize % PAGE_HEADER_SIZE != 0)
+	{
+		throw std::invalid_argument("The page size must be a multiple of 16 and large enough for the file header.");
+	}
+
+	m_file.reset(new PageFile(filename, pageSize));
+
+	if(m_file->pageCount == 0)
+	{
+		// The data file is new, so reserve its first slot for a file header that does not yet describe a saved B+-tree.
+		m_file->allocate_page();
+		m_file->set_page_kind(HEADER_PAGE_ID, PK_HEADER);
+		m_file->invalidate_header();
+		return;
+	}
+
+	if(m_file->page_kind(HEADER_PAGE_ID) != PK_HEADER)
+	{
+		throw std::invalid_argument("The data file " + filename + " does not start with a file header.");
+	}
+
+	// Start with every page slot in use, and then free the ones that are not needed.
+	m_file->pageIDAllocator.reserve(m_file->pageCount);
+	for(unsigned int i = 0; i < m_file->pageCount; ++i)
+	{
+		m_file->pageIDAllocator.allocate();
+		++m_file->usedPageCount;
+	}
+
+	BTreeStructure structure;
+	std::vector<int> tablePageIDs;
+	if(m_file->read_structure(structure, tablePageIDs))
+	{
+		// The file contains a saved B+-tree, so retain the slots of its pages and node table. When the
+		// structure was saved, all other slots were marked as free, so there is no need to scan them.
+		std::vector<bool> used(m_file->pageCount, false);
+		used[HEADER_PAGE_ID] = true;
+		for(std::vector<BTreeStructure::NodeRecord>::const_iterator it = structure.nodes.begin(), iend = structure.nodes.end(); it != iend; ++it)
+		{
+			if(it->pageID != -1) used[it->pageID] = true;
+		}
+		for(std::vector<int>::const_iterator it = tablePageIDs.begin(), iend = tablePageIDs.end(); it != iend; ++it)
+		{
+			used[*it] = true;
+		}
+
+		for(int i = static_cast<int>(m_file->pageCount) - 1; i > HEADER_PAGE_ID; --i)
+		{
+			if(!used[i])
+			{
+				m_file->pageIDAllocator.deallocate(i);
+				--m_file->usedPageCount;
+			}
+		}
+	}
+	else
+	{
+		// The previous session did not save its B+-tree, so scan the page slots it left. Non-empty leaf pages are
+		// retained so that they can be recovered; all other slots (free slots, branch pages, empty leaf pages and
+		// the remains of any node table) are freed.
+		for(unsigned int i = HEADER_PAGE_ID + 1; i < m_file->pageCount; ++i)
+		{
+			const PageFile::Chunk& chunk = m_file->chunk_for(i);
+			unsigned int offset = (i - chunk.firstPageID) * pageSize;
+			if(m_file->page_kind(i) == PK_LEAF &&
+			   MappedSortedPage(chunk.region, offset + PAGE_HEADER_SIZE, pageSize - PAGE_HEADER_SIZE, m_leafTupleManipulator, false).tuple_count() > 0)
+			{
+				m_file->recoverableLeafIDs.push_back(i);
+			}
+			else
+			{
+				m_file->deallocate_page(i);
+			}
+		}
+	}
+}
+
+//#################### PUBLIC METHODS ####################
+
+TupleManipulator MappedBTreePageController::btree_branch_tuple_manipulator() const
+{
+	return m_branchTupleManipulator;
+}
+
+TupleManipulator MappedBTreePageController::btree_leaf_tuple_manipulator() const
+{
+	return m_leafTupleManipulator;
+}
+
+int MappedBTreePageController::btree_page_id(const SortedPage& page) const
+{
+	std::map<const SortedPage*,int>::const_iterator it = m_file->pageIDs.find(&page);
+	if(it == m_file->pageIDs.end()) throw std::invalid_argument("The page was not made by this page controller.");
+	return it->second;
+}
+
+boost::optional<BTreePageController::BTreeStructure> MappedBTreePageController::load_btree_structure() const
+{
+	// Since the B+-tree that loads the structure will modify its pages, the saved structure is invalidated
+	// as it is taken; it becomes valid again when the B+-tree saves its structure on destruction.
+	BTreeStructure structure;
+	if(m_file->take_structure(&structure)) return structure;
+	else return boost::none;
+}
+
+SortedPage_Ptr MappedBTreePageController::make_btree_branch_page() const
+{
+	return make_page(m_branchTupleManipulator, PK_BRANCH, -1, false);
+}
+
+SortedPage_Ptr MappedBTreePageController::make_btree_leaf_page() const
+{
+	return make_page(m_leafTupleManipulator, PK_LEAF, -1, false);
+}
+
+unsigned int MappedBTreePageController::max_btree_branch_tuple_count() const
+{
+	return SlottedSortedPage::max_tuple_count_for(m_file->pageSize - PAGE_HEADER_SIZE, m_branchTupleManipulator);
+}
+
+unsigned int MappedBTreePageController::max_btree_leaf_tuple_count() const
+{
+	return SlottedSortedPage::max_tuple_count_for(m_file->pageSize - PAGE_HEADER_SIZE, m_leafTupleManipulator);
+}
+
+bool MappedBTreePageController::persists_btree_structure() const
+{
+	return true;
+}
+
+std::vector<SortedPage_Ptr> MappedBTreePageController::recover_leaf_pages()
+{
+	std::vector<SortedPage_Ptr> pages;
+	pages.reserve(m_file->recoverableLeafIDs.size());
+	for(std::vector<int>::const_iterator it = m_file->recoverableLeafIDs.begin(), iend = m_file->recoverableLeafIDs.end(); it != iend; ++it)
+	{
+		pages.push_back(make_page(m_leafTupleManipulator, PK_LEAF, *it, true));
+	}
+	m_file->recoverableLeafIDs.clear();
+
+	std::sort(pages.begin(), pages.end(), first_tuple_less);
+	return pages;
+}
+
+SortedPage_Ptr MappedBTreePageController::reopen_btree_page(int pageID, bool leaf) const
+{
+	const PageKind kind = leaf ? PK_LEAF : PK_BRANCH;
+	if(m_file->page_kind(pageID) != kind)
+	{
+		throw std::invalid_argument("The saved B+-tree structure does not match the pages in the data file.");
+	}
+	return make_page(leaf ? m_leafTupleManipulator : m_branchTupleManipulator, kind, pageID, false);
+}
+
+void MappedBTreePageController::save_btree_structure(const BTreeStructure& structure) const
+{
+	// Discard any structure that is still saved (e.g. if no B+-tree loaded it), since the new one supersedes it.
+	m_file->take_structure(NULL);
+
+	// Free the slots of any leaf pages from a previous session that were never recovered, since
+	// they are not part of the B+-tree being saved and would otherwise never be freed.
+	for(std::vector<int>::const_iterator it = m_file->recoverableLeafIDs.begin(), iend = m_file->recoverableLeafIDs.end(); it != iend; ++it)
+	{
+		m_file->deallocate_page(*it);
+	}
+	m_file->recoverableLeafIDs.clear();
+
+	m_file->write_structure(structure);
+}
+
+unsigned int MappedBTreePageController::used_page_count() const
+{
+	// Note that the header slot is not counted.
+	return m_file->usedPageCount - 1;
+}
+
+//#################### PRIVATE METHODS ####################
+
+SortedPage_Ptr MappedBTreePageController::make_page(const TupleManipulator& tupleManipulator, PageKind kind, int pageID, bool alwaysFree) const
+{
+	const bool fresh = pageID == -1;
+	if(fresh)
+	{
+		pageID = m_file->allocate_page();
+		m_file->set_page_kind(pageID, kind);
+	}
+
+	const PageFile::Chunk& chunk = m_file->chunk_for(pageID);
+	unsigned int offset = (pageID - chunk.firstPageID) * m_file->pageSize;
+	SortedPage_Ptr page(
+		new MappedSortedPage(chunk.region, offset + PAGE_HEADER_SIZE, m_file->pageSize - PAGE_HEADER_SIZE, tupleManipulator, fresh),
+		PageDeleter(m_file, pageID, alwaysFree)
+	);
+	m_file->pageIDs.insert(std::make_pair(page.get(), pageID));
+	return page;
+}
+
+}
@@ -0,0 +1,450 @@
+/**
+ * whery: PostingListBTree.cpp
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#include "whery/db/btrees/PostingListBTree.h"
+
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+
+#include "whery/db/base/IntFieldManipulator.h"
+
+namespace whery {
+
+//#################### LOCAL FUNCTIONS ####################
+
+namespace {
+
+/**
+Computes the value that is encoded to represent the difference between two consecutive payloads in a posting list.
+Since the payloads are strictly ascending, the difference is at least one, so one less than it is encoded.
+
+\param lower	The lower payload.
+\param upper	The upper payload.
+\return			One less than the difference between the payloads.
+*/
+unsigned int encoded_difference(int lower, int upper)
+{
+	return static_cast<unsigned int>(upper) - static_cast<unsigned int>(lower) - 1;
+}
+
+/**
+Calculates the number of bytes needed to encode the specified value as a variable-length integer.
+
+\param value	The value.
+\return			The number of bytes needed (between one and five).
+*/
+unsigned int varint_size(unsigned int value)
+{
+	unsigned int result = 1;
+	while(value >= 0x80)
+	{
+		value >>= 7;
+		++result;
+	}
+	return result;
+}
+
+/**
+Calculates the number of bytes needed to encode the differences between a range of consecutive payloads.
+
+\param payloads	The payloads (in ascending order).
+\param begin	The index of the first payload in the range.
+\param end		The index one beyond that of the last payload in the range.
+\return			The number of bytes needed.
+*/
+unsigned int encoded_size(const std::vector<int>& payloads, size_t begin, size_t end)
+{
+	unsigned int result = 0;
+	for(size_t i = begin + 1; i < end; ++i)
+	{
+		result += varint_size(encoded_difference(payloads[i - 1], payloads[i]));
+	}
+	return result;
+}
+
+/**
+Checks that the specified B+-tree is not in concurrent mode, and that its leaf tuples can hold posting lists
+whose keys have the specified number of fields, and gets the index of the field that holds their payload count. This is called before
+any of the other members of a posting list B+-tree are initialised, since they depend on the key arity.
+
+\param tree						The B+-tree.
+\param keyArity					The number of fields in each key.
+\return							The index of the field in each posting list that holds its payload count.
+\throw std::invalid_argument	If the B+-tree is in concurrent mode, or its leaf tuples do not consist of
+								keyArity key fields, followed by at least one int payload field and an int
+								payload count.
+*/
+unsigned int checked_count_field(const BTree_Ptr& tree, unsigned int keyArity)
+{
+	if(tree->is_concurrent())
+	{
+		throw std::invalid_argument("A posting list B+-tree updates its posting lists in place, so its B+-tree must not be in concurrent mode.");
+	}
+
+	const std::vector<const FieldManipulator*>& fieldManipulators = tree->leaf_tuple_manipulator().field_manipulators();
+	const unsigned int arity = static_cast<unsigned int>(fieldManipulators.size());
+	if(keyArity == 0 || arity < keyArity + 2)
+	{
+		throw std::invalid_argument("The leaf tuples of a posting list B+-tree must have at least one key field, one payload and a payload count.");
+	}
+
+	for(unsigned int i = keyArity; i < arity; ++i)
+	{
+		if(fieldManipulators[i] != &IntFieldManipulator::instance())
+		{
+			throw std::invalid_argument("The payloads and payload count of a posting list must be int fields.");
+		}
+	}
+
+	return arity - 1;
+}
+
+/**
+Makes an array containing the indices of the first n fields of a tuple.
+
+\param n	The number of fields.
+\return		The array [0,n).
+*/
+std::vector<unsigned int> first_fields(unsigned int n)
+{
+	std::vector<unsigned int> result(n);
+	for(unsigned int i = 0; i < n; ++i) result[i] = i;
+	return result;
+}
+
+}
+
+//#################### CONSTRUCTORS ####################
+
+PostingListBTree::PostingListBTree(const BTree_Ptr& tree, unsigned int keyArity)
+:	m_countField(checked_count_field(tree, keyArity)),
+	m_entryKeyPrototype(tree->leaf_tuple_manipulator(), first_fields(keyArity + 1)),
+	m_entryTupleManipulator(tree->leaf_tuple_manipulator().field_manipulators(), first_fields(keyArity + 1)),
+	m_keyArity(keyArity),
+	m_tree(tree)
+{
+	// The differences between the payloads are encoded in the bytes of the int fields between the first payload and the count.
+	m_byteCapacity = (m_countField - keyArity - 1) * sizeof(int);
+
+	// Note that the entries in any posting lists that the B+-tree already contains are only counted when first needed.
+}
+
+//#################### PUBLIC METHODS ####################
+
+PostingListBTree::ConstIterator PostingListBTree::begin() const
+{
+	return ConstIterator(this, m_tree->begin(), 0);
+}
+
+PostingListBTree::ConstIterator PostingListBTree::end() const
+{
+	return ConstIterator(this, m_tree->end(), 0);
+}
+
+PostingListBTree::EqualRangeResult PostingListBTree::equal_range(const ValueKey& key) const
+{
+	return std::make_pair(lower_bound(key), upper_bound(key));
+}
+
+void PostingListBTree::erase_tuple(const ValueKey& key)
+{
+	if(key.arity() != m_keyArity + 1)
+	{
+		throw std::invalid_argument("The key of an entry to erase from a posting list B+-tree must specify both its key fields and its payload.");
+	}
+
+	// Find the posting list that would contain the entry, and check whether or not its payload is in it.
+	BTree::ConstIterator it = find_posting_list(key);
+	if(it == m_tree->end()) return;
+
+	std::vector<int> payloads;
+	decode_payloads(*it, payloads);
+	std::vector<int>::iterator pt = std::lower_bound(payloads.begin(), payloads.end(), key.field(m_keyArity).get_int());
+	if(pt == payloads.end() || *pt != key.field(m_keyArity).get_int()) return;
+
+	// Update the posting list so that it no longer contains the payload (or simply erase it, if it was its only payload).
+	// Erasing a payload never makes the encoded differences any longer, so the remaining payloads always still fit.
+	if(payloads.size() > 1)
+	{
+		payloads.erase(pt);
+		FreshTuple postingList(m_tree->leaf_tuple_manipulator());
+		postingList.copy_from(*it);
+		if(!encode_payloads(payloads, 0, payloads.size(), postingList))
+		{
+			throw std::logic_error("Erasing a payload from a posting list should never stop its remaining payloads from fitting.");
+		}
+		m_tree->update_tuple(it, postingList);
+	}
+	else m_tree->erase_tuple(make_entry_key(*it));
+
+	if(m_tupleCount) --*m_tupleCount;
+}
+
+void PostingListBTree::insert_tuple(const Tuple& tuple)
+{
+	const ValueKey entryKey = make_entry_key(tuple);
+	const int payload = entryKey.field(m_keyArity).get_int();
+	FreshTuple postingList(m_tree->leaf_tuple_manipulator());
+	std::vector<int> payloads;
+
+	// If there is a posting list for the key that starts at or before the payload, the entry belongs in it, unless it
+	// is full and the payload comes after all of its payloads (as it will if the payloads are being inserted in order).
+	BTree::ConstIterator it = find_posting_list(entryKey);
+	if(it != m_tree->end())
+	{
+		decode_payloads(*it, payloads);
+		std::vector<int>::iterator pt = std::lower_bound(payloads.begin(), payloads.end(), payload);
+		if(pt != payloads.end() && *pt == payload) return;
+
+		const bool last = pt == payloads.end();
+		payloads.insert(pt, payload);
+		postingList.copy_from(*it);
+
+		if(encode_payloads(payloads, 0, payloads.size(), postingList))
+		{
+			m_tree->update_tuple(it, postingList);
+			if(m_tupleCount) ++*m_tupleCount;
+			return;
+		}
+		else if(!last)
+		{
+			// The posting list is full, so move its upper payloads to a fresh posting list.
+			const size_t split = split_point(payloads);
+			FreshTuple upperList(m_tree->leaf_tuple_manipulator());
+			upperList.copy_from(postingList);
+			if(!encode_payloads(payloads, 0, split, postingList) || !encode_payloads(payloads, split, payloads.size(), upperList))
+			{
+				throw std::logic_error("Each half of a split posting list should fit in a posting list of its own.");
+			}
+			m_tree->update_tuple(it, postingList);
+			m_tree->insert_tuple(upperList);
+			if(m_tupleCount) ++*m_tupleCount;
+			return;
+		}
+	}
+
+	// Otherwise, the payload comes before (or between) the payloads in the posting lists for the key, so add it to
+	// the start of the next posting list for the key if that has room, or else make a fresh posting list for it.
+	BTree::ConstIterator jt = m_tree->upper_bound(entryKey);
+	if(jt != m_tree->end() && same_key(*jt, entryKey))
+	{
+		decode_payloads(*jt, payloads);
+		payloads.insert(payloads.begin(), payload);
+		postingList.copy_from(*jt);
+		if(encode_payloads(payloads, 0, payloads.size(), postingList))
+		{
+			m_tree->update_tuple(jt, postingList);
+			if(m_tupleCount) ++*m_tupleCount;
+			return;
+		}
+	}
+
+	for(unsigned int i = 0; i < m_keyArity; ++i)
+	{
+		postingList.field(i).set_from(entryKey.field(i));
+	}
+
+	payloads.assign(1, payload);
+	encode_payloads(payloads, 0, 1, postingList);
+	m_tree->insert_tuple(postingList);
+	if(m_tupleCount) ++*m_tupleCount;
+}
+
+PostingListBTree::ConstIterator PostingListBTree::lower_bound(const ValueKey& key) const
+{
+	return bound(key, false);
+}
+
+const BTree& PostingListBTree::tree() const
+{
+	return *m_tree;
+}
+
+unsigned int PostingListBTree::tuple_count() const
+{
+	if(!m_tupleCount)
+	{
+		unsigned int tupleCount = 0;
+		for(BTree::ConstIterator it = m_tree->begin(), iend = m_tree->end(); it != iend; ++it)
+		{
+			tupleCount += payload_count(*it);
+		}
+		m_tupleCount = tupleCount;
+	}
+	return *m_tupleCount;
+}
+
+PostingListBTree::ConstIterator PostingListBTree::upper_bound(const ValueKey& key) const
+{
+	return bound(key, true);
+}
+
+//#################### PRIVATE METHODS ####################
+
+PostingListBTree::ConstIterator PostingListBTree::bound(const ValueKey& key, bool upper) const
+{
+	// If the key does not specify a payload, then all of the entries in a posting list compare the same
+	// way against it, so the bound is at the start of the posting list at the bound in the B+-tree.
+	if(key.arity() <= m_keyArity)
+	{
+		return ConstIterator(this, upper ? m_tree->upper_bound(key) : m_tree->lower_bound(key), 0);
+	}
+
+	// Otherwise, find the posting list that would contain the entry, and then find the bound within it.
+	// If there is no such posting list, all of the entries for the key that come after the payload are
+	// in the posting lists that start after it (as are all of the entries for later keys).
+	BTree::ConstIterator it = find_posting_list(key);
+	if(it == m_tree->end()) return ConstIterator(this, m_tree->upper_bound(key), 0);
+
+	std::vector<int> payloads;
+	decode_payloads(*it, payloads);
+	const int payload = key.field(m_keyArity).get_int();
+	const size_t position = (upper ? std::upper_bound(payloads.begin(), payloads.end(), payload)
+								   : std::lower_bound(payloads.begin(), payloads.end(), payload)) - payloads.begin();
+	if(position < payloads.size()) return ConstIterator(this, it, static_cast<unsigned int>(position));
+	else return ConstIterator(this, ++it, 0);
+}
+
+void PostingListBTree::decode_payloads(const Tuple& postingList, std::vector<int>& payloads) const
+{
+	const unsigned int count = payload_count(postingList);
+	payloads.resize(count);
+	payloads[0] = first_payload(postingList);
+
+	unsigned int offset = 0;
+	for(unsigned int i = 1; i < count; ++i)
+	{
+		payloads[i] = next_payload(postingList, payloads[i - 1], offset);
+	}
+}
+
+bool PostingListBTree::encode_payloads(const std::vector<int>& payloads, size_t begin, size_t end, FreshTuple& postingList) const
+{
+	if(encoded_size(payloads, begin, end) > m_byteCapacity) return false;
+
+	postingList.field(m_keyArity).set_int(payloads[begin]);
+	postingList.field(m_countField).set_int(static_cast<int>(end - begin));
+
+	// Encode the differences seven bits at a time, packing the bytes into the data fields in little-endian order.
+	const unsigned int firstDataField = m_keyArity + 1;
+	unsigned int offset = 0, word = 0;
+	for(size_t i = begin + 1; i < end; ++i)
+	{
+		unsigned int difference = encoded_difference(payloads[i - 1], payloads[i]);
+		do
+		{
+			unsigned int byte = difference & 0x7F;
+			difference >>= 7;
+			if(difference != 0) byte |= 0x80;
+
+			word |= byte << (8 * (offset % sizeof(int)));
+			if(++offset % sizeof(int) == 0)
+			{
+				postingList.field(firstDataField + offset / sizeof(int) - 1).set_int(static_cast<int>(word));
+				word = 0;
+			}
+		} while(difference != 0);
+	}
+
+	// Write the last partially-filled data field (if any), and clear the unused ones, so that equivalent posting lists are always identical.
+	for(unsigned int i = firstDataField + offset / sizeof(int); i < m_countField; ++i)
+	{
+		postingList.field(i).set_int(static_cast<int>(word));
+		word = 0;
+	}
+
+	return true;
+}
+
+BTree::ConstIterator PostingListBTree::find_posting_list(const ValueKey& entryKey) const
+{
+	// Find the first posting list that starts after the entry, and step back to the one before it.
+	BTree::ConstIterator it = m_tree->upper_bound(entryKey);
+	if(it == m_tree->begin()) return m_tree->end();
+	--it;
+	return same_key(*it, entryKey) ? it : m_tree->end();
+}
+
+int PostingListBTree::first_payload(const Tuple& postingList) const
+{
+	return postingList.field(m_keyArity).get_int();
+}
+
+FreshTuple PostingListBTree::make_entry(const Tuple& postingList, int payload) const
+{
+	FreshTuple result(m_entryTupleManipulator);
+	for(unsigned int i = 0; i < m_keyArity; ++i)
+	{
+		result.field(i).set_from(postingList.field(i));
+	}
+	result.field(m_keyArity).set_int(payload);
+	return result;
+}
+
+ValueKey PostingListBTree::make_entry_key(const Tuple& source) const
+{
+	ValueKey result(m_entryKeyPrototype);
+	for(unsigned int i = 0; i <= m_keyArity; ++i)
+	{
+		result.field(i).set_from(source.field(i));
+	}
+	return result;
+}
+
+int PostingListBTree::next_payload(const Tuple& postingList, int payload, unsigned int& offset) const
+{
+	unsigned int difference = 0;
+	for(unsigned int shift = 0; ; shift += 7)
+	{
+		const unsigned int word = static_cast<unsigned int>(postingList.field(m_keyArity + 1 + offset / sizeof(int)).get_int());
+		const unsigned int byte = (word >> (8 * (offset % sizeof(int)))) & 0xFF;
+		++offset;
+
+		difference |= (byte & 0x7F) << shift;
+		if((byte & 0x80) == 0) break;
+	}
+	return static_cast<int>(static_cast<unsigned int>(payload) + difference + 1);
+}
+
+unsigned int PostingListBTree::payload_count(const Tuple& postingList) const
+{
+	return static_cast<unsigned int>(postingList.field(m_countField).get_int());
+}
+
+bool PostingListBTree::same_key(const Tuple& lhs, const Tuple& rhs) const
+{
+	for(unsigned int i = 0; i < m_keyArity; ++i)
+	{
+		if(lhs.field(i).compare_to(rhs.field(i)) != 0) return false;
+	}
+	return true;
+}
+
+size_t PostingListBTree::split_point(const std::vector<int>& payloads) const
+{
+	// Splitting before payload k drops the difference that led up to it, since it becomes the first payload of the upper posting list.
+	// Each encoded difference takes at most five bytes, and the posting list fitted before the payload that made it too big was inserted,
+	// so splitting at the last payload for which the lower posting list still fits always leaves an upper posting list that fits too.
+	const unsigned int total = encoded_size(payloads, 0, payloads.size());
+	size_t result = 0;
+	unsigned int resultSize = 0, lowerSize = 0;
+	for(size_t k = 1; k < payloads.size(); ++k)
+	{
+		const unsigned int size = varint_size(encoded_difference(payloads[k - 1], payloads[k]));
+		const unsigned int upperSize = total - lowerSize - size;
+		if(lowerSize <= m_byteCapacity && upperSize <= m_byteCapacity && (result == 0 || std::max(lowerSize, upperSize) < resultSize))
+		{
+			result = k;
+			resultSize = std::max(lowerSize, upperSize);
+		}
+		lowerSize += size;
+	}
+
+	assert(result != 0);
+	return result;
+}
+
+}
@@ -0,0 +1,326 @@
+/**
+ * whery: BufferPool.cpp
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#include "whery/db/buffers/BufferPool.h"
+
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
+
+namespace whery {
+
+//#################### NESTED CLASSES ####################
+
+/**
+\brief An instance of this class is a slotted page whose buffer is one of a buffer pool's frames.
+*/
+class BufferPool::FramePage : public SlottedSortedPage
+{
+	//#################### PRIVATE VARIABLES ####################
+private:
+	/** The frame's buffer. */
+	char *m_buffer;
+
+	/** The size (in bytes) of the frame's buffer. */
+	unsigned int m_bufferSize;
+
+	//#################### CONSTRUCTORS ####################
+public:
+	FramePage(char *buffer, unsigned int bufferSize, const TupleManipulator& tupleManipulator)
+	:	SlottedSortedPage(tupleManipulator), m_buffer(buffer), m_bufferSize(bufferSize)
+	{}
+
+	//#################### PUBLIC METHODS ####################
+public:
+	/**
+	Makes the page view whatever has just been loaded into the frame's buffer.
+
+	\param fresh	Whether or not the page is a fresh one (in which case the buffer is formatted as an empty page).
+	*/
+	void load(bool fresh)
+	{
+		initialise(m_buffer, m_bufferSize, fresh);
+	}
+};
+
+//#################### CONSTRUCTORS ####################
+
+BufferPool::Pin::Pin(BufferPool& pool, int pageID, const TupleManipulator& tupleManipulator, bool fresh, int *frameHint)
+:	m_dirty(fresh), m_pool(&pool)
+{
+	m_frame = m_pool->pin_page(pageID, tupleManipulator, fresh, frameHint ? *frameHint : -1);
+	m_page = m_pool->m_frames[m_frame].page;
+	if(frameHint) *frameHint = static_cast<int>(m_frame);
+}
+
+BufferPool::BufferPool(const PageStore_Ptr& store, const EvictionPolicy_Ptr& policy, unsigned int memoryBudget)
+:	m_policy(policy), m_store(store)
+{
+	// Each frame needs room for both its page and its row cache (see Pin::row).
+	const unsigned int frameCount = memoryBudget / (2 * m_store->page_size());
+	if(frameCount < 3)
+	{
+		throw std::invalid_argument("The memory budget for a buffer pool must be large enough for at least three frames (each of which takes up twice the page size).");
+	}
+
+	m_frames.reserve(frameCount);
+	m_freeFrames.reserve(frameCount);
+	for(unsigned int i = 0; i < frameCount; ++i)
+	{
+		m_frames.push_back(Frame(m_store->page_size()));
+		m_freeFrames.push_back(frameCount - 1 - i);
+	}
+
+	m_policy->reset(frameCount);
+	m_recentFrames[0] = m_recentFrames[1] = -1;
+}
+
+//#################### DESTRUCTOR ####################
+
+BufferPool::Pin::~Pin()
+{
+	m_pool->unpin_page(m_frame, m_dirty);
+}
+
+//#################### PUBLIC OPERATORS ####################
+
+SlottedSortedPage& BufferPool::Pin::operator*() const
+{
+	return *m_page;
+}
+
+SlottedSortedPage *BufferPool::Pin::operator->() const
+{
+	return m_page;
+}
+
+//#################### PUBLIC METHODS ####################
+
+void BufferPool::Pin::mark_dirty()
+{
+	m_dirty = true;
+	m_pool->m_frames[m_frame].invalidate_rows();
+}
+
+char *BufferPool::Pin::row(unsigned int i) const
+{
+	Frame& f = m_pool->m_frames[m_frame];
+	const unsigned int tupleSize = m_page->tuple_manipulator().size();
+	assert(!m_page->tuple_manipulator().uses_suffix_truncation() && (i + 1) * tupleSize <= f.buffer.size());
+
+	if(f.rows.empty()) f.rows.resize(f.buffer.size());
+
+	char *location = &f.rows[i * tupleSize];
+	if(f.rowStamps[i] != f.rowGeneration)
+	{
+		memcpy(location, m_page->tuple_location(i), tupleSize);
+		f.rowStamps[i] = f.rowGeneration;
+	}
+	return location;
+}
+
+int BufferPool::allocate_page()
+{
+	return m_store->allocate_page();
+}
+
+char *BufferPool::cached_row(int pageID, int frame, unsigned int i) const
+{
+	if(frame == -1) return NULL;
+
+	const Frame& f = m_frames[frame];
+	if(f.pageID != pageID || i >= f.rowStamps.size() || f.rowStamps[i] != f.rowGeneration) return NULL;
+
+	return const_cast<char*>(&f.rows[i * f.page->tuple_manipulator().size()]);
+}
+
+void BufferPool::discard_page(int pageID)
+{
+	std::map<int,unsigned int>::iterator it = m_pageTable.find(pageID);
+	if(it != m_pageTable.end())
+	{
+		const unsigned int frame = it->second;
+		Frame& f = m_frames[frame];
+		if(f.pinCount > 0)
+		{
+			throw std::logic_error("It is not possible to discard a pinned page.");
+		}
+
+		m_policy->page_discarded(frame);
+		m_pageTable.erase(it);
+		f.dirty = f.evictable = false;
+		f.page = NULL;
+		f.pageID = -1;
+		m_freeFrames.push_back(frame);
+	}
+
+	m_store->deallocate_page(pageID);
+}
+
+void BufferPool::flush()
+{
+	for(std::vector<Frame>::iterator it = m_frames.begin(), iend = m_frames.end(); it != iend; ++it)
+	{
+		if(it->pageID != -1 && it->dirty)
+		{
+			m_store->write_page(it->pageID, &it->buffer[0]);
+			it->dirty = false;
+		}
+	}
+}
+
+unsigned int BufferPool::frame_count() const
+{
+	return static_cast<unsigned int>(m_frames.size());
+}
+
+unsigned int BufferPool::page_size() const
+{
+	return m_store->page_size();
+}
+
+unsigned int BufferPool::resident_page_count() const
+{
+	return static_cast<unsigned int>(m_pageTable.size());
+}
+
+//#################### PRIVATE METHODS ####################
+
+unsigned int BufferPool::acquire_frame()
+{
+	if(!m_freeFrames.empty())
+	{
+		unsigned int frame = m_freeFrames.back();
+		m_freeFrames.pop_back();
+		return frame;
+	}
+
+	// All the frames contain pages, so ask the eviction policy to choose one whose page can be evicted.
+	int victim = m_policy->choose_victim();
+	if(victim == -1)
+	{
+		throw std::runtime_error("All of the frames in the buffer pool are in use, so no page can be evicted.");
+	}
+
+	assert(m_frames[victim].evictable);
+	evict_page(victim);
+	return victim;
+}
+
+void BufferPool::evict_page(unsigned int frame)
+{
+	Frame& f = m_frames[frame];
+	if(f.dirty)
+	{
+		m_store->write_page(f.pageID, &f.buffer[0]);
+		f.dirty = false;
+	}
+
+	m_policy->page_evicted(frame);
+	m_pageTable.erase(f.pageID);
+	f.evictable = false;
+	f.page = NULL;
+	f.pageID = -1;
+}
+
+void BufferPool::load_page(unsigned int frame, int pageID, const TupleManipulator& tupleManipulator, bool fresh)
+{
+	Frame& f = m_frames[frame];
+	if(!fresh) m_store->read_page(pageID, &f.buffer[0]);
+
+	// Find (or if necessary make) a page object for the tuple manipulator, and point it at the page's data.
+	f.page = NULL;
+	for(std::vector<FramePage_Ptr>::const_iterator it = f.pages.begin(), iend = f.pages.end(); it != iend; ++it)
+	{
+		if((*it)->tuple_manipulator() == tupleManipulator)
+		{
+			f.page = it->get();
+			break;
+		}
+	}
+
+	if(!f.page)
+	{
+		f.pages.push_back(FramePage_Ptr(new FramePage(&f.buffer[0], static_cast<unsigned int>(f.buffer.size()), tupleManipulator)));
+		f.page = f.pages.back().get();
+	}
+
+	f.page->load(fresh);
+	f.pageID = pageID;
+
+	// Discard the rows of the frame's previous page.
+	if(f.rowStamps.size() < f.page->max_tuple_count()) f.rowStamps.resize(f.page->max_tuple_count(), 0);
+	f.invalidate_rows();
+}
+
+void BufferPool::note_access(unsigned int frame)
+{
+	if(m_recentFrames[0] != static_cast<int>(frame))
+	{
+		// If the frame was not already one of the two most recent ones, the older of those is no longer protected from eviction.
+		const int displaced = m_recentFrames[1] != static_cast<int>(frame) ? m_recentFrames[1] : -1;
+		m_recentFrames[1] = m_recentFrames[0];
+		m_recentFrames[0] = frame;
+		update_evictability(displaced);
+	}
+}
+
+unsigned int BufferPool::pin_page(int pageID, const TupleManipulator& tupleManipulator, bool fresh, int frameHint)
+{
+	unsigned int frame;
+
+	std::map<int,unsigned int>::const_iterator it;
+	if(frameHint != -1 && m_frames[frameHint].pageID == pageID)
+	{
+		// The page is still in the frame in which it was last found, so there is no need to search the page table.
+		assert(!fresh);
+		frame = frameHint;
+		m_policy->page_accessed(frame);
+	}
+	else if((it = m_pageTable.find(pageID)) != m_pageTable.end())
+	{
+		// The page is already resident.
+		assert(!fresh);
+		frame = it->second;
+		m_policy->page_accessed(frame);
+	}
+	else
+	{
+		// The page is not resident, so load it into a frame (or simply make it empty if it is fresh).
+		frame = acquire_frame();
+		load_page(frame, pageID, tupleManipulator, fresh);
+		m_pageTable.insert(std::make_pair(pageID, frame));
+		m_policy->page_loaded(frame, pageID);
+	}
+
+	++m_frames[frame].pinCount;
+	note_access(frame);
+	update_evictability(frame);
+	return frame;
+}
+
+void BufferPool::unpin_page(unsigned int frame, bool dirty)
+{
+	Frame& f = m_frames[frame];
+	assert(f.pinCount > 0);
+	--f.pinCount;
+	if(dirty) f.dirty = true;
+	update_evictability(frame);
+}
+
+void BufferPool::update_evictability(int frame)
+{
+	if(frame == -1) return;
+
+	Frame& f = m_frames[frame];
+	const bool evictable = f.pageID != -1 && f.pinCount == 0 && frame != m_recentFrames[0] && frame != m_recentFrames[1];
+	if(evictable != f.evictable)
+	{
+		f.evictable = evictable;
+		m_policy->set_evictable(frame, evictable);
+	}
+}
+
+}
@@ -0,0 +1,84 @@
+/**
+ * whery: ClockEvictionPolicy.cpp
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#include "whery/db/buffers/ClockEvictionPolicy.h"
+
+#include <cassert>
+
+namespace whery {
+
+//#################### CONSTRUCTORS ####################
+
+ClockEvictionPolicy::ClockEvictionPolicy()
+:	m_evictableCount(0), m_hand(0)
+{}
+
+//#################### PUBLIC METHODS ####################
+
+int ClockEvictionPolicy::choose_victim()
+{
+	if(m_evictableCount == 0) return -1;
+
+	// Two full sweeps are always enough: the first clears the reference bits of any evictable
+	// frames it passes, so the second is guaranteed to find a victim.
+	const unsigned int frameCount = static_cast<unsigned int>(m_occupied.size());
+	for(unsigned int i = 0; i < 2 * frameCount; ++i)
+	{
+		unsigned int frame = m_hand;
+		m_hand = (m_hand + 1) % frameCount;
+
+		if(!m_evictable[frame]) continue;
+
+		if(m_referenced[frame]) m_referenced[frame] = false;
+		else return frame;
+	}
+
+	assert(false);
+	return -1;
+}
+
+void ClockEvictionPolicy::page_accessed(unsigned int frame)
+{
+	m_referenced[frame] = true;
+}
+
+void ClockEvictionPolicy::page_discarded(unsigned int frame)
+{
+	set_evictable(frame, false);
+	m_occupied[frame] = m_referenced[frame] = false;
+}
+
+void ClockEvictionPolicy::page_evicted(unsigned int frame)
+{
+	set_evictable(frame, false);
+	m_occupied[frame] = m_referenced[frame] = false;
+}
+
+void ClockEvictionPolicy::page_loaded(unsigned int frame, int /*pageID*/)
+{
+	m_occupied[frame] = m_referenced[frame] = true;
+}
+
+void ClockEvictionPolicy::reset(unsigned int frameCount)
+{
+	m_evictable.assign(frameCount, false);
+	m_evictableCount = 0;
+	m_hand = 0;
+	m_occupied.assign(frameCount, false);
+	m_referenced.assign(frameCount, false);
+}
+
+void ClockEvictionPolicy::set_evictable(unsigned int frame, bool evictable)
+{
+	assert(!evictable || m_occupied[frame]);
+	if(m_evictable[frame] != evictable)
+	{
+		m_evictable[frame] = evictable;
+		if(evictable) ++m_evictableCount;
+		else --m_evictableCount;
+	}
+}
+
+}
@@ -0,0 +1,65 @@
+/**
+ * whery: FilePageStore.cpp
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#include "whery/db/buffers/FilePageStore.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace whery {
+
+//#################### CONSTRUCTORS ####################
+
+FilePageStore::FilePageStore(const std::string& filename, unsigned int pageSize)
+:	m_fs(filename.c_str(), std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc), m_pageSize(pageSize)
+{
+	if(!m_fs)
+	{
+		throw std::runtime_error("Could not open the page store file " + filename + ".");
+	}
+}
+
+//#################### PUBLIC METHODS ####################
+
+int FilePageStore::allocate_page()
+{
+	return m_pageIDAllocator.allocate();
+}
+
+void FilePageStore::deallocate_page(int pageID)
+{
+	m_pageIDAllocator.deallocate(pageID);
+}
+
+unsigned int FilePageStore::page_size() const
+{
+	return m_pageSize;
+}
+
+void FilePageStore::read_page(int pageID, char *buffer) const
+{
+	m_fs.seekg(static_cast<std::streamoff>(pageID) * m_pageSize);
+	m_fs.read(buffer, m_pageSize);
+
+	// If the page lies (partly) beyond the end of the file, it has never been written, so zero-fill the rest of it.
+	std::streamsize bytesRead = m_fs.gcount();
+	if(bytesRead < static_cast<std::streamsize>(m_pageSize))
+	{
+		std::fill(buffer + bytesRead, buffer + m_pageSize, 0);
+		m_fs.clear();
+	}
+}
+
+void FilePageStore::write_page(int pageID, const char *buffer)
+{
+	m_fs.seekp(static_cast<std::streamoff>(pageID) * m_pageSize);
+	m_fs.write(buffer, m_pageSize);
+	if(!m_fs)
+	{
+		throw std::runtime_error("Could not write a page to the page store file.");
+	}
+}
+
+}
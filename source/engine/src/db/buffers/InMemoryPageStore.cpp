@@ -0,0 +1,58 @@
+/**
+ * whery: InMemoryPageStore.cpp
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#include "whery/db/buffers/InMemoryPageStore.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace whery {
+
+//#################### CONSTRUCTORS ####################
+
+InMemoryPageStore::InMemoryPageStore(unsigned int pageSize)
+:	m_pageSize(pageSize)
+{}
+
+//#################### PUBLIC METHODS ####################
+
+int InMemoryPageStore::allocate_page()
+{
+	int pageID = m_pageIDAllocator.allocate();
+	if(static_cast<unsigned int>(pageID) >= m_pages.size())
+	{
+		m_pages.resize(pageID + 1);
+	}
+	return pageID;
+}
+
+void InMemoryPageStore::deallocate_page(int pageID)
+{
+	m_pageIDAllocator.deallocate(pageID);
+
+	// Release the memory used by the page (note that swapping is needed to guarantee this).
+	std::vector<char>().swap(m_pages[pageID]);
+}
+
+unsigned int InMemoryPageStore::page_size() const
+{
+	return m_pageSize;
+}
+
+void InMemoryPageStore::read_page(int pageID, char *buffer) const
+{
+	assert(static_cast<unsigned int>(pageID) < m_pages.size());
+	const std::vector<char>& page = m_pages[pageID];
+	if(page.empty()) std::fill(buffer, buffer + m_pageSize, 0);
+	else std::copy(page.begin(), page.end(), buffer);
+}
+
+void InMemoryPageStore::write_page(int pageID, const char *buffer)
+{
+	assert(static_cast<unsigned int>(pageID) < m_pages.size());
+	m_pages[pageID].assign(buffer, buffer + m_pageSize);
+}
+
+}
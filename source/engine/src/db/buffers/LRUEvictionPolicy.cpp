@@ -0,0 +1,71 @@
+/**
+ * whery: LRUEvictionPolicy.cpp
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#include "whery/db/buffers/LRUEvictionPolicy.h"
+
+#include <cassert>
+
+namespace whery {
+
+//#################### PUBLIC METHODS ####################
+
+int LRUEvictionPolicy::choose_victim()
+{
+	return m_frames.empty() ? -1 : static_cast<int>(m_frames.front());
+}
+
+void LRUEvictionPolicy::page_accessed(unsigned int frame)
+{
+	if(m_positions[frame] != m_frames.end())
+	{
+		m_frames.splice(m_frames.end(), m_frames, m_positions[frame]);
+	}
+}
+
+void LRUEvictionPolicy::page_discarded(unsigned int frame)
+{
+	remove_frame(frame);
+}
+
+void LRUEvictionPolicy::page_evicted(unsigned int frame)
+{
+	remove_frame(frame);
+}
+
+void LRUEvictionPolicy::page_loaded(unsigned int frame, int /*pageID*/)
+{
+	// The page is not evictable until the pool says so (see set_evictable).
+	assert(m_positions[frame] == m_frames.end());
+	(void)frame;
+}
+
+void LRUEvictionPolicy::reset(unsigned int frameCount)
+{
+	m_frames.clear();
+	m_positions.assign(frameCount, m_frames.end());
+}
+
+void LRUEvictionPolicy::set_evictable(unsigned int frame, bool evictable)
+{
+	if(evictable)
+	{
+		assert(m_positions[frame] == m_frames.end());
+		m_positions[frame] = m_frames.insert(m_frames.end(), frame);
+	}
+	else remove_frame(frame);
+}
+
+//#################### PRIVATE METHODS ####################
+
+void LRUEvictionPolicy::remove_frame(unsigned int frame)
+{
+	if(m_positions[frame] != m_frames.end())
+	{
+		m_frames.erase(m_positions[frame]);
+		m_positions[frame] = m_frames.end();
+	}
+}
+
+}
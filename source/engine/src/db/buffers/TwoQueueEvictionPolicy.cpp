@@ -0,0 +1,131 @@
+/**
+ * whery: TwoQueueEvictionPolicy.cpp
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#include "whery/db/buffers/TwoQueueEvictionPolicy.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace whery {
+
+//#################### PUBLIC METHODS ####################
+
+int TwoQueueEvictionPolicy::choose_victim()
+{
+	// Prefer to take the victim from A1in if it is larger than its target size, and from Am otherwise,
+	// but fall back to the other queue if the preferred one does not contain an evictable frame.
+	int victim;
+	if(m_a1in.size() > m_targetA1InSize)
+	{
+		victim = first_evictable(m_a1in);
+		if(victim == -1) victim = first_evictable(m_am);
+	}
+	else
+	{
+		victim = first_evictable(m_am);
+		if(victim == -1) victim = first_evictable(m_a1in);
+	}
+	return victim;
+}
+
+void TwoQueueEvictionPolicy::page_accessed(unsigned int frame)
+{
+	// Accesses to pages in A1in are deliberately ignored (they are likely to be correlated with the initial access).
+	if(m_queues[frame] == Q_AM)
+	{
+		m_am.splice(m_am.end(), m_am, m_positions[frame]);
+	}
+}
+
+void TwoQueueEvictionPolicy::page_discarded(unsigned int frame)
+{
+	remove_frame(frame);
+}
+
+void TwoQueueEvictionPolicy::page_evicted(unsigned int frame)
+{
+	// If the page is being evicted from A1in, remember its ID in A1out.
+	if(m_queues[frame] == Q_A1IN)
+	{
+		m_a1out.push_back(m_pageIDs[frame]);
+		if(m_a1out.size() > m_maxA1OutSize) m_a1out.pop_front();
+	}
+
+	remove_frame(frame);
+}
+
+void TwoQueueEvictionPolicy::page_loaded(unsigned int frame, int pageID)
+{
+	assert(m_queues[frame] == Q_NONE);
+	m_pageIDs[frame] = pageID;
+
+	std::list<int>::iterator it = std::find(m_a1out.begin(), m_a1out.end(), pageID);
+	if(it != m_a1out.end())
+	{
+		// The page was evicted from A1in recently, so it goes into Am.
+		m_a1out.erase(it);
+		m_positions[frame] = m_am.insert(m_am.end(), frame);
+		m_queues[frame] = Q_AM;
+	}
+	else
+	{
+		// The page has not been seen recently, so it goes into A1in.
+		m_positions[frame] = m_a1in.insert(m_a1in.end(), frame);
+		m_queues[frame] = Q_A1IN;
+	}
+}
+
+void TwoQueueEvictionPolicy::reset(unsigned int frameCount)
+{
+	m_a1in.clear();
+	m_a1out.clear();
+	m_am.clear();
+	m_evictable.assign(frameCount, false);
+	m_pageIDs.assign(frameCount, -1);
+	m_positions.assign(frameCount, std::list<unsigned int>::iterator());
+	m_queues.assign(frameCount, Q_NONE);
+
+	// These are the sizes suggested in the original paper (Kin = 25% and Kout = 50% of the pool).
+	m_maxA1OutSize = std::max(1u, frameCount / 2);
+	m_targetA1InSize = std::max(1u, frameCount / 4);
+}
+
+void TwoQueueEvictionPolicy::set_evictable(unsigned int frame, bool evictable)
+{
+	assert(!evictable || m_queues[frame] != Q_NONE);
+	m_evictable[frame] = evictable;
+}
+
+//#################### PRIVATE METHODS ####################
+
+int TwoQueueEvictionPolicy::first_evictable(const std::list<unsigned int>& queue) const
+{
+	for(std::list<unsigned int>::const_iterator it = queue.begin(), iend = queue.end(); it != iend; ++it)
+	{
+		if(m_evictable[*it]) return *it;
+	}
+	return -1;
+}
+
+void TwoQueueEvictionPolicy::remove_frame(unsigned int frame)
+{
+	switch(m_queues[frame])
+	{
+	case Q_A1IN:
+		m_a1in.erase(m_positions[frame]);
+		break;
+	case Q_AM:
+		m_am.erase(m_positions[frame]);
+		break;
+	default:
+		assert(false);
+		break;
+	}
+
+	m_evictable[frame] = false;
+	m_queues[frame] = Q_NONE;
+}
+
+}
@@ -0,0 +1,231 @@
+/**
+ * whery: BufferedSortedPage.cpp
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#include "whery/db/pages/BufferedSortedPage.h"
+
+#include <stdexcept>
+
+namespace whery {
+
+//#################### CONSTRUCTORS ####################
+
+BufferedSortedPage::BufferedSortedPage(const BufferPool_Ptr& pool, const TupleManipulator& tupleManipulator)
+:	m_frameHint(-1), m_pageID(pool->allocate_page()), m_pool(pool), m_tupleCount(0), m_tupleManipulator(tupleManipulator)
+{
+	if(tupleManipulator.uses_suffix_truncation())
+	{
+		m_pool->discard_page(m_pageID);
+		throw std::invalid_argument("A buffered page cannot store tuples with trailing key fields omitted.");
+	}
+
+	BufferPool::Pin pin(*m_pool, m_pageID, m_tupleManipulator, true, &m_frameHint);
+	m_maxTupleCount = pin->max_tuple_count();
+}
+
+//#################### DESTRUCTOR ####################
+
+BufferedSortedPage::~BufferedSortedPage()
+{
+	m_pool->discard_page(m_pageID);
+}
+
+//#################### PUBLIC METHODS ####################
+
+void BufferedSortedPage::add_tuple(const Tuple& tuple)
+{
+	BufferPool::Pin pin(*m_pool, m_pageID, m_tupleManipulator, false, &m_frameHint);
+	pin->add_tuple(tuple);
+	page_modified(pin);
+}
+
+SortedPage::TupleSetCIter BufferedSortedPage::begin() const
+{
+	return TupleSetCIter(this, 0);
+}
+
+unsigned int BufferedSortedPage::buffer_size() const
+{
+	return m_pool->page_size();
+}
+
+void BufferedSortedPage::clear()
+{
+	BufferPool::Pin pin(*m_pool, m_pageID, m_tupleManipulator, false, &m_frameHint);
+	pin->clear();
+	page_modified(pin);
+}
+
+unsigned int BufferedSortedPage::empty_tuple_count() const
+{
+	return max_tuple_count() - tuple_count();
+}
+
+SortedPage::TupleSetCIter BufferedSortedPage::end() const
+{
+	return TupleSetCIter(this, tuple_count());
+}
+
+SortedPage::EqualRangeResult BufferedSortedPage::equal_range(const RangeKey& key) const
+{
+	BufferPool::Pin pin(*m_pool, m_pageID, m_tupleManipulator, false, &m_frameHint);
+	EqualRangeResult result = pin->equal_range(key);
+	return std::make_pair(wrap(result.first), wrap(result.second));
+}
+
+SortedPage::EqualRangeResult BufferedSortedPage::equal_range(const ValueKey& key) const
+{
+	BufferPool::Pin pin(*m_pool, m_pageID, m_tupleManipulator, false, &m_frameHint);
+	EqualRangeResult result = pin->equal_range(key);
+	return std::make_pair(wrap(result.first), wrap(result.second));
+}
+
+void BufferedSortedPage::erase_tuple(const BackedTuple& key)
+{
+	BufferPool::Pin pin(*m_pool, m_pageID, m_tupleManipulator, false, &m_frameHint);
+	pin->erase_tuple(key);
+	page_modified(pin);
+}
+
+void BufferedSortedPage::erase_tuple(const TupleSetCIter& it)
+{
+	BufferPool::Pin pin(*m_pool, m_pageID, m_tupleManipulator, false, &m_frameHint);
+	pin->erase_tuple(TupleSetCIter(&*pin, it.index()));
+	page_modified(pin);
+}
+
+void BufferedSortedPage::erase_tuple(const TupleSetCRIter& rit)
+{
+	BufferPool::Pin pin(*m_pool, m_pageID, m_tupleManipulator, false, &m_frameHint);
+	pin->erase_tuple(TupleSetCRIter(TupleSetCIter(&*pin, rit.base().index())));
+	page_modified(pin);
+}
+
+void BufferedSortedPage::erase_tuples(const TupleSetCIter& begin, const TupleSetCIter& end)
+{
+	BufferPool::Pin pin(*m_pool, m_pageID, m_tupleManipulator, false, &m_frameHint);
+	pin->erase_tuples(TupleSetCIter(&*pin, begin.index()), TupleSetCIter(&*pin, end.index()));
+	page_modified(pin);
+}
+
+const std::vector<const FieldManipulator*>& BufferedSortedPage::field_manipulators() const
+{
+	return m_tupleManipulator.field_manipulators();
+}
+
+SortedPage::TupleSetCIter BufferedSortedPage::find(const ValueKey& key) const
+{
+	BufferPool::Pin pin(*m_pool, m_pageID, m_tupleManipulator, false, &m_frameHint);
+	return wrap(pin->find(key));
+}
+
+SortedPage::TupleSetCIter BufferedSortedPage::lower_bound(const RangeKey& key) const
+{
+	BufferPool::Pin pin(*m_pool, m_pageID, m_tupleManipulator, false, &m_frameHint);
+	return wrap(pin->lower_bound(key));
+}
+
+SortedPage::TupleSetCIter BufferedSortedPage::lower_bound(const ValueKey& key) const
+{
+	BufferPool::Pin pin(*m_pool, m_pageID, m_tupleManipulator, false, &m_frameHint);
+	return wrap(pin->lower_bound(key));
+}
+
+unsigned int BufferedSortedPage::max_tuple_count() const
+{
+	return m_maxTupleCount;
+}
+
+double BufferedSortedPage::percentage_full() const
+{
+	return tuple_count() * 100.0 / max_tuple_count();
+}
+
+SortedPage::TupleSetCRIter BufferedSortedPage::rbegin() const
+{
+	return TupleSetCRIter(end());
+}
+
+void BufferedSortedPage::read_doubles(unsigned int fieldIndex, unsigned int begin, unsigned int end, double *values) const
+{
+	BufferPool::Pin pin(*m_pool, m_pageID, m_tupleManipulator, false, &m_frameHint);
+	pin->read_doubles(fieldIndex, begin, end, values);
+}
+
+void BufferedSortedPage::read_ints(unsigned int fieldIndex, unsigned int begin, unsigned int end, int *values) const
+{
+	BufferPool::Pin pin(*m_pool, m_pageID, m_tupleManipulator, false, &m_frameHint);
+	pin->read_ints(fieldIndex, begin, end, values);
+}
+
+SortedPage::TupleSetCRIter BufferedSortedPage::rend() const
+{
+	return TupleSetCRIter(begin());
+}
+
+bool BufferedSortedPage::supports_concurrent_reads() const
+{
+	// The buffer pool that holds the page is not thread-safe, so even reading the page from several threads is unsafe.
+	return false;
+}
+
+unsigned int BufferedSortedPage::tuple_count() const
+{
+	return m_tupleCount;
+}
+
+char *BufferedSortedPage::tuple_location(unsigned int i) const
+{
+	char *location = m_pool->cached_row(m_pageID, m_frameHint, i);
+	if(!location)
+	{
+		BufferPool::Pin pin(*m_pool, m_pageID, m_tupleManipulator, false, &m_frameHint);
+		location = pin.row(i);
+	}
+	return location;
+}
+
+void BufferedSortedPage::tuple_locations(unsigned int begin, unsigned int end, const char **locations) const
+{
+	// Use any copies of the tuples in the range that are already in the row cache, and copy the rest, pinning the page only once to do so.
+	unsigned int i = begin;
+	while(i < end && (locations[i - begin] = m_pool->cached_row(m_pageID, m_frameHint, i)) != NULL) ++i;
+	if(i < end)
+	{
+		BufferPool::Pin pin(*m_pool, m_pageID, m_tupleManipulator, false, &m_frameHint);
+		for(; i < end; ++i) locations[i - begin] = pin.row(i);
+	}
+}
+
+const TupleManipulator& BufferedSortedPage::tuple_manipulator() const
+{
+	return m_tupleManipulator;
+}
+
+SortedPage::TupleSetCIter BufferedSortedPage::upper_bound(const RangeKey& key) const
+{
+	BufferPool::Pin pin(*m_pool, m_pageID, m_tupleManipulator, false, &m_frameHint);
+	return wrap(pin->upper_bound(key));
+}
+
+SortedPage::TupleSetCIter BufferedSortedPage::upper_bound(const ValueKey& key) const
+{
+	BufferPool::Pin pin(*m_pool, m_pageID, m_tupleManipulator, false, &m_frameHint);
+	return wrap(pin->upper_bound(key));
+}
+
+//#################### PRIVATE METHODS ####################
+
+void BufferedSortedPage::page_modified(BufferPool::Pin& pin)
+{
+	pin.mark_dirty();
+	m_tupleCount = pin->tuple_count();
+}
+
+SortedPage::TupleSetCIter BufferedSortedPage::wrap(const TupleSetCIter& it) const
+{
+	return TupleSetCIter(this, it.index());
+}
+
+}
@@ -0,0 +1,492 @@
+/**
+ * whery: ColumnarSortedPage.cpp
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#include "whery/db/pages/ColumnarSortedPage.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
+
+#include "whery/db/base/DoubleFieldManipulator.h"
+#include "whery/db/base/IntFieldManipulator.h"
+#include "whery/db/base/RangeKey.h"
+#include "whery/util/AlignmentTracker.h"
+#include "whery/util/SimdSearch.h"
+
+namespace whery {
+
+//#################### LOCAL FUNCTIONS ####################
+
+namespace {
+
+double get_value(const FieldManipulator& fieldManipulator, const char *location, double*)	{ return fieldManipulator.get_double(location); }
+int get_value(const FieldManipulator& fieldManipulator, const char *location, int*)			{ return fieldManipulator.get_int(location); }
+
+/**
+Finds the positions of the values in a minipage that lie in the range [low,high].
+
+\param column				The minipage.
+\param count				The number of values in the minipage.
+\param fieldManipulator		The manipulator for the minipage's field.
+\param nativeManipulator	The manipulator for fields whose values can be read directly as a T.
+\param low					The lower bound of the range.
+\param high					The upper bound of the range.
+\param positions			Used to return the positions of the matching values (in ascending order).
+*/
+template <typename T>
+void filter_values(const char *column, unsigned int count, const FieldManipulator& fieldManipulator, const FieldManipulator& nativeManipulator,
+				   T low, T high, std::vector<unsigned int>& positions)
+{
+	positions.clear();
+	if(&fieldManipulator == &nativeManipulator)
+	{
+		const T *values = reinterpret_cast<const T*>(column);
+		for(unsigned int i = 0; i < count; ++i)
+		{
+			if(low <= values[i] && values[i] <= high) positions.push_back(i);
+		}
+	}
+	else
+	{
+		const unsigned int fieldSize = fieldManipulator.size();
+		for(unsigned int i = 0; i < count; ++i)
+		{
+			const T value = get_value(fieldManipulator, column + i * fieldSize, static_cast<T*>(NULL));
+			if(low <= value && value <= high) positions.push_back(i);
+		}
+	}
+}
+
+/**
+Decodes the values at a range of positions in a minipage.
+
+\param column				The minipage.
+\param fieldManipulator		The manipulator for the minipage's field.
+\param nativeManipulator	The manipulator for fields whose values can be read directly as a T.
+\param begin				The first position.
+\param end					The position one beyond the last position.
+\param values				An array with room for end - begin values, into which to write them.
+*/
+template <typename T>
+void read_values(const char *column, const FieldManipulator& fieldManipulator, const FieldManipulator& nativeManipulator,
+				 unsigned int begin, unsigned int end, T *values)
+{
+	// If the field is known to be a T, the values can simply be copied out of the minipage en masse.
+	if(&fieldManipulator == &nativeManipulator)
+	{
+		memcpy(values, column + begin * sizeof(T), (end - begin) * sizeof(T));
+	}
+	else
+	{
+		const unsigned int fieldSize = fieldManipulator.size();
+		for(unsigned int i = begin; i < end; ++i) *values++ = get_value(fieldManipulator, column + i * fieldSize, static_cast<T*>(NULL));
+	}
+}
+
+}
+
+//#################### CONSTRUCTORS ####################
+
+ColumnarSortedPage::ColumnarSortedPage(unsigned int bufferSize, const TupleManipulator& tupleManipulator)
+:	m_buffer(bufferSize), m_maxTupleCount(0), m_tupleManipulator(tupleManipulator)
+{
+	if(bufferSize < sizeof(unsigned int))
+	{
+		throw std::invalid_argument("The buffer for a page must be large enough to hold its tuple count.");
+	}
+
+	if(tupleManipulator.uses_suffix_truncation())
+	{
+		throw std::invalid_argument("A columnar page cannot store tuples with trailing key fields omitted.");
+	}
+
+	// Find the largest number of tuples whose minipages (and tuple count) fit in the buffer. Since the minipages
+	// need at least the sum of the field sizes for each tuple, start there and work down to allow for padding.
+	unsigned int valuesSize = 0;
+	const std::vector<const FieldManipulator*>& fieldManipulators = m_tupleManipulator.field_manipulators();
+	for(size_t j = 0, arity = fieldManipulators.size(); j < arity; ++j)
+	{
+		valuesSize += fieldManipulators[j]->size();
+	}
+
+	m_maxTupleCount = (bufferSize - sizeof(unsigned int)) / valuesSize;
+	while(m_maxTupleCount > 0 && lay_out(m_maxTupleCount, m_tupleManipulator, NULL) > bufferSize) --m_maxTupleCount;
+	lay_out(m_maxTupleCount, m_tupleManipulator, &m_columnOffsets);
+
+	m_rowCache.resize(m_maxTupleCount * m_tupleManipulator.size());
+	m_rowCached.resize(m_maxTupleCount, 0);
+	*tuple_count_location() = 0;
+}
+
+//#################### PUBLIC STATIC METHODS ####################
+
+unsigned int ColumnarSortedPage::buffer_size_for(unsigned int maxTupleCount, const TupleManipulator& tupleManipulator)
+{
+	return lay_out(maxTupleCount, tupleManipulator, NULL);
+}
+
+//#################### PUBLIC INHERITED METHODS ####################
+
+void ColumnarSortedPage::add_tuple(const Tuple& tuple)
+{
+	if(tuple_count() >= max_tuple_count())
+	{
+		throw std::out_of_range("It is not possible to add an additional tuple to a full page.");
+	}
+
+	if(tuple.arity() != m_tupleManipulator.arity())
+	{
+		throw std::invalid_argument("It is not possible to add a tuple whose arity differs from that of the page.");
+	}
+
+	// Insert the tuple after any equivalent tuples already on the page, shifting the later values in each minipage up to make room.
+	unsigned int& count = *tuple_count_location();
+	const unsigned int pos = upper_bound_index(tuple);
+	const std::vector<const FieldManipulator*>& fieldManipulators = m_tupleManipulator.field_manipulators();
+	for(unsigned int j = 0, arity = tuple.arity(); j < arity; ++j)
+	{
+		const unsigned int fieldSize = fieldManipulators[j]->size();
+		char *location = column_location(j, pos);
+		memmove(location + fieldSize, location, (count - pos) * fieldSize);
+		Field(location, *fieldManipulators[j]).set_from(tuple.field(j));
+	}
+
+	++count;
+	invalidate_rows(pos, count);
+}
+
+SortedPage::TupleSetCIter ColumnarSortedPage::begin() const
+{
+	return TupleSetCIter(this, 0);
+}
+
+unsigned int ColumnarSortedPage::buffer_size() const
+{
+	return static_cast<unsigned int>(m_buffer.size());
+}
+
+void ColumnarSortedPage::clear()
+{
+	invalidate_rows(0, tuple_count());
+	*tuple_count_location() = 0;
+}
+
+unsigned int ColumnarSortedPage::empty_tuple_count() const
+{
+	return max_tuple_count() - tuple_count();
+}
+
+SortedPage::TupleSetCIter ColumnarSortedPage::end() const
+{
+	return TupleSetCIter(this, tuple_count());
+}
+
+SortedPage::EqualRangeResult ColumnarSortedPage::equal_range(const RangeKey& key) const
+{
+	if(key.is_valid())
+	{
+		return std::make_pair(lower_bound(key), upper_bound(key));
+	}
+	else
+	{
+		TupleSetCIter it = lower_bound(key);
+		return std::make_pair(it, it);
+	}
+}
+
+SortedPage::EqualRangeResult ColumnarSortedPage::equal_range(const ValueKey& key) const
+{
+	return std::make_pair(lower_bound(key), upper_bound(key));
+}
+
+void ColumnarSortedPage::erase_tuple(const BackedTuple& key)
+{
+	unsigned int i = lower_bound_index(key);
+	if(i != tuple_count() && compare_tuple(i, key) == 0)
+	{
+		erase_tuples_at(i, i + 1);
+	}
+}
+
+void ColumnarSortedPage::erase_tuple(const TupleSetCIter& it)
+{
+	if(it != end())
+	{
+		erase_tuples_at(it.index(), it.index() + 1);
+	}
+}
+
+void ColumnarSortedPage::erase_tuple(const TupleSetCRIter& rit)
+{
+	if(rit != rend())
+	{
+		erase_tuples_at(rit.base().index() - 1, rit.base().index());
+	}
+}
+
+void ColumnarSortedPage::erase_tuples(const TupleSetCIter& begin, const TupleSetCIter& end)
+{
+	erase_tuples_at(begin.index(), end.index());
+}
+
+const std::vector<const FieldManipulator*>& ColumnarSortedPage::field_manipulators() const
+{
+	return m_tupleManipulator.field_manipulators();
+}
+
+SortedPage::TupleSetCIter ColumnarSortedPage::find(const ValueKey& key) const
+{
+	unsigned int i = lower_bound_index(key);
+	if(i != tuple_count() && compare_tuple(i, key) == 0) return TupleSetCIter(this, i);
+	else return end();
+}
+
+SortedPage::TupleSetCIter ColumnarSortedPage::lower_bound(const RangeKey& key) const
+{
+	if(key.has_low_endpoint())
+	{
+		// For an open endpoint, the range starts after all the tuples that are equivalent to the endpoint value.
+		const ValueKey& value = key.low_value();
+		return TupleSetCIter(this, key.low_kind() == OPEN ? upper_bound_index(value) : lower_bound_index(value));
+	}
+	else return begin();
+}
+
+SortedPage::TupleSetCIter ColumnarSortedPage::lower_bound(const ValueKey& key) const
+{
+	return TupleSetCIter(this, lower_bound_index(key));
+}
+
+unsigned int ColumnarSortedPage::max_tuple_count() const
+{
+	return m_maxTupleCount;
+}
+
+double ColumnarSortedPage::percentage_full() const
+{
+	return tuple_count() * 100.0 / max_tuple_count();
+}
+
+SortedPage::TupleSetCRIter ColumnarSortedPage::rbegin() const
+{
+	return TupleSetCRIter(end());
+}
+
+void ColumnarSortedPage::read_doubles(unsigned int fieldIndex, unsigned int begin, unsigned int end, double *values) const
+{
+	read_values(column(fieldIndex), *field_manipulators()[fieldIndex], DoubleFieldManipulator::instance(), begin, end, values);
+}
+
+void ColumnarSortedPage::read_ints(unsigned int fieldIndex, unsigned int begin, unsigned int end, int *values) const
+{
+	read_values(column(fieldIndex), *field_manipulators()[fieldIndex], IntFieldManipulator::instance(), begin, end, values);
+}
+
+SortedPage::TupleSetCRIter ColumnarSortedPage::rend() const
+{
+	return TupleSetCRIter(begin());
+}
+
+bool ColumnarSortedPage::supports_concurrent_reads() const
+{
+	// Reading a tuple can write to the row cache.
+	return false;
+}
+
+unsigned int ColumnarSortedPage::tuple_count() const
+{
+	return *tuple_count_location();
+}
+
+char *ColumnarSortedPage::tuple_location(unsigned int i) const
+{
+	assert(i < tuple_count());
+	char *row = &m_rowCache[i * m_tupleManipulator.size()];
+
+	// If the tuple has not been reconstructed since the page was last modified, gather its fields from the minipages.
+	if(!m_rowCached[i])
+	{
+		const std::vector<const FieldManipulator*>& fieldManipulators = m_tupleManipulator.field_manipulators();
+		for(unsigned int j = 0, arity = m_tupleManipulator.arity(); j < arity; ++j)
+		{
+			memcpy(row + m_tupleManipulator.field_offset(j), column_location(j, i), fieldManipulators[j]->size());
+		}
+		m_rowCached[i] = 1;
+	}
+
+	return row;
+}
+
+const TupleManipulator& ColumnarSortedPage::tuple_manipulator() const
+{
+	return m_tupleManipulator;
+}
+
+SortedPage::TupleSetCIter ColumnarSortedPage::upper_bound(const RangeKey& key) const
+{
+	if(key.has_high_endpoint())
+	{
+		// For an open endpoint, the range ends before all the tuples that are equivalent to the endpoint value.
+		const ValueKey& value = key.high_value();
+		return TupleSetCIter(this, key.high_kind() == OPEN ? lower_bound_index(value) : upper_bound_index(value));
+	}
+	else return end();
+}
+
+SortedPage::TupleSetCIter ColumnarSortedPage::upper_bound(const ValueKey& key) const
+{
+	return TupleSetCIter(this, upper_bound_index(key));
+}
+
+//#################### PUBLIC METHODS ####################
+
+const char *ColumnarSortedPage::column(unsigned int fieldIndex) const
+{
+	return &m_buffer[m_columnOffsets[fieldIndex]];
+}
+
+void ColumnarSortedPage::filter_doubles(unsigned int fieldIndex, double low, double high, std::vector<unsigned int>& positions) const
+{
+	filter_values(column(fieldIndex), tuple_count(), *field_manipulators()[fieldIndex], DoubleFieldManipulator::instance(), low, high, positions);
+}
+
+void ColumnarSortedPage::filter_ints(unsigned int fieldIndex, int low, int high, std::vector<unsigned int>& positions) const
+{
+	filter_values(column(fieldIndex), tuple_count(), *field_manipulators()[fieldIndex], IntFieldManipulator::instance(), low, high, positions);
+}
+
+//#################### PRIVATE METHODS ####################
+
+char *ColumnarSortedPage::column_location(unsigned int fieldIndex, unsigned int i) const
+{
+	return const_cast<char*>(column(fieldIndex)) + i * m_tupleManipulator.field_manipulators()[fieldIndex]->size();
+}
+
+int ColumnarSortedPage::compare_tuple(unsigned int i, const Tuple& key) const
+{
+	// Note that this performs the same comparison as PrefixTupleComparator, but reads the tuple's
+	// fields straight from the minipages rather than reconstructing the tuple first.
+	const std::vector<const FieldManipulator*>& fieldManipulators = m_tupleManipulator.field_manipulators();
+	for(unsigned int j = 0, size = std::min(m_tupleManipulator.arity(), key.arity()); j < size; ++j)
+	{
+		const int result = Field(column_location(j, i), *fieldManipulators[j], true).compare_to(key.field(j));
+		if(result != 0) return result;
+	}
+
+	// If the tuple and key are equivalent up to this point, they compare equal.
+	return 0;
+}
+
+void ColumnarSortedPage::erase_tuples_at(unsigned int begin, unsigned int end)
+{
+	unsigned int& count = *tuple_count_location();
+	assert(begin <= end && end <= count);
+
+	// Shift the later values in each minipage down over the erased tuples' values.
+	const std::vector<const FieldManipulator*>& fieldManipulators = m_tupleManipulator.field_manipulators();
+	for(unsigned int j = 0, arity = m_tupleManipulator.arity(); j < arity; ++j)
+	{
+		const unsigned int fieldSize = fieldManipulators[j]->size();
+		memmove(column_location(j, begin), column_location(j, end), (count - end) * fieldSize);
+	}
+
+	invalidate_rows(begin, count);
+	count -= end - begin;
+}
+
+void ColumnarSortedPage::invalidate_rows(unsigned int begin, unsigned int end)
+{
+	std::fill(m_rowCached.begin() + begin, m_rowCached.begin() + end, 0);
+}
+
+bool ColumnarSortedPage::leading_field_range(const Tuple& key, unsigned int& low, unsigned int& high) const
+{
+	if(key.arity() == 0) return false;
+
+	// Convert the key's leading field to the type of the tuples' leading field (exactly as FieldManipulator::compare_to()
+	// would), so that it can be compared with the values in the minipage directly.
+	const FieldManipulator& fieldManipulator = *m_tupleManipulator.field_manipulators()[0];
+	const unsigned int count = tuple_count();
+	if(&fieldManipulator == &IntFieldManipulator::instance())
+	{
+		int value;
+		Field(reinterpret_cast<char*>(&value), fieldManipulator).set_from(key.field(0));
+		const int *values = reinterpret_cast<const int*>(column(0));
+		low = simd_lower_bound(values, count, value);
+		high = low + simd_upper_bound(values + low, count - low, value);
+		return true;
+	}
+	else if(&fieldManipulator == &DoubleFieldManipulator::instance())
+	{
+		double value;
+		Field(reinterpret_cast<char*>(&value), fieldManipulator).set_from(key.field(0));
+		const double *values = reinterpret_cast<const double*>(column(0));
+		low = simd_lower_bound(values, count, value);
+		high = low + simd_upper_bound(values + low, count - low, value);
+		return true;
+	}
+	else return false;
+}
+
+unsigned int ColumnarSortedPage::lower_bound_index(const Tuple& key) const
+{
+	// If the key only has a leading field, its lower bound is simply that of its leading field.
+	unsigned int low = 0, high = tuple_count();
+	if(leading_field_range(key, low, high) && std::min(key.arity(), m_tupleManipulator.arity()) == 1) return low;
+
+	while(low < high)
+	{
+		unsigned int mid = low + (high - low) / 2;
+		if(compare_tuple(mid, key) == -1) low = mid + 1;
+		else high = mid;
+	}
+	return low;
+}
+
+unsigned int *ColumnarSortedPage::tuple_count_location() const
+{
+	return reinterpret_cast<unsigned int*>(const_cast<char*>(&m_buffer[0]) + m_columnOffsets.back());
+}
+
+unsigned int ColumnarSortedPage::upper_bound_index(const Tuple& key) const
+{
+	// If the key only has a leading field, its upper bound is simply that of its leading field.
+	unsigned int low = 0, high = tuple_count();
+	if(leading_field_range(key, low, high) && std::min(key.arity(), m_tupleManipulator.arity()) == 1) return high;
+
+	while(low < high)
+	{
+		unsigned int mid = low + (high - low) / 2;
+		if(compare_tuple(mid, key) == 1) high = mid;
+		else low = mid + 1;
+	}
+	return low;
+}
+
+//#################### PRIVATE STATIC METHODS ####################
+
+unsigned int ColumnarSortedPage::lay_out(unsigned int maxTupleCount, const TupleManipulator& tupleManipulator, std::vector<unsigned int> *columnOffsets)
+{
+	AlignmentTracker alignmentTracker;
+	if(columnOffsets) columnOffsets->clear();
+
+	// Lay out a suitably-aligned minipage for each field in turn, followed by the tuple count.
+	const std::vector<const FieldManipulator*>& fieldManipulators = tupleManipulator.field_manipulators();
+	for(size_t j = 0, arity = fieldManipulators.size(); j < arity; ++j)
+	{
+		alignmentTracker.advance_to_boundary(fieldManipulators[j]->alignment_requirement());
+		if(columnOffsets) columnOffsets->push_back(alignmentTracker.offset());
+		alignmentTracker.advance(maxTupleCount * fieldManipulators[j]->size());
+	}
+
+	alignmentTracker.advance_to_boundary(sizeof(unsigned int));
+	if(columnOffsets) columnOffsets->push_back(alignmentTracker.offset());
+	alignmentTracker.advance(sizeof(unsigned int));
+
+	return alignmentTracker.offset();
+}
+
+}
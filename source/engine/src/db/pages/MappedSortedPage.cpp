@@ -0,0 +1,36 @@
+/**
+ * whery: MappedSortedPage.cpp
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#include "whery/db/pages/MappedSortedPage.h"
+
+#include <stdexcept>
+
+#include <boost/interprocess/mapped_region.hpp>
+
+namespace whery {
+
+//#################### CONSTRUCTORS ####################
+
+MappedSortedPage::MappedSortedPage(const boost::shared_ptr<boost::interprocess::mapped_region>& region, unsigned int bufferOffset, unsigned int bufferSize,
+								   const TupleManipulator& tupleManipulator, bool fresh)
+:	SlottedSortedPage(tupleManipulator), m_bufferOffset(bufferOffset), m_region(region)
+{
+	if(bufferOffset > m_region->get_size() || bufferSize > m_region->get_size() - bufferOffset)
+	{
+		throw std::invalid_argument("The buffer for a page must lie within its mapped region.");
+	}
+
+	char *buffer = static_cast<char*>(m_region->get_address()) + bufferOffset;
+	initialise(buffer, bufferSize, fresh);
+}
+
+//#################### PUBLIC METHODS ####################
+
+void MappedSortedPage::flush() const
+{
+	m_region->flush(m_bufferOffset, buffer_size());
+}
+
+}
@@ -0,0 +1,708 @@
+/**
+ * whery: PackedSortedPage.cpp
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#include "whery/db/pages/PackedSortedPage.h"
+
+#include <algorithm>
+#include <cassert>
+#include <climits>
+#include <cstring>
+#include <stdexcept>
+
+#include <boost/cstdint.hpp>
+
+#include "whery/db/base/DoubleFieldManipulator.h"
+#include "whery/db/base/IntFieldManipulator.h"
+#include "whery/db/base/RangeKey.h"
+#include "whery/util/BitPacking.h"
+
+namespace whery {
+
+//#################### LOCAL CONSTANTS ####################
+
+namespace {
+
+/** The bit width at which a packed column can hold any int. */
+const unsigned int FULL_BIT_WIDTH = 32;
+
+/** The number of values unpacked at a time when reading or re-encoding a packed column in chunks. */
+const unsigned int READ_CHUNK_SIZE = 64;
+
+//#################### LOCAL FUNCTIONS ####################
+
+/**
+Gets the largest offset that can be stored in the specified number of bits.
+
+\param bitWidth	The number of bits.
+\return			The largest offset that can be stored.
+*/
+unsigned int max_offset(unsigned int bitWidth)
+{
+	return bitWidth >= 32 ? ~0u : (1u << bitWidth) - 1;
+}
+
+/**
+Widens the range of int values seen so far to include those in the specified array.
+
+\param values	The values.
+\param count	The number of values.
+\param seen	Whether or not any values have been seen so far (updated to true if count > 0).
+\param low		The smallest value seen so far (updated).
+\param high	The largest value seen so far (updated).
+*/
+void widen_range(const int *values, unsigned int count, bool& seen, int& low, int& high)
+{
+	for(unsigned int i = 0; i < count; ++i)
+	{
+		if(!seen || values[i] < low) low = values[i];
+		if(!seen || values[i] > high) high = values[i];
+		seen = true;
+	}
+}
+
+/**
+Widens the range of int values seen so far to include those in a column of the specified page.
+
+\param page		The page.
+\param fieldIndex	The index of the column's field.
+\param seen		Whether or not any values have been seen so far (updated to true if the page is non-empty).
+\param low			The smallest value seen so far (updated).
+\param high		The largest value seen so far (updated).
+*/
+void widen_range(const SortedPage& page, unsigned int fieldIndex, bool& seen, int& low, int& high)
+{
+	const unsigned int tupleCount = page.tuple_count();
+	int values[READ_CHUNK_SIZE];
+	if(fieldIndex == 0 && tupleCount > 0)
+	{
+		// The leading field is sorted, so its extremes are at either end of the page.
+		page.read_ints(0, 0, 1, values);
+		page.read_ints(0, tupleCount - 1, tupleCount, values + 1);
+		widen_range(values, 2, seen, low, high);
+		return;
+	}
+
+	for(unsigned int chunkBegin = 0; chunkBegin < tupleCount; chunkBegin += READ_CHUNK_SIZE)
+	{
+		const unsigned int chunkSize = std::min(tupleCount - chunkBegin, READ_CHUNK_SIZE);
+		page.read_ints(fieldIndex, chunkBegin, chunkBegin + chunkSize, values);
+		widen_range(values, chunkSize, seen, low, high);
+	}
+}
+
+}
+
+//#################### CONSTRUCTORS ####################
+
+PackedSortedPage::PackedSortedPage(unsigned int bufferSize, const TupleManipulator& tupleManipulator)
+:	m_buffer(bufferSize), m_maxTupleCount(0), m_tupleCount(0), m_tupleManipulator(tupleManipulator)
+{
+	if(tupleManipulator.uses_suffix_truncation())
+	{
+		throw std::invalid_argument("A packed page cannot store tuples with trailing key fields omitted.");
+	}
+
+	// A page that could not hold two tuples could not be split, so the B+-tree could not make room for a tuple by splitting it.
+	if(max_tuple_count_for(bufferSize, tupleManipulator) < 2)
+	{
+		throw std::invalid_argument("The buffer for a packed page must be large enough to hold at least two tuples whatever their values.");
+	}
+
+	// The page starts out empty, so each packed column can start out with a bit width of 0.
+	m_maxTupleCount = plan_encoding(NULL, NULL, m_columns);
+}
+
+//#################### PUBLIC STATIC METHODS ####################
+
+unsigned int PackedSortedPage::buffer_size_for(unsigned int maxTupleCount, const TupleManipulator& tupleManipulator)
+{
+	std::vector<Column> columns = make_full_width_columns(tupleManipulator);
+	return lay_out(maxTupleCount, tupleManipulator, columns);
+}
+
+unsigned int PackedSortedPage::max_tuple_count_for(unsigned int bufferSize, const TupleManipulator& tupleManipulator)
+{
+	std::vector<Column> columns = make_full_width_columns(tupleManipulator);
+	return capacity_for(bufferSize, tupleManipulator, columns);
+}
+
+//#################### PUBLIC INHERITED METHODS ####################
+
+void PackedSortedPage::add_tuple(const Tuple& tuple)
+{
+	if(tuple.arity() != m_tupleManipulator.arity())
+	{
+		throw std::invalid_argument("It is not possible to add a tuple whose arity differs from that of the page.");
+	}
+
+	// If the page is full at its current encoding, or the tuple's values do not fit it, re-encode the columns so that they
+	// can hold the tuple's values as compactly as possible (which may also make room for more tuples).
+	if(m_tupleCount >= m_maxTupleCount || !fits_encoding(tuple))
+	{
+		std::vector<Column> columns;
+		const unsigned int maxTupleCount = plan_encoding(&tuple, NULL, columns);
+		if(maxTupleCount <= m_tupleCount)
+		{
+			throw std::out_of_range("It is not possible to add an additional tuple to a full page.");
+		}
+		re_encode(columns, maxTupleCount);
+	}
+
+	// Insert the tuple after any equivalent tuples already on the page, by shifting the later values in each column up and
+	// writing the tuple's values in place.
+	const unsigned int pos = upper_bound_index(tuple);
+	const std::vector<const FieldManipulator*>& fieldManipulators = m_tupleManipulator.field_manipulators();
+	for(unsigned int j = 0, arity = tuple.arity(); j < arity; ++j)
+	{
+		const Column& column = m_columns[j];
+		if(column.packed)
+		{
+			char *data = column_data(column);
+			move_packed_ints(data, pos, m_tupleCount, pos + 1, column.bitWidth);
+			pack_int(data, pos, column.base, column.bitWidth, tuple.field(j).get_int());
+		}
+		else
+		{
+			const unsigned int fieldSize = fieldManipulators[j]->size();
+			char *location = raw_location(j, pos);
+			memmove(location + fieldSize, location, (m_tupleCount - pos) * fieldSize);
+			Field(location, *fieldManipulators[j]).set_from(tuple.field(j));
+		}
+	}
+
+	++m_tupleCount;
+	invalidate_rows(pos, m_tupleCount);
+}
+
+SortedPage::TupleSetCIter PackedSortedPage::begin() const
+{
+	return TupleSetCIter(this, 0);
+}
+
+unsigned int PackedSortedPage::buffer_size() const
+{
+	return static_cast<unsigned int>(m_buffer.size());
+}
+
+void PackedSortedPage::clear()
+{
+	invalidate_rows(0, m_tupleCount);
+	m_tupleCount = 0;
+
+	// Shrink the packed columns back down to nothing (there are no values to move, so the columns can simply be laid out afresh).
+	for(size_t j = 0, arity = m_columns.size(); j < arity; ++j)
+	{
+		m_columns[j].base = 0;
+		m_columns[j].bitWidth = 0;
+	}
+	m_maxTupleCount = capacity_for(buffer_size(), m_tupleManipulator, m_columns);
+}
+
+unsigned int PackedSortedPage::empty_tuple_count() const
+{
+	return max_tuple_count() - tuple_count();
+}
+
+SortedPage::TupleSetCIter PackedSortedPage::end() const
+{
+	return TupleSetCIter(this, tuple_count());
+}
+
+SortedPage::EqualRangeResult PackedSortedPage::equal_range(const RangeKey& key) const
+{
+	if(key.is_valid())
+	{
+		return std::make_pair(lower_bound(key), upper_bound(key));
+	}
+	else
+	{
+		TupleSetCIter it = lower_bound(key);
+		return std::make_pair(it, it);
+	}
+}
+
+SortedPage::EqualRangeResult PackedSortedPage::equal_range(const ValueKey& key) const
+{
+	return std::make_pair(lower_bound(key), upper_bound(key));
+}
+
+void PackedSortedPage::erase_tuple(const BackedTuple& key)
+{
+	unsigned int i = lower_bound_index(key);
+	if(i != tuple_count() && compare_tuple(i, key) == 0)
+	{
+		erase_tuples_at(i, i + 1);
+	}
+}
+
+void PackedSortedPage::erase_tuple(const TupleSetCIter& it)
+{
+	if(it != end())
+	{
+		erase_tuples_at(it.index(), it.index() + 1);
+	}
+}
+
+void PackedSortedPage::erase_tuple(const TupleSetCRIter& rit)
+{
+	if(rit != rend())
+	{
+		erase_tuples_at(rit.base().index() - 1, rit.base().index());
+	}
+}
+
+void PackedSortedPage::erase_tuples(const TupleSetCIter& begin, const TupleSetCIter& end)
+{
+	erase_tuples_at(begin.index(), end.index());
+}
+
+const std::vector<const FieldManipulator*>& PackedSortedPage::field_manipulators() const
+{
+	return m_tupleManipulator.field_manipulators();
+}
+
+SortedPage::TupleSetCIter PackedSortedPage::find(const ValueKey& key) const
+{
+	unsigned int i = lower_bound_index(key);
+	if(i != tuple_count() && compare_tuple(i, key) == 0) return TupleSetCIter(this, i);
+	else return end();
+}
+
+bool PackedSortedPage::has_room_for(const Tuple& tuple, unsigned int erasedCount) const
+{
+	assert(erasedCount <= m_tupleCount);
+	const unsigned int tupleCount = m_tupleCount - erasedCount;
+	if(tupleCount < m_maxTupleCount && fits_encoding(tuple)) return true;
+
+	// Note that the values of the tuples to be erased are conservatively assumed to stay on the page.
+	std::vector<Column> columns;
+	return tupleCount < plan_encoding(&tuple, NULL, columns);
+}
+
+bool PackedSortedPage::has_room_for_tuples_from(const SortedPage& source, unsigned int count) const
+{
+	if(count == 0) return true;
+
+	// Work out how many tuples the page could hold if its columns were re-encoded to hold every value on the source page
+	// (which is conservative if only some of the source's tuples will be moved, but avoids depending on which ones they are).
+	std::vector<Column> columns;
+	return m_tupleCount + count <= plan_encoding(NULL, &source, columns);
+}
+
+SortedPage::TupleSetCIter PackedSortedPage::lower_bound(const RangeKey& key) const
+{
+	if(key.has_low_endpoint())
+	{
+		// For an open endpoint, the range starts after all the tuples that are equivalent to the endpoint value.
+		const ValueKey& value = key.low_value();
+		return TupleSetCIter(this, key.low_kind() == OPEN ? upper_bound_index(value) : lower_bound_index(value));
+	}
+	else return begin();
+}
+
+SortedPage::TupleSetCIter PackedSortedPage::lower_bound(const ValueKey& key) const
+{
+	return TupleSetCIter(this, lower_bound_index(key));
+}
+
+unsigned int PackedSortedPage::max_tuple_count() const
+{
+	return m_maxTupleCount;
+}
+
+double PackedSortedPage::percentage_full() const
+{
+	return m_maxTupleCount > 0 ? tuple_count() * 100.0 / max_tuple_count() : 100.0;
+}
+
+SortedPage::TupleSetCRIter PackedSortedPage::rbegin() const
+{
+	return TupleSetCRIter(end());
+}
+
+void PackedSortedPage::read_doubles(unsigned int fieldIndex, unsigned int begin, unsigned int end, double *values) const
+{
+	const Column& column = m_columns[fieldIndex];
+	const FieldManipulator& fieldManipulator = *field_manipulators()[fieldIndex];
+	if(column.packed)
+	{
+		// Unpack the values a chunk at a time, and then convert them to doubles.
+		int ints[READ_CHUNK_SIZE];
+		for(unsigned int chunkBegin = begin; chunkBegin < end; chunkBegin += READ_CHUNK_SIZE)
+		{
+			const unsigned int chunkSize = std::min(end - chunkBegin, READ_CHUNK_SIZE);
+			unpack_ints(column_data(column), chunkBegin, chunkBegin + chunkSize, column.base, column.bitWidth, ints);
+			for(unsigned int i = 0; i < chunkSize; ++i) *values++ = ints[i];
+		}
+	}
+	else if(&fieldManipulator == &DoubleFieldManipulator::instance())
+	{
+		memcpy(values, raw_location(fieldIndex, begin), (end - begin) * sizeof(double));
+	}
+	else
+	{
+		for(unsigned int i = begin; i < end; ++i) *values++ = fieldManipulator.get_double(raw_location(fieldIndex, i));
+	}
+}
+
+void PackedSortedPage::read_ints(unsigned int fieldIndex, unsigned int begin, unsigned int end, int *values) const
+{
+	const Column& column = m_columns[fieldIndex];
+	if(column.packed)
+	{
+		unpack_ints(column_data(column), begin, end, column.base, column.bitWidth, values);
+	}
+	else
+	{
+		const FieldManipulator& fieldManipulator = *field_manipulators()[fieldIndex];
+		for(unsigned int i = begin; i < end; ++i) *values++ = fieldManipulator.get_int(raw_location(fieldIndex, i));
+	}
+}
+
+SortedPage::TupleSetCRIter PackedSortedPage::rend() const
+{
+	return TupleSetCRIter(begin());
+}
+
+bool PackedSortedPage::supports_concurrent_reads() const
+{
+	// Reading a tuple can write to the row cache.
+	return false;
+}
+
+unsigned int PackedSortedPage::tuple_count() const
+{
+	return m_tupleCount;
+}
+
+char *PackedSortedPage::tuple_location(unsigned int i) const
+{
+	assert(i < tuple_count());
+
+	// The row cache is allocated the first time a tuple is read, and grows whenever re-encoding has let the page hold more tuples.
+	if(m_rowCached.size() < m_maxTupleCount)
+	{
+		m_rowCache.resize(m_maxTupleCount * m_tupleManipulator.size());
+		m_rowCached.resize(m_maxTupleCount, 0);
+	}
+	char *row = &m_rowCache[i * m_tupleManipulator.size()];
+
+	// If the tuple has not been reconstructed since the page was last modified, gather (and unpack) its fields from the columns.
+	if(!m_rowCached[i])
+	{
+		const std::vector<const FieldManipulator*>& fieldManipulators = m_tupleManipulator.field_manipulators();
+		for(unsigned int j = 0, arity = m_tupleManipulator.arity(); j < arity; ++j)
+		{
+			const Column& column = m_columns[j];
+			char *location = row + m_tupleManipulator.field_offset(j);
+			if(column.packed) fieldManipulators[j]->set_int(location, unpack_int(column_data(column), i, column.base, column.bitWidth));
+			else memcpy(location, raw_location(j, i), fieldManipulators[j]->size());
+		}
+		m_rowCached[i] = 1;
+	}
+
+	return row;
+}
+
+const TupleManipulator& PackedSortedPage::tuple_manipulator() const
+{
+	return m_tupleManipulator;
+}
+
+SortedPage::TupleSetCIter PackedSortedPage::upper_bound(const RangeKey& key) const
+{
+	if(key.has_high_endpoint())
+	{
+		// For an open endpoint, the range ends before all the tuples that are equivalent to the endpoint value.
+		const ValueKey& value = key.high_value();
+		return TupleSetCIter(this, key.high_kind() == OPEN ? lower_bound_index(value) : upper_bound_index(value));
+	}
+	else return end();
+}
+
+SortedPage::TupleSetCIter PackedSortedPage::upper_bound(const ValueKey& key) const
+{
+	return TupleSetCIter(this, upper_bound_index(key));
+}
+
+//#################### PUBLIC METHODS ####################
+
+unsigned int PackedSortedPage::bit_width(unsigned int fieldIndex) const
+{
+	const Column& column = m_columns[fieldIndex];
+	return column.packed ? column.bitWidth : field_manipulators()[fieldIndex]->size() * 8;
+}
+
+//#################### PRIVATE STATIC METHODS ####################
+
+unsigned int PackedSortedPage::capacity_for(unsigned int bufferSize, const TupleManipulator& tupleManipulator, std::vector<Column>& columns)
+{
+	// Find the largest number of tuples for which the columns fit in the buffer (capping it at one tuple per byte, so that a page
+	// whose tuples take no space at all, e.g. because all their fields are equal ints, still has a finite capacity).
+	unsigned int low = 0, high = bufferSize;
+	while(low < high)
+	{
+		unsigned int mid = low + (high - low + 1) / 2;
+		if(lay_out(mid, tupleManipulator, columns) <= bufferSize) low = mid;
+		else high = mid - 1;
+	}
+
+	lay_out(low, tupleManipulator, columns);
+	return low;
+}
+
+unsigned int PackedSortedPage::lay_out(unsigned int maxTupleCount, const TupleManipulator& tupleManipulator, std::vector<Column>& columns)
+{
+	// Lay the columns out one after the other, starting each of them on an 8-byte boundary.
+	const std::vector<const FieldManipulator*>& fieldManipulators = tupleManipulator.field_manipulators();
+	boost::uint64_t offset = 0;
+	for(size_t j = 0, arity = columns.size(); j < arity; ++j)
+	{
+		Column& column = columns[j];
+		column.offset = static_cast<unsigned int>(std::min(offset, static_cast<boost::uint64_t>(UINT_MAX)));
+		const boost::uint64_t size = column.packed ? packed_size(maxTupleCount, column.bitWidth) : static_cast<boost::uint64_t>(maxTupleCount) * fieldManipulators[j]->size();
+		offset += (size + 7) / 8 * 8;
+	}
+	return static_cast<unsigned int>(std::min(offset, static_cast<boost::uint64_t>(UINT_MAX)));
+}
+
+std::vector<PackedSortedPage::Column> PackedSortedPage::make_full_width_columns(const TupleManipulator& tupleManipulator)
+{
+	const std::vector<const FieldManipulator*>& fieldManipulators = tupleManipulator.field_manipulators();
+	std::vector<Column> columns(fieldManipulators.size());
+	for(size_t j = 0, arity = fieldManipulators.size(); j < arity; ++j)
+	{
+		Column& column = columns[j];
+		column.base = 0;
+		column.packed = fieldManipulators[j] == &IntFieldManipulator::instance();
+		column.bitWidth = column.packed ? FULL_BIT_WIDTH : 0;
+		column.offset = 0;
+	}
+	return columns;
+}
+
+//#################### PRIVATE METHODS ####################
+
+char *PackedSortedPage::column_data(const Column& column) const
+{
+	return const_cast<char*>(&m_buffer[0]) + column.offset;
+}
+
+int PackedSortedPage::compare_tuple(unsigned int i, const Tuple& key) const
+{
+	// Note that this performs the same comparison as PrefixTupleComparator, but reads the tuple's
+	// fields straight from the columns rather than reconstructing the tuple first.
+	const std::vector<const FieldManipulator*>& fieldManipulators = m_tupleManipulator.field_manipulators();
+	for(unsigned int j = 0, size = std::min(m_tupleManipulator.arity(), key.arity()); j < size; ++j)
+	{
+		const Column& column = m_columns[j];
+		int result;
+		if(column.packed)
+		{
+			int value = unpack_int(column_data(column), i, column.base, column.bitWidth);
+			result = Field(reinterpret_cast<char*>(&value), *fieldManipulators[j], true).compare_to(key.field(j));
+		}
+		else result = Field(raw_location(j, i), *fieldManipulators[j], true).compare_to(key.field(j));
+
+		if(result != 0) return result;
+	}
+
+	// If the tuple and key are equivalent up to this point, they compare equal.
+	return 0;
+}
+
+void PackedSortedPage::erase_tuples_at(unsigned int begin, unsigned int end)
+{
+	assert(begin <= end && end <= m_tupleCount);
+
+	// Shift the later values in each column down over the erased tuples' values. The packed columns keep their current
+	// bases and bit widths, since the remaining values still fit them.
+	const std::vector<const FieldManipulator*>& fieldManipulators = m_tupleManipulator.field_manipulators();
+	for(unsigned int j = 0, arity = m_tupleManipulator.arity(); j < arity; ++j)
+	{
+		const Column& column = m_columns[j];
+		if(column.packed)
+		{
+			move_packed_ints(column_data(column), end, m_tupleCount, begin, column.bitWidth);
+		}
+		else
+		{
+			const unsigned int fieldSize = fieldManipulators[j]->size();
+			memmove(raw_location(j, begin), raw_location(j, end), (m_tupleCount - end) * fieldSize);
+		}
+	}
+
+	invalidate_rows(begin, m_tupleCount);
+	m_tupleCount -= end - begin;
+}
+
+bool PackedSortedPage::fits_encoding(const Tuple& tuple) const
+{
+	for(unsigned int j = 0, arity = m_tupleManipulator.arity(); j < arity; ++j)
+	{
+		const Column& column = m_columns[j];
+		if(!column.packed) continue;
+
+		const unsigned int offset = static_cast<unsigned int>(tuple.field(j).get_int()) - static_cast<unsigned int>(column.base);
+		if(offset > max_offset(column.bitWidth)) return false;
+	}
+	return true;
+}
+
+void PackedSortedPage::invalidate_rows(unsigned int begin, unsigned int end)
+{
+	// Rows beyond the end of the cache have never been reconstructed.
+	end = std::min(end, static_cast<unsigned int>(m_rowCached.size()));
+	if(begin < end) std::fill(m_rowCached.begin() + begin, m_rowCached.begin() + end, 0);
+}
+
+bool PackedSortedPage::leading_field_range(const Tuple& key, unsigned int& low, unsigned int& high) const
+{
+	if(key.arity() == 0 || !m_columns[0].packed) return false;
+
+	// Convert the key's leading field to an int (exactly as FieldManipulator::compare_to() would), so that it can be
+	// compared with the unpacked values directly.
+	const Column& column = m_columns[0];
+	int value;
+	Field(reinterpret_cast<char*>(&value), IntFieldManipulator::instance()).set_from(key.field(0));
+
+	// If the value is outside the column's range, the bounds are at one end of the page.
+	low = 0;
+	high = m_tupleCount;
+	if(m_tupleCount == 0 || value < column.base)
+	{
+		high = 0;
+		return true;
+	}
+
+	if(static_cast<unsigned int>(value) - static_cast<unsigned int>(column.base) > max_offset(column.bitWidth))
+	{
+		low = m_tupleCount;
+		return true;
+	}
+
+	// Otherwise, find the first value that is not less than the key, and then the first one after it that is greater.
+	const char *data = column_data(column);
+	while(low < high)
+	{
+		unsigned int mid = low + (high - low) / 2;
+		if(unpack_int(data, mid, column.base, column.bitWidth) < value) low = mid + 1;
+		else high = mid;
+	}
+
+	unsigned int upper = m_tupleCount;
+	while(high < upper)
+	{
+		unsigned int mid = high + (upper - high) / 2;
+		if(value < unpack_int(data, mid, column.base, column.bitWidth)) upper = mid;
+		else high = mid + 1;
+	}
+
+	return true;
+}
+
+unsigned int PackedSortedPage::lower_bound_index(const Tuple& key) const
+{
+	// If the key only has a leading field, its lower bound is simply that of its leading field.
+	unsigned int low = 0, high = tuple_count();
+	if(leading_field_range(key, low, high) && std::min(key.arity(), m_tupleManipulator.arity()) == 1) return low;
+
+	while(low < high)
+	{
+		unsigned int mid = low + (high - low) / 2;
+		if(compare_tuple(mid, key) == -1) low = mid + 1;
+		else high = mid;
+	}
+	return low;
+}
+
+unsigned int PackedSortedPage::plan_encoding(const Tuple *tuple, const SortedPage *source, std::vector<Column>& columns) const
+{
+	const std::vector<const FieldManipulator*>& fieldManipulators = m_tupleManipulator.field_manipulators();
+	columns.resize(fieldManipulators.size());
+	for(unsigned int j = 0, arity = m_tupleManipulator.arity(); j < arity; ++j)
+	{
+		Column& column = columns[j];
+		column.base = 0;
+		column.bitWidth = 0;
+		column.packed = fieldManipulators[j] == &IntFieldManipulator::instance();
+		if(!column.packed) continue;
+
+		// Find the range of values that the column must hold.
+		bool seen = false;
+		int low = 0, high = 0;
+		widen_range(*this, j, seen, low, high);
+		if(tuple)
+		{
+			const int value = tuple->field(j).get_int();
+			widen_range(&value, 1, seen, low, high);
+		}
+		if(source) widen_range(*source, j, seen, low, high);
+		if(!seen) continue;
+
+		// Use just enough bits for the range, and centre the range within the offsets available at that width, so that
+		// values a little beyond either end of it can later be added without re-encoding the column.
+		const boost::uint64_t range = static_cast<boost::uint64_t>(static_cast<boost::int64_t>(high) - low);
+		column.bitWidth = packed_bit_width(static_cast<unsigned int>(range));
+		const boost::int64_t spare = static_cast<boost::int64_t>(max_offset(column.bitWidth) - range);
+		column.base = static_cast<int>(std::max(static_cast<boost::int64_t>(INT_MIN), low - spare / 2));
+	}
+
+	return capacity_for(buffer_size(), m_tupleManipulator, columns);
+}
+
+char *PackedSortedPage::raw_location(unsigned int fieldIndex, unsigned int i) const
+{
+	assert(!m_columns[fieldIndex].packed);
+	return column_data(m_columns[fieldIndex]) + i * m_tupleManipulator.field_manipulators()[fieldIndex]->size();
+}
+
+void PackedSortedPage::re_encode(const std::vector<Column>& columns, unsigned int maxTupleCount)
+{
+	assert(m_tupleCount <= maxTupleCount);
+
+	// Copy the columns into a fresh buffer laid out for the new encoding, repacking the packed values a chunk at a time.
+	std::vector<char> buffer(m_buffer.size());
+	const std::vector<const FieldManipulator*>& fieldManipulators = m_tupleManipulator.field_manipulators();
+	int values[READ_CHUNK_SIZE];
+	for(unsigned int j = 0, arity = m_tupleManipulator.arity(); j < arity; ++j)
+	{
+		const Column& from = m_columns[j];
+		const Column& to = columns[j];
+		char *data = &buffer[0] + to.offset;
+		if(to.packed)
+		{
+			for(unsigned int chunkBegin = 0; chunkBegin < m_tupleCount; chunkBegin += READ_CHUNK_SIZE)
+			{
+				const unsigned int chunkEnd = std::min(m_tupleCount, chunkBegin + READ_CHUNK_SIZE);
+				unpack_ints(column_data(from), chunkBegin, chunkEnd, from.base, from.bitWidth, values);
+				for(unsigned int i = chunkBegin; i < chunkEnd; ++i) pack_int(data, i, to.base, to.bitWidth, values[i - chunkBegin]);
+			}
+		}
+		else memcpy(data, column_data(from), m_tupleCount * fieldManipulators[j]->size());
+	}
+
+	// Note that the values themselves are unchanged, so any rows in the row cache remain valid.
+	m_buffer.swap(buffer);
+	m_columns = columns;
+	m_maxTupleCount = maxTupleCount;
+}
+
+unsigned int PackedSortedPage::upper_bound_index(const Tuple& key) const
+{
+	// If the key only has a leading field, its upper bound is simply that of its leading field.
+	unsigned int low = 0, high = tuple_count();
+	if(leading_field_range(key, low, high) && std::min(key.arity(), m_tupleManipulator.arity()) == 1) return high;
+
+	while(low < high)
+	{
+		unsigned int mid = low + (high - low) / 2;
+		if(compare_tuple(mid, key) == 1) high = mid;
+		else low = mid + 1;
+	}
+	return low;
+}
+
+}
@@ -0,0 +1,906 @@
+/**
+ * whery: SlottedSortedPage.cpp
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#include "whery/db/pages/SlottedSortedPage.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
+
+#include "whery/db/base/FieldManipulator.h"
+#include "whery/db/base/RangeKey.h"
+#include "whery/util/AlignmentTracker.h"
+
+#if defined(_MSC_VER)
+#include <xmmintrin.h>
+#endif
+
+namespace whery {
+
+//#################### LOCAL CONSTANTS ####################
+
+namespace {
+
+/** The maximum size (in bytes) of a tuple whose layout can be used for a search key (see LayoutKeyComparator). */
+const unsigned int MAX_LAYOUT_KEY_SIZE = 128;
+
+/** The maximum size (in bytes) of a field (or its normalized encoding) that can be used in a normalized key prefix. */
+const unsigned int MAX_NORMALIZED_FIELD_SIZE = 16;
+
+}
+
+//#################### LOCAL CLASSES ####################
+
+namespace {
+
+/**
+\brief An instance of this class compares tuples on a page with a search key by accessing their fields
+through the field manipulators.
+*/
+class DynamicKeyComparator
+{
+	//#################### PRIVATE VARIABLES ####################
+private:
+	/** The search key. */
+	const Tuple& m_key;
+
+	/** The manipulator used to interact with the tuples on the page. */
+	const TupleManipulator& m_tupleManipulator;
+
+	//#################### CONSTRUCTORS ####################
+public:
+	DynamicKeyComparator(const TupleManipulator& tupleManipulator, const Tuple& key)
+	:	m_key(key), m_tupleManipulator(tupleManipulator)
+	{}
+
+	//#################### PUBLIC OPERATORS ####################
+public:
+	int operator()(char *location) const
+	{
+		for(unsigned int j = 0, size = std::min(m_tupleManipulator.arity(), m_key.arity()); j < size; ++j)
+		{
+			switch(m_tupleManipulator.field(location, j, true).compare_to(m_key.field(j)))
+			{
+			case -1:
+				return -1;
+			case 0:
+				continue;
+			case 1:
+				return 1;
+			}
+		}
+
+		// If the tuple and key are equivalent up to this point, they compare equal.
+		return 0;
+	}
+};
+
+/**
+\brief An instance of this class compares tuples on a page with a search key by using the layout comparator
+of the page's tuple manipulator (see TypedTupleManipulator).
+
+To make this possible, the search key is converted into the layout of the page's tuples when the comparator
+is constructed. Converting each field of the key to the type of the corresponding tuple field is exactly what
+FieldManipulator::compare_to() does on every comparison, so the search results are unaffected.
+*/
+class LayoutKeyComparator
+{
+	//#################### PRIVATE VARIABLES ####################
+private:
+	/** The number of fields to compare. */
+	unsigned int m_arity;
+
+	/** A buffer containing the search key, converted into the layout of the page's tuples. */
+	union
+	{
+		char m_key[MAX_LAYOUT_KEY_SIZE];
+		AlignmentTracker::MaxAlignmentHelper m_alignment;
+	};
+
+	/** The function used to compare the tuples on the page with the converted search key. */
+	TupleManipulator::LayoutComparator m_layoutComparator;
+
+	//#################### CONSTRUCTORS ####################
+public:
+	LayoutKeyComparator(const TupleManipulator& tupleManipulator, const Tuple& key)
+	:	m_arity(std::min(tupleManipulator.arity(), key.arity())), m_layoutComparator(tupleManipulator.layout_comparator())
+	{
+		assert(is_usable_with(tupleManipulator));
+		for(unsigned int j = 0; j < m_arity; ++j)
+		{
+			tupleManipulator.field(m_key, j).set_from(key.field(j));
+		}
+	}
+
+	//#################### PUBLIC STATIC METHODS ####################
+public:
+	/**
+	Determines whether or not a layout key comparator can be used for a page whose tuples are
+	manipulated by the specified tuple manipulator.
+
+	\param tupleManipulator	The tuple manipulator.
+	\return					true, if a layout key comparator can be used, or false otherwise.
+	*/
+	static bool is_usable_with(const TupleManipulator& tupleManipulator)
+	{
+		return tupleManipulator.layout_comparator() != NULL && tupleManipulator.size() <= MAX_LAYOUT_KEY_SIZE;
+	}
+
+	//#################### PUBLIC OPERATORS ####################
+public:
+	int operator()(const char *location) const
+	{
+		return m_layoutComparator(location, m_key, m_arity);
+	}
+};
+
+/**
+\brief An instance of this class orders the slots of a page that uses suffix truncation by descending offset of their cells.
+*/
+class SlotOffsetGreater
+{
+	//#################### PRIVATE VARIABLES ####################
+private:
+	/** A mask selecting the bits of a slot that hold the offset of its cell. */
+	unsigned int m_offsetMask;
+
+	/** The slots. */
+	const unsigned int *m_slots;
+
+	//#################### CONSTRUCTORS ####################
+public:
+	SlotOffsetGreater(const unsigned int *slots, unsigned int offsetMask)
+	:	m_offsetMask(offsetMask), m_slots(slots)
+	{}
+
+	//#################### PUBLIC OPERATORS ####################
+public:
+	bool operator()(unsigned int i, unsigned int j) const
+	{
+		return (m_slots[i] & m_offsetMask) > (m_slots[j] & m_offsetMask);
+	}
+};
+
+}
+
+//#################### LOCAL FUNCTIONS ####################
+
+namespace {
+
+/**
+Hints to the processor that the memory at the specified location is about to be read.
+
+\param location	The location.
+*/
+inline void prefetch_for_read(const void *location)
+{
+#if defined(__GNUC__)
+	__builtin_prefetch(location, 0, 3);
+#elif defined(_MSC_VER)
+	_mm_prefetch(static_cast<const char*>(location), _MM_HINT_T0);
+#else
+	(void)location;
+#endif
+}
+
+}
+
+//#################### NESTED CLASSES ####################
+
+int SlottedSortedPage::KeyPrefix::compare(const unsigned int *prefix) const
+{
+	for(unsigned int i = 0; i < wordCount; ++i)
+	{
+		if(prefix[i] < words[i]) return -1;
+		else if(prefix[i] > words[i]) return 1;
+	}
+	return 0;
+}
+
+//#################### CONSTRUCTORS ####################
+
+SlottedSortedPage::SlottedSortedPage(const TupleManipulator& tupleManipulator)
+:	m_buffer(NULL), m_bufferSize(0), m_keyPrefixWordCount(0), m_maxTupleCount(0), m_tupleManipulator(tupleManipulator)
+{
+	if(tupleManipulator.uses_suffix_truncation() && tupleManipulator.arity() >= 2)
+	{
+		for(unsigned int keyArity = 1, maxKeyArity = tupleManipulator.arity() - 1; keyArity <= maxKeyArity; ++keyArity)
+		{
+			m_truncatedTupleManipulators.push_back(tupleManipulator.truncated(keyArity));
+			m_truncatedCellSizes.push_back(truncated_cell_size(m_truncatedTupleManipulators.back(), tupleManipulator));
+		}
+	}
+}
+
+//#################### PUBLIC STATIC METHODS ####################
+
+unsigned int SlottedSortedPage::buffer_size_for(unsigned int maxTupleCount, const TupleManipulator& tupleManipulator)
+{
+	if(tupleManipulator.uses_suffix_truncation())
+	{
+		const unsigned int maxAlignment = AlignmentTracker().max_alignment();
+		const unsigned int size = HW_COUNT * sizeof(unsigned int) + maxTupleCount * (truncated_cell_size(tupleManipulator, tupleManipulator) + sizeof(unsigned int));
+		return (size + maxAlignment - 1) / maxAlignment * maxAlignment;
+	}
+
+	const unsigned int slotSize = (1 + key_prefix_word_count(tupleManipulator)) * sizeof(unsigned int);
+	return maxTupleCount * (tupleManipulator.size() + slotSize) + sizeof(unsigned int);
+}
+
+unsigned int SlottedSortedPage::max_tuple_count_for(unsigned int bufferSize, const TupleManipulator& tupleManipulator)
+{
+	if(tupleManipulator.uses_suffix_truncation())
+	{
+		const unsigned int cellsEnd = truncated_cells_end(bufferSize);
+		const unsigned int headerSize = HW_COUNT * sizeof(unsigned int);
+		return cellsEnd >= headerSize ? (cellsEnd - headerSize) / (truncated_cell_size(tupleManipulator, tupleManipulator) + sizeof(unsigned int)) : 0;
+	}
+
+	const unsigned int slotSize = (1 + key_prefix_word_count(tupleManipulator)) * sizeof(unsigned int);
+	return (bufferSize - sizeof(unsigned int)) / (tupleManipulator.size() + slotSize);
+}
+
+//#################### PUBLIC METHODS ####################
+
+void SlottedSortedPage::add_tuple(const Tuple& tuple)
+{
+	if(!m_truncatedTupleManipulators.empty())
+	{
+		const unsigned int keyArity = tuple.arity() - 1;
+		if(tuple.arity() < 2 || keyArity > m_truncatedTupleManipulators.size())
+		{
+			throw std::invalid_argument("It is not possible to add a tuple that is longer than those of the page, or that has no key fields.");
+		}
+
+		const TupleManipulator& tupleManipulator = m_truncatedTupleManipulators[keyArity - 1];
+		const unsigned int size = m_truncatedCellSizes[keyArity - 1];
+		if(free_bytes() < size + sizeof(unsigned int))
+		{
+			throw std::out_of_range("It is not possible to add an additional tuple to a full page.");
+		}
+
+		// Allocate a cell for the tuple just below the existing cells, first compacting them if the gap
+		// between them and the slot array is too small (the space is there, but some of it is fragmented).
+		unsigned int *h = header();
+		unsigned int *s = slots();
+		unsigned int& count = h[HW_TUPLE_COUNT];
+		if(h[HW_CELLS_BEGIN] < HW_COUNT * sizeof(unsigned int) + (count + 1) * sizeof(unsigned int) + size) compact_cells();
+		h[HW_CELLS_BEGIN] -= size;
+		char *location = m_buffer + h[HW_CELLS_BEGIN];
+		for(unsigned int i = 0, arity = tuple.arity(); i < arity; ++i)
+		{
+			tupleManipulator.field(location, i).set_from(tuple.field(i));
+		}
+
+		// Insert a slot for the tuple in its place in the total order on the page's tuples.
+		const unsigned int pos = truncated_bound_index(tuple, true, true);
+		memmove(s + pos + 1, s + pos, (count - pos) * sizeof(unsigned int));
+		s[pos] = h[HW_CELLS_BEGIN] | (keyArity << SLOT_OFFSET_BITS);
+
+		h[HW_CELL_BYTES] += size;
+		++count;
+		return;
+	}
+
+	if(tuple_count() >= max_tuple_count())
+	{
+		throw std::out_of_range("It is not possible to add an additional tuple to a full page.");
+	}
+
+	if(tuple.arity() != m_tupleManipulator.arity())
+	{
+		throw std::invalid_argument("It is not possible to add a tuple whose arity differs from that of the page.");
+	}
+
+	// Copy the tuple into the first free cell (the free cells are the ones referred to by the slots beyond the live ones).
+	unsigned int *s = slots();
+	unsigned int& count = *tuple_count_location();
+	const unsigned int offset = s[count];
+	char *location = m_buffer + offset;
+	for(unsigned int i = 0, arity = tuple.arity(); i < arity; ++i)
+	{
+		m_tupleManipulator.field(location, i).set_from(tuple.field(i));
+	}
+
+	// Insert a slot for the tuple after any equivalent tuples already on the page, shifting the later slots up to make room.
+	const unsigned int pos = upper_bound_index(tuple);
+	memmove(s + pos + 1, s + pos, (count - pos) * sizeof(unsigned int));
+	s[pos] = offset;
+
+	// If the page uses key prefixes, do the same for the tuple's prefix.
+	if(m_keyPrefixWordCount > 0)
+	{
+		unsigned int *prefix = key_prefixes() + pos * m_keyPrefixWordCount;
+		memmove(prefix + m_keyPrefixWordCount, prefix, (count - pos) * m_keyPrefixWordCount * sizeof(unsigned int));
+
+		KeyPrefix keyPrefix = make_key_prefix(tuple);
+		assert(keyPrefix.wordCount == m_keyPrefixWordCount);
+		std::copy(keyPrefix.words, keyPrefix.words + m_keyPrefixWordCount, prefix);
+	}
+
+	++count;
+}
+
+SortedPage::TupleSetCIter SlottedSortedPage::begin() const
+{
+	return TupleSetCIter(this, 0);
+}
+
+unsigned int SlottedSortedPage::buffer_size() const
+{
+	return m_bufferSize;
+}
+
+void SlottedSortedPage::clear()
+{
+	if(!m_truncatedTupleManipulators.empty())
+	{
+		unsigned int *h = header();
+		h[HW_TUPLE_COUNT] = 0;
+		h[HW_CELLS_BEGIN] = cells_end();
+		h[HW_CELL_BYTES] = 0;
+		return;
+	}
+
+	// Note that the slots still form a permutation of the cells, so there is no need to reset them.
+	*tuple_count_location() = 0;
+}
+
+unsigned int SlottedSortedPage::empty_tuple_count() const
+{
+	if(!m_truncatedTupleManipulators.empty()) return free_bytes() / (m_truncatedCellSizes.back() + sizeof(unsigned int));
+	return max_tuple_count() - tuple_count();
+}
+
+SortedPage::TupleSetCIter SlottedSortedPage::end() const
+{
+	return TupleSetCIter(this, tuple_count());
+}
+
+SortedPage::EqualRangeResult SlottedSortedPage::equal_range(const RangeKey& key) const
+{
+	if(key.is_valid())
+	{
+		return std::make_pair(lower_bound(key), upper_bound(key));
+	}
+	else
+	{
+		TupleSetCIter it = lower_bound(key);
+		return std::make_pair(it, it);
+	}
+}
+
+SortedPage::EqualRangeResult SlottedSortedPage::equal_range(const ValueKey& key) const
+{
+	return std::make_pair(lower_bound(key), upper_bound(key));
+}
+
+void SlottedSortedPage::erase_tuple(const BackedTuple& key)
+{
+	if(!m_truncatedTupleManipulators.empty())
+	{
+		// The key is one of the page's own tuples, so find exactly that tuple rather than the first one that starts with it.
+		unsigned int i = truncated_bound_index(key, true, false);
+		if(i != tuple_count() && compare_cell(i, key, true) == 0)
+		{
+			erase_tuples_at(i, i + 1);
+		}
+		return;
+	}
+
+	unsigned int i = lower_bound_index(key);
+	if(i != tuple_count() && compare_tuple(i, key) == 0)
+	{
+		erase_tuples_at(i, i + 1);
+	}
+}
+
+void SlottedSortedPage::erase_tuple(const TupleSetCIter& it)
+{
+	if(it != end())
+	{
+		erase_tuples_at(it.index(), it.index() + 1);
+	}
+}
+
+void SlottedSortedPage::erase_tuple(const TupleSetCRIter& rit)
+{
+	if(rit != rend())
+	{
+		erase_tuples_at(rit.base().index() - 1, rit.base().index());
+	}
+}
+
+void SlottedSortedPage::erase_tuples(const TupleSetCIter& begin, const TupleSetCIter& end)
+{
+	erase_tuples_at(begin.index(), end.index());
+}
+
+const std::vector<const FieldManipulator*>& SlottedSortedPage::field_manipulators() const
+{
+	return m_tupleManipulator.field_manipulators();
+}
+
+SortedPage::TupleSetCIter SlottedSortedPage::find(const ValueKey& key) const
+{
+	unsigned int i = lower_bound_index(key);
+	if(i != tuple_count() && compare_tuple(i, key) == 0) return TupleSetCIter(this, i);
+	else return end();
+}
+
+SortedPage::TupleSetCIter SlottedSortedPage::lower_bound(const RangeKey& key) const
+{
+	if(key.has_low_endpoint())
+	{
+		// For an open endpoint, the range starts after all the tuples that are equivalent to the endpoint value.
+		const ValueKey& value = key.low_value();
+		return TupleSetCIter(this, key.low_kind() == OPEN ? upper_bound_index(value) : lower_bound_index(value));
+	}
+	else return begin();
+}
+
+SortedPage::TupleSetCIter SlottedSortedPage::lower_bound(const ValueKey& key) const
+{
+	return TupleSetCIter(this, lower_bound_index(key));
+}
+
+unsigned int SlottedSortedPage::max_tuple_count() const
+{
+	if(!m_truncatedTupleManipulators.empty()) return tuple_count() + empty_tuple_count();
+	return m_maxTupleCount;
+}
+
+double SlottedSortedPage::percentage_full() const
+{
+	if(!m_truncatedTupleManipulators.empty())
+	{
+		const unsigned int usableBytes = cells_end() - HW_COUNT * sizeof(unsigned int);
+		return (usableBytes - free_bytes()) * 100.0 / usableBytes;
+	}
+	return tuple_count() * 100.0 / max_tuple_count();
+}
+
+void SlottedSortedPage::prefetch() const
+{
+	// A search reads the tuple count first, and then starts its binary search in the middle of the slot
+	// array (and of the key prefixes, if there are any). Note that we avoid reading the tuple count here,
+	// since that would make us wait for the very cache miss we are trying to overlap.
+	const unsigned int mid = m_maxTupleCount / 2;
+	prefetch_for_read(tuple_count_location());
+	prefetch_for_read(slots() + mid);
+	if(m_keyPrefixWordCount > 0) prefetch_for_read(key_prefixes() + mid * m_keyPrefixWordCount);
+}
+
+SortedPage::TupleSetCRIter SlottedSortedPage::rbegin() const
+{
+	return TupleSetCRIter(end());
+}
+
+SortedPage::TupleSetCRIter SlottedSortedPage::rend() const
+{
+	return TupleSetCRIter(begin());
+}
+
+unsigned int SlottedSortedPage::tuple_count() const
+{
+	return *tuple_count_location();
+}
+
+char *SlottedSortedPage::tuple_location(unsigned int i) const
+{
+	// Note that the index is only checked against the capacity of the page, since an optimistic reader of a
+	// concurrent B+-tree may legitimately read a slot that a writer has just vacated (it will then discard
+	// whatever it read and restart).
+	assert(i < max_tuple_count());
+	if(!m_truncatedTupleManipulators.empty())
+	{
+		unsigned int keyArity;
+		return cell_location(i, keyArity);
+	}
+	return m_buffer + slots()[i];
+}
+
+void SlottedSortedPage::tuple_locations(unsigned int begin, unsigned int end, const char **locations) const
+{
+	assert(begin <= end && end <= max_tuple_count());
+	if(!m_truncatedTupleManipulators.empty())
+	{
+		for(unsigned int i = begin; i < end; ++i) *locations++ = tuple_location(i);
+		return;
+	}
+
+	const unsigned int *s = slots();
+	for(unsigned int i = begin; i < end; ++i) *locations++ = m_buffer + s[i];
+}
+
+const TupleManipulator& SlottedSortedPage::tuple_manipulator() const
+{
+	return m_tupleManipulator;
+}
+
+const TupleManipulator& SlottedSortedPage::tuple_manipulator_at(unsigned int i) const
+{
+	if(m_truncatedTupleManipulators.empty()) return m_tupleManipulator;
+
+	unsigned int keyArity;
+	cell_location(i, keyArity);
+	return m_truncatedTupleManipulators[keyArity - 1];
+}
+
+SortedPage::TupleSetCIter SlottedSortedPage::upper_bound(const RangeKey& key) const
+{
+	if(key.has_high_endpoint())
+	{
+		// For an open endpoint, the range ends before all the tuples that are equivalent to the endpoint value.
+		const ValueKey& value = key.high_value();
+		return TupleSetCIter(this, key.high_kind() == OPEN ? lower_bound_index(value) : upper_bound_index(value));
+	}
+	else return end();
+}
+
+SortedPage::TupleSetCIter SlottedSortedPage::upper_bound(const ValueKey& key) const
+{
+	return TupleSetCIter(this, upper_bound_index(key));
+}
+
+//#################### PROTECTED METHODS ####################
+
+void SlottedSortedPage::initialise(char *buffer, unsigned int bufferSize, bool fresh)
+{
+	if(bufferSize < sizeof(unsigned int))
+	{
+		throw std::invalid_argument("The buffer for a page must be large enough to hold its tuple count.");
+	}
+
+	m_buffer = buffer;
+	m_bufferSize = bufferSize;
+	m_keyPrefixWordCount = key_prefix_word_count(m_tupleManipulator);
+	m_maxTupleCount = max_tuple_count_for(bufferSize, m_tupleManipulator);
+
+	if(m_tupleManipulator.uses_suffix_truncation())
+	{
+		if(m_truncatedTupleManipulators.empty())
+		{
+			throw std::invalid_argument("The tuples of a page that uses suffix truncation must have at least one key field and a last field.");
+		}
+
+		if(m_keyPrefixWordCount > 0)
+		{
+			throw std::invalid_argument("A page cannot use both normalized key prefixes and suffix truncation.");
+		}
+
+		if(bufferSize >= (1u << SLOT_OFFSET_BITS) || cells_end() < HW_COUNT * sizeof(unsigned int))
+		{
+			throw std::invalid_argument("The buffer for a page that uses suffix truncation must be able to hold its header, and must be smaller than 16MB.");
+		}
+
+		// Reserve enough space to order the slots during compaction even if the page is full of the smallest cells,
+		// so that compacting the cells never needs to allocate memory.
+		m_compactionOrder.reserve(cells_end() / (m_truncatedCellSizes.front() + sizeof(unsigned int)) + 1);
+
+		if(fresh) clear();
+		else
+		{
+			const unsigned int *h = header();
+			const unsigned int slotsEnd = (HW_COUNT + h[HW_TUPLE_COUNT]) * sizeof(unsigned int);
+			if(h[HW_TUPLE_COUNT] > cells_end() || slotsEnd > h[HW_CELLS_BEGIN] || h[HW_CELLS_BEGIN] > cells_end() ||
+			   h[HW_CELL_BYTES] > cells_end() - h[HW_CELLS_BEGIN])
+			{
+				throw std::invalid_argument("The buffer does not contain a valid page.");
+			}
+		}
+		return;
+	}
+
+	if(fresh)
+	{
+		// Initially, all the cells are free, and each slot simply refers to the corresponding cell.
+		unsigned int *s = slots();
+		for(unsigned int i = 0; i < m_maxTupleCount; ++i)
+		{
+			s[i] = i * m_tupleManipulator.size();
+		}
+
+		*tuple_count_location() = 0;
+	}
+	else if(tuple_count() > m_maxTupleCount)
+	{
+		throw std::invalid_argument("The buffer does not contain a valid page.");
+	}
+}
+
+//#################### PRIVATE METHODS ####################
+
+char *SlottedSortedPage::cell_location(unsigned int i, unsigned int& keyArity) const
+{
+	const unsigned int slot = slots()[i];
+	const unsigned int maxKeyArity = static_cast<unsigned int>(m_truncatedTupleManipulators.size());
+	keyArity = std::max(1u, std::min(slot >> SLOT_OFFSET_BITS, maxKeyArity));
+
+	const unsigned int size = m_truncatedCellSizes[keyArity - 1];
+	const unsigned int end = cells_end();
+	const unsigned int offset = std::min(slot & ((1u << SLOT_OFFSET_BITS) - 1), end >= size ? end - size : 0);
+	return m_buffer + offset;
+}
+
+unsigned int SlottedSortedPage::cells_end() const
+{
+	return truncated_cells_end(m_bufferSize);
+}
+
+void SlottedSortedPage::compact_cells()
+{
+	unsigned int *h = header();
+	unsigned int *s = slots();
+	const unsigned int count = h[HW_TUPLE_COUNT];
+	if(count == 0)
+	{
+		h[HW_CELLS_BEGIN] = cells_end();
+		return;
+	}
+
+	// Visit the live cells in descending order of offset, sliding each one up against those that have already been
+	// moved. A cell can only move towards the end of the buffer, and the cells that have not yet been visited all lie
+	// below it, so no cell is overwritten before it has been moved, and no separate copy of the cells is needed.
+	const unsigned int offsetMask = (1u << SLOT_OFFSET_BITS) - 1;
+	m_compactionOrder.resize(count);
+	for(unsigned int i = 0; i < count; ++i) m_compactionOrder[i] = i;
+	std::sort(m_compactionOrder.begin(), m_compactionOrder.end(), SlotOffsetGreater(s, offsetMask));
+
+	unsigned int offset = cells_end();
+	for(unsigned int i = 0; i < count; ++i)
+	{
+		unsigned int& slot = s[m_compactionOrder[i]];
+		const unsigned int keyArity = slot >> SLOT_OFFSET_BITS;
+		const unsigned int size = m_truncatedCellSizes[keyArity - 1];
+		offset -= size;
+		if(offset != (slot & offsetMask)) memmove(m_buffer + offset, m_buffer + (slot & offsetMask), size);
+		slot = offset | (keyArity << SLOT_OFFSET_BITS);
+	}
+
+	h[HW_CELLS_BEGIN] = offset;
+}
+
+int SlottedSortedPage::compare_cell(unsigned int i, const Tuple& key, bool keyIsTuple) const
+{
+	unsigned int keyArity;
+	char *location = cell_location(i, keyArity);
+	const TupleManipulator& tupleManipulator = m_truncatedTupleManipulators[keyArity - 1];
+	const unsigned int otherKeyArity = keyIsTuple ? key.arity() - 1 : key.arity();
+	for(unsigned int j = 0, size = std::min(keyArity, otherKeyArity); j < size; ++j)
+	{
+		int result = tupleManipulator.field(location, j, true).compare_to(key.field(j));
+		if(result != 0) return result;
+	}
+
+	if(keyIsTuple)
+	{
+		if(keyArity != otherKeyArity) return keyArity < otherKeyArity ? -1 : 1;
+		return tupleManipulator.field(location, keyArity, true).compare_to(key.field(otherKeyArity));
+	}
+	else
+	{
+		// A truncated tuple whose key fields form a proper prefix of the search key is ordered before it.
+		return keyArity < otherKeyArity && keyArity < m_truncatedTupleManipulators.size() ? -1 : 0;
+	}
+}
+
+int SlottedSortedPage::compare_tuple(unsigned int i, const Tuple& key) const
+{
+	if(!m_truncatedTupleManipulators.empty()) return compare_cell(i, key, false);
+
+	// Note that this performs the same comparison as PrefixTupleComparator, but accesses the tuple's
+	// fields directly rather than constructing a BackedTuple for it.
+	return DynamicKeyComparator(m_tupleManipulator, key)(tuple_location(i));
+}
+
+void SlottedSortedPage::erase_tuples_at(unsigned int begin, unsigned int end)
+{
+	unsigned int *s = slots();
+	unsigned int& count = *tuple_count_location();
+	assert(begin <= end && end <= count);
+
+	if(!m_truncatedTupleManipulators.empty())
+	{
+		// Release the erased tuples' cells (their space is reclaimed by the next compaction), and shift the later slots down.
+		unsigned int& cellBytes = header()[HW_CELL_BYTES];
+		for(unsigned int i = begin; i < end; ++i)
+		{
+			cellBytes -= m_truncatedCellSizes[(s[i] >> SLOT_OFFSET_BITS) - 1];
+		}
+		memmove(s + begin, s + end, (count - end) * sizeof(unsigned int));
+		count -= end - begin;
+		return;
+	}
+
+	// Shift the later slots down over the erased tuples' slots, and move their slots
+	// to the start of the free area so that their cells can be reused. (Rotating the
+	// slots does both at once.)
+	std::rotate(s + begin, s + end, s + count);
+
+	// If the page uses key prefixes, shift the later prefixes down as well (the prefixes for free cells are unused).
+	if(m_keyPrefixWordCount > 0)
+	{
+		unsigned int *prefixes = key_prefixes();
+		memmove(prefixes + begin * m_keyPrefixWordCount, prefixes + end * m_keyPrefixWordCount, (count - end) * m_keyPrefixWordCount * sizeof(unsigned int));
+	}
+
+	count -= end - begin;
+}
+
+unsigned int SlottedSortedPage::free_bytes() const
+{
+	const unsigned int *h = header();
+	return cells_end() - (HW_COUNT + h[HW_TUPLE_COUNT]) * sizeof(unsigned int) - h[HW_CELL_BYTES];
+}
+
+unsigned int *SlottedSortedPage::header() const
+{
+	return reinterpret_cast<unsigned int*>(m_buffer);
+}
+
+unsigned int *SlottedSortedPage::key_prefixes() const
+{
+	return slots() + m_maxTupleCount;
+}
+
+unsigned int SlottedSortedPage::lower_bound_index(const Tuple& key) const
+{
+	if(!m_truncatedTupleManipulators.empty()) return truncated_bound_index(key, false, false);
+
+	KeyPrefix keyPrefix = make_key_prefix(key);
+	if(LayoutKeyComparator::is_usable_with(m_tupleManipulator)) return lower_bound_index_with(LayoutKeyComparator(m_tupleManipulator, key), keyPrefix);
+	else return lower_bound_index_with(DynamicKeyComparator(m_tupleManipulator, key), keyPrefix);
+}
+
+template <typename Comp>
+unsigned int SlottedSortedPage::lower_bound_index_with(const Comp& comp, const KeyPrefix& keyPrefix) const
+{
+	const unsigned int *s = slots();
+	const unsigned int *prefixes = key_prefixes();
+	unsigned int low = 0, high = tuple_count();
+	while(low < high)
+	{
+		unsigned int mid = low + (high - low) / 2;
+		int result = keyPrefix.compare(prefixes + mid * m_keyPrefixWordCount);
+		if(result == 0 && !keyPrefix.complete) result = comp(m_buffer + s[mid]);
+		if(result == -1) low = mid + 1;
+		else high = mid;
+	}
+	return low;
+}
+
+SlottedSortedPage::KeyPrefix SlottedSortedPage::make_key_prefix(const Tuple& key) const
+{
+	KeyPrefix keyPrefix;
+	keyPrefix.complete = false;
+	keyPrefix.wordCount = 0;
+	if(m_keyPrefixWordCount == 0) return keyPrefix;
+
+	// Convert the leading fields of the key to the types of the corresponding tuple fields (exactly as
+	// FieldManipulator::compare_to() would), and write their normalized encodings into a buffer.
+	const std::vector<const FieldManipulator*>& fieldManipulators = m_tupleManipulator.field_manipulators();
+	const unsigned int maxPrefixSize = m_keyPrefixWordCount * sizeof(unsigned int);
+	unsigned char bytes[MAX_KEY_PREFIX_WORDS * sizeof(unsigned int) + MAX_NORMALIZED_FIELD_SIZE];
+	const unsigned int arity = std::min(m_tupleManipulator.arity(), key.arity());
+	unsigned int j = 0, size = 0;
+	for(; j < arity && size < maxPrefixSize; ++j)
+	{
+		union
+		{
+			char value[MAX_NORMALIZED_FIELD_SIZE];
+			AlignmentTracker::MaxAlignmentHelper alignment;
+		};
+
+		const FieldManipulator& fieldManipulator = *fieldManipulators[j];
+		assert(fieldManipulator.size() <= MAX_NORMALIZED_FIELD_SIZE && fieldManipulator.normalized_size() <= MAX_NORMALIZED_FIELD_SIZE);
+		Field field(value, fieldManipulator);
+		field.set_from(key.field(j));
+		field.write_normalized(reinterpret_cast<char*>(bytes + size));
+		size += fieldManipulator.normalized_size();
+	}
+
+	// Pack the bytes into big-endian words, so that comparing the words compares the bytes lexicographically.
+	// Only whole words can be compared: a key that only covers part of a word compares equal to its prefix.
+	keyPrefix.complete = j == arity && size <= maxPrefixSize;
+	keyPrefix.wordCount = std::min(size, maxPrefixSize) / sizeof(unsigned int);
+	for(unsigned int i = 0; i < keyPrefix.wordCount; ++i)
+	{
+		const unsigned char *b = bytes + i * sizeof(unsigned int);
+		keyPrefix.words[i] = (b[0] << 24) | (b[1] << 16) | (b[2] << 8) | b[3];
+	}
+
+	return keyPrefix;
+}
+
+unsigned int *SlottedSortedPage::slots() const
+{
+	if(!m_truncatedTupleManipulators.empty()) return header() + HW_COUNT;
+	return reinterpret_cast<unsigned int*>(m_buffer + m_maxTupleCount * m_tupleManipulator.size());
+}
+
+unsigned int *SlottedSortedPage::tuple_count_location() const
+{
+	if(!m_truncatedTupleManipulators.empty()) return header() + HW_TUPLE_COUNT;
+	return key_prefixes() + m_maxTupleCount * m_keyPrefixWordCount;
+}
+
+unsigned int SlottedSortedPage::truncated_bound_index(const Tuple& key, bool keyIsTuple, bool upper) const
+{
+	unsigned int low = 0, high = tuple_count();
+	while(low < high)
+	{
+		unsigned int mid = low + (high - low) / 2;
+		int result = compare_cell(mid, key, keyIsTuple);
+		if(result == -1 || (upper && result == 0)) low = mid + 1;
+		else high = mid;
+	}
+	return low;
+}
+
+unsigned int SlottedSortedPage::upper_bound_index(const Tuple& key) const
+{
+	if(!m_truncatedTupleManipulators.empty()) return truncated_bound_index(key, false, true);
+
+	KeyPrefix keyPrefix = make_key_prefix(key);
+	if(LayoutKeyComparator::is_usable_with(m_tupleManipulator)) return upper_bound_index_with(LayoutKeyComparator(m_tupleManipulator, key), keyPrefix);
+	else return upper_bound_index_with(DynamicKeyComparator(m_tupleManipulator, key), keyPrefix);
+}
+
+template <typename Comp>
+unsigned int SlottedSortedPage::upper_bound_index_with(const Comp& comp, const KeyPrefix& keyPrefix) const
+{
+	const unsigned int *s = slots();
+	const unsigned int *prefixes = key_prefixes();
+	unsigned int low = 0, high = tuple_count();
+	while(low < high)
+	{
+		unsigned int mid = low + (high - low) / 2;
+		int result = keyPrefix.compare(prefixes + mid * m_keyPrefixWordCount);
+		if(result == 0 && !keyPrefix.complete) result = comp(m_buffer + s[mid]);
+		if(result == 1) high = mid;
+		else low = mid + 1;
+	}
+	return low;
+}
+
+//#################### PRIVATE STATIC METHODS ####################
+
+unsigned int SlottedSortedPage::key_prefix_word_count(const TupleManipulator& tupleManipulator)
+{
+	if(!tupleManipulator.uses_key_prefixes()) return 0;
+
+	unsigned int normalizedSize = 0;
+	const std::vector<const FieldManipulator*>& fieldManipulators = tupleManipulator.field_manipulators();
+	for(size_t i = 0, size = fieldManipulators.size(); i < size; ++i)
+	{
+		normalizedSize += fieldManipulators[i]->normalized_size();
+	}
+
+	return std::min<unsigned int>(normalizedSize / sizeof(unsigned int), MAX_KEY_PREFIX_WORDS);
+}
+
+unsigned int SlottedSortedPage::truncated_cell_size(const TupleManipulator& truncatedManipulator, const TupleManipulator& tupleManipulator)
+{
+	unsigned int alignment = 1;
+	const std::vector<const FieldManipulator*>& fieldManipulators = tupleManipulator.field_manipulators();
+	for(size_t i = 0, size = fieldManipulators.size(); i < size; ++i)
+	{
+		alignment = std::max(alignment, fieldManipulators[i]->alignment_requirement());
+	}
+
+	const unsigned int last = truncatedManipulator.arity() - 1;
+	const unsigned int end = truncatedManipulator.field_offset(last) + truncatedManipulator.field_manipulators()[last]->size();
+	return (end + alignment - 1) / alignment * alignment;
+}
+
+unsigned int SlottedSortedPage::truncated_cells_end(unsigned int bufferSize)
+{
+	const unsigned int maxAlignment = AlignmentTracker().max_alignment();
+	return bufferSize / maxAlignment * maxAlignment;
+}
+
+}
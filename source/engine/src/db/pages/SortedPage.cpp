@@ -0,0 +1,81 @@
+/**
+ * whery: SortedPage.cpp
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#include "whery/db/pages/SortedPage.h"
+
+#include <algorithm>
+
+#include "whery/db/base/DoubleFieldManipulator.h"
+#include "whery/db/base/IntFieldManipulator.h"
+
+namespace whery {
+
+//#################### LOCAL CONSTANTS ####################
+
+namespace {
+
+/** The number of tuple locations fetched at a time when decoding the values of a field. */
+const unsigned int READ_CHUNK_SIZE = 64;
+
+}
+
+//#################### LOCAL FUNCTIONS ####################
+
+namespace {
+
+double get_value(const FieldManipulator& fieldManipulator, const char *location, double*)	{ return fieldManipulator.get_double(location); }
+int get_value(const FieldManipulator& fieldManipulator, const char *location, int*)			{ return fieldManipulator.get_int(location); }
+
+/**
+Decodes the values of the specified field of the tuples at a range of positions on a page.
+
+\param page				The page.
+\param fieldIndex		The index of the field.
+\param begin			The position of the first tuple.
+\param end				The position one beyond the last tuple.
+\param values			An array with room for end - begin values, into which to write them.
+\param nativeManipulator	The manipulator for fields whose values can be read directly as a T.
+*/
+template <typename T>
+void read_values(const SortedPage& page, unsigned int fieldIndex, unsigned int begin, unsigned int end, T *values, const FieldManipulator& nativeManipulator)
+{
+	const TupleManipulator& tupleManipulator = page.tuple_manipulator();
+	const FieldManipulator& fieldManipulator = *tupleManipulator.field_manipulators()[fieldIndex];
+	const unsigned int offset = tupleManipulator.field_offset(fieldIndex);
+	const bool native = &fieldManipulator == &nativeManipulator;
+
+	const char *locations[READ_CHUNK_SIZE];
+	for(unsigned int chunkBegin = begin; chunkBegin < end; chunkBegin += READ_CHUNK_SIZE)
+	{
+		const unsigned int chunkSize = std::min(end - chunkBegin, READ_CHUNK_SIZE);
+		page.tuple_locations(chunkBegin, chunkBegin + chunkSize, locations);
+
+		// If the field is known to be a T, read it directly; otherwise, convert it using its manipulator.
+		if(native)
+		{
+			for(unsigned int i = 0; i < chunkSize; ++i) *values++ = *reinterpret_cast<const T*>(locations[i] + offset);
+		}
+		else
+		{
+			for(unsigned int i = 0; i < chunkSize; ++i) *values++ = get_value(fieldManipulator, locations[i] + offset, static_cast<T*>(NULL));
+		}
+	}
+}
+
+}
+
+//#################### PUBLIC METHODS ####################
+
+void SortedPage::read_doubles(unsigned int fieldIndex, unsigned int begin, unsigned int end, double *values) const
+{
+	read_values(*this, fieldIndex, begin, end, values, DoubleFieldManipulator::instance());
+}
+
+void SortedPage::read_ints(unsigned int fieldIndex, unsigned int begin, unsigned int end, int *values) const
+{
+	read_values(*this, fieldIndex, begin, end, values, IntFieldManipulator::instance());
+}
+
+}
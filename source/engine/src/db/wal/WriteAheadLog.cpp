@@ -0,0 +1,439 @@
+/**
+ * whery: WriteAheadLog.cpp
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#include "whery/db/wal/WriteAheadLog.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+#include <boost/crc.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <boost/integer_traits.hpp>
+#include <boost/thread/locks.hpp>
+
+namespace whery {
+
+//#################### LOCAL CONSTANTS ####################
+
+namespace {
+
+/** The magic number at the start of every log file. */
+const char LOG_MAGIC[] = "WHRYWAL1";
+
+/** The size (in bytes) of the magic number. */
+const size_t LOG_MAGIC_SIZE = 8;
+
+/** The size (in bytes) of the file header, which consists of the magic number and the LSN of the last record discarded by reset(). */
+const size_t FILE_HEADER_SIZE = LOG_MAGIC_SIZE + sizeof(WriteAheadLog::LSN);
+
+/** The size (in bytes) of each record header, which consists of the payload size, a checksum, the LSN and the type. */
+const size_t RECORD_HEADER_SIZE = sizeof(boost::uint32_t) + sizeof(boost::uint32_t) + sizeof(WriteAheadLog::LSN) + 1;
+
+}
+
+//#################### LOCAL FUNCTIONS ####################
+
+namespace {
+
+/**
+Calculates the checksum of a record.
+
+\param lsn		The LSN of the record.
+\param type		The type of the record.
+\param payload	A pointer to the payload of the record.
+\param size		The size (in bytes) of the payload.
+\return			The checksum.
+*/
+boost::uint32_t record_checksum(WriteAheadLog::LSN lsn, unsigned char type, const char *payload, size_t size)
+{
+	boost::crc_32_type crc;
+	crc.process_bytes(&lsn, sizeof(lsn));
+	crc.process_byte(type);
+	crc.process_bytes(payload, size);
+	return crc.checksum();
+}
+
+/**
+Finds the first record after the specified one in the contents of a log file whose records are all valid.
+
+\param contents	The contents of the log file (starting with a valid file header).
+\param lsn		The LSN of the specified record.
+\return			The offset of the first record whose LSN is greater than lsn (or the end of the contents, if there is none).
+*/
+size_t find_record_after(const std::vector<char>& contents, WriteAheadLog::LSN lsn)
+{
+	size_t offset = FILE_HEADER_SIZE, size = contents.size();
+	while(size - offset >= RECORD_HEADER_SIZE)
+	{
+		boost::uint32_t payloadSize;
+		WriteAheadLog::LSN recordLSN;
+		memcpy(&payloadSize, &contents[offset], sizeof(payloadSize));
+		memcpy(&recordLSN, &contents[offset + 8], sizeof(recordLSN));
+		if(recordLSN > lsn) break;
+		offset += RECORD_HEADER_SIZE + payloadSize;
+	}
+	return offset;
+}
+
+/**
+Reads the whole of the specified file into memory.
+
+\param filename				The name of the file.
+\return						The contents of the file.
+\throw std::runtime_error	If the file cannot be read.
+*/
+std::vector<char> read_file(const std::string& filename)
+{
+	std::ifstream fs(filename.c_str(), std::ios::binary);
+	if(!fs)
+	{
+		throw std::runtime_error("Could not open the file " + filename + " for reading.");
+	}
+
+	return std::vector<char>(std::istreambuf_iterator<char>(fs), std::istreambuf_iterator<char>());
+}
+
+/**
+Scans the records in the contents of a log file, stopping at the first one that is torn or corrupt.
+
+\param contents	The contents of the log file (starting with a valid file header).
+\param records	A vector to which to add the records that have not been discarded by reset() (or NULL, if not needed).
+\param lastLSN	Used to return the LSN of the last valid record (or the LSN in the file header, if that is larger).
+\return			The offset of the end of the last valid record.
+*/
+size_t scan_records(const std::vector<char>& contents, std::vector<WriteAheadLog::Record> *records, WriteAheadLog::LSN& lastLSN)
+{
+	WriteAheadLog::LSN resetLSN;
+	memcpy(&resetLSN, &contents[LOG_MAGIC_SIZE], sizeof(resetLSN));
+	lastLSN = resetLSN;
+
+	size_t offset = FILE_HEADER_SIZE, size = contents.size();
+	WriteAheadLog::LSN previousLSN = 0;
+	while(size - offset >= RECORD_HEADER_SIZE)
+	{
+		const char *header = &contents[offset];
+		boost::uint32_t payloadSize, checksum;
+		WriteAheadLog::LSN lsn;
+		memcpy(&payloadSize, header, sizeof(payloadSize));
+		memcpy(&checksum, header + 4, sizeof(checksum));
+		memcpy(&lsn, header + 8, sizeof(lsn));
+		const unsigned char type = static_cast<unsigned char>(header[16]);
+
+		// Stop if the record is incomplete, corrupt or out of sequence (it must have been torn by a crash).
+		if(size - offset - RECORD_HEADER_SIZE < payloadSize) break;
+		const char *payload = header + RECORD_HEADER_SIZE;
+		if(record_checksum(lsn, type, payload, payloadSize) != checksum || lsn <= previousLSN) break;
+
+		if(records && lsn > resetLSN)
+		{
+			WriteAheadLog::Record record;
+			record.lsn = lsn;
+			record.payload.assign(payload, payload + payloadSize);
+			record.type = type;
+			records->push_back(record);
+		}
+
+		if(lsn > lastLSN) lastLSN = lsn;
+		previousLSN = lsn;
+		offset += RECORD_HEADER_SIZE + payloadSize;
+	}
+
+	return offset;
+}
+
+/**
+Writes a log file header to the start of the specified file.
+
+\param file		The file.
+\param resetLSN	The LSN of the last record discarded by reset().
+*/
+void write_file_header(BinaryFile& file, WriteAheadLog::LSN resetLSN)
+{
+	char header[FILE_HEADER_SIZE];
+	memcpy(header, LOG_MAGIC, LOG_MAGIC_SIZE);
+	memcpy(header + LOG_MAGIC_SIZE, &resetLSN, sizeof(resetLSN));
+	file.seek(0);
+	file.write(header, FILE_HEADER_SIZE);
+}
+
+}
+
+//#################### CONSTRUCTORS ####################
+
+WriteAheadLog::WriteAheadLog(const std::string& filename, unsigned int syncInterval)
+:	m_commitsSinceSync(0), m_failed(false), m_durableLSN(0), m_file(filename), m_fileBusy(false), m_filename(filename),
+	m_lastLSN(0), m_syncCount(0), m_syncInterval(syncInterval), m_writtenLSN(0)
+{
+	if(syncInterval == 0)
+	{
+		throw std::invalid_argument("The sync interval of a write-ahead log must be at least 1.");
+	}
+
+	std::vector<char> contents = read_file(filename);
+	if(contents.size() < FILE_HEADER_SIZE)
+	{
+		// The file is fresh (or its header was torn by a crash whilst it was being created, in which
+		// case it cannot contain any records yet), so start a fresh log.
+		m_file.truncate(0);
+		write_file_header(m_file, 0);
+		m_file.sync();
+		BinaryFile::sync_directory_of(filename);
+	}
+	else
+	{
+		if(memcmp(&contents[0], LOG_MAGIC, LOG_MAGIC_SIZE) != 0)
+		{
+			throw std::runtime_error("The file " + filename + " is not a write-ahead log.");
+		}
+
+		// Find the end of the valid records, and discard anything after it.
+		size_t end = scan_records(contents, NULL, m_lastLSN);
+		if(end < contents.size())
+		{
+			m_file.truncate(end);
+			m_file.sync();
+		}
+		m_file.seek(end);
+	}
+
+	m_durableLSN = m_writtenLSN = m_lastLSN;
+}
+
+//#################### DESTRUCTOR ####################
+
+WriteAheadLog::~WriteAheadLog()
+{
+	try
+	{
+		sync();
+	}
+	catch(...) {}
+}
+
+//#################### PUBLIC METHODS ####################
+
+WriteAheadLog::LSN WriteAheadLog::append(unsigned char type, const char *payload, size_t size)
+{
+	if(size > boost::integer_traits<boost::uint32_t>::const_max)
+	{
+		throw std::invalid_argument("The payload of a log record is too large.");
+	}
+
+	boost::lock_guard<boost::mutex> lock(m_mutex);
+	check_not_failed();
+	const LSN lsn = ++m_lastLSN;
+	const boost::uint32_t payloadSize = static_cast<boost::uint32_t>(size);
+	const boost::uint32_t checksum = record_checksum(lsn, type, payload, size);
+
+	size_t offset = m_buffer.size();
+	m_buffer.resize(offset + RECORD_HEADER_SIZE + size);
+	char *record = &m_buffer[offset];
+	memcpy(record, &payloadSize, sizeof(payloadSize));
+	memcpy(record + 4, &checksum, sizeof(checksum));
+	memcpy(record + 8, &lsn, sizeof(lsn));
+	record[16] = static_cast<char>(type);
+	if(size > 0) memcpy(record + RECORD_HEADER_SIZE, payload, size);
+
+	return lsn;
+}
+
+void WriteAheadLog::commit(LSN lsn)
+{
+	boost::unique_lock<boost::mutex> lock(m_mutex);
+	check_not_failed();
+	if(lsn > m_lastLSN)
+	{
+		throw std::invalid_argument("It is not possible to commit a log record that has not been appended.");
+	}
+
+	const bool syncFile = ++m_commitsSinceSync >= m_syncInterval;
+	write_through(lock, lsn, syncFile);
+}
+
+void WriteAheadLog::discard_through(LSN lsn)
+{
+	boost::unique_lock<boost::mutex> lock(m_mutex);
+	check_not_failed();
+	if(lsn > m_durableLSN)
+	{
+		throw std::invalid_argument("Only records that are durable can be discarded from a write-ahead log.");
+	}
+
+	// Take over the log file (as if writing records to it), so that records can still be appended to the buffer
+	// whilst we replace the file, but nothing is written to it until we have finished.
+	while(m_fileBusy) m_fileIdle.wait(lock);
+	m_fileBusy = true;
+	lock.unlock();
+
+	bool replaced = false;
+	try
+	{
+		// Write the records after the specified one to a fresh log file, whose header records that everything up to
+		// the specified one has been discarded, so that the LSNs of any records appended later will still be fresh.
+		std::vector<char> contents = read_file(m_filename);
+		LSN resetLSN;
+		memcpy(&resetLSN, &contents[LOG_MAGIC_SIZE], sizeof(resetLSN));
+		const size_t offset = find_record_after(contents, lsn);
+		const size_t keptSize = contents.size() - offset;
+
+		const std::string tempFilename = m_filename + ".tmp";
+		{
+			BinaryFile file(tempFilename, true);
+			write_file_header(file, std::max(lsn, resetLSN));
+			if(keptSize > 0) file.write(&contents[offset], keptSize);
+			file.sync();
+		}
+
+		// Atomically replace the existing log file with the fresh one, and switch over to it. From this point on,
+		// the existing file is no longer the log, so if anything fails, it is no longer safe to use the log.
+		boost::filesystem::rename(tempFilename, m_filename);
+		replaced = true;
+		BinaryFile file(m_filename);
+		file.seek(FILE_HEADER_SIZE + keptSize);
+		m_file.swap(file);
+		BinaryFile::sync_directory_of(m_filename);
+	}
+	catch(...)
+	{
+		lock.lock();
+		if(replaced) m_failed = true;
+		m_fileBusy = false;
+		m_fileIdle.notify_all();
+		throw;
+	}
+
+	lock.lock();
+	m_fileBusy = false;
+	m_fileIdle.notify_all();
+}
+
+WriteAheadLog::LSN WriteAheadLog::durable_lsn() const
+{
+	boost::lock_guard<boost::mutex> lock(m_mutex);
+	return m_durableLSN;
+}
+
+WriteAheadLog::LSN WriteAheadLog::last_lsn() const
+{
+	boost::lock_guard<boost::mutex> lock(m_mutex);
+	return m_lastLSN;
+}
+
+std::vector<WriteAheadLog::Record> WriteAheadLog::read_records() const
+{
+	boost::unique_lock<boost::mutex> lock(m_mutex);
+	while(m_fileBusy) m_fileIdle.wait(lock);
+
+	std::vector<Record> records;
+	std::vector<char> contents = read_file(m_filename);
+	LSN lastLSN;
+	if(contents.size() >= FILE_HEADER_SIZE) scan_records(contents, &records, lastLSN);
+	return records;
+}
+
+void WriteAheadLog::reset()
+{
+	boost::unique_lock<boost::mutex> lock(m_mutex);
+	while(m_fileBusy) m_fileIdle.wait(lock);
+	check_not_failed();
+
+	// Record the fact that all of the records so far have been discarded before actually truncating the file,
+	// so that if we crash in between, the LSNs of any records that are appended later will still be fresh.
+	m_buffer.clear();
+	try
+	{
+		write_file_header(m_file, m_lastLSN);
+		m_file.sync();
+		m_file.truncate(FILE_HEADER_SIZE);
+		m_file.sync();
+	}
+	catch(...)
+	{
+		m_failed = true;
+		throw;
+	}
+	m_syncCount += 2;
+
+	m_commitsSinceSync = 0;
+	m_durableLSN = m_writtenLSN = m_lastLSN;
+}
+
+void WriteAheadLog::sync()
+{
+	boost::unique_lock<boost::mutex> lock(m_mutex);
+	check_not_failed();
+	write_through(lock, m_lastLSN, true);
+}
+
+boost::uint64_t WriteAheadLog::sync_count() const
+{
+	boost::lock_guard<boost::mutex> lock(m_mutex);
+	return m_syncCount;
+}
+
+//#################### PRIVATE METHODS ####################
+
+void WriteAheadLog::check_not_failed() const
+{
+	if(m_failed)
+	{
+		throw std::runtime_error("The write-ahead log " + m_filename + " cannot be used, since an earlier write to it failed.");
+	}
+}
+
+void WriteAheadLog::write_through(boost::unique_lock<boost::mutex>& lock, LSN lsn, bool syncFile)
+{
+	// Wait until either another thread has done what we need, or the file is free for us to use.
+	for(;;)
+	{
+		if(lsn <= (syncFile ? m_durableLSN : m_writtenLSN)) return;
+		check_not_failed();
+		if(!m_fileBusy) break;
+		m_fileIdle.wait(lock);
+	}
+
+	// Take all of the records appended so far (not just those we need), so that any other threads that are
+	// waiting to commit will find that we have done their work for them. New records can be appended to the
+	// (now empty) buffer whilst we write the file, and will be written by whichever thread commits next.
+	m_fileBusy = true;
+	m_writeBuffer.swap(m_buffer);
+	const LSN targetLSN = m_lastLSN;
+	if(syncFile) m_commitsSinceSync = 0;
+	lock.unlock();
+
+	try
+	{
+		if(!m_writeBuffer.empty()) m_file.write(&m_writeBuffer[0], m_writeBuffer.size());
+		if(syncFile) m_file.sync();
+	}
+	catch(...)
+	{
+		// The records may have been partly written, and if the sync failed, the kernel may have discarded the
+		// dirty pages, so a later sync could succeed without them ever reaching the disk. Rather than retrying,
+		// poison the log, so that nothing more is appended after records whose durability is unknown.
+		lock.lock();
+		m_writeBuffer.clear();
+		m_failed = true;
+		m_fileBusy = false;
+		m_fileIdle.notify_all();
+		throw;
+	}
+
+	lock.lock();
+	m_writeBuffer.clear();
+	m_writtenLSN = targetLSN;
+	if(syncFile)
+	{
+		m_durableLSN = targetLSN;
+		++m_syncCount;
+	}
+	m_fileBusy = false;
+	m_fileIdle.notify_all();
+}
+
+}
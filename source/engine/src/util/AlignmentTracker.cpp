@@ -30,15 +30,7 @@ void AlignmentTracker::advance_to_boundary(unsigned int alignment)
 
 unsigned int AlignmentTracker::max_alignment() const
 {
-	// Note: This is an egregious hack - I feel slightly unclean.
-	union helper
-	{
-		long double ld;
-		long long ll;
-		void *vp;
-	};
-
-	return sizeof(helper);
+	return sizeof(MaxAlignmentHelper);
 }
 
 unsigned int AlignmentTracker::offset() const
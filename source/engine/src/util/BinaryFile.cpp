@@ -0,0 +1,148 @@
+/**
+ * whery: BinaryFile.cpp
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#include "whery/util/BinaryFile.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <stdexcept>
+
+#include <boost/filesystem/path.hpp>
+
+#ifdef _WIN32
+	#include <fcntl.h>
+	#include <io.h>
+	#include <sys/stat.h>
+#else
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+
+namespace whery {
+
+//#################### CONSTRUCTORS ####################
+
+BinaryFile::BinaryFile(const std::string& filename, bool truncate)
+:	m_filename(filename)
+{
+#ifdef _WIN32
+	m_fd = _open(filename.c_str(), _O_RDWR | _O_CREAT | _O_BINARY | (truncate ? _O_TRUNC : 0), _S_IREAD | _S_IWRITE);
+#else
+	m_fd = open(filename.c_str(), O_RDWR | O_CREAT | (truncate ? O_TRUNC : 0), 0644);
+#endif
+
+	if(m_fd == -1)
+	{
+		throw std::runtime_error("Could not open the file " + filename + ".");
+	}
+}
+
+//#################### DESTRUCTOR ####################
+
+BinaryFile::~BinaryFile()
+{
+#ifdef _WIN32
+	_close(m_fd);
+#else
+	close(m_fd);
+#endif
+}
+
+//#################### PUBLIC STATIC METHODS ####################
+
+void BinaryFile::sync_directory_of(const std::string& filename)
+{
+#ifndef _WIN32
+	std::string directory = boost::filesystem::path(filename).parent_path().string();
+	if(directory.empty()) directory = ".";
+
+	int fd = open(directory.c_str(), O_RDONLY);
+	if(fd == -1)
+	{
+		throw std::runtime_error("Could not open the directory " + directory + ".");
+	}
+
+	int result = fsync(fd);
+	close(fd);
+	if(result != 0)
+	{
+		throw std::runtime_error("Could not sync the directory " + directory + ".");
+	}
+#endif
+}
+
+//#################### PUBLIC METHODS ####################
+
+void BinaryFile::seek(boost::uint64_t offset)
+{
+#ifdef _WIN32
+	bool succeeded = _lseeki64(m_fd, static_cast<__int64>(offset), SEEK_SET) != -1;
+#else
+	bool succeeded = lseek(m_fd, static_cast<off_t>(offset), SEEK_SET) != -1;
+#endif
+
+	if(!succeeded)
+	{
+		throw std::runtime_error("Could not seek in the file " + m_filename + ".");
+	}
+}
+
+void BinaryFile::swap(BinaryFile& rhs)
+{
+	std::swap(m_fd, rhs.m_fd);
+	m_filename.swap(rhs.m_filename);
+}
+
+void BinaryFile::sync()
+{
+#ifdef _WIN32
+	bool succeeded = _commit(m_fd) == 0;
+#else
+	bool succeeded = fsync(m_fd) == 0;
+#endif
+
+	if(!succeeded)
+	{
+		throw std::runtime_error("Could not sync the file " + m_filename + ".");
+	}
+}
+
+void BinaryFile::truncate(boost::uint64_t size)
+{
+#ifdef _WIN32
+	bool succeeded = _chsize_s(m_fd, static_cast<__int64>(size)) == 0;
+#else
+	bool succeeded = ftruncate(m_fd, static_cast<off_t>(size)) == 0;
+#endif
+
+	if(!succeeded)
+	{
+		throw std::runtime_error("Could not resize the file " + m_filename + ".");
+	}
+}
+
+void BinaryFile::write(const char *data, size_t size)
+{
+	// Note that a write may be interrupted, or may only write part of the data, so keep going until it has all been written.
+	while(size > 0)
+	{
+#ifdef _WIN32
+		int written = _write(m_fd, data, static_cast<unsigned int>(size));
+#else
+		ssize_t written = ::write(m_fd, data, size);
+#endif
+
+		if(written < 0)
+		{
+			if(errno == EINTR) continue;
+			throw std::runtime_error("Could not write to the file " + m_filename + ".");
+		}
+
+		data += written;
+		size -= static_cast<size_t>(written);
+	}
+}
+
+}
@@ -0,0 +1,212 @@
+/**
+ * whery: BitPacking.cpp
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#include "whery/util/BitPacking.h"
+
+#include <cstring>
+
+#include <boost/cstdint.hpp>
+
+#include "whery/util/SimdTarget.h"
+
+namespace whery {
+
+//#################### LOCAL CONSTANTS ####################
+
+namespace {
+
+/** The largest bit width at which every packed int can be extracted from a single (unaligned) 32-bit load. */
+const unsigned int MAX_AVX2_BIT_WIDTH = 25;
+
+}
+
+//#################### LOCAL FUNCTIONS ####################
+
+namespace {
+
+/**
+Loads the (unaligned) 64-bit word that starts at the byte containing the specified bit of a packed array.
+
+\param packed	The packed array.
+\param bit		The index of the bit.
+\return			The word, shifted so that the specified bit is its least significant bit.
+*/
+boost::uint64_t load_word(const char *packed, boost::uint64_t bit)
+{
+	boost::uint64_t word;
+	memcpy(&word, packed + (bit >> 3), sizeof(word));
+	return word >> (bit & 7);
+}
+
+/**
+Stores an offset in the bits of a packed array that start at the specified bit, leaving the other bits unchanged.
+
+\param packed	The packed array.
+\param bit		The index of the first bit at which to store the offset.
+\param bitWidth	The number of bits used to store the offset.
+\param offset	The offset (which must fit in bitWidth bits).
+*/
+void store_offset(char *packed, boost::uint64_t bit, unsigned int bitWidth, unsigned int offset)
+{
+	// As for pack_ints, the offset always fits in the 64-bit word that starts at the byte containing its first bit.
+	const unsigned int shift = static_cast<unsigned int>(bit & 7);
+	const boost::uint64_t mask = ((static_cast<boost::uint64_t>(1) << bitWidth) - 1) << shift;
+
+	boost::uint64_t word;
+	char *location = packed + (bit >> 3);
+	memcpy(&word, location, sizeof(word));
+	word = (word & ~mask) | (static_cast<boost::uint64_t>(offset) << shift);
+	memcpy(location, &word, sizeof(word));
+}
+
+/**
+Makes a mask that selects the low bits of a 32-bit value.
+
+\param bitWidth	The number of low bits to select (in the range [0,32]).
+\return			The mask.
+*/
+unsigned int low_bits_mask(unsigned int bitWidth)
+{
+	return bitWidth >= 32 ? ~0u : (1u << bitWidth) - 1;
+}
+
+#ifdef WHERY_SIMD_X86_64
+
+/**
+Unpacks the ints in a range whose start is a multiple of eight, eight at a time, using AVX2. Since eight
+packed ints occupy exactly bitWidth bytes, the byte offsets and shifts of the ints within each block of
+eight are the same for every block. This must only be called if best_simd_level() says that AVX2 is
+supported, and if bitWidth <= MAX_AVX2_BIT_WIDTH.
+
+\param packed	The packed array.
+\param begin	The index of the first int to unpack (a multiple of eight).
+\param end		The index one beyond that of the last int to unpack.
+\param base		The base relative to which the ints were packed.
+\param bitWidth	The number of bits used to store each int.
+\param values	An array into which to unpack the ints.
+\return			The index one beyond that of the last int that was unpacked (the remaining ints are left to the caller).
+*/
+WHERY_TARGET_AVX2 unsigned int unpack_blocks_avx2(const char *packed, unsigned int begin, unsigned int end, int base, unsigned int bitWidth, int *values)
+{
+	const unsigned int w = bitWidth;
+	const __m256i offsets = _mm256_setr_epi32(0, w / 8, 2 * w / 8, 3 * w / 8, 4 * w / 8, 5 * w / 8, 6 * w / 8, 7 * w / 8);
+	const __m256i shifts = _mm256_setr_epi32(0, w % 8, 2 * w % 8, 3 * w % 8, 4 * w % 8, 5 * w % 8, 6 * w % 8, 7 * w % 8);
+	const __m256i mask = _mm256_set1_epi32(static_cast<int>(low_bits_mask(w)));
+	const __m256i b = _mm256_set1_epi32(base);
+
+	unsigned int i = begin;
+	const char *block = packed + static_cast<size_t>(begin) * w / 8;
+	for(; i + 8 <= end; i += 8, block += w)
+	{
+		// The last load of a block can extend past its w bytes by up to four bytes, which the padding at the end of the packed array allows for.
+		__m256i v = _mm256_i32gather_epi32(reinterpret_cast<const int*>(block), offsets, 1);
+		v = _mm256_and_si256(_mm256_srlv_epi32(v, shifts), mask);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(values + (i - begin)), _mm256_add_epi32(v, b));
+	}
+	return i;
+}
+
+#endif
+
+}
+
+//#################### GLOBAL FUNCTIONS ####################
+
+void move_packed_ints(char *packed, unsigned int begin, unsigned int end, unsigned int dest, unsigned int bitWidth)
+{
+	if(bitWidth == 0 || begin == end || begin == dest) return;
+
+	// If the ints occupy whole bytes, they can simply be moved en masse.
+	if(bitWidth % 8 == 0)
+	{
+		const unsigned int bytes = bitWidth / 8;
+		memmove(packed + static_cast<size_t>(dest) * bytes, packed + static_cast<size_t>(begin) * bytes, static_cast<size_t>(end - begin) * bytes);
+		return;
+	}
+
+	// Otherwise, move them one at a time, in an order that ensures that no int is overwritten before it has been moved.
+	const unsigned int mask = low_bits_mask(bitWidth);
+	const unsigned int count = end - begin;
+	if(dest < begin)
+	{
+		for(unsigned int k = 0; k < count; ++k)
+		{
+			const unsigned int offset = static_cast<unsigned int>(load_word(packed, static_cast<boost::uint64_t>(begin + k) * bitWidth)) & mask;
+			store_offset(packed, static_cast<boost::uint64_t>(dest + k) * bitWidth, bitWidth, offset);
+		}
+	}
+	else
+	{
+		for(unsigned int k = count; k-- > 0;)
+		{
+			const unsigned int offset = static_cast<unsigned int>(load_word(packed, static_cast<boost::uint64_t>(begin + k) * bitWidth)) & mask;
+			store_offset(packed, static_cast<boost::uint64_t>(dest + k) * bitWidth, bitWidth, offset);
+		}
+	}
+}
+
+unsigned int packed_bit_width(unsigned int range)
+{
+	unsigned int bitWidth = 0;
+	for(; range != 0; range >>= 1) ++bitWidth;
+	return bitWidth;
+}
+
+unsigned int packed_size(unsigned int count, unsigned int bitWidth)
+{
+	return static_cast<unsigned int>((static_cast<boost::uint64_t>(count) * bitWidth + 7) / 8 + sizeof(boost::uint64_t));
+}
+
+void pack_ints(const int *values, unsigned int count, int base, unsigned int bitWidth, char *packed)
+{
+	memset(packed, 0, packed_size(count, bitWidth));
+	if(bitWidth == 0) return;
+
+	// Each offset is or'ed into the 64-bit word that starts at the byte containing its first bit. Since the offset has
+	// at most 32 bits and starts within the first byte of the word, it always fits.
+	for(unsigned int i = 0; i < count; ++i)
+	{
+		const boost::uint64_t bit = static_cast<boost::uint64_t>(i) * bitWidth;
+		const unsigned int offset = static_cast<unsigned int>(values[i]) - static_cast<unsigned int>(base);
+
+		boost::uint64_t word;
+		char *location = packed + (bit >> 3);
+		memcpy(&word, location, sizeof(word));
+		word |= static_cast<boost::uint64_t>(offset) << (bit & 7);
+		memcpy(location, &word, sizeof(word));
+	}
+}
+
+void pack_int(char *packed, unsigned int i, int base, unsigned int bitWidth, int value)
+{
+	if(bitWidth == 0) return;
+	store_offset(packed, static_cast<boost::uint64_t>(i) * bitWidth, bitWidth, static_cast<unsigned int>(value) - static_cast<unsigned int>(base));
+}
+
+int unpack_int(const char *packed, unsigned int i, int base, unsigned int bitWidth)
+{
+	const unsigned int offset = static_cast<unsigned int>(load_word(packed, static_cast<boost::uint64_t>(i) * bitWidth)) & low_bits_mask(bitWidth);
+	return static_cast<int>(static_cast<unsigned int>(base) + offset);
+}
+
+void unpack_ints(const char *packed, unsigned int begin, unsigned int end, int base, unsigned int bitWidth, int *values, SimdLevel level)
+{
+	unsigned int i = begin;
+
+#ifdef WHERY_SIMD_X86_64
+	if(level >= SIMD_AVX2 && best_simd_level() >= SIMD_AVX2 && bitWidth <= MAX_AVX2_BIT_WIDTH)
+	{
+		// Unpack the ints up to the first multiple of eight one at a time, and then unpack whole blocks of eight.
+		for(; i < end && i % 8 != 0; ++i) *values++ = unpack_int(packed, i, base, bitWidth);
+		const unsigned int blocksEnd = unpack_blocks_avx2(packed, i, end, base, bitWidth, values);
+		values += blocksEnd - i;
+		i = blocksEnd;
+	}
+#endif
+
+	for(; i < end; ++i) *values++ = unpack_int(packed, i, base, bitWidth);
+}
+
+}
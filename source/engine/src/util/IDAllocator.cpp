@@ -5,6 +5,8 @@
 
 #include "whery/util/IDAllocator.h"
 
+#include <algorithm>
+#include <functional>
 #include <stdexcept>
 
 namespace whery {
@@ -13,56 +15,60 @@ namespace whery {
 
 int IDAllocator::allocate()
 {
-	int n;
+	const int size = static_cast<int>(m_used.size());
 
-	if(!m_free.empty())
+	// Reuse the smallest deallocated ID (if any), skipping over any stale entries in the heap.
+	while(!m_free.empty())
 	{
-		n = *m_free.begin();
-		m_free.erase(m_free.begin());
-	}
-	else
-	{
-		n = static_cast<int>(m_used.size());
+		std::pop_heap(m_free.begin(), m_free.end(), std::greater<int>());
+		int n = m_free.back();
+		m_free.pop_back();
+
+		if(n < size && !m_used[n])
+		{
+			m_used[n] = true;
+			return n;
+		}
 	}
 
-	m_used.insert(n);
-	return n;
+	// If there are no deallocated IDs to reuse, the IDs in use must be exactly [0,size), so allocate the next one.
+	m_used.push_back(true);
+	return size;
 }
 
 void IDAllocator::deallocate(int n)
 {
-	std::set<int>::iterator it = m_used.find(n);
-	if(it == m_used.end())
+	if(n < 0 || n >= static_cast<int>(m_used.size()) || !m_used[n])
 	{
 		throw std::invalid_argument("The specified ID is not currently in use.");
 	}
 
-	// Note: If we get here, m_used is guaranteed to be non-empty (as it contains n).
-	if(n == *m_used.rbegin())
+	m_used[n] = false;
+
+	if(n == static_cast<int>(m_used.size()) - 1)
 	{
-		// We're removing the last element of the used set.
-		m_used.erase(it);
-		m_free.erase(m_free.upper_bound(max_used()), m_free.end());
+		// We're removing the largest ID in use, so trim it (and any unused IDs immediately below it) from the end of
+		// the bitmap. Any entries for the trimmed IDs in the heap become stale. If no IDs are left in use, all of the
+		// entries in the heap are stale, so we might as well clear it.
+		while(!m_used.empty() && !m_used.back()) m_used.pop_back();
+		if(m_used.empty()) m_free.clear();
 	}
 	else
 	{
-		m_used.erase(it);
-		m_free.insert(n);
+		m_free.push_back(n);
+		std::push_heap(m_free.begin(), m_free.end(), std::greater<int>());
 	}
 }
 
-void IDAllocator::reset()
+void IDAllocator::reserve(unsigned int n)
 {
-	m_free.clear();
-	m_used.clear();
+	m_used.reserve(n);
 }
 
-//#################### PRIVATE METHODS ####################
-
-int IDAllocator::max_used() const
+void IDAllocator::reset()
 {
-	if(m_used.empty()) return -1;
-	else return *m_used.rbegin();
+	m_free.clear();
+	m_used.clear();
 }
 
 }
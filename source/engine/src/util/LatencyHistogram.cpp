@@ -0,0 +1,148 @@
+/**
+ * whery: LatencyHistogram.cpp
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#include "whery/util/LatencyHistogram.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace whery {
+
+//#################### LOCAL FUNCTIONS ####################
+
+namespace {
+
+/**
+Gets the position of the most significant set bit of a (non-zero) value.
+
+\param value	The value.
+\return			The position of its most significant set bit (0 for the least significant bit).
+*/
+unsigned int most_significant_bit(boost::uint64_t value)
+{
+#ifdef __GNUC__
+	return 63 - __builtin_clzll(value);
+#else
+	unsigned int result = 0;
+	while(value >>= 1) ++result;
+	return result;
+#endif
+}
+
+}
+
+//#################### CONSTRUCTORS ####################
+
+LatencyHistogram::LatencyHistogram()
+:	m_bucketCounts(BUCKET_COUNT, 0), m_count(0), m_max(0), m_min(0), m_sum(0)
+{}
+
+LatencyHistogram::LatencyHistogram(const std::vector<boost::uint64_t>& bucketCounts, boost::uint64_t min, boost::uint64_t max, boost::uint64_t sum)
+:	m_bucketCounts(bucketCounts), m_count(0), m_sum(sum)
+{
+	if(bucketCounts.size() != BUCKET_COUNT)
+	{
+		throw std::invalid_argument("A latency histogram must have exactly one count for each of its buckets.");
+	}
+
+	for(size_t i = 0; i < BUCKET_COUNT; ++i) m_count += m_bucketCounts[i];
+	m_max = m_count != 0 ? max : 0;
+	m_min = m_count != 0 ? min : 0;
+}
+
+//#################### PUBLIC STATIC METHODS ####################
+
+size_t LatencyHistogram::bucket_for(boost::uint64_t value)
+{
+	if(value < SUB_BUCKET_COUNT) return static_cast<size_t>(value);
+
+	// The value lies in [2^e,2^(e+1)), which is divided into SUB_BUCKET_COUNT buckets of width 2^(e-SUB_BUCKET_BITS).
+	const unsigned int e = most_significant_bit(value);
+	const unsigned int shift = e - SUB_BUCKET_BITS;
+	const size_t subBucket = static_cast<size_t>(value >> shift) - SUB_BUCKET_COUNT;
+	return (shift + 1) * SUB_BUCKET_COUNT + subBucket;
+}
+
+boost::uint64_t LatencyHistogram::bucket_highest(size_t bucket)
+{
+	if(bucket < SUB_BUCKET_COUNT) return bucket;
+	const unsigned int shift = static_cast<unsigned int>(bucket / SUB_BUCKET_COUNT - 1);
+	return bucket_lowest(bucket) + ((boost::uint64_t(1) << shift) - 1);
+}
+
+boost::uint64_t LatencyHistogram::bucket_lowest(size_t bucket)
+{
+	if(bucket < SUB_BUCKET_COUNT) return bucket;
+	const unsigned int shift = static_cast<unsigned int>(bucket / SUB_BUCKET_COUNT - 1);
+	return boost::uint64_t(SUB_BUCKET_COUNT + bucket % SUB_BUCKET_COUNT) << shift;
+}
+
+//#################### PUBLIC METHODS ####################
+
+boost::uint64_t LatencyHistogram::count() const
+{
+	return m_count;
+}
+
+boost::uint64_t LatencyHistogram::max() const
+{
+	return m_max;
+}
+
+double LatencyHistogram::mean() const
+{
+	return m_count != 0 ? static_cast<double>(m_sum) / m_count : 0.0;
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& rhs)
+{
+	if(rhs.m_count == 0) return;
+
+	for(size_t i = 0; i < BUCKET_COUNT; ++i) m_bucketCounts[i] += rhs.m_bucketCounts[i];
+	m_max = m_count != 0 ? std::max(m_max, rhs.m_max) : rhs.m_max;
+	m_min = m_count != 0 ? std::min(m_min, rhs.m_min) : rhs.m_min;
+	m_count += rhs.m_count;
+	m_sum += rhs.m_sum;
+}
+
+boost::uint64_t LatencyHistogram::min() const
+{
+	return m_min;
+}
+
+boost::uint64_t LatencyHistogram::percentile(double p) const
+{
+	if(!(p >= 0.0 && p <= 100.0))
+	{
+		throw std::invalid_argument("A percentile must be in the range [0,100].");
+	}
+
+	if(m_count == 0) return 0;
+
+	// Find the bucket containing the value of the required rank (counting from 1).
+	boost::uint64_t rank = static_cast<boost::uint64_t>(std::ceil(p / 100.0 * m_count));
+	rank = std::max<boost::uint64_t>(rank, 1);
+
+	boost::uint64_t cumulativeCount = 0;
+	for(size_t i = 0; i < BUCKET_COUNT; ++i)
+	{
+		cumulativeCount += m_bucketCounts[i];
+		if(cumulativeCount >= rank) return std::max(m_min, std::min(bucket_highest(i), m_max));
+	}
+
+	return m_max;
+}
+
+void LatencyHistogram::record(boost::uint64_t value)
+{
+	++m_bucketCounts[bucket_for(value)];
+	m_max = m_count != 0 ? std::max(m_max, value) : value;
+	m_min = m_count != 0 ? std::min(m_min, value) : value;
+	++m_count;
+	m_sum += value;
+}
+
+}
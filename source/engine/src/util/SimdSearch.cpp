@@ -0,0 +1,294 @@
+/**
+ * whery: SimdSearch.cpp
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#include "whery/util/SimdSearch.h"
+
+#include "whery/util/SimdTarget.h"
+
+namespace whery {
+
+//#################### LOCAL CONSTANTS ####################
+
+namespace {
+
+/** The size of range below which a search stops bisecting and compares the remaining values with the key a vector at a time. */
+const unsigned int LINEAR_SEARCH_THRESHOLD = 32;
+
+}
+
+//#################### LOCAL CLASSES ####################
+
+namespace {
+
+/**
+\brief This struct provides the scalar versions of the operations used to finish off a search.
+*/
+struct ScalarKernel
+{
+	/**
+	Counts the bits that are set in the specified mask (e.g. the result of a vector comparison).
+
+	\param mask	The mask.
+	\return		The number of bits that are set.
+	*/
+	static unsigned int count_bits(unsigned int mask)
+	{
+#if defined(__GNUC__)
+		return __builtin_popcount(mask);
+#else
+		mask = mask - ((mask >> 1) & 0x55555555);
+		mask = (mask & 0x33333333) + ((mask >> 2) & 0x33333333);
+		return (((mask + (mask >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24;
+#endif
+	}
+
+	template <typename T>
+	static unsigned int count_greater(const T *values, unsigned int count, T key)
+	{
+		unsigned int result = 0;
+		for(unsigned int i = 0; i < count; ++i) result += key < values[i];
+		return result;
+	}
+
+	template <typename T>
+	static unsigned int count_less(const T *values, unsigned int count, T key)
+	{
+		unsigned int result = 0;
+		for(unsigned int i = 0; i < count; ++i) result += values[i] < key;
+		return result;
+	}
+};
+
+#ifdef WHERY_SIMD_X86_64
+
+/**
+\brief This struct provides the SSE2 versions of the operations used to finish off a search.
+*/
+struct Sse2Kernel
+{
+	static unsigned int count_greater(const double *values, unsigned int count, double key)
+	{
+		const __m128d k = _mm_set1_pd(key);
+		unsigned int i = 0, result = 0;
+		for(; i + 2 <= count; i += 2)
+		{
+			result += ScalarKernel::count_bits(_mm_movemask_pd(_mm_cmpgt_pd(_mm_loadu_pd(values + i), k)));
+		}
+		return result + ScalarKernel::count_greater(values + i, count - i, key);
+	}
+
+	static unsigned int count_greater(const int *values, unsigned int count, int key)
+	{
+		const __m128i k = _mm_set1_epi32(key);
+		unsigned int i = 0, result = 0;
+		for(; i + 4 <= count; i += 4)
+		{
+			const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i));
+			result += ScalarKernel::count_bits(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(v, k))));
+		}
+		return result + ScalarKernel::count_greater(values + i, count - i, key);
+	}
+
+	static unsigned int count_less(const double *values, unsigned int count, double key)
+	{
+		const __m128d k = _mm_set1_pd(key);
+		unsigned int i = 0, result = 0;
+		for(; i + 2 <= count; i += 2)
+		{
+			result += ScalarKernel::count_bits(_mm_movemask_pd(_mm_cmplt_pd(_mm_loadu_pd(values + i), k)));
+		}
+		return result + ScalarKernel::count_less(values + i, count - i, key);
+	}
+
+	static unsigned int count_less(const int *values, unsigned int count, int key)
+	{
+		const __m128i k = _mm_set1_epi32(key);
+		unsigned int i = 0, result = 0;
+		for(; i + 4 <= count; i += 4)
+		{
+			const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i));
+			result += ScalarKernel::count_bits(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmplt_epi32(v, k))));
+		}
+		return result + ScalarKernel::count_less(values + i, count - i, key);
+	}
+};
+
+/**
+\brief This struct provides the AVX2 versions of the operations used to finish off a search. Its functions
+are compiled for AVX2 regardless of the compiler flags, so they must only be called if best_simd_level()
+says that AVX2 is supported.
+*/
+struct Avx2Kernel
+{
+	WHERY_TARGET_AVX2 static unsigned int count_greater(const double *values, unsigned int count, double key)
+	{
+		const __m256d k = _mm256_set1_pd(key);
+		unsigned int i = 0, result = 0;
+		for(; i + 4 <= count; i += 4)
+		{
+			result += ScalarKernel::count_bits(_mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(values + i), k, _CMP_GT_OQ)));
+		}
+		return result + ScalarKernel::count_greater(values + i, count - i, key);
+	}
+
+	WHERY_TARGET_AVX2 static unsigned int count_greater(const int *values, unsigned int count, int key)
+	{
+		const __m256i k = _mm256_set1_epi32(key);
+		unsigned int i = 0, result = 0;
+		for(; i + 8 <= count; i += 8)
+		{
+			const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i));
+			result += ScalarKernel::count_bits(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(v, k))));
+		}
+		return result + ScalarKernel::count_greater(values + i, count - i, key);
+	}
+
+	WHERY_TARGET_AVX2 static unsigned int count_less(const double *values, unsigned int count, double key)
+	{
+		const __m256d k = _mm256_set1_pd(key);
+		unsigned int i = 0, result = 0;
+		for(; i + 4 <= count; i += 4)
+		{
+			result += ScalarKernel::count_bits(_mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(values + i), k, _CMP_LT_OQ)));
+		}
+		return result + ScalarKernel::count_less(values + i, count - i, key);
+	}
+
+	WHERY_TARGET_AVX2 static unsigned int count_less(const int *values, unsigned int count, int key)
+	{
+		const __m256i k = _mm256_set1_epi32(key);
+		unsigned int i = 0, result = 0;
+		for(; i + 8 <= count; i += 8)
+		{
+			const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i));
+			result += ScalarKernel::count_bits(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(k, v))));
+		}
+		return result + ScalarKernel::count_less(values + i, count - i, key);
+	}
+};
+
+#endif
+
+}
+
+//#################### LOCAL FUNCTIONS ####################
+
+namespace {
+
+/**
+Detects the best instruction set that this machine can use to search sorted arrays.
+
+\return	The best instruction set that can be used.
+*/
+SimdLevel detect_simd_level()
+{
+#if defined(WHERY_SIMD_X86_64) && defined(__GNUC__)
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") ? SIMD_AVX2 : SIMD_SSE2;
+#elif defined(WHERY_SIMD_X86_64) && defined(_MSC_VER)
+	// AVX2 needs both the processor's support (CPUID leaf 7) and the operating system's (it must save the AVX state, see XGETBV).
+	int info[4];
+	__cpuid(info, 0);
+	if(info[0] < 7) return SIMD_SSE2;
+
+	__cpuid(info, 1);
+	const bool osxsave = (info[2] & (1 << 27)) != 0;
+	if(!osxsave || (_xgetbv(0) & 6) != 6) return SIMD_SSE2;
+
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0 ? SIMD_AVX2 : SIMD_SSE2;
+#else
+	return SIMD_NONE;
+#endif
+}
+
+/**
+Finds the lower or upper bound of a key in a sorted array, by bisecting the array until the range that
+contains the bound is small enough to finish off by counting the values on the near side of the bound.
+
+\param values		The array.
+\param count		The number of values in the array.
+\param key			The key.
+\param upper		Whether to find the upper bound (true) or lower bound (false).
+\param threshold	The size of range at which to stop bisecting.
+\return				The position of the bound.
+*/
+template <typename Kernel, typename T>
+unsigned int bound(const T *values, unsigned int count, T key, bool upper, unsigned int threshold)
+{
+	unsigned int low = 0, high = count;
+	while(high - low > threshold)
+	{
+		const unsigned int mid = low + (high - low) / 2;
+		if(upper ? !(key < values[mid]) : values[mid] < key) low = mid + 1;
+		else high = mid;
+	}
+
+	// Since the array is sorted, the bound is preceded by exactly those values in the range that are less than
+	// the key (for a lower bound) or not greater than it (for an upper bound).
+	const unsigned int size = high - low;
+	return low + (upper ? size - Kernel::count_greater(values + low, size, key) : Kernel::count_less(values + low, size, key));
+}
+
+/**
+Finds the lower or upper bound of a key in a sorted array, using the specified instruction set (if available).
+
+\param values	The array.
+\param count	The number of values in the array.
+\param key		The key.
+\param upper	Whether to find the upper bound (true) or lower bound (false).
+\param level	The instruction set to use.
+\return			The position of the bound.
+*/
+template <typename T>
+unsigned int dispatch_bound(const T *values, unsigned int count, T key, bool upper, SimdLevel level)
+{
+	const SimdLevel bestLevel = best_simd_level();
+	if(level > bestLevel) level = bestLevel;
+
+	switch(level)
+	{
+#ifdef WHERY_SIMD_X86_64
+	case SIMD_AVX2:
+		return bound<Avx2Kernel>(values, count, key, upper, LINEAR_SEARCH_THRESHOLD);
+	case SIMD_SSE2:
+		return bound<Sse2Kernel>(values, count, key, upper, LINEAR_SEARCH_THRESHOLD);
+#endif
+	default:
+		return bound<ScalarKernel>(values, count, key, upper, 0);
+	}
+}
+
+}
+
+//#################### GLOBAL FUNCTIONS ####################
+
+SimdLevel best_simd_level()
+{
+	static const SimdLevel level = detect_simd_level();
+	return level;
+}
+
+unsigned int simd_lower_bound(const double *values, unsigned int count, double key, SimdLevel level)
+{
+	return dispatch_bound(values, count, key, false, level);
+}
+
+unsigned int simd_lower_bound(const int *values, unsigned int count, int key, SimdLevel level)
+{
+	return dispatch_bound(values, count, key, false, level);
+}
+
+unsigned int simd_upper_bound(const double *values, unsigned int count, double key, SimdLevel level)
+{
+	return dispatch_bound(values, count, key, true, level);
+}
+
+unsigned int simd_upper_bound(const int *values, unsigned int count, int key, SimdLevel level)
+{
+	return dispatch_bound(values, count, key, true, level);
+}
+
+}
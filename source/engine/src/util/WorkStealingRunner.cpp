@@ -0,0 +1,187 @@
+/**
+ * whery: WorkStealingRunner.cpp
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#include "whery/util/WorkStealingRunner.h"
+
+#include <algorithm>
+#include <deque>
+#include <stdexcept>
+
+#include <boost/atomic.hpp>
+#include <boost/bind.hpp>
+#include <boost/exception_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+namespace whery {
+
+//#################### LOCAL TYPES ####################
+
+namespace {
+
+/**
+\brief An instance of this struct holds the indices of the tasks that remain to be run by a single thread.
+*/
+struct TaskQueue
+{
+	/** The indices of the tasks. */
+	std::deque<size_t> indices;
+
+	/** The mutex used to synchronise access to the indices (the thread that owns them may be robbed). */
+	boost::mutex mutex;
+};
+
+typedef boost::shared_ptr<TaskQueue> TaskQueue_Ptr;
+
+/**
+\brief An instance of this struct holds the state shared by the threads that are running a batch of tasks.
+*/
+struct Batch
+{
+	/** The first exception thrown by any of the tasks (if any). */
+	boost::exception_ptr error;
+
+	/** The mutex used to synchronise access to the error. */
+	boost::mutex errorMutex;
+
+	/** Whether or not any of the tasks has thrown an exception (in which case no more tasks should be started). */
+	boost::atomic<bool> failed;
+
+	/** The task queues of the threads. */
+	std::vector<TaskQueue_Ptr> queues;
+
+	/** The tasks. */
+	const std::vector<WorkStealingRunner::Task> *tasks;
+};
+
+}
+
+//#################### LOCAL FUNCTIONS ####################
+
+namespace {
+
+/**
+Takes the index of the next task to be run by a thread, first from the front of the thread's own queue,
+and then (if that is empty) from the back of each other thread's queue in turn.
+
+\param batch	The batch.
+\param self		The index of the thread.
+\param index	Used to return the index of the task.
+\return			true, if a task was found, or false if there are no more tasks to run.
+*/
+bool take_task(Batch& batch, size_t self, size_t& index)
+{
+	const size_t threadCount = batch.queues.size();
+	for(size_t i = 0; i < threadCount; ++i)
+	{
+		TaskQueue& queue = *batch.queues[(self + i) % threadCount];
+		boost::lock_guard<boost::mutex> lock(queue.mutex);
+		if(queue.indices.empty()) continue;
+
+		if(i == 0)
+		{
+			index = queue.indices.front();
+			queue.indices.pop_front();
+		}
+		else
+		{
+			index = queue.indices.back();
+			queue.indices.pop_back();
+		}
+		return true;
+	}
+	return false;
+}
+
+/**
+Runs tasks from a batch on a thread until there are none left (or one of them has failed).
+
+\param batch	The batch.
+\param self		The index of the thread.
+*/
+void run_tasks(Batch& batch, size_t self)
+{
+	size_t index;
+	while(!batch.failed && take_task(batch, self, index))
+	{
+		try
+		{
+			(*batch.tasks)[index]();
+		}
+		catch(...)
+		{
+			boost::lock_guard<boost::mutex> lock(batch.errorMutex);
+			if(!batch.failed)
+			{
+				batch.error = boost::current_exception();
+				batch.failed = true;
+			}
+		}
+	}
+}
+
+}
+
+//#################### CONSTRUCTORS ####################
+
+WorkStealingRunner::WorkStealingRunner(unsigned int threadCount)
+:	m_threadCount(threadCount)
+{
+	if(threadCount == 0) throw std::invalid_argument("A work-stealing runner must have at least one thread.");
+}
+
+//#################### PUBLIC METHODS ####################
+
+void WorkStealingRunner::run(const std::vector<Task>& tasks) const
+{
+	const size_t taskCount = tasks.size();
+	const size_t threadCount = std::min<size_t>(m_threadCount, taskCount);
+	if(threadCount == 0) return;
+
+	// Divide the tasks between the threads in contiguous blocks.
+	Batch batch;
+	batch.failed = false;
+	batch.tasks = &tasks;
+	for(size_t i = 0; i < threadCount; ++i)
+	{
+		TaskQueue_Ptr queue(new TaskQueue);
+		for(size_t j = i * taskCount / threadCount, end = (i + 1) * taskCount / threadCount; j < end; ++j)
+		{
+			queue->indices.push_back(j);
+		}
+		batch.queues.push_back(queue);
+	}
+
+	// Run the tasks, using the calling thread as the first of the threads.
+	boost::thread_group threads;
+	try
+	{
+		for(size_t i = 1; i < threadCount; ++i)
+		{
+			threads.create_thread(boost::bind(&run_tasks, boost::ref(batch), i));
+		}
+	}
+	catch(...)
+	{
+		// The threads that have already started refer to the batch, so stop them and wait for them to finish
+		// before the batch goes out of scope.
+		batch.failed = true;
+		threads.join_all();
+		throw;
+	}
+	run_tasks(batch, 0);
+	threads.join_all();
+
+	if(batch.error) boost::rethrow_exception(batch.error);
+}
+
+unsigned int WorkStealingRunner::thread_count() const
+{
+	return m_threadCount;
+}
+
+}
@@ -5,8 +5,16 @@
 
 #include <boost/test/unit_test.hpp>
 
+#include <algorithm>
+#include <climits>
+#include <map>
+#include <set>
+#include <sstream>
+
 #include <boost/algorithm/clamp.hpp>
 #include <boost/assign/list_of.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
 using namespace boost::assign;
 
 #include "whery/db/base/DoubleFieldManipulator.h"
@@ -18,40 +26,10 @@ using namespace boost::assign;
 using namespace whery;
 
 #include "Constants.h"
+#include "TestPageController.h"
 
 //#################### HELPER CLASSES ####################
 
-class TestPageController : public BTreePageController
-{
-	//#################### PRIVATE VARIABLES ####################
-private:
-	/** The number of tuples that should fit on a B+-tree branch page. */
-	const int m_tuplesPerBranch;
-
-	/** The number of tuples that should fit on a B+-tree leaf page. */
-	const int m_tuplesPerLeaf;
-
-	//#################### CONSTRUCTORS ####################
-public:
-	TestPageController(int tuplesPerBranch, int tuplesPerLeaf)
-	:	m_tuplesPerBranch(tuplesPerBranch), m_tuplesPerLeaf(tuplesPerLeaf)
-	{}
-
-	//#################### PUBLIC INHERITED METHODS ####################
-public:
-	virtual SortedPage_Ptr make_btree_branch_page() const
-	{
-		TupleManipulator tupleManipulator = btree_branch_tuple_manipulator();
-		return SortedPage_Ptr(new InMemorySortedPage(tupleManipulator.size() * m_tuplesPerBranch, tupleManipulator));
-	}
-
-	virtual SortedPage_Ptr make_btree_leaf_page() const
-	{
-		TupleManipulator tupleManipulator = btree_leaf_tuple_manipulator();
-		return SortedPage_Ptr(new InMemorySortedPage(tupleManipulator.size() * m_tuplesPerLeaf, tupleManipulator));
-	}
-};
-
 /**
 An instance of this class provides page support to a primary B+-tree
 with leaf tuples of the form <tuple ID,x,y> and branch tuples of the
@@ -63,27 +41,18 @@ class PrimaryTestPageController : public TestPageController
 	//#################### CONSTRUCTORS ####################
 public:
 	PrimaryTestPageController(int tuplesPerBranch, int tuplesPerLeaf)
-	:	TestPageController(tuplesPerBranch, tuplesPerLeaf)
+	:	TestPageController(PT_IN_MEMORY, tuplesPerBranch, tuplesPerLeaf,
+			TupleManipulator(list_of<const FieldManipulator*>
+				(&IntFieldManipulator::instance())
+				(&IntFieldManipulator::instance())
+			),
+			TupleManipulator(list_of<const FieldManipulator*>
+				(&IntFieldManipulator::instance())
+				(&DoubleFieldManipulator::instance())
+				(&DoubleFieldManipulator::instance())
+			)
+		)
 	{}
-
-	//#################### PUBLIC INHERITED METHODS ####################
-public:
-	virtual TupleManipulator btree_branch_tuple_manipulator() const
-	{
-		return TupleManipulator(list_of<const FieldManipulator*>
-			(&IntFieldManipulator::instance())
-			(&IntFieldManipulator::instance())
-		);
-	}
-
-	virtual TupleManipulator btree_leaf_tuple_manipulator() const
-	{
-		return TupleManipulator(list_of<const FieldManipulator*>
-			(&IntFieldManipulator::instance())
-			(&DoubleFieldManipulator::instance())
-			(&DoubleFieldManipulator::instance())
-		);
-	}
 };
 
 /**
@@ -99,26 +68,50 @@ class SecondaryTestPageController : public TestPageController
 	//#################### CONSTRUCTORS ####################
 public:
 	SecondaryTestPageController(int tuplesPerBranch, int tuplesPerLeaf)
-	:	TestPageController(tuplesPerBranch, tuplesPerLeaf)
+	:	TestPageController(PT_IN_MEMORY, tuplesPerBranch, tuplesPerLeaf,
+			TupleManipulator(list_of<const FieldManipulator*>
+				(&DoubleFieldManipulator::instance())
+				(&IntFieldManipulator::instance())
+				(&IntFieldManipulator::instance())
+			),
+			TupleManipulator(list_of<const FieldManipulator*>
+				(&DoubleFieldManipulator::instance())
+				(&IntFieldManipulator::instance())
+			)
+		)
 	{}
+};
+
+/**
+An instance of this class records the tuple IDs in each of the runs passed to it by a parallel scan
+of a primary B+-tree (it may be called from several threads at once).
+*/
+class RunRecorder
+{
+	//#################### PRIVATE VARIABLES ####################
+private:
+	/** The mutex used to synchronise access to the runs. */
+	boost::mutex m_mutex;
+
+	/** The tuple IDs in each run (in the order in which the runs were recorded). */
+	std::vector<std::vector<int> > m_runs;
 
-	//#################### PUBLIC INHERITED METHODS ####################
+	//#################### PUBLIC OPERATORS ####################
 public:
-	virtual TupleManipulator btree_branch_tuple_manipulator() const
+	void operator()(const BTree::ConstIterator& begin, const BTree::ConstIterator& end)
 	{
-		return TupleManipulator(list_of<const FieldManipulator*>
-			(&DoubleFieldManipulator::instance())
-			(&IntFieldManipulator::instance())
-			(&IntFieldManipulator::instance())
-		);
+		std::vector<int> run;
+		for(BTree::ConstIterator it = begin; it != end; ++it) run.push_back(it->field(0).get_int());
+
+		boost::lock_guard<boost::mutex> lock(m_mutex);
+		m_runs.push_back(run);
 	}
 
-	virtual TupleManipulator btree_leaf_tuple_manipulator() const
+	//#################### PUBLIC METHODS ####################
+public:
+	const std::vector<std::vector<int> >& runs() const
 	{
-		return TupleManipulator(list_of<const FieldManipulator*>
-			(&DoubleFieldManipulator::instance())
-			(&IntFieldManipulator::instance())
-		);
+		return m_runs;
 	}
 };
 
@@ -155,10 +148,328 @@ std::pair<BTree_Ptr,BTree_Ptr> make_trees()
 	return std::make_pair(primaryTree, secondaryTree);
 }
 
+/**
+Counts the leaves of a B+-tree, i.e. the nodes on the deepest level of its printed form.
+
+\param tree	The B+-tree.
+\return		The number of leaves in the B+-tree.
+*/
+int leaf_count(const BTree& tree)
+{
+	std::ostringstream os;
+	tree.print(os);
+
+	std::map<size_t,int> nodeCounts;
+	std::istringstream is(os.str());
+	std::string line;
+	while(std::getline(is, line))
+	{
+		size_t depth = line.find_first_not_of('\t');
+		if(line.compare(depth, 5, "Node:") == 0) ++nodeCounts[depth];
+	}
+
+	return nodeCounts.empty() ? 0 : nodeCounts.rbegin()->second;
+}
+
+/**
+\brief An instance of this struct summarises a node in the printed form of a B+-tree (see min_leaf_tuple_count).
+*/
+struct NodeSummary
+{
+	size_t depth;
+	bool hasRightSibling;
+	int tupleCount;
+};
+
+/**
+Finds the smallest number of tuples held by any leaf of a B+-tree other than the root and the last leaf (which a split
+biased towards appends may leave with few tuples), by parsing the printed form of the B+-tree.
+
+\param tree	The B+-tree.
+\return		The smallest number of tuples held by such a leaf (or INT_MAX, if there are none).
+*/
+int min_leaf_tuple_count(const BTree& tree)
+{
+	std::ostringstream os;
+	tree.print(os);
+
+	// Note the depth and tuple count of each node, and whether or not it has a right sibling.
+	std::vector<NodeSummary> nodes;
+	size_t leafDepth = 0;
+	std::istringstream is(os.str());
+	std::string line;
+	while(std::getline(is, line))
+	{
+		size_t depth = line.find_first_not_of('\t');
+		if(line.compare(depth, 5, "Node:") == 0)
+		{
+			NodeSummary node = { depth, false, 0 };
+			nodes.push_back(node);
+			leafDepth = std::max(leafDepth, depth);
+		}
+		else if(line.compare(depth, 14, "Right Sibling:") == 0) nodes.back().hasRightSibling = line.compare(depth, 17, "Right Sibling: -1") != 0;
+		else if(line.compare(depth, 6, "Tuple(") == 0) ++nodes.back().tupleCount;
+	}
+
+	int result = INT_MAX;
+	for(size_t i = 0, size = nodes.size(); i < size; ++i)
+	{
+		if(nodes[i].depth == leafDepth && nodes[i].depth > 0 && nodes[i].hasRightSibling) result = std::min(result, nodes[i].tupleCount);
+	}
+	return result;
+}
+
+/**
+Makes a set of sorted pages containing primary B+-tree leaf tuples of the form <i,i*i,i*i*i>, for i in [0,n).
+
+\param tree			The B+-tree for which the pages are intended.
+\param n				The number of tuples to put on the pages.
+\param tuplesPerPage	The maximum number of tuples to put on each page.
+\return				The pages.
+*/
+std::vector<SortedPage_Ptr> make_bulk_load_pages(const BTree& tree, int n, int tuplesPerPage)
+{
+	TupleManipulator tupleManipulator = tree.leaf_tuple_manipulator();
+	std::vector<SortedPage_Ptr> pages;
+
+	FreshTuple tuple(tupleManipulator);
+	for(int i = 0; i < n; ++i)
+	{
+		if(i % tuplesPerPage == 0)
+		{
+			pages.push_back(SortedPage_Ptr(new InMemorySortedPage(InMemorySortedPage::buffer_size_for(tuplesPerPage, tupleManipulator), tupleManipulator)));
+
+			// Add an empty page every so often to check that empty pages are skipped correctly.
+			if(pages.size() % 3 == 0)
+			{
+				pages.push_back(SortedPage_Ptr(new InMemorySortedPage(InMemorySortedPage::buffer_size_for(tuplesPerPage, tupleManipulator), tupleManipulator)));
+			}
+		}
+
+		tuple.field(0).set_int(i);
+		tuple.field(1).set_double(i * i);
+		tuple.field(2).set_double(i * i * i);
+		pages.back()->add_tuple(tuple);
+	}
+
+	return pages;
+}
+
+/**
+Checks that the order statistics of a counted primary B+-tree match those of the expected set of tuple IDs.
+
+\param tree		The B+-tree.
+\param expected	The tuple IDs of the tuples that the B+-tree is expected to contain.
+\param n			An upper bound on the tuple IDs, used to choose the keys and ranges to check.
+*/
+void check_order_statistics(const BTree& tree, const std::set<int>& expected, int n)
+{
+	// Check that each rank selects the expected tuple.
+	unsigned int k = 0;
+	for(std::set<int>::const_iterator it = expected.begin(), iend = expected.end(); it != iend; ++it, ++k)
+	{
+		BTree::ConstIterator jt = tree.select(k);
+		BOOST_REQUIRE(jt != tree.end());
+		BOOST_CHECK_EQUAL(jt->field(0).get_int(), *it);
+	}
+	BOOST_CHECK(tree.select(k) == tree.end());
+
+	// Check the ranks of keys both in and between the tuples (and beyond either end).
+	ValueKey valueKey(tree.leaf_tuple_manipulator(), list_of(0));
+	for(int x = -1; x <= n; ++x)
+	{
+		valueKey.field(0).set_int(x);
+		BOOST_CHECK_EQUAL(tree.rank(valueKey), std::distance(expected.begin(), expected.lower_bound(x)));
+	}
+
+	// Check the counts of a selection of ranges, with both open and closed (and missing) endpoints.
+	RangeEndpointKind kinds[] = { CLOSED, OPEN };
+	RangeKey rangeKey(tree.leaf_tuple_manipulator().field_manipulators(), list_of(0));
+	for(int low = -2; low <= n + 1; low += 5)
+	{
+		for(int high = low - 1; high <= n + 1; high += 7)
+		{
+			for(int i = 0; i < 4; ++i)
+			{
+				rangeKey.low_value().field(0).set_int(low);
+				rangeKey.high_value().field(0).set_int(high);
+				rangeKey.low_kind() = kinds[i % 2];
+				rangeKey.high_kind() = kinds[i / 2];
+				if(low < 0) rangeKey.clear_low_endpoint();
+				if(high > n) rangeKey.clear_high_endpoint();
+
+				unsigned int count = 0;
+				for(std::set<int>::const_iterator it = expected.begin(), iend = expected.end(); it != iend; ++it)
+				{
+					bool aboveLow = !rangeKey.has_low_endpoint() || *it > low || (*it == low && rangeKey.low_kind() == CLOSED);
+					bool belowHigh = !rangeKey.has_high_endpoint() || *it < high || (*it == high && rangeKey.high_kind() == CLOSED);
+					if(aboveLow && belowHigh) ++count;
+				}
+				if(!rangeKey.is_valid()) count = 0;
+
+				BOOST_CHECK_EQUAL(tree.count(rangeKey), count);
+			}
+		}
+	}
+}
+
 //#################### TESTS ####################
 
 BOOST_AUTO_TEST_SUITE(BTreeTest)
 
+BOOST_AUTO_TEST_CASE(append)
+{
+	const int N = 200;
+	for(int counted = 0; counted < 2; ++counted)
+	{
+		// Insert tuples with increasing IDs, all of which are appended to the end of the B+-tree.
+		BTree tree(BTreePageController_CPtr(new PrimaryTestPageController(4, 10)), false, counted == 1);
+		std::set<int> expected;
+		FreshTuple tuple(tree.leaf_tuple_manipulator());
+		for(int i = 0; i < N; ++i)
+		{
+			tuple.field(0).set_int(i);
+			tuple.field(1).set_double(i * i);
+			tuple.field(2).set_double(i * i * i);
+			tree.insert_tuple(tuple);
+			expected.insert(i);
+		}
+		BOOST_CHECK_EQUAL(tree.tuple_count(), N);
+
+		// The splits should have been biased to the right, leaving 9 tuples in each leaf but the last (which has the other 2).
+		BOOST_CHECK_EQUAL(leaf_count(tree), 23);
+
+		int i = 0;
+		for(BTree::ConstIterator it = tree.begin(), iend = tree.end(); it != iend; ++it, ++i)
+		{
+			BOOST_CHECK_EQUAL(it->field(0).get_int(), i);
+		}
+		BOOST_CHECK_EQUAL(i, N);
+		if(tree.is_counted()) check_order_statistics(tree, expected, N);
+
+		// Erase the tuples in a scattered order, starting with the last one (in the sparsely-populated last leaf),
+		// to check that erasures cope with the nodes left with fewer than the usual minimum number of tuples.
+		ValueKey key(tree.leaf_tuple_manipulator(), list_of(0));
+		for(int j = 0; j < N; ++j)
+		{
+			const int x = (N - 1 + j * 163) % N;
+			key.field(0).set_int(x);
+			tree.erase_tuple(key);
+			expected.erase(x);
+			BOOST_CHECK_EQUAL(tree.tuple_count(), N - j - 1);
+			if(tree.is_counted() && j % 20 == 0) check_order_statistics(tree, expected, N);
+		}
+		BOOST_CHECK(tree.begin() == tree.end());
+	}
+}
+
+BOOST_AUTO_TEST_CASE(append_then_erase)
+{
+	// Build trees of every size up to a few branch splits by appending, so that each tree's last leaf (and, for
+	// some of the sizes, its last branch) has only just been made by a biased split and is still far below the
+	// usual minimum size. Then erase tuples from the end, starting with the ones in those nodes, and check that
+	// each point erase leaves the tree intact.
+	for(int counted = 0; counted < 2; ++counted)
+	{
+		for(int n = 11; n <= 60; ++n)
+		{
+			BTree tree(BTreePageController_CPtr(new PrimaryTestPageController(4, 10)), false, counted == 1);
+			std::set<int> expected;
+			FreshTuple tuple(tree.leaf_tuple_manipulator());
+			for(int i = 0; i < n; ++i)
+			{
+				tuple.field(0).set_int(i);
+				tuple.field(1).set_double(i);
+				tuple.field(2).set_double(i);
+				tree.insert_tuple(tuple);
+				expected.insert(i);
+			}
+
+			ValueKey key(tree.leaf_tuple_manipulator(), list_of(0));
+			for(int x = n - 1; x >= std::max(0, n - 12); --x)
+			{
+				key.field(0).set_int(x);
+				tree.erase_tuple(key);
+				expected.erase(x);
+				BOOST_REQUIRE_EQUAL(tree.tuple_count(), x);
+
+				int i = 0;
+				for(BTree::ConstIterator it = tree.begin(), iend = tree.end(); it != iend; ++it, ++i)
+				{
+					BOOST_REQUIRE_EQUAL(it->field(0).get_int(), i);
+				}
+				BOOST_REQUIRE_EQUAL(i, x);
+
+				for(int y = 0; y < x; ++y)
+				{
+					key.field(0).set_int(y);
+					BOOST_REQUIRE(tree.find(key) != tree.end());
+				}
+				if(tree.is_counted()) check_order_statistics(tree, expected, n);
+			}
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE(batch_cursor)
+{
+	const int N = 100;
+	BTree tree(BTreePageController_CPtr(new PrimaryTestPageController(4, 5)));
+	FreshTuple tuple(tree.leaf_tuple_manipulator());
+	for(int i = 0; i < N; ++i)
+	{
+		const int x = (i * 37) % N;
+		tuple.field(0).set_int(x);
+		tuple.field(1).set_double(x * 0.5);
+		tuple.field(2).set_double(-x);
+		tree.insert_tuple(tuple);
+	}
+
+	const int lows[] = { -1, 0, 17, 50, 50, 200 };
+	const int highs[] = { N, 3, 83, 50, 51, 300 };
+	RangeKey key(tree.leaf_tuple_manipulator().field_manipulators(), list_of(0));
+	for(size_t i = 0; i < sizeof(lows) / sizeof(int); ++i)
+	{
+		// Traverse the range [low,high) a batch at a time, and check that the batches together contain exactly the tuples in it.
+		key.low_value().field(0).set_int(lows[i]);
+		key.high_value().field(0).set_int(highs[i]);
+		key.low_kind() = CLOSED;
+		key.high_kind() = OPEN;
+		BTree::EqualRangeResult range = tree.equal_range(key);
+		BTree::BatchCursor cursor(range.first, range.second);
+		BOOST_CHECK_EQUAL(cursor.size(), 0);
+
+		int expected = std::max(lows[i], 0);
+		std::vector<int> ids;
+		std::vector<double> xs, idsAsDoubles;
+		while(cursor.next())
+		{
+			// Each batch should come from a single leaf.
+			BOOST_CHECK(cursor.size() > 0 && cursor.size() <= 5);
+
+			cursor.read_ints(0, ids);
+			cursor.read_doubles(1, xs);
+			cursor.read_doubles(0, idsAsDoubles);
+			BOOST_REQUIRE_EQUAL(ids.size(), cursor.size());
+			for(unsigned int j = 0; j < cursor.size(); ++j, ++expected)
+			{
+				BOOST_CHECK_EQUAL(ids[j], expected);
+				BOOST_CHECK_EQUAL(xs[j], expected * 0.5);
+				BOOST_CHECK_EQUAL(idsAsDoubles[j], expected);
+				BOOST_CHECK_EQUAL(cursor.tuple_manipulator().field(const_cast<char*>(cursor.location(j)), 2).get_double(), -expected);
+			}
+		}
+		BOOST_CHECK_EQUAL(expected, std::max(std::min(highs[i], N), std::max(lows[i], 0)));
+		BOOST_CHECK_EQUAL(cursor.size(), 0);
+		BOOST_CHECK(cursor.locations() == NULL);
+	}
+
+	// A cursor over an empty B+-tree should yield no batches.
+	BTree emptyTree(primaryController_2_2);
+	BTree::BatchCursor emptyCursor(emptyTree.begin(), emptyTree.end());
+	BOOST_CHECK(!emptyCursor.next());
+}
+
 BOOST_AUTO_TEST_CASE(begin_end)
 {
 	BTree tree(primaryController_2_2);
@@ -191,6 +502,78 @@ BOOST_AUTO_TEST_CASE(begin_end)
 	BOOST_REQUIRE(tree.begin() == tree.end());
 }
 
+BOOST_AUTO_TEST_CASE(bulk_load)
+{
+	double fillFactors[] = {0.25, 0.5, 0.75, 1.0};
+	int fillFactorCount = sizeof(fillFactors) / sizeof(double);
+
+	for(int f = 0; f < fillFactorCount; ++f)
+	{
+		for(int n = 0; n <= 40; ++n)
+		{
+			BTree tree(primaryController_2_2);
+			tree.bulk_load(make_bulk_load_pages(tree, n, 3), fillFactors[f]);
+			BOOST_CHECK_EQUAL(tree.tuple_count(), n);
+
+			// Check that the B+-tree contains the right tuples, in the right order.
+			int i = 0;
+			for(BTree::ConstIterator it = tree.begin(), iend = tree.end(); it != iend; ++it, ++i)
+			{
+				BOOST_CHECK_EQUAL(it->field(0).get_int(), i);
+				BOOST_CHECK_CLOSE(it->field(1).get_double(), i * i, Constants::SMALL_EPSILON);
+			}
+			BOOST_CHECK_EQUAL(i, n);
+
+			// Check that each tuple can be found by searching the B+-tree.
+			ValueKey key(tree.leaf_tuple_manipulator(), list_of(0));
+			for(int j = -1; j <= n; ++j)
+			{
+				key.field(0).set_int(j);
+				BTree::ConstIterator it = tree.find(key);
+				if(j >= 0 && j < n)
+				{
+					BOOST_REQUIRE(it != tree.end());
+					BOOST_CHECK_EQUAL(it->field(0).get_int(), j);
+				}
+				else BOOST_CHECK_MESSAGE(it == tree.end(), "check it == tree.end() failed");
+			}
+
+			// Check that the bulk-loaded B+-tree can be updated normally afterwards.
+			FreshTuple tuple(tree.leaf_tuple_manipulator());
+			tuple.field(0).set_int(n);
+			tuple.field(1).set_double(n * n);
+			tuple.field(2).set_double(n * n * n);
+			tree.insert_tuple(tuple);
+			BOOST_CHECK_EQUAL(tree.tuple_count(), n + 1);
+			BOOST_CHECK_EQUAL((--tree.end())->field(0).get_int(), n);
+
+			for(int j = 0; j <= n; ++j)
+			{
+				key.field(0).set_int(j);
+				tree.erase_tuple(key);
+				BOOST_CHECK_EQUAL(tree.tuple_count(), n - j);
+				if(j < n) BOOST_CHECK_EQUAL(tree.begin()->field(0).get_int(), j + 1);
+			}
+			BOOST_CHECK(tree.begin() == tree.end());
+		}
+	}
+
+	// Check that bulk loading into a non-empty B+-tree fails.
+	BTree_Ptr tree;
+	boost::tie(tree, boost::tuples::ignore) = make_trees();
+	BOOST_CHECK_THROW(tree->bulk_load(make_bulk_load_pages(*tree, 5, 3)), std::logic_error);
+
+	// Check that bulk loading pages that are not sorted with respect to each other fails.
+	BTree unsortedTree(primaryController_2_2);
+	std::vector<SortedPage_Ptr> pages = make_bulk_load_pages(unsortedTree, 9, 3);
+	std::swap(pages.front(), pages.back());
+	BOOST_CHECK_THROW(unsortedTree.bulk_load(pages), std::invalid_argument);
+
+	// Check that invalid fill factors are rejected.
+	BOOST_CHECK_THROW(unsortedTree.bulk_load(make_bulk_load_pages(unsortedTree, 5, 3), 0.0), std::invalid_argument);
+	BOOST_CHECK_THROW(unsortedTree.bulk_load(make_bulk_load_pages(unsortedTree, 5, 3), 1.5), std::invalid_argument);
+}
+
 BOOST_AUTO_TEST_CASE(constructor)
 {
 	BTree tree(primaryController_2_2);
@@ -308,6 +691,149 @@ BOOST_AUTO_TEST_CASE(equal_range_valuekey)
 	}
 }
 
+BOOST_AUTO_TEST_CASE(erase_via_right_sibling)
+{
+	// Regression test for erasing a tuple that is the first in its leaf, when that leaf is reached by hopping to the
+	// right sibling of the leaf found by descending from the root, and has a different parent. Any merge that the
+	// erasure triggers one level up must then be done on the leaf's own parent, rather than on the node that the
+	// descent passed through. Several erase orders are used, so that the hop happens at various heights.
+	const int N = 101;
+	const int multipliers[] = {17, 53, 89};
+	for(size_t m = 0; m < sizeof(multipliers) / sizeof(int); ++m)
+	{
+		BTree tree(primaryController_2_2);
+		std::set<int> currentTuples;
+
+		FreshTuple tuple(tree.leaf_tuple_manipulator());
+		for(int i = 0; i < N; ++i)
+		{
+			const int x = (i * 37) % N;
+			tuple.field(0).set_int(x);
+			tuple.field(1).set_double(x);
+			tuple.field(2).set_double(x);
+			tree.insert_tuple(tuple);
+			currentTuples.insert(x);
+		}
+
+		// Check that the set of tuples is as expected after each erasure.
+		ValueKey key(tree.leaf_tuple_manipulator(), list_of(0));
+		for(int i = 0; i < N; ++i)
+		{
+			const int x = (i * multipliers[m]) % N;
+			key.field(0).set_int(x);
+			tree.erase_tuple(key);
+			currentTuples.erase(x);
+
+			BOOST_REQUIRE_EQUAL(tree.tuple_count(), currentTuples.size());
+			std::set<int>::const_iterator kt = currentTuples.begin();
+			for(BTree::ConstIterator jt = tree.begin(), jend = tree.end(); jt != jend; ++jt, ++kt)
+			{
+				BOOST_REQUIRE_EQUAL(jt->field(0).get_int(), *kt);
+			}
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE(erase_tuples_rangekey)
+{
+	const int N = 40;
+	BTreePageController_CPtr controllers[] = { primaryController_2_2, BTreePageController_CPtr(new PrimaryTestPageController(4, 5)) };
+	RangeEndpointKind kinds[] = { CLOSED, OPEN };
+
+	for(size_t c = 0; c < sizeof(controllers) / sizeof(BTreePageController_CPtr); ++c)
+	{
+		for(int low = -2; low <= N + 1; low += 3)
+		{
+			for(int high = low; high <= N + 1; high += 4)
+			{
+				for(int k = 0; k < 4; ++k)
+				{
+					// Fill a B+-tree with the tuples <x,x*x,x*x*x> for each x in [0,N), inserted in a scattered order.
+					BTree tree(controllers[c]);
+					FreshTuple tuple(tree.leaf_tuple_manipulator());
+					for(int i = 0; i < N; ++i)
+					{
+						const int x = (i * 17) % N;
+						tuple.field(0).set_int(x);
+						tuple.field(1).set_double(x * x);
+						tuple.field(2).set_double(x * x * x);
+						tree.insert_tuple(tuple);
+					}
+
+					// Erase a range of tuples (sometimes leaving off one of the endpoints).
+					RangeKey key(tree.leaf_tuple_manipulator().field_manipulators(), list_of(0));
+					key.low_value().field(0).set_int(low);
+					key.high_value().field(0).set_int(high);
+					key.low_kind() = kinds[k % 2];
+					key.high_kind() = kinds[k / 2];
+					if(low < 0) key.clear_low_endpoint();
+					if(high > N) key.clear_high_endpoint();
+					tree.erase_tuples(key);
+
+					std::set<int> expected;
+					for(int x = 0; x < N; ++x)
+					{
+						bool aboveLow = !key.has_low_endpoint() || x > low || (x == low && key.low_kind() == CLOSED);
+						bool belowHigh = !key.has_high_endpoint() || x < high || (x == high && key.high_kind() == CLOSED);
+						if(!key.is_valid() || !(aboveLow && belowHigh)) expected.insert(x);
+					}
+
+					// Check that exactly the expected tuples remain, and that each of them can still be found.
+					BOOST_REQUIRE_EQUAL(tree.tuple_count(), expected.size());
+					std::set<int>::const_iterator et = expected.begin();
+					for(BTree::ConstIterator it = tree.begin(), iend = tree.end(); it != iend; ++it, ++et)
+					{
+						BOOST_REQUIRE(et != expected.end());
+						BOOST_CHECK_EQUAL(it->field(0).get_int(), *et);
+					}
+					BOOST_CHECK(et == expected.end());
+
+					// Check that the B+-tree is still well-formed by inserting some more tuples and then erasing
+					// everything one tuple at a time (the single-tuple algorithms rely on the B+-tree's invariants).
+					for(int x = N; x < N + 5; ++x)
+					{
+						tuple.field(0).set_int(x);
+						tree.insert_tuple(tuple);
+						expected.insert(x);
+					}
+
+					ValueKey valueKey(tree.leaf_tuple_manipulator(), list_of(0));
+					for(std::set<int>::const_iterator jt = expected.begin(), jend = expected.end(); jt != jend; ++jt)
+					{
+						valueKey.field(0).set_int(*jt);
+						BOOST_CHECK(tree.find(valueKey) != tree.end());
+						tree.erase_tuple(valueKey);
+					}
+					BOOST_CHECK_EQUAL(tree.tuple_count(), 0);
+					BOOST_CHECK(tree.begin() == tree.end());
+				}
+			}
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE(erase_tuples_valuekey)
+{
+	BTree_Ptr secondaryTree;
+	boost::tie(boost::tuples::ignore, secondaryTree) = make_trees();
+
+	// Erase all of the tuples with each value of y in turn from the secondary B+-tree (which contains three of each).
+	ValueKey key(secondaryTree->leaf_tuple_manipulator(), list_of(0));
+	for(int i = 2; i >= -1; --i)
+	{
+		key.field(0).set_double(i);
+		secondaryTree->erase_tuples(key);
+		BOOST_CHECK_EQUAL(secondaryTree->tuple_count(), std::max(i, 0) * 3);
+
+		for(BTree::ConstIterator it = secondaryTree->begin(), iend = secondaryTree->end(); it != iend; ++it)
+		{
+			BOOST_CHECK_LT(it->field(0).get_double(), i);
+		}
+	}
+
+	BOOST_CHECK(secondaryTree->begin() == secondaryTree->end());
+}
+
 BOOST_AUTO_TEST_CASE(find)
 {
 	BTree_Ptr tree;
@@ -331,6 +857,30 @@ BOOST_AUTO_TEST_CASE(find)
 	BOOST_CHECK_MESSAGE(actual == tree->end(), "check actual == tree->end() failed");
 }
 
+BOOST_AUTO_TEST_CASE(find_batch)
+{
+	BTree_Ptr tree;
+	boost::tie(tree, boost::tuples::ignore) = make_trees();
+
+	// Search for a scattered batch of keys (including duplicates and keys that are not present).
+	std::vector<ValueKey> keys;
+	ValueKey key(tree->leaf_tuple_manipulator(), list_of(0));
+	for(int i = 0; i < 25; ++i)
+	{
+		key.field(0).set_int((i * 7) % 13 - 2);
+		keys.push_back(key);
+	}
+
+	std::vector<BTree::ConstIterator> actual = tree->find_batch(keys);
+	BOOST_REQUIRE_EQUAL(actual.size(), keys.size());
+	for(size_t i = 0, size = keys.size(); i < size; ++i)
+	{
+		BOOST_CHECK_MESSAGE(actual[i] == tree->find(keys[i]), "check actual[i] == tree->find(keys[i]) failed");
+	}
+
+	BOOST_CHECK(tree->find_batch(std::vector<ValueKey>()).empty());
+}
+
 BOOST_AUTO_TEST_CASE(insert_erase)
 {
 	BTree tree(primaryController_2_2);
@@ -384,4 +934,480 @@ BOOST_AUTO_TEST_CASE(insert_erase)
 	}
 }
 
+BOOST_AUTO_TEST_CASE(insert_erase_scattered)
+{
+	BTree tree(primaryController_2_2);
+
+	// Insert and then erase tuples in scattered orders. Many of the erased tuples will be the first
+	// tuples in their leaves, which are found by way of the right sibling of the leaf reached from
+	// the root, and which may therefore have a different parent from that leaf.
+	const int N = 101;
+	FreshTuple tuple(tree.leaf_tuple_manipulator());
+	for(int i = 0; i < N; ++i)
+	{
+		const int x = (i * 37) % N;
+		tuple.field(0).set_int(x);
+		tuple.field(1).set_double(x * x);
+		tuple.field(2).set_double(x * x * x);
+		tree.insert_tuple(tuple);
+	}
+
+	ValueKey key(tree.leaf_tuple_manipulator(), list_of(0));
+	for(int i = 0; i < N; ++i)
+	{
+		key.field(0).set_int((i * 53) % N);
+		tree.erase_tuple(key);
+		BOOST_CHECK_EQUAL(tree.tuple_count(), N - i - 1);
+	}
+
+	BOOST_CHECK(tree.begin() == tree.end());
+}
+
+BOOST_AUTO_TEST_CASE(lower_bound_batch)
+{
+	const int N = 200;
+	BTreePageController_CPtr controllers[] = { primaryController_2_2, BTreePageController_CPtr(new PrimaryTestPageController(4, 5)) };
+	for(size_t c = 0; c < sizeof(controllers) / sizeof(BTreePageController_CPtr); ++c)
+	{
+		// Fill a B+-tree with the tuples <2x,x,x> for each x in [0,N), inserted in a scattered order.
+		BTree tree(controllers[c]);
+		FreshTuple tuple(tree.leaf_tuple_manipulator());
+		for(int i = 0; i < N; ++i)
+		{
+			const int x = (i * 37) % N;
+			tuple.field(0).set_int(2 * x);
+			tuple.field(1).set_double(x);
+			tuple.field(2).set_double(x);
+			tree.insert_tuple(tuple);
+		}
+
+		// Search for a scattered batch of keys, about half of which are present, and some of which are
+		// repeated or lie beyond either end of the B+-tree.
+		std::vector<ValueKey> keys;
+		ValueKey key(tree.leaf_tuple_manipulator(), list_of(0));
+		for(int i = 0; i < 3 * N; ++i)
+		{
+			key.field(0).set_int((i * 89) % (2 * N + 7) - 3);
+			keys.push_back(key);
+		}
+
+		std::vector<BTree::ConstIterator> actual = tree.lower_bound_batch(keys);
+		BOOST_REQUIRE_EQUAL(actual.size(), keys.size());
+		for(size_t i = 0, size = keys.size(); i < size; ++i)
+		{
+			BOOST_CHECK_MESSAGE(actual[i] == tree.lower_bound(keys[i]), "check actual[i] == tree.lower_bound(keys[i]) failed");
+		}
+	}
+
+	// Check that prefix keys (which match several tuples each) are handled correctly.
+	BTree_Ptr secondaryTree;
+	boost::tie(boost::tuples::ignore, secondaryTree) = make_trees();
+
+	std::vector<ValueKey> keys;
+	ValueKey key(secondaryTree->leaf_tuple_manipulator(), list_of(0));
+	const double ys[] = { 2.5, 1, -1, 0, 1, 0.5, 2, 3 };
+	for(size_t i = 0; i < sizeof(ys) / sizeof(double); ++i)
+	{
+		key.field(0).set_double(ys[i]);
+		keys.push_back(key);
+	}
+
+	std::vector<BTree::ConstIterator> actual = secondaryTree->lower_bound_batch(keys);
+	for(size_t i = 0, size = keys.size(); i < size; ++i)
+	{
+		BOOST_CHECK_MESSAGE(actual[i] == secondaryTree->lower_bound(keys[i]), "check actual[i] == secondaryTree->lower_bound(keys[i]) failed");
+	}
+}
+
+BOOST_AUTO_TEST_CASE(order_statistics)
+{
+	const int N = 60;
+	BTreePageController_CPtr controllers[] = { primaryController_2_2, BTreePageController_CPtr(new PrimaryTestPageController(4, 5)) };
+	for(size_t c = 0; c < sizeof(controllers) / sizeof(BTreePageController_CPtr); ++c)
+	{
+		// Insert and then erase tuples in scattered orders, checking the order statistics after each change
+		// (the counts must be maintained correctly through every split, merge and redistribution).
+		BTree tree(controllers[c], false, true);
+		BOOST_CHECK(tree.is_counted());
+
+		std::set<int> expected;
+		FreshTuple tuple(tree.leaf_tuple_manipulator());
+		for(int i = 0; i < N; ++i)
+		{
+			const int x = (i * 37) % N;
+			tuple.field(0).set_int(x);
+			tuple.field(1).set_double(x * x);
+			tuple.field(2).set_double(x * x * x);
+			tree.insert_tuple(tuple);
+			expected.insert(x);
+			check_order_statistics(tree, expected, N);
+		}
+
+		ValueKey key(tree.leaf_tuple_manipulator(), list_of(0));
+		for(int i = 0; i < N; ++i)
+		{
+			const int x = (i * 53) % N;
+			key.field(0).set_int(x);
+			tree.erase_tuple(key);
+			expected.erase(x);
+
+			// Erasing a tuple that is not there should leave the counts unchanged.
+			if(i % 10 == 0)
+			{
+				key.field(0).set_int(x);
+				tree.erase_tuple(key);
+				BOOST_CHECK_EQUAL(tree.tuple_count(), expected.size());
+			}
+
+			check_order_statistics(tree, expected, N);
+		}
+
+		// Refill the B+-tree, erase a range from the middle of it, and check again.
+		for(int x = 0; x < N; ++x)
+		{
+			tuple.field(0).set_int(x);
+			tree.insert_tuple(tuple);
+			expected.insert(x);
+		}
+
+		RangeKey rangeKey(tree.leaf_tuple_manipulator().field_manipulators(), list_of(0));
+		rangeKey.low_value().field(0).set_int(N / 4);
+		rangeKey.high_value().field(0).set_int(3 * N / 4);
+		rangeKey.low_kind() = CLOSED;
+		rangeKey.high_kind() = OPEN;
+		tree.erase_tuples(rangeKey);
+		for(int x = N / 4; x < 3 * N / 4; ++x) expected.erase(x);
+		check_order_statistics(tree, expected, N);
+
+		// Check that a bulk-loaded B+-tree is counted correctly.
+		BTree bulkTree(controllers[c], false, true);
+		bulkTree.bulk_load(make_bulk_load_pages(bulkTree, N, 7));
+		expected.clear();
+		for(int x = 0; x < N; ++x) expected.insert(x);
+		check_order_statistics(bulkTree, expected, N);
+	}
+
+	// Check that prefix keys are ranked correctly (the secondary B+-tree contains three tuples with each value of y).
+	BTree secondaryTree(secondaryController_2_2, false, true);
+	FreshTuple secondaryTuple(secondaryTree.leaf_tuple_manipulator());
+	for(int tupleID = 0; tupleID < 9; ++tupleID)
+	{
+		secondaryTuple.field(0).set_double(tupleID % 3);
+		secondaryTuple.field(1).set_int(tupleID);
+		secondaryTree.insert_tuple(secondaryTuple);
+	}
+
+	ValueKey secondaryKey(secondaryTree.leaf_tuple_manipulator(), list_of(0));
+	const double ys[] = { -1, 0, 0.5, 1, 2, 3 };
+	const unsigned int ranks[] = { 0, 0, 3, 3, 6, 9 };
+	for(size_t i = 0; i < sizeof(ys) / sizeof(double); ++i)
+	{
+		secondaryKey.field(0).set_double(ys[i]);
+		BOOST_CHECK_EQUAL(secondaryTree.rank(secondaryKey), ranks[i]);
+	}
+
+	// Check that order statistics are not available for an uncounted B+-tree.
+	BTree uncountedTree(primaryController_2_2);
+	BOOST_CHECK(!uncountedTree.is_counted());
+	BOOST_CHECK_THROW(uncountedTree.select(0), std::logic_error);
+}
+
+BOOST_AUTO_TEST_CASE(parallel_scan)
+{
+	const int N = 500;
+	BTree tree(BTreePageController_CPtr(new PrimaryTestPageController(4, 5)));
+	FreshTuple tuple(tree.leaf_tuple_manipulator());
+	for(int i = 0; i < N; ++i)
+	{
+		const int x = (i * 37) % N;
+		tuple.field(0).set_int(x);
+		tuple.field(1).set_double(x);
+		tuple.field(2).set_double(x);
+		tree.insert_tuple(tuple);
+	}
+
+	const int lows[] = { -1, 100, 123, 250, 600 };
+	const int highs[] = { N, 400, 124, 250, 700 };
+	const unsigned int threadCounts[] = { 1, 3, 8 };
+	RangeKey key(tree.leaf_tuple_manipulator().field_manipulators(), list_of(0));
+	for(size_t i = 0; i < sizeof(lows) / sizeof(int); ++i)
+	{
+		for(size_t j = 0; j < sizeof(threadCounts) / sizeof(unsigned int); ++j)
+		{
+			// Scan the range [low,high), and check that the runs together contain exactly the tuples in it, in order.
+			key.low_value().field(0).set_int(lows[i]);
+			key.high_value().field(0).set_int(highs[i]);
+			key.low_kind() = CLOSED;
+			key.high_kind() = OPEN;
+
+			RunRecorder recorder;
+			tree.parallel_scan(key, threadCounts[j], boost::ref(recorder));
+
+			std::vector<std::vector<int> > runs = recorder.runs();
+			std::sort(runs.begin(), runs.end());
+
+			int expected = std::max(lows[i], 0);
+			const int expectedEnd = std::max(std::min(highs[i], N), expected);
+			for(std::vector<std::vector<int> >::const_iterator it = runs.begin(), iend = runs.end(); it != iend; ++it)
+			{
+				BOOST_CHECK(!it->empty());
+				for(std::vector<int>::const_iterator jt = it->begin(), jend = it->end(); jt != jend; ++jt, ++expected)
+				{
+					BOOST_CHECK_EQUAL(*jt, expected);
+				}
+			}
+			BOOST_CHECK_EQUAL(expected, expectedEnd);
+
+			// A big enough range should be cut into at least one run for each thread, but a single-threaded scan
+			// should simply scan the whole range (and an empty range should not be scanned at all).
+			if(expectedEnd - lows[i] >= 300)
+			{
+				BOOST_CHECK_GE(runs.size(), threadCounts[j]);
+			}
+			if(threadCounts[j] == 1) BOOST_CHECK_EQUAL(runs.size(), expected > std::max(lows[i], 0) ? 1 : 0);
+		}
+	}
+
+	RunRecorder recorder;
+	BOOST_CHECK_THROW(tree.parallel_scan(key, 0, boost::ref(recorder)), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(stats)
+{
+	BTree tree(primaryController_2_2);
+
+	// Insert and then erase enough tuples to split, redistribute and merge nodes at both levels.
+	const int N = 50;
+	FreshTuple tuple(tree.leaf_tuple_manipulator());
+	for(int i = 0; i < N; ++i)
+	{
+		const int x = (i * 17) % N;
+		tuple.field(0).set_int(x);
+		tuple.field(1).set_double(x);
+		tuple.field(2).set_double(x);
+		tree.insert_tuple(tuple);
+	}
+
+	ValueKey key(tree.leaf_tuple_manipulator(), list_of(0));
+	for(int i = 0; i < N; ++i)
+	{
+		key.field(0).set_int(i);
+		tree.find(key);
+	}
+	tree.equal_range(key);
+
+	RunRecorder recorder;
+	tree.parallel_scan(RangeKey(tree.leaf_tuple_manipulator().field_manipulators(), list_of(0)), 2, boost::ref(recorder));
+
+	for(int i = 0; i < N; ++i)
+	{
+		key.field(0).set_int((i * 23) % N);
+		tree.erase_tuple(key);
+	}
+
+	BTreeStats stats = tree.stats();
+#ifdef WHERY_BTREE_STATS
+	// Check that each operation has been timed (exactly once, so the parallel scan is not also counted as a
+	// range lookup), and that the structural events have been counted.
+	BOOST_CHECK_EQUAL(stats.operation_count(BTreeStats::OP_INSERT), N);
+	BOOST_CHECK_EQUAL(stats.operation_count(BTreeStats::OP_FIND), N);
+	BOOST_CHECK_EQUAL(stats.operation_count(BTreeStats::OP_ERASE), N);
+	BOOST_CHECK_EQUAL(stats.operation_count(BTreeStats::OP_PARALLEL_SCAN), 1);
+	BOOST_CHECK_EQUAL(stats.operation_count(BTreeStats::OP_RANGE_LOOKUP), 1);
+	BOOST_CHECK_LE(stats.latencies(BTreeStats::OP_INSERT).percentile(50), stats.latencies(BTreeStats::OP_INSERT).max());
+
+	const BTreeStats::Event events[] =
+	{
+		BTreeStats::EVENT_ADD_ROOT_NODE,
+		BTreeStats::EVENT_MERGE_BRANCHES,
+		BTreeStats::EVENT_MERGE_LEAVES,
+		BTreeStats::EVENT_REDISTRIBUTE_LEAF,
+		BTreeStats::EVENT_SPLIT_BRANCH,
+		BTreeStats::EVENT_SPLIT_LEAF
+	};
+	for(size_t i = 0; i < sizeof(events) / sizeof(BTreeStats::Event); ++i)
+	{
+		BOOST_CHECK_MESSAGE(stats.event_count(events[i]) > 0, "check " << BTreeStats::event_name(events[i]) << " > 0 failed");
+	}
+	BOOST_CHECK_EQUAL(stats.event_count(BTreeStats::EVENT_OPTIMISTIC_RESTART), 0);
+
+	// Check that resetting the statistics discards everything recorded so far.
+	tree.reset_stats();
+	stats = tree.stats();
+#endif
+
+	// Check that nothing is left (or, if statistics are compiled out, that nothing was ever recorded).
+	for(int op = 0; op < BTreeStats::OPERATION_COUNT; ++op)
+	{
+		BOOST_CHECK_EQUAL(stats.operation_count(static_cast<BTreeStats::Operation>(op)), 0);
+	}
+	for(int event = 0; event < BTreeStats::EVENT_COUNT; ++event)
+	{
+		BOOST_CHECK_EQUAL(stats.event_count(static_cast<BTreeStats::Event>(event)), 0);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(suffix_truncation)
+{
+	// Make a B+-tree with leaf tuples of the form <a,b,c> (all of which form the key) and branch tuples
+	// of the form <a,b,c,child node ID>, whose separators are truncated where possible.
+	TupleManipulator leafTupleManipulator(list_of<const FieldManipulator*>
+		(&IntFieldManipulator::instance())
+		(&IntFieldManipulator::instance())
+		(&IntFieldManipulator::instance())
+	);
+	TupleManipulator branchTupleManipulator(list_of<const FieldManipulator*>
+		(&IntFieldManipulator::instance())
+		(&IntFieldManipulator::instance())
+		(&IntFieldManipulator::instance())
+		(&IntFieldManipulator::instance())
+	);
+	BTree plainTree(BTreePageController_CPtr(new TestPageController(TestPageController::PT_IN_MEMORY, 4, 4, branchTupleManipulator, leafTupleManipulator)));
+	branchTupleManipulator.set_uses_suffix_truncation(true);
+	BTree tree(BTreePageController_CPtr(new TestPageController(TestPageController::PT_IN_MEMORY, 4, 4, branchTupleManipulator, leafTupleManipulator)));
+
+	// Insert tuples in a scattered order, so that many of the separators can be truncated to one or two fields.
+	// (The same tuples are inserted into an otherwise identical B+-tree whose separators are not truncated.)
+	const int N = 500;
+	FreshTuple tuple(tree.leaf_tuple_manipulator());
+	for(int i = 0; i < N; ++i)
+	{
+		const int x = (i * 37) % N;
+		tuple.field(0).set_int(x / 100);
+		tuple.field(1).set_int(x / 10 % 10);
+		tuple.field(2).set_int(x % 10);
+		tree.insert_tuple(tuple);
+		plainTree.insert_tuple(tuple);
+	}
+	BOOST_CHECK_EQUAL(tree.tuple_count(), N);
+
+	// Check that the tuples are in order, and that each of them can be found.
+	ValueKey key(tree.leaf_tuple_manipulator(), list_of(0)(1)(2));
+	int expected = 0;
+	for(BTree::ConstIterator it = tree.begin(), iend = tree.end(); it != iend; ++it, ++expected)
+	{
+		BOOST_CHECK_EQUAL(it->field(0).get_int() * 100 + it->field(1).get_int() * 10 + it->field(2).get_int(), expected);
+		key.field(0).set_from(it->field(0));
+		key.field(1).set_from(it->field(1));
+		key.field(2).set_from(it->field(2));
+		BOOST_CHECK_MESSAGE(tree.find(key) == it, "check tree.find(key) == it failed");
+	}
+	BOOST_CHECK_EQUAL(expected, N);
+
+	// Erase every other tuple in a scattered order, and then every tuple whose first field is 1 or 2.
+	for(int i = 0; i < N; ++i)
+	{
+		const int x = (i * 53) % N;
+		if(x % 2 == 0) continue;
+		key.field(0).set_int(x / 100);
+		key.field(1).set_int(x / 10 % 10);
+		key.field(2).set_int(x % 10);
+		tree.erase_tuple(key);
+		plainTree.erase_tuple(key);
+	}
+	BOOST_CHECK_EQUAL(tree.tuple_count(), N / 2);
+
+	// Without truncation, every leaf (other than the last) should still have at least the minimum of 2 tuples. With it,
+	// an erasure may leave a leaf below its minimum, but only within the bound documented in BTree, so never empty.
+	BOOST_CHECK_GE(min_leaf_tuple_count(plainTree), 2);
+	BOOST_CHECK_GE(min_leaf_tuple_count(tree), 1);
+
+	RangeKey rangeKey(tree.leaf_tuple_manipulator().field_manipulators(), list_of(0));
+	rangeKey.low_kind() = CLOSED;
+	rangeKey.low_value().field(0).set_int(1);
+	rangeKey.high_kind() = CLOSED;
+	rangeKey.high_value().field(0).set_int(2);
+	tree.erase_tuples(rangeKey);
+	BOOST_CHECK_EQUAL(tree.tuple_count(), N / 2 - 100);
+
+	// Check that the remaining tuples are still in order, and can still be found.
+	expected = 0;
+	for(BTree::ConstIterator it = tree.begin(), iend = tree.end(); it != iend; ++it, expected += expected == 98 ? 202 : 2)
+	{
+		BOOST_CHECK_EQUAL(it->field(0).get_int() * 100 + it->field(1).get_int() * 10 + it->field(2).get_int(), expected);
+		key.field(0).set_from(it->field(0));
+		key.field(1).set_from(it->field(1));
+		key.field(2).set_from(it->field(2));
+		BOOST_CHECK_MESSAGE(tree.find(key) == it, "check tree.find(key) == it failed");
+	}
+	BOOST_CHECK_EQUAL(expected, N);
+
+	// Check that truncation is refused if the branch key fields do not match the leading leaf fields.
+	TupleManipulator mismatchedTupleManipulator(list_of<const FieldManipulator*>
+		(&DoubleFieldManipulator::instance())
+		(&IntFieldManipulator::instance())
+	);
+	mismatchedTupleManipulator.set_uses_suffix_truncation(true);
+	BOOST_CHECK_THROW(
+		BTree(BTreePageController_CPtr(new TestPageController(TestPageController::PT_IN_MEMORY, 4, 4, mismatchedTupleManipulator, leafTupleManipulator))),
+		std::invalid_argument
+	);
+}
+
+BOOST_AUTO_TEST_CASE(update_tuple)
+{
+	for(int counted = 0; counted < 2; ++counted)
+	{
+		BTree tree(BTreePageController_CPtr(new PrimaryTestPageController(4, 4)), false, counted == 1);
+
+		// Insert the tuples <i,i,i> for even i.
+		const int N = 40;
+		FreshTuple tuple(tree.leaf_tuple_manipulator());
+		for(int i = 0; i < N; i += 2)
+		{
+			tuple.field(0).set_int(i);
+			tuple.field(1).set_double(i);
+			tuple.field(2).set_double(i);
+			tree.insert_tuple(tuple);
+		}
+
+		// Change the non-key fields of every tuple (which leaves each of them where it is), and
+		// move the tuple with ID 10 to ID 31 (which moves it into a later leaf).
+		ValueKey key(tree.leaf_tuple_manipulator(), list_of(0));
+		for(int i = 0; i < N; i += 2)
+		{
+			key.field(0).set_int(i);
+			BTree::ConstIterator it = tree.find(key);
+			BOOST_REQUIRE(it != tree.end());
+			tuple.field(0).set_int(i == 10 ? 31 : i);
+			tuple.field(1).set_double(-i);
+			tuple.field(2).set_double(i * 0.5);
+			tree.update_tuple(it, tuple);
+		}
+
+		BOOST_CHECK_EQUAL(tree.tuple_count(), N / 2);
+
+		std::vector<int> expected;
+		for(int i = 0; i < N; i += 2) expected.push_back(i == 10 ? 31 : i);
+		std::sort(expected.begin(), expected.end());
+
+		std::vector<int> actual;
+		for(BTree::ConstIterator it = tree.begin(), iend = tree.end(); it != iend; ++it)
+		{
+			const int i = it->field(0).get_int();
+			actual.push_back(i);
+			BOOST_CHECK_EQUAL(it->field(1).get_double(), i == 31 ? -10 : -i);
+			BOOST_CHECK_EQUAL(it->field(2).get_double(), i == 31 ? 5 : i * 0.5);
+		}
+		BOOST_CHECK_EQUAL_COLLECTIONS(actual.begin(), actual.end(), expected.begin(), expected.end());
+
+		// In counted mode, check that the subtree counts are still right.
+		if(counted == 1)
+		{
+			for(unsigned int k = 0, size = static_cast<unsigned int>(expected.size()); k < size; ++k)
+			{
+				BOOST_CHECK_EQUAL(tree.select(k)->field(0).get_int(), expected[k]);
+			}
+		}
+
+		// Check that moving the first tuple of a leaf ahead of the tuples in the previous leaf also works.
+		key.field(0).set_int(N - 2);
+		tuple.field(0).set_int(-1);
+		tree.update_tuple(tree.find(key), tuple);
+		BOOST_CHECK_EQUAL(tree.begin()->field(0).get_int(), -1);
+		BOOST_CHECK_EQUAL(tree.tuple_count(), N / 2);
+		BOOST_CHECK(tree.find(key) == tree.end());
+	}
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,106 @@
+/**
+ * test-db: BitPackingTest.cpp
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#include <boost/test/unit_test.hpp>
+
+#include <climits>
+#include <vector>
+
+#include "whery/util/BitPacking.h"
+using namespace whery;
+
+//#################### TESTS ####################
+
+BOOST_AUTO_TEST_SUITE(BitPackingTest)
+
+BOOST_AUTO_TEST_CASE(move_packed_ints)
+{
+	// Shift ranges of packed values up and down at every bit width, as a page does when it inserts or erases values in place.
+	const unsigned int COUNT = 40;
+	for(unsigned int bitWidth = 1; bitWidth <= 32; ++bitWidth)
+	{
+		const int base = bitWidth == 32 ? INT_MIN : 0;
+		const unsigned int maxOffset = bitWidth == 32 ? UINT_MAX : (1u << bitWidth) - 1;
+
+		std::vector<int> values;
+		for(unsigned int i = 0; i < COUNT; ++i)
+		{
+			values.push_back(static_cast<int>(static_cast<unsigned int>(base) + ((i * 2654435761u) & maxOffset)));
+		}
+
+		std::vector<char> packed(packed_size(COUNT + 1, bitWidth));
+		pack_ints(&values[0], COUNT, base, bitWidth, &packed[0]);
+
+		// Insert a value at position 5 (shifting the later values up), and check that its neighbours are unaffected.
+		whery::move_packed_ints(&packed[0], 5, COUNT, 6, bitWidth);
+		pack_int(&packed[0], 5, base, bitWidth, base);
+		values.insert(values.begin() + 5, base);
+		for(unsigned int i = 0; i <= COUNT; ++i)
+		{
+			BOOST_CHECK_EQUAL(unpack_int(&packed[0], i, base, bitWidth), values[i]);
+		}
+
+		// Erase the values at positions [3,10) (shifting the later values down).
+		whery::move_packed_ints(&packed[0], 10, COUNT + 1, 3, bitWidth);
+		values.erase(values.begin() + 3, values.begin() + 10);
+		for(unsigned int i = 0, size = static_cast<unsigned int>(values.size()); i < size; ++i)
+		{
+			BOOST_CHECK_EQUAL(unpack_int(&packed[0], i, base, bitWidth), values[i]);
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE(pack_unpack)
+{
+	// Pack a range of values at every bit width (with an odd count, so that the last block of eight is incomplete).
+	const unsigned int COUNT = 101;
+	for(unsigned int bitWidth = 0; bitWidth <= 32; ++bitWidth)
+	{
+		const int base = bitWidth == 32 ? INT_MIN : -1000;
+		const unsigned int maxOffset = bitWidth == 32 ? UINT_MAX : (1u << bitWidth) - 1;
+
+		std::vector<int> values;
+		for(unsigned int i = 0; i < COUNT; ++i)
+		{
+			// Include the largest offset that fits, to check that no bits are lost.
+			const unsigned int offset = i % 3 == 0 ? maxOffset : (i * 2654435761u) & maxOffset;
+			values.push_back(static_cast<int>(static_cast<unsigned int>(base) + offset));
+		}
+
+		std::vector<char> packed(packed_size(COUNT, bitWidth));
+		pack_ints(&values[0], COUNT, base, bitWidth, &packed[0]);
+
+		for(unsigned int i = 0; i < COUNT; ++i)
+		{
+			BOOST_CHECK_EQUAL(unpack_int(&packed[0], i, base, bitWidth), values[i]);
+		}
+
+		// Unpack ranges that start both on and off a block boundary, using each of the instruction sets available.
+		for(int level = SIMD_NONE; level <= best_simd_level(); ++level)
+		{
+			for(unsigned int begin = 0; begin <= 19; begin += 3)
+			{
+				std::vector<int> unpacked(COUNT - begin);
+				unpack_ints(&packed[0], begin, COUNT, base, bitWidth, &unpacked[0], SimdLevel(level));
+				BOOST_CHECK_EQUAL_COLLECTIONS(unpacked.begin(), unpacked.end(), values.begin() + begin, values.end());
+			}
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE(packed_bit_width)
+{
+	BOOST_CHECK_EQUAL(whery::packed_bit_width(0), 0);
+	BOOST_CHECK_EQUAL(whery::packed_bit_width(1), 1);
+	BOOST_CHECK_EQUAL(whery::packed_bit_width(255), 8);
+	BOOST_CHECK_EQUAL(whery::packed_bit_width(256), 9);
+	BOOST_CHECK_EQUAL(whery::packed_bit_width(UINT_MAX), 32);
+
+	// A packed array should only take the bytes its bits need, plus the padding at the end.
+	BOOST_CHECK_EQUAL(packed_size(100, 0), packed_size(0, 0));
+	BOOST_CHECK_EQUAL(packed_size(100, 10) - packed_size(0, 10), 125);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,197 @@
+/**
+ * test-db: BufferPoolTest.cpp
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#include <boost/test/unit_test.hpp>
+
+#include <boost/assign/list_of.hpp>
+#include <boost/filesystem/operations.hpp>
+using namespace boost::assign;
+
+#include "whery/db/base/DoubleFieldManipulator.h"
+#include "whery/db/base/FreshTuple.h"
+#include "whery/db/base/IntFieldManipulator.h"
+#include "whery/db/base/ValueKey.h"
+#include "whery/db/btrees/BTree.h"
+#include "whery/db/btrees/BufferedBTreePageController.h"
+#include "whery/db/buffers/ClockEvictionPolicy.h"
+#include "whery/db/buffers/FilePageStore.h"
+#include "whery/db/buffers/InMemoryPageStore.h"
+#include "whery/db/buffers/LRUEvictionPolicy.h"
+#include "whery/db/buffers/TwoQueueEvictionPolicy.h"
+#include "whery/db/pages/BufferedSortedPage.h"
+using namespace whery;
+
+#include "Constants.h"
+
+//#################### HELPER FUNCTIONS ####################
+
+namespace {
+
+const unsigned int PAGE_SIZE = 256;
+
+/**
+Checks that a B+-tree whose pages are cached in a small buffer pool behaves correctly under
+a workload of insertions and erasures, and that the pool stays within its memory budget.
+
+\param store	The store in which to keep the pool's pages.
+\param policy	The eviction policy for the pool to use.
+*/
+void check_btree_workload(const PageStore_Ptr& store, const EvictionPolicy_Ptr& policy)
+{
+	const int N = 500;
+
+	// Each frame is charged for both its page and its row cache.
+	BufferPool_Ptr pool(new BufferPool(store, policy, 12 * PAGE_SIZE));
+	BOOST_CHECK_EQUAL(pool->frame_count(), 6);
+
+	TupleManipulator branchTupleManipulator(list_of<const FieldManipulator*>
+		(&IntFieldManipulator::instance())
+		(&IntFieldManipulator::instance())
+	);
+
+	TupleManipulator leafTupleManipulator(list_of<const FieldManipulator*>
+		(&IntFieldManipulator::instance())
+		(&DoubleFieldManipulator::instance())
+	);
+
+	{
+		BTree tree(BTreePageController_CPtr(new BufferedBTreePageController(pool, branchTupleManipulator, leafTupleManipulator)));
+
+		// Insert a number of tuples in a scattered order (this will need far more pages than fit in the pool).
+		FreshTuple tuple(tree.leaf_tuple_manipulator());
+		for(int i = 0; i < N; ++i)
+		{
+			int tupleID = (i * 7) % N;
+			tuple.field(0).set_int(tupleID);
+			tuple.field(1).set_double(tupleID * 0.5);
+			tree.insert_tuple(tuple);
+			BOOST_CHECK(pool->resident_page_count() <= pool->frame_count());
+		}
+		BOOST_CHECK_EQUAL(tree.tuple_count(), N);
+
+		// Erase the tuples with odd IDs.
+		ValueKey key(tree.leaf_tuple_manipulator(), list_of(0));
+		for(int i = 1; i < N; i += 2)
+		{
+			key.field(0).set_int(i);
+			tree.erase_tuple(key);
+		}
+		BOOST_CHECK_EQUAL(tree.tuple_count(), N / 2);
+
+		// Check that the remaining tuples have survived being evicted and reloaded.
+		int i = 0;
+		for(BTree::ConstIterator it = tree.begin(), iend = tree.end(); it != iend; ++it, i += 2)
+		{
+			BOOST_CHECK_EQUAL(it->field(0).get_int(), i);
+			BOOST_CHECK_CLOSE(it->field(1).get_double(), i * 0.5, Constants::SMALL_EPSILON);
+		}
+		BOOST_CHECK_EQUAL(i, N);
+
+		for(int i = 0; i < N; i += 10)
+		{
+			key.field(0).set_int(i);
+			BTree::EqualRangeResult result = tree.equal_range(key);
+			BOOST_REQUIRE(result.first != result.second);
+			BOOST_CHECK_CLOSE(result.first->field(1).get_double(), i * 0.5, Constants::SMALL_EPSILON);
+		}
+	}
+
+	// Check that destroying the B+-tree discarded all of its pages from the pool.
+	BOOST_CHECK_EQUAL(pool->resident_page_count(), 0);
+}
+
+}
+
+//#################### TESTS ####################
+
+BOOST_AUTO_TEST_SUITE(BufferPoolTest)
+
+BOOST_AUTO_TEST_CASE(btree_clock)
+{
+	check_btree_workload(PageStore_Ptr(new InMemoryPageStore(PAGE_SIZE)), EvictionPolicy_Ptr(new ClockEvictionPolicy));
+}
+
+BOOST_AUTO_TEST_CASE(btree_file)
+{
+	const std::string filename = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string();
+	check_btree_workload(PageStore_Ptr(new FilePageStore(filename, PAGE_SIZE)), EvictionPolicy_Ptr(new LRUEvictionPolicy));
+	boost::filesystem::remove(filename);
+}
+
+BOOST_AUTO_TEST_CASE(btree_lru)
+{
+	check_btree_workload(PageStore_Ptr(new InMemoryPageStore(PAGE_SIZE)), EvictionPolicy_Ptr(new LRUEvictionPolicy));
+}
+
+BOOST_AUTO_TEST_CASE(btree_two_queue)
+{
+	check_btree_workload(PageStore_Ptr(new InMemoryPageStore(PAGE_SIZE)), EvictionPolicy_Ptr(new TwoQueueEvictionPolicy));
+}
+
+BOOST_AUTO_TEST_CASE(pinning)
+{
+	BufferPool pool(PageStore_Ptr(new InMemoryPageStore(PAGE_SIZE)), EvictionPolicy_Ptr(new LRUEvictionPolicy), 6 * PAGE_SIZE);
+	BOOST_CHECK_EQUAL(pool.frame_count(), 3);
+	BOOST_CHECK_THROW(BufferPool(PageStore_Ptr(new InMemoryPageStore(PAGE_SIZE)), EvictionPolicy_Ptr(new LRUEvictionPolicy), 5 * PAGE_SIZE), std::invalid_argument);
+
+	TupleManipulator tupleManipulator(list_of<const FieldManipulator*>(&IntFieldManipulator::instance()));
+	int pageIDs[4];
+	for(int i = 0; i < 4; ++i) pageIDs[i] = pool.allocate_page();
+
+	{
+		// Pin three pages, filling the pool: a fourth page cannot then be loaded.
+		BufferPool::Pin pin0(pool, pageIDs[0], tupleManipulator, true);
+		BufferPool::Pin pin1(pool, pageIDs[1], tupleManipulator, true);
+		BufferPool::Pin pin2(pool, pageIDs[2], tupleManipulator, true);
+		BOOST_CHECK_THROW(BufferPool::Pin(pool, pageIDs[3], tupleManipulator, true), std::runtime_error);
+		BOOST_CHECK_THROW(pool.discard_page(pageIDs[0]), std::logic_error);
+
+		FreshTuple tuple(tupleManipulator);
+		tuple.field(0).set_int(23);
+		pin0->add_tuple(tuple);
+	}
+
+	{
+		// Once the pins are released, the fourth page can be loaded, evicting the first (which must be written back).
+		BufferPool::Pin pin3(pool, pageIDs[3], tupleManipulator, true);
+		BOOST_CHECK_EQUAL(pool.resident_page_count(), 3);
+	}
+
+	{
+		BufferPool::Pin pin0(pool, pageIDs[0], tupleManipulator);
+		BOOST_REQUIRE_EQUAL(pin0->tuple_count(), 1);
+		BOOST_CHECK_EQUAL(pin0->begin()->field(0).get_int(), 23);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(row_cache)
+{
+	BufferPool_Ptr pool(new BufferPool(PageStore_Ptr(new InMemoryPageStore(PAGE_SIZE)), EvictionPolicy_Ptr(new LRUEvictionPolicy), 6 * PAGE_SIZE));
+	TupleManipulator tupleManipulator(list_of<const FieldManipulator*>(&IntFieldManipulator::instance()));
+
+	BufferedSortedPage page(pool, tupleManipulator);
+	FreshTuple tuple(tupleManipulator);
+	tuple.field(0).set_int(23);
+	page.add_tuple(tuple);
+
+	// Check that a tuple is copied into the row cache once, and that the copy is then reused.
+	const char *location = page.tuple_location(0);
+	BOOST_CHECK_EQUAL(tupleManipulator.field(const_cast<char*>(location), 0).get_int(), 23);
+	BOOST_CHECK_EQUAL(page.tuple_location(0), location);
+
+	// Check that modifying the page invalidates the copies in the row cache.
+	tuple.field(0).set_int(9);
+	page.add_tuple(tuple);
+	BOOST_CHECK_EQUAL(page.begin()->field(0).get_int(), 9);
+	BOOST_CHECK_EQUAL((++page.begin())->field(0).get_int(), 23);
+
+	// Check that the tuples can still be read once the page has been evicted, by loading it again.
+	BufferedSortedPage other0(pool, tupleManipulator), other1(pool, tupleManipulator), other2(pool, tupleManipulator);
+	BOOST_CHECK_EQUAL(pool->resident_page_count(), 3);
+	BOOST_CHECK_EQUAL(page.begin()->field(0).get_int(), 9);
+	BOOST_CHECK_EQUAL((++page.begin())->field(0).get_int(), 23);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,390 @@
+/**
+ * test-db: ColumnarSortedPageTest.cpp
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#include <boost/test/unit_test.hpp>
+
+#include <iterator>
+
+#include <boost/assign/list_of.hpp>
+#include <boost/bind.hpp>
+using namespace boost::assign;
+
+#include "whery/db/base/DoubleFieldManipulator.h"
+#include "whery/db/base/IntFieldManipulator.h"
+#include "whery/db/base/RangeKey.h"
+#include "whery/db/btrees/BTree.h"
+#include "whery/db/pages/ColumnarSortedPage.h"
+#include "whery/db/pages/InMemorySortedPage.h"
+using namespace whery;
+
+#include "TestPageController.h"
+
+//#################### HELPER FUNCTIONS ####################
+
+namespace {
+
+void add_run_size(unsigned int *total, const BTree::ConstIterator& begin, const BTree::ConstIterator& end)
+{
+	*total += static_cast<unsigned int>(std::distance(begin, end));
+}
+
+void check_tuple(const BackedTuple& tuple, int i, int j, int k)
+{
+	BOOST_CHECK_EQUAL(tuple.field(0).get_int(), i);
+	BOOST_CHECK_EQUAL(tuple.field(1).get_int(), j);
+	BOOST_CHECK_EQUAL(tuple.field(2).get_int(), k);
+}
+
+/**
+Makes a page controller that provides a B+-tree with small columnar pages, for leaf tuples of the form
+<int,double> and branch tuples of the form <int,child node ID>.
+
+\return	The page controller.
+*/
+BTreePageController_CPtr make_page_controller()
+{
+	return BTreePageController_CPtr(new TestPageController(TestPageController::PT_COLUMNAR, 4, 8,
+		TupleManipulator(list_of<const FieldManipulator*>(&IntFieldManipulator::instance())(&IntFieldManipulator::instance())),
+		TupleManipulator(list_of<const FieldManipulator*>(&IntFieldManipulator::instance())(&DoubleFieldManipulator::instance()))
+	));
+}
+
+ColumnarSortedPage_Ptr make_prefix_page()
+{
+	const unsigned int N = 5;
+
+	TupleManipulator tupleManipulator(list_of<const FieldManipulator*>
+		(&IntFieldManipulator::instance())
+		(&IntFieldManipulator::instance())
+		(&IntFieldManipulator::instance())
+	);
+
+	ColumnarSortedPage_Ptr page(new ColumnarSortedPage(ColumnarSortedPage::buffer_size_for(N * N * N, tupleManipulator), tupleManipulator));
+
+	// Add the tuples in reverse order, so that each one has to be inserted at the start of every minipage.
+	FreshTuple tuple(page->field_manipulators());
+	for(int i = N - 1; i >= 0; --i)
+	{
+		for(int j = N - 1; j >= 0; --j)
+		{
+			for(int k = N - 1; k >= 0; --k)
+			{
+				tuple.field(0).set_int(i);
+				tuple.field(1).set_int(j);
+				tuple.field(2).set_int(k);
+				page->add_tuple(tuple);
+			}
+		}
+	}
+
+	return page;
+}
+
+}
+
+//#################### TESTS ####################
+
+BOOST_AUTO_TEST_SUITE(ColumnarSortedPageTest)
+
+BOOST_AUTO_TEST_CASE(add_tuple)
+{
+	const unsigned int N = 10;
+
+	TupleManipulator tupleManipulator(list_of<const FieldManipulator*>
+		(&IntFieldManipulator::instance())
+		(&DoubleFieldManipulator::instance())
+		(&IntFieldManipulator::instance())
+	);
+
+	// The minipages need no padding between the values, so the page should be smaller than a slotted one.
+	ColumnarSortedPage page(ColumnarSortedPage::buffer_size_for(N, tupleManipulator), tupleManipulator);
+	BOOST_CHECK_EQUAL(page.max_tuple_count(), N);
+	BOOST_CHECK_LT(page.buffer_size(), InMemorySortedPage::buffer_size_for(N, tupleManipulator));
+
+	// Add tuples in a scrambled order (including some duplicates), and check that the page is always sorted.
+	FreshTuple tuple(page.field_manipulators());
+	for(unsigned int i = 0; i < N; ++i)
+	{
+		tuple.field(0).set_int((i * 7) % 5);
+		tuple.field(1).set_double(i * 0.5);
+		tuple.field(2).set_int(i);
+		page.add_tuple(tuple);
+
+		BOOST_CHECK_EQUAL(page.tuple_count(), i + 1);
+		for(ColumnarSortedPage::TupleSetCIter it = page.begin(), jt = ++page.begin(), iend = page.end(); jt != iend; ++it, ++jt)
+		{
+			BOOST_CHECK(it->field(0).get_int() <= jt->field(0).get_int());
+		}
+	}
+
+	// Check that equivalent tuples are kept in the order in which they were added, and that their rows are reconstructed correctly.
+	ValueKey key(page.field_manipulators(), list_of(0));
+	key.field(0).set_int(2);
+	ColumnarSortedPage::EqualRangeResult result = page.equal_range(key);
+	std::vector<BackedTuple> tuples(result.first, result.second);
+	BOOST_REQUIRE_EQUAL(tuples.size(), 2);
+	BOOST_CHECK_EQUAL(tuples[0].field(1).get_double(), 0.5);
+	BOOST_CHECK_EQUAL(tuples[0].field(2).get_int(), 1);
+	BOOST_CHECK_EQUAL(tuples[1].field(1).get_double(), 3.0);
+	BOOST_CHECK_EQUAL(tuples[1].field(2).get_int(), 6);
+
+	// Check that each field's values are stored contiguously in sorted order.
+	const int *keys = reinterpret_cast<const int*>(page.column(0));
+	const int expectedKeys[] = { 0, 0, 1, 1, 2, 2, 3, 3, 4, 4 };
+	BOOST_CHECK_EQUAL_COLLECTIONS(keys, keys + N, expectedKeys, expectedKeys + N);
+
+	// Check that adding a tuple to a full page fails.
+	BOOST_CHECK_THROW(page.add_tuple(tuple), std::out_of_range);
+
+	// Erase the first and last tuples via iterators, and check that the remaining tuples are unaffected.
+	page.erase_tuple(page.begin());
+	page.erase_tuple(page.rbegin());
+	BOOST_CHECK_EQUAL(page.tuple_count(), N - 2);
+	BOOST_CHECK_EQUAL(page.begin()->field(2).get_int(), 5);
+	BOOST_CHECK_EQUAL(page.rbegin()->field(2).get_int(), 2);
+	BOOST_CHECK_EQUAL(keys[0], 0);
+	BOOST_CHECK_EQUAL(keys[N - 3], 4);
+}
+
+BOOST_AUTO_TEST_CASE(btree_pages)
+{
+	BTree tree(make_page_controller());
+
+	// Insert the tuples <i,i*0.5> in a scrambled order, and then erase the ones with odd keys.
+	const int N = 200;
+	FreshTuple tuple(tree.leaf_tuple_manipulator());
+	for(int i = 0; i < N; ++i)
+	{
+		const int k = (i * 37) % N;
+		tuple.field(0).set_int(k);
+		tuple.field(1).set_double(k * 0.5);
+		tree.insert_tuple(tuple);
+	}
+
+	ValueKey key(tree.leaf_tuple_manipulator(), list_of(0));
+	for(int i = 1; i < N; i += 2)
+	{
+		key.field(0).set_int(i);
+		tree.erase_tuple(key);
+	}
+	BOOST_CHECK_EQUAL(tree.tuple_count(), N / 2);
+
+	// Check that iterating over the tuples, reading their columns a leaf at a time and looking them up all find the remaining tuples.
+	int expected = 0;
+	for(BTree::ConstIterator it = tree.begin(), iend = tree.end(); it != iend; ++it, expected += 2)
+	{
+		BOOST_CHECK_EQUAL(it->field(0).get_int(), expected);
+		BOOST_CHECK_EQUAL(it->field(1).get_double(), expected * 0.5);
+	}
+	BOOST_CHECK_EQUAL(expected, N);
+
+	expected = 0;
+	std::vector<int> ints;
+	std::vector<double> doubles;
+	BTree::BatchCursor cursor(tree.begin(), tree.end());
+	while(cursor.next())
+	{
+		cursor.read_ints(0, ints);
+		cursor.read_doubles(1, doubles);
+		BOOST_REQUIRE_EQUAL(ints.size(), cursor.size());
+		BOOST_REQUIRE_EQUAL(doubles.size(), cursor.size());
+		for(unsigned int i = 0, size = cursor.size(); i < size; ++i, expected += 2)
+		{
+			BOOST_CHECK_EQUAL(ints[i], expected);
+			BOOST_CHECK_EQUAL(doubles[i], expected * 0.5);
+			BOOST_CHECK_EQUAL(tree.leaf_tuple_manipulator().field(const_cast<char*>(cursor.location(i)), 0, true).get_int(), expected);
+		}
+	}
+	BOOST_CHECK_EQUAL(expected, N);
+
+	// The leaves cannot be read from several threads at once, so a parallel scan can only use the calling thread.
+	RangeKey all(tree.leaf_tuple_manipulator().field_manipulators(), list_of(0));
+	unsigned int total = 0;
+	tree.parallel_scan(all, 1, boost::bind(add_run_size, &total, _1, _2));
+	BOOST_CHECK_EQUAL(total, N / 2);
+	BOOST_CHECK_THROW(tree.parallel_scan(all, 2, boost::bind(add_run_size, &total, _1, _2)), std::logic_error);
+
+	for(int i = 0; i < N; ++i)
+	{
+		key.field(0).set_int(i);
+		BTree::ConstIterator it = tree.find(key);
+		if(i % 2 == 0)
+		{
+			BOOST_REQUIRE(it != tree.end());
+			BOOST_CHECK_EQUAL(it->field(0).get_int(), i);
+		}
+		else BOOST_CHECK(it == tree.end());
+	}
+}
+
+BOOST_AUTO_TEST_CASE(double_leading_field)
+{
+	TupleManipulator tupleManipulator(list_of<const FieldManipulator*>
+		(&DoubleFieldManipulator::instance())
+		(&IntFieldManipulator::instance())
+	);
+
+	// Add the tuples <i/4,i> for i in [0,100) in a scrambled order, so that each key is shared by four tuples.
+	const unsigned int N = 100;
+	ColumnarSortedPage page(ColumnarSortedPage::buffer_size_for(N, tupleManipulator), tupleManipulator);
+	FreshTuple tuple(page.field_manipulators());
+	for(unsigned int i = 0; i < N; ++i)
+	{
+		const int k = (i * 37) % N;
+		tuple.field(0).set_double(k / 4);
+		tuple.field(1).set_int(k);
+		page.add_tuple(tuple);
+	}
+
+	// Search for keys with only a leading field (both as doubles and as ints, which are converted to doubles).
+	ValueKey doubleKey(page.field_manipulators(), list_of(0));
+	doubleKey.field(0).set_double(7.0);
+	BOOST_CHECK_EQUAL(page.lower_bound(doubleKey).index(), 28);
+	BOOST_CHECK_EQUAL(page.upper_bound(doubleKey).index(), 32);
+
+	doubleKey.field(0).set_double(6.5);
+	BOOST_CHECK_EQUAL(page.lower_bound(doubleKey).index(), 28);
+	BOOST_CHECK_EQUAL(page.upper_bound(doubleKey).index(), 28);
+
+	ValueKey intKey(list_of<const FieldManipulator*>(&IntFieldManipulator::instance()), list_of(0));
+	intKey.field(0).set_int(24);
+	BOOST_CHECK_EQUAL(page.lower_bound(intKey).index(), 96);
+	BOOST_CHECK(page.upper_bound(intKey) == page.end());
+
+	// Search for a key with both fields, which must be found within the run of tuples that share its leading field.
+	ValueKey fullKey(page.field_manipulators(), list_of(0)(1));
+	fullKey.field(0).set_double(7.0);
+	fullKey.field(1).set_int(30);
+	ColumnarSortedPage::TupleSetCIter it = page.find(fullKey);
+	BOOST_REQUIRE(it != page.end());
+	BOOST_CHECK_EQUAL(it.index(), 30);
+	BOOST_CHECK_EQUAL(it->field(1).get_int(), 30);
+
+	fullKey.field(1).set_int(27);
+	BOOST_CHECK(page.find(fullKey) == page.end());
+	BOOST_CHECK_EQUAL(page.lower_bound(fullKey).index(), 28);
+}
+
+BOOST_AUTO_TEST_CASE(equal_range_rangekey)
+{
+	ColumnarSortedPage_Ptr page = make_prefix_page();
+
+	// Check a [] range.
+	RangeKey key(page->field_manipulators(), list_of(0)(1));
+	key.low_kind() = CLOSED;
+	key.low_value().field(0).set_int(2);
+	key.low_value().field(1).set_int(4);
+	key.high_kind() = CLOSED;
+	key.high_value().field(0).set_int(3);
+	key.high_value().field(1).set_int(0);
+	ColumnarSortedPage::EqualRangeResult result = page->equal_range(key);
+	std::vector<BackedTuple> tuples(result.first, result.second);
+
+	BOOST_CHECK_EQUAL(tuples.size(), 10);
+	check_tuple(tuples[0], 2, 4, 0);
+	check_tuple(tuples[9], 3, 0, 4);
+
+	// Check a () range.
+	key.low_kind() = OPEN;
+	key.high_kind() = OPEN;
+	result = page->equal_range(key);
+	BOOST_CHECK(result.first == result.second);
+
+	// Check a (] range.
+	key.high_kind() = CLOSED;
+	result = page->equal_range(key);
+	tuples = std::vector<BackedTuple>(result.first, result.second);
+
+	BOOST_CHECK_EQUAL(tuples.size(), 5);
+	check_tuple(tuples[0], 3, 0, 0);
+	check_tuple(tuples[4], 3, 0, 4);
+
+	// Check an unbounded range.
+	key.clear_low_endpoint();
+	key.clear_high_endpoint();
+	result = page->equal_range(key);
+	tuples = std::vector<BackedTuple>(result.first, result.second);
+
+	BOOST_CHECK_EQUAL(tuples.size(), 125);
+	check_tuple(tuples[0], 0, 0, 0);
+	check_tuple(tuples[124], 4, 4, 4);
+}
+
+BOOST_AUTO_TEST_CASE(erase_tuple)
+{
+	ColumnarSortedPage_Ptr page = make_prefix_page();
+
+	// Look up a tuple, so that its row is reconstructed, and then erase the tuple before it.
+	ValueKey key(page->field_manipulators(), list_of(0)(1)(2));
+	key.field(0).set_int(2);
+	key.field(1).set_int(3);
+	key.field(2).set_int(1);
+	ColumnarSortedPage::TupleSetCIter it = page->find(key);
+	BOOST_REQUIRE(it != page->end());
+	check_tuple(*it, 2, 3, 1);
+
+	FreshTuple tuple(page->field_manipulators());
+	tuple.field(0).set_int(2);
+	tuple.field(1).set_int(3);
+	tuple.field(2).set_int(0);
+	page->erase_tuple(BackedTuple(tuple));
+	BOOST_CHECK_EQUAL(page->tuple_count(), 124);
+
+	// The tuple now at the looked-up position must be the one that followed it.
+	check_tuple(*it, 2, 3, 2);
+	check_tuple(*page->find(key), 2, 3, 1);
+
+	// Erasing a tuple that is not on the page should have no effect.
+	page->erase_tuple(BackedTuple(tuple));
+	BOOST_CHECK_EQUAL(page->tuple_count(), 124);
+
+	// Erase all the tuples whose first field is 2 in one go, and check that the looked-up position now holds the right tuple.
+	ValueKey rangeKey(page->field_manipulators(), list_of(0));
+	rangeKey.field(0).set_int(2);
+	ColumnarSortedPage::EqualRangeResult result = page->equal_range(rangeKey);
+	page->erase_tuples(result.first, result.second);
+	BOOST_CHECK_EQUAL(page->tuple_count(), 100);
+	check_tuple(*it, 3, 3, 1);
+	BOOST_CHECK(page->find(key) == page->end());
+
+	page->clear();
+	BOOST_CHECK_EQUAL(page->tuple_count(), 0);
+	BOOST_CHECK(page->find(key) == page->end());
+}
+
+BOOST_AUTO_TEST_CASE(read_filter)
+{
+	ColumnarSortedPage_Ptr page = make_prefix_page();
+
+	// Read the third field of the tuples from position 10 onwards.
+	std::vector<int> values(page->tuple_count() - 10);
+	page->read_ints(2, 10, page->tuple_count(), &values[0]);
+	for(unsigned int i = 0, size = values.size(); i < size; ++i)
+	{
+		BOOST_CHECK_EQUAL(values[i], static_cast<int>(i % 5));
+	}
+
+	std::vector<double> doubles(5);
+	page->read_doubles(1, 25, 30, &doubles[0]);
+	BOOST_CHECK_EQUAL(doubles[0], 0.0);
+	BOOST_CHECK_EQUAL(doubles[4], 0.0);
+
+	// Find the tuples whose second field is 1 or 2.
+	std::vector<unsigned int> positions;
+	page->filter_ints(1, 1, 2, positions);
+	BOOST_REQUIRE_EQUAL(positions.size(), 50);
+	BOOST_CHECK_EQUAL(positions[0], 5);
+	BOOST_CHECK_EQUAL(positions[9], 14);
+	BOOST_CHECK_EQUAL(positions[10], 30);
+
+	page->filter_doubles(0, 3.5, 10.0, positions);
+	BOOST_REQUIRE_EQUAL(positions.size(), 25);
+	BOOST_CHECK_EQUAL(positions[0], 100);
+
+	page->filter_ints(0, 5, 10, positions);
+	BOOST_CHECK(positions.empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
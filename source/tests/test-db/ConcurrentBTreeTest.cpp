@@ -0,0 +1,264 @@
+/**
+ * test-db: ConcurrentBTreeTest.cpp
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#include <boost/test/unit_test.hpp>
+
+#include <boost/assign/list_of.hpp>
+#include <boost/atomic.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+using namespace boost::assign;
+
+#include "whery/db/base/DoubleFieldManipulator.h"
+#include "whery/db/base/FreshTuple.h"
+#include "whery/db/base/IntFieldManipulator.h"
+#include "whery/db/base/RangeKey.h"
+#include "whery/db/base/ValueKey.h"
+#include "whery/db/btrees/BTree.h"
+using namespace whery;
+
+#include "Constants.h"
+#include "TestPageController.h"
+
+//#################### HELPER FUNCTIONS ####################
+
+namespace {
+
+/**
+Inserts the tuples <i,i*0.5> for each i in [first,last) with the specified stride into a B+-tree.
+
+\param tree		The B+-tree.
+\param first	The first tuple ID.
+\param last		One past the last tuple ID.
+\param stride	The stride.
+*/
+void insert_tuples(BTree& tree, int first, int last, int stride)
+{
+	FreshTuple tuple(tree.leaf_tuple_manipulator());
+	for(int i = first; i < last; i += stride)
+	{
+		tuple.field(0).set_int(i);
+		tuple.field(1).set_double(i * 0.5);
+		tree.insert_tuple(tuple);
+	}
+}
+
+/**
+Erases the tuples with IDs i for each i in [first,last) with the specified stride from a B+-tree.
+
+\param tree		The B+-tree.
+\param first	The first tuple ID.
+\param last		One past the last tuple ID.
+\param stride	The stride.
+*/
+void erase_tuples(BTree& tree, int first, int last, int stride)
+{
+	ValueKey key(tree.leaf_tuple_manipulator(), list_of(0));
+	for(int i = first; i < last; i += stride)
+	{
+		key.field(0).set_int(i);
+		tree.erase_tuple(key);
+	}
+}
+
+/**
+Repeatedly looks up the tuples with even IDs in [0,n) in a B+-tree until told to stop,
+counting any lookups that fail to find the right tuple.
+
+\param tree		The B+-tree.
+\param n		One past the largest tuple ID to look up.
+\param stop		A flag that will be set when the lookups should stop.
+\param failures	A counter for the failed lookups.
+*/
+void look_up_even_tuples(const BTree& tree, int n, const boost::atomic<bool>& stop, boost::atomic<int>& failures)
+{
+	ValueKey key(tree.leaf_tuple_manipulator(), list_of(0));
+	do
+	{
+		for(int i = 0; i < n; i += 2)
+		{
+			key.field(0).set_int(i);
+			boost::optional<FreshTuple> tuple = tree.lookup(key);
+			if(!tuple || tuple->field(0).get_int() != i || tuple->field(1).get_double() != i * 0.5) ++failures;
+		}
+	} while(!stop);
+}
+
+/**
+Makes a page controller that provides in-memory pages to a B+-tree with leaf tuples of the
+form <tuple ID,value> and branch tuples of the form <tuple ID,child node ID>.
+
+\param tuplesPerPage	The number of tuples that should fit on a B+-tree page.
+\return				The page controller.
+*/
+BTreePageController_CPtr make_page_controller(unsigned int tuplesPerPage)
+{
+	return BTreePageController_CPtr(new TestPageController(TestPageController::PT_IN_MEMORY, tuplesPerPage, tuplesPerPage,
+		TupleManipulator(list_of<const FieldManipulator*>(&IntFieldManipulator::instance())(&IntFieldManipulator::instance())),
+		TupleManipulator(list_of<const FieldManipulator*>(&IntFieldManipulator::instance())(&DoubleFieldManipulator::instance()))
+	));
+}
+
+}
+
+//#################### TESTS ####################
+
+BOOST_AUTO_TEST_SUITE(ConcurrentBTreeTest)
+
+BOOST_AUTO_TEST_CASE(counted)
+{
+	const int N = 2000;
+	const int WRITERS = 4;
+
+	// Have several writers insert interleaved shares of the tuples into a concurrent, counted B+-tree,
+	// and then erase every other one of them, whilst the order statistics are computed concurrently.
+	BTree tree(make_page_controller(8), true, true);
+	BOOST_CHECK(tree.is_counted());
+
+	boost::thread_group writers;
+	for(int i = 0; i < WRITERS; ++i)
+	{
+		writers.create_thread(boost::bind(&insert_tuples, boost::ref(tree), i, N, WRITERS));
+	}
+
+	RangeKey rangeKey(tree.leaf_tuple_manipulator().field_manipulators(), list_of(0));
+	rangeKey.clear_low_endpoint();
+	rangeKey.clear_high_endpoint();
+	unsigned int lastCount = 0;
+	for(int i = 0; i < 100; ++i)
+	{
+		// The B+-tree only ever grows whilst the insertions are in progress.
+		unsigned int count = tree.count(rangeKey);
+		BOOST_CHECK_GE(count, lastCount);
+		lastCount = count;
+	}
+	writers.join_all();
+
+	for(int i = 0; i < WRITERS; ++i)
+	{
+		writers.create_thread(boost::bind(&erase_tuples, boost::ref(tree), 2 * i + 1, N, 2 * WRITERS));
+	}
+	writers.join_all();
+
+	// Check that the counts are exactly right once the writers have finished.
+	BOOST_CHECK_EQUAL(tree.tuple_count(), N / 2);
+	BOOST_CHECK_EQUAL(tree.count(rangeKey), N / 2);
+
+	ValueKey key(tree.leaf_tuple_manipulator(), list_of(0));
+	for(int i = 0; i < N; i += 7)
+	{
+		key.field(0).set_int(i);
+		BOOST_CHECK_EQUAL(tree.rank(key), (i + 1) / 2);
+
+		BTree::ConstIterator it = tree.select(i / 2);
+		BOOST_REQUIRE(it != tree.end());
+		BOOST_CHECK_EQUAL(it->field(0).get_int(), i / 2 * 2);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(readers_and_writers)
+{
+	const int N = 4000;
+	const int WRITERS = 4;
+	const int READERS = 2;
+
+	// Fill a concurrent B+-tree with the tuples that have even IDs.
+	BTree tree(make_page_controller(8), true);
+	BOOST_CHECK(tree.is_concurrent());
+	insert_tuples(tree, 0, N, 2);
+
+	// Start some readers that repeatedly look up the tuples with even IDs, which should always be found.
+	boost::atomic<bool> stop(false);
+	boost::atomic<int> failures(0);
+	boost::thread_group readers;
+	for(int i = 0; i < READERS; ++i)
+	{
+		readers.create_thread(boost::bind(&look_up_even_tuples, boost::cref(tree), N, boost::cref(stop), boost::ref(failures)));
+	}
+
+	// Meanwhile, have several writers insert the tuples with odd IDs (each taking an interleaved share of them,
+	// so that they contend for the same leaves and cause plenty of splits), and then erase them again.
+	boost::thread_group writers;
+	for(int i = 0; i < WRITERS; ++i)
+	{
+		writers.create_thread(boost::bind(&insert_tuples, boost::ref(tree), 2 * i + 1, N, 2 * WRITERS));
+	}
+	writers.join_all();
+	BOOST_CHECK_EQUAL(tree.tuple_count(), N);
+
+	for(int i = 0; i < WRITERS; ++i)
+	{
+		writers.create_thread(boost::bind(&erase_tuples, boost::ref(tree), 2 * i + 1, N, 2 * WRITERS));
+	}
+	writers.join_all();
+
+	stop = true;
+	readers.join_all();
+	BOOST_CHECK_EQUAL(failures, 0);
+
+	// Check that the B+-tree is left containing exactly the tuples with even IDs, in order.
+	BOOST_CHECK_EQUAL(tree.tuple_count(), N / 2);
+	int i = 0;
+	for(BTree::ConstIterator it = tree.begin(), iend = tree.end(); it != iend; ++it, i += 2)
+	{
+		BOOST_CHECK_EQUAL(it->field(0).get_int(), i);
+	}
+	BOOST_CHECK_EQUAL(i, N);
+}
+
+BOOST_AUTO_TEST_CASE(serial_equivalence)
+{
+	const int N = 500;
+
+	// Insert the same tuples into a serial B+-tree and a concurrent one.
+	BTreePageController_CPtr controller = make_page_controller(4);
+	BTree serialTree(controller), concurrentTree(controller, true);
+	BOOST_CHECK(!serialTree.is_concurrent());
+	insert_tuples(serialTree, 0, N, 1);
+	insert_tuples(concurrentTree, 0, N, 1);
+	erase_tuples(serialTree, 0, N, 3);
+	erase_tuples(concurrentTree, 0, N, 3);
+	BOOST_CHECK_EQUAL(serialTree.tuple_count(), concurrentTree.tuple_count());
+
+	// Check that searching the two B+-trees gives the same results.
+	ValueKey key(serialTree.leaf_tuple_manipulator(), list_of(0));
+	for(int i = -1; i <= N; ++i)
+	{
+		key.field(0).set_int(i);
+
+		BTree::ConstIterator serialIt = serialTree.lower_bound(key), concurrentIt = concurrentTree.lower_bound(key);
+		BOOST_REQUIRE_EQUAL(serialIt == serialTree.end(), concurrentIt == concurrentTree.end());
+		if(serialIt != serialTree.end()) BOOST_CHECK_EQUAL(serialIt->field(0).get_int(), concurrentIt->field(0).get_int());
+
+		serialIt = serialTree.upper_bound(key), concurrentIt = concurrentTree.upper_bound(key);
+		BOOST_REQUIRE_EQUAL(serialIt == serialTree.end(), concurrentIt == concurrentTree.end());
+		if(serialIt != serialTree.end()) BOOST_CHECK_EQUAL(serialIt->field(0).get_int(), concurrentIt->field(0).get_int());
+
+		const bool present = i >= 0 && i < N && i % 3 != 0;
+		BOOST_CHECK_EQUAL(serialTree.find(key) != serialTree.end(), present);
+		BOOST_CHECK_EQUAL(concurrentTree.find(key) != concurrentTree.end(), present);
+
+		boost::optional<FreshTuple> tuple = concurrentTree.lookup(key);
+		BOOST_REQUIRE_EQUAL(tuple.is_initialized(), present);
+		if(tuple) BOOST_CHECK_CLOSE(tuple->field(1).get_double(), i * 0.5, Constants::SMALL_EPSILON);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(update_tuple)
+{
+	// An iterator into a concurrent B+-tree is only a snapshot, so it cannot be used to update a tuple.
+	BTree tree(make_page_controller(8), true);
+	insert_tuples(tree, 0, 10, 1);
+
+	ValueKey key(tree.leaf_tuple_manipulator(), list_of(0));
+	key.field(0).set_int(5);
+	FreshTuple tuple(tree.leaf_tuple_manipulator());
+	tuple.field(0).set_int(5);
+	tuple.field(1).set_double(-5);
+	BOOST_CHECK_THROW(tree.update_tuple(tree.find(key), tuple), std::logic_error);
+	BOOST_CHECK_EQUAL(tree.find(key)->field(1).get_double(), 2.5);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
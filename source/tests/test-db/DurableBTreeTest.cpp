@@ -0,0 +1,220 @@
+/**
+ * test-db: DurableBTreeTest.cpp
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#include <boost/test/unit_test.hpp>
+
+#include <boost/assign/list_of.hpp>
+#include <boost/bind.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <boost/thread/thread.hpp>
+using namespace boost::assign;
+
+#include "whery/db/base/DoubleFieldManipulator.h"
+#include "whery/db/base/FreshTuple.h"
+#include "whery/db/base/IntFieldManipulator.h"
+#include "whery/db/base/ValueKey.h"
+#include "whery/db/btrees/DurableBTree.h"
+using namespace whery;
+
+#include "Constants.h"
+#include "TestPageController.h"
+
+//#################### HELPER FUNCTIONS ####################
+
+namespace {
+
+/**
+Checks that a B+-tree contains exactly the tuples <i,i*0.5> for which i is in the range [0,n) and
+satisfies the specified predicate.
+
+\param tree		The B+-tree.
+\param n		The upper bound of the range of tuple IDs.
+\param pred		The predicate.
+*/
+template <typename Pred>
+void check_contents(const BTree& tree, int n, Pred pred)
+{
+	BTree::ConstIterator it = tree.begin(), iend = tree.end();
+	for(int i = 0; i < n; ++i)
+	{
+		if(!pred(i)) continue;
+		BOOST_REQUIRE(it != iend);
+		BOOST_CHECK_EQUAL(it->field(0).get_int(), i);
+		BOOST_CHECK_CLOSE(it->field(1).get_double(), i * 0.5, Constants::SMALL_EPSILON);
+		++it;
+	}
+	BOOST_CHECK(it == iend);
+}
+
+/**
+Makes an empty B+-tree to be wrapped by a durable B+-tree.
+
+\return	The B+-tree.
+*/
+BTree_Ptr make_tree()
+{
+	return BTree_Ptr(new BTree(BTreePageController_CPtr(new TestPageController(TestPageController::PT_IN_MEMORY, 4, 4,
+		TupleManipulator(list_of<const FieldManipulator*>(&IntFieldManipulator::instance())(&IntFieldManipulator::instance())),
+		TupleManipulator(list_of<const FieldManipulator*>(&IntFieldManipulator::instance())(&DoubleFieldManipulator::instance()))
+	))));
+}
+
+/**
+Inserts the tuples <i,i*0.5> for which i is in the range [begin,end) into a durable B+-tree.
+
+\param tree		The durable B+-tree.
+\param begin	The lower bound of the range of tuple IDs.
+\param end		The upper bound of the range of tuple IDs.
+*/
+void insert_range(DurableBTree& tree, int begin, int end)
+{
+	FreshTuple tuple(tree.tree().leaf_tuple_manipulator());
+	for(int i = begin; i < end; ++i)
+	{
+		tuple.field(0).set_int(i);
+		tuple.field(1).set_double(i * 0.5);
+		tree.insert_tuple(tuple);
+	}
+}
+
+/**
+Removes the log and checkpoint files of a durable B+-tree.
+
+\param basename	The base name of the files.
+*/
+void remove_files(const std::string& basename)
+{
+	boost::filesystem::remove(basename + ".ckpt");
+	boost::filesystem::remove(basename + ".wal");
+}
+
+bool is_any(int)		{ return true; }
+bool is_even(int i)	{ return i % 2 == 0; }
+bool is_kept(int i)	{ return i < 50 || i >= 70; }
+
+}
+
+//#################### TESTS ####################
+
+BOOST_AUTO_TEST_SUITE(DurableBTreeTest)
+
+BOOST_AUTO_TEST_CASE(recover_from_log)
+{
+	const std::string basename = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string();
+	const int N = 100;
+
+	{
+		DurableBTree tree(make_tree(), basename, 0);
+		insert_range(tree, 0, N);
+
+		ValueKey key(tree.tree().leaf_tuple_manipulator(), list_of(0));
+		for(int i = 1; i < N; i += 2)
+		{
+			key.field(0).set_int(i);
+			tree.erase_tuple(key);
+		}
+		BOOST_CHECK_EQUAL(tree.log().durable_lsn(), N + N / 2);
+	}
+
+	// Check that both the insertions and the erasures are replayed from the log.
+	{
+		DurableBTree tree(make_tree(), basename, 0);
+		check_contents(tree.tree(), N, is_even);
+	}
+
+	remove_files(basename);
+}
+
+BOOST_AUTO_TEST_CASE(concurrent_checkpoints)
+{
+	const std::string basename = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string();
+	const int N = 2000, THREADS = 4;
+
+	{
+		// Insert disjoint ranges of tuples from several threads, so that writes carry on whilst the automatic checkpoints
+		// are being written, and records logged whilst each checkpoint is written must be kept in the log.
+		DurableBTree tree(make_tree(), basename, 50);
+		boost::thread_group threads;
+		for(int i = 0; i < THREADS; ++i)
+		{
+			threads.create_thread(boost::bind(&insert_range, boost::ref(tree), i * N / THREADS, (i + 1) * N / THREADS));
+		}
+		threads.join_all();
+		check_contents(tree.tree(), N, is_any);
+		BOOST_CHECK_LT(tree.log().read_records().size(), N);
+	}
+
+	{
+		DurableBTree tree(make_tree(), basename, 50);
+		check_contents(tree.tree(), N, is_any);
+		BOOST_CHECK_EQUAL(tree.log().last_lsn(), N);
+	}
+
+	remove_files(basename);
+}
+
+BOOST_AUTO_TEST_CASE(recover_from_checkpoint)
+{
+	const std::string basename = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string();
+	const int N = 100;
+
+	{
+		DurableBTree tree(make_tree(), basename, 0);
+		insert_range(tree, 0, 80);
+		tree.checkpoint();
+		BOOST_CHECK(tree.log().read_records().empty());
+
+		// Make some changes after the checkpoint, which will have to be replayed from the log.
+		insert_range(tree, 80, N);
+		ValueKey key(tree.tree().leaf_tuple_manipulator(), list_of(0));
+		for(int i = 50; i < 70; ++i)
+		{
+			key.field(0).set_int(i);
+			tree.erase_tuple(key);
+		}
+	}
+
+	{
+		DurableBTree tree(make_tree(), basename, 0);
+		check_contents(tree.tree(), N, is_kept);
+
+		// Check that the LSNs carry on from where they left off.
+		BOOST_CHECK_EQUAL(tree.log().last_lsn(), N + 20);
+	}
+
+	// A durable B+-tree can only be recovered into an empty B+-tree.
+	{
+		BTree_Ptr nonEmptyTree = make_tree();
+		FreshTuple tuple(nonEmptyTree->leaf_tuple_manipulator());
+		tuple.field(0).set_int(0);
+		tuple.field(1).set_double(0.0);
+		nonEmptyTree->insert_tuple(tuple);
+		BOOST_CHECK_THROW(DurableBTree(nonEmptyTree, basename), std::invalid_argument);
+	}
+
+	remove_files(basename);
+}
+
+BOOST_AUTO_TEST_CASE(automatic_checkpoints)
+{
+	const std::string basename = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string();
+	const int N = 105;
+
+	{
+		// With a checkpoint every 10 records, only the last 5 insertions should remain in the log.
+		DurableBTree tree(make_tree(), basename, 10, 4);
+		insert_range(tree, 0, N);
+		BOOST_CHECK_EQUAL(tree.log().read_records().size(), 5);
+	}
+
+	{
+		DurableBTree tree(make_tree(), basename, 10, 4);
+		check_contents(tree.tree(), N, is_any);
+	}
+
+	remove_files(basename);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
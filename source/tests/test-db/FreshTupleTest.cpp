@@ -5,7 +5,10 @@
 
 #include <boost/test/unit_test.hpp>
 
+#include <utility>
+
 #include <boost/assign/list_of.hpp>
+#include <boost/config.hpp>
 using namespace boost::assign;
 
 #include "whery/db/base/DoubleFieldManipulator.h"
@@ -37,4 +40,53 @@ BOOST_AUTO_TEST_CASE(field)
 	BOOST_CHECK_EQUAL(tuple.field(2).get_int(), 84);
 }
 
+BOOST_AUTO_TEST_CASE(copy)
+{
+	// Check that copies of both small (inline) and large (heap-allocated) tuples are independent of the original.
+	for(unsigned int arity = 1; arity <= 64; arity *= 4)
+	{
+		std::vector<const FieldManipulator*> fms(arity, &IntFieldManipulator::instance());
+		FreshTuple tuple(fms);
+		for(unsigned int i = 0; i < arity; ++i) tuple.field(i).set_int(i);
+
+		FreshTuple copy(tuple);
+		FreshTuple assigned(std::vector<const FieldManipulator*>(1, &DoubleFieldManipulator::instance()));
+		assigned = tuple;
+		for(unsigned int i = 0; i < arity; ++i) tuple.field(i).set_int(-1);
+
+		BOOST_CHECK_EQUAL(copy.arity(), arity);
+		BOOST_CHECK_EQUAL(assigned.arity(), arity);
+		for(unsigned int i = 0; i < arity; ++i)
+		{
+			BOOST_CHECK_EQUAL(copy.field(i).get_int(), static_cast<int>(i));
+			BOOST_CHECK_EQUAL(assigned.field(i).get_int(), static_cast<int>(i));
+		}
+	}
+}
+
+#ifndef BOOST_NO_CXX11_RVALUE_REFERENCES
+BOOST_AUTO_TEST_CASE(copy_moved_from)
+{
+	// Check that a large (heap-allocated) tuple that has been moved from can still be copied (giving a zeroed tuple).
+	const unsigned int arity = 64;
+	std::vector<const FieldManipulator*> fms(arity, &IntFieldManipulator::instance());
+	FreshTuple tuple(fms);
+	for(unsigned int i = 0; i < arity; ++i) tuple.field(i).set_int(i + 1);
+
+	FreshTuple moved(std::move(tuple));
+	FreshTuple copy(tuple);
+	FreshTuple assigned(std::vector<const FieldManipulator*>(1, &DoubleFieldManipulator::instance()));
+	assigned = tuple;
+	FreshTuple movedAgain(std::move(tuple));
+
+	for(unsigned int i = 0; i < arity; ++i)
+	{
+		BOOST_CHECK_EQUAL(moved.field(i).get_int(), static_cast<int>(i + 1));
+		BOOST_CHECK_EQUAL(copy.field(i).get_int(), 0);
+		BOOST_CHECK_EQUAL(assigned.field(i).get_int(), 0);
+		BOOST_CHECK_EQUAL(movedAgain.field(i).get_int(), 0);
+	}
+}
+#endif
+
 BOOST_AUTO_TEST_SUITE_END()
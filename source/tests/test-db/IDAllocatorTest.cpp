@@ -5,6 +5,8 @@
 
 #include <boost/test/unit_test.hpp>
 
+#include <stdexcept>
+
 #include "whery/util/IDAllocator.h"
 using namespace whery;
 
@@ -33,6 +35,52 @@ BOOST_AUTO_TEST_CASE(deallocate)
 	BOOST_CHECK_EQUAL(a.allocate(), 11);
 }
 
+BOOST_AUTO_TEST_CASE(deallocate_invalid)
+{
+	IDAllocator a;
+	BOOST_CHECK_THROW(a.deallocate(0), std::invalid_argument);
+
+	a.allocate();
+	a.allocate();
+	a.deallocate(0);
+	BOOST_CHECK_THROW(a.deallocate(0), std::invalid_argument);
+	BOOST_CHECK_THROW(a.deallocate(2), std::invalid_argument);
+	BOOST_CHECK_THROW(a.deallocate(-1), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(deallocate_largest)
+{
+	IDAllocator a;
+	a.reserve(10);
+
+	for(int i = 0; i < 10; ++i)
+	{
+		BOOST_CHECK_EQUAL(a.allocate(), i);
+	}
+
+	// Deallocating the largest ID in use should also free up the unused IDs immediately below it.
+	a.deallocate(4);
+	a.deallocate(7);
+	a.deallocate(8);
+	a.deallocate(9);
+	BOOST_CHECK_EQUAL(a.allocate(), 4);
+	BOOST_CHECK_EQUAL(a.allocate(), 7);
+	BOOST_CHECK_EQUAL(a.allocate(), 8);
+
+	// Check that IDs that are deallocated more than once along the way are only reallocated once.
+	a.deallocate(5);
+	a.deallocate(8);
+	a.deallocate(7);
+	a.deallocate(6);
+	BOOST_CHECK_EQUAL(a.allocate(), 5);
+	a.deallocate(5);
+	BOOST_CHECK_EQUAL(a.allocate(), 5);
+	BOOST_CHECK_EQUAL(a.allocate(), 6);
+	BOOST_CHECK_EQUAL(a.allocate(), 7);
+	BOOST_CHECK_EQUAL(a.allocate(), 8);
+	BOOST_CHECK_EQUAL(a.allocate(), 9);
+}
+
 BOOST_AUTO_TEST_CASE(reset)
 {
 	IDAllocator a;
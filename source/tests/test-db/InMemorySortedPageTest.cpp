@@ -3,6 +3,8 @@
  * Copyright Stuart Golodetz, 2013. All rights reserved.
  */
 
+#include <iterator>
+
 #include <boost/test/unit_test.hpp>
 
 #include <boost/assign/list_of.hpp>
@@ -37,7 +39,7 @@ InMemorySortedPage make_prefix_page()
 		(&IntFieldManipulator::instance())
 	);
 
-	InMemorySortedPage page(tupleManipulator.size() * N * N * N, tupleManipulator);
+	InMemorySortedPage page(InMemorySortedPage::buffer_size_for(N * N * N, tupleManipulator), tupleManipulator);
 
 	FreshTuple tuple(page.field_manipulators());
 	for(unsigned int i = 0; i < N; ++i)
@@ -94,6 +96,71 @@ InMemorySortedPage make_small_page()
 
 BOOST_AUTO_TEST_SUITE(InMemorySortedPageTest)
 
+BOOST_AUTO_TEST_CASE(add_tuple)
+{
+	const unsigned int N = 10;
+
+	TupleManipulator tupleManipulator(list_of<const FieldManipulator*>
+		(&IntFieldManipulator::instance())
+		(&IntFieldManipulator::instance())
+		(&IntFieldManipulator::instance())
+	);
+
+	InMemorySortedPage page(InMemorySortedPage::buffer_size_for(N, tupleManipulator), tupleManipulator);
+	BOOST_CHECK_EQUAL(page.max_tuple_count(), N);
+
+	// Add tuples in a scrambled order (including some duplicates), and check that the page is always sorted.
+	FreshTuple tuple(page.field_manipulators());
+	for(unsigned int i = 0; i < N; ++i)
+	{
+		tuple.field(0).set_int((i * 7) % 5);
+		tuple.field(1).set_int(i);
+		tuple.field(2).set_int(0);
+		page.add_tuple(tuple);
+
+		BOOST_CHECK_EQUAL(page.tuple_count(), i + 1);
+		for(InMemorySortedPage::TupleSetCIter it = page.begin(), jt = ++page.begin(), iend = page.end(); jt != iend; ++it, ++jt)
+		{
+			BOOST_CHECK(it->field(0).get_int() <= jt->field(0).get_int());
+		}
+	}
+
+	// Check that equivalent tuples are kept in the order in which they were added.
+	ValueKey key(page.field_manipulators(), list_of(0));
+	key.field(0).set_int(2);
+	InMemorySortedPage::EqualRangeResult result = page.equal_range(key);
+	std::vector<BackedTuple> tuples(result.first, result.second);
+	BOOST_REQUIRE_EQUAL(tuples.size(), 2);
+	check_tuple(tuples[0], 2, 1, 0);
+	check_tuple(tuples[1], 2, 6, 0);
+
+	// Check that adding a tuple to a full page fails.
+	BOOST_CHECK_THROW(page.add_tuple(tuple), std::out_of_range);
+
+	// Check that the tuples can be traversed in reverse order.
+	std::vector<BackedTuple> forward(page.begin(), page.end());
+	std::vector<BackedTuple> reversed(page.rbegin(), page.rend());
+	BOOST_REQUIRE_EQUAL(reversed.size(), N);
+	for(unsigned int i = 0; i < N; ++i)
+	{
+		BOOST_CHECK(reversed[i].location() == forward[N - 1 - i].location());
+	}
+
+	// Check that a dereferenced tuple outlives the (temporary) iterator, and is read-only.
+	const BackedTuple& first = *page.begin();
+	const BackedTuple& last = *page.rbegin();
+	check_tuple(first, 0, 0, 0);
+	check_tuple(last, 4, 7, 0);
+	BOOST_CHECK_THROW(first.field(0).set_int(1), std::logic_error);
+
+	// Erase the first and last tuples via iterators, and check that the remaining tuples are unaffected.
+	page.erase_tuple(page.begin());
+	page.erase_tuple(page.rbegin());
+	BOOST_CHECK_EQUAL(page.tuple_count(), N - 2);
+	check_tuple(*page.begin(), 0, 5, 0);
+	check_tuple(*page.rbegin(), 4, 2, 0);
+}
+
 BOOST_AUTO_TEST_CASE(equal_range_rangekey)
 {
 	InMemorySortedPage page = make_prefix_page();
@@ -222,4 +289,146 @@ BOOST_AUTO_TEST_CASE(erase_tuple)
 	BOOST_CHECK_EQUAL(page.tuple_count(), 4);
 }
 
+BOOST_AUTO_TEST_CASE(erase_tuples)
+{
+	InMemorySortedPage page = make_prefix_page();
+
+	// Erase the tuples whose first field is 1 or 2.
+	RangeKey key(page.field_manipulators(), list_of(0));
+	key.low_kind() = CLOSED;
+	key.low_value().field(0).set_int(1);
+	key.high_kind() = CLOSED;
+	key.high_value().field(0).set_int(2);
+	InMemorySortedPage::EqualRangeResult result = page.equal_range(key);
+	page.erase_tuples(result.first, result.second);
+
+	// Check that the other tuples are still in order, and that their cells were not reused for one another.
+	BOOST_CHECK_EQUAL(page.tuple_count(), 75);
+	std::vector<BackedTuple> tuples(page.begin(), page.end());
+	BOOST_REQUIRE_EQUAL(tuples.size(), 75);
+	check_tuple(tuples[24], 0, 4, 4);
+	check_tuple(tuples[25], 3, 0, 0);
+	check_tuple(tuples[74], 4, 4, 4);
+	BOOST_CHECK(page.equal_range(key).first == page.equal_range(key).second);
+
+	// Check that the freed cells can be reused, and that erasing an empty range has no effect.
+	FreshTuple tuple(page.field_manipulators());
+	tuple.field(0).set_int(2);
+	tuple.field(1).set_int(9);
+	tuple.field(2).set_int(9);
+	for(int i = 0; i < 50; ++i) page.add_tuple(tuple);
+	BOOST_CHECK_THROW(page.add_tuple(tuple), std::out_of_range);
+	check_tuple(*page.rbegin(), 4, 4, 4);
+
+	page.erase_tuples(page.begin(), page.begin());
+	BOOST_CHECK_EQUAL(page.tuple_count(), 125);
+	page.erase_tuples(page.begin(), page.end());
+	BOOST_CHECK_EQUAL(page.tuple_count(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(suffix_truncation)
+{
+	const unsigned int N = 10;
+
+	TupleManipulator tupleManipulator(list_of<const FieldManipulator*>
+		(&IntFieldManipulator::instance())
+		(&IntFieldManipulator::instance())
+		(&IntFieldManipulator::instance())
+		(&IntFieldManipulator::instance())
+	);
+	tupleManipulator.set_uses_suffix_truncation(true);
+
+	InMemorySortedPage page(InMemorySortedPage::buffer_size_for(N, tupleManipulator), tupleManipulator);
+	BOOST_CHECK_EQUAL(page.max_tuple_count(), N);
+
+	// Add tuples with different numbers of key fields (the last field of each one is its "child").
+	FreshTuple short1(tupleManipulator.truncated(1));
+	short1.field(0).set_int(5);
+	short1.field(1).set_int(1);
+	page.add_tuple(short1);
+
+	FreshTuple long3(tupleManipulator);
+	long3.field(0).set_int(5);
+	long3.field(1).set_int(3);
+	long3.field(2).set_int(7);
+	long3.field(3).set_int(3);
+	page.add_tuple(long3);
+
+	FreshTuple short2(tupleManipulator.truncated(2));
+	short2.field(0).set_int(5);
+	short2.field(1).set_int(3);
+	short2.field(2).set_int(2);
+	page.add_tuple(short2);
+
+	short1.field(0).set_int(2);
+	short1.field(1).set_int(4);
+	page.add_tuple(short1);
+
+	// Check that a tuple is ordered by its key fields, with a tuple whose key fields are a prefix of another's first.
+	std::vector<BackedTuple> tuples(page.begin(), page.end());
+	BOOST_REQUIRE_EQUAL(tuples.size(), 4);
+	const int expectedArities[] = { 2, 2, 3, 4 };
+	const int expectedChildren[] = { 4, 1, 2, 3 };
+	for(unsigned int i = 0; i < 4; ++i)
+	{
+		BOOST_CHECK_EQUAL(tuples[i].arity(), expectedArities[i]);
+		BOOST_CHECK_EQUAL(tuples[i].field(tuples[i].arity() - 1).get_int(), expectedChildren[i]);
+	}
+
+	// Check that a search key is ordered after any tuple whose key fields are a proper prefix of it.
+	ValueKey key(page.field_manipulators(), list_of(0)(1)(2));
+	key.field(0).set_int(5);
+	key.field(1).set_int(3);
+	key.field(2).set_int(0);
+	BOOST_CHECK_EQUAL(std::distance(page.begin(), page.lower_bound(key)), 3);
+	key.field(2).set_int(7);
+	BOOST_CHECK_EQUAL(std::distance(page.begin(), page.lower_bound(key)), 3);
+	BOOST_CHECK(page.upper_bound(key) == page.end());
+
+	// Check that erasing a tuple leaves the others unaffected.
+	page.erase_tuple(tuples[2]);
+	tuples.assign(page.begin(), page.end());
+	BOOST_REQUIRE_EQUAL(tuples.size(), 3);
+	BOOST_CHECK_EQUAL(tuples[1].field(1).get_int(), 1);
+	BOOST_CHECK_EQUAL(tuples[2].field(3).get_int(), 3);
+
+	// Check that a page of short tuples holds more than the full-length tuple count for which it was sized, and
+	// that the cells freed by erasing tuples are reused once the remaining ones have been compacted.
+	page.clear();
+	unsigned int count = 0;
+	try
+	{
+		for(;; ++count)
+		{
+			short1.field(0).set_int(count);
+			short1.field(1).set_int(count);
+			page.add_tuple(short1);
+		}
+	}
+	catch(std::out_of_range&) {}
+	BOOST_CHECK_GT(count, N);
+	BOOST_CHECK_EQUAL(page.tuple_count(), count);
+
+	tuples.assign(page.begin(), page.end());
+	for(unsigned int i = 0; i < count / 2; ++i)
+	{
+		page.erase_tuple(tuples[i * 2]);
+	}
+	for(unsigned int i = 0; i < count / 2; ++i)
+	{
+		short1.field(0).set_int(count + i);
+		short1.field(1).set_int(count + i);
+		page.add_tuple(short1);
+	}
+	BOOST_CHECK_THROW(page.add_tuple(short1), std::out_of_range);
+
+	tuples.assign(page.begin(), page.end());
+	BOOST_REQUIRE_EQUAL(tuples.size(), count);
+	for(unsigned int i = 0; i + 1 < count; ++i)
+	{
+		BOOST_CHECK_LT(tuples[i].field(0).get_int(), tuples[i + 1].field(0).get_int());
+		BOOST_CHECK_EQUAL(tuples[i].field(0).get_int(), tuples[i].field(1).get_int());
+	}
+}
+
 BOOST_AUTO_TEST_SUITE_END()
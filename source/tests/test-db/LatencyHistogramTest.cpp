@@ -0,0 +1,87 @@
+/**
+ * test-db: LatencyHistogramTest.cpp
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#include <boost/test/unit_test.hpp>
+
+#include <boost/integer_traits.hpp>
+
+#include "whery/util/LatencyHistogram.h"
+using namespace whery;
+
+#include "Constants.h"
+
+//#################### TESTS ####################
+
+BOOST_AUTO_TEST_SUITE(LatencyHistogramTest)
+
+BOOST_AUTO_TEST_CASE(buckets)
+{
+	// Check that the buckets are contiguous and cover the whole range of a 64-bit integer.
+	BOOST_CHECK_EQUAL(LatencyHistogram::bucket_lowest(0), 0);
+	for(size_t i = 1; i < LatencyHistogram::BUCKET_COUNT; ++i)
+	{
+		BOOST_CHECK_EQUAL(LatencyHistogram::bucket_lowest(i), LatencyHistogram::bucket_highest(i - 1) + 1);
+	}
+	BOOST_CHECK_EQUAL(LatencyHistogram::bucket_highest(LatencyHistogram::BUCKET_COUNT - 1), boost::integer_traits<boost::uint64_t>::const_max);
+
+	// Check that values fall into the right buckets, and that the buckets are no wider than the required precision.
+	const boost::uint64_t values[] = { 0, 1, 15, 16, 17, 31, 32, 33, 1000, 123456789, boost::integer_traits<boost::uint64_t>::const_max };
+	for(size_t i = 0; i < sizeof(values) / sizeof(boost::uint64_t); ++i)
+	{
+		const size_t bucket = LatencyHistogram::bucket_for(values[i]);
+		BOOST_CHECK_LE(LatencyHistogram::bucket_lowest(bucket), values[i]);
+		BOOST_CHECK_GE(LatencyHistogram::bucket_highest(bucket), values[i]);
+		BOOST_CHECK_LE(LatencyHistogram::bucket_highest(bucket) - LatencyHistogram::bucket_lowest(bucket), values[i] / LatencyHistogram::SUB_BUCKET_COUNT);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(percentile)
+{
+	LatencyHistogram h;
+	BOOST_CHECK_EQUAL(h.count(), 0);
+	BOOST_CHECK_EQUAL(h.percentile(50), 0);
+
+	for(boost::uint64_t i = 1; i <= 1000; ++i) h.record(i * 1000);
+
+	BOOST_CHECK_EQUAL(h.count(), 1000);
+	BOOST_CHECK_EQUAL(h.min(), 1000);
+	BOOST_CHECK_EQUAL(h.max(), 1000000);
+	BOOST_CHECK_CLOSE(h.mean(), 500500.0, Constants::SMALL_EPSILON);
+	BOOST_CHECK_LE(h.percentile(0), 1000 + 1000 / LatencyHistogram::SUB_BUCKET_COUNT);
+	BOOST_CHECK_EQUAL(h.percentile(100), 1000000);
+
+	// Check that the percentiles are accurate to within the precision of the buckets.
+	const double ps[] = { 10, 50, 90, 99, 99.9 };
+	for(size_t i = 0; i < sizeof(ps) / sizeof(double); ++i)
+	{
+		const double expected = ps[i] * 10000;
+		BOOST_CHECK_GE(static_cast<double>(h.percentile(ps[i])), expected);
+		BOOST_CHECK_LE(static_cast<double>(h.percentile(ps[i])), expected * (1.0 + 1.0 / LatencyHistogram::SUB_BUCKET_COUNT));
+	}
+
+	BOOST_CHECK_THROW(h.percentile(-1), std::invalid_argument);
+	BOOST_CHECK_THROW(h.percentile(101), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(merge)
+{
+	LatencyHistogram a, b;
+	for(boost::uint64_t i = 0; i < 100; ++i) a.record(i);
+	for(boost::uint64_t i = 100; i < 300; ++i) b.record(i);
+
+	LatencyHistogram empty;
+	a.merge(empty);
+	BOOST_CHECK_EQUAL(a.count(), 100);
+	empty.merge(b);
+	BOOST_CHECK_EQUAL(empty.min(), 100);
+
+	a.merge(b);
+	BOOST_CHECK_EQUAL(a.count(), 300);
+	BOOST_CHECK_EQUAL(a.min(), 0);
+	BOOST_CHECK_EQUAL(a.max(), 299);
+	BOOST_CHECK_CLOSE(a.mean(), 149.5, Constants::SMALL_EPSILON);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,268 @@
+/**
+ * test-db: MappedBTreePageControllerTest.cpp
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#include <boost/test/unit_test.hpp>
+
+#include <fstream>
+
+#include <boost/assign/list_of.hpp>
+#include <boost/filesystem/operations.hpp>
+using namespace boost::assign;
+
+#include "whery/db/base/DoubleFieldManipulator.h"
+#include "whery/db/base/FreshTuple.h"
+#include "whery/db/base/IntFieldManipulator.h"
+#include "whery/db/base/RangeKey.h"
+#include "whery/db/base/ValueKey.h"
+#include "whery/db/btrees/BTree.h"
+#include "whery/db/btrees/MappedBTreePageController.h"
+using namespace whery;
+
+#include "Constants.h"
+
+//#################### HELPER FUNCTIONS ####################
+
+namespace {
+
+/**
+Makes a controller that stores pages for a B+-tree with leaf tuples of the form <tuple ID,x>
+and branch tuples of the form <tuple ID,child node ID> in the specified data file.
+
+\param filename	The name of the data file.
+\return			The controller.
+*/
+MappedBTreePageController_Ptr make_controller(const std::string& filename)
+{
+	const unsigned int PAGE_SIZE = 256;
+
+	TupleManipulator branchTupleManipulator(list_of<const FieldManipulator*>
+		(&IntFieldManipulator::instance())
+		(&IntFieldManipulator::instance())
+	);
+
+	TupleManipulator leafTupleManipulator(list_of<const FieldManipulator*>
+		(&IntFieldManipulator::instance())
+		(&DoubleFieldManipulator::instance())
+	);
+
+	return MappedBTreePageController_Ptr(new MappedBTreePageController(filename, PAGE_SIZE, branchTupleManipulator, leafTupleManipulator));
+}
+
+/**
+Fills a B+-tree with N tuples of the form <i,i/2>, inserted in a scrambled order.
+
+\param tree	The B+-tree.
+\param N	The number of tuples.
+*/
+void fill_tree(BTree& tree, int N)
+{
+	FreshTuple tuple(tree.leaf_tuple_manipulator());
+	for(int i = 0; i < N; ++i)
+	{
+		int tupleID = (i * 7) % N;
+		tuple.field(0).set_int(tupleID);
+		tuple.field(1).set_double(tupleID * 0.5);
+		tree.insert_tuple(tuple);
+	}
+}
+
+/**
+Checks that a B+-tree contains exactly the N tuples of the form <i,i/2>, in order.
+
+\param tree	The B+-tree.
+\param N	The number of tuples.
+*/
+void check_tree(const BTree& tree, int N)
+{
+	BOOST_CHECK_EQUAL(tree.tuple_count(), N);
+
+	int i = 0;
+	for(BTree::ConstIterator it = tree.begin(), iend = tree.end(); it != iend; ++it, ++i)
+	{
+		BOOST_CHECK_EQUAL(it->field(0).get_int(), i);
+		BOOST_CHECK_CLOSE(it->field(1).get_double(), i * 0.5, Constants::SMALL_EPSILON);
+	}
+	BOOST_CHECK_EQUAL(i, N);
+}
+
+}
+
+//#################### TESTS ####################
+
+BOOST_AUTO_TEST_SUITE(MappedBTreePageControllerTest)
+
+BOOST_AUTO_TEST_CASE(insert_erase)
+{
+	const std::string filename = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string();
+
+	{
+		MappedBTreePageController_Ptr controller = make_controller(filename);
+		BTree tree(controller);
+
+		// Check that the controller works out the capacity of its pages correctly.
+		BOOST_CHECK_EQUAL(controller->max_btree_branch_tuple_count(), controller->make_btree_branch_page()->max_tuple_count());
+		BOOST_CHECK_EQUAL(controller->max_btree_leaf_tuple_count(), controller->make_btree_leaf_page()->max_tuple_count());
+
+		// Insert and then erase a number of tuples, and check that the slots of the deleted pages get freed.
+		FreshTuple tuple(tree.leaf_tuple_manipulator());
+		ValueKey key(tree.leaf_tuple_manipulator(), list_of(0));
+		for(int i = 0; i < 200; ++i)
+		{
+			tuple.field(0).set_int(i);
+			tuple.field(1).set_double(i * 0.5);
+			tree.insert_tuple(tuple);
+		}
+		BOOST_CHECK(controller->used_page_count() > 1);
+
+		for(int i = 0; i < 200; ++i)
+		{
+			key.field(0).set_int(i);
+			tree.erase_tuple(key);
+		}
+		BOOST_CHECK_EQUAL(controller->used_page_count(), 1);
+	}
+
+	boost::filesystem::remove(filename);
+}
+
+BOOST_AUTO_TEST_CASE(erase_range)
+{
+	const std::string filename = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string();
+	const int N = 1000, LOW = 100, HIGH = 899;
+
+	{
+		MappedBTreePageController_Ptr controller = make_controller(filename);
+		BTree tree(controller);
+		fill_tree(tree, N);
+		unsigned int usedPageCount = controller->used_page_count();
+
+		// Erase a range of tuples, and check that the slots of the deleted leaves get freed. The erased tuples filled
+		// at least (HIGH - LOW + 1) / maxLeafTupleCount leaves, all of which but the two at the ends must be deleted.
+		RangeKey key(tree.leaf_tuple_manipulator().field_manipulators(), list_of(0));
+		key.low_value().field(0).set_int(LOW);
+		key.high_value().field(0).set_int(HIGH);
+		tree.erase_tuples(key);
+		BOOST_CHECK_EQUAL(tree.tuple_count(), N - (HIGH - LOW + 1));
+
+		const unsigned int deletedLeafCount = (HIGH - LOW + 1) / controller->max_btree_leaf_tuple_count() - 2;
+		BOOST_CHECK(controller->used_page_count() + deletedLeafCount <= usedPageCount);
+	}
+
+	{
+		// Corrupt the checksum in the file header, as if the process had stopped without saving the B+-tree.
+		std::fstream fs(filename.c_str(), std::ios::binary | std::ios::in | std::ios::out);
+		fs.seekp(16 + 9 * sizeof(unsigned int));
+		fs.put('\xFF').put('\xFF');
+	}
+
+	{
+		// Check that only the tuples outside the erased range are recovered.
+		MappedBTreePageController_Ptr controller = make_controller(filename);
+		BTree tree(controller);
+		tree.bulk_load(controller->recover_leaf_pages());
+		BOOST_CHECK_EQUAL(tree.tuple_count(), N - (HIGH - LOW + 1));
+
+		int i = 0;
+		for(BTree::ConstIterator it = tree.begin(), iend = tree.end(); it != iend; ++it, ++i)
+		{
+			if(i == LOW) i = HIGH + 1;
+			BOOST_CHECK_EQUAL(it->field(0).get_int(), i);
+		}
+		BOOST_CHECK_EQUAL(i, N);
+	}
+
+	boost::filesystem::remove(filename);
+}
+
+BOOST_AUTO_TEST_CASE(recover)
+{
+	const std::string filename = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string();
+	const int N = 500;
+
+	{
+		MappedBTreePageController_Ptr controller = make_controller(filename);
+		BTree tree(controller);
+		fill_tree(tree, N);
+	}
+
+	{
+		// Corrupt the checksum in the file header (which follows the page slot header and nine other words),
+		// as if the process had stopped without saving the B+-tree.
+		std::fstream fs(filename.c_str(), std::ios::binary | std::ios::in | std::ios::out);
+		fs.seekp(16 + 9 * sizeof(unsigned int));
+		fs.put('\xFF').put('\xFF');
+	}
+
+	{
+		// Check that the saved structure is ignored, and that the B+-tree can be rebuilt from the leaf pages left in the file.
+		MappedBTreePageController_Ptr controller = make_controller(filename);
+		BTree tree(controller);
+		BOOST_CHECK_EQUAL(tree.tuple_count(), 0);
+		tree.bulk_load(controller->recover_leaf_pages());
+		check_tree(tree, N);
+
+		// Check that the recovered pages have been freed, so that only the rebuilt B+-tree's pages are in use.
+		unsigned int usedPageCount = controller->used_page_count();
+		BOOST_CHECK(controller->recover_leaf_pages().empty());
+		BOOST_CHECK_EQUAL(controller->used_page_count(), usedPageCount);
+	}
+
+	{
+		// Check that the rebuilt B+-tree was itself saved (exactly once).
+		MappedBTreePageController_Ptr controller = make_controller(filename);
+		BTree tree(controller);
+		check_tree(tree, N);
+		BOOST_CHECK(controller->recover_leaf_pages().empty());
+	}
+
+	boost::filesystem::remove(filename);
+}
+
+BOOST_AUTO_TEST_CASE(restart)
+{
+	const std::string filename = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string();
+	const int N = 500;
+
+	unsigned int usedPageCount;
+	{
+		// Build a B+-tree whose pages are stored in the data file.
+		MappedBTreePageController_Ptr controller = make_controller(filename);
+		BTree tree(controller);
+		fill_tree(tree, N);
+		usedPageCount = controller->used_page_count();
+	}
+	boost::uintmax_t fileSize = boost::filesystem::file_size(filename);
+
+	{
+		// Reopen the data file, and check that the B+-tree is reopened in place, without any pages being copied.
+		MappedBTreePageController_Ptr controller = make_controller(filename);
+		BTree tree(controller);
+		check_tree(tree, N);
+		BOOST_CHECK(controller->recover_leaf_pages().empty());
+		BOOST_CHECK_EQUAL(controller->used_page_count(), usedPageCount);
+
+		// Check that the reopened B+-tree can be modified.
+		ValueKey key(tree.leaf_tuple_manipulator(), list_of(0));
+		for(int i = N / 2; i < N; ++i)
+		{
+			key.field(0).set_int(i);
+			tree.erase_tuple(key);
+		}
+		check_tree(tree, N / 2);
+	}
+	BOOST_CHECK_EQUAL(boost::filesystem::file_size(filename), fileSize);
+
+	{
+		// Check that the modifications were saved.
+		MappedBTreePageController_Ptr controller = make_controller(filename);
+		BTree tree(controller);
+		check_tree(tree, N / 2);
+		fill_tree(tree, N / 2);
+	}
+
+	boost::filesystem::remove(filename);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,248 @@
+/**
+ * test-db: NormalizedKeyTest.cpp
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#include <boost/test/unit_test.hpp>
+
+#include <climits>
+#include <cstring>
+
+#include <boost/assign/list_of.hpp>
+#include <boost/uuid/uuid_generators.hpp>
+using namespace boost::assign;
+
+#include "whery/db/base/DoubleFieldManipulator.h"
+#include "whery/db/base/FreshTuple.h"
+#include "whery/db/base/IntFieldManipulator.h"
+#include "whery/db/base/TupleComparator.h"
+#include "whery/db/base/UuidFieldManipulator.h"
+#include "whery/db/base/ValueKey.h"
+#include "whery/db/pages/InMemorySortedPage.h"
+using namespace whery;
+
+#include "Constants.h"
+
+//#################### HELPER FUNCTIONS ####################
+
+namespace {
+
+/**
+Returns the sign of an integer.
+
+\param i	The integer.
+\return		-1, if i is negative; 1, if i is positive; 0, otherwise.
+*/
+int sign(int i)
+{
+	return i < 0 ? -1 : (i > 0 ? 1 : 0);
+}
+
+/**
+Checks that comparing the normalized encodings of every pair of fields in an array (in both
+sort directions) gives the same result as comparing the fields themselves.
+
+\param fields	The fields.
+*/
+void check_normalized_order(const std::vector<Field>& fields)
+{
+	for(size_t i = 0, size = fields.size(); i < size; ++i)
+	{
+		for(size_t j = 0; j < size; ++j)
+		{
+			const unsigned int n = fields[i].normalized_size();
+			BOOST_REQUIRE_EQUAL(fields[j].normalized_size(), n);
+
+			std::vector<char> lhs(n), rhs(n);
+			fields[i].write_normalized(&lhs[0], ASC);
+			fields[j].write_normalized(&rhs[0], ASC);
+			BOOST_CHECK_EQUAL(sign(memcmp(&lhs[0], &rhs[0], n)), fields[i].compare_to(fields[j]));
+
+			fields[i].write_normalized(&lhs[0], DESC);
+			fields[j].write_normalized(&rhs[0], DESC);
+			BOOST_CHECK_EQUAL(sign(memcmp(&lhs[0], &rhs[0], n)), -fields[i].compare_to(fields[j]));
+		}
+	}
+}
+
+}
+
+//#################### TESTS ####################
+
+BOOST_AUTO_TEST_SUITE(NormalizedKeyTest)
+
+BOOST_AUTO_TEST_CASE(double_fields)
+{
+	const double values[] = { -1e300, -23.5, -1.0, -1e-300, -0.0, 0.0, 1e-300, 0.5, 1.0, 9.0, 1e300 };
+	const size_t count = sizeof(values) / sizeof(double);
+
+	const DoubleFieldManipulator& dfm = DoubleFieldManipulator::instance();
+	std::vector<char> buffer(count * dfm.size());
+	std::vector<Field> fields;
+	for(size_t i = 0; i < count; ++i)
+	{
+		fields.push_back(Field(&buffer[i * dfm.size()], dfm));
+		fields.back().set_double(values[i]);
+	}
+
+	check_normalized_order(fields);
+}
+
+BOOST_AUTO_TEST_CASE(int_fields)
+{
+	const int values[] = { INT_MIN, -70000, -256, -1, 0, 1, 255, 256, 70000, INT_MAX };
+	const size_t count = sizeof(values) / sizeof(int);
+
+	const IntFieldManipulator& ifm = IntFieldManipulator::instance();
+	std::vector<char> buffer(count * ifm.size());
+	std::vector<Field> fields;
+	for(size_t i = 0; i < count; ++i)
+	{
+		fields.push_back(Field(&buffer[i * ifm.size()], ifm));
+		fields.back().set_int(values[i]);
+	}
+
+	check_normalized_order(fields);
+}
+
+BOOST_AUTO_TEST_CASE(page_key_prefixes)
+{
+	const unsigned int N = 200;
+
+	// Fill a page that uses key prefixes and one that does not with the same tuples.
+	TupleManipulator tupleManipulator(list_of<const FieldManipulator*>
+		(&IntFieldManipulator::instance())
+		(&DoubleFieldManipulator::instance())
+		(&IntFieldManipulator::instance())
+	);
+	TupleManipulator prefixedTupleManipulator = tupleManipulator;
+	prefixedTupleManipulator.set_uses_key_prefixes(true);
+
+	InMemorySortedPage page(InMemorySortedPage::buffer_size_for(N, tupleManipulator), tupleManipulator);
+	InMemorySortedPage prefixedPage(InMemorySortedPage::buffer_size_for(N, prefixedTupleManipulator), prefixedTupleManipulator);
+	BOOST_CHECK_EQUAL(prefixedPage.max_tuple_count(), N);
+	BOOST_CHECK_GT(prefixedPage.buffer_size(), page.buffer_size());
+
+	FreshTuple tuple(tupleManipulator);
+	for(unsigned int i = 0; i < N; ++i)
+	{
+		tuple.field(0).set_int(static_cast<int>((i * 37) % 20) - 10);
+		tuple.field(1).set_double(((i * 11) % 7) * -0.5);
+		tuple.field(2).set_int(i);
+		page.add_tuple(tuple);
+		prefixedPage.add_tuple(tuple);
+	}
+
+	// Erase some of the tuples, so that the prefixes get shifted about.
+	ValueKey eraseKey(tupleManipulator, list_of(0)(1)(2));
+	for(unsigned int i = 0; i < N; i += 3)
+	{
+		eraseKey.field(0).set_int(static_cast<int>((i * 37) % 20) - 10);
+		eraseKey.field(1).set_double(((i * 11) % 7) * -0.5);
+		eraseKey.field(2).set_int(i);
+		page.erase_tuple(page.find(eraseKey));
+		prefixedPage.erase_tuple(prefixedPage.find(eraseKey));
+	}
+
+	// Erase all the tuples whose first field is 3 in one go.
+	ValueKey rangeEraseKey(tupleManipulator, list_of(0));
+	rangeEraseKey.field(0).set_int(3);
+	SortedPage::EqualRangeResult range = page.equal_range(rangeEraseKey);
+	page.erase_tuples(range.first, range.second);
+	range = prefixedPage.equal_range(rangeEraseKey);
+	prefixedPage.erase_tuples(range.first, range.second);
+	BOOST_REQUIRE_EQUAL(page.tuple_count(), prefixedPage.tuple_count());
+
+	// Check that the pages agree on the results of searching for keys of various arities (including
+	// one whose only field is a double, which must be converted to match the tuples' first field).
+	ValueKey key1(tupleManipulator, list_of(0));
+	ValueKey key2(tupleManipulator, list_of(0)(1));
+	ValueKey doubleKey(list_of<const FieldManipulator*>(&DoubleFieldManipulator::instance()), list_of(0));
+	for(int i = -12; i <= 12; ++i)
+	{
+		key1.field(0).set_int(i);
+		BOOST_CHECK_EQUAL(page.lower_bound(key1).index(), prefixedPage.lower_bound(key1).index());
+		BOOST_CHECK_EQUAL(page.upper_bound(key1).index(), prefixedPage.upper_bound(key1).index());
+
+		for(int j = -4; j <= 1; ++j)
+		{
+			key2.field(0).set_int(i);
+			key2.field(1).set_double(j * 0.5);
+			BOOST_CHECK_EQUAL(page.lower_bound(key2).index(), prefixedPage.lower_bound(key2).index());
+			BOOST_CHECK_EQUAL(page.upper_bound(key2).index(), prefixedPage.upper_bound(key2).index());
+		}
+
+		doubleKey.field(0).set_double(i + 0.5);
+		BOOST_CHECK_EQUAL(page.lower_bound(doubleKey).index(), prefixedPage.lower_bound(doubleKey).index());
+		BOOST_CHECK_EQUAL(page.upper_bound(doubleKey).index(), prefixedPage.upper_bound(doubleKey).index());
+	}
+
+	// Check that the tuples on the prefixed page are still in order.
+	TupleComparator comp = TupleComparator::make_default(3);
+	for(SortedPage::TupleSetCIter it = prefixedPage.begin(), next = it, iend = prefixedPage.end(); it != iend; it = next)
+	{
+		if(++next != iend) BOOST_CHECK_NE(comp.compare(*it, *next), 1);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(tuple_comparator)
+{
+	const unsigned int N = 100;
+
+	TupleManipulator tupleManipulator(list_of<const FieldManipulator*>
+		(&IntFieldManipulator::instance())
+		(&DoubleFieldManipulator::instance())
+		(&UuidFieldManipulator::instance())
+	);
+
+	const UuidFieldManipulator& ufm = UuidFieldManipulator::instance();
+	boost::uuids::random_generator gen;
+	std::vector<char> ubuffer(ufm.size());
+	std::vector<FreshTuple> tuples;
+	for(unsigned int i = 0; i < N; ++i)
+	{
+		FreshTuple tuple(tupleManipulator);
+		tuple.field(0).set_int(static_cast<int>(i % 5) - 2);
+		tuple.field(1).set_double(((i * 7) % 10) * 0.75 - 3.0);
+		ufm.set_uuid(&ubuffer[0], gen());
+		tuple.field(2).set_from(Field(&ubuffer[0], ufm));
+		tuples.push_back(tuple);
+	}
+
+	// Check that comparing the normalized keys of the tuples gives the same results as comparing the tuples.
+	std::vector<std::pair<unsigned int,SortDirection> > fieldIndices = list_of
+		(std::make_pair(1u, DESC))
+		(std::make_pair(0u, ASC))
+		(std::make_pair(2u, DESC));
+	TupleComparator comp(fieldIndices);
+
+	std::vector<std::string> keys;
+	for(unsigned int i = 0; i < N; ++i) keys.push_back(comp.normalized_key(tuples[i]));
+
+	for(unsigned int i = 0; i < N; ++i)
+	{
+		for(unsigned int j = 0; j < N; ++j)
+		{
+			BOOST_CHECK_EQUAL(sign(keys[i].compare(keys[j])), comp.compare(tuples[i], tuples[j]));
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE(uuid_fields)
+{
+	const UuidFieldManipulator& ufm = UuidFieldManipulator::instance();
+	const size_t count = 20;
+
+	boost::uuids::random_generator gen;
+	std::vector<char> buffer(count * ufm.size());
+	std::vector<Field> fields;
+	for(size_t i = 0; i < count; ++i)
+	{
+		fields.push_back(Field(&buffer[i * ufm.size()], ufm));
+		ufm.set_uuid(&buffer[i * ufm.size()], gen());
+	}
+
+	check_normalized_order(fields);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,359 @@
+/**
+ * test-db: PackedSortedPageTest.cpp
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#include <boost/test/unit_test.hpp>
+
+#include <climits>
+
+#include <boost/assign/list_of.hpp>
+using namespace boost::assign;
+
+#include "whery/db/base/DoubleFieldManipulator.h"
+#include "whery/db/base/IntFieldManipulator.h"
+#include "whery/db/base/RangeKey.h"
+#include "whery/db/btrees/BTree.h"
+#include "whery/db/pages/ColumnarSortedPage.h"
+#include "whery/db/pages/PackedSortedPage.h"
+using namespace whery;
+
+#include "TestPageController.h"
+
+//#################### TESTS ####################
+
+BOOST_AUTO_TEST_SUITE(PackedSortedPageTest)
+
+BOOST_AUTO_TEST_CASE(add_tuple)
+{
+	const unsigned int N = 64;
+
+	TupleManipulator tupleManipulator(list_of<const FieldManipulator*>
+		(&IntFieldManipulator::instance())
+		(&DoubleFieldManipulator::instance())
+		(&IntFieldManipulator::instance())
+	);
+
+	// Add tuples with large but closely-spaced keys in a scrambled order (including some duplicates), and check that the page is always sorted.
+	PackedSortedPage page(PackedSortedPage::buffer_size_for(N, tupleManipulator), tupleManipulator);
+	BOOST_CHECK_GE(PackedSortedPage::max_tuple_count_for(page.buffer_size(), tupleManipulator), N);
+	FreshTuple tuple(page.field_manipulators());
+	for(unsigned int i = 0; i < N; ++i)
+	{
+		tuple.field(0).set_int(1000000 + (i * 7) % 32);
+		tuple.field(1).set_double(i * 0.5);
+		tuple.field(2).set_int(i % 4);
+		page.add_tuple(tuple);
+
+		BOOST_CHECK_EQUAL(page.tuple_count(), i + 1);
+		for(PackedSortedPage::TupleSetCIter it = page.begin(), jt = ++page.begin(), iend = page.end(); jt != iend; ++it, ++jt)
+		{
+			BOOST_CHECK(it->field(0).get_int() <= jt->field(0).get_int());
+		}
+	}
+
+	// The keys should be packed into 5 bits each and the third field into 2 bits each, so the page should have room
+	// for many more tuples than it would if every int took 4 bytes (as in a columnar page of the same size).
+	BOOST_CHECK_EQUAL(page.bit_width(0), 5);
+	BOOST_CHECK_EQUAL(page.bit_width(1), 64);
+	BOOST_CHECK_EQUAL(page.bit_width(2), 2);
+	BOOST_CHECK_GT(page.max_tuple_count(), PackedSortedPage::max_tuple_count_for(page.buffer_size(), tupleManipulator) * 3 / 2);
+	BOOST_CHECK_GT(page.max_tuple_count(), ColumnarSortedPage(page.buffer_size(), tupleManipulator).max_tuple_count() * 3 / 2);
+
+	// Check that equivalent tuples are kept in the order in which they were added, and that their rows are reconstructed correctly.
+	ValueKey key(page.field_manipulators(), list_of(0));
+	key.field(0).set_int(1000002);
+	PackedSortedPage::EqualRangeResult result = page.equal_range(key);
+	std::vector<BackedTuple> tuples(result.first, result.second);
+	BOOST_REQUIRE_EQUAL(tuples.size(), 2);
+	BOOST_CHECK_EQUAL(tuples[0].field(1).get_double(), 7.0);
+	BOOST_CHECK_EQUAL(tuples[0].field(2).get_int(), 2);
+	BOOST_CHECK_EQUAL(tuples[1].field(1).get_double(), 23.0);
+	BOOST_CHECK_EQUAL(tuples[1].field(2).get_int(), 2);
+
+	// Keys outside the range of the page's keys should be bounded by the ends of the page.
+	key.field(0).set_int(-5);
+	BOOST_CHECK(page.lower_bound(key) == page.begin());
+	BOOST_CHECK(page.upper_bound(key) == page.begin());
+	key.field(0).set_int(2000000);
+	BOOST_CHECK(page.lower_bound(key) == page.end());
+	BOOST_CHECK(page.find(key) == page.end());
+
+	// Erase the first and last tuples via iterators, and check that the remaining tuples are unaffected.
+	page.erase_tuple(page.begin());
+	page.erase_tuple(page.rbegin());
+	BOOST_CHECK_EQUAL(page.tuple_count(), N - 2);
+	BOOST_CHECK_EQUAL(page.begin()->field(0).get_int(), 1000000);
+	BOOST_CHECK_EQUAL(page.begin()->field(1).get_double(), 16.0);
+	BOOST_CHECK_EQUAL(page.rbegin()->field(0).get_int(), 1000031);
+	BOOST_CHECK_EQUAL(page.rbegin()->field(1).get_double(), 4.5);
+}
+
+BOOST_AUTO_TEST_CASE(capacity)
+{
+	TupleManipulator tupleManipulator(list_of<const FieldManipulator*>
+		(&IntFieldManipulator::instance())
+		(&IntFieldManipulator::instance())
+	);
+
+	const unsigned int N = 16;
+	PackedSortedPage page(PackedSortedPage::buffer_size_for(N, tupleManipulator), tupleManipulator);
+	const unsigned int worstCaseCount = PackedSortedPage::max_tuple_count_for(page.buffer_size(), tupleManipulator);
+	BOOST_CHECK_GE(worstCaseCount, N);
+
+	// Fill the page with tuples whose values span small ranges, which should fit several times as many tuples as the worst case.
+	FreshTuple tuple(page.field_manipulators());
+	for(int i = 0;; ++i)
+	{
+		tuple.field(0).set_int(1000 + i);
+		tuple.field(1).set_int(i % 2);
+		if(!page.has_room_for(tuple)) break;
+		page.add_tuple(tuple);
+	}
+	BOOST_CHECK_GT(page.tuple_count(), worstCaseCount * 3);
+
+	// Check that adding a tuple to a full page fails, and leaves the page unchanged.
+	const unsigned int tupleCount = page.tuple_count();
+	BOOST_CHECK_THROW(page.add_tuple(tuple), std::out_of_range);
+	BOOST_CHECK_EQUAL(page.tuple_count(), tupleCount);
+	BOOST_CHECK_EQUAL(page.rbegin()->field(0).get_int(), 1000 + static_cast<int>(tupleCount) - 1);
+
+	// A tuple would fit once one has been erased, unless its values would widen the columns.
+	BOOST_CHECK(page.has_room_for(*page.begin(), 1));
+	tuple.field(0).set_int(INT_MAX);
+	BOOST_CHECK(!page.has_room_for(tuple, 1));
+
+	// Another packed page should be able to take some of this page's tuples, but not all of them together with its own
+	// if they span a wide range.
+	PackedSortedPage other(page.buffer_size(), tupleManipulator);
+	BOOST_CHECK(other.has_room_for_tuples_from(page, tupleCount));
+	tuple.field(0).set_int(INT_MIN);
+	tuple.field(1).set_int(INT_MAX);
+	other.add_tuple(tuple);
+	BOOST_CHECK(other.has_room_for_tuples_from(page, 1));
+	BOOST_CHECK(!other.has_room_for_tuples_from(page, tupleCount));
+
+	// Values that span the full range of an int should only fit as many tuples as the worst case.
+	page.clear();
+	for(int i = 0;; ++i)
+	{
+		tuple.field(0).set_int(i % 2 == 0 ? INT_MIN + i : INT_MAX - i);
+		tuple.field(1).set_int(i % 2 == 0 ? INT_MIN : INT_MAX);
+		if(!page.has_room_for(tuple)) break;
+		page.add_tuple(tuple);
+	}
+	BOOST_CHECK_EQUAL(page.tuple_count(), worstCaseCount);
+	BOOST_CHECK_EQUAL(page.begin()->field(0).get_int(), INT_MIN);
+	BOOST_CHECK_EQUAL(page.rbegin()->field(0).get_int(), INT_MAX - 1);
+
+	// A buffer too small to hold two tuples whatever their values should be rejected.
+	BOOST_CHECK_THROW(PackedSortedPage(16, tupleManipulator), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(bit_widths)
+{
+	TupleManipulator tupleManipulator(list_of<const FieldManipulator*>
+		(&IntFieldManipulator::instance())
+		(&IntFieldManipulator::instance())
+	);
+
+	PackedSortedPage page(PackedSortedPage::buffer_size_for(8, tupleManipulator), tupleManipulator);
+	BOOST_CHECK_EQUAL(page.bit_width(0), 0);
+	const unsigned int emptyCount = page.max_tuple_count();
+
+	// A page whose values are all equal needs no bits to store them.
+	FreshTuple tuple(page.field_manipulators());
+	tuple.field(0).set_int(7);
+	tuple.field(1).set_int(-3);
+	page.add_tuple(tuple);
+	page.add_tuple(tuple);
+	BOOST_CHECK_EQUAL(page.bit_width(0), 0);
+	BOOST_CHECK_EQUAL(page.max_tuple_count(), emptyCount);
+
+	// Adding a value below the base should move the base down, and adding an extreme value should widen the column.
+	tuple.field(0).set_int(3);
+	tuple.field(1).set_int(INT_MAX);
+	page.add_tuple(tuple);
+	BOOST_CHECK_EQUAL(page.bit_width(0), 3);
+	BOOST_CHECK_EQUAL(page.bit_width(1), 32);
+	BOOST_CHECK_LT(page.max_tuple_count(), emptyCount);
+
+	std::vector<int> values(5);
+	page.read_ints(0, 0, 3, &values[0]);
+	BOOST_CHECK_EQUAL(values[0], 3);
+	BOOST_CHECK_EQUAL(values[2], 7);
+	page.read_ints(1, 0, 3, &values[0]);
+	BOOST_CHECK_EQUAL(values[0], INT_MAX);
+	BOOST_CHECK_EQUAL(values[1], -3);
+
+	// Erasing the extreme tuple should shift the other values down in place, without re-encoding the columns.
+	page.erase_tuple(page.begin());
+	BOOST_CHECK_EQUAL(page.bit_width(1), 32);
+	BOOST_CHECK_EQUAL(page.begin()->field(1).get_int(), -3);
+
+	// The columns should shrink again when a value outside their range makes the page re-encode them.
+	tuple.field(0).set_int(1000);
+	tuple.field(1).set_int(5);
+	page.add_tuple(tuple);
+	BOOST_CHECK_EQUAL(page.bit_width(0), 10);
+	BOOST_CHECK_EQUAL(page.bit_width(1), 4);
+
+	// The range of a re-encoded column should leave room for values a little beyond either end of it, so that they can
+	// be added in place.
+	tuple.field(0).set_int(1010);
+	page.add_tuple(tuple);
+	tuple.field(0).set_int(0);
+	page.add_tuple(tuple);
+	BOOST_CHECK_EQUAL(page.bit_width(0), 10);
+	page.read_ints(0, 0, 5, &values[0]);
+	BOOST_CHECK_EQUAL(values[0], 0);
+	BOOST_CHECK_EQUAL(values[1], 7);
+	BOOST_CHECK_EQUAL(values[3], 1000);
+	BOOST_CHECK_EQUAL(values[4], 1010);
+
+	page.erase_tuples(++page.begin(), page.end());
+	BOOST_CHECK_EQUAL(page.tuple_count(), 1);
+	BOOST_CHECK_EQUAL(page.begin()->field(0).get_int(), 0);
+
+	page.clear();
+	BOOST_CHECK_EQUAL(page.tuple_count(), 0);
+	BOOST_CHECK_EQUAL(page.bit_width(0), 0);
+	BOOST_CHECK_EQUAL(page.max_tuple_count(), emptyCount);
+}
+
+BOOST_AUTO_TEST_CASE(btree_pages)
+{
+	// Use small packed leaf pages (sized to hold 16 tuples whatever their values), for leaf tuples of the form <int,int,double>
+	// and branch tuples of the form <int,child node ID>.
+	BTree tree(BTreePageController_CPtr(new TestPageController(TestPageController::PT_PACKED, 4, 16,
+		TupleManipulator(list_of<const FieldManipulator*>(&IntFieldManipulator::instance())(&IntFieldManipulator::instance())),
+		TupleManipulator(list_of<const FieldManipulator*>(&IntFieldManipulator::instance())(&IntFieldManipulator::instance())(&DoubleFieldManipulator::instance()))
+	)));
+
+	// Insert the tuples <i,i%10,i*0.5> in a scrambled order, and then erase the ones with odd keys.
+	const int N = 500;
+	FreshTuple tuple(tree.leaf_tuple_manipulator());
+	for(int i = 0; i < N; ++i)
+	{
+		const int k = (i * 37) % N;
+		tuple.field(0).set_int(k);
+		tuple.field(1).set_int(k % 10);
+		tuple.field(2).set_double(k * 0.5);
+		tree.insert_tuple(tuple);
+	}
+	BOOST_CHECK_EQUAL(tree.tuple_count(), N);
+
+	// The leaves' ints span small ranges, so the leaves should be able to hold more than 16 tuples each.
+	unsigned int maxLeafSize = 0;
+	BTree::BatchCursor leafCursor(tree.begin(), tree.end());
+	while(leafCursor.next()) maxLeafSize = std::max(maxLeafSize, leafCursor.size());
+	BOOST_CHECK_GT(maxLeafSize, 16);
+
+	ValueKey key(tree.leaf_tuple_manipulator(), list_of(0));
+	for(int i = 1; i < N; i += 2)
+	{
+		key.field(0).set_int(i);
+		tree.erase_tuple(key);
+	}
+	BOOST_CHECK_EQUAL(tree.tuple_count(), N / 2);
+
+	// Check that iterating over the tuples, reading their columns a leaf at a time and looking them up all find the remaining tuples.
+	int expected = 0;
+	for(BTree::ConstIterator it = tree.begin(), iend = tree.end(); it != iend; ++it, expected += 2)
+	{
+		BOOST_CHECK_EQUAL(it->field(0).get_int(), expected);
+		BOOST_CHECK_EQUAL(it->field(1).get_int(), expected % 10);
+		BOOST_CHECK_EQUAL(it->field(2).get_double(), expected * 0.5);
+	}
+	BOOST_CHECK_EQUAL(expected, N);
+
+	expected = 0;
+	std::vector<int> ints;
+	std::vector<double> doubles;
+	BTree::BatchCursor cursor(tree.begin(), tree.end());
+	while(cursor.next())
+	{
+		cursor.read_ints(1, ints);
+		cursor.read_doubles(0, doubles);
+		BOOST_REQUIRE_EQUAL(ints.size(), cursor.size());
+		BOOST_REQUIRE_EQUAL(doubles.size(), cursor.size());
+		for(unsigned int i = 0, size = cursor.size(); i < size; ++i, expected += 2)
+		{
+			BOOST_CHECK_EQUAL(ints[i], expected % 10);
+			BOOST_CHECK_EQUAL(doubles[i], expected);
+		}
+	}
+	BOOST_CHECK_EQUAL(expected, N);
+
+	for(int i = 0; i < N; ++i)
+	{
+		key.field(0).set_int(i);
+		BTree::ConstIterator it = tree.find(key);
+		if(i % 2 == 0)
+		{
+			BOOST_REQUIRE(it != tree.end());
+			BOOST_CHECK_EQUAL(it->field(2).get_double(), i * 0.5);
+		}
+		else BOOST_CHECK(it == tree.end());
+	}
+
+	// Check a range query that uses both fields of the key.
+	RangeKey rangeKey(tree.leaf_tuple_manipulator().field_manipulators(), list_of(0)(1));
+	rangeKey.low_kind() = CLOSED;
+	rangeKey.low_value().field(0).set_int(100);
+	rangeKey.low_value().field(1).set_int(1);
+	rangeKey.high_kind() = OPEN;
+	rangeKey.high_value().field(0).set_int(110);
+	rangeKey.high_value().field(1).set_int(0);
+	BTree::EqualRangeResult result = tree.equal_range(rangeKey);
+	std::vector<BackedTuple> tuples(result.first, result.second);
+	BOOST_REQUIRE_EQUAL(tuples.size(), 4);
+	BOOST_CHECK_EQUAL(tuples[0].field(0).get_int(), 102);
+	BOOST_CHECK_EQUAL(tuples[3].field(0).get_int(), 108);
+}
+
+BOOST_AUTO_TEST_CASE(btree_wide_values)
+{
+	// Use packed leaf pages for leaf tuples of the form <int,int>, whose second fields alternate between narrow and
+	// wide ranges of values, so that inserting a tuple often leaves a leaf without room for it even after splitting.
+	BTree tree(BTreePageController_CPtr(new TestPageController(TestPageController::PT_PACKED, 4, 8,
+		TupleManipulator(list_of<const FieldManipulator*>(&IntFieldManipulator::instance())(&IntFieldManipulator::instance())),
+		TupleManipulator(list_of<const FieldManipulator*>(&IntFieldManipulator::instance())(&IntFieldManipulator::instance()))
+	)));
+
+	const int N = 1000;
+	FreshTuple tuple(tree.leaf_tuple_manipulator());
+	for(int i = 0; i < N; ++i)
+	{
+		const int k = (i * 37) % N;
+		tuple.field(0).set_int(k);
+		tuple.field(1).set_int(k % 50 == 0 ? INT_MIN + k : k % 3);
+		tree.insert_tuple(tuple);
+	}
+	BOOST_CHECK_EQUAL(tree.tuple_count(), N);
+
+	// Erase the tuples in a different scrambled order, checking the remaining ones at intervals.
+	ValueKey key(tree.leaf_tuple_manipulator(), list_of(0));
+	for(int i = 0; i < N; ++i)
+	{
+		if(i % 250 == 0)
+		{
+			int count = 0, prev = -1;
+			for(BTree::ConstIterator it = tree.begin(), iend = tree.end(); it != iend; ++it, ++count)
+			{
+				const int k = it->field(0).get_int();
+				BOOST_CHECK_LT(prev, k);
+				BOOST_CHECK_EQUAL(it->field(1).get_int(), k % 50 == 0 ? INT_MIN + k : k % 3);
+				prev = k;
+			}
+			BOOST_CHECK_EQUAL(count, N - i);
+		}
+
+		key.field(0).set_int((i * 113) % N);
+		tree.erase_tuple(key);
+	}
+	BOOST_CHECK_EQUAL(tree.tuple_count(), 0);
+	BOOST_CHECK(tree.begin() == tree.end());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
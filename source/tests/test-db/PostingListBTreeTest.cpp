@@ -0,0 +1,250 @@
+/**
+ * test-db: PostingListBTreeTest.cpp
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#include <boost/test/unit_test.hpp>
+
+#include <map>
+#include <set>
+
+#include <boost/assign/list_of.hpp>
+using namespace boost::assign;
+
+#include "whery/db/base/DoubleFieldManipulator.h"
+#include "whery/db/base/FreshTuple.h"
+#include "whery/db/base/IntFieldManipulator.h"
+#include "whery/db/btrees/PostingListBTree.h"
+using namespace whery;
+
+#include "TestPageController.h"
+
+//#################### HELPER FUNCTIONS ####################
+
+namespace {
+
+typedef std::map<int,std::set<int> > Entries;
+
+/**
+Checks that a posting list B+-tree contains exactly the expected entries, both by iterating
+over all of them and by looking up the range of entries for each key.
+
+\param index	The posting list B+-tree.
+\param expected	A map from each key to the set of payloads expected for it.
+*/
+void check_contents(const PostingListBTree& index, const Entries& expected)
+{
+	unsigned int count = 0;
+	PostingListBTree::ConstIterator it = index.begin(), iend = index.end();
+	for(Entries::const_iterator kt = expected.begin(), kend = expected.end(); kt != kend; ++kt)
+	{
+		for(std::set<int>::const_iterator pt = kt->second.begin(), pend = kt->second.end(); pt != pend; ++pt, ++it, ++count)
+		{
+			BOOST_REQUIRE(it != iend);
+			BOOST_CHECK_EQUAL((*it).field(0).get_double(), kt->first);
+			BOOST_CHECK_EQUAL((*it).field(1).get_int(), *pt);
+		}
+	}
+	BOOST_CHECK(it == iend);
+	BOOST_CHECK_EQUAL(index.tuple_count(), count);
+
+	ValueKey key(index.tree().leaf_tuple_manipulator(), list_of(0));
+	for(int y = -1; y <= 5; ++y)
+	{
+		key.field(0).set_double(y);
+		PostingListBTree::EqualRangeResult result = index.equal_range(key);
+
+		Entries::const_iterator kt = expected.find(y);
+		std::set<int> payloads;
+		if(kt != expected.end()) payloads = kt->second;
+
+		std::set<int>::const_iterator pt = payloads.begin(), pend = payloads.end();
+		for(PostingListBTree::ConstIterator jt = result.first; jt != result.second; ++jt, ++pt)
+		{
+			BOOST_REQUIRE(pt != pend);
+			BOOST_CHECK_EQUAL(jt.payload(), *pt);
+		}
+		BOOST_CHECK(pt == pend);
+	}
+}
+
+/**
+Makes a page controller that provides small in-memory pages to a B+-tree whose leaf tuples are posting lists of the form
+<y,first payload,data 1,data 2,data 3,payload count> and whose branch tuples are of the form <y,first payload,child node ID>.
+
+\return	The page controller.
+*/
+BTreePageController_CPtr make_page_controller()
+{
+	return BTreePageController_CPtr(new TestPageController(TestPageController::PT_IN_MEMORY, 4, 4,
+		TupleManipulator(list_of<const FieldManipulator*>
+			(&DoubleFieldManipulator::instance())
+			(&IntFieldManipulator::instance())
+			(&IntFieldManipulator::instance())
+		),
+		TupleManipulator(list_of<const FieldManipulator*>
+			(&DoubleFieldManipulator::instance())
+			(&IntFieldManipulator::instance())
+			(&IntFieldManipulator::instance())
+			(&IntFieldManipulator::instance())
+			(&IntFieldManipulator::instance())
+			(&IntFieldManipulator::instance())
+		)
+	));
+}
+
+/**
+Makes a posting list B+-tree around an empty B+-tree that uses small pages.
+
+\return	The posting list B+-tree.
+*/
+PostingListBTree make_index()
+{
+	return PostingListBTree(BTree_Ptr(new BTree(make_page_controller())), 1);
+}
+
+}
+
+//#################### TESTS ####################
+
+BOOST_AUTO_TEST_SUITE(PostingListBTreeTest)
+
+BOOST_AUTO_TEST_CASE(bounds)
+{
+	PostingListBTree index = make_index();
+	FreshTuple entry(list_of<const FieldManipulator*>(&DoubleFieldManipulator::instance())(&IntFieldManipulator::instance()));
+	for(int i = 0; i < 20; ++i)
+	{
+		entry.field(0).set_double(i % 2);
+		entry.field(1).set_int(i);
+		index.insert_tuple(entry);
+	}
+
+	// Look up the bounds of keys that specify a payload as well as the key field.
+	ValueKey key(index.tree().leaf_tuple_manipulator(), list_of(0)(1));
+	key.field(0).set_double(1);
+	key.field(1).set_int(8);
+	BOOST_CHECK_EQUAL(index.lower_bound(key).payload(), 9);
+	BOOST_CHECK_EQUAL(index.upper_bound(key).payload(), 9);
+
+	key.field(1).set_int(9);
+	BOOST_CHECK_EQUAL(index.lower_bound(key).payload(), 9);
+	BOOST_CHECK_EQUAL(index.upper_bound(key).payload(), 11);
+
+	PostingListBTree::EqualRangeResult result = index.equal_range(key);
+	BOOST_CHECK(result.first != result.second);
+	BOOST_CHECK(++result.first == result.second);
+
+	// The bounds of payloads before or after all of those for a key lie at the ends of the key's range.
+	key.field(0).set_double(0);
+	key.field(1).set_int(-5);
+	BOOST_CHECK(index.lower_bound(key) == index.begin());
+	key.field(1).set_int(100);
+	BOOST_CHECK_EQUAL(index.lower_bound(key).payload(), 1);
+	key.field(0).set_double(1);
+	BOOST_CHECK(index.upper_bound(key) == index.end());
+}
+
+BOOST_AUTO_TEST_CASE(constructor)
+{
+	// The leaf tuples must have room for a payload and a payload count after the key fields, both of which must be ints.
+	BTree_Ptr tree(new BTree(make_page_controller()));
+	BOOST_CHECK_THROW(PostingListBTree(tree, 0), std::invalid_argument);
+	BOOST_CHECK_THROW(PostingListBTree(tree, 5), std::invalid_argument);
+
+	PostingListBTree index(tree, 2);
+	BOOST_CHECK_EQUAL(index.tuple_count(), 0);
+
+	// The posting lists are updated in place, which is not supported in concurrent mode.
+	BOOST_CHECK_THROW(PostingListBTree(BTree_Ptr(new BTree(make_page_controller(), true)), 2), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(insert_erase)
+{
+	PostingListBTree index = make_index();
+
+	// Insert entries for a handful of keys in a scattered order, so that posting lists fill up and are split.
+	const int N = 300;
+	Entries expected;
+	FreshTuple entry(list_of<const FieldManipulator*>(&DoubleFieldManipulator::instance())(&IntFieldManipulator::instance()));
+	for(int i = 0; i < N; ++i)
+	{
+		const int payload = (i * 37) % N;
+		entry.field(0).set_double(payload % 5);
+		entry.field(1).set_int(payload);
+		index.insert_tuple(entry);
+		expected[payload % 5].insert(payload);
+	}
+	check_contents(index, expected);
+
+	// Each key should be stored far fewer times than it has entries.
+	BOOST_CHECK_LE(index.tree().tuple_count(), N / 2);
+
+	// Inserting an entry that is already present should have no effect.
+	index.insert_tuple(entry);
+	BOOST_CHECK_EQUAL(index.tuple_count(), N);
+
+	// Erase the entries in a different order, checking the contents every so often.
+	ValueKey key(index.tree().leaf_tuple_manipulator(), list_of(0)(1));
+	for(int i = 0; i < N; ++i)
+	{
+		const int payload = (i * 53) % N;
+		key.field(0).set_double(payload % 5);
+		key.field(1).set_int(payload);
+		index.erase_tuple(key);
+		expected[payload % 5].erase(payload);
+		if(expected[payload % 5].empty()) expected.erase(payload % 5);
+		if(i % 25 == 0) check_contents(index, expected);
+
+		// Erasing an entry that is not there should have no effect.
+		index.erase_tuple(key);
+		BOOST_CHECK_EQUAL(index.tuple_count(), N - i - 1);
+	}
+
+	BOOST_CHECK(index.begin() == index.end());
+	BOOST_CHECK_EQUAL(index.tree().tuple_count(), 0);
+	BOOST_CHECK_THROW(index.erase_tuple(ValueKey(index.tree().leaf_tuple_manipulator(), list_of(0))), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(sequential_payloads)
+{
+	BTree_Ptr tree(new BTree(make_page_controller()));
+	PostingListBTree index(tree, 1);
+
+	// Payloads inserted in ascending order should fill each posting list before starting another. Consecutive
+	// payloads differ by one, which takes a single byte to encode, so each posting list holds 3 * 4 + 1 of them.
+	const int N = 101;
+	FreshTuple entry(list_of<const FieldManipulator*>(&DoubleFieldManipulator::instance())(&IntFieldManipulator::instance()));
+	entry.field(0).set_double(1);
+	for(int i = 0; i < N; ++i)
+	{
+		entry.field(1).set_int(i);
+		index.insert_tuple(entry);
+	}
+
+	BOOST_CHECK_EQUAL(index.tree().tuple_count(), (N + 12) / 13);
+
+	// Payloads that are 1000 apart take two bytes each to encode, so each posting list for them holds 6 + 1 of them.
+	entry.field(0).set_double(2);
+	for(int i = 0; i < N; ++i)
+	{
+		entry.field(1).set_int(i * 1000);
+		index.insert_tuple(entry);
+	}
+
+	BOOST_CHECK_EQUAL(index.tree().tuple_count(), (N + 12) / 13 + (N + 6) / 7);
+
+	Entries expected;
+	for(int i = 0; i < N; ++i)
+	{
+		expected[1].insert(i);
+		expected[2].insert(i * 1000);
+	}
+	check_contents(index, expected);
+
+	// Reopening the index around the same B+-tree should recover the number of entries.
+	PostingListBTree reopened(tree, 1);
+	BOOST_CHECK_EQUAL(reopened.tuple_count(), 2 * N);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
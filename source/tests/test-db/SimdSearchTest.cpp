@@ -0,0 +1,87 @@
+/**
+ * test-db: SimdSearchTest.cpp
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+#include <climits>
+#include <vector>
+
+#include "whery/util/SimdSearch.h"
+using namespace whery;
+
+//#################### HELPER FUNCTIONS ####################
+
+namespace {
+
+/**
+Checks that the SIMD searches of a sorted array, using each of the instruction sets that are
+available on this machine, find the same bounds as std::lower_bound and std::upper_bound for
+every key in the specified range.
+
+\param values	The array.
+\param lowKey	The lowest key for which to check the bounds.
+\param highKey	The highest key for which to check the bounds.
+*/
+template <typename T>
+void check_bounds(const std::vector<T>& values, int lowKey, int highKey)
+{
+	const T *begin = values.empty() ? NULL : &values[0], *end = begin + values.size();
+	const unsigned int count = static_cast<unsigned int>(values.size());
+	for(int level = SIMD_NONE; level <= best_simd_level(); ++level)
+	{
+		for(int k = lowKey; k <= highKey; ++k)
+		{
+			// Check keys between the values as well as keys that are equal to them.
+			for(int half = 0; half < 2; ++half)
+			{
+				const T key = static_cast<T>(k + half * 0.5);
+				BOOST_CHECK_EQUAL(simd_lower_bound(begin, count, key, SimdLevel(level)), std::lower_bound(begin, end, key) - begin);
+				BOOST_CHECK_EQUAL(simd_upper_bound(begin, count, key, SimdLevel(level)), std::upper_bound(begin, end, key) - begin);
+			}
+		}
+	}
+}
+
+}
+
+//#################### TESTS ####################
+
+BOOST_AUTO_TEST_SUITE(SimdSearchTest)
+
+BOOST_AUTO_TEST_CASE(doubles)
+{
+	// Use arrays of various sizes (including ones that are not a multiple of the vector width), with runs of duplicates.
+	for(unsigned int size = 0; size <= 130; size += 13)
+	{
+		std::vector<double> values;
+		for(unsigned int i = 0; i < size; ++i) values.push_back((i / 3) * 2.0 - 10);
+		check_bounds(values, -12, size);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(ints)
+{
+	for(unsigned int size = 0; size <= 130; size += 13)
+	{
+		std::vector<int> values;
+		for(unsigned int i = 0; i < size; ++i) values.push_back(static_cast<int>(i / 3) * 2 - 10);
+		check_bounds(values, -12, size);
+	}
+
+	// Check that the searches cope with the extreme values of the type.
+	std::vector<int> values(40, 0);
+	values.front() = INT_MIN;
+	values.back() = INT_MAX;
+	for(int level = SIMD_NONE; level <= best_simd_level(); ++level)
+	{
+		BOOST_CHECK_EQUAL(simd_lower_bound(&values[0], 40, INT_MIN, SimdLevel(level)), 0);
+		BOOST_CHECK_EQUAL(simd_upper_bound(&values[0], 40, INT_MIN, SimdLevel(level)), 1);
+		BOOST_CHECK_EQUAL(simd_lower_bound(&values[0], 40, INT_MAX, SimdLevel(level)), 39);
+		BOOST_CHECK_EQUAL(simd_upper_bound(&values[0], 40, INT_MAX, SimdLevel(level)), 40);
+	}
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,130 @@
+/**
+ * test-db: TestPageController.h
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#ifndef H_TESTDB_TESTPAGECONTROLLER
+#define H_TESTDB_TESTPAGECONTROLLER
+
+#include "whery/db/btrees/BTreePageController.h"
+#include "whery/db/pages/ColumnarSortedPage.h"
+#include "whery/db/pages/InMemorySortedPage.h"
+#include "whery/db/pages/PackedSortedPage.h"
+
+/**
+\brief An instance of this class provides small in-memory pages of a specified type to a B+-tree whose branch and
+leaf tuples have the specified schemas, so that the tests can easily build B+-trees that have many levels.
+*/
+class TestPageController : public whery::BTreePageController
+{
+	//#################### ENUMERATIONS ####################
+public:
+	/**
+	\brief The values of this enum represent the types of page that the controller can provide.
+	*/
+	enum PageType
+	{
+		/** Columnar pages (see ColumnarSortedPage). */
+		PT_COLUMNAR,
+
+		/** Slotted in-memory pages (see InMemorySortedPage). */
+		PT_IN_MEMORY,
+
+		/** Leaf pages with packed int columns (see PackedSortedPage), with slotted in-memory branch pages. */
+		PT_PACKED
+	};
+
+	//#################### PRIVATE VARIABLES ####################
+private:
+	/** The manipulator for the B+-tree's branch (index) tuples. */
+	whery::TupleManipulator m_branchTupleManipulator;
+
+	/** The manipulator for the B+-tree's leaf (data) tuples. */
+	whery::TupleManipulator m_leafTupleManipulator;
+
+	/** The type of page to provide. */
+	PageType m_pageType;
+
+	/** The number of tuples that should fit on a B+-tree branch page. */
+	unsigned int m_tuplesPerBranch;
+
+	/** The number of tuples that should fit on a B+-tree leaf page. */
+	unsigned int m_tuplesPerLeaf;
+
+	//#################### CONSTRUCTORS ####################
+public:
+	/**
+	Constructs a test page controller.
+
+	\param pageType					The type of page to provide.
+	\param tuplesPerBranch			The number of tuples that should fit on a B+-tree branch page.
+	\param tuplesPerLeaf			The number of tuples that should fit on a B+-tree leaf page (for packed pages,
+									whatever their values: more may fit if their values span small ranges).
+	\param branchTupleManipulator	The manipulator for the B+-tree's branch (index) tuples.
+	\param leafTupleManipulator		The manipulator for the B+-tree's leaf (data) tuples.
+	*/
+	TestPageController(PageType pageType, unsigned int tuplesPerBranch, unsigned int tuplesPerLeaf,
+					   const whery::TupleManipulator& branchTupleManipulator, const whery::TupleManipulator& leafTupleManipulator)
+	:	m_branchTupleManipulator(branchTupleManipulator), m_leafTupleManipulator(leafTupleManipulator),
+		m_pageType(pageType), m_tuplesPerBranch(tuplesPerBranch), m_tuplesPerLeaf(tuplesPerLeaf)
+	{}
+
+	//#################### PUBLIC INHERITED METHODS ####################
+public:
+	virtual whery::TupleManipulator btree_branch_tuple_manipulator() const
+	{
+		return m_branchTupleManipulator;
+	}
+
+	virtual whery::TupleManipulator btree_leaf_tuple_manipulator() const
+	{
+		return m_leafTupleManipulator;
+	}
+
+	virtual whery::SortedPage_Ptr make_btree_branch_page() const
+	{
+		return make_page(m_pageType == PT_PACKED ? PT_IN_MEMORY : m_pageType, m_tuplesPerBranch, m_branchTupleManipulator);
+	}
+
+	virtual whery::SortedPage_Ptr make_btree_leaf_page() const
+	{
+		return make_page(m_pageType, m_tuplesPerLeaf, m_leafTupleManipulator);
+	}
+
+	virtual unsigned int max_btree_leaf_tuple_count() const
+	{
+		// An empty packed page can hold far more tuples than it can if their values span large ranges.
+		if(m_pageType == PT_PACKED)
+		{
+			using whery::PackedSortedPage;
+			return PackedSortedPage::max_tuple_count_for(PackedSortedPage::buffer_size_for(m_tuplesPerLeaf, m_leafTupleManipulator), m_leafTupleManipulator);
+		}
+		else return BTreePageController::max_btree_leaf_tuple_count();
+	}
+
+	//#################### PRIVATE METHODS ####################
+private:
+	/**
+	Makes a page of the specified type.
+
+	\param pageType			The type of page to make.
+	\param maxTupleCount	The number of tuples that should fit on the page.
+	\param tupleManipulator	The manipulator to be used to interact with tuples on the page.
+	\return					The page.
+	*/
+	static whery::SortedPage_Ptr make_page(PageType pageType, unsigned int maxTupleCount, const whery::TupleManipulator& tupleManipulator)
+	{
+		using namespace whery;
+		switch(pageType)
+		{
+			case PT_COLUMNAR:
+				return SortedPage_Ptr(new ColumnarSortedPage(ColumnarSortedPage::buffer_size_for(maxTupleCount, tupleManipulator), tupleManipulator));
+			case PT_PACKED:
+				return SortedPage_Ptr(new PackedSortedPage(PackedSortedPage::buffer_size_for(maxTupleCount, tupleManipulator), tupleManipulator));
+			default:
+				return SortedPage_Ptr(new InMemorySortedPage(InMemorySortedPage::buffer_size_for(maxTupleCount, tupleManipulator), tupleManipulator));
+		}
+	}
+};
+
+#endif
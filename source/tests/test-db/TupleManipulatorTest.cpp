@@ -39,4 +39,60 @@ BOOST_AUTO_TEST_CASE(field)
 	BOOST_CHECK_CLOSE(tupleManipulator.field(loc, 1).get_double(), 9.0, Constants::SMALL_EPSILON);
 }
 
+BOOST_AUTO_TEST_CASE(schema_sharing)
+{
+	std::vector<const FieldManipulator*> fieldManipulators = list_of<const FieldManipulator*>
+		(&IntFieldManipulator::instance())
+		(&DoubleFieldManipulator::instance());
+	TupleManipulator tupleManipulator(fieldManipulators);
+
+	// Check that tuple manipulators for the same signature share their schema (and hence their field manipulators).
+	TupleManipulator other(list_of<const FieldManipulator*>(&IntFieldManipulator::instance())(&DoubleFieldManipulator::instance()));
+	BOOST_CHECK_EQUAL(&tupleManipulator.field_manipulators(), &other.field_manipulators());
+
+	TupleManipulator projected(list_of<const FieldManipulator*>(&DoubleFieldManipulator::instance())(&IntFieldManipulator::instance()), list_of(1)(0));
+	BOOST_CHECK_EQUAL(&tupleManipulator.field_manipulators(), &projected.field_manipulators());
+
+	// Check that a projection onto a prefix of the fields does not share the schema of the full tuple.
+	TupleManipulator prefix(fieldManipulators, list_of(0));
+	BOOST_CHECK_EQUAL(prefix.arity(), 1);
+	BOOST_CHECK(&prefix.field_manipulators() != &tupleManipulator.field_manipulators());
+
+	// Check that changing whether or not a tuple manipulator uses key prefixes does not affect any copies of it.
+	TupleManipulator copy = tupleManipulator;
+	copy.set_uses_key_prefixes(true);
+	BOOST_CHECK(copy.uses_key_prefixes());
+	BOOST_CHECK(!tupleManipulator.uses_key_prefixes());
+	BOOST_CHECK(copy.field_manipulators() == tupleManipulator.field_manipulators());
+	BOOST_CHECK_EQUAL(copy.size(), tupleManipulator.size());
+
+	// Check that the same holds for whether or not a tuple manipulator uses suffix truncation.
+	copy = tupleManipulator;
+	copy.set_uses_suffix_truncation(true);
+	BOOST_CHECK(copy.uses_suffix_truncation());
+	BOOST_CHECK(!tupleManipulator.uses_suffix_truncation());
+	BOOST_CHECK(copy.field_manipulators() == tupleManipulator.field_manipulators());
+
+	// Check that a tuple manipulator is no bigger than a pointer to its schema.
+	BOOST_CHECK_EQUAL(sizeof(TupleManipulator), sizeof(void*));
+}
+
+BOOST_AUTO_TEST_CASE(truncated)
+{
+	TupleManipulator tupleManipulator(list_of<const FieldManipulator*>
+		(&DoubleFieldManipulator::instance())
+		(&DoubleFieldManipulator::instance())
+		(&IntFieldManipulator::instance()));
+
+	// Check that keeping every key field yields the manipulator itself.
+	BOOST_CHECK_EQUAL(&tupleManipulator.truncated(2).field_manipulators(), &tupleManipulator.field_manipulators());
+
+	// Check that keeping fewer key fields yields a smaller tuple that keeps the last field.
+	TupleManipulator truncated = tupleManipulator.truncated(1);
+	BOOST_CHECK_EQUAL(truncated.arity(), 2);
+	BOOST_CHECK(truncated.field_manipulators()[0] == &DoubleFieldManipulator::instance());
+	BOOST_CHECK(truncated.field_manipulators()[1] == &IntFieldManipulator::instance());
+	BOOST_CHECK_LT(truncated.size(), tupleManipulator.size());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
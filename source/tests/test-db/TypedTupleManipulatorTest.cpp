@@ -0,0 +1,172 @@
+/**
+ * test-db: TypedTupleManipulatorTest.cpp
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#include <boost/test/unit_test.hpp>
+
+#include <boost/assign/list_of.hpp>
+using namespace boost::assign;
+
+#include "whery/db/base/FreshTuple.h"
+#include "whery/db/base/TypedTupleManipulator.h"
+#include "whery/db/base/ValueKey.h"
+#include "whery/db/btrees/BTree.h"
+#include "whery/db/btrees/BufferedBTreePageController.h"
+#include "whery/db/buffers/InMemoryPageStore.h"
+#include "whery/db/buffers/LRUEvictionPolicy.h"
+#include "whery/db/pages/InMemorySortedPage.h"
+using namespace whery;
+
+#include "Constants.h"
+
+//#################### HELPER FUNCTIONS ####################
+
+namespace {
+
+/**
+Checks that the layout calculated at compile time by a typed tuple manipulator
+matches the one calculated at runtime for the same field manipulators.
+
+\param typedTupleManipulator	The typed tuple manipulator.
+\param offsets					The compile-time field offsets of the typed tuple manipulator.
+*/
+void check_layout(const TupleManipulator& typedTupleManipulator, const std::vector<unsigned int>& offsets)
+{
+	TupleManipulator tupleManipulator(typedTupleManipulator.field_manipulators());
+	BOOST_CHECK_EQUAL(typedTupleManipulator.size(), tupleManipulator.size());
+
+	// Fill a buffer with distinct bytes, and check that reading each field at its compile-time offset
+	// yields the same value as reading it via the ordinary tuple manipulator.
+	std::vector<char> buffer(tupleManipulator.size());
+	for(size_t i = 0, size = buffer.size(); i < size; ++i) buffer[i] = static_cast<char>(i + 1);
+	char *loc = &buffer[0];
+
+	const std::vector<const FieldManipulator*>& fieldManipulators = tupleManipulator.field_manipulators();
+	for(unsigned int i = 0, arity = tupleManipulator.arity(); i < arity; ++i)
+	{
+		BOOST_CHECK_EQUAL(fieldManipulators[i]->get_string(loc + offsets[i]), tupleManipulator.field(loc, i).get_string());
+	}
+}
+
+}
+
+//#################### TESTS ####################
+
+BOOST_AUTO_TEST_SUITE(TypedTupleManipulatorTest)
+
+BOOST_AUTO_TEST_CASE(btree)
+{
+	typedef TypedTupleManipulator<int,int> BranchTupleManipulator;
+	typedef TypedTupleManipulator<int,double> LeafTupleManipulator;
+
+	BufferPool_Ptr pool(new BufferPool(PageStore_Ptr(new InMemoryPageStore(256)), EvictionPolicy_Ptr(new LRUEvictionPolicy), 64 * 256));
+	BTree tree(BTreePageController_CPtr(new BufferedBTreePageController(pool, BranchTupleManipulator(), LeafTupleManipulator())));
+
+	const int N = 500;
+	FreshTuple tuple(tree.leaf_tuple_manipulator());
+	for(int i = 0; i < N; ++i)
+	{
+		int tupleID = (i * 7) % N;
+		tuple.field(0).set_int(tupleID);
+		tuple.field(1).set_double(tupleID * 0.5);
+		tree.insert_tuple(tuple);
+	}
+
+	int i = 0;
+	for(BTree::ConstIterator it = tree.begin(), iend = tree.end(); it != iend; ++it, ++i)
+	{
+		BOOST_CHECK_EQUAL(it->field(0).get_int(), i);
+	}
+	BOOST_CHECK_EQUAL(i, N);
+
+	ValueKey key(tree.leaf_tuple_manipulator(), list_of(0));
+	for(int i = 0; i < N; i += 10)
+	{
+		key.field(0).set_int(i);
+		BTree::EqualRangeResult result = tree.equal_range(key);
+		BOOST_REQUIRE(result.first != result.second);
+		BOOST_CHECK_CLOSE(result.first->field(1).get_double(), i * 0.5, Constants::SMALL_EPSILON);
+		BOOST_CHECK(++result.first == result.second);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(compare)
+{
+	typedef TypedTupleManipulator<int,double> TM;
+	TM tupleManipulator;
+
+	std::vector<char> lhsBuffer(tupleManipulator.size()), rhsBuffer(tupleManipulator.size());
+	char *lhs = &lhsBuffer[0], *rhs = &rhsBuffer[0];
+	tupleManipulator.field(lhs, 0).set_int(23);
+	tupleManipulator.field(lhs, 1).set_double(9.0);
+	tupleManipulator.field(rhs, 0).set_int(23);
+	tupleManipulator.field(rhs, 1).set_double(10.0);
+
+	BOOST_CHECK_EQUAL(TM::compare(lhs, rhs, 1), 0);
+	BOOST_CHECK_EQUAL(TM::compare(lhs, rhs, 2), -1);
+	BOOST_CHECK_EQUAL(TM::compare(rhs, lhs, 2), 1);
+	BOOST_CHECK(tupleManipulator.layout_comparator() == &TM::compare);
+
+	// Check that a copy of the manipulator (e.g. one stored by a page) retains the layout comparator.
+	TupleManipulator copy = tupleManipulator;
+	BOOST_CHECK(copy.layout_comparator() == &TM::compare);
+	BOOST_CHECK(TupleManipulator(copy.field_manipulators()).layout_comparator() == NULL);
+}
+
+BOOST_AUTO_TEST_CASE(layout)
+{
+	typedef TypedTupleManipulator<int,double,int> TM1;
+	BOOST_CHECK_EQUAL(TM1::ARITY, 3);
+	check_layout(TM1(), list_of(TM1::OFFSET0)(TM1::OFFSET1)(TM1::OFFSET2));
+
+	typedef TypedTupleManipulator<int,boost::uuids::uuid,double,int> TM2;
+	BOOST_CHECK_EQUAL(TM2::ARITY, 4);
+	check_layout(TM2(), list_of(TM2::OFFSET0)(TM2::OFFSET1)(TM2::OFFSET2)(TM2::OFFSET3));
+
+	typedef TypedTupleManipulator<double> TM3;
+	BOOST_CHECK_EQUAL(TM3::ARITY, 1);
+	check_layout(TM3(), list_of(TM3::OFFSET0));
+}
+
+BOOST_AUTO_TEST_CASE(page_search)
+{
+	const unsigned int N = 100;
+
+	// Fill a page that uses an ordinary tuple manipulator and one that uses a typed one with the same tuples.
+	TypedTupleManipulator<double,int> typedTupleManipulator;
+	TupleManipulator tupleManipulator(typedTupleManipulator.field_manipulators());
+	InMemorySortedPage page(InMemorySortedPage::buffer_size_for(N, tupleManipulator), tupleManipulator);
+	InMemorySortedPage typedPage(InMemorySortedPage::buffer_size_for(N, typedTupleManipulator), typedTupleManipulator);
+
+	FreshTuple tuple(tupleManipulator);
+	for(unsigned int i = 0; i < N; ++i)
+	{
+		tuple.field(0).set_double(((i * 37) % N) * 0.25);
+		tuple.field(1).set_int(i % 3);
+		page.add_tuple(tuple);
+		typedPage.add_tuple(tuple);
+	}
+
+	// Check that the pages agree on the results of searching for both full and prefix keys. Note
+	// that the prefix key has an int field, which must be converted to match the tuples' double field.
+	ValueKey key(tupleManipulator, list_of(0)(1));
+	ValueKey prefixKey(list_of<const FieldManipulator*>(&IntFieldManipulator::instance()), list_of(0));
+	for(int i = -1; i <= static_cast<int>(N) / 4 + 1; ++i)
+	{
+		for(int j = 0; j < 3; ++j)
+		{
+			key.field(0).set_double(i + j * 0.5);
+			key.field(1).set_int(j);
+			BOOST_CHECK_EQUAL(page.lower_bound(key).index(), typedPage.lower_bound(key).index());
+			BOOST_CHECK_EQUAL(page.upper_bound(key).index(), typedPage.upper_bound(key).index());
+			BOOST_CHECK_EQUAL(page.find(key) == page.end(), typedPage.find(key) == typedPage.end());
+		}
+
+		prefixKey.field(0).set_int(i);
+		BOOST_CHECK_EQUAL(page.lower_bound(prefixKey).index(), typedPage.lower_bound(prefixKey).index());
+		BOOST_CHECK_EQUAL(page.upper_bound(prefixKey).index(), typedPage.upper_bound(prefixKey).index());
+	}
+}
+
+BOOST_AUTO_TEST_SUITE_END()
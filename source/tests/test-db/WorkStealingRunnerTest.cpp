@@ -0,0 +1,92 @@
+/**
+ * test-db: WorkStealingRunnerTest.cpp
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#include <boost/test/unit_test.hpp>
+
+#include <stdexcept>
+#include <vector>
+
+#include <boost/atomic.hpp>
+#include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include "whery/util/WorkStealingRunner.h"
+using namespace whery;
+
+//#################### HELPER FUNCTIONS ####################
+
+namespace {
+
+/**
+Counts a run of a task.
+
+\param count	The number of times the task has been run.
+\param work		The number of iterations of busy work to do (so that some tasks take longer than others).
+*/
+void count_run(boost::atomic<int>& count, int work)
+{
+	volatile int sink = 0;
+	for(int i = 0; i < work; ++i) sink += i;
+	++count;
+}
+
+/**
+Throws an exception.
+*/
+void fail()
+{
+	throw std::runtime_error("Failed");
+}
+
+}
+
+//#################### TESTS ####################
+
+BOOST_AUTO_TEST_SUITE(WorkStealingRunnerTest)
+
+BOOST_AUTO_TEST_CASE(run)
+{
+	BOOST_CHECK_THROW(WorkStealingRunner(0), std::invalid_argument);
+
+	const int N = 1000;
+	const unsigned int threadCounts[] = { 1, 4, 2000 };
+	for(size_t i = 0; i < sizeof(threadCounts) / sizeof(unsigned int); ++i)
+	{
+		WorkStealingRunner runner(threadCounts[i]);
+		BOOST_CHECK_EQUAL(runner.thread_count(), threadCounts[i]);
+
+		// Make the tasks at the start of the batch much slower than the others, so that most of them have to be stolen.
+		std::vector<boost::shared_ptr<boost::atomic<int> > > counts;
+		std::vector<WorkStealingRunner::Task> tasks;
+		for(int j = 0; j < N; ++j)
+		{
+			counts.push_back(boost::shared_ptr<boost::atomic<int> >(new boost::atomic<int>(0)));
+			tasks.push_back(boost::bind(&count_run, boost::ref(*counts.back()), j < N / 4 ? 10000 : 0));
+		}
+		runner.run(tasks);
+
+		// Check that each task was run exactly once.
+		for(int j = 0; j < N; ++j)
+		{
+			BOOST_CHECK_EQUAL(counts[j]->load(), 1);
+		}
+	}
+
+	// Running an empty batch should do nothing.
+	WorkStealingRunner(4).run(std::vector<WorkStealingRunner::Task>());
+}
+
+BOOST_AUTO_TEST_CASE(run_failing)
+{
+	boost::atomic<int> count(0);
+	std::vector<WorkStealingRunner::Task> tasks(10, boost::bind(&count_run, boost::ref(count), 0));
+	tasks.push_back(&fail);
+
+	// The exception thrown by the failing task should be rethrown once the batch has finished.
+	BOOST_CHECK_THROW(WorkStealingRunner(3).run(tasks), std::runtime_error);
+	BOOST_CHECK_LE(count.load(), 10);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,231 @@
+/**
+ * test-db: WriteAheadLogTest.cpp
+ * Copyright Stuart Golodetz, 2013. All rights reserved.
+ */
+
+#include <boost/test/unit_test.hpp>
+
+#include <string>
+
+#include <boost/filesystem/operations.hpp>
+
+#include "whery/db/wal/WriteAheadLog.h"
+using namespace whery;
+
+//#################### HELPER FUNCTIONS ####################
+
+namespace {
+
+/**
+Appends a record whose payload is the specified string to a log.
+
+\param log		The log.
+\param type		The type of the record.
+\param payload	The payload.
+\return			The LSN of the record.
+*/
+WriteAheadLog::LSN append_string(WriteAheadLog& log, unsigned char type, const std::string& payload)
+{
+	return log.append(type, payload.data(), payload.size());
+}
+
+/**
+Gets the payload of a log record as a string.
+
+\param record	The log record.
+\return			The payload of the record.
+*/
+std::string payload_of(const WriteAheadLog::Record& record)
+{
+	return std::string(record.payload.begin(), record.payload.end());
+}
+
+}
+
+//#################### TESTS ####################
+
+BOOST_AUTO_TEST_SUITE(WriteAheadLogTest)
+
+BOOST_AUTO_TEST_CASE(append_commit_reopen)
+{
+	const std::string filename = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string();
+
+	{
+		WriteAheadLog log(filename);
+		BOOST_CHECK_EQUAL(append_string(log, 1, "Wibble"), 1);
+		BOOST_CHECK_EQUAL(append_string(log, 2, ""), 2);
+		WriteAheadLog::LSN lsn = append_string(log, 3, "Foo");
+		BOOST_CHECK_EQUAL(lsn, 3);
+		BOOST_CHECK_EQUAL(log.durable_lsn(), 0);
+
+		log.commit(lsn);
+		BOOST_CHECK_EQUAL(log.durable_lsn(), 3);
+		BOOST_CHECK_EQUAL(log.sync_count(), 1);
+
+		// Committing records that are already durable should not sync the log again.
+		log.commit(2);
+		BOOST_CHECK_EQUAL(log.sync_count(), 1);
+
+		BOOST_CHECK_THROW(log.commit(4), std::invalid_argument);
+	}
+
+	{
+		WriteAheadLog log(filename);
+		BOOST_CHECK_EQUAL(log.last_lsn(), 3);
+
+		std::vector<WriteAheadLog::Record> records = log.read_records();
+		BOOST_REQUIRE_EQUAL(records.size(), 3);
+		BOOST_CHECK_EQUAL(records[0].lsn, 1);
+		BOOST_CHECK_EQUAL(records[0].type, 1);
+		BOOST_CHECK_EQUAL(payload_of(records[0]), "Wibble");
+		BOOST_CHECK_EQUAL(records[1].lsn, 2);
+		BOOST_CHECK(records[1].payload.empty());
+		BOOST_CHECK_EQUAL(payload_of(records[2]), "Foo");
+
+		// Records appended after reopening should carry on from where the log left off.
+		BOOST_CHECK_EQUAL(append_string(log, 1, "Bar"), 4);
+	}
+
+	boost::filesystem::remove(filename);
+}
+
+BOOST_AUTO_TEST_CASE(discard_through)
+{
+	const std::string filename = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string();
+
+	{
+		WriteAheadLog log(filename);
+		for(int i = 0; i < 5; ++i) append_string(log, 1, "Wibble");
+		log.commit(5);
+		append_string(log, 1, "Wibble");
+
+		// Only records that are durable can be discarded.
+		BOOST_CHECK_THROW(log.discard_through(6), std::invalid_argument);
+
+		// Discarding the first few records should keep the later ones, including those that have not yet been written.
+		log.discard_through(2);
+		append_string(log, 2, "Foo");
+		log.sync();
+
+		std::vector<WriteAheadLog::Record> records = log.read_records();
+		BOOST_REQUIRE_EQUAL(records.size(), 5);
+		BOOST_CHECK_EQUAL(records[0].lsn, 3);
+		BOOST_CHECK_EQUAL(records[4].lsn, 7);
+		BOOST_CHECK_EQUAL(payload_of(records[4]), "Foo");
+
+		log.discard_through(7);
+		BOOST_CHECK(log.read_records().empty());
+	}
+
+	{
+		// The LSNs of the discarded records must not be reused, even after reopening the log.
+		WriteAheadLog log(filename);
+		BOOST_CHECK_EQUAL(log.last_lsn(), 7);
+		BOOST_CHECK(log.read_records().empty());
+		BOOST_CHECK(!boost::filesystem::exists(filename + ".tmp"));
+	}
+
+	boost::filesystem::remove(filename);
+}
+
+BOOST_AUTO_TEST_CASE(group_commit)
+{
+	const std::string filename = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string();
+
+	{
+		BOOST_CHECK_THROW(WriteAheadLog(filename, 0), std::invalid_argument);
+
+		WriteAheadLog log(filename, 3);
+		for(int i = 0; i < 9; ++i)
+		{
+			log.commit(append_string(log, 1, "Wibble"));
+		}
+		BOOST_CHECK_EQUAL(log.sync_count(), 3);
+		BOOST_CHECK_EQUAL(log.durable_lsn(), 9);
+
+		// Only one commit out of each group of three should sync the log.
+		log.commit(append_string(log, 1, "Foo"));
+		BOOST_CHECK_EQUAL(log.durable_lsn(), 9);
+
+		log.sync();
+		BOOST_CHECK_EQUAL(log.sync_count(), 4);
+		BOOST_CHECK_EQUAL(log.durable_lsn(), 10);
+	}
+
+	boost::filesystem::remove(filename);
+}
+
+BOOST_AUTO_TEST_CASE(reset)
+{
+	const std::string filename = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string();
+
+	{
+		WriteAheadLog log(filename);
+		for(int i = 0; i < 5; ++i) append_string(log, 1, "Wibble");
+		log.sync();
+		log.reset();
+		BOOST_CHECK(log.read_records().empty());
+
+		log.commit(append_string(log, 1, "Foo"));
+	}
+
+	{
+		// The LSNs of the discarded records must not be reused, even after reopening the log.
+		WriteAheadLog log(filename);
+		BOOST_CHECK_EQUAL(log.last_lsn(), 6);
+
+		std::vector<WriteAheadLog::Record> records = log.read_records();
+		BOOST_REQUIRE_EQUAL(records.size(), 1);
+		BOOST_CHECK_EQUAL(records[0].lsn, 6);
+		BOOST_CHECK_EQUAL(payload_of(records[0]), "Foo");
+
+		log.reset();
+	}
+
+	{
+		WriteAheadLog log(filename);
+		BOOST_CHECK_EQUAL(log.last_lsn(), 6);
+		BOOST_CHECK(log.read_records().empty());
+	}
+
+	boost::filesystem::remove(filename);
+}
+
+BOOST_AUTO_TEST_CASE(torn_tail)
+{
+	const std::string filename = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string();
+
+	boost::uintmax_t intactSize;
+	{
+		WriteAheadLog log(filename);
+		append_string(log, 1, "Wibble");
+		log.commit(append_string(log, 1, "Foo"));
+		intactSize = boost::filesystem::file_size(filename);
+		log.commit(append_string(log, 1, "Bar"));
+	}
+
+	// Simulate a crash in the middle of writing the last record.
+	boost::filesystem::resize_file(filename, boost::filesystem::file_size(filename) - 1);
+
+	{
+		WriteAheadLog log(filename);
+		BOOST_CHECK_EQUAL(log.last_lsn(), 2);
+		BOOST_CHECK_EQUAL(log.read_records().size(), 2);
+		BOOST_CHECK_EQUAL(boost::filesystem::file_size(filename), intactSize);
+
+		// The torn record's LSN should be reused, since it never became durable.
+		log.commit(append_string(log, 1, "Baz"));
+	}
+
+	{
+		WriteAheadLog log(filename);
+		std::vector<WriteAheadLog::Record> records = log.read_records();
+		BOOST_REQUIRE_EQUAL(records.size(), 3);
+		BOOST_CHECK_EQUAL(records[2].lsn, 3);
+		BOOST_CHECK_EQUAL(payload_of(records[2]), "Baz");
+	}
+
+	boost::filesystem::remove(filename);
+}
+
+BOOST_AUTO_TEST_SUITE_END()